@@ -0,0 +1,50 @@
+# qmake .pro file for qdirstat/bench: qdirstat-bench, reproducible
+# benchmarks for reading directories, the cache files, the statistics, the
+# treemap and the tree view model.
+#
+# The treemap needs most of the GUI classes, so this simply links all of
+# qdirstat except its main.cpp. This is not installed; run it from the
+# build directory:
+#
+#     QT_QPA_PLATFORM=offscreen bench/qdirstat-bench -o results.json
+
+TEMPLATE	 = app
+
+QT		+= widgets
+CONFIG		+= debug console
+CONFIG		-= app_bundle
+DEPENDPATH	+= . ../src
+INCLUDEPATH	+= ../src
+MOC_DIR		 = .moc
+OBJECTS_DIR	 = .obj
+UI_DIR		 = .ui
+LIBS		+= -lz
+
+# The same as in src/src.pro
+
+exists( /usr/include/linux/io_uring.h ):DEFINES += HAVE_IO_URING
+exists( /usr/include/zstd.h ) {
+    DEFINES += HAVE_ZSTD
+    LIBS    += -lzstd
+}
+
+# For checking the tree view model (needs Qt 5.11 or later)
+
+qtHaveModule( testlib ) {
+    QT      += testlib
+    DEFINES += HAVE_MODEL_TESTER
+}
+
+equals(QT_MAJOR_VERSION, 5):greaterThan(QT_MINOR_VERSION, 5):contains(QT_CONFIG, opengl):DEFINES += HAVE_TREEMAP_GL
+
+major_is_less_5 = $$find(QT_MAJOR_VERSION, [234])
+!isEmpty(major_is_less_5):DEFINES += 'Q_DECL_OVERRIDE=""'
+
+TARGET		 = qdirstat-bench
+
+SOURCES		 = main.cpp $$files( ../src/*.cpp )
+SOURCES		-= ../src/main.cpp
+HEADERS		 = $$files( ../src/*.h )
+FORMS		 = $$files( ../src/*.ui )
+FORMS		-= ../src/general-config-page.ui
+RESOURCES	 = ../src/icons.qrc
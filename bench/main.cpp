@@ -0,0 +1,1561 @@
+/*
+ *   File name: main.cpp
+ *   Summary:	qdirstat-bench main program: Reproducible benchmarks
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <unistd.h>	// getopt(), ftruncate()
+#include <stdlib.h>	// atoi()
+#include <fcntl.h>	// open()
+#include <sys/stat.h>	// mkdir()
+#include <algorithm>	// std::sort()
+#include <iostream>	// cerr
+#include <zlib.h>	// gzopen()
+
+#include <QApplication>
+#include <QEventLoop>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QTextStream>
+#include <QStringList>
+#include <QThread>
+#include <QHash>
+#include <QItemSelection>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+
+#if defined( HAVE_MODEL_TESTER ) && QT_VERSION >= QT_VERSION_CHECK( 5, 11, 0 )
+#  include <QAbstractItemModelTester>
+#  define USE_MODEL_TESTER	1
+#endif
+
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "DirTreeModel.h"
+#include "SelectionModel.h"
+#include "DataColumns.h"
+#include "FileSizeStats.h"
+#include "FileTypeStats.h"
+#include "TreemapView.h"
+#include "TreemapTile.h"
+#include "CushionKernel.h"
+#include "Squarifier.h"
+#include "FileInfoIterator.h"
+#include "BinaryCache.h"	// BINARY_CACHE_SUFFIX
+#include "DirTreeCache.h"	// CACHE_FORMAT_VERSION, ZSTD_CACHE_SUFFIX
+#include "Logger.h"
+#include "Exception.h"
+#include "Version.h"
+
+
+#define TREEMAP_WIDTH	1920
+#define TREEMAP_HEIGHT	1080
+#define SQUARIFY_CHILDREN	200000
+#define SQUARIFY_MIN_TILE	3
+#define CACHE_PARSE_LINES	2000000
+#define CACHE_PARSE_FILES	100	// Files per directory
+#define MODEL_ITEMS		1000000
+#define MODEL_FANOUT		10
+#define MODEL_FILES		90	// Files per directory of the large tree
+#define MODEL_DEEP_LEVELS	200
+#define MODEL_DEEP_FILES	10	// Files per directory of the deep chain
+#define MODEL_DELETE_FILES	100	// Files deleted from the wide directory
+#define MODEL_CHECK_ROWS	20	// Rows per directory whose columns are checked
+#define MODEL_MAX_ERRORS_LOGGED	20
+#define REGRESSION_TOLERANCE	25	// Percent
+#define REGRESSION_MIN_SEC	0.01	// Shorter differences are noise
+
+using std::cerr;
+using namespace QDirStat;
+
+
+/**
+ * The result of one workload: The median of all repeats.
+ **/
+struct BenchResult
+{
+    QString name;
+    double  seconds;
+    qint64  count;	// Items processed per run
+    QString unit;	// What 'count' counts
+};
+
+
+/**
+ * The shape of the synthetic directory tree.
+ **/
+struct TreeShape
+{
+    int levels;		// Directory levels below the toplevel
+    int fanout;		// Subdirectories per directory
+    int files;		// Files per directory
+};
+
+
+/**
+ * The synthetic trees for the DirTreeModel workloads.
+ **/
+enum ModelScenario
+{
+    LargeTree,		// A lot of items in a balanced tree
+    WideDir,		// One directory with a lot of files
+    DeepChain		// A long chain of subdirectories
+};
+
+
+static QList<BenchResult> results;
+static int		  repeats     = 5;
+static quint32		  randSeed    = 42;
+static int		  modelErrors = 0;
+static int		  scanErrors  = 0;
+
+
+void usage()
+{
+    cerr << "\n"
+	 << "Usage: \n"
+	 << "\n"
+	 << "  qdirstat-bench [-h] [-l <levels>] [-f <fanout>] [-n <files>] [-r <repeats>]\n"
+	 << "                 [-j <threads>] [-b lstat|io_uring] [-c <lines>]\n"
+	 << "                 [-m <items>] [-t] [-o <result-file>]\n"
+	 << "                 [-B <baseline-file>] [-T <percent>]\n"
+	 << "                 [<work-dir>]\n"
+	 << "\n"
+	 << "Generate a synthetic directory tree in <work-dir> (default: a temporary\n"
+	 << "directory) and time reading it, writing and reading cache files, the file\n"
+	 << "size and file type statistics, the treemap and the tree view model. The tree\n"
+	 << "is always the same for the same -l, -f and -n, so results of different builds\n"
+	 << "can be compared. A second, smaller tree is read at the same time as the first\n"
+	 << "one to check that trees sharing the read threads each get their own totals.\n"
+	 << "\n"
+	 << "  -l  directory levels (default: 3)\n"
+	 << "  -f  subdirectories per directory (default: 8)\n"
+	 << "  -n  files per directory (default: 50)\n"
+	 << "  -r  repeats of each workload; the median is reported (default: 5)\n"
+	 << "  -j  threads for reading directories (default: one per CPU)\n"
+	 << "  -b  backend for stat()ing the directory entries\n"
+	 << "  -c  lines of the synthetic cache file for parsing (default: 2000000;\n"
+	 << "      0 to skip it)\n"
+	 << "  -m  items of the synthetic trees for the tree view model (default: 1000000;\n"
+	 << "      0 to skip it)\n"
+	 << "  -t  also check the model with QAbstractItemModelTester (slow; this aborts\n"
+	 << "      at the first error)\n"
+	 << "  -o  write the results as JSON to <result-file> (default: stdout)\n"
+	 << "  -B  compare the results with <baseline-file> from an earlier -o\n"
+	 << "  -T  percent that a workload may take longer than in the baseline\n"
+	 << "      (default: 25)\n"
+	 << "  -h  help (this usage message)\n"
+	 << "\n"
+	 << "The files are sparse, so the page cache is warm after the first repeat\n"
+	 << "and this measures the CPU side of reading. Without a display, run this\n"
+	 << "with QT_QPA_PLATFORM=offscreen.\n"
+	 << "\n"
+	 << "The exit code is 1 if the model or the scans of two trees at once made any\n"
+	 << "mistakes or if any workload took longer than the baseline allows.\n"
+	 << std::endl;
+}
+
+
+/**
+ * Return the next pseudo random number. This is a plain LCG so the tree
+ * is the same on all platforms.
+ **/
+quint32 nextRandom()
+{
+    randSeed = randSeed * 1103515245 + 12345;
+
+    return ( randSeed >> 8 ) & 0xffffff;
+}
+
+
+/**
+ * Create 'shape.files' files and 'shape.fanout' subdirectories in 'dir'
+ * and recurse into the subdirectories for 'level' more levels. Return the
+ * number of files and directories that were created.
+ **/
+qint64 generateTree( const QString & dir, const TreeShape & shape, int level )
+{
+    static const char * suffixes[] =
+	{ ".jpg", ".png", ".mp4", ".mp3", ".txt", ".pdf", ".cpp", ".h", ".o", ".tar.gz", "" };
+    static const int suffixCount = sizeof( suffixes ) / sizeof( suffixes[0] );
+
+    qint64 count = 0;
+
+    for ( int i=0; i < shape.files; ++i )
+    {
+	// Roughly log-uniform file sizes from 0 to 16 MB like in real trees
+
+	qint64 size = 1LL << ( nextRandom() % 24 );
+	size += nextRandom() % size;
+
+	QString name = QString( "%1/file-%2%3" ).arg( dir ).arg( i )
+	    .arg( suffixes[ nextRandom() % suffixCount ] );
+
+	int fd = open( name.toUtf8(), O_CREAT | O_WRONLY | O_TRUNC, 0644 );
+
+	if ( fd < 0 )
+	    THROW( SysCallFailedException( "open", name ) );
+
+	if ( ftruncate( fd, size ) != 0 )	// Sparse: No disk I/O
+	    logWarning() << "ftruncate() failed for " << name << endl;
+
+	close( fd );
+	++count;
+    }
+
+    if ( level <= 0 )
+	return count;
+
+    for ( int i=0; i < shape.fanout; ++i )
+    {
+	QString subDir = QString( "%1/dir-%2" ).arg( dir ).arg( i );
+
+	if ( mkdir( subDir.toUtf8(), 0755 ) != 0 )
+	    THROW( SysCallFailedException( "mkdir", subDir ) );
+
+	count += 1 + generateTree( subDir, shape, level - 1 );
+    }
+
+    return count;
+}
+
+
+/**
+ * Add the median of 'nsec' as a result.
+ **/
+void addResult( const QString & name, QList<qint64> nsec, qint64 count, const QString & unit )
+{
+    std::sort( nsec.begin(), nsec.end() );
+
+    BenchResult result;
+    result.name	   = name;
+    result.seconds = nsec.isEmpty() ? 0.0 : nsec.at( nsec.size() / 2 ) / 1e9;
+    result.count   = count;
+    result.unit	   = unit;
+    results << result;
+
+    logInfo() << name << ": " << result.seconds << " sec for " << count << " " << unit
+	      << " (" << (qint64) ( count / qMax( result.seconds, 1e-9 ) ) << " / sec)"
+	      << endl;
+}
+
+
+/**
+ * Wait until 'tree' emits finished() or aborted() after 'loop' was
+ * connected to it and the reading was started.
+ **/
+void waitForTree( DirTree * tree, QEventLoop & loop )
+{
+    if ( tree->isBusy() )
+	loop.exec();
+}
+
+
+/**
+ * Read 'dir' into 'tree' and return the time in nanoseconds.
+ **/
+qint64 readDir( DirTree * tree, const QString & dir )
+{
+    QEventLoop loop;
+    QObject::connect( tree, SIGNAL( finished() ), &loop, SLOT( quit() ) );
+    QObject::connect( tree, SIGNAL( aborted()  ), &loop, SLOT( quit() ) );
+
+    QElapsedTimer timer;
+    timer.start();
+
+    tree->startReading( dir );
+    waitForTree( tree, loop );
+
+    return timer.nsecsElapsed();
+}
+
+
+/**
+ * Read cache file 'cacheFile' into 'tree' and return the time in
+ * nanoseconds.
+ **/
+qint64 readCache( DirTree * tree, const QString & cacheFile )
+{
+    QEventLoop loop;
+    QObject::connect( tree, SIGNAL( finished() ), &loop, SLOT( quit() ) );
+    QObject::connect( tree, SIGNAL( aborted()  ), &loop, SLOT( quit() ) );
+
+    QElapsedTimer timer;
+    timer.start();
+
+    tree->clear();
+    tree->readCache( cacheFile );
+    waitForTree( tree, loop );
+
+    return timer.nsecsElapsed();
+}
+
+
+/**
+ * Return the number of items of 'tree'.
+ **/
+qint64 itemCount( DirTree * tree )
+{
+    FileInfo * toplevel = tree->firstToplevel();
+
+    return toplevel ? toplevel->totalItems() + 1 : 0;
+}
+
+
+void benchScan( const QString & dir, int threads, LocalScanBackend backend )
+{
+    QList<qint64> nsec;
+    qint64 count = 0;
+
+    for ( int i=0; i < repeats; ++i )
+    {
+	DirTree tree;
+	tree.setScannerThreads( threads );
+	tree.setScanBackend( backend );
+
+	nsec << readDir( &tree, dir );
+	count = itemCount( &tree );
+    }
+
+    addResult( backend == IoUringScanBackend ? "scan.io_uring" : "scan.lstat",
+	       nsec, count, "items" );
+}
+
+
+/**
+ * Read 'dir' into a new tree of its own and return the total size.
+ **/
+FileSize totalSize( const QString & dir, int threads, LocalScanBackend backend )
+{
+    DirTree tree;
+    tree.setScannerThreads( threads );
+    tree.setScanBackend( backend );
+    readDir( &tree, dir );
+
+    return tree.firstToplevel() ? tree.firstToplevel()->totalSize() : 0;
+}
+
+
+/**
+ * Check that 'tree' has 'items' items with 'size' bytes after reading
+ * 'dir'.
+ **/
+void checkScan( DirTree * tree, const QString & dir, qint64 items, FileSize size )
+{
+    FileSize treeSize = tree->firstToplevel() ? tree->firstToplevel()->totalSize() : 0;
+
+    if ( itemCount( tree ) != items || treeSize != size )
+    {
+	logError() << "Read " << itemCount( tree ) << " items with " << treeSize
+		   << " bytes from " << dir << " instead of " << items
+		   << " items with " << size << " bytes" << endl;
+	++scanErrors;
+    }
+}
+
+
+/**
+ * Read 'dir1' and 'dir2' at the same time into two trees that share the
+ * pool of read threads, and check that each of them gets the same totals
+ * as when it is read alone. 'items1' and 'items2' are the numbers of
+ * items that were generated below them.
+ **/
+void benchConcurrentScan( const QString & dir1, qint64 items1,
+			  const QString & dir2, qint64 items2,
+			  int threads, LocalScanBackend backend )
+{
+    FileSize size1 = totalSize( dir1, threads, backend );
+    FileSize size2 = totalSize( dir2, threads, backend );
+
+    QList<qint64> nsec;
+
+    for ( int i=0; i < repeats; ++i )
+    {
+	DirTree tree1;
+	DirTree tree2;
+	QEventLoop loop;
+
+	foreach ( DirTree * tree, QList<DirTree *>() << &tree1 << &tree2 )
+	{
+	    tree->setScannerThreads( threads );
+	    tree->setScanBackend( backend );
+
+	    QObject::connect( tree, SIGNAL( finished() ), &loop, SLOT( quit() ) );
+	    QObject::connect( tree, SIGNAL( aborted()  ), &loop, SLOT( quit() ) );
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+
+	tree1.startReading( dir1 );
+	tree2.startReading( dir2 );
+
+	// The signals only arrive in the event loop, so none can get lost
+
+	while ( tree1.isBusy() || tree2.isBusy() )
+	    loop.exec();
+
+	nsec << timer.nsecsElapsed();
+
+	checkScan( &tree1, dir1, items1 + 1, size1 );
+	checkScan( &tree2, dir2, items2 + 1, size2 );
+    }
+
+    addResult( "scan.concurrent", nsec, items1 + items2 + 2, "items" );
+}
+
+
+void benchCache( DirTree * tree, const QString & workDir, const QString & suffix )
+{
+    QString cacheFile = workDir + "/bench-cache" + suffix;
+    QString name      = suffix == BINARY_CACHE_SUFFIX ? "binary" :
+			suffix.endsWith( ZSTD_CACHE_SUFFIX ) ? "zstd" : "text";
+    qint64  count     = itemCount( tree );
+
+    QList<qint64> nsec;
+
+    for ( int i=0; i < repeats; ++i )
+    {
+	QElapsedTimer timer;
+	timer.start();
+
+	if ( ! tree->writeCache( cacheFile ) )
+	{
+	    logError() << "Writing " << cacheFile << " failed" << endl;
+	    return;
+	}
+
+	nsec << timer.nsecsElapsed();
+    }
+
+    addResult( "cache.write." + name, nsec, count, "items" );
+    nsec.clear();
+
+    for ( int i=0; i < repeats; ++i )
+    {
+	DirTree cacheTree;
+	nsec << readCache( &cacheTree, cacheFile );
+
+	if ( itemCount( &cacheTree ) != count )
+	    logWarning() << "Read " << itemCount( &cacheTree ) << " items from "
+			 << cacheFile << " instead of " << count << endl;
+    }
+
+    addResult( "cache.read." + name, nsec, count, "items" );
+    addResult( "cache.read." + name + ".bytes", nsec, QFileInfo( cacheFile ).size(), "bytes" );
+
+    QFile::remove( cacheFile );
+}
+
+
+/**
+ * Write a text cache file 'cacheFile' with 'lines' lines in directories of
+ * CACHE_PARSE_FILES files each, with escaped non-ASCII characters and
+ * blanks in the names like in real caches. Return the number of items.
+ **/
+qint64 generateCache( const QString & cacheFile, qint64 lines )
+{
+    gzFile cache = gzopen( cacheFile.toUtf8(), "w1" );
+
+    if ( ! cache )
+	THROW( SysCallFailedException( "gzopen", cacheFile ) );
+
+    gzputs( cache,
+	    "[qdirstat " CACHE_FORMAT_VERSION " cache file]\n"
+	    "D /bench\t4096\t0x5f000000\n" );
+
+    qint64 count = 1;
+
+    for ( int dir=0; count < lines; ++dir )
+    {
+	gzprintf( cache, "D /bench/dir-%d/sub%%20dir-%d\t4096\t0x5f000000\n",
+		  dir / CACHE_PARSE_FILES, dir );
+	++count;
+
+	for ( int i=0; i < CACHE_PARSE_FILES && count < lines; ++i )
+	{
+	    gzprintf( cache, "F\tfile-%d-%%C3%%A4%%C3%%B6.jpg\t%uK\t0x%x\tblocks: %u\n",
+		      i, nextRandom() % 4096, 0x5f000000 + nextRandom(), nextRandom() % 8192 );
+	    ++count;
+	}
+    }
+
+    gzclose( cache );
+
+    return count;
+}
+
+
+/**
+ * Time parsing a text cache file with 'lines' lines.
+ **/
+void benchCacheParse( const QString & workDir, qint64 lines )
+{
+    if ( lines <= 0 )
+	return;
+
+    QString cacheFile = workDir + "/bench-parse.cache.gz";
+    qint64  count     = generateCache( cacheFile, lines );
+
+    QList<qint64> nsec;
+
+    for ( int i=0; i < repeats; ++i )
+    {
+	DirTree tree;
+	nsec << readCache( &tree, cacheFile );
+
+	if ( itemCount( &tree ) != count )
+	    logWarning() << "Read " << itemCount( &tree ) << " items from "
+			 << cacheFile << " instead of " << count << endl;
+    }
+
+    addResult( "cache.parse.text", nsec, count, "lines" );
+
+    QFile::remove( cacheFile );
+}
+
+
+void benchFileSizeStats( DirTree * tree )
+{
+    FileInfo * toplevel = tree->firstToplevel();
+    QList<qint64> nsec;
+    qint64 count = 0;
+
+    for ( int i=0; i < repeats; ++i )
+    {
+	QElapsedTimer timer;
+	timer.start();
+
+	FileSizeStats stats;
+	stats.collect( toplevel );
+	stats.median();
+
+	nsec << timer.nsecsElapsed();
+	count = stats.dataSize();
+    }
+
+    addResult( "stats.fileSize", nsec, count, "files" );
+}
+
+
+void benchFileTypeStats( DirTree * tree )
+{
+    FileInfo * toplevel = tree->firstToplevel();
+    QList<qint64> nsec;
+    qint64 count = toplevel ? toplevel->totalFiles() : 0;
+
+    for ( int i=0; i < repeats; ++i )
+    {
+	FileTypeStats stats;
+	QEventLoop loop;
+	QObject::connect( &stats, SIGNAL( calcFinished() ), &loop, SLOT( quit() ) );
+
+	QElapsedTimer timer;
+	timer.start();
+
+	stats.calc( toplevel );
+
+	if ( stats.isBusy() )
+	    loop.exec();
+
+	nsec << timer.nsecsElapsed();
+    }
+
+    addResult( "stats.fileType", nsec, count, "files" );
+}
+
+
+/**
+ * Return the leaf tiles below 'tile'.
+ **/
+QList<TreemapTile *> leafTiles( TreemapTile * rootTile )
+{
+    QList<TreemapTile *> leaves;
+    QList<TreemapTile *> tiles;
+
+    if ( rootTile )
+	tiles << rootTile;
+
+    while ( ! tiles.isEmpty() )
+    {
+	TreemapTile * tile = tiles.takeFirst();
+	bool hasChildTiles = false;
+
+	foreach ( QGraphicsItem * child, tile->childItems() )
+	{
+	    TreemapTile * childTile = dynamic_cast<TreemapTile *>( child );
+
+	    if ( childTile )
+	    {
+		tiles << childTile;
+		hasChildTiles = true;
+	    }
+	}
+
+	if ( ! hasChildTiles )
+	    leaves << tile;
+    }
+
+    return leaves;
+}
+
+
+void benchTreemap( DirTree * tree )
+{
+    FileInfo * toplevel = tree->firstToplevel();
+    QRectF rect( 0.0, 0.0, TREEMAP_WIDTH, TREEMAP_HEIGHT );
+
+    TreemapView view;
+    view.setDirTree( tree );
+    view.rebuildTreemap( toplevel, rect.size() );	// Creates the scene
+
+    // The layout alone: Creating the tiles
+
+    QList<qint64> nsec;
+    qint64 count = 0;
+
+    for ( int i=0; i < repeats; ++i )
+    {
+	QElapsedTimer timer;
+	timer.start();
+
+	TreemapTile * rootTile = new TreemapTile( &view, 0, toplevel, rect );
+	CHECK_NEW( rootTile );
+
+	nsec << timer.nsecsElapsed();
+	count = leafTiles( rootTile ).size();
+	delete rootTile;
+    }
+
+    addResult( "treemap.layout", nsec, count, "tiles" );
+    nsec.clear();
+
+    // The cushions of all leaf tiles in one thread
+
+    view.rebuildTreemap( toplevel, rect.size() );
+    QList<TreemapTile *> leaves = leafTiles( view.rootTile() );
+    QImage framebuffer( rect.size().toSize(), QImage::Format_RGB32 );
+
+    for ( int i=0; i < repeats; ++i )
+    {
+	QElapsedTimer timer;
+	timer.start();
+
+	foreach ( TreemapTile * tile, leaves )
+	{
+	    QRect cushionRect = tile->cushionRect().intersected( framebuffer.rect() );
+
+	    if ( cushionRect.isEmpty() )
+		continue;
+
+	    uchar * bits = framebuffer.bits()
+		+ cushionRect.y() * framebuffer.bytesPerLine()
+		+ cushionRect.x() * sizeof( QRgb );
+
+	    CushionKernel::renderCushion( tile->cushionShading(), cushionRect,
+					  bits, framebuffer.bytesPerLine() );
+	}
+
+	nsec << timer.nsecsElapsed();
+    }
+
+    addResult( QString( "treemap.renderCushion.%1" ).arg( CushionKernel::name() ),
+	       nsec, leaves.size(), "tiles" );
+    nsec.clear();
+
+    // Everything: Layout and the cushions with the render threads
+
+    for ( int i=0; i < repeats; ++i )
+    {
+	QElapsedTimer timer;
+	timer.start();
+
+	view.rebuildTreemap( toplevel, rect.size() );
+
+	nsec << timer.nsecsElapsed();
+    }
+
+    addResult( "treemap.rebuild", nsec, count, "tiles" );
+}
+
+
+/**
+ * Return what is left of 'rect' after laying out a row of children with
+ * 'sum' along its longer side like TreemapTile::layoutRow().
+ **/
+QRectF remainingRect( const QRectF & rect, double scale, FileSize sum )
+{
+    int primary	  = qMax( rect.width(), rect.height() );
+    int secondary = (int) ( sum * scale / primary );
+
+    if ( sum == 0 || secondary < SQUARIFY_MIN_TILE )
+	return rect;
+
+    if ( rect.width() > rect.height() )
+	return QRectF( rect.x() + secondary, rect.y(), rect.width() - secondary, rect.height() );
+    else
+	return QRectF( rect.x(), rect.y() + secondary, rect.width(), rect.height() - secondary );
+}
+
+
+/**
+ * The row breaks like TreemapTile did before the Squarifier: Call
+ * totalSize() for each child and each comparison and add up the row again
+ * for its layout. Return the number of rows.
+ **/
+int squarifyChildren( const FileInfoList & children, const QRectF & fullRect, double scale )
+{
+    QRectF rect = fullRect;
+    int	   pos	= 0;
+    int	   rows = 0;
+
+    while ( pos < children.size() )
+    {
+	int length = qMax( rect.width(), rect.height() );
+	int first  = pos;
+
+	if ( length == 0 )
+	{
+	    ++pos;
+	    continue;
+	}
+
+	const double scaledLengthSquare = length * (double) length / scale;
+	double lastWorstAspectRatio = -1.0;
+	double sum = 0;
+
+	while ( pos < children.size() )
+	{
+	    sum += children.at( pos )->totalSize();
+
+	    if ( pos > first && sum != 0 && children.at( pos )->totalSize() != 0 )
+	    {
+		double sumSquare	= sum * sum;
+		double worstAspectRatio = qMax( scaledLengthSquare * children.at( first )->totalSize() / sumSquare,
+						sumSquare / ( scaledLengthSquare * children.at( pos )->totalSize() ) );
+
+		if ( lastWorstAspectRatio >= 0.0 && worstAspectRatio > lastWorstAspectRatio )
+		    break;
+
+		lastWorstAspectRatio = worstAspectRatio;
+	    }
+
+	    ++pos;
+	}
+
+	FileSize rowSum = 0;
+
+	for ( int i = first; i < pos; ++i )
+	    rowSum += children.at( i )->totalSize();
+
+	rect = remainingRect( rect, scale, rowSum );
+	++rows;
+    }
+
+    return rows;
+}
+
+
+/**
+ * The same row breaks with the Squarifier. Return the number of rows.
+ **/
+int squarifySizes( const FileInfoList & children, const QRectF & fullRect, double scale )
+{
+    QVector<FileSize> sizes;
+    sizes.reserve( children.size() );
+
+    foreach ( FileInfo * child, children )
+	sizes.append( child->totalSize() );
+
+    Squarifier squarifier( sizes );
+    QRectF rect = fullRect;
+    int	   pos	= 0;
+    int	   rows = 0;
+
+    while ( pos < sizes.size() )
+    {
+	int end = squarifier.rowEnd( rect, scale, pos );
+
+	if ( end == pos )
+	{
+	    ++pos;
+	    continue;
+	}
+
+	rect = remainingRect( rect, scale, squarifier.sum( pos, end ) );
+	pos  = end;
+	++rows;
+    }
+
+    return rows;
+}
+
+
+void benchSquarify()
+{
+    // One directory with a lot of children, but without any tiles or disk
+    // access: Only the row breaks of the squarified layout
+
+    DirTree tree;
+    DirInfo * dir = new DirInfo( &tree );
+    CHECK_NEW( dir );
+
+    for ( int i=0; i < SQUARIFY_CHILDREN; ++i )
+    {
+	qint64 size = 1LL << ( nextRandom() % 24 );
+	size += nextRandom() % size;
+
+	FileInfo * file = new FileInfo( &tree, dir, QString( "file-%1" ).arg( i ),
+					S_IFREG | 0644, size, 0 );
+	CHECK_NEW( file );
+	dir->insertChild( file );
+    }
+
+    FileInfoList children;
+    FileInfoSortedBySizeIterator it( dir );
+
+    while ( *it )
+    {
+	children << *it;
+	++it;
+    }
+
+    QRectF rect( 0.0, 0.0, TREEMAP_WIDTH, TREEMAP_HEIGHT );
+    double scale = rect.width() * rect.height() / dir->totalSize();
+    QList<qint64> nsec;
+    int rows = 0;
+
+    for ( int i=0; i < repeats; ++i )
+    {
+	QElapsedTimer timer;
+	timer.start();
+	rows = squarifyChildren( children, rect, scale );
+	nsec << timer.nsecsElapsed();
+    }
+
+    addResult( "treemap.squarify.totalSize", nsec, children.size(), "children" );
+    nsec.clear();
+
+    for ( int i=0; i < repeats; ++i )
+    {
+	QElapsedTimer timer;
+	timer.start();
+
+	if ( squarifySizes( children, rect, scale ) != rows )
+	    logWarning() << "Different row breaks with the Squarifier" << endl;
+
+	nsec << timer.nsecsElapsed();
+    }
+
+    addResult( "treemap.squarify.prefixSums", nsec, children.size(), "children" );
+
+    delete dir;
+}
+
+
+/**
+ * Log a mistake of the model about 'item'.
+ **/
+void modelError( const QString & msg, FileInfo * item )
+{
+    if ( ++modelErrors <= MODEL_MAX_ERRORS_LOGGED )
+	logError() << "Model error: " << msg << ": " << item << endl;
+}
+
+
+/**
+ * Add 'count' files with pseudo random sizes to 'dir'.
+ **/
+void addModelFiles( DirTree * tree, DirInfo * dir, int count )
+{
+    for ( int i=0; i < count; ++i )
+    {
+	qint64 size = 1LL << ( nextRandom() % 24 );
+	size += nextRandom() % size;
+
+	FileInfo * file = new FileInfo( tree, dir, QString( "file-%1" ).arg( i ),
+					S_IFREG | 0644, size, nextRandom() );
+	CHECK_NEW( file );
+	dir->insertChild( file );
+    }
+}
+
+
+/**
+ * Add a subdirectory 'name' to 'parent' that is finished reading.
+ **/
+DirInfo * addModelDir( DirTree * tree, DirInfo * parent, const QString & name )
+{
+    DirInfo * dir = new DirInfo( tree, parent, name, S_IFDIR | 0755, 4096, 0 );
+    CHECK_NEW( dir );
+    parent->insertChild( dir );
+    dir->setReadState( DirFinished );
+
+    return dir;
+}
+
+
+/**
+ * Fill 'dir' with files and subdirectories down to 'levels' more levels
+ * and return the number of items that were added.
+ **/
+qint64 fillModelDir( DirTree * tree, DirInfo * dir, int levels )
+{
+    addModelFiles( tree, dir, MODEL_FILES );
+    qint64 count = MODEL_FILES;
+
+    if ( levels > 0 )
+    {
+	for ( int i=0; i < MODEL_FANOUT; ++i )
+	{
+	    DirInfo * subDir = addModelDir( tree, dir, QString( "dir-%1" ).arg( i ) );
+	    count += 1 + fillModelDir( tree, subDir, levels - 1 );
+	}
+    }
+
+    return count;
+}
+
+
+/**
+ * Build the synthetic tree for 'scenario' with about 'items' items right
+ * in 'tree', without any disk access, and notify the model about it the
+ * same way as a read job does.
+ **/
+void buildModelTree( DirTree * tree, ModelScenario scenario, qint64 items )
+{
+    DirInfo * toplevel = addModelDir( tree, tree->root(), "/synthetic" );
+
+    switch ( scenario )
+    {
+	case LargeTree:
+	    {
+		int    levels = 0;
+		qint64 dirs   = 1;
+		qint64 total  = 1 + MODEL_FILES;
+
+		while ( total < items )
+		{
+		    dirs  *= MODEL_FANOUT;
+		    total += dirs * ( 1 + MODEL_FILES );
+		    ++levels;
+		}
+
+		fillModelDir( tree, toplevel, levels );
+	    }
+	    break;
+
+	case WideDir:
+	    addModelFiles( tree, toplevel, items );
+	    break;
+
+	case DeepChain:
+	    {
+		DirInfo * dir = toplevel;
+
+		for ( int i=0; i < items; ++i )
+		{
+		    dir = addModelDir( tree, dir, QString( "level-%1" ).arg( i ) );
+		    addModelFiles( tree, dir, MODEL_DEEP_FILES );
+		}
+	    }
+	    break;
+    }
+
+    toplevel->finalizeAll();
+    tree->sendReadJobFinished( tree->root() );
+    tree->sendFinished();
+}
+
+
+/**
+ * Create a model with an empty tree.
+ **/
+DirTreeModel * newModel( bool useTester )
+{
+    DirTreeModel * model = new DirTreeModel();
+    CHECK_NEW( model );
+
+#ifdef USE_MODEL_TESTER
+    if ( useTester )
+	new QAbstractItemModelTester( model, QAbstractItemModelTester::FailureReportingMode::Fatal, model );
+#else
+    if ( useTester )
+	logWarning() << "Built without QAbstractItemModelTester" << endl;
+#endif
+
+    return model;
+}
+
+
+/**
+ * Fetch all rows below 'parent' and ask for the name of each of them like
+ * a view that shows all rows (QTreeView::expandAll()). Return the number
+ * of rows.
+ **/
+qint64 expandAll( DirTreeModel * model, const QModelIndex & parent )
+{
+    while ( model->canFetchMore( parent ) )
+	model->fetchMore( parent );
+
+    int	   rows	 = model->rowCount( parent );
+    qint64 count = rows;
+
+    for ( int row=0; row < rows; ++row )
+    {
+	QModelIndex index = model->index( row, 0, parent );
+	model->data( index, Qt::DisplayRole );
+
+	if ( model->hasChildren( index ) )
+	    count += expandAll( model, index );
+    }
+
+    return count;
+}
+
+
+/**
+ * Check the parts of the contract of QAbstractItemModel that the tree view
+ * relies on for everything below 'parent' after expandAll(): Each index
+ * has to have the right row, column and parent, each directory has to have
+ * a row for each child, and the rows have to be in the right order if the
+ * model is sorted by the total size. Return the number of rows.
+ **/
+qint64 checkModel( DirTreeModel * model, const QModelIndex & parent )
+{
+    FileInfo * parentItem = parent.isValid() ?
+	static_cast<FileInfo *>( parent.internalPointer() ) : model->tree()->root();
+
+    int rows	 = model->rowCount( parent );
+    int cols	 = model->columnCount( parent );
+    int children = model->countDirectChildren( parentItem );
+
+    if ( rows != children )
+	modelError( QString( "%1 rows for %2 children" ).arg( rows ).arg( children ), parentItem );
+
+    if ( model->canFetchMore( parent ) )
+	modelError( "More rows to fetch after fetching all", parentItem );
+
+    if ( rows > 0 && ! model->hasChildren( parent ) )
+	modelError( "Rows, but no children", parentItem );
+
+    if ( model->index( rows, 0, parent ).isValid() )
+	modelError( "Valid index after the last row", parentItem );
+
+    bool       bySize = model->sortColumn() == TotalSizeCol;
+    FileInfo * prev   = 0;
+    qint64     count  = rows;
+
+    for ( int row=0; row < rows; ++row )
+    {
+	QModelIndex index = model->index( row, 0, parent );
+	FileInfo *  item  = static_cast<FileInfo *>( index.internalPointer() );
+
+	if ( ! index.isValid() || ! item || index.row() != row || index.model() != model )
+	{
+	    modelError( QString( "Bad index for row %1" ).arg( row ), parentItem );
+	    continue;
+	}
+
+	if ( item->parent() != parentItem )
+	    modelError( QString( "Row %1 is not a child" ).arg( row ), parentItem );
+
+	if ( model->parent( index ) != parent )
+	    modelError( "Wrong parent", item );
+
+	if ( model->modelIndex( item ) != index )
+	    modelError( "Wrong model index", item );
+
+	if ( bySize && prev )
+	{
+	    bool sorted = model->sortOrder() == Qt::AscendingOrder ?
+		prev->totalSize() <= item->totalSize() :
+		prev->totalSize() >= item->totalSize();
+
+	    if ( ! sorted )
+		modelError( "Not sorted by total size", item );
+	}
+
+	prev = item;
+
+	if ( row < MODEL_CHECK_ROWS )
+	{
+	    for ( int col=1; col < cols; ++col )
+	    {
+		QModelIndex sibling = model->index( row, col, parent );
+
+		if ( sibling.internalPointer() != item || model->parent( sibling ) != parent )
+		    modelError( QString( "Bad index for column %1" ).arg( col ), item );
+
+		model->data( sibling, Qt::DisplayRole );
+	    }
+	}
+
+	if ( model->hasChildren( index ) )
+	    count += checkModel( model, index );
+    }
+
+    return count;
+}
+
+
+/**
+ * Add one selection range for the rows of 'parent' and of each directory
+ * below it to 'selection'.
+ **/
+void addRowRanges( DirTreeModel * model, const QModelIndex & parent, QItemSelection & selection )
+{
+    int rows = model->rowCount( parent );
+
+    if ( rows == 0 )
+	return;
+
+    selection.select( model->index( 0, 0, parent ), model->index( rows - 1, 0, parent ) );
+
+    for ( int row=0; row < rows; ++row )
+    {
+	QModelIndex index = model->index( row, 0, parent );
+
+	if ( model->hasChildren( index ) )
+	    addRowRanges( model, index, selection );
+    }
+}
+
+
+/**
+ * Return the first subdirectory of 'dir' or 0 if there is none.
+ **/
+DirInfo * firstSubDir( DirInfo * dir )
+{
+    for ( FileInfo * child = dir->firstChild(); child; child = child->next() )
+    {
+	if ( child->isDirInfo() && ! child->isDotEntry() )
+	    return child->toDirInfo();
+    }
+
+    return 0;
+}
+
+
+/**
+ * Return the items to delete from the tree of 'scenario'.
+ **/
+FileInfoList modelVictims( DirTree * tree, ModelScenario scenario )
+{
+    DirInfo * toplevel = tree->firstToplevel()->toDirInfo();
+    FileInfoList victims;
+
+    switch ( scenario )
+    {
+	case LargeTree:
+	    victims << firstSubDir( toplevel );
+	    break;
+
+	case WideDir:
+	    {
+		FileInfoIterator it( toplevel );
+		int step = qMax( 1, it.count() / MODEL_DELETE_FILES );
+		int i	 = 0;
+
+		for ( FileInfo * child = toplevel->firstChild(); child; child = child->next() )
+		{
+		    if ( i++ % step == 0 && victims.size() < MODEL_DELETE_FILES )
+			victims << child;
+		}
+	    }
+	    break;
+
+	case DeepChain:
+	    {
+		DirInfo * dir = toplevel;
+
+		for ( int i=0; dir && i < MODEL_DEEP_LEVELS / 2; ++i )
+		    dir = firstSubDir( dir );
+
+		victims << dir;
+	    }
+	    break;
+    }
+
+    victims.removeAll( 0 );
+
+    return victims;
+}
+
+
+/**
+ * Time the tree view model with the synthetic tree of 'scenario': Fetching
+ * all rows, sorting, selecting all rows and deleting subtrees. The model
+ * is checked after each of them.
+ **/
+void benchModel( const QString & name, ModelScenario scenario, qint64 items, bool useTester )
+{
+    QList<qint64> nsec;
+    DirTreeModel * model = 0;
+    qint64 rows = 0;
+
+    // Each repeat needs a new model: Rows once fetched stay fetched
+
+    for ( int i=0; i < repeats; ++i )
+    {
+	delete model;
+	model = newModel( useTester );
+	buildModelTree( model->tree(), scenario, items );
+
+	QElapsedTimer timer;
+	timer.start();
+	rows = expandAll( model, QModelIndex() );
+	nsec << timer.nsecsElapsed();
+    }
+
+    addResult( name + ".expand", nsec, rows, "rows" );
+    checkModel( model, QModelIndex() );
+    nsec.clear();
+
+
+    // Each directory keeps the children sorted by the last two sort orders,
+    // so cycling through three of them sorts from scratch every time.
+
+    static const DataColumn sortCols[] = { TotalSizeCol, TotalItemsCol, NameCol };
+
+    for ( int i=0; i < repeats; ++i )
+    {
+	DataColumn sortCol = sortCols[ i % 3 ];
+
+	QElapsedTimer timer;
+	timer.start();
+	model->sort( DataColumns::toViewCol( sortCol ),
+		     sortCol == NameCol ? Qt::AscendingOrder : Qt::DescendingOrder );
+	expandAll( model, QModelIndex() );	// The view asks for all rows again
+	nsec << timer.nsecsElapsed();
+    }
+
+    addResult( name + ".sort", nsec, rows, "rows" );
+    model->sort( DataColumns::toViewCol( TotalSizeCol ), Qt::DescendingOrder );
+    checkModel( model, QModelIndex() );
+    nsec.clear();
+
+
+    SelectionModel selectionModel( model );
+    QItemSelection selection;
+    addRowRanges( model, QModelIndex(), selection );
+    int selected = 0;
+
+    for ( int i=0; i < repeats; ++i )
+    {
+	selectionModel.clearSelection();
+
+	QElapsedTimer timer;
+	timer.start();
+	selectionModel.select( selection, QItemSelectionModel::ClearAndSelect | QItemSelectionModel::Rows );
+	selected = selectionModel.selectedItems().size();
+	nsec << timer.nsecsElapsed();
+    }
+
+    addResult( name + ".selectAll", nsec, selected, "items" );
+
+    if ( selected != rows )
+	modelError( QString( "%1 selected items for %2 rows" ).arg( selected ).arg( rows ),
+		    model->tree()->firstToplevel() );
+
+    selectionModel.clearSelection();
+    nsec.clear();
+
+
+    // Deleting can't be repeated with the same tree
+
+    FileInfoList victims = modelVictims( model->tree(), scenario );
+    qint64 deleted     = 0;
+    qint64 deletedRows = 0;
+
+    foreach ( FileInfo * victim, victims )
+    {
+	deleted     += victim->totalItems() + 1;
+	deletedRows += 1 + expandAll( model, model->modelIndex( victim ) );
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    foreach ( FileInfo * victim, victims )
+	model->tree()->deleteSubtree( victim );
+
+    nsec << timer.nsecsElapsed();
+    addResult( name + ".delete", nsec, deleted, "items" );
+
+    if ( checkModel( model, QModelIndex() ) != rows - deletedRows )
+	modelError( QString( "Wrong number of rows after deleting %1 rows" ).arg( deletedRows ),
+		    model->tree()->firstToplevel() );
+
+    delete model;
+}
+
+
+/**
+ * Write all results as JSON to 'fileName' or to stdout if 'fileName' is
+ * empty.
+ **/
+void writeResults( const QString & fileName, const TreeShape & shape,
+		   qint64 items, int threads )
+{
+    QFile file;
+
+    if ( fileName.isEmpty() )
+	file.open( stdout, QIODevice::WriteOnly );
+    else
+	file.setFileName( fileName );
+
+    if ( ! file.isOpen() && ! file.open( QIODevice::WriteOnly | QIODevice::Truncate ) )
+    {
+	logError() << "Can't open " << fileName << endl;
+	return;
+    }
+
+    QTextStream str( &file );
+
+    str << "{\n"
+	<< "  \"version\": \"" << QDIRSTAT_VERSION << "\",\n"
+	<< "  \"qt\": \"" << qVersion() << "\",\n"
+	<< "  \"threads\": " << threads << ",\n"
+	<< "  \"repeats\": " << repeats << ",\n"
+	<< "  \"tree\": { \"levels\": " << shape.levels
+	<< ", \"fanout\": " << shape.fanout
+	<< ", \"files\": " << shape.files
+	<< ", \"items\": " << items << " },\n"
+	<< "  \"results\": [\n";
+
+    for ( int i=0; i < results.size(); ++i )
+    {
+	const BenchResult & result = results.at( i );
+
+	str << "    { \"name\": \"" << result.name << "\""
+	    << ", \"seconds\": " << QString::number( result.seconds, 'f', 6 )
+	    << ", \"count\": " << result.count
+	    << ", \"unit\": \"" << result.unit << "\""
+	    << ", \"perSecond\": " << (qint64) ( result.count / qMax( result.seconds, 1e-9 ) )
+	    << " }" << ( i < results.size() - 1 ? "," : "" ) << "\n";
+    }
+
+    str << "  ]\n"
+	<< "}\n";
+}
+
+
+/**
+ * Compare the results with those in 'baselineFile' from an earlier run and
+ * return the number of workloads that took more than 'tolerance' percent
+ * longer. Workloads with a different item count are not compared.
+ **/
+int checkRegressions( const QString & baselineFile, int tolerance )
+{
+    QFile file( baselineFile );
+
+    if ( ! file.open( QIODevice::ReadOnly ) )
+    {
+	logError() << "Can't open " << baselineFile << endl;
+	return 1;
+    }
+
+    QJsonParseError parseError;
+    QJsonDocument doc = QJsonDocument::fromJson( file.readAll(), &parseError );
+
+    if ( doc.isNull() )
+    {
+	logError() << baselineFile << ": " << parseError.errorString() << endl;
+	return 1;
+    }
+
+    QHash<QString, QJsonObject> baseline;
+
+    foreach ( const QJsonValue & value, doc.object().value( "results" ).toArray() )
+    {
+	QJsonObject result = value.toObject();
+	baseline.insert( result.value( "name" ).toString(), result );
+    }
+
+    int regressions = 0;
+
+    foreach ( const BenchResult & result, results )
+    {
+	if ( ! baseline.contains( result.name ) )
+	    continue;
+
+	QJsonObject old = baseline.value( result.name );
+	double oldSeconds = old.value( "seconds" ).toDouble();
+
+	if ( (qint64) old.value( "count" ).toDouble() != result.count )
+	{
+	    logWarning() << "Not comparing " << result.name << ": "
+			 << result.count << " instead of " << (qint64) old.value( "count" ).toDouble()
+			 << " " << result.unit << endl;
+	    continue;
+	}
+
+	if ( result.seconds > oldSeconds * ( 100 + tolerance ) / 100.0 &&
+	     result.seconds - oldSeconds > REGRESSION_MIN_SEC )
+	{
+	    logError() << "Regression: " << result.name << ": " << result.seconds
+		       << " sec instead of " << oldSeconds << " sec" << endl;
+	    cerr << "qdirstat-bench: " << qPrintable( result.name ) << " took "
+		 << result.seconds << " sec instead of " << oldSeconds << " sec" << std::endl;
+	    ++regressions;
+	}
+    }
+
+    return regressions;
+}
+
+
+int main( int argc, char *argv[] )
+{
+    Logger logger( "/tmp/qdirstat-$USER", "qdirstat-bench.log" );
+    logInfo() << "qdirstat-bench-" << QDIRSTAT_VERSION
+	      << " built with Qt " << QT_VERSION_STR
+	      << endl;
+
+    // Not the settings of qdirstat: The user's exclude rules and treemap
+    // settings would make the results depend on who runs this.
+
+    QCoreApplication::setOrganizationName( "QDirStat" );
+    QCoreApplication::setApplicationName ( "QDirStat-Bench" );
+    QApplication app( argc, argv );
+
+    TreeShape shape;
+    shape.levels = 3;
+    shape.fanout = 8;
+    shape.files	 = 50;
+
+    int		     threads = QThread::idealThreadCount();
+    LocalScanBackend backend = LstatScanBackend;
+    qint64	     cacheLines = CACHE_PARSE_LINES;
+    qint64	     modelItems = MODEL_ITEMS;
+    bool	     useTester	= false;
+    QString	     resultFile;
+    QString	     baselineFile;
+    int		     tolerance	= REGRESSION_TOLERANCE;
+    int		     opt;
+
+    while ( ( opt = getopt( argc, argv, "l:f:n:r:j:b:c:m:to:B:T:h" ) ) != -1 )
+    {
+	switch ( opt )
+	{
+	    case 'l': shape.levels = qMax( 0, atoi( optarg ) ); break;
+	    case 'f': shape.fanout = qMax( 0, atoi( optarg ) ); break;
+	    case 'n': shape.files  = qMax( 0, atoi( optarg ) ); break;
+	    case 'r': repeats	   = qMax( 1, atoi( optarg ) ); break;
+	    case 'j': threads	   = qMax( 1, atoi( optarg ) ); break;
+	    case 'c': cacheLines   = qMax( 0LL, atoll( optarg ) ); break;
+	    case 'm': modelItems   = qMax( 0LL, atoll( optarg ) ); break;
+	    case 't': useTester	   = true; break;
+	    case 'o': resultFile   = QString::fromUtf8( optarg ); break;
+	    case 'B': baselineFile = QString::fromUtf8( optarg ); break;
+	    case 'T': tolerance	   = qMax( 0, atoi( optarg ) ); break;
+
+	    case 'b':
+		if ( QString( optarg ) == "io_uring" )
+		    backend = IoUringScanBackend;
+		else if ( QString( optarg ) == "lstat" )
+		    backend = LstatScanBackend;
+		else
+		{
+		    usage();
+		    return 1;
+		}
+		break;
+
+	    default:
+		usage();
+		return opt == 'h' ? 0 : 1;
+	}
+    }
+
+    QTemporaryDir tempDir;
+    QString workDir = optind < argc ? QString::fromUtf8( argv[ optind ] ) : tempDir.path();
+    QString treeDir  = workDir + "/tree";
+    QString tree2Dir = workDir + "/tree2";	// For reading two trees at once
+
+    foreach ( const QString & dir, QStringList() << treeDir << tree2Dir )
+    {
+	if ( QFileInfo( dir ).exists() )
+	{
+	    cerr << "qdirstat-bench: " << qPrintable( dir ) << " already exists" << std::endl;
+	    return 1;
+	}
+
+	if ( mkdir( dir.toUtf8(), 0755 ) != 0 )
+	{
+	    cerr << "qdirstat-bench: Can't create " << qPrintable( dir ) << std::endl;
+	    return 1;
+	}
+    }
+
+    // The second tree is smaller, so mixing up the totals of the two
+    // trees shows.
+
+    TreeShape shape2 = shape;
+    shape2.files = shape.files / 2 + 1;
+
+    QElapsedTimer timer;
+    timer.start();
+    qint64 items  = generateTree( treeDir,  shape,  shape.levels );
+    qint64 items2 = generateTree( tree2Dir, shape2, shape2.levels );
+    logInfo() << "Generated " << items + items2 << " items in " << timer.elapsed() << " ms" << endl;
+
+    benchScan( treeDir, threads, backend );
+    benchConcurrentScan( treeDir, items, tree2Dir, items2, threads, backend );
+
+    DirTree tree;
+    tree.setScannerThreads( threads );
+    tree.setScanBackend( backend );
+    readDir( &tree, treeDir );
+
+    benchCache( &tree, workDir, ".cache.gz" );
+    benchCache( &tree, workDir, BINARY_CACHE_SUFFIX );
+
+    if ( haveZstd() )
+	benchCache( &tree, workDir, ".cache" ZSTD_CACHE_SUFFIX );
+
+    benchCacheParse( workDir, cacheLines );
+    benchFileSizeStats( &tree );
+    benchFileTypeStats( &tree );
+    benchTreemap( &tree );
+    benchSquarify();
+
+    if ( modelItems > 0 )
+    {
+	benchModel( "model.large", LargeTree, modelItems,	 useTester );
+	benchModel( "model.wide",  WideDir,   modelItems / 2,	 useTester );
+	benchModel( "model.deep",  DeepChain, MODEL_DEEP_LEVELS, useTester );
+    }
+
+    writeResults( resultFile, shape, itemCount( &tree ), threads );
+
+    if ( optind < argc )
+	logInfo() << "Keeping " << treeDir << " and " << tree2Dir << endl;
+
+    int status = 0;
+
+    if ( modelErrors > 0 )
+    {
+	cerr << "qdirstat-bench: " << modelErrors << " model errors" << std::endl;
+	status = 1;
+    }
+
+    if ( scanErrors > 0 )
+    {
+	cerr << "qdirstat-bench: " << scanErrors << " scan errors" << std::endl;
+	status = 1;
+    }
+
+    if ( ! baselineFile.isEmpty() && checkRegressions( baselineFile, tolerance ) > 0 )
+	status = 1;
+
+    return status;
+}
@@ -0,0 +1,171 @@
+/*
+ *   File name: main.cpp
+ *   Summary:	qdirstat-scan main program: Headless scans to cache files
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <unistd.h>	// getopt()
+#include <stdlib.h>	// atoi()
+#include <stdio.h>	// sscanf()
+#include <iostream>	// cerr
+
+#include <QCoreApplication>
+#include <QThread>
+#include <QFile>
+
+#include "CacheScanner.h"
+#include "ScanThrottle.h"
+#include "Statx.h"
+#include "Logger.h"
+#include "Version.h"
+
+
+#define DEFAULT_CACHE_FILE_NAME ".qdirstat.cache.gz"
+
+using std::cerr;
+using namespace QDirStat;
+
+
+void usage()
+{
+    cerr << "\n"
+	 << "Usage: \n"
+	 << "\n"
+	 << "  qdirstat-scan [-mncvh] [-j <threads>] [-b lstat|io_uring] [-s <shard>/<shards>]\n"
+	 << "                [-r <ops>] <directory-name> [<cache-file-name>]\n"
+	 << "\n"
+	 << "Scan <directory-name> and write a QDirStat cache file. If not specified,\n"
+	 << "<cache-file-name> is " << DEFAULT_CACHE_FILE_NAME << " in <directory-name>;\n"
+	 << "\"-\" writes to stdout.\n"
+	 << "\n"
+	 << "  -m  scan mounted file systems (cross file system boundaries)\n"
+	 << "  -j  number of threads for reading directories (default: one per CPU)\n"
+	 << "  -b  backend for stat()ing the directory entries\n"
+	 << "  -s  scan only one shard (0 .. <shards>-1) of the toplevel subdirectories;\n"
+	 << "      read all shard cache files with \"qdirstat --merge\"\n"
+	 << "  -n  low impact: idle I/O priority, nice 19 and back off when the disk is busy\n"
+	 << "  -r  at most <ops> readdir() and lstat() calls per second\n"
+	 << "  -c  use cached attributes: don't make NFS etc. ask the server for each file\n"
+	 << "  -v  verbose: report the result on stdout\n"
+	 << "  -h  help (this usage message)\n"
+	 << "\n"
+	 << "Like qdirstat-cache-writer, this uses the exclude rules of QDirStat.\n"
+	 << "The options -l and -d of qdirstat-cache-writer are accepted, but ignored.\n"
+	 << std::endl;
+}
+
+
+int main( int argc, char *argv[] )
+{
+    Logger logger( "/tmp/qdirstat-$USER", "qdirstat-scan.log" );
+    logInfo() << "qdirstat-scan-" << QDIRSTAT_VERSION
+	      << " built with Qt " << QT_VERSION_STR
+	      << endl;
+
+    // Same org/app name as qdirstat for QSettings: Use the same settings
+
+    QCoreApplication::setOrganizationName( "QDirStat" );
+    QCoreApplication::setApplicationName ( "QDirStat" );
+    QCoreApplication app( argc, argv );
+
+    CacheScanner scanner;
+    scanner.readSettings();
+    scanner.setThreads( QThread::idealThreadCount() );
+
+    bool verbose = false;
+    int	 opt;
+
+    while ( ( opt = getopt( argc, argv, "mnr:cj:b:s:vldh" ) ) != -1 )
+    {
+	switch ( opt )
+	{
+	    case 'm':
+		scanner.setCrossFileSystems( true );
+		break;
+
+	    case 'n':
+		ScanThrottle::instance()->setBackgroundPriority( true );
+		ScanThrottle::instance()->setAdaptiveBackoff( true );
+		break;
+
+	    case 'r':
+		ScanThrottle::instance()->setMaxOpsPerSec( atoi( optarg ) );
+		break;
+
+	    case 'c':
+		Statx::setUseCachedAttributes( true );
+		break;
+
+	    case 'j':
+		scanner.setThreads( atoi( optarg ) );
+		break;
+
+	    case 'b':
+		if ( scanBackendName( scanBackendFromName( optarg ) ) != optarg )
+		{
+		    usage();
+		    return 1;
+		}
+
+		scanner.setScanBackend( scanBackendFromName( optarg ) );
+		break;
+
+	    case 's':
+		{
+		    int index = 0;
+		    int count = 0;
+
+		    if ( sscanf( optarg, "%d/%d", &index, &count ) != 2 ||
+			 count < 1 || index < 0 || index >= count )
+		    {
+			usage();
+			return 1;
+		    }
+
+		    scanner.setShard( index, count );
+		}
+		break;
+
+	    case 'v':
+		verbose = true;
+		break;
+
+	    case 'l':	// qdirstat-cache-writer long format: not supported
+	    case 'd':	// qdirstat-cache-writer debug: see the log file
+		break;
+
+	    case 'h':
+	    default:
+		usage();
+		return opt == 'h' ? 0 : 1;
+	}
+    }
+
+    if ( optind >= argc || argc - optind > 2 )
+    {
+	usage();
+	return 1;
+    }
+
+    QString dirName = QFile::decodeName( argv[ optind ] );
+    QString cacheFileName;
+
+    if ( optind + 1 < argc )
+	cacheFileName = QFile::decodeName( argv[ optind + 1 ] );
+    else
+	cacheFileName = dirName + "/" + DEFAULT_CACHE_FILE_NAME;
+
+    bool ok = scanner.scan( dirName, cacheFileName );
+
+    if ( verbose && cacheFileName != "-" )
+    {
+	std::cout << "Wrote " << scanner.dirCount() << " directories and "
+		  << scanner.fileCount() << " other entries to "
+		  << qPrintable( cacheFileName ) << std::endl;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,138 @@
+# qmake .pro file for qdirstat/scan: qdirstat-scan, the headless scanner
+# that writes cache files, e.g. from cron jobs on servers.
+#
+# This uses the same classes as the qdirstat binary for reading directories
+# and writing cache files. It never opens a display, but some of those
+# classes (the settings helpers, the MIME categories) still need the Qt GUI
+# libraries.
+
+TEMPLATE	 = app
+
+QT		+= widgets
+CONFIG		+= debug console
+CONFIG		-= app_bundle
+DEPENDPATH	+= . ../src
+INCLUDEPATH	+= ../src
+MOC_DIR		 = .moc
+OBJECTS_DIR	 = .obj
+LIBS		+= -lz
+
+# Use io_uring for batched statx() calls if the kernel headers have it
+exists( /usr/include/linux/io_uring.h ):DEFINES += HAVE_IO_URING
+
+# Optional zstd compression of cache files
+exists( /usr/include/zstd.h ) {
+    DEFINES += HAVE_ZSTD
+    LIBS    += -lzstd
+}
+
+major_is_less_5 = $$find(QT_MAJOR_VERSION, [234])
+!isEmpty(major_is_less_5):DEFINES += 'Q_DECL_OVERRIDE=""'
+
+TARGET		 = qdirstat-scan
+TARGET.files	 = qdirstat-scan
+TARGET.path	 = /usr/bin
+INSTALLS	+= TARGET
+
+SOURCES	  = main.cpp			\
+	    ../src/BinaryCache.cpp	\
+	    ../src/CacheBudget.cpp	\
+	    ../src/CacheDiff.cpp	\
+	    ../src/CacheScanner.cpp	\
+	    ../src/CacheSnapshot.cpp	\
+	    ../src/CacheStream.cpp	\
+	    ../src/ChildColumns.cpp	\
+	    ../src/ColdSubtree.cpp	\
+	    ../src/CompactName.cpp	\
+	    ../src/DataColumns.cpp	\
+	    ../src/DirInfo.cpp		\
+	    ../src/DirReadJob.cpp	\
+	    ../src/DirReadTimes.cpp	\
+	    ../src/DirReadWorker.cpp	\
+	    ../src/DirTree.cpp		\
+	    ../src/DirTreeCache.cpp	\
+	    ../src/DirTreeWatcher.cpp	\
+	    ../src/DirentReader.cpp	\
+	    ../src/Exception.cpp	\
+	    ../src/ExcludeRules.cpp	\
+	    ../src/ExtentStats.cpp	\
+	    ../src/FileAgeStats.cpp	\
+	    ../src/FileInfo.cpp		\
+	    ../src/FileInfoIterator.cpp	\
+	    ../src/FileInfoSet.cpp	\
+	    ../src/FileInfoSorter.cpp	\
+	    ../src/FileSizeSketch.cpp	\
+	    ../src/InodeSet.cpp		\
+	    ../src/IoUringStat.cpp	\
+	    ../src/LogBuffer.cpp	\
+	    ../src/Logger.cpp		\
+	    ../src/MimeCategorizer.cpp	\
+	    ../src/MimeCategory.cpp	\
+	    ../src/MountPoints.cpp	\
+	    ../src/NameIndex.cpp	\
+	    ../src/NodePool.cpp		\
+	    ../src/OwnerTotals.cpp	\
+	    ../src/PrecomputedStats.cpp	\
+	    ../src/QuotaEstimates.cpp	\
+	    ../src/ScanMetrics.cpp	\
+	    ../src/ScanProgress.cpp	\
+	    ../src/ScanStats.cpp	\
+	    ../src/ScanThrottle.cpp	\
+	    ../src/Settings.cpp		\
+	    ../src/SettingsHelpers.cpp	\
+	    ../src/Statx.cpp		\
+	    ../src/SuffixIndex.cpp	\
+	    ../src/TreeSnapshot.cpp	\
+
+
+HEADERS	  =				\
+	    ../src/BinaryCache.h	\
+	    ../src/CacheBudget.h	\
+	    ../src/CacheDiff.h	\
+	    ../src/CacheScanner.h	\
+	    ../src/CacheSnapshot.h	\
+	    ../src/CacheStream.h	\
+	    ../src/ChildColumns.h	\
+	    ../src/ColdSubtree.h	\
+	    ../src/CompactName.h	\
+	    ../src/DataColumns.h	\
+	    ../src/DirInfo.h		\
+	    ../src/DirReadJob.h		\
+	    ../src/DirReadTimes.h	\
+	    ../src/DirReadWorker.h	\
+	    ../src/DirTree.h		\
+	    ../src/DirTreeCache.h	\
+	    ../src/DirTreeWatcher.h	\
+	    ../src/DirentReader.h	\
+	    ../src/Exception.h		\
+	    ../src/ExcludeRules.h	\
+	    ../src/ExtentStats.h	\
+	    ../src/FileAgeStats.h	\
+	    ../src/FileInfo.h		\
+	    ../src/FileInfoIterator.h	\
+	    ../src/FileInfoSet.h	\
+	    ../src/FileInfoSorter.h	\
+	    ../src/FileSizeSketch.h	\
+	    ../src/InodeSet.h		\
+	    ../src/IoUringStat.h	\
+	    ../src/ListMover.h		\
+	    ../src/LogBuffer.h	\
+	    ../src/Logger.h		\
+	    ../src/MimeCategorizer.h	\
+	    ../src/MimeCategory.h	\
+	    ../src/MountPoints.h	\
+	    ../src/NameIndex.h		\
+	    ../src/NodePool.h		\
+	    ../src/OwnerTotals.h	\
+	    ../src/PrecomputedStats.h	\
+	    ../src/QuotaEstimates.h	\
+	    ../src/ScanMetrics.h	\
+	    ../src/ScanProgress.h	\
+	    ../src/ScanStats.h	\
+	    ../src/ScanThrottle.h	\
+	    ../src/Settings.h		\
+	    ../src/SettingsHelpers.h	\
+	    ../src/Statx.h		\
+	    ../src/SuffixIndex.h	\
+	    ../src/TreeSnapshot.h	\
+	    ../src/Version.h		\
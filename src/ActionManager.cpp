@@ -39,8 +39,16 @@ void ActionManager::addWidgetTree( QObject * tree )
 }
 
 
-QAction * ActionManager::action( const QString & actionName )
+QAction * ActionManager::action( const QString & actionName, QWidget * context )
 {
+    if ( context && _widgetTrees.contains( context->window() ) )
+    {
+	QAction * action = context->window()->findChild<QAction *>( actionName );
+
+	if ( action )
+	    return action;
+    }
+
     foreach ( QPointer<QObject> tree, _widgetTrees )
     {
 	if ( tree ) // might be destroyed in the meantime
@@ -57,7 +65,9 @@ QAction * ActionManager::action( const QString & actionName )
 }
 
 
-bool ActionManager::addActions( QMenu * menu, const QStringList & actionNames )
+bool ActionManager::addActions( QMenu		    * menu,
+				const QStringList   & actionNames,
+				QWidget		    * context )
 {
     bool foundAll = true;
     CHECK_PTR( menu );
@@ -68,7 +78,7 @@ bool ActionManager::addActions( QMenu * menu, const QStringList & actionNames )
 	    menu->addSeparator();
 	else
 	{
-	    QAction * act = action( actionName );
+	    QAction * act = action( actionName, context );
 
 	    if ( act )
 		menu->addAction( act );
@@ -11,6 +11,7 @@
 #define ActionManager_h
 
 #include <QAction>
+#include <QWidget>
 #include <QList>
 #include <QPointer>
 
@@ -45,17 +46,23 @@ namespace QDirStat
 	/**
 	 * Search the known widget trees for the first QAction with the Qt
 	 * object name 'actionName'. Return 0 if there is no such QAction.
+	 *
+	 * If 'context' is non-null, the widget tree of its window is searched
+	 * first: With several main windows, each has its own actions.
 	 **/
-	QAction * action( const QString & actionName );
+	QAction * action( const QString & actionName, QWidget * context = 0 );
 
 	/**
 	 * Add all the actions in 'actionNames' to a menu. Return 'true' if
-	 * success, 'false' if any of the actions were not found.
+	 * success, 'false' if any of the actions were not found. 'context'
+	 * is the widget the menu is for (see action()).
 	 *
 	 * If an action name in actionNames starts with "---", a separator is
 	 * added to the menu instead of an action.
 	 **/
-	bool addActions( QMenu * menu, const QStringList & actionNames );
+	bool addActions( QMenu		   * menu,
+			 const QStringList & actionNames,
+			 QWidget	   * context = 0 );
 
 
     protected:
@@ -0,0 +1,685 @@
+/*
+ *   File name: BinaryCache.cpp
+ *   Summary:	Binary cache file format for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <string.h>
+#include <limits.h>
+#include <zlib.h>
+
+#include <QtEndian>
+
+#include "BinaryCache.h"
+#include "DirTreeCache.h"
+#include "DirReadJob.h"
+#include "DirInfo.h"
+#include "ExcludeRules.h"
+#include "Logger.h"
+#include "Exception.h"
+
+#define NoParent		0xFFFFFFFFU
+#define NODE_BUFFER_SIZE	( 1024 * 1024 )
+#define ZLIB_OUT_BUFFER_SIZE	( 64 * 1024 )
+
+using namespace QDirStat;
+
+
+Q_STATIC_ASSERT( sizeof( BinaryCacheHeader ) == 48 );
+Q_STATIC_ASSERT( sizeof( BinaryCacheNode   ) == 48 );
+
+
+
+BinaryCacheWriter::BinaryCacheWriter( const QString & fileName,
+				      DirTree	    * tree,
+				      bool	      compressed ):
+    _file( fileName ),
+    _compressed( compressed ),
+    _ok( false ),
+    _nodeCount( 0 ),
+    _dirCount( 0 ),
+    _bodySize( 0 ),
+    _zStream( 0 )
+{
+    _ok = writeCache( fileName, tree );
+}
+
+
+bool BinaryCacheWriter::isBinaryCacheName( const QString & fileName )
+{
+    return fileName.endsWith( BINARY_CACHE_SUFFIX ) ||
+	isCompressedBinaryCacheName( fileName );
+}
+
+
+bool BinaryCacheWriter::isCompressedBinaryCacheName( const QString & fileName )
+{
+    return fileName.endsWith( COMPRESSED_BINARY_CACHE_SUFFIX );
+}
+
+
+bool BinaryCacheWriter::writeCache( const QString & fileName, DirTree * tree )
+{
+    if ( ! tree || ! tree->root() )
+	return false;
+
+    tree->thaw();
+
+    if ( ! _file.open( QIODevice::WriteOnly | QIODevice::Truncate ) )
+    {
+	logError() << "Can't open " << fileName << ": " << _file.errorString() << endl;
+	return false;
+    }
+
+    // Write a placeholder for the header first; the real one is written
+    // when all the numbers are known.
+
+    BinaryCacheHeader header;
+    memset( &header, 0, sizeof( header ) );
+
+    if ( _file.write( (const char *) &header, sizeof( header ) ) != sizeof( header ) )
+    {
+	logError() << "Write error in " << fileName << ": " << _file.errorString() << endl;
+	return false;
+    }
+
+    z_stream zStream;
+
+    if ( _compressed )
+    {
+	memset( &zStream, 0, sizeof( zStream ) );
+
+	if ( deflateInit( &zStream, Z_DEFAULT_COMPRESSION ) != Z_OK )
+	{
+	    logError() << "Can't initialize zlib for " << fileName << endl;
+	    return false;
+	}
+
+	_zStream = &zStream;
+    }
+
+    _ok = true;
+    _nodes.reserve( NODE_BUFFER_SIZE );
+    addTree( tree->root()->firstChild(), NoParent );
+
+    writeBody( _nodes.constData(), _nodes.size() );
+    writeBody( _strings.constData(), _strings.size(), true ); // finish
+
+    if ( _compressed )
+    {
+	deflateEnd( &zStream );
+	_zStream = 0;
+    }
+
+    if ( _ok )
+    {
+	memcpy( header.magic, BINARY_CACHE_MAGIC, sizeof( header.magic ) );
+	header.version	       = qToLittleEndian<quint32>( BINARY_CACHE_VERSION );
+	header.flags	       = qToLittleEndian<quint32>( _compressed ? CompressedBody : 0 );
+	header.nodeCount       = qToLittleEndian<quint64>( _nodeCount );
+	header.dirCount	       = qToLittleEndian<quint64>( _dirCount );
+	header.stringTableSize = qToLittleEndian<quint64>( _strings.size() );
+	header.bodySize	       = qToLittleEndian<quint64>( _bodySize );
+
+	if ( ! _file.seek( 0 ) ||
+	     _file.write( (const char *) &header, sizeof( header ) ) != sizeof( header ) )
+	{
+	    logError() << "Write error in " << fileName << ": " << _file.errorString() << endl;
+	    _ok = false;
+	}
+    }
+
+    _file.close();
+    _strings.clear();
+    _nodes.clear();
+
+    return _ok;
+}
+
+
+void BinaryCacheWriter::addTree( FileInfo * item, quint32 parent )
+{
+    if ( ! item || ! _ok )
+	return;
+
+    if ( ! item->isDirInfo() || item->isDotEntry() )
+    {
+	addNode( item, item->compactName().toUtf8(), parent );
+	return;
+    }
+
+    // Only the toplevel directory uses its absolute path
+
+    QByteArray name = parent == NoParent ? item->url().toUtf8() : item->compactName().toUtf8();
+    addNode( item, name, parent );
+    quint32 dirNo = _dirCount++;
+
+    // Files
+
+    if ( item->dotEntry() )
+    {
+	FileInfo * child = item->dotEntry()->firstChild();
+
+	while ( child )
+	{
+	    addTree( child, dirNo );
+	    child = child->next();
+	}
+    }
+
+    // Subdirectories (and files that are not in a dot entry)
+
+    FileInfo * child = item->firstChild();
+
+    while ( child )
+    {
+	addTree( child, dirNo );
+	child = child->next();
+    }
+}
+
+
+void BinaryCacheWriter::addNode( FileInfo * item, const QByteArray & name, quint32 parent )
+{
+    mode_t mode = item->mode();
+
+    // Make sure the reader creates a DirInfo for every DirInfo, even for
+    // placeholders without a valid mode: Other nodes refer to it.
+
+    if ( item->isDirInfo() )
+	mode = ( mode & ~S_IFMT ) | S_IFDIR;
+
+    BinaryCacheNode node;
+    node.size	    = qToLittleEndian<qint64> ( item->size()   );
+    node.blocks	    = qToLittleEndian<qint64> ( item->blocks() );
+    node.mtime	    = qToLittleEndian<qint64> ( item->mtime()  );
+    node.nameOffset = qToLittleEndian<quint64>( _strings.size() );
+    node.parent	    = qToLittleEndian<quint32>( parent );
+    node.nameLen    = qToLittleEndian<quint32>( name.size() );
+    node.links	    = qToLittleEndian<quint32>( item->links() );
+    node.mode	    = qToLittleEndian<quint32>( mode );
+
+    _strings.append( name );
+    _nodes.append( (const char *) &node, sizeof( node ) );
+    ++_nodeCount;
+
+    if ( _nodes.size() >= NODE_BUFFER_SIZE )
+    {
+	writeBody( _nodes.constData(), _nodes.size() );
+	_nodes.resize( 0 ); // keeps the reserved capacity
+    }
+}
+
+
+bool BinaryCacheWriter::writeBody( const char * data, qint64 len, bool finish )
+{
+    if ( ! _ok )
+	return false;
+
+    if ( ! _zStream )
+    {
+	if ( len > 0 && _file.write( data, len ) != len )
+	{
+	    logError() << "Write error in " << _file.fileName() << ": " << _file.errorString() << endl;
+	    _ok = false;
+	}
+
+	_bodySize += len;
+
+	return _ok;
+    }
+
+    z_stream * zStream = static_cast<z_stream *>( _zStream );
+    char buffer[ ZLIB_OUT_BUFFER_SIZE ];
+
+    do
+    {
+	// zlib can only take an uInt in one go
+
+	qint64 chunkSize = qMin( len, (qint64) 1024 * 1024 * 1024 );
+	zStream->next_in  = (Bytef *) data;
+	zStream->avail_in = (uInt) chunkSize;
+	data += chunkSize;
+	len  -= chunkSize;
+
+	int flush = ( finish && len == 0 ) ? Z_FINISH : Z_NO_FLUSH;
+
+	do
+	{
+	    zStream->next_out  = (Bytef *) buffer;
+	    zStream->avail_out = sizeof( buffer );
+
+	    if ( deflate( zStream, flush ) == Z_STREAM_ERROR )
+	    {
+		logError() << "zlib error in " << _file.fileName() << endl;
+		_ok = false;
+		return false;
+	    }
+
+	    qint64 compressedLen = sizeof( buffer ) - zStream->avail_out;
+
+	    if ( _file.write( buffer, compressedLen ) != compressedLen )
+	    {
+		logError() << "Write error in " << _file.fileName() << ": " << _file.errorString() << endl;
+		_ok = false;
+		return false;
+	    }
+
+	    _bodySize += compressedLen;
+
+	} while ( zStream->avail_out == 0 );
+
+    } while ( len > 0 );
+
+    return _ok;
+}
+
+
+
+
+
+
+BinaryCacheReader::BinaryCacheReader( const QString & fileName,
+				      DirTree	    * tree,
+				      DirInfo	    * parent ):
+    QObject(),
+    _tree( tree ),
+    _toplevel( parent ),
+    _fileName( fileName ),
+    _file( fileName ),
+    _ok( false ),
+    _nodes( 0 ),
+    _strings( 0 ),
+    _nodeCount( 0 ),
+    _dirCount( 0 ),
+    _stringTableSize( 0 ),
+    _nextNode( 0 ),
+    _refresh( false )
+{
+    _ok = open();
+}
+
+
+BinaryCacheReader::~BinaryCacheReader()
+{
+    logDebug() << "Binary cache reading finished" << endl;
+
+    if ( _toplevel )
+    {
+	// finalizeAll() builds the child arrays for everything in parallel
+
+	_tree->setDeferChildArrays( true );
+	finalizeRecursive( _toplevel );
+	_tree->setDeferChildArrays( false );
+	_toplevel->finalizeAll();
+    }
+
+    emit finished();
+}
+
+
+bool BinaryCacheReader::isBinaryCache( const QString & fileName )
+{
+    QFile file( fileName );
+
+    if ( ! file.open( QIODevice::ReadOnly ) )
+	return false;
+
+    char magic[ sizeof( BinaryCacheHeader().magic ) ];
+
+    return file.read( magic, sizeof( magic ) ) == sizeof( magic ) &&
+	memcmp( magic, BINARY_CACHE_MAGIC, sizeof( magic ) ) == 0;
+}
+
+
+bool BinaryCacheReader::open()
+{
+    if ( ! _file.open( QIODevice::ReadOnly ) )
+    {
+	logError() << "Can't open " << _fileName << ": " << _file.errorString() << endl;
+	emit error();
+	return false;
+    }
+
+    qint64 fileSize = _file.size();
+
+    if ( fileSize < (qint64) sizeof( BinaryCacheHeader ) )
+    {
+	setError( "File too short" );
+	return false;
+    }
+
+    const uchar * data = _file.map( 0, fileSize );
+
+    if ( ! data )
+    {
+	setError( "Can't map file: " + _file.errorString() );
+	return false;
+    }
+
+    BinaryCacheHeader header;
+    memcpy( &header, data, sizeof( header ) );
+
+    if ( memcmp( header.magic, BINARY_CACHE_MAGIC, sizeof( header.magic ) ) != 0 )
+    {
+	setError( "Unknown file format" );
+	return false;
+    }
+
+    if ( qFromLittleEndian<quint32>( header.version ) != BINARY_CACHE_VERSION )
+    {
+	setError( "Incompatible cache file version" );
+	return false;
+    }
+
+    quint32 flags    = qFromLittleEndian<quint32>( header.flags	   );
+    quint64 bodySize = qFromLittleEndian<quint64>( header.bodySize );
+    _nodeCount	     = qFromLittleEndian<quint64>( header.nodeCount );
+    _dirCount	     = qFromLittleEndian<quint64>( header.dirCount  );
+    _stringTableSize = qFromLittleEndian<quint64>( header.stringTableSize );
+
+    quint64 nodeTableSize = _nodeCount * sizeof( BinaryCacheNode );
+
+    if ( bodySize > (quint64) fileSize - sizeof( header ) ||
+	 _nodeCount > ( 1ULL << 40 ) || _stringTableSize > ( 1ULL << 40 ) )
+    {
+	setError( "Invalid header" );
+	return false;
+    }
+
+    const char * body = (const char *) data + sizeof( header );
+
+    if ( flags & CompressedBody )
+    {
+	if ( nodeTableSize + _stringTableSize > (quint64) INT_MAX )
+	{
+	    setError( "Compressed body too large" );
+	    return false;
+	}
+
+	uLongf expandedSize = nodeTableSize + _stringTableSize;
+	_body.resize( expandedSize );
+
+	if ( uncompress( (Bytef *) _body.data(), &expandedSize, (const Bytef *) body, bodySize ) != Z_OK ||
+	     expandedSize != nodeTableSize + _stringTableSize )
+	{
+	    _body.clear();
+	    setError( "Corrupt compressed data" );
+	    return false;
+	}
+
+	_file.unmap( const_cast<uchar *>( data ) );
+	body = _body.constData();
+    }
+    else if ( bodySize != nodeTableSize + _stringTableSize )
+    {
+	setError( "Invalid body size" );
+	return false;
+    }
+
+    _nodes   = body;
+    _strings = body + nodeTableSize;
+    _dirs.reserve( _dirCount );
+
+    return true;
+}
+
+
+bool BinaryCacheReader::read( int maxNodes )
+{
+    while ( _ok && _nextNode < _nodeCount && maxNodes-- != 0 )
+	addNode( _nextNode++ );
+
+    return ! eof();
+}
+
+
+void BinaryCacheReader::rewind()
+{
+    _nextNode = 0;
+    _dirs.clear();
+    _refreshDirs.clear();
+}
+
+
+void BinaryCacheReader::queueRefreshJobs()
+{
+    foreach ( DirInfo * dir, _refreshDirs )
+    {
+	LocalDirReadJob * job = new LocalDirReadJob( _tree, dir );
+	CHECK_NEW( job );
+	job->setKeepExistingSubDirs( true );
+	_tree->addJob( job );
+    }
+
+    if ( ! _refreshDirs.isEmpty() )
+	logInfo() << "Rereading " << _refreshDirs.size() << " changed directories" << endl;
+
+    _refreshDirs.clear();
+}
+
+
+QString BinaryCacheReader::firstDir() const
+{
+    if ( ! _ok || _nodeCount == 0 )
+	return "";
+
+    BinaryCacheNode toplevel = node( 0 );
+
+    if ( ! S_ISDIR( toplevel.mode ) || toplevel.nameOffset + toplevel.nameLen > _stringTableSize )
+	return "";
+
+    return nodeName( toplevel );
+}
+
+
+BinaryCacheNode BinaryCacheReader::node( quint64 index ) const
+{
+    BinaryCacheNode node;
+    memcpy( &node, _nodes + index * sizeof( BinaryCacheNode ), sizeof( node ) );
+
+    node.size	    = qFromLittleEndian<qint64> ( node.size	  );
+    node.blocks	    = qFromLittleEndian<qint64> ( node.blocks	  );
+    node.mtime	    = qFromLittleEndian<qint64> ( node.mtime	  );
+    node.nameOffset = qFromLittleEndian<quint64>( node.nameOffset );
+    node.parent	    = qFromLittleEndian<quint32>( node.parent	  );
+    node.nameLen    = qFromLittleEndian<quint32>( node.nameLen	  );
+    node.links	    = qFromLittleEndian<quint32>( node.links	  );
+    node.mode	    = qFromLittleEndian<quint32>( node.mode	  );
+
+    return node;
+}
+
+
+QString BinaryCacheReader::nodeName( const BinaryCacheNode & node ) const
+{
+    return QString::fromUtf8( _strings + node.nameOffset, node.nameLen );
+}
+
+
+void BinaryCacheReader::addNode( quint64 index )
+{
+    BinaryCacheNode node = this->node( index );
+
+    if ( node.nameOffset + node.nameLen > _stringTableSize )
+    {
+	setError( QString( "Invalid name in node %1" ).arg( index ) );
+	return;
+    }
+
+    bool      isDir  = S_ISDIR( node.mode );
+    QString   name   = nodeName( node );
+    QString   path;	// Full path of the toplevel node
+    DirInfo * parent = 0;
+
+    if ( node.parent == NoParent )
+    {
+	if ( index != 0 || ! isDir )
+	{
+	    setError( QString( "Unexpected toplevel node %1" ).arg( index ) );
+	    return;
+	}
+
+	parent = toplevelParent( name );
+
+	if ( ! parent )
+	{
+	    setError( "Could not locate parent for " + name );
+	    return;
+	}
+
+	path = name;
+
+	if ( parent != _tree->root() )
+	    name = name.mid( name.lastIndexOf( '/' ) + 1 );
+    }
+    else
+    {
+	if ( node.parent >= (quint64) _dirs.size() )
+	{
+	    setError( QString( "Invalid parent in node %1" ).arg( index ) );
+	    return;
+	}
+
+	parent = _dirs.at( node.parent );
+
+	if ( ! parent )		// Somewhere below an excluded directory
+	{
+	    if ( isDir )
+		_dirs.append( 0 );
+
+	    return;
+	}
+    }
+
+    if ( isDir )
+    {
+	time_t mtime = node.mtime;
+	CachedDirStatus dirStatus = CachedDirUnchanged;
+
+	if ( _refresh )
+	{
+	    if ( path.isEmpty() )
+	    {
+		path = parent->url();
+
+		if ( ! path.endsWith( "/" ) )
+		    path += "/";
+
+		path += name;
+	    }
+
+	    dirStatus = CacheReader::checkCachedDir( path, node.mtime, mtime );
+
+	    if ( dirStatus == CachedDirGone )
+	    {
+		logDebug() << "Not on disk anymore: " << path << endl;
+		_dirs.append( 0 );
+		return;
+	    }
+	}
+
+	DirInfo * dir = new DirInfo( _tree, parent, name,
+				     node.mode, node.size, mtime );
+	CHECK_NEW( dir );
+	dir->setReadState( DirReading );
+	parent->insertChild( dir );
+
+	if ( ! _toplevel )
+	    _toplevel = dir;
+
+	_tree->childAddedNotify( dir );
+
+	if ( dirStatus == CachedDirChanged )
+	    _refreshDirs.insert( dir );	  // Read its entries from disk later instead
+
+	if ( dir != _toplevel && ExcludeRules::instance()->match( dir->url(), dir->name() ) )
+	{
+	    logDebug() << "Excluding " << name << endl;
+	    _refreshDirs.remove( dir );
+	    dir->setExcluded();
+	    dir->setReadState( DirOnRequestOnly );
+	    _tree->sendFinalizeLocal( dir );
+	    dir->finalizeLocal();
+	    _tree->sendReadJobFinished( dir );
+	    dir = 0;
+	}
+
+	_dirs.append( dir );
+    }
+    else
+    {
+	if ( _refreshDirs.contains( parent ) )
+	    return;
+
+	if ( _tree->aggregateOnly() )
+	{
+	    FileInfo item( _tree, parent, name,
+			   node.mode, node.size, node.mtime,
+			   node.blocks, node.links );
+	    parent->foldChild( &item );
+	    return;
+	}
+
+	FileInfo * item = new FileInfo( _tree, parent, name,
+					node.mode, node.size, node.mtime,
+					node.blocks, node.links );
+	CHECK_NEW( item );
+	parent->insertChild( item );
+	_tree->childAddedNotify( item );
+    }
+}
+
+
+DirInfo * BinaryCacheReader::toplevelParent( const QString & path )
+{
+    if ( ! _tree->root()->hasChildren() )
+	return _tree->root();
+
+    int	    slashPos   = path.lastIndexOf( '/' );
+    QString parentPath = slashPos > 0 ? path.left( slashPos ) : QString( "/" );
+    DirInfo * parent   = 0;
+
+    if ( _toplevel )
+	parent = dynamic_cast<DirInfo *>( _toplevel->locate( parentPath ) );
+
+    if ( ! parent )
+	parent = dynamic_cast<DirInfo *>( _tree->locate( parentPath ) );
+
+    return parent;
+}
+
+
+void BinaryCacheReader::finalizeRecursive( DirInfo * dir )
+{
+    if ( dir->readState() != DirOnRequestOnly )
+    {
+	if ( dir->readState() != DirError )
+	    dir->setReadState( DirCached );
+
+	_tree->sendFinalizeLocal( dir );
+	dir->finalizeLocal();
+	_tree->sendReadJobFinished( dir );
+    }
+
+    FileInfo * child = dir->firstChild();
+
+    while ( child )
+    {
+	if ( child->isDirInfo() )
+	    finalizeRecursive( child->toDirInfo() );
+
+	child = child->next();
+    }
+}
+
+
+void BinaryCacheReader::setError( const QString & msg )
+{
+    logError() << _fileName << ": " << msg << endl;
+    _ok = false;
+    emit error();
+}
@@ -0,0 +1,306 @@
+/*
+ *   File name: BinaryCache.h
+ *   Summary:	Binary cache file format for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef BinaryCache_h
+#define BinaryCache_h
+
+
+#include <QObject>
+#include <QFile>
+#include <QVector>
+#include <QByteArray>
+#include <QSet>
+
+#include "DirTree.h"
+
+
+#define BINARY_CACHE_SUFFIX		".qdcache"
+#define COMPRESSED_BINARY_CACHE_SUFFIX	".qdcache.z"
+#define BINARY_CACHE_MAGIC		"QDSCACHE"
+#define BINARY_CACHE_VERSION		1
+
+
+namespace QDirStat
+{
+    /**
+     * Binary QDirStat cache file format:
+     *
+     *	 BinaryCacheHeader
+     *	 Body:	 BinaryCacheNode[ nodeCount ]
+     *		 String table ( stringTableSize bytes of UTF-8 names )
+     *
+     * All numbers are little endian. The nodes are in the same order as
+     * in the text cache format: Each directory is followed by its files
+     * and then by its subdirectories, recursively. So a parent always
+     * comes before its children.
+     *
+     * Nodes refer to their parent by the number of the parent among all
+     * directory nodes in the file, and to their name by its offset in the
+     * string table. The name of the first (toplevel) node is its absolute
+     * path; all other names are without path.
+     *
+     * Without compression, the file can simply be memory-mapped and the
+     * nodes are used directly from the mapped memory. With the
+     * CompressedBody flag, the body is one zlib stream.
+     *
+     * The text format (see DirTreeCache.h) is still the default; it is
+     * what scripts like qdirstat-cache-writer understand.
+     **/
+    struct BinaryCacheHeader
+    {
+	char	magic[8];		// BINARY_CACHE_MAGIC without the 0 byte
+	quint32 version;
+	quint32 flags;
+	quint64 nodeCount;
+	quint64 dirCount;
+	quint64 stringTableSize;
+	quint64 bodySize;		// Size of the body in the file
+    };
+
+
+    struct BinaryCacheNode
+    {
+	qint64	size;
+	qint64	blocks;
+	qint64	mtime;
+	quint64 nameOffset;		// Offset in the string table
+	quint32 parent;			// Directory number of the parent
+	quint32 nameLen;
+	quint32 links;
+	quint32 mode;
+    };
+
+
+    enum BinaryCacheFlags
+    {
+	CompressedBody = 0x1
+    };
+
+
+    class BinaryCacheWriter
+    {
+    public:
+
+	/**
+	 * Write 'tree' to file 'fileName' in the binary cache format. If
+	 * 'compressed' is true, compress the body with zlib; such a file
+	 * cannot be memory-mapped.
+	 *
+	 * Check BinaryCacheWriter::ok() to see if writing went OK.
+	 **/
+	BinaryCacheWriter( const QString & fileName,
+			   DirTree	 * tree,
+			   bool		   compressed = false );
+
+	/**
+	 * Returns true if writing the cache file went OK.
+	 **/
+	bool ok() const { return _ok; }
+
+	/**
+	 * Return 'true' if 'fileName' is the name of a binary cache file
+	 * that should be written with this class rather than with the text
+	 * format CacheWriter.
+	 **/
+	static bool isBinaryCacheName( const QString & fileName );
+
+	/**
+	 * Return 'true' if 'fileName' is the name of a compressed binary
+	 * cache file.
+	 **/
+	static bool isCompressedBinaryCacheName( const QString & fileName );
+
+
+    protected:
+
+	/**
+	 * Write the cache file. Returns 'true' if OK, 'false' upon error.
+	 **/
+	bool writeCache( const QString & fileName, DirTree * tree );
+
+	/**
+	 * Add 'item' and everything below it to the body.
+	 **/
+	void addTree( FileInfo * item, quint32 parent );
+
+	/**
+	 * Add one node for 'item' with name 'name' to the body.
+	 **/
+	void addNode( FileInfo * item, const QByteArray & name, quint32 parent );
+
+	/**
+	 * Write 'len' bytes of the body, compressing them if requested.
+	 **/
+	bool writeBody( const char * data, qint64 len, bool finish = false );
+
+
+	//
+	// Data members
+	//
+
+	QFile		_file;
+	bool		_compressed;
+	bool		_ok;
+	QByteArray	_nodes;		// Node buffer, flushed when full
+	QByteArray	_strings;
+	quint64		_nodeCount;
+	quint64		_dirCount;
+	quint64		_bodySize;
+	void *		_zStream;
+    };
+
+
+
+    class BinaryCacheReader: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Open binary cache file 'fileName' for reading into 'tree'.
+	 *
+	 * If 'parent' is 0, the content of the cache file will replace all
+	 * current tree items.
+	 **/
+	BinaryCacheReader( const QString & fileName,
+			   DirTree	 * tree,
+			   DirInfo	 * parent = 0 );
+
+	/**
+	 * Destructor. This finalizes all directories read from the cache.
+	 **/
+	virtual ~BinaryCacheReader();
+
+	/**
+	 * Add at most 'maxNodes' nodes from the cache file to the tree (all
+	 * if 'maxNodes' is 0).
+	 *
+	 * Returns true if OK and there is more to read, false otherwise.
+	 **/
+	bool read( int maxNodes = 0 );
+
+	/**
+	 * Returns true if all nodes are read (or if there was an error).
+	 **/
+	bool eof() const { return ! _ok || _nextNode >= _nodeCount; }
+
+	/**
+	 * Returns true if reading the cache file is OK so far.
+	 **/
+	bool ok() const { return _ok; }
+
+	/**
+	 * Start reading from the first node again.
+	 **/
+	void rewind();
+
+	/**
+	 * Returns the absolute path of the toplevel directory of this cache
+	 * file or an empty string if there is none.
+	 **/
+	QString firstDir() const;
+
+	/**
+	 * Return 'true' if 'fileName' is a binary cache file, i.e. if it
+	 * starts with the binary cache magic.
+	 **/
+	static bool isBinaryCache( const QString & fileName );
+
+	/**
+	 * Set refresh mode: Compare each directory with the directory on
+	 * disk. See CacheReader::setRefresh() for details.
+	 **/
+	void setRefresh( bool refresh ) { _refresh = refresh; }
+
+	/**
+	 * Queue read jobs for all directories that changed on disk. Call
+	 * this when reading the cache file is finished.
+	 **/
+	void queueRefreshJobs();
+
+
+    signals:
+
+	/**
+	 * Emitted when reading this cache is finished.
+	 **/
+	void finished();
+
+	/**
+	 * Emitted if there is a read error.
+	 **/
+	void error();
+
+
+    protected:
+
+	/**
+	 * Map the file (or inflate its body) and check the header.
+	 **/
+	bool open();
+
+	/**
+	 * Add node no. 'index' to the tree.
+	 **/
+	void addNode( quint64 index );
+
+	/**
+	 * Return the name of 'node'.
+	 **/
+	QString nodeName( const BinaryCacheNode & node ) const;
+
+	/**
+	 * Return node no. 'index' converted to host byte order.
+	 **/
+	BinaryCacheNode node( quint64 index ) const;
+
+	/**
+	 * Find the tree item that should become the parent of the toplevel
+	 * directory 'path' of this cache.
+	 **/
+	DirInfo * toplevelParent( const QString & path );
+
+	/**
+	 * Recursively set the read state of all dirs from 'dir' on, send tree
+	 * signals and finalize local.
+	 **/
+	void finalizeRecursive( DirInfo * dir );
+
+	/**
+	 * Report an error and stop reading.
+	 **/
+	void setError( const QString & msg );
+
+
+	//
+	// Data members
+	//
+
+	DirTree *		_tree;
+	DirInfo *		_toplevel;
+	QString			_fileName;
+	QFile			_file;
+	bool			_ok;
+	QByteArray		_body;	   // Inflated body if compressed
+	const char *		_nodes;
+	const char *		_strings;
+	quint64			_nodeCount;
+	quint64			_dirCount;
+	quint64			_stringTableSize;
+	quint64			_nextNode;
+	QVector<DirInfo *>	_dirs;	   // 0 for excluded dirs
+	bool			_refresh;
+	QSet<DirInfo *>		_refreshDirs;
+    };
+
+}	// namespace QDirStat
+
+
+#endif // ifndef BinaryCache_h
@@ -0,0 +1,181 @@
+/*
+ *   File name: CacheBudget.cpp
+ *   Summary:	Memory budget for the sort caches and the treemap cushions
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QTimer>
+
+#include "CacheBudget.h"
+#include "DirInfo.h"
+#include "Logger.h"
+
+
+using namespace QDirStat;
+
+
+qint64 CacheBudget::_budget = 0;
+
+
+CacheBudget * CacheBudget::instance()
+{
+    static CacheBudget instance;
+
+    return &instance;
+}
+
+
+CacheBudget::CacheBudget():
+    QObject(),
+    _usedBytes( 0 ),
+    _evictions( 0 ),
+    _evictPending( false )
+{
+}
+
+
+void CacheBudget::setBudget( qint64 bytes )
+{
+    QMutexLocker locker( &_mutex );
+
+    _budget = qMax( bytes, 0LL );
+
+    if ( _budget == 0 )
+    {
+	_lru.clear();
+	_index.clear();
+	_usedBytes = 0;
+    }
+    else
+    {
+	logInfo() << "Budget for sort caches and cushions: " << formatSize( _budget ) << endl;
+    }
+}
+
+
+/**
+ * Drop the sort cache of directory 'dir'.
+ **/
+static void dropSortCache( void * dir )
+{
+    static_cast<DirInfo *>( dir )->dropSortCache();
+}
+
+
+void CacheBudget::touch( DirInfo * dir )
+{
+    // The size-sorted children are not dropped here, so they don't count
+
+    touch( dir, SortCache, dir->sortCacheBytes( false ), dropSortCache );
+}
+
+
+void CacheBudget::touch( void *	      owner,
+			 CacheType    type,
+			 qint64	      bytes,
+			 DropFunction drop )
+{
+    if ( ! isEnabled() )
+	return;
+
+    QMutexLocker locker( &_mutex );
+    QHash<void *, EntryList::iterator>::iterator it = _index.find( owner );
+
+    if ( it != _index.end() )
+    {
+	EntryList::iterator entry = it.value();
+	_usedBytes += bytes - entry->bytes;
+	entry->bytes = bytes;
+
+	if ( entry != _lru.begin() )
+	    _lru.splice( _lru.begin(), _lru, entry );
+    }
+    else
+    {
+	Entry entry;
+	entry.owner = owner;
+	entry.type  = type;
+	entry.bytes = bytes;
+	entry.drop  = drop;
+
+	_lru.push_front( entry );
+	_index.insert( owner, _lru.begin() );
+	_usedBytes += bytes;
+    }
+
+    if ( _usedBytes > _budget && ! _evictPending )
+    {
+	_evictPending = true;
+	QTimer::singleShot( 0, this, SLOT( evict() ) );
+    }
+}
+
+
+void CacheBudget::remove( void * owner )
+{
+    // This is also called from the destructors of a subtree that is deleted
+    // in a worker thread.
+
+    QMutexLocker locker( &_mutex );
+    QHash<void *, EntryList::iterator>::iterator it = _index.find( owner );
+
+    if ( it == _index.end() )
+	return;
+
+    _usedBytes -= it.value()->bytes;
+    _lru.erase( it.value() );
+    _index.erase( it );
+}
+
+
+void CacheBudget::evict()
+{
+    QMutexLocker locker( &_mutex );
+    _evictPending = false;
+
+    if ( ! isEnabled() || _usedBytes <= _budget )
+	return;
+
+    qint64 lowWater = _budget / 4 * 3;
+    qint64 before   = _usedBytes;
+    int	   dropped  = 0;
+    bool   sortCachesDropping = false;
+
+    while ( _usedBytes > lowWater && ! _lru.empty() )
+    {
+	// Take the entry out of the list first and unlock while dropping the
+	// cache: That calls remove() again.
+
+	Entry entry = _lru.back();
+	_lru.pop_back();
+	_index.remove( entry.owner );
+	_usedBytes -= entry.bytes;
+	++dropped;
+	locker.unlock();
+
+	if ( entry.type == SortCache && ! sortCachesDropping )
+	{
+	    sortCachesDropping = true;
+	    emit aboutToDropSortCaches();
+	}
+
+	entry.drop( entry.owner );
+
+	locker.relock();
+    }
+
+    _evictions += dropped;
+
+    logInfo() << "Dropped " << dropped << " caches with "
+	      << formatSize( before - _usedBytes ) << "; "
+	      << formatSize( _usedBytes ) << " in " << _index.size() << " caches left"
+	      << endl;
+
+    locker.unlock();
+
+    if ( sortCachesDropping )
+	emit sortCachesDropped();
+}
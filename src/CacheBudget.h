@@ -0,0 +1,184 @@
+/*
+ *   File name: CacheBudget.h
+ *   Summary:	Memory budget for the sort caches and the treemap cushions
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef CacheBudget_h
+#define CacheBudget_h
+
+
+#include <list>
+
+#include <QObject>
+#include <QHash>
+#include <QMutex>
+
+
+namespace QDirStat
+{
+    class DirInfo;
+
+
+    /**
+     * Memory budget for caches that are only built on demand and that can
+     * be built again at any time: The sorted children of the directories
+     * that the tree view has seen and the cushion pixmaps of the treemap
+     * tiles that were painted. Without a limit, they accumulate while the
+     * user navigates a huge tree for a long time.
+     *
+     * Each cache is kept in a LRU list when it is used. The owners tell
+     * the budget the size of their cache and how to drop it, so this
+     * doesn't depend on the classes that own them. When the total is
+     * over the budget, the least recently used ones are dropped down to
+     * 3/4 of the budget. This is deferred to the event loop, so nobody
+     * loses a cache that is just being used; the DirTreeModel is told
+     * before and after that with signals since it needs to update its
+     * persistent model indexes.
+     *
+     * Caches are only used and dropped in the main thread: The size-sorted
+     * children that the treemap layout might use in worker threads are
+     * not tracked. But remove() is also called when a DirInfo is
+     * destroyed, and subtrees are deleted in a worker thread (see
+     * DirTree::deleteInBackground()), so the tracking itself is protected
+     * by a mutex.
+     *
+     * This is a singleton. Use instance() to get it.
+     **/
+    class CacheBudget: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Return the singleton.
+	 **/
+	static CacheBudget * instance();
+
+	/**
+	 * Return 'true' if there is a budget at all. This is the cheap check
+	 * before calling any of the other methods.
+	 **/
+	static bool isEnabled() { return _budget > 0; }
+
+	/**
+	 * Return the budget in bytes. 0 means unlimited.
+	 **/
+	static qint64 budget() { return _budget; }
+
+	/**
+	 * Set the budget in bytes. 0 means unlimited; this also forgets all
+	 * caches that are tracked.
+	 **/
+	void setBudget( qint64 bytes );
+
+	enum CacheType
+	{
+	    SortCache,		// Before dropping those, the model is told
+	    OtherCache
+	};
+
+	/**
+	 * Function that drops the cache of 'owner'.
+	 **/
+	typedef void (*DropFunction)( void * owner );
+
+	/**
+	 * Notification that the sort cache of 'dir' was just used.
+	 **/
+	void touch( DirInfo * dir );
+
+	/**
+	 * Notification that the cache of 'owner' with 'bytes' bytes was just
+	 * used: Move it to the front of the LRU list or add it there. 'drop'
+	 * will be called in the main thread to drop it when it is evicted.
+	 **/
+	void touch( void *	 owner,
+		    CacheType	 type,
+		    qint64	 bytes,
+		    DropFunction drop );
+
+	/**
+	 * Forget 'owner' because its cache was dropped or because it is
+	 * destroyed.
+	 **/
+	void remove( void * owner );
+
+	/**
+	 * Return the bytes of all caches that are tracked.
+	 **/
+	qint64 usedBytes() const { return _usedBytes; }
+
+	/**
+	 * Return the number of caches that are tracked.
+	 **/
+	int count() const { return _index.size(); }
+
+	/**
+	 * Return the number of caches that were dropped to stay within the
+	 * budget so far.
+	 **/
+	int evictions() const { return _evictions; }
+
+
+    signals:
+
+	/**
+	 * Emitted before sort caches are dropped.
+	 **/
+	void aboutToDropSortCaches();
+
+	/**
+	 * Emitted after sort caches were dropped.
+	 **/
+	void sortCachesDropped();
+
+
+    protected slots:
+
+	/**
+	 * Drop the least recently used caches until the total is below 3/4
+	 * of the budget.
+	 **/
+	void evict();
+
+
+    protected:
+
+	struct Entry
+	{
+	    void *	 owner;
+	    CacheType	 type;
+	    qint64	 bytes;
+	    DropFunction drop;
+	};
+
+	typedef std::list<Entry> EntryList;
+
+	/**
+	 * Constructor. Use instance() instead.
+	 **/
+	CacheBudget();
+
+
+	// Data members
+
+	static qint64				_budget;
+
+	EntryList				_lru;		// Most recent first
+	QHash<void *, EntryList::iterator>	_index;
+	qint64					_usedBytes;
+	int					_evictions;
+	bool					_evictPending;
+	QMutex					_mutex;
+
+    };	// class CacheBudget
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef CacheBudget_h
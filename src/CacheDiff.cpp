@@ -0,0 +1,351 @@
+/*
+ *   File name: CacheDiff.cpp
+ *   Summary:	Comparing a DirTree with an older cache file
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <sys/stat.h>
+
+#include <QVector>
+
+#include "CacheDiff.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "DirTreeCache.h"
+#include "BinaryCache.h"
+#include "FileInfoIterator.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+namespace
+{
+    /**
+     * Cache reader that doesn't add anything to the tree: It only sums up
+     * the totals of each directory of the cache file and hands them to
+     * the CacheDiff.
+     **/
+    class CacheDiffReader: public CacheReader
+    {
+    public:
+
+	CacheDiffReader( const QString &		    fileName,
+			 DirTree *			    tree,
+			 QHash<DirInfo *, CacheDiffEntry> & oldDirs ):
+	    CacheReader( fileName, tree, 0 ),
+	    _oldDirs( oldDirs )
+	    {}
+
+	/**
+	 * Finish all directories that are still open.
+	 **/
+	void finish() { closeDirs( QString() ); }
+
+    protected:
+
+	struct OpenDir
+	{
+	    QString   url;
+	    DirInfo * dir;	// The same directory in the tree (or 0)
+	    FileSize  totalSize;
+	    int	      totalFiles;
+	};
+
+	/**
+	 * Sum up 'record' instead of adding it to the tree.
+	 *
+	 * Reimplemented from CacheReader.
+	 **/
+	virtual void addItem( const CacheRecord & record ) Q_DECL_OVERRIDE
+	{
+	    if ( record.syntaxError )
+		return;
+
+	    if ( record.isDir )
+	    {
+		QString url = buildPath( record.path, record.name );
+		closeDirs( url );
+
+		OpenDir openDir;
+		openDir.url	   = url;
+		openDir.dir	   = findDir( url, record.name );
+		openDir.totalSize  = record.size;
+		openDir.totalFiles = 0;
+		_openDirs.append( openDir );
+
+		return;
+	    }
+
+	    if ( record.absolutePath )
+		closeDirs( record.path );
+
+	    if ( _openDirs.isEmpty() )
+		return;
+
+	    OpenDir & openDir = _openDirs.last();
+	    openDir.totalSize += record.size;
+
+	    if ( S_ISREG( record.mode ) )
+		++openDir.totalFiles;
+	}
+
+	/**
+	 * Return the directory 'url' in the tree or 0 if it is not there.
+	 **/
+	DirInfo * findDir( const QString & url, const QString & name )
+	{
+	    FileInfo * item = 0;
+
+	    if ( ! _openDirs.isEmpty() && _openDirs.last().dir )
+		item = _openDirs.last().dir->findChild( name );
+	    else if ( _tree->firstToplevel() && _tree->firstToplevel()->url() == url )
+		item = _tree->firstToplevel();	// Where the tree starts
+
+	    if ( item && item->isDirInfo() && ! item->isDotEntry() )
+		return item->toDirInfo();
+
+	    return 0;
+	}
+
+	/**
+	 * Finish all open directories that are not ancestors of 'url'. The
+	 * subtree of a directory is complete when the cache file continues
+	 * with anything outside of it.
+	 **/
+	void closeDirs( const QString & url )
+	{
+	    while ( ! _openDirs.isEmpty() )
+	    {
+		const OpenDir & openDir = _openDirs.last();
+		QString prefix = openDir.url.endsWith( "/" ) ? openDir.url : openDir.url + "/";
+
+		if ( ! url.isEmpty() && ( url == openDir.url || url.startsWith( prefix ) ) )
+		    return;
+
+		if ( openDir.dir )
+		{
+		    CacheDiffEntry entry;
+		    entry.totalSize  = openDir.totalSize;
+		    entry.totalFiles = openDir.totalFiles;
+		    _oldDirs.insert( openDir.dir, entry );
+		}
+
+		FileSize totalSize  = openDir.totalSize;
+		int	 totalFiles = openDir.totalFiles;
+		_openDirs.removeLast();
+
+		if ( ! _openDirs.isEmpty() )
+		{
+		    _openDirs.last().totalSize	+= totalSize;
+		    _openDirs.last().totalFiles += totalFiles;
+		}
+	    }
+	}
+
+
+	QHash<DirInfo *, CacheDiffEntry> & _oldDirs;
+	QVector<OpenDir>		   _openDirs;
+    };
+
+}	// namespace
+
+
+
+
+CacheDiff::CacheDiff( DirTree * tree ):
+    QObject( tree ),
+    _tree( tree )
+{
+    CHECK_PTR( _tree );
+
+    connect( _tree, SIGNAL( deletingChild  ( FileInfo * ) ),
+	     this,  SLOT  ( deletingChild  ( FileInfo * ) ) );
+
+    connect( _tree, SIGNAL( clearingSubtree( DirInfo *	) ),
+	     this,  SLOT  ( clearingSubtree( DirInfo *	) ) );
+
+    connect( _tree, SIGNAL( clearing() ),
+	     this,  SLOT  ( clear()    ) );
+}
+
+
+CacheDiff::~CacheDiff()
+{
+    // NOP
+}
+
+
+bool CacheDiff::load( const QString & fileName )
+{
+    clear();
+
+    if ( BinaryCacheReader::isBinaryCache( fileName ) )
+    {
+	logError() << "Can't compare with binary cache file " << fileName << endl;
+	return false;
+    }
+
+    _fileName = fileName;
+    logInfo() << "Comparing with " << fileName << endl;
+
+    CacheDiffReader reader( fileName, _tree, _oldDirs );
+
+    if ( ! reader.ok() )
+	return false;
+
+    while ( reader.read( 0 ) )
+    {
+	// Read everything
+    }
+
+    reader.finish();
+
+    logInfo() << "Found " << _oldDirs.size() << " directories in " << fileName << endl;
+
+    return reader.ok();
+}
+
+
+void CacheDiff::clear()
+{
+    // Assigning an empty hash frees the memory right away
+
+    _oldDirs = QHash<DirInfo *, CacheDiffEntry>();
+}
+
+
+bool CacheDiff::contains( FileInfo * dir ) const
+{
+    return dir && dir->isDirInfo() && _oldDirs.contains( dir->toDirInfo() );
+}
+
+
+FileSize CacheDiff::sizeDelta( FileInfo * dir ) const
+{
+    if ( ! dir || ! dir->isDirInfo() || dir->isDotEntry() )
+	return 0;
+
+    QHash<DirInfo *, CacheDiffEntry>::const_iterator it = _oldDirs.find( dir->toDirInfo() );
+
+    if ( it == _oldDirs.end() )
+	return dir->totalSize();
+
+    return dir->totalSize() - it.value().totalSize;
+}
+
+
+int CacheDiff::filesDelta( FileInfo * dir ) const
+{
+    if ( ! dir || ! dir->isDirInfo() || dir->isDotEntry() )
+	return 0;
+
+    QHash<DirInfo *, CacheDiffEntry>::const_iterator it = _oldDirs.find( dir->toDirInfo() );
+
+    if ( it == _oldDirs.end() )
+	return dir->totalFiles();
+
+    return dir->totalFiles() - it.value().totalFiles;
+}
+
+
+QString CacheDiff::growthText( FileInfo * item ) const
+{
+    if ( ! item || ! item->isDirInfo() || item->isDotEntry() )
+	return QString();
+
+    if ( ! contains( item ) )
+	return tr( "New" );
+
+    FileSize delta = sizeDelta( item );
+
+    if ( delta > 0 )
+	return "+" + formatSize( delta );
+
+    if ( delta < 0 )
+	return "-" + formatSize( -delta );
+
+    return formatSize( 0 );
+}
+
+
+QColor CacheDiff::growthColor( FileInfo * file ) const
+{
+    DirInfo * dir = dirOf( file );
+
+    if ( ! dir )
+	return QColor( 0x80, 0x80, 0x80 );
+
+    QHash<DirInfo *, CacheDiffEntry>::const_iterator it = _oldDirs.find( dir );
+
+    if ( it == _oldDirs.end() )
+	return QColor( 0xff, 0x00, 0x00 );	// New
+
+    FileSize oldSize = qMax( it.value().totalSize, 1LL );
+    float    ratio   = (float) ( dir->totalSize() - it.value().totalSize ) / oldSize;
+    ratio = qBound( -1.0f, ratio, 1.0f );
+
+    if ( ratio >= 0.0 )	// grey to red
+	return QColor( 0x80 + (int) ( 0x7f * ratio ),
+		       0x80 - (int) ( 0x80 * ratio ),
+		       0x80 - (int) ( 0x80 * ratio ) );
+    else		// grey to green
+	return QColor( 0x80 + (int) ( 0x80 * ratio ),
+		       0x80 - (int) ( 0x40 * ratio ),
+		       0x80 + (int) ( 0x80 * ratio ) );
+}
+
+
+DirInfo * CacheDiff::dirOf( FileInfo * item ) const
+{
+    while ( item && ( ! item->isDirInfo() || item->isDotEntry() ) )
+	item = item->parent();
+
+    return item ? item->toDirInfo() : 0;
+}
+
+
+void CacheDiff::deletingChild( FileInfo * child )
+{
+    if ( child && ! _oldDirs.isEmpty() )
+	removeSubtree( child );
+}
+
+
+void CacheDiff::clearingSubtree( DirInfo * subtree )
+{
+    if ( ! subtree || _oldDirs.isEmpty() )
+	return;
+
+    // The subtree itself remains; only its children are deleted.
+
+    FileInfoIterator it( subtree );
+
+    while ( *it )
+    {
+	removeSubtree( *it );
+	++it;
+    }
+}
+
+
+void CacheDiff::removeSubtree( FileInfo * subtree )
+{
+    if ( ! subtree->isDirInfo() )
+	return;
+
+    _oldDirs.remove( subtree->toDirInfo() );
+
+    FileInfoIterator it( subtree );
+
+    while ( *it )
+    {
+	removeSubtree( *it );
+	++it;
+    }
+}
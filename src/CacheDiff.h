@@ -0,0 +1,164 @@
+/*
+ *   File name: CacheDiff.h
+ *   Summary:	Comparing a DirTree with an older cache file
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef CacheDiff_h
+#define CacheDiff_h
+
+
+#include <QObject>
+#include <QHash>
+#include <QString>
+#include <QColor>
+
+#include "FileInfo.h"	// FileSize
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class DirInfo;
+
+
+    /**
+     * The totals of one directory in the older cache file.
+     **/
+    struct CacheDiffEntry
+    {
+	FileSize totalSize;
+	int	 totalFiles;
+    };
+
+
+    /**
+     * Comparison of a DirTree with an older snapshot of it in a cache file,
+     * e.g. to find out what grew since last week.
+     *
+     * The older cache file is never read into a tree: It is streamed, and
+     * only the totals of each directory are kept, and only for the
+     * directories that are also in the tree. Since the cache file has each
+     * directory followed by its complete subtree, the totals of the
+     * directories can be summed up on the way with just a stack of the
+     * directories that are still open.
+     *
+     * Directories that are not in the older cache file are new; what is
+     * only in the older cache file shows up as a smaller total of a
+     * directory that still exists.
+     *
+     * Use DirTree::compareWithCache() to create the comparison for a tree.
+     **/
+    class CacheDiff: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor. The comparison is a child of 'tree'.
+	 **/
+	CacheDiff( DirTree * tree );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~CacheDiff();
+
+	/**
+	 * Read the older cache file 'fileName' and compare it with the tree.
+	 * Returns 'true' if OK, 'false' upon error. Binary cache files are
+	 * not supported.
+	 **/
+	bool load( const QString & fileName );
+
+	/**
+	 * Return the name of the older cache file.
+	 **/
+	const QString & fileName() const { return _fileName; }
+
+	/**
+	 * Return 'true' if 'dir' was in the older cache file.
+	 **/
+	bool contains( FileInfo * dir ) const;
+
+	/**
+	 * Return the growth of the total size of directory 'dir' since the
+	 * older cache file; for a directory that is new, this is its total
+	 * size. For files, this is 0.
+	 **/
+	FileSize sizeDelta( FileInfo * dir ) const;
+
+	/**
+	 * Return the growth of the number of files in directory 'dir' since
+	 * the older cache file.
+	 **/
+	int filesDelta( FileInfo * dir ) const;
+
+	/**
+	 * Return the text for the "Growth" column of the tree view for
+	 * 'item': The size delta with a sign or "New" for a directory that
+	 * is new and an empty string for files.
+	 **/
+	QString growthText( FileInfo * item ) const;
+
+	/**
+	 * Return the color for a treemap tile of 'file' by the growth of
+	 * its directory: From grey (no change) to red (it doubled or it is
+	 * new) for growing and to green for shrinking directories.
+	 **/
+	QColor growthColor( FileInfo * file ) const;
+
+	/**
+	 * Return the number of directories of the tree that were found in
+	 * the older cache file.
+	 **/
+	int size() const { return _oldDirs.size(); }
+
+    public slots:
+
+	/**
+	 * Forget everything about the older cache file.
+	 **/
+	void clear();
+
+    protected slots:
+
+	/**
+	 * Forget the directories of a subtree that is being deleted.
+	 **/
+	void deletingChild( FileInfo * child );
+
+	/**
+	 * Forget the directories below a subtree that is being cleared.
+	 **/
+	void clearingSubtree( DirInfo * subtree );
+
+    protected:
+
+	/**
+	 * Forget 'subtree' and all directories below it.
+	 **/
+	void removeSubtree( FileInfo * subtree );
+
+	/**
+	 * Return the directory that 'item' belongs to for growthColor().
+	 **/
+	DirInfo * dirOf( FileInfo * item ) const;
+
+
+	// Data members
+
+	DirTree *			   _tree;
+	QString				   _fileName;
+	QHash<DirInfo *, CacheDiffEntry>   _oldDirs;
+
+    };	// class CacheDiff
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef CacheDiff_h
@@ -0,0 +1,380 @@
+/*
+ *   File name: CacheReport.cpp
+ *   Summary:	Text or JSON summary of a cache file without a DirTree
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <sys/stat.h>
+#include <algorithm>
+
+#include <QStringList>
+#include <QVector>
+#include <QPair>
+
+#include "CacheReport.h"
+#include "DirTreeCache.h"
+#include "BinaryCache.h"
+#include "MimeCategory.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+#define OTHER_CATEGORY	"Other"
+
+
+using namespace QDirStat;
+
+
+namespace
+{
+    /**
+     * Cache reader that doesn't build a tree: It sums up the totals of
+     * each directory while it is open and hands it to the CacheReport
+     * when its subtree is complete.
+     **/
+    class CacheReportReader: public CacheReader
+    {
+    public:
+
+	CacheReportReader( const QString & fileName, CacheReport * report ):
+	    CacheReader( fileName, 0, 0 ),
+	    _report( report )
+	    {}
+
+	/**
+	 * Finish all directories that are still open.
+	 **/
+	void finish() { closeDirs( QString() ); }
+
+    protected:
+
+	struct OpenDir
+	{
+	    CacheReportDir dir;
+	    int		   reportIndex;
+	};
+
+	/**
+	 * Sum up 'record' instead of adding it to a tree.
+	 *
+	 * Reimplemented from CacheReader.
+	 **/
+	virtual void addItem( const CacheRecord & record ) Q_DECL_OVERRIDE
+	{
+	    if ( record.syntaxError )
+		return;
+
+	    if ( record.isDir )
+	    {
+		QString url = buildPath( record.path, record.name );
+		closeDirs( url );
+
+		OpenDir openDir;
+		openDir.dir.url	      = url;
+		openDir.dir.depth     = _openDirs.size();
+		openDir.dir.totalSize = record.size;
+		openDir.reportIndex   = _report->reserveDir( url, openDir.dir.depth );
+		_openDirs.append( openDir );
+
+		return;
+	    }
+
+	    if ( record.absolutePath )
+		closeDirs( record.path );
+
+	    _report->addFile( record.name, record.size );
+
+	    if ( _openDirs.isEmpty() )
+		return;
+
+	    CacheReportDir & dir = _openDirs.last().dir;
+	    dir.totalSize += record.size;
+
+	    if ( S_ISREG( record.mode ) )
+		++dir.totalFiles;
+	}
+
+	/**
+	 * Finish all open directories that are not ancestors of 'url'.
+	 **/
+	void closeDirs( const QString & url )
+	{
+	    while ( ! _openDirs.isEmpty() )
+	    {
+		const OpenDir & openDir = _openDirs.last();
+		const QString & dirUrl	= openDir.dir.url;
+		QString prefix = dirUrl.endsWith( "/" ) ? dirUrl : dirUrl + "/";
+
+		if ( ! url.isEmpty() && ( url == dirUrl || url.startsWith( prefix ) ) )
+		    return;
+
+		CacheReportDir dir = openDir.dir;
+		_report->addDir( dir, openDir.reportIndex );
+		_openDirs.removeLast();
+
+		if ( ! _openDirs.isEmpty() )
+		{
+		    CacheReportDir & parent = _openDirs.last().dir;
+		    parent.totalSize	+= dir.totalSize;
+		    parent.totalFiles	+= dir.totalFiles;
+		    parent.totalSubDirs += dir.totalSubDirs + 1;
+		}
+	    }
+	}
+
+
+	CacheReport *	  _report;
+	QVector<OpenDir>  _openDirs;
+    };
+
+
+    /**
+     * Compare two type totals by size in descending order.
+     **/
+    bool largerType( const QPair<QString, FileTypeTotal> & a,
+		     const QPair<QString, FileTypeTotal> & b )
+    {
+	return a.second.sum > b.second.sum;
+    }
+
+}	// namespace
+
+
+
+
+CacheReport::CacheReport():
+    _maxDepth( 1 ),
+    _topCount( 10 )
+{
+    // NOP
+}
+
+
+bool CacheReport::read( const QString & fileName )
+{
+    if ( BinaryCacheReader::isBinaryCache( fileName ) )
+    {
+	logError() << "Can't make a report of binary cache file " << fileName << endl;
+	return false;
+    }
+
+    CacheReportReader reader( fileName, this );
+
+    if ( ! reader.ok() )
+	return false;
+
+    while ( reader.read( 0 ) )
+    {
+	// Read everything
+    }
+
+    reader.finish();
+
+    return reader.ok();
+}
+
+
+int CacheReport::reserveDir( const QString & url, int depth )
+{
+    if ( depth > _maxDepth )
+	return -1;
+
+    CacheReportDir dir;
+    dir.url   = url;
+    dir.depth = depth;
+    _dirs.append( dir );
+
+    return _dirs.size() - 1;
+}
+
+
+void CacheReport::addDir( const CacheReportDir & dir, int reportIndex )
+{
+    if ( reportIndex >= 0 && reportIndex < _dirs.size() )
+	_dirs[ reportIndex ] = dir;
+
+    if ( dir.depth == 0 )
+    {
+	// Merged cache files can have more than one toplevel directory
+
+	if ( _toplevel.url.isEmpty() )
+	    _toplevel = dir;
+	else
+	{
+	    _toplevel.totalSize	   += dir.totalSize;
+	    _toplevel.totalFiles   += dir.totalFiles;
+	    _toplevel.totalSubDirs += dir.totalSubDirs + 1;
+	}
+    }
+
+    if ( _topCount <= 0 )
+	return;
+
+    if ( _largest.size() >= _topCount && dir.totalSize <= _largest.last().totalSize )
+	return;
+
+    int pos = _largest.size();
+
+    while ( pos > 0 && _largest.at( pos - 1 ).totalSize < dir.totalSize )
+	--pos;
+
+    _largest.insert( pos, dir );
+
+    if ( _largest.size() > _topCount )
+	_largest.removeLast();
+}
+
+
+void CacheReport::addFile( const QString & name, FileSize size )
+{
+    MimeCategory * category = _mimeCategorizer.category( name );
+    FileTypeTotal & total = _types[ category ? category->name() : QString( OTHER_CATEGORY ) ];
+
+    total.sum += size;
+    total.count++;
+}
+
+
+QList<QPair<QString, FileTypeTotal> > CacheReport::sortedTypes() const
+{
+    QList<QPair<QString, FileTypeTotal> > types;
+
+    for ( QHash<QString, FileTypeTotal>::const_iterator it = _types.constBegin();
+	  it != _types.constEnd();
+	  ++it )
+    {
+	types << qMakePair( it.key(), it.value() );
+    }
+
+    std::sort( types.begin(), types.end(), largerType );
+
+    return types;
+}
+
+
+QString CacheReport::text() const
+{
+    QStringList lines;
+
+    lines << _toplevel.url
+	  << QString( "Total size:   %1" ).arg( formatSize( _toplevel.totalSize ) )
+	  << QString( "Files:        %1" ).arg( _toplevel.totalFiles )
+	  << QString( "Directories:  %1" ).arg( _toplevel.totalSubDirs )
+	  << ""
+	  << QString( "Directories down to depth %1:" ).arg( _maxDepth );
+
+    foreach ( const CacheReportDir & dir, _dirs )
+    {
+	lines << QString( "%1 %2 files  %3%4" )
+	    .arg( formatSize( dir.totalSize ), 10 )
+	    .arg( dir.totalFiles, 9 )
+	    .arg( QString( 2 * dir.depth, ' ' ) )
+	    .arg( dir.url );
+    }
+
+    lines << ""
+	  << QString( "Largest directories:" );
+
+    foreach ( const CacheReportDir & dir, _largest )
+    {
+	lines << QString( "%1 %2 files  %3" )
+	    .arg( formatSize( dir.totalSize ), 10 )
+	    .arg( dir.totalFiles, 9 )
+	    .arg( dir.url );
+    }
+
+    lines << ""
+	  << QString( "File types:" );
+
+    typedef QPair<QString, FileTypeTotal> TypeTotal;
+
+    foreach ( const TypeTotal & type, sortedTypes() )
+    {
+	lines << QString( "%1 %2 files  %3" )
+	    .arg( formatSize( type.second.sum ), 10 )
+	    .arg( type.second.count, 9 )
+	    .arg( type.first );
+    }
+
+    return lines.join( "\n" );
+}
+
+
+QString CacheReport::json() const
+{
+    QStringList dirs;
+    QStringList largest;
+    QStringList types;
+
+    foreach ( const CacheReportDir & dir, _dirs )
+    {
+	// The path comes last: It might contain something like "%1" itself
+
+	dirs << QString( "    { \"depth\": %1, \"size\": %2, \"files\": %3, \"dirs\": %4, \"path\": %5 }" )
+	    .arg( dir.depth )
+	    .arg( dir.totalSize )
+	    .arg( dir.totalFiles )
+	    .arg( dir.totalSubDirs )
+	    .arg( jsonString( dir.url ) );
+    }
+
+    foreach ( const CacheReportDir & dir, _largest )
+    {
+	largest << QString( "    { \"size\": %1, \"files\": %2, \"dirs\": %3, \"path\": %4 }" )
+	    .arg( dir.totalSize )
+	    .arg( dir.totalFiles )
+	    .arg( dir.totalSubDirs )
+	    .arg( jsonString( dir.url ) );
+    }
+
+    typedef QPair<QString, FileTypeTotal> TypeTotal;
+
+    foreach ( const TypeTotal & type, sortedTypes() )
+    {
+	types << QString( "    { \"size\": %1, \"files\": %2, \"category\": %3 }" )
+	    .arg( type.second.sum )
+	    .arg( type.second.count )
+	    .arg( jsonString( type.first ) );
+    }
+
+    QString result;
+    result += "{\n";
+    result += QString( "  \"path\": %1,\n"  ).arg( jsonString( _toplevel.url ) );
+    result += QString( "  \"size\": %1,\n"  ).arg( _toplevel.totalSize );
+    result += QString( "  \"files\": %1,\n" ).arg( _toplevel.totalFiles );
+    result += QString( "  \"dirs\": %1,\n"  ).arg( _toplevel.totalSubDirs );
+    result += "  \"directories\": [\n" + dirs.join( ",\n" )    + "\n  ],\n";
+    result += "  \"largest\": [\n"     + largest.join( ",\n" ) + "\n  ],\n";
+    result += "  \"types\": [\n"       + types.join( ",\n" )   + "\n  ]\n";
+    result += "}";
+
+    return result;
+}
+
+
+QString CacheReport::jsonString( const QString & str )
+{
+    QString result = "\"";
+
+    foreach ( QChar c, str )
+    {
+	switch ( c.unicode() )
+	{
+	    case '"':	result += "\\\""; break;
+	    case '\\':	result += "\\\\"; break;
+	    case '\n':	result += "\\n";  break;
+	    case '\t':	result += "\\t";  break;
+
+	    default:
+		if ( c.unicode() < 0x20 )
+		    result += QString( "\\u%1" ).arg( (int) c.unicode(), 4, 16, QChar( '0' ) );
+		else
+		    result += c;
+	}
+    }
+
+    return result + "\"";
+}
@@ -0,0 +1,144 @@
+/*
+ *   File name: CacheReport.h
+ *   Summary:	Text or JSON summary of a cache file without a DirTree
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef CacheReport_h
+#define CacheReport_h
+
+
+#include <QString>
+#include <QList>
+#include <QHash>
+
+#include "DirInfo.h"		// FileTypeTotal
+#include "MimeCategorizer.h"
+
+
+namespace QDirStat
+{
+    /**
+     * One directory in a CacheReport.
+     **/
+    struct CacheReportDir
+    {
+	CacheReportDir():
+	    depth( 0 ),
+	    totalSize( 0LL ),
+	    totalFiles( 0 ),
+	    totalSubDirs( 0 )
+	    {}
+
+	QString		url;
+	int		depth;		// 0 for the toplevel directory
+	FileSize	totalSize;
+	int		totalFiles;
+	int		totalSubDirs;
+    };
+
+
+    /**
+     * Summary of a text cache file for the command line (qdirstat
+     * --report): The totals, the directories down to a certain depth, the
+     * largest directories and the sizes by MIME category.
+     *
+     * The cache file is only streamed through: Like the CacheDiff, this
+     * keeps only the directories that are open at any time (which is the
+     * depth of the tree), plus what it reports. Memory usage does not
+     * depend on the size of the tree.
+     **/
+    class CacheReport
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	CacheReport();
+
+	/**
+	 * List the directories down to 'depth' levels below the toplevel
+	 * directory. Set this before read().
+	 **/
+	void setMaxDepth( int depth ) { _maxDepth = depth; }
+
+	/**
+	 * Report the 'count' largest directories. Set this before read().
+	 **/
+	void setTopCount( int count ) { _topCount = count; }
+
+	/**
+	 * Read text cache file 'fileName'. Returns 'true' if OK, 'false'
+	 * upon error.
+	 **/
+	bool read( const QString & fileName );
+
+	/**
+	 * Return the report as text.
+	 **/
+	QString text() const;
+
+	/**
+	 * Return the report as JSON.
+	 **/
+	QString json() const;
+
+	/**
+	 * Return the toplevel directory and the directories down to the
+	 * maximum depth after read().
+	 **/
+	const CacheReportDir & toplevel() const { return _toplevel; }
+	const QList<CacheReportDir> & dirs() const { return _dirs; }
+
+	/**
+	 * Add a directory that is complete. This is called by the reader.
+	 **/
+	void addDir( const CacheReportDir & dir, int reportIndex );
+
+	/**
+	 * Reserve a place in the directory list for directory 'url' so the
+	 * list keeps the order of the cache file. Return the index or -1 if
+	 * it is too deep to be listed. This is called by the reader.
+	 **/
+	int reserveDir( const QString & url, int depth );
+
+	/**
+	 * Add a file called 'name' with 'size'. This is called by the
+	 * reader.
+	 **/
+	void addFile( const QString & name, FileSize size );
+
+
+    protected:
+
+	/**
+	 * Return 'str' as a quoted JSON string.
+	 **/
+	static QString jsonString( const QString & str );
+
+	/**
+	 * Return the type totals sorted by size in descending order.
+	 **/
+	QList<QPair<QString, FileTypeTotal> > sortedTypes() const;
+
+
+	// Data members
+
+	int				_maxDepth;
+	int				_topCount;
+	CacheReportDir			_toplevel;
+	QList<CacheReportDir>		_dirs;		// Down to _maxDepth
+	QList<CacheReportDir>		_largest;	// Largest first
+	QHash<QString, FileTypeTotal>	_types;		// By category name
+	MimeCategorizer			_mimeCategorizer;
+
+    };	// class CacheReport
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef CacheReport_h
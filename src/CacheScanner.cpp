@@ -0,0 +1,424 @@
+/*
+ *   File name: CacheScanner.cpp
+ *   Summary:	Scan a directory tree directly into a cache file
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <errno.h>
+
+#include <QFileInfo>
+#include <QStringList>
+#include <QMutexLocker>
+
+#include "CacheScanner.h"
+#include "DirReadJob.h"
+#include "ExcludeRules.h"
+#include "MountPoints.h"
+#include "ScanThrottle.h"
+#include "Statx.h"
+#include "Settings.h"
+#include "Logger.h"
+#include "Exception.h"
+
+// Same as in FileInfo.cpp: Don't report files as sparse files if only a
+// fragment of a block is missing.
+
+#define FRAGMENT_SIZE	2048
+
+// Maximum number of directories that are read, but not written yet
+
+#define MAX_READ_AHEAD	10000
+
+using namespace QDirStat;
+
+
+CacheScanner::CacheScanner():
+    _crossFileSystems( false ),
+    _scanBackend( LstatScanBackend ),
+    _writeIndex( false ),
+    _threads( 0 ),
+    _shardIndex( 0 ),
+    _shardCount( 1 ),
+    _root( 0 ),
+    _dirCount( 0 ),
+    _fileCount( 0 ),
+    _errorCount( 0 ),
+    _readAhead( 0 ),
+    _stop( false )
+{
+    // NOP
+}
+
+
+CacheScanner::~CacheScanner()
+{
+    stopWorkers();
+}
+
+
+void CacheScanner::readSettings()
+{
+    Settings settings;
+    settings.beginGroup( "DirectoryTree" );
+
+    setCrossFileSystems( settings.value( "CrossFileSystems", false ).toBool() );
+    setWriteIndex      ( settings.value( "WriteCacheIndex",  false ).toBool() );
+    setScanBackend     ( scanBackendFromName( settings.value( "ScanBackend", "lstat" ).toString() ) );
+    setThreads	       ( settings.value( "ScannerThreads",   1	   ).toInt()  );
+
+    Statx::setUseCachedAttributes( settings.value( "UseCachedAttributes", false ).toBool() );
+
+    settings.endGroup();
+
+    ScanThrottle::instance()->readSettings();
+    ExcludeRules::instance()->readSettings();
+}
+
+
+void CacheScanner::setShard( int index, int count )
+{
+    _shardCount = qMax( 1, count );
+    _shardIndex = qBound( 0, index, _shardCount - 1 );
+}
+
+
+int CacheScanner::shardOf( const QString & name, int shardCount )
+{
+    if ( shardCount <= 1 )
+	return 0;
+
+    // FNV-1a: qHash() might be different for other Qt versions
+
+    QByteArray utf8 = name.toUtf8();
+    quint32 hash = 2166136261U;
+
+    for ( int i=0; i < utf8.size(); ++i )
+    {
+	hash ^= (uchar) utf8.at( i );
+	hash *= 16777619U;
+    }
+
+    return hash % shardCount;
+}
+
+
+bool CacheScanner::scan( const QString & rawDirName, const QString & cacheFileName )
+{
+    QString dirName = QFileInfo( rawDirName ).absoluteFilePath();
+    struct stat statInfo;
+
+    if ( lstat( dirName.toUtf8(), &statInfo ) != 0 )
+    {
+	logError() << "lstat(" << dirName << ") failed: " << formatErrno() << endl;
+	return false;
+    }
+
+    if ( ! S_ISDIR( statInfo.st_mode ) )
+    {
+	logError() << dirName << " is not a directory" << endl;
+	return false;
+    }
+
+    if ( ! _writer.open( cacheFileName, true, _writeIndex ) )
+	return false;
+
+    logInfo() << "Scanning " << dirName << " to " << cacheFileName
+	      << " with " << _threads << " worker threads" << endl;
+
+    const MountPoint * mountPoint = MountPoints::findNearestMountPoint( dirName );
+    CacheScanNode * root = new CacheScanNode( dirName, dirName, statInfo,
+					      mountPoint ? mountPoint->device() : "" );
+    CHECK_NEW( root );
+    _root = root;
+
+    if ( _shardCount > 1 )
+	logInfo() << "Scanning shard " << _shardIndex << " of " << _shardCount << endl;
+
+    _stop      = false;
+    _readAhead = 0;
+    _threadPool.setMaxThreadCount( qMax( 1, _threads ) );
+
+    for ( int i=0; i < _threads; ++i )
+    {
+	CacheScanWorker * worker = new CacheScanWorker( this );
+	CHECK_NEW( worker );
+	_threadPool.start( worker );	// The thread pool takes ownership
+    }
+
+    writeDir( root );
+    stopWorkers();
+    delete root;
+    _root = 0;
+
+    bool ok = _writer.close();
+
+    logInfo() << "Wrote " << _dirCount << " directories and "
+	      << _fileCount << " other entries to " << cacheFileName
+	      << ( ok ? "" : " - ERROR" ) << endl;
+
+    return ok;
+}
+
+
+void CacheScanner::stopWorkers()
+{
+    _mutex.lock();
+    _stop = true;
+    _stateChanged.wakeAll();
+    _mutex.unlock();
+
+    _threadPool.waitForDone();
+}
+
+
+bool CacheScanner::readNext()
+{
+    QMutexLocker locker( &_mutex );
+
+    while ( true )
+    {
+	while ( ! _stop && ( _stack.isEmpty() || _readAhead >= MAX_READ_AHEAD ) )
+	    _stateChanged.wait( &_mutex );
+
+	if ( _stop )
+	    return false;
+
+	CacheScanNode * node = _stack.last();
+	_stack.removeLast();
+
+	if ( node->state == CacheScanNode::Pending )
+	{
+	    node->state = CacheScanNode::Reading;
+	    locker.unlock();
+	    readDir( node );
+
+	    return true;
+	}
+    }
+}
+
+
+void CacheScanner::readDir( CacheScanNode * node )
+{
+    // No logging here: This is called in the worker threads.
+
+    LocalDirEntryList entries;
+    LocalDirReadStatus status = LocalDirReadJob::readEntries( node->path, entries,
+							      false, _scanBackend );
+    QString pathPrefix = node->path == "/" ? "" : node->path; // Avoid leading // when in root dir
+    pathPrefix += "/";
+
+    bool sharded = node == _root && _shardCount > 1;
+
+    foreach ( const LocalDirEntry & entry, entries )
+    {
+	if ( entry.statErrno != 0 || ! S_ISDIR( entry.statInfo.st_mode ) )
+	{
+	    if ( ! sharded || _shardIndex == 0 )
+		node->files.append( entry );
+
+	    continue;
+	}
+
+	if ( sharded && shardOf( entry.name, _shardCount ) != _shardIndex )
+	    continue;
+
+	CacheScanNode * subDir = new CacheScanNode( pathPrefix + entry.name, entry.name,
+						    entry.statInfo, node->device );
+	CHECK_NEW( subDir );
+
+	_excludeMutex.lock();
+	bool excluded = ExcludeRules::instance()->match( subDir->path, subDir->name );
+	_excludeMutex.unlock();
+
+	if ( excluded )
+	    subDir->state = CacheScanNode::Excluded;
+	else if ( entry.statInfo.st_dev != node->statInfo.st_dev )
+	    subDir->state = CacheScanNode::OtherFileSystem; // The writer decides with the mount points
+
+	node->subDirs.append( subDir );
+    }
+
+    QMutexLocker locker( &_mutex );
+
+    node->status = status;
+    node->state	 = CacheScanNode::Read;
+    ++_readAhead;
+
+    // The first subdirectory is written first, so it goes on top
+
+    for ( int i = node->subDirs.size() - 1; i >= 0; --i )
+    {
+	if ( node->subDirs.at( i )->state == CacheScanNode::Pending )
+	    _stack.append( node->subDirs.at( i ) );
+    }
+
+    _stateChanged.wakeAll();
+}
+
+
+void CacheScanner::writeDir( CacheScanNode * node )
+{
+    _mutex.lock();
+
+    if ( node->state == CacheScanNode::Pending )
+    {
+	// Nobody took it yet: Read it right here
+
+	int index = _stack.lastIndexOf( node );
+
+	if ( index >= 0 )
+	    _stack.remove( index );
+
+	node->state = CacheScanNode::Reading;
+	_mutex.unlock();
+	readDir( node );
+	_mutex.lock();
+    }
+
+    while ( node->state != CacheScanNode::Read )
+	_stateChanged.wait( &_mutex );
+
+    _mutex.unlock();
+
+    writeEntry( node->path, node->statInfo );
+
+    switch ( node->status )
+    {
+	case LocalDirReadOk:
+	    break;
+
+	case LocalDirNoPermission:
+	    logWarning() << "No permission to read directory " << node->path << endl;
+	    ++_errorCount;
+	    break;
+
+	case LocalDirOpenFailed:
+	    logWarning() << "opendir(" << node->path << ") failed" << endl;
+	    ++_errorCount;
+	    break;
+    }
+
+    // The files of a directory have to be written right after the
+    // directory, before any subdirectory.
+
+    foreach ( const LocalDirEntry & entry, node->files )
+    {
+	if ( entry.statErrno != 0 )
+	{
+	    errno = entry.statErrno;	// for formatErrno()
+	    logWarning() << "lstat(" << node->path << "/" << entry.name << ") failed: "
+			 << formatErrno() << endl;
+	}
+	else
+	{
+	    writeEntry( entry.name, entry.statInfo );
+	}
+    }
+
+    node->files.clear();
+
+    _mutex.lock();
+    --_readAhead;
+    _stateChanged.wakeAll();
+    _mutex.unlock();
+
+    while ( ! node->subDirs.isEmpty() )
+    {
+	CacheScanNode * subDir = node->subDirs.takeFirst();
+
+	_mutex.lock();
+	CacheScanNode::State state = subDir->state;	// A worker might be reading it
+	_mutex.unlock();
+
+	switch ( state )
+	{
+	    case CacheScanNode::Excluded:
+		logDebug() << "Excluding " << subDir->path << endl;
+		writeEntry( subDir->path, subDir->statInfo );
+		break;
+
+	    case CacheScanNode::OtherFileSystem:
+
+		if ( ! DirReadJob::crossingFileSystems( node->statInfo.st_dev, node->device,
+							subDir->statInfo.st_dev, subDir->path ) )
+		{
+		    subDir->state = CacheScanNode::Pending;
+		    writeDir( subDir );
+		}
+		else if ( _crossFileSystems )
+		{
+		    subDir->device = DirReadJob::mountPointDevice( subDir->path );
+		    subDir->state  = CacheScanNode::Pending;
+		    writeDir( subDir );
+		}
+		else
+		{
+		    writeEntry( subDir->path, subDir->statInfo );
+		}
+		break;
+
+	    default:
+		writeDir( subDir );
+		break;
+	}
+
+	delete subDir;
+    }
+}
+
+
+void CacheScanner::writeEntry( const QString & name, const struct stat & statInfo )
+{
+    // Calculate the size just like FileInfo does
+
+    mode_t   mode   = statInfo.st_mode;
+    int	     links  = statInfo.st_nlink;
+    FileSize size   = 0;
+    FileSize blocks = -1;
+
+    if ( S_ISREG( mode ) || S_ISDIR( mode ) || S_ISLNK( mode ) )
+    {
+	size = statInfo.st_size;
+
+	if ( S_ISREG( mode ) &&
+	     statInfo.st_blocks >= 0 &&
+	     statInfo.st_blocks * 512LL + FRAGMENT_SIZE < size )
+	{
+	    // Sparse file
+
+	    blocks = statInfo.st_blocks;
+	    size   = blocks * 512LL;
+	}
+
+	if ( links > 1 && ! S_ISDIR( mode ) )
+	    size /= links;
+    }
+
+    if ( S_ISDIR( mode ) )
+	++_dirCount;
+    else
+	++_fileCount;
+
+    QByteArray utf8 = name.toUtf8();
+
+    _writer.writeEntry( mode, utf8.constData(), utf8.size(),
+			size, statInfo.st_mtime, blocks,
+			S_ISREG( mode ) ? links : 1 );
+}
+
+
+
+
+void CacheScanWorker::run()
+{
+    ScanThrottle::instance()->workerStarted();
+
+    while ( _scanner->readNext() )
+    {
+	// NOP
+    }
+}
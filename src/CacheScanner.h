@@ -0,0 +1,273 @@
+/*
+ *   File name: CacheScanner.h
+ *   Summary:	Scan a directory tree directly into a cache file
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef CacheScanner_h
+#define CacheScanner_h
+
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <QString>
+#include <QList>
+#include <QVector>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include <QRunnable>
+
+#include "DirTreeCache.h"
+#include "DirReadWorker.h"
+
+
+namespace QDirStat
+{
+    /**
+     * One directory of a CacheScanner scan. The subdirectories of a
+     * directory only exist until that directory is completely written.
+     **/
+    struct CacheScanNode
+    {
+	enum State
+	{
+	    Pending,		// Waiting to be read
+	    Reading,		// Being read right now
+	    Read,		// Ready to be written
+	    Excluded,		// Matches an exclude rule - don't read
+	    OtherFileSystem	// Not read yet - CacheScanner decides
+	};
+
+	CacheScanNode( const QString	 & path,
+		       const QString	 & name,
+		       const struct stat & statInfo,
+		       const QString	 & device ):
+	    path( path ),
+	    name( name ),
+	    statInfo( statInfo ),
+	    device( device ),
+	    state( Pending ),
+	    status( LocalDirReadOk )
+	    {}
+
+	~CacheScanNode() { qDeleteAll( subDirs ); }
+
+	QString			path;
+	QString			name;
+	struct stat		statInfo;
+	QString			device;
+	State			state;
+	LocalDirReadStatus	status;
+	LocalDirEntryList	files;		// Everything but directories
+	QList<CacheScanNode *>	subDirs;
+    };
+
+
+    /**
+     * Scanner that walks a directory tree on disk and writes it directly
+     * to a cache file without building a DirTree: Only the subdirectories
+     * of the directories that are currently being processed are kept in
+     * memory, so memory usage depends on the depth of the tree, not on
+     * its size. This is meant for headless scans (qdirstat --scan-to-cache),
+     * e.g. for nightly cron jobs.
+     *
+     * Exclude rules and file system boundaries are handled just like in
+     * LocalDirReadJob: Excluded directories and mount points that are not
+     * crossed are written to the cache file, but without any content.
+     *
+     * The result is the same as scanning the directory in the GUI and then
+     * writing the cache file.
+     *
+     * With worker threads (see setThreads()), the directories are read in
+     * parallel: Each directory that is read puts its subdirectories on a
+     * stack that all workers take their work from, so they stay close to
+     * the directory that is written next. The cache file has to be written
+     * in a fixed order, so this is done only in the calling thread; if the
+     * directory it needs next isn't taken by a worker yet, it reads it
+     * itself rather than waiting. Only a limited number of directories are
+     * read ahead of the writer to keep the memory usage down.
+     **/
+    class CacheScanner
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	CacheScanner();
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~CacheScanner();
+
+	/**
+	 * Scan directory 'dirName' recursively and write the result to
+	 * 'cacheFileName'. Returns 'true' if OK, 'false' upon error.
+	 **/
+	bool scan( const QString & dirName, const QString & cacheFileName );
+
+	/**
+	 * Set if the scan should continue on other file systems when it
+	 * encounters a mount point.
+	 **/
+	void setCrossFileSystems( bool doCross ) { _crossFileSystems = doCross; }
+
+	/**
+	 * Set the backend for stat()ing the directory entries.
+	 **/
+	void setScanBackend( LocalScanBackend backend ) { _scanBackend = backend; }
+
+	/**
+	 * Set if an index should be written along with the cache file. See
+	 * CacheWriter::open().
+	 **/
+	void setWriteIndex( bool writeIndex ) { _writeIndex = writeIndex; }
+
+	/**
+	 * Set the number of worker threads that read directories. With 0,
+	 * everything is done in the calling thread.
+	 **/
+	void setThreads( int threads ) { _threads = qMax( 0, threads ); }
+
+	/**
+	 * Return the number of worker threads.
+	 **/
+	int threads() const { return _threads; }
+
+	/**
+	 * Scan only shard 'index' of 'count' shards of the directory tree:
+	 * Each subdirectory of the toplevel directory belongs to exactly one
+	 * shard (see shardOf()), and the files of the toplevel directory
+	 * belong to shard 0. The cache files of all shards together can be
+	 * read into one tree with DirTree::mergeCaches().
+	 *
+	 * This is meant for scanning a big tree on several machines at the
+	 * same time, e.g. a network file system.
+	 **/
+	void setShard( int index, int count );
+
+	/**
+	 * Return the shard that subdirectory 'name' of the toplevel
+	 * directory belongs to. This depends only on the name, so it is the
+	 * same on all machines.
+	 **/
+	static int shardOf( const QString & name, int shardCount );
+
+	/**
+	 * Read the settings that the GUI uses for reading directories
+	 * ("cross file systems", scan backend, scanner threads, cache index)
+	 * and the exclude rules.
+	 **/
+	void readSettings();
+
+	/**
+	 * Take the next directory from the stack and read it. Return 'false'
+	 * if the scan is over. This is called in the worker threads.
+	 **/
+	bool readNext();
+
+	/**
+	 * Return the number of directories / other entries written.
+	 **/
+	qint64 dirCount()  const { return _dirCount;  }
+	qint64 fileCount() const { return _fileCount; }
+
+	/**
+	 * Return the number of directories that could not be read.
+	 **/
+	int errorCount() const { return _errorCount; }
+
+
+    protected:
+
+	/**
+	 * Write directory 'node' and everything below it to the cache file.
+	 * This reads the directory first if no worker did that yet.
+	 **/
+	void writeDir( CacheScanNode * node );
+
+	/**
+	 * Read the directory 'node' and put its subdirectories on the stack.
+	 * 'node' has to be in the 'Reading' state.
+	 **/
+	void readDir( CacheScanNode * node );
+
+	/**
+	 * Stop the worker threads and wait for them.
+	 **/
+	void stopWorkers();
+
+	/**
+	 * Write the entry 'name' (the full path for directories) with
+	 * 'statInfo' to the cache file.
+	 **/
+	void writeEntry( const QString & name, const struct stat & statInfo );
+
+
+	//
+	// Data members
+	//
+
+	CacheWriter		_writer;
+	bool			_crossFileSystems;
+	LocalScanBackend	_scanBackend;
+	bool			_writeIndex;
+	int			_threads;
+	int			_shardIndex;
+	int			_shardCount;
+	CacheScanNode *		_root;
+	qint64			_dirCount;
+	qint64			_fileCount;
+	int			_errorCount;
+
+	// Shared with the worker threads; protected by _mutex
+
+	QMutex			_mutex;
+	QWaitCondition		_stateChanged;
+	QVector<CacheScanNode *> _stack;
+	int			_readAhead;	// Read, but not written yet
+	bool			_stop;
+	QThreadPool		_threadPool;
+	QMutex			_excludeMutex;	// ExcludeRules is not thread-safe
+    };
+
+
+    /**
+     * Runnable for a QThreadPool that reads directories for a
+     * CacheScanner until the scan is over.
+     **/
+    class CacheScanWorker: public QRunnable
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	CacheScanWorker( CacheScanner * scanner ):
+	    QRunnable(),
+	    _scanner( scanner )
+	    { setAutoDelete( true ); }
+
+	/**
+	 * Do the work. This is called in a worker thread.
+	 *
+	 * Reimplemented from QRunnable.
+	 **/
+	virtual void run() Q_DECL_OVERRIDE;
+
+    protected:
+
+	CacheScanner * _scanner;
+
+    };	// class CacheScanWorker
+
+}	// namespace QDirStat
+
+
+#endif // ifndef CacheScanner_h
@@ -0,0 +1,160 @@
+/*
+ *   File name: CacheSnapshot.cpp
+ *   Summary:	Write a cache file from a snapshot of a tree in the background
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <sys/stat.h>	// S_ISREG()
+
+#include <QElapsedTimer>
+
+#include "CacheSnapshot.h"
+#include "DirTree.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+CacheSnapshot::CacheSnapshot( DirTree * tree )
+{
+    CHECK_PTR( tree );
+
+    _snapshot = new TreeSnapshot( tree );
+    CHECK_NEW( _snapshot );
+}
+
+
+CacheSnapshot::~CacheSnapshot()
+{
+    delete _snapshot;
+}
+
+
+bool CacheSnapshot::write( const QString & fileName, bool writeIndex ) const
+{
+    CacheWriter writer;
+
+    if ( ! writer.open( fileName, true, writeIndex ) )
+	return false;
+
+    if ( _snapshot->top() )
+	writeTree( writer, _snapshot->top(), 0, _snapshot->url().toUtf8() );
+
+    return writer.close();
+}
+
+
+void CacheSnapshot::writeTree( CacheWriter	 & writer,
+			       const SnapshotDir * dir,
+			       int		   index,
+			       const QByteArray	 & url ) const
+{
+    const SnapshotNode & node = dir->node( index );
+
+    if ( ! node.isDotEntry )
+    {
+	int len;
+	const char * name;
+
+	if ( node.isDirInfo )	// Use absolute path
+	{
+	    name = url.constData();
+	    len	 = url.size();
+	}
+	else
+	{
+	    name = dir->utf8Name( index, &len );
+	}
+
+	writer.writeEntry( node.mode, name, len,
+			   node.size,
+			   node.mtime,
+			   node.isSparseFile   ? node.blocks : -1,
+			   S_ISREG( node.mode ) ? node.links  : 1,
+			   isUnread( node ) );
+    }
+
+    const SnapshotDir * children = node.children.data();
+
+    if ( ! children )
+	return;
+
+    // The files first: The dot entry
+
+    for ( int i=0; i < children->size(); ++i )
+    {
+	if ( children->node( i ).isDotEntry && ! isUnread( node ) )
+	    writeTree( writer, children, i, url );
+    }
+
+    // Then the subdirectories (or the files if there is no dot entry)
+
+    for ( int i=0; i < children->size(); ++i )
+    {
+	if ( ! children->node( i ).isDotEntry )
+	    writeTree( writer, children, i, TreeSnapshot::childUrl( url, children, i ) );
+    }
+}
+
+
+bool CacheSnapshot::isUnread( const SnapshotNode & node )
+{
+    if ( ! node.isDirInfo || node.isDotEntry )
+	return false;
+
+    switch ( node.readState )
+    {
+	case DirQueued:
+	case DirReading:
+	case DirAborted:
+	    return true;
+
+	default:
+	    return false;
+    }
+}
+
+
+
+
+CacheWriterThread::CacheWriterThread( CacheSnapshot * snapshot,
+				      const QString & fileName,
+				      bool	      writeIndex ):
+    QThread(),
+    _snapshot( snapshot ),
+    _fileName( fileName ),
+    _writeIndex( writeIndex ),
+    _ok( false )
+{
+    CHECK_PTR( snapshot );
+}
+
+
+CacheWriterThread::~CacheWriterThread()
+{
+    wait();
+    delete _snapshot;
+}
+
+
+void CacheWriterThread::run()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    _ok = _snapshot->write( _fileName, _writeIndex );
+
+    if ( _ok )
+	logInfo() << "Wrote " << _snapshot->size() << " items to " << _fileName
+		  << " in " << timer.elapsed() << " ms" << endl;
+    else
+	logError() << "Error writing " << _fileName << endl;
+
+    // The snapshot is deleted in the destructor: It is registered with the
+    // tree, so it has to be deleted in the main thread.
+}
@@ -0,0 +1,135 @@
+/*
+ *   File name: CacheSnapshot.h
+ *   Summary:	Write a cache file from a snapshot of a tree in the background
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef CacheSnapshot_h
+#define CacheSnapshot_h
+
+
+#include <QThread>
+#include <QByteArray>
+#include <QString>
+
+#include "DirTreeCache.h"
+#include "TreeSnapshot.h"
+
+
+namespace QDirStat
+{
+    /**
+     * A TreeSnapshot of a tree for writing a cache file from it in any
+     * thread. Taking the snapshot only copies the directories that
+     * changed since the last snapshot, so it can be done in the main
+     * thread while nothing else changes the tree, even for each
+     * checkpoint during a long scan.
+     *
+     * write() then writes the entries exactly as CacheWriter would have
+     * written them at the time the snapshot was taken.
+     *
+     * Create and delete this in the main thread.
+     **/
+    class CacheSnapshot
+    {
+    public:
+
+	/**
+	 * Constructor. This takes the snapshot of 'tree'.
+	 **/
+	CacheSnapshot( DirTree * tree );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~CacheSnapshot();
+
+	/**
+	 * Return the number of entries.
+	 **/
+	int size() const { return _snapshot->size(); }
+
+	/**
+	 * Write the snapshot to cache file 'fileName', optionally with an
+	 * index (see CacheWriter). Returns 'true' if OK.
+	 **/
+	bool write( const QString & fileName, bool writeIndex ) const;
+
+    protected:
+
+	/**
+	 * Write node no. 'index' of 'dir' with URL 'url' and everything
+	 * below it in the same order as CacheWriter::writeTree().
+	 **/
+	void writeTree( CacheWriter	  & writer,
+			const SnapshotDir * dir,
+			int		    index,
+			const QByteArray  & url ) const;
+
+	/**
+	 * Return 'true' if 'node' is a directory whose entries are not read
+	 * yet, like CacheWriter::isUnread().
+	 **/
+	static bool isUnread( const SnapshotNode & node );
+
+
+	TreeSnapshot * _snapshot;
+
+    private:
+
+	// Disable copying
+
+	CacheSnapshot( const CacheSnapshot & );
+	CacheSnapshot & operator=( const CacheSnapshot & );
+    };
+
+
+    /**
+     * Thread that writes a CacheSnapshot to a cache file. Use
+     * QThread::finished() to find out when it is done and ok() if it went
+     * OK.
+     **/
+    class CacheWriterThread: public QThread
+    {
+    public:
+
+	/**
+	 * Constructor. This takes over 'snapshot'.
+	 **/
+	CacheWriterThread( CacheSnapshot * snapshot,
+			   const QString & fileName,
+			   bool		   writeIndex );
+
+	/**
+	 * Destructor. This waits until the thread is finished.
+	 **/
+	virtual ~CacheWriterThread();
+
+	/**
+	 * Return the name of the cache file.
+	 **/
+	const QString & fileName() const { return _fileName; }
+
+	/**
+	 * Return 'true' if the cache file was written OK. Only use this
+	 * after the thread is finished.
+	 **/
+	bool ok() const { return _ok; }
+
+    protected:
+
+	virtual void run() Q_DECL_OVERRIDE;
+
+	CacheSnapshot * _snapshot;
+	QString		_fileName;
+	bool		_writeIndex;
+	bool		_ok;
+    };
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef CacheSnapshot_h
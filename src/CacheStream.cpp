@@ -0,0 +1,571 @@
+/*
+ *   File name: CacheStream.cpp
+ *   Summary:	Compression and decompression of QDirStat cache files
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <QThreadPool>
+#include <QRunnable>
+#include <QAtomicInt>
+
+#include "CacheStream.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+CacheCompression QDirStat::compressionForFile( const QString & fileName,
+					       CacheCompression fallback )
+{
+    if ( fileName.endsWith( ZSTD_CACHE_SUFFIX ) )
+    {
+	if ( haveZstd() )
+	    return ZstdCompression;
+
+	logWarning() << "Built without zstd support - using gzip for " << fileName << endl;
+	return GzipCompression;
+    }
+
+    if ( fileName.endsWith( ".gz" ) )
+	return GzipCompression;
+
+    return fallback;
+}
+
+
+bool QDirStat::haveZstd()
+{
+#ifdef HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+/**
+ * Compress 'data' to one complete gzip member in 'result'.
+ **/
+static bool gzipMember( const QByteArray & data, QByteArray & result )
+{
+    z_stream zStream;
+    memset( &zStream, 0, sizeof( zStream ) );
+
+    // 15 + 16: The maximum window with a gzip header and trailer
+
+    if ( deflateInit2( &zStream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+		       15 + 16, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+    {
+	return false;
+    }
+
+    result.resize( deflateBound( &zStream, data.size() ) );
+
+    zStream.next_in   = (Bytef *) data.constData();
+    zStream.avail_in  = data.size();
+    zStream.next_out  = (Bytef *) result.data();
+    zStream.avail_out = result.size();
+
+    int status = deflate( &zStream, Z_FINISH );
+    result.resize( zStream.total_out );
+    deflateEnd( &zStream );
+
+    return status == Z_STREAM_END;
+}
+
+
+namespace
+{
+    /**
+     * Runnable for a QThreadPool that compresses one buffer after the
+     * other until there is none left.
+     **/
+    class GzipWorker: public QRunnable
+    {
+    public:
+
+	GzipWorker( const QList<QByteArray> & buffers,
+		    QVector<QByteArray>	    & results,
+		    QAtomicInt		    & next ):
+	    QRunnable(),
+	    _buffers( buffers ),
+	    _results( results ),
+	    _next( next ),
+	    _ok( true )
+	    {
+		setAutoDelete( false );
+	    }
+
+	virtual void run() Q_DECL_OVERRIDE
+	{
+	    int i;
+
+	    while ( ( i = _next.fetchAndAddOrdered( 1 ) ) < _buffers.size() )
+	    {
+		if ( ! gzipMember( _buffers.at( i ), _results[i] ) )
+		    _ok = false;
+	    }
+	}
+
+	bool ok() const { return _ok; }
+
+    private:
+
+	const QList<QByteArray> & _buffers;
+	QVector<QByteArray>	& _results;
+	QAtomicInt		& _next;
+	bool			  _ok;
+    };
+}
+
+
+bool QDirStat::gzipCompress( const QList<QByteArray> & buffers,
+			     QVector<QByteArray>     & results,
+			     int			threads )
+{
+    results.resize( buffers.size() );
+    threads = qMin( threads, buffers.size() );
+
+    if ( threads < 2 )
+    {
+	for ( int i=0; i < buffers.size(); ++i )
+	{
+	    if ( ! gzipMember( buffers.at( i ), results[i] ) )
+		return false;
+	}
+
+	return true;
+    }
+
+    // QVector::operator[] must not detach while the workers write to it
+
+    results.detach();
+
+    QList<GzipWorker *> workers;
+    QAtomicInt		next( 0 );
+    QThreadPool		pool;
+    pool.setMaxThreadCount( threads );
+
+    for ( int i=0; i < threads; ++i )
+    {
+	GzipWorker * worker = new GzipWorker( buffers, results, next );
+	CHECK_NEW( worker );
+
+	workers << worker;
+	pool.start( worker );
+    }
+
+    pool.waitForDone();
+
+    bool ok = true;
+
+    foreach ( GzipWorker * worker, workers )
+    {
+	if ( ! worker->ok() )
+	    ok = false;
+    }
+
+    qDeleteAll( workers );
+
+    return ok;
+}
+
+
+
+
+#ifdef HAVE_ZSTD
+
+ZstdCompressor::ZstdCompressor( int threads ):
+    _cctx( 0 ),
+    _frameOpen( false )
+{
+    _cctx = ZSTD_createCCtx();
+    CHECK_NEW( _cctx );
+
+    ZSTD_CCtx_setParameter( _cctx, ZSTD_c_compressionLevel, ZSTD_CACHE_LEVEL );
+    ZSTD_CCtx_setParameter( _cctx, ZSTD_c_enableLongDistanceMatching, 1 );
+
+    if ( threads > 1 )
+    {
+	size_t result = ZSTD_CCtx_setParameter( _cctx, ZSTD_c_nbWorkers, threads );
+
+	if ( ZSTD_isError( result ) )
+	{
+	    logWarning() << "No multithreaded zstd compression: "
+			 << ZSTD_getErrorName( result ) << endl;
+	}
+    }
+}
+
+
+ZstdCompressor::~ZstdCompressor()
+{
+    ZSTD_freeCCtx( _cctx );
+}
+
+
+bool ZstdCompressor::compress( const QByteArray & data,
+			       QByteArray	& result,
+			       bool		  endFrame,
+			       bool		  flush )
+{
+    ZSTD_EndDirective mode = endFrame ? ZSTD_e_end :
+	flush ? ZSTD_e_flush : ZSTD_e_continue;
+
+    ZSTD_inBuffer input = { data.constData(), (size_t) data.size(), 0 };
+    QByteArray	  chunk( ZSTD_CStreamOutSize(), 0 );
+    size_t	  remaining;
+
+    _frameOpen = ! endFrame;
+
+    // With ZSTD_e_continue, libzstd returns as soon as all input is
+    // consumed; otherwise it has to be called until there is nothing
+    // left to write.
+
+    do
+    {
+	ZSTD_outBuffer output = { chunk.data(), (size_t) chunk.size(), 0 };
+	remaining = ZSTD_compressStream2( _cctx, &output, &input, mode );
+
+	if ( ZSTD_isError( remaining ) )
+	{
+	    logError() << "zstd error: " << ZSTD_getErrorName( remaining ) << endl;
+	    return false;
+	}
+
+	result.append( chunk.constData(), output.pos );
+
+    } while ( mode == ZSTD_e_continue ? input.pos < input.size : remaining > 0 );
+
+    return true;
+}
+
+
+bool ZstdCompressor::finish( QByteArray & result )
+{
+    if ( ! _frameOpen )
+	return true;
+
+    return compress( QByteArray(), result, true );
+}
+
+#endif // HAVE_ZSTD
+
+
+
+
+CacheInput::CacheInput( int fd ):
+    _fd( fd ),
+    _zStreamInit( false )
+{
+    memset( &_zStream, 0, sizeof( _zStream ) );
+
+#ifdef HAVE_ZSTD
+    _zstd = 0;
+#endif
+
+    _in.resize ( CACHE_INPUT_BUFFER_SIZE );
+    _out.resize( CACHE_INPUT_BUFFER_SIZE );
+    reset();
+}
+
+
+CacheInput::~CacheInput()
+{
+    if ( _zStreamInit )
+	inflateEnd( &_zStream );
+
+#ifdef HAVE_ZSTD
+    if ( _zstd )
+	ZSTD_freeDStream( _zstd );
+#endif
+
+    if ( _fd >= 0 )
+	::close( _fd );
+}
+
+
+void CacheInput::reset()
+{
+    _compression = NoCompression;
+    _detected	 = false;
+    _inputEof	 = false;
+    _eof	 = false;
+    _error	 = false;
+    _position	 = 0;
+    _rawRead	 = 0;
+    _inPos	 = 0;
+    _inLen	 = 0;
+    _outPos	 = 0;
+    _outLen	 = 0;
+}
+
+
+bool CacheInput::rewind()
+{
+    if ( lseek( _fd, 0, SEEK_SET ) < 0 )
+	return false;
+
+    reset();
+
+    return true;
+}
+
+
+bool CacheInput::seek( qint64 pos )
+{
+    if ( pos < _position && ! rewind() )
+	return false;
+
+    while ( _position < pos )
+    {
+	if ( _outPos == _outLen && ! fill() )
+	    return false;
+
+	int len = (int) qMin( (qint64) ( _outLen - _outPos ), pos - _position );
+	_outPos	  += len;
+	_position += len;
+    }
+
+    return true;
+}
+
+
+char * CacheInput::gets( char * buffer, int len )
+{
+    if ( len < 1 || _error )
+	return 0;
+
+    int count = 0;
+
+    while ( count < len - 1 )
+    {
+	if ( _outPos == _outLen && ! fill() )
+	    break;
+
+	const char * start   = _out.constData() + _outPos;
+	int	     avail   = qMin( _outLen - _outPos, len - 1 - count );
+	const char * newline = (const char *) memchr( start, '\n', avail );
+
+	if ( newline )
+	    avail = newline - start + 1;
+
+	memcpy( buffer + count, start, avail );
+	count	  += avail;
+	_outPos	  += avail;
+	_position += avail;
+
+	if ( newline )
+	    break;
+    }
+
+    buffer[ count ] = 0;
+
+    return count > 0 && ! _error ? buffer : 0;
+}
+
+
+bool CacheInput::fill()
+{
+    _outPos = 0;
+    _outLen = 0;
+
+    while ( _outLen == 0 && ! _eof && ! _error )
+    {
+	if ( ! readInput( 4 ) )	// Enough for any magic bytes
+	{
+	    _error = true;
+	    break;
+	}
+
+	if ( _inPos == _inLen )
+	{
+	    if ( _detected && _compression != NoCompression )
+	    {
+		logError() << "Unexpected end of compressed data" << endl;
+		_error = true;
+	    }
+
+	    _eof = true;
+	    break;
+	}
+
+	if ( ! _detected && ! detectFormat() )
+	{
+	    _eof = true;
+	    break;
+	}
+
+	switch ( _compression )
+	{
+	    case NoCompression:
+		_outLen = qMin( _inLen - _inPos, _out.size() );
+		memcpy( _out.data(), _in.constData() + _inPos, _outLen );
+		_inPos += _outLen;
+		break;
+
+	    case GzipCompression:
+		inflateInput();
+		break;
+
+	    case ZstdCompression:
+#ifdef HAVE_ZSTD
+		zstdDecompressInput();
+#endif
+		break;
+	}
+    }
+
+    return _outLen > 0;
+}
+
+
+bool CacheInput::readInput( int len )
+{
+    if ( _inLen - _inPos >= len || _inputEof )
+	return true;
+
+    if ( _inPos > 0 )
+    {
+	memmove( _in.data(), _in.constData() + _inPos, _inLen - _inPos );
+	_inLen -= _inPos;
+	_inPos	= 0;
+    }
+
+    while ( _inLen < len && ! _inputEof )
+    {
+	ssize_t result = ::read( _fd, _in.data() + _inLen, _in.size() - _inLen );
+
+	if ( result < 0 )
+	{
+	    if ( errno == EINTR )
+		continue;
+
+	    logError() << "Read error: " << formatErrno() << endl;
+	    return false;
+	}
+
+	if ( result == 0 )
+	    _inputEof = true;
+
+	_inLen	 += result;
+	_rawRead += result;
+    }
+
+    return true;
+}
+
+
+bool CacheInput::detectFormat()
+{
+    const unsigned char * magic = (const unsigned char *) _in.constData() + _inPos;
+    int avail = _inLen - _inPos;
+
+    if ( avail >= 2 && magic[0] == 0x1f && magic[1] == 0x8b )
+    {
+	if ( ! _zStreamInit )
+	{
+	    if ( inflateInit2( &_zStream, 15 + 16 ) != Z_OK )
+	    {
+		logError() << "Can't initialize zlib" << endl;
+		_error = true;
+		return false;
+	    }
+
+	    _zStreamInit = true;
+	}
+	else
+	{
+	    inflateReset( &_zStream );
+	}
+
+	_compression = GzipCompression;
+    }
+    else if ( avail >= 4 &&
+	      magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd )
+    {
+#ifdef HAVE_ZSTD
+	if ( ! _zstd )
+	{
+	    _zstd = ZSTD_createDStream();
+	    CHECK_NEW( _zstd );
+	}
+
+	ZSTD_initDStream( _zstd );
+	_compression = ZstdCompression;
+#else
+	logError() << "Can't read zstd compressed data: Built without zstd support" << endl;
+	_error = true;
+	return false;
+#endif
+    }
+    else if ( _compression != NoCompression )
+    {
+	// Like zlib: Ignore trailing garbage after the compressed data
+
+	return false;
+    }
+
+    _detected = true;
+
+    return true;
+}
+
+
+void CacheInput::inflateInput()
+{
+    _zStream.next_in   = (Bytef *) _in.data() + _inPos;
+    _zStream.avail_in  = _inLen - _inPos;
+    _zStream.next_out  = (Bytef *) _out.data() + _outLen;
+    _zStream.avail_out = _out.size() - _outLen;
+
+    int result = inflate( &_zStream, Z_NO_FLUSH );
+
+    _inPos  = _inLen	  - _zStream.avail_in;
+    _outLen = _out.size() - _zStream.avail_out;
+
+    if ( result == Z_STREAM_END )
+    {
+	_detected = false;	// Another gzip member might follow
+    }
+    else if ( result != Z_OK && result != Z_BUF_ERROR )
+    {
+	logError() << "Corrupt gzip data: " << ( _zStream.msg ? _zStream.msg : "" ) << endl;
+	_error = true;
+    }
+}
+
+
+#ifdef HAVE_ZSTD
+
+void CacheInput::zstdDecompressInput()
+{
+    ZSTD_inBuffer  input  = { _in.constData() + _inPos, (size_t) ( _inLen - _inPos ), 0 };
+    ZSTD_outBuffer output = { _out.data() + _outLen, (size_t) ( _out.size() - _outLen ), 0 };
+
+    size_t result = ZSTD_decompressStream( _zstd, &output, &input );
+
+    if ( ZSTD_isError( result ) )
+    {
+	logError() << "Corrupt zstd data: " << ZSTD_getErrorName( result ) << endl;
+	_error = true;
+	return;
+    }
+
+    _inPos  += input.pos;
+    _outLen += output.pos;
+
+    if ( result == 0 )
+	_detected = false;	// Another frame might follow
+}
+
+#endif // HAVE_ZSTD
@@ -0,0 +1,245 @@
+/*
+ *   File name: CacheStream.h
+ *   Summary:	Compression and decompression of QDirStat cache files
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef CacheStream_h
+#define CacheStream_h
+
+
+#include <zlib.h>
+
+#include <QByteArray>
+#include <QList>
+#include <QVector>
+#include <QString>
+
+#ifdef HAVE_ZSTD
+#  include <zstd.h>
+#endif
+
+#define ZSTD_CACHE_SUFFIX		".zst"
+#define CACHE_INPUT_BUFFER_SIZE		( 256 * 1024 )
+#define ZSTD_CACHE_LEVEL		3
+
+
+namespace QDirStat
+{
+    /**
+     * Compression of a cache file.
+     **/
+    enum CacheCompression
+    {
+	NoCompression,
+	GzipCompression,	// The default; what qdirstat-cache-writer writes
+	ZstdCompression		// Only if built with libzstd (HAVE_ZSTD)
+    };
+
+
+    /**
+     * Return the compression for writing file 'fileName': zstd for
+     * ZSTD_CACHE_SUFFIX (if available; gzip otherwise), gzip for ".gz",
+     * 'fallback' for anything else.
+     **/
+    CacheCompression compressionForFile( const QString & fileName,
+					 CacheCompression fallback = GzipCompression );
+
+    /**
+     * Return 'true' if this was built with zstd support.
+     **/
+    bool haveZstd();
+
+    /**
+     * Compress each of 'buffers' to a gzip member of its own in
+     * 'results' with up to 'threads' threads. Concatenated gzip members
+     * are still one valid gzip file. Returns 'false' if anything went
+     * wrong.
+     **/
+    bool gzipCompress( const QList<QByteArray> & buffers,
+		       QVector<QByteArray>     & results,
+		       int			 threads = 1 );
+
+
+#ifdef HAVE_ZSTD
+
+    /**
+     * Zstd compression of one stream. With more than one thread, libzstd
+     * compresses in worker threads of its own; long distance matching
+     * finds repetitions further apart than the usual window (like the
+     * same long paths in very different places of a big tree).
+     **/
+    class ZstdCompressor
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	ZstdCompressor( int threads = 1 );
+
+	/**
+	 * Destructor.
+	 **/
+	~ZstdCompressor();
+
+	/**
+	 * Compress 'data' and append the compressed data to 'result'.
+	 *
+	 * With 'endFrame', this ends the zstd frame so decompressing can
+	 * also start with the next one; with 'flush', all of 'data' can be
+	 * decompressed from what is there so far. Otherwise libzstd may
+	 * keep some of it for later.
+	 **/
+	bool compress( const QByteArray & data,
+		       QByteArray	& result,
+		       bool		  endFrame = false,
+		       bool		  flush	   = false );
+
+	/**
+	 * End the current frame (if anything was compressed since the last
+	 * one) and append the rest to 'result'.
+	 **/
+	bool finish( QByteArray & result );
+
+    protected:
+
+	ZSTD_CCtx * _cctx;
+	bool	    _frameOpen;
+    };
+
+#endif // HAVE_ZSTD
+
+
+    /**
+     * Sequential input of a cache file: Decompresses whatever it finds in
+     * file descriptor 'fd': gzip, zstd (if available) or uncompressed
+     * data, detected by their magic bytes. Concatenated gzip members and
+     * zstd frames are read as one stream.
+     *
+     * This reads the file descriptor only sequentially, so it is also
+     * good for pipes. The interface is modeled after zlib's gzgets() and
+     * friends.
+     **/
+    class CacheInput
+    {
+    public:
+
+	/**
+	 * Constructor. This takes over 'fd'.
+	 **/
+	CacheInput( int fd );
+
+	/**
+	 * Destructor. This closes the file descriptor.
+	 **/
+	~CacheInput();
+
+	/**
+	 * Read a line of at most 'len' - 1 bytes, including the newline,
+	 * into 'buffer' and terminate it with a 0 byte. Return 'buffer' or
+	 * 0 at the end of the input or upon error.
+	 **/
+	char * gets( char * buffer, int len );
+
+	/**
+	 * Return 'true' if the end of the input is reached.
+	 **/
+	bool eof() const { return _eof && _outPos == _outLen; }
+
+	/**
+	 * Return 'true' if there was a read error or corrupt data.
+	 **/
+	bool error() const { return _error; }
+
+	/**
+	 * Return the position in the uncompressed data.
+	 **/
+	qint64 position() const { return _position; }
+
+	/**
+	 * Return the number of bytes of the file that were decompressed so
+	 * far, like zlib's gzoffset().
+	 **/
+	qint64 compressedPosition() const { return _rawRead - ( _inLen - _inPos ); }
+
+	/**
+	 * Skip forward to position 'pos' in the uncompressed data.
+	 * Return 'false' if that is not possible.
+	 **/
+	bool seek( qint64 pos );
+
+	/**
+	 * Start reading from the beginning again. Return 'false' if that's
+	 * not possible, e.g. for a pipe.
+	 **/
+	bool rewind();
+
+	/**
+	 * Return the compression of what was read so far.
+	 **/
+	CacheCompression compression() const { return _compression; }
+
+    protected:
+
+	/**
+	 * Reset to the state right after opening.
+	 **/
+	void reset();
+
+	/**
+	 * Decompress more data to the output buffer. Return 'false' at the
+	 * end of the input or upon error.
+	 **/
+	bool fill();
+
+	/**
+	 * Make sure there are at least 'len' bytes of raw input unless the
+	 * end of the file is reached. Return 'false' upon read error.
+	 **/
+	bool readInput( int len );
+
+	/**
+	 * Detect the format of the raw input by its magic bytes.
+	 **/
+	bool detectFormat();
+
+	/**
+	 * Decompress from the raw input to the output buffer.
+	 **/
+	void inflateInput();
+#ifdef HAVE_ZSTD
+	void zstdDecompressInput();
+#endif
+
+
+	int			_fd;
+	CacheCompression	_compression;
+	bool			_detected;	// In a gzip member or zstd frame
+	bool			_inputEof;
+	bool			_eof;
+	bool			_error;
+	qint64			_position;
+	qint64			_rawRead;	// Bytes read from _fd
+
+	QByteArray		_in;
+	int			_inPos;
+	int			_inLen;
+	QByteArray		_out;
+	int			_outPos;
+	int			_outLen;
+
+	z_stream		_zStream;
+	bool			_zStreamInit;
+#ifdef HAVE_ZSTD
+	ZSTD_DStream *		_zstd;
+#endif
+    };
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef CacheStream_h
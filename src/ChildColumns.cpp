@@ -0,0 +1,129 @@
+/*
+ *   File name: ChildColumns.cpp
+ *   Summary:	Contiguous arrays of the sizes etc. of directory children
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <sys/stat.h>	// S_IFMT etc.
+
+#include "ChildColumns.h"
+#include "DirInfo.h"
+
+
+using namespace QDirStat;
+
+
+ChildColumns::ChildColumns( const DirInfo * dir )
+{
+    int leaves = 0;
+    int dirs   = 0;
+
+    for ( FileInfo * child = dir->firstChild(); child; child = child->next() )
+    {
+	if ( child->isDirInfo() )
+	    ++dirs;
+	else
+	    ++leaves;
+    }
+
+    _sizes.reserve( leaves );
+    _blocks.reserve( leaves );
+    _mtimes.reserve( leaves );
+    _modes.reserve( leaves );
+    _dirs.reserve( dirs );
+
+    for ( FileInfo * child = dir->firstChild(); child; child = child->next() )
+    {
+	if ( child->isDirInfo() )
+	{
+	    _dirs.append( child->toDirInfo() );
+	}
+	else
+	{
+	    _sizes.append( child->size() );
+	    _blocks.append( child->countedBlocks() );
+	    _mtimes.append( child->mtime() );
+	    _modes.append( child->mode() );
+	}
+    }
+}
+
+
+// The loops below are kept simple on purpose, so the compiler can
+// vectorize them.
+
+
+FileSize ChildColumns::totalSize() const
+{
+    const FileSize * sizes = _sizes.constData();
+    const int	     count = _sizes.size();
+    FileSize	     sum   = 0;
+
+    for ( int i = 0; i < count; ++i )
+	sum += sizes[ i ];
+
+    return sum;
+}
+
+
+FileSize ChildColumns::totalBlocks() const
+{
+    const FileSize * blocks = _blocks.constData();
+    const int	     count  = _blocks.size();
+    FileSize	     sum    = 0;
+
+    for ( int i = 0; i < count; ++i )
+	sum += blocks[ i ];
+
+    return sum;
+}
+
+
+time_t ChildColumns::latestMtime() const
+{
+    const time_t * mtimes = _mtimes.constData();
+    const int	   count  = _mtimes.size();
+    time_t	   latest = 0;
+
+    for ( int i = 0; i < count; ++i )
+	latest = mtimes[ i ] > latest ? mtimes[ i ] : latest;
+
+    return latest;
+}
+
+
+int ChildColumns::files() const
+{
+    const mode_t * modes = _modes.constData();
+    const int	   count = _modes.size();
+    int		   files = 0;
+
+    for ( int i = 0; i < count; ++i )
+	files += ( modes[ i ] & S_IFMT ) == S_IFREG;
+
+    return files;
+}
+
+
+int ChildColumns::subDirs() const
+{
+    const mode_t * modes = _modes.constData();
+    const int	   count = _modes.size();
+    int		   dirs	 = 0;
+
+    for ( int i = 0; i < count; ++i )
+	dirs += ( modes[ i ] & S_IFMT ) == S_IFDIR;
+
+    return dirs;
+}
+
+
+qint64 ChildColumns::bytes() const
+{
+    return sizeof( *this ) +
+	count() * ( 2 * sizeof( FileSize ) + sizeof( time_t ) + sizeof( mode_t ) ) +
+	_dirs.size() * sizeof( DirInfo * );
+}
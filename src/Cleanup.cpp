@@ -14,6 +14,7 @@
 
 #include "Cleanup.h"
 #include "FileInfo.h"
+#include "FileInfoSet.h"
 #include "DirTree.h"
 #include "DirSaver.h"
 #include "OutputWindow.h"
@@ -24,6 +25,7 @@
 
 #define SIMULATE_COMMAND	1
 #define WAIT_TIMEOUT_MILLISEC	30000
+#define MAX_BATCH_ARG_LENGTH	32768
 
 using namespace QDirStat;
 
@@ -45,6 +47,8 @@ Cleanup::Cleanup( QString   command,
     _outputWindowPolicy	   = ShowAfterTimeout;
     _outputWindowTimeout   = 500;
     _outputWindowAutoClose = false;
+    _maxParallelProcesses  = 1;
+    _batchSize		   = 1;
 
     QAction::setEnabled( true );
 }
@@ -76,42 +80,64 @@ bool Cleanup::worksFor( FileInfo *item ) const
 }
 
 
+bool Cleanup::isNativeDelete() const
+{
+    return _command.simplified() == "rm -rf %p";
+}
+
+
 void Cleanup::execute( FileInfo *item, OutputWindow * outputWindow )
 {
-    if ( worksFor( item ) )
-    {
-	DirTree * tree = item->tree();
+    FileInfoSet items;
+    items << item;
 
-	executeRecursive( item, outputWindow );
+    execute( items, outputWindow );
+}
 
-	switch ( _refreshPolicy )
-	{
-	    case NoRefresh:
-		// Do nothing (by definition).
-		break;
-
-	    case RefreshThis:
-	    case RefreshParent:
-		// Done from CleanupCollection::execute() via a Refresher
-		// object that is triggered by the
-		// OutputWindow::lastProcessFinished() signal.
-		//
-		// Nothing left to do here.
-		break;
 
-	    case AssumeDeleted:
+void Cleanup::execute( const FileInfoSet & items, OutputWindow * outputWindow )
+{
+    QList<FileInfo *> targets;
 
-		// Assume the cleanup action has deleted the item.
-		// Modify the DirTree accordingly.
+    foreach ( FileInfo * item, items )
+	collectRecursive( item, targets );
 
-		tree->deleteSubtree( item );
-		break;
-	}
+    if ( targets.isEmpty() )
+	return;
+
+    runBatches( targets, outputWindow );
+
+    switch ( _refreshPolicy )
+    {
+	case NoRefresh:
+	    // Do nothing (by definition).
+	    break;
+
+	case RefreshThis:
+	case RefreshParent:
+	    // Done from CleanupCollection::execute() via a Refresher
+	    // object that is triggered by the
+	    // OutputWindow::lastProcessFinished() signal.
+	    //
+	    // Nothing left to do here.
+	    break;
+
+	case AssumeDeleted:
+
+	    // Assume the cleanup action has deleted the items.
+	    // Modify the DirTree accordingly.
+
+	    foreach ( FileInfo * item, items.normalized() )
+	    {
+		if ( worksFor( item ) )
+		    item->tree()->deleteSubtree( item );
+	    }
+	    break;
     }
 }
 
 
-void Cleanup::executeRecursive( FileInfo *item, OutputWindow * outputWindow )
+void Cleanup::collectRecursive( FileInfo * item, QList<FileInfo *> & targets ) const
 {
     if ( worksFor( item ) )
     {
@@ -132,7 +158,7 @@ void Cleanup::executeRecursive( FileInfo *item, OutputWindow * outputWindow )
 		     * the dot entry) if there are no real subdirectories on
 		     * this directory level.
 		     **/
-		    executeRecursive( subdir, outputWindow );
+		    collectRecursive( subdir, targets );
 		}
 		subdir = subdir->next();
 	    }
@@ -141,7 +167,48 @@ void Cleanup::executeRecursive( FileInfo *item, OutputWindow * outputWindow )
 
 	// Perform cleanup for this directory.
 
-	runCommand( item, _command, outputWindow );
+	targets << item;
+    }
+}
+
+
+void Cleanup::runBatches( const QList<FileInfo *> & targets,
+			  OutputWindow		  * outputWindow ) const
+{
+    bool usesItems = _command.contains( "%p" ) || _command.contains( "%n" );
+    bool usesDir   = _command.contains( "%n" ) || _command.contains( "%d" );
+    int	 maxItems  = usesItems ? _batchSize : 1;
+    int	 i	   = 0;
+
+    while ( i < targets.size() )
+    {
+	QList<FileInfo *> batch;
+	QString dir = itemDir( targets.at( i ) );
+	int argLength = 0;
+
+	while ( i < targets.size() && batch.size() < maxItems )
+	{
+	    FileInfo * item = targets.at( i );
+
+	    // Names and %d are relative to the working directory, so they
+	    // can only be batched within the same directory. Also stay well
+	    // below the system's limit for the length of a command line.
+
+	    if ( ! batch.isEmpty() )
+	    {
+		if ( usesDir && itemDir( item ) != dir )
+		    break;
+
+		if ( argLength + item->url().size() > MAX_BATCH_ARG_LENGTH )
+		    break;
+	    }
+
+	    argLength += item->url().size() + 3;	// Quotes and blank
+	    batch << item;
+	    ++i;
+	}
+
+	runCommand( batch, _command, outputWindow );
     }
 }
 
@@ -176,9 +243,10 @@ QString Cleanup::cleanTitle() const
 }
 
 
-QString Cleanup::expandVariables( const FileInfo * item,
-				  const QString	 & unexpanded ) const
+QString Cleanup::expandVariables( const QList<FileInfo *> & items,
+				  const QString		  & unexpanded ) const
 {
+    const FileInfo * item = items.first();
     QString expanded = expandDesktopSpecificApps( unexpanded );
     QString dirName = "";
 
@@ -187,8 +255,17 @@ QString Cleanup::expandVariables( const FileInfo * item,
     else if ( item->parent() )
 	dirName = item->parent()->url();
 
-    expanded.replace( "%p", quoted( escaped( item->url()  ) ) );
-    expanded.replace( "%n", quoted( escaped( item->name() ) ) );
+    QStringList paths;
+    QStringList names;
+
+    foreach ( const FileInfo * batchItem, items )
+    {
+	paths << quoted( escaped( batchItem->url()  ) );
+	names << quoted( escaped( batchItem->name() ) );
+    }
+
+    expanded.replace( "%p", paths.join( " " ) );
+    expanded.replace( "%n", names.join( " " ) );
 
     if ( ! dirName.isEmpty() )
 	expanded.replace( "%d", quoted( escaped( dirName ) ) );
@@ -263,9 +340,9 @@ QString Cleanup::chooseShell( OutputWindow * outputWindow ) const
 }
 
 
-void Cleanup::runCommand( const FileInfo * item,
-			  const QString	 & command,
-			  OutputWindow	 * outputWindow ) const
+void Cleanup::runCommand( const QList<FileInfo *> & items,
+			  const QString		  & command,
+			  OutputWindow		  * outputWindow ) const
 {
     QString shell = chooseShell( outputWindow );
 
@@ -277,13 +354,13 @@ void Cleanup::runCommand( const FileInfo * item,
 	return;
     }
 
-    QString cleanupCommand( expandVariables( item, command ));
+    QString cleanupCommand( expandVariables( items, command ));
     Process * process = new Process( parent() );
     CHECK_NEW( process );
 
     process->setProgram( shell );
     process->setArguments( QStringList() << "-c" << cleanupCommand );
-    process->setWorkingDirectory( itemDir( item ) );
+    process->setWorkingDirectory( itemDir( items.first() ) );
     // logDebug() << "New process \"" << process << endl;
 
     outputWindow->addProcess( process );
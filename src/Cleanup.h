@@ -21,6 +21,7 @@ class OutputWindow;
 namespace QDirStat
 {
     class FileInfo;
+    class FileInfoSet;
 
 
     /**
@@ -250,6 +251,38 @@ namespace QDirStat
 	 **/
 	bool outputWindowAutoClose() const { return _outputWindowAutoClose; }
 
+	/**
+	 * Return the maximum number of processes of this cleanup that may run
+	 * at the same time. The default is 1, i.e. one after another.
+	 *
+	 * Use more only for commands that don't depend on each other: With
+	 * 'recurse', the command for a directory might then run before the
+	 * one for one of its subdirectories is finished.
+	 **/
+	int maxParallelProcesses() const { return _maxParallelProcesses; }
+
+	/**
+	 * Return the maximum number of items to pass to one invocation of the
+	 * command (like 'xargs'). The default is 1, i.e. one shell for each
+	 * item.
+	 *
+	 * With more than that, %p and %n expand to the paths or names of
+	 * all items of the batch, separated by blanks. This only makes sense
+	 * for commands that accept any number of arguments like "rm -rf %p".
+	 * If the command uses %n or %d, only items in the same directory are
+	 * batched since those are relative to the working directory; if it
+	 * uses neither %p nor %n, there is no batching at all.
+	 **/
+	int batchSize() const { return _batchSize; }
+
+	/**
+	 * Return 'true' if this cleanup just deletes the items, i.e. if its
+	 * command is "rm -rf %p". Then CleanupCollection doesn't start a
+	 * shell for this, but deletes the items with a DeleteJob and removes
+	 * them from the tree directly, no matter what the refresh policy is.
+	 **/
+	bool isNativeDelete() const;
+
 	/**
 	 * Return a mapping from RefreshPolicy to string.
 	 **/
@@ -311,6 +344,8 @@ namespace QDirStat
 	void setOutputWindowPolicy   ( OutputWindowPolicy policy ) { _outputWindowPolicy    = policy;	 }
 	void setOutputWindowTimeout  ( int timeoutMillisec )	   { _outputWindowTimeout   = timeoutMillisec; }
 	void setOutputWindowAutoClose( bool autoClose )		   { _outputWindowAutoClose = autoClose; }
+	void setMaxParallelProcesses ( int count )		   { _maxParallelProcesses  = qMax( 1, count ); }
+	void setBatchSize	     ( int size )		   { _batchSize		    = qMax( 1, size ); }
 
     public slots:
 
@@ -323,13 +358,27 @@ namespace QDirStat
 	 **/
 	void execute( FileInfo * item, OutputWindow * outputWindow );
 
+	/**
+	 * Perform the cleanup with all of 'items' that it works for. This is
+	 * where batchSize() comes into play; with a batch size of 1, this is
+	 * the same as calling execute() for each item.
+	 **/
+	void execute( const FileInfoSet & items, OutputWindow * outputWindow );
+
 
     protected:
 
 	/**
-	 * Recursively perform the cleanup.
+	 * Recursively collect the items to run the command for in the order
+	 * to run it: For 'recurse', the subdirectories first.
 	 **/
-	void executeRecursive( FileInfo *item, OutputWindow * outputWindow );
+	void collectRecursive( FileInfo * item, QList<FileInfo *> & targets ) const;
+
+	/**
+	 * Run the command for 'targets', with as many of them as possible in
+	 * one invocation according to batchSize().
+	 **/
+	void runBatches( const QList<FileInfo *> & targets, OutputWindow * outputWindow ) const;
 
 	/**
 	 * Retrieve the directory part of a FileInfo's path.
@@ -378,9 +427,12 @@ namespace QDirStat
 	 *
 	 *     "xdg-open %p"
 	 *     "tar cjvf %n.tar.bz2 && rm -rf %n"
+	 *
+	 * With more than one item, %p and %n expand to the paths or names of
+	 * all of them, separated by blanks; %d is taken from the first item.
 	 **/
-	QString expandVariables ( const FileInfo * item,
-				  const QString	 & unexpanded ) const;
+	QString expandVariables ( const QList<FileInfo *> & items,
+				  const QString		  & unexpanded ) const;
 
 	/**
 	 * Expand some variables in string 'unexpanded' to application that are
@@ -403,11 +455,12 @@ namespace QDirStat
 	QString quoted( const QString & unquoted ) const;
 
 	/**
-	 * Run a command with 'item' as base to expand variables.
+	 * Run a command with 'items' as base to expand variables. The working
+	 * directory is the one of the first item.
 	 **/
-	void runCommand( const FileInfo * item,
-			 const QString	& command,
-			 OutputWindow	* outputWindow) const;
+	void runCommand( const QList<FileInfo *> & items,
+			 const QString		 & command,
+			 OutputWindow		 * outputWindow) const;
 
 
 	//
@@ -428,6 +481,8 @@ namespace QDirStat
 	OutputWindowPolicy _outputWindowPolicy;
 	int		   _outputWindowTimeout;
 	bool		   _outputWindowAutoClose;
+	int		   _maxParallelProcesses;
+	int		   _batchSize;
     };
 
 
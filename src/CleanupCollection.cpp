@@ -13,6 +13,7 @@
 
 #include "CleanupCollection.h"
 #include "Cleanup.h"
+#include "DeleteJob.h"
 #include "StdCleanup.h"
 #include "Settings.h"
 #include "SettingsHelpers.h"
@@ -35,10 +36,8 @@ CleanupCollection::CleanupCollection( SelectionModel * selectionModel,
 {
     readSettings();
 
-    // Just initialize to show the current status in the log;
-    // the contents are cached anyway.
-
-    (void) Cleanup::desktopSpecificApps();
+    // Cleanup::desktopSpecificApps() is only needed when a cleanup is
+    // started; the MainWindow calls it once the window is shown.
 
     if ( _cleanupList.isEmpty() )
 	addStdCleanups();
@@ -249,6 +248,7 @@ void CleanupCollection::execute()
     OutputWindow * outputWindow = new OutputWindow( qApp->activeWindow() );
     CHECK_NEW( outputWindow );
     outputWindow->setAutoClose( cleanup->outputWindowAutoClose() );
+    outputWindow->setMaxParallelProcesses( cleanup->maxParallelProcesses() );
 
     switch ( cleanup->outputWindowPolicy() )
     {
@@ -268,6 +268,31 @@ void CleanupCollection::execute()
 	    break;
     }
 
+    connect( outputWindow, SIGNAL( lastProcessFinished( int ) ),
+	     this,	   SIGNAL( cleanupFinished    ( int ) ) );
+
+    if ( cleanup->isNativeDelete() )
+    {
+	// No shell and no refresh: The items are deleted in a worker thread
+	// and removed from the tree as soon as they are gone.
+
+	DeleteJob * job = new DeleteJob( DeleteJob::Delete, outputWindow );
+	CHECK_NEW( job );
+
+	foreach ( FileInfo * item, selection )
+	{
+	    if ( ! cleanup->worksFor( item ) )
+		selection.remove( item );
+	}
+
+	job->addItems( selection );
+	outputWindow->addJob( job );
+	job->start();
+	outputWindow->noMoreProcesses();
+
+	return;
+    }
+
     if ( cleanup->refreshPolicy() == Cleanup::RefreshThis ||
 	 cleanup->refreshPolicy() == Cleanup::RefreshParent )
     {
@@ -283,14 +308,13 @@ void CleanupCollection::execute()
 		 refresher,    SLOT  ( refresh()		) );
     }
 
-    connect( outputWindow, SIGNAL( lastProcessFinished( int ) ),
-	     this,	   SIGNAL( cleanupFinished    ( int ) ) );
+    FileInfoSet items;
 
     foreach ( FileInfo * item, selection )
     {
 	if ( cleanup->worksFor( item ) )
 	{
-	    cleanup->execute( item, outputWindow );
+	    items << item;
 	}
 	else
 	{
@@ -299,6 +323,7 @@ void CleanupCollection::execute()
 	}
     }
 
+    cleanup->execute( items, outputWindow );
     outputWindow->noMoreProcesses();
 }
 
@@ -486,6 +511,8 @@ void CleanupCollection::readSettings()
 	    bool askForConfirmation    = settings.value( "AskForConfirmation"	, false ).toBool();
 	    bool outputWindowAutoClose = settings.value( "OutputWindowAutoClose", false ).toBool();
 	    int	 outputWindowTimeout   = settings.value( "OutputWindowTimeout"	, 0	).toInt();
+	    int	 maxParallelProcesses  = settings.value( "MaxParallelProcesses" , 1	).toInt();
+	    int	 batchSize	       = settings.value( "BatchSize"		, 1	).toInt();
 
 	    int refreshPolicy	    = readEnumEntry( settings, "RefreshPolicy",
 						     Cleanup::NoRefresh,
@@ -510,6 +537,8 @@ void CleanupCollection::readSettings()
 		cleanup->setAskForConfirmation	 ( askForConfirmation	 );
 		cleanup->setOutputWindowAutoClose( outputWindowAutoClose );
 		cleanup->setOutputWindowTimeout	 ( outputWindowTimeout	 );
+		cleanup->setMaxParallelProcesses ( maxParallelProcesses	 );
+		cleanup->setBatchSize		 ( batchSize		 );
 		cleanup->setRefreshPolicy     ( static_cast<Cleanup::RefreshPolicy>( refreshPolicy ) );
 		cleanup->setOutputWindowPolicy( static_cast<Cleanup::OutputWindowPolicy>( outputWindowPolicy ) );
 
@@ -574,6 +603,12 @@ void CleanupCollection::writeSettings()
 	if ( cleanup->outputWindowTimeout() > 0 )
 	    settings.setValue( "OutputWindowTimeout"  , cleanup->outputWindowTimeout()	 );
 
+	if ( cleanup->maxParallelProcesses() > 1 )
+	    settings.setValue( "MaxParallelProcesses" , cleanup->maxParallelProcesses() );
+
+	if ( cleanup->batchSize() > 1 )
+	    settings.setValue( "BatchSize"	      , cleanup->batchSize()		 );
+
 	writeEnumEntry( settings, "RefreshPolicy",
 			cleanup->refreshPolicy(),
 			Cleanup::refreshPolicyMapping() );
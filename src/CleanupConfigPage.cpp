@@ -154,6 +154,9 @@ void CleanupConfigPage::save( void * value )
 
     cleanup->setOutputWindowAutoClose( _ui->outputWindowAutoCloseCheckBox->isChecked() );
 
+    cleanup->setMaxParallelProcesses( _ui->parallelProcessesSpinBox->value() );
+    cleanup->setBatchSize	    ( _ui->batchSizeSpinBox->value()	     );
+
     policy = _ui->refreshPolicyComboBox->currentIndex();
     cleanup->setRefreshPolicy( static_cast<Cleanup::RefreshPolicy>( policy ) );
 }
@@ -192,6 +195,9 @@ void CleanupConfigPage::load( void * value )
     _ui->outputWindowTimeoutSpinBox->setValue( timeout / 1000.0 );
     _ui->outputWindowAutoCloseCheckBox->setChecked( cleanup->outputWindowAutoClose() );
 
+    _ui->parallelProcessesSpinBox->setValue( cleanup->maxParallelProcesses() );
+    _ui->batchSizeSpinBox->setValue	   ( cleanup->batchSize()	     );
+
     _ui->refreshPolicyComboBox->setCurrentIndex( cleanup->refreshPolicy() );
 }
 
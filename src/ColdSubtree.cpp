@@ -0,0 +1,311 @@
+/*
+ *   File name: ColdSubtree.cpp
+ *   Summary:	Compressed in-memory form of a subtree that nobody looks at
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <string.h>	// memcpy()
+
+#include <QVector>
+
+#include "ColdSubtree.h"
+#include "DirInfo.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+// Speed matters more than the last few percent here: The data are
+// compressed in the main thread while the user might be waiting.
+
+#define COLD_COMPRESSION_LEVEL	1
+
+
+using namespace QDirStat;
+
+
+namespace
+{
+    /**
+     * One node of a cold subtree. The name follows directly, then the
+     * FoldedFiles of the directory and of its dot entry if there are any.
+     **/
+    struct ColdNode
+    {
+	qint64	size;
+	qint64	blocks;
+	qint64	mtime;
+	quint32 parent;		// Number of the directory; 0 is the cold directory
+	quint32 links;
+	quint32 mode;
+	quint16 nameLen;
+	quint16 deviceIndex;
+	quint32 flags;		// ColdNodeFlags and the DirReadState in bits 16-23
+	quint16 ownerIndex;	// In the padding at the end
+    };
+
+    enum ColdNodeFlags
+    {
+	IsDirInfo	 = 0x0001,
+	InDotEntry	 = 0x0002,
+	SparseFile	 = 0x0004,
+	PrimaryLink	 = 0x0008,
+	DuplicateLink	 = 0x0010,
+	LocalFile	 = 0x0020,
+	Excluded	 = 0x0040,
+	MountPoint	 = 0x0080,
+	NoDotEntry	 = 0x0100,
+	HasFolded	 = 0x0200,
+	DotEntryFolded	 = 0x0400
+    };
+
+    const int ReadStateShift = 16;
+}
+
+
+ColdSubtree::ColdSubtree( DirInfo * dir ):
+    _totalSize( dir->totalSize() ),
+    _totalBlocks( dir->totalBlocks() ),
+    _totalItems( dir->totalItems() ),
+    _totalSubDirs( dir->totalSubDirs() ),
+    _totalFiles( dir->totalFiles() ),
+    _latestMtime( dir->latestMtime() ),
+    _nodes( 0 ),
+    _dirs( 0 )
+{
+    QByteArray raw;
+    raw.reserve( _totalItems * ( sizeof( ColdNode ) + 16 ) );
+
+    // The record for 'dir' itself only keeps its dot entry and folded files
+
+    addNode( raw, dir, 0, 0 );
+    _dirs = 1;
+    addChildren( raw, dir, 0 );
+
+    --_nodes;	// Not counting 'dir'
+    _data = qCompress( raw, COLD_COMPRESSION_LEVEL );
+    _data.squeeze();
+
+    logDebug() << dir << ": " << _nodes << " nodes in "
+	       << formatSize( _data.size() ) << endl;
+}
+
+
+void ColdSubtree::addChildren( QByteArray & raw, DirInfo * dir, quint32 dirNo )
+{
+    if ( dir->_dotEntry )
+    {
+	for ( FileInfo * child = dir->_dotEntry->_firstChild; child; child = child->next() )
+	    add( raw, child, dirNo, true );
+    }
+
+    for ( FileInfo * child = dir->_firstChild; child; child = child->next() )
+	add( raw, child, dirNo, false );
+}
+
+
+void ColdSubtree::add( QByteArray & raw, FileInfo * item, quint32 parent, bool inDotEntry )
+{
+    addNode( raw, item, parent, inDotEntry ? InDotEntry : 0 );
+
+    if ( item->isDirInfo() )
+	addChildren( raw, item->toDirInfo(), _dirs++ );
+}
+
+
+void ColdSubtree::addNode( QByteArray & raw, FileInfo * item, quint32 parent, quint32 flags )
+{
+    QByteArray name = item->compactName().toUtf8();
+    DirInfo *  dir  = item->isDirInfo() ? item->toDirInfo() : 0;
+
+    ColdNode node;
+    node.size	     = item->_size;
+    node.blocks	     = item->_blocks;
+    node.mtime	     = item->mtime();
+    node.parent	     = parent;
+    node.links	     = item->_links;
+    node.mode	     = item->mode();
+    node.nameLen     = qMin( name.size(), 0xFFFF );
+    node.deviceIndex = item->_deviceIndex;
+    node.ownerIndex  = item->_ownerIndex;
+
+    if ( item->_isSparseFile	) flags |= SparseFile;
+    if ( item->_isPrimaryLink	) flags |= PrimaryLink;
+    if ( item->_isDuplicateLink ) flags |= DuplicateLink;
+    if ( item->_isLocalFile	) flags |= LocalFile;
+
+    if ( dir )
+    {
+	flags |= IsDirInfo;
+	flags |= dir->_readState << ReadStateShift;
+
+	if ( dir->_isExcluded	)	       flags |= Excluded;
+	if ( dir->_isMountPoint )	       flags |= MountPoint;
+	if ( ! dir->_dotEntry	)	       flags |= NoDotEntry;
+	if ( dir->_foldedFiles	)	       flags |= HasFolded;
+	if ( dir->_dotEntry && dir->_dotEntry->_foldedFiles ) flags |= DotEntryFolded;
+    }
+
+    node.flags = flags;
+
+    raw.append( (const char *) &node, sizeof( node ) );
+    ++_nodes;
+
+    if ( _nodes > 1 )	// Not 'dir' itself
+	_ownerTotals.add( item );
+
+    if ( dir )
+    {
+	_ownerTotals.add( dir->_foldedFiles );
+
+	if ( dir->_dotEntry )
+	    _ownerTotals.add( dir->_dotEntry->_foldedFiles );
+    }
+    raw.append( name.constData(), node.nameLen );
+
+    if ( flags & HasFolded )
+	raw.append( (const char *) dir->_foldedFiles, sizeof( FoldedFiles ) );
+
+    if ( flags & DotEntryFolded )
+	raw.append( (const char *) dir->_dotEntry->_foldedFiles, sizeof( FoldedFiles ) );
+}
+
+
+bool ColdSubtree::inflate( DirInfo * dir ) const
+{
+    QByteArray	raw = qUncompress( _data );
+    const char * pos = raw.constData();
+    const char * end = pos + raw.size();
+    DirTree *	tree = dir->tree();
+
+    QVector<DirInfo *> dirs;
+    dirs.reserve( _totalSubDirs + 1 );
+
+    while ( end - pos >= (int) sizeof( ColdNode ) )
+    {
+	ColdNode node;
+	memcpy( &node, pos, sizeof( node ) );
+	pos += sizeof( node );
+
+	QString name = QString::fromUtf8( pos, node.nameLen );
+	pos += node.nameLen;
+
+	FoldedFiles * folded	     = 0;
+	FoldedFiles * dotEntryFolded = 0;
+
+	if ( node.flags & HasFolded )
+	{
+	    folded = new FoldedFiles();
+	    CHECK_NEW( folded );
+	    memcpy( folded, pos, sizeof( FoldedFiles ) );
+	    pos += sizeof( FoldedFiles );
+	}
+
+	if ( node.flags & DotEntryFolded )
+	{
+	    dotEntryFolded = new FoldedFiles();
+	    CHECK_NEW( dotEntryFolded );
+	    memcpy( dotEntryFolded, pos, sizeof( FoldedFiles ) );
+	    pos += sizeof( FoldedFiles );
+	}
+
+	if ( pos > end )
+	{
+	    logError() << dir << ": Truncated cold subtree" << endl;
+	    delete folded;
+	    delete dotEntryFolded;
+	    return false;
+	}
+
+	FileInfo * item	 = 0;
+	DirInfo *  subDir = 0;
+
+	if ( dirs.isEmpty() )	// The record of 'dir' itself
+	{
+	    subDir = dir;
+
+	    if ( ! ( node.flags & NoDotEntry ) && ! dir->_dotEntry )
+	    {
+		dir->_dotEntry = new DirInfo( tree, dir, true );
+		CHECK_NEW( dir->_dotEntry );
+	    }
+	}
+	else
+	{
+	    DirInfo * parent = dirs.value( node.parent, 0 );
+
+	    if ( ! parent )
+	    {
+		logError() << dir << ": Bad parent " << node.parent << " in cold subtree" << endl;
+		delete folded;
+		delete dotEntryFolded;
+		return false;
+	    }
+
+	    if ( ( node.flags & InDotEntry ) && parent->_dotEntry )
+		parent = parent->_dotEntry;
+
+	    if ( node.flags & IsDirInfo )
+	    {
+		subDir = new DirInfo( tree, parent, name,
+				      node.mode, node.size, node.mtime );
+		CHECK_NEW( subDir );
+
+		subDir->_readState    = (DirReadState) ( ( node.flags >> ReadStateShift ) & 0xFF );
+		subDir->_isExcluded   = node.flags & Excluded;
+		subDir->_isMountPoint = node.flags & MountPoint;
+
+		if ( node.flags & NoDotEntry )
+		{
+		    delete subDir->_dotEntry;
+		    subDir->_dotEntry = 0;
+		}
+
+		item = subDir;
+	    }
+	    else
+	    {
+		item = new FileInfo( tree, parent, name,
+				     node.mode, node.size, node.mtime,
+				     node.blocks, node.links );
+		CHECK_NEW( item );
+	    }
+
+	    item->_blocks	   = node.blocks;
+	    item->_links	   = node.links;
+	    item->_deviceIndex	   = node.deviceIndex;
+	    item->_ownerIndex	   = node.ownerIndex;
+	    item->_isSparseFile	   = node.flags & SparseFile;
+	    item->_isPrimaryLink   = node.flags & PrimaryLink;
+	    item->_isDuplicateLink = node.flags & DuplicateLink;
+	    item->_isLocalFile	   = node.flags & LocalFile;
+
+	    // Like DirInfo::insertChild(), but without updating any summaries:
+	    // They are already what they will be when everything is back.
+
+	    item->setNext( parent->_firstChild );
+	    parent->_firstChild = item;
+	}
+
+	if ( subDir )
+	{
+	    dirs.append( subDir );
+	    subDir->_foldedFiles  = folded;
+	    subDir->_summaryDirty = true;
+
+	    if ( subDir->_dotEntry )
+	    {
+		subDir->_dotEntry->_deviceIndex	 = subDir->_deviceIndex;
+		subDir->_dotEntry->_ownerIndex	 = subDir->_ownerIndex;
+		subDir->_dotEntry->_foldedFiles	 = dotEntryFolded;
+		subDir->_dotEntry->_summaryDirty = true;
+	    }
+	    else
+		delete dotEntryFolded;
+	}
+    }
+
+    return true;
+}
@@ -0,0 +1,118 @@
+/*
+ *   File name: ColdSubtree.h
+ *   Summary:	Compressed in-memory form of a subtree that nobody looks at
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef ColdSubtree_h
+#define ColdSubtree_h
+
+
+#include <QByteArray>
+
+#include "FileInfo.h"
+#include "OwnerTotals.h"
+
+
+namespace QDirStat
+{
+    class DirInfo;
+
+    /**
+     * The children of a directory, serialized and compressed: A huge tree
+     * has many subtrees that the user never opens. Those can be compacted
+     * to this with DirTree::freezeColdSubtrees(), so only the directory
+     * itself with its totals remains as nodes. DirInfo::thaw() restores
+     * the nodes when anything needs them again.
+     *
+     * Each node is a fixed-size record in host byte order followed by its
+     * name in UTF-8, in depth-first order so each parent comes before its
+     * children. This is never written to disk.
+     **/
+    class ColdSubtree
+    {
+    public:
+
+	/**
+	 * Constructor: Serialize everything below 'dir', but not 'dir'
+	 * itself, and remember its totals. This does not change 'dir'.
+	 **/
+	ColdSubtree( DirInfo * dir );
+
+	/**
+	 * Create the nodes again below 'dir' which must not have any
+	 * children. This neither sends any signals nor does it tell the
+	 * ancestors: The summaries of the subtree are the same as before.
+	 * Return 'false' if the data are corrupt.
+	 **/
+	bool inflate( DirInfo * dir ) const;
+
+	/**
+	 * The totals of the subtree; see DirInfo.
+	 **/
+	FileSize totalSize()	const { return _totalSize;    }
+	FileSize totalBlocks()	const { return _totalBlocks;  }
+	int	 totalItems()	const { return _totalItems;   }
+	int	 totalSubDirs() const { return _totalSubDirs; }
+	int	 totalFiles()	const { return _totalFiles;   }
+	time_t	 latestMtime()	const { return _latestMtime;  }
+
+	/**
+	 * Return the totals by owner of everything below the directory,
+	 * so OwnerTotals::collect() doesn't have to thaw it.
+	 **/
+	const OwnerTotals & ownerTotals() const { return _ownerTotals; }
+
+	/**
+	 * Return the number of nodes.
+	 **/
+	int nodes() const { return _nodes; }
+
+	/**
+	 * Return the number of bytes of the compressed data.
+	 **/
+	qint64 bytes() const { return _data.capacity(); }
+
+
+    protected:
+
+	/**
+	 * Append 'item' and its subtree to 'raw'. 'parent' is the number of
+	 * the directory that it belongs to (0 for the cold directory itself).
+	 **/
+	void add( QByteArray & raw, FileInfo * item, quint32 parent, bool inDotEntry );
+
+	/**
+	 * Append one node record to 'raw'.
+	 **/
+	void addNode( QByteArray & raw, FileInfo * item, quint32 parent, quint32 flags );
+
+	/**
+	 * Append the children of 'dir' and of its dot entry to 'raw'.
+	 * 'dirNo' is the number of 'dir'.
+	 **/
+	void addChildren( QByteArray & raw, DirInfo * dir, quint32 dirNo );
+
+
+	// Data members
+
+	QByteArray	_data;
+	FileSize	_totalSize;
+	FileSize	_totalBlocks;
+	int		_totalItems;
+	int		_totalSubDirs;
+	int		_totalFiles;
+	time_t		_latestMtime;
+	int		_nodes;
+	quint32		_dirs;		// Only while serializing
+	OwnerTotals	_ownerTotals;
+
+    };	// class ColdSubtree
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef ColdSubtree_h
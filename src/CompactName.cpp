@@ -0,0 +1,398 @@
+/*
+ *   File name: CompactName.cpp
+ *   Summary:	Memory-efficient storage for file names
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <string.h>
+#include <stdlib.h>
+#include <new>
+
+#include <QMutex>
+#include <QMutexLocker>
+
+#include "CompactName.h"
+#include "NodePool.h"
+
+using namespace QDirStat;
+
+
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+#  define InlineLenByte	  0	// Byte with the tag and the length
+#  define InlineFirstByte 1	// First byte of the name
+#else
+#  define InlineLenByte	  7
+#  define InlineFirstByte 0
+#endif
+
+
+namespace
+{
+    /**
+     * Heap block of a private (not interned) name.
+     **/
+    struct PrivateName
+    {
+	int  len;
+	char bytes[1];	// Actually 'len' bytes
+    };
+
+
+    /**
+     * Heap block of an interned name.
+     **/
+    struct InternedName
+    {
+	InternedName *	next;	     // Next in the same hash bucket
+	uint		hash;
+	int		refCount;
+	int		len;
+	char		bytes[1];    // Actually 'len' bytes
+    };
+
+
+    /**
+     * The process-wide pool of interned names: A hash table with
+     * chaining. The pool does not own the names, it only finds them; names
+     * remove themselves when their reference count drops to zero.
+     **/
+    class InternPool
+    {
+    public:
+
+	InternPool():
+	    _buckets( 0 ),
+	    _bucketCount( 0 ),
+	    _count( 0 ),
+	    _references( 0 ),
+	    _bytes( 0 )
+	    {}
+
+	InternedName * intern( const char * utf8, int len );
+	void release( InternedName * name );
+
+	int count()	 const { return _count; }
+	int references() const { return _references; }
+	qint64 bytes()	   const { return _bytes + _bucketCount * sizeof( InternedName * ); }
+
+	QMutex mutex;
+
+    protected:
+
+	void rehash( int newBucketCount );
+
+	static uint hash( const char * utf8, int len );
+
+
+	InternedName ** _buckets;
+	int		_bucketCount;
+	int		_count;
+	int		_references;
+	qint64		_bytes;		// Of all InternedName blocks
+    };
+
+
+    InternPool & internPool()
+    {
+	static InternPool pool;
+	return pool;
+    }
+
+
+    uint InternPool::hash( const char * utf8, int len )
+    {
+	return CompactName::hash( utf8, len );
+    }
+
+
+    void InternPool::rehash( int newBucketCount )
+    {
+	InternedName ** newBuckets = static_cast<InternedName **>( calloc( newBucketCount, sizeof( InternedName * ) ) );
+
+	if ( ! newBuckets )
+	    throw std::bad_alloc();
+
+	for ( int i=0; i < _bucketCount; ++i )
+	{
+	    InternedName * name = _buckets[i];
+
+	    while ( name )
+	    {
+		InternedName * next = name->next;
+		InternedName *& bucket = newBuckets[ name->hash & ( newBucketCount - 1 ) ];
+		name->next = bucket;
+		bucket = name;
+		name = next;
+	    }
+	}
+
+	free( _buckets );
+	_buckets     = newBuckets;
+	_bucketCount = newBucketCount;
+    }
+
+
+    InternedName * InternPool::intern( const char * utf8, int len )
+    {
+	uint nameHash = hash( utf8, len );
+
+	if ( _bucketCount > 0 )
+	{
+	    InternedName * name = _buckets[ nameHash & ( _bucketCount - 1 ) ];
+
+	    while ( name )
+	    {
+		if ( name->hash == nameHash &&
+		     name->len	== len	    &&
+		     memcmp( name->bytes, utf8, len ) == 0 )
+		{
+		    ++name->refCount;
+		    ++_references;
+		    return name;
+		}
+
+		name = name->next;
+	    }
+	}
+
+	if ( _count >= _bucketCount )
+	    rehash( _bucketCount > 0 ? 2 * _bucketCount : 1024 );
+
+	InternedName * name = static_cast<InternedName *>( NodePool::allocate( sizeof( InternedName ) + len ) );
+	name->hash     = nameHash;
+	name->refCount = 1;
+	name->len      = len;
+	memcpy( name->bytes, utf8, len );
+
+	InternedName *& bucket = _buckets[ nameHash & ( _bucketCount - 1 ) ];
+	name->next = bucket;
+	bucket = name;
+	++_count;
+	++_references;
+	_bytes += sizeof( InternedName ) + len;
+
+	return name;
+    }
+
+
+    void InternPool::release( InternedName * name )
+    {
+	--_references;
+
+	if ( --name->refCount > 0 )
+	    return;
+
+	InternedName ** link = &_buckets[ name->hash & ( _bucketCount - 1 ) ];
+
+	while ( *link && *link != name )
+	    link = &(*link)->next;
+
+	if ( *link )
+	    *link = name->next;
+
+	--_count;
+	_bytes -= sizeof( InternedName ) + name->len;
+	NodePool::release( name, sizeof( InternedName ) + name->len );
+
+	if ( _count == 0 )
+	{
+	    free( _buckets );
+	    _buckets	 = 0;
+	    _bucketCount = 0;
+	}
+    }
+
+}	// namespace
+
+
+
+CompactName::CompactName( const CompactName & other ):
+    _data( InlineTag )
+{
+    int len;
+    const char * bytes = other.utf8( &len );
+    set( bytes, len );
+}
+
+
+CompactName & CompactName::operator=( const CompactName & other )
+{
+    if ( &other != this )
+    {
+	// Copy the bytes first: 'other' might share the interned block
+	QByteArray bytes = other.toUtf8();
+	clear();
+	set( bytes );
+    }
+
+    return *this;
+}
+
+
+void CompactName::set( const char * utf8, int len )
+{
+    if ( len <= InlineMaxLen )
+    {
+	_data = 0;
+	_bytes[ InlineLenByte ] = (char) ( InlineTag | ( len << 1 ) );
+
+	if ( len > 0 )
+	    memcpy( _bytes + InlineFirstByte, utf8, len );
+    }
+    else if ( len <= InternMaxLen )
+    {
+	InternPool & pool = internPool();
+	QMutexLocker locker( &pool.mutex );
+	InternedName * name = pool.intern( utf8, len );
+	_data = (quint64) (quintptr) name | InternedTag;
+    }
+    else
+    {
+	PrivateName * name = static_cast<PrivateName *>( NodePool::allocate( sizeof( PrivateName ) + len ) );
+	name->len = len;
+	memcpy( name->bytes, utf8, len );
+	_data = (quint64) (quintptr) name;
+    }
+}
+
+
+void CompactName::clear()
+{
+    if ( isInline() )
+    {
+	// Nothing to release
+    }
+    else if ( isInterned() )
+    {
+	InternPool & pool = internPool();
+	QMutexLocker locker( &pool.mutex );
+	pool.release( static_cast<InternedName *>( block() ) );
+    }
+    else
+    {
+	PrivateName * name = static_cast<PrivateName *>( block() );
+	NodePool::release( name, sizeof( PrivateName ) + name->len );
+    }
+
+    _data = 0;
+    _bytes[ InlineLenByte ] = InlineTag;
+}
+
+
+const char * CompactName::utf8( int * len ) const
+{
+    if ( isInline() )
+    {
+	*len = ( (unsigned char) _bytes[ InlineLenByte ] >> 1 ) & 0x7;
+	return _bytes + InlineFirstByte;
+    }
+    else if ( isInterned() )
+    {
+	const InternedName * name = static_cast<const InternedName *>( block() );
+	*len = name->len;
+	return name->bytes;
+    }
+    else
+    {
+	const PrivateName * name = static_cast<const PrivateName *>( block() );
+	*len = name->len;
+	return name->bytes;
+    }
+}
+
+
+QString CompactName::toString() const
+{
+    int len;
+    const char * bytes = utf8( &len );
+
+    return QString::fromUtf8( bytes, len );
+}
+
+
+uint CompactName::hash( const char * utf8, int len )
+{
+    // FNV-1a
+
+    uint hash = 2166136261U;
+
+    for ( int i=0; i < len; ++i )
+    {
+	hash ^= (unsigned char) utf8[i];
+	hash *= 16777619U;
+    }
+
+    return hash;
+}
+
+
+uint CompactName::hash() const
+{
+    if ( isInterned() )
+	return static_cast<const InternedName *>( block() )->hash;
+
+    int len;
+    const char * bytes = utf8( &len );
+
+    return hash( bytes, len );
+}
+
+
+bool CompactName::equals( const char * utf8, int len ) const
+{
+    int myLen;
+    const char * myBytes = CompactName::utf8( &myLen );
+
+    return myLen == len && memcmp( myBytes, utf8, len ) == 0;
+}
+
+
+bool CompactName::operator==( const CompactName & other ) const
+{
+    if ( _data == other._data )
+	return true;
+
+    int len;
+    const char * bytes = other.utf8( &len );
+
+    return equals( bytes, len );
+}
+
+
+int CompactName::internedNames()
+{
+    InternPool & pool = internPool();
+    QMutexLocker locker( &pool.mutex );
+
+    return pool.count();
+}
+
+
+int CompactName::internedReferences()
+{
+    InternPool & pool = internPool();
+    QMutexLocker locker( &pool.mutex );
+
+    return pool.references();
+}
+
+
+qint64 CompactName::internedBytes()
+{
+    InternPool & pool = internPool();
+    QMutexLocker locker( &pool.mutex );
+
+    return pool.bytes();
+}
+
+
+int CompactName::privateBytes() const
+{
+    if ( isInline() || isInterned() )
+	return 0;
+
+    return sizeof( PrivateName ) + static_cast<const PrivateName *>( block() )->len;
+}
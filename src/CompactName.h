@@ -0,0 +1,217 @@
+/*
+ *   File name: CompactName.h
+ *   Summary:	Memory-efficient storage for file names
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef CompactName_h
+#define CompactName_h
+
+
+#include <QString>
+#include <QByteArray>
+#include <QTextStream>
+#include <QtEndian>
+
+
+namespace QDirStat
+{
+    /**
+     * Compact storage for the name of a FileInfo.
+     *
+     * A QString needs a reference-counted heap block with a header of 16
+     * to 24 bytes plus two bytes per character. Since there is one name for
+     * each of the millions of FileInfo objects, this is stored as UTF-8
+     * instead, in one of three ways:
+     *
+     * - Names of up to 7 bytes are stored directly in the 8 bytes that
+     *	 would otherwise hold the pointer, so they don't need any heap
+     *	 memory at all ("src", ".git", "README").
+     *
+     * - Short names (up to InternMaxLen bytes) are interned in a
+     *	 process-wide pool: There is only one reference-counted copy of
+     *	 "Makefile", "__init__.py", "index.html" etc. for all trees.
+     *
+     * - Longer names are stored in a private block from the NodePool.
+     *
+     * toString() materializes a QString only on demand.
+     **/
+    class CompactName
+    {
+    public:
+
+	/**
+	 * Default constructor: An empty name.
+	 **/
+	CompactName(): _data( InlineTag ) {}
+
+	/**
+	 * Constructor from a QString.
+	 **/
+	CompactName( const QString & name ): _data( InlineTag )
+	    { set( name.toUtf8() ); }
+
+	/**
+	 * Constructor from UTF-8 bytes.
+	 **/
+	CompactName( const char * utf8, int len ): _data( InlineTag )
+	    { set( utf8, len ); }
+
+	/**
+	 * Copy constructor.
+	 **/
+	CompactName( const CompactName & other );
+
+	/**
+	 * Destructor.
+	 **/
+	~CompactName() { clear(); }
+
+	/**
+	 * Assignment operators.
+	 **/
+	CompactName & operator=( const CompactName & other );
+	CompactName & operator=( const QString & name )
+	    { clear(); set( name.toUtf8() ); return *this; }
+
+	/**
+	 * Return the name as a QString.
+	 **/
+	QString toString() const;
+
+	/**
+	 * Return the name as UTF-8.
+	 **/
+	QByteArray toUtf8() const
+	    { int len; const char * bytes = utf8( &len ); return QByteArray( bytes, len ); }
+
+	/**
+	 * Return the UTF-8 bytes of the name and its length in 'len'. The
+	 * bytes are not null-terminated. The pointer is only valid as long
+	 * as this object is not changed or destroyed.
+	 **/
+	const char * utf8( int * len ) const;
+
+	/**
+	 * Return the length of the name in UTF-8 bytes.
+	 **/
+	int utf8Length() const { int len; utf8( &len ); return len; }
+
+	/**
+	 * Return 'true' if the name is empty.
+	 **/
+	bool isEmpty() const { return utf8Length() == 0; }
+
+	/**
+	 * Return 'true' if this name is the same as 'utf8' with 'len' bytes.
+	 **/
+	bool equals( const char * utf8, int len ) const;
+
+	/**
+	 * Comparison operators.
+	 **/
+	bool operator==( const CompactName & other ) const;
+	bool operator!=( const CompactName & other ) const
+	    { return ! ( *this == other ); }
+
+	bool operator==( const QString & other ) const
+	    { QByteArray bytes = other.toUtf8(); return equals( bytes.constData(), bytes.size() ); }
+
+	/**
+	 * Return a hash value of the name. This is the same as
+	 * hash( utf8, len ) for its UTF-8 bytes.
+	 **/
+	uint hash() const;
+
+	/**
+	 * Return a hash value (FNV-1a) of 'utf8' with 'len' bytes.
+	 **/
+	static uint hash( const char * utf8, int len );
+
+	/**
+	 * Return the number of distinct names in the intern pool and the
+	 * number of references to them.
+	 **/
+	static int internedNames();
+	static int internedReferences();
+
+	/**
+	 * Return the number of bytes of the intern pool: All interned names
+	 * and the hash table. This is shared between all trees.
+	 **/
+	static qint64 internedBytes();
+
+	/**
+	 * Return the number of heap bytes of this name that are not shared
+	 * with other names: 0 for inline and interned names.
+	 **/
+	int privateBytes() const;
+
+
+	enum
+	{
+	    InternMaxLen = 24
+	};
+
+    protected:
+
+	/**
+	 * Store 'utf8' with 'len' bytes in the most compact way.
+	 **/
+	void set( const char * utf8, int len );
+	void set( const QByteArray & utf8 ) { set( utf8.constData(), utf8.size() ); }
+
+	/**
+	 * Release any storage and make this an empty name.
+	 **/
+	void clear();
+
+	enum
+	{
+	    InlineTag	   = 0x1,	// Bit 0: Inline name
+	    InternedTag	   = 0x2,	// Bit 1: Interned name
+	    TagMask	   = 0x7,
+	    InlineMaxLen   = 7
+	};
+
+	bool isInline()	  const { return _data & InlineTag; }
+	bool isInterned() const { return ! isInline() && ( _data & InternedTag ); }
+
+	/**
+	 * Return the heap block of a name that is not inline.
+	 **/
+	void * block() const { return reinterpret_cast<void *>( (quintptr) ( _data & ~(quint64) TagMask ) ); }
+
+
+	// Inline names: The length is in bits 1..3 of the least significant
+	// byte, the UTF-8 bytes of the name in the other 7 bytes in memory
+	// order.
+	//
+	// Other names: A pointer to the heap block with the tag bits in the
+	// lowest 3 bits.
+
+	union
+	{
+	    quint64 _data;
+	    char    _bytes[8];
+	};
+
+    };	// class CompactName
+
+
+    /**
+     * Print a CompactName in a debug stream.
+     **/
+    inline QTextStream & operator<< ( QTextStream & stream, const CompactName & name )
+    {
+	stream << name.toString();
+	return stream;
+    }
+
+}	// namespace QDirStat
+
+
+#endif // ifndef CompactName_h
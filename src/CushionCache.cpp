@@ -0,0 +1,86 @@
+/*
+ *   File name: CushionCache.cpp
+ *   Summary:	Cache for rendered treemap cushions
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <string.h>	// memcmp()
+#include <limits.h>	// INT_MAX
+
+#include <QByteArray>
+
+#include "CushionCache.h"
+#include "Exception.h"
+
+
+// Until the treemap view knows the size of its framebuffer
+
+#define DefaultMaxBytes	 ( 32 * 1024 * 1024LL )
+
+
+using namespace QDirStat;
+
+
+bool CushionCacheKey::operator==( const CushionCacheKey & other ) const
+{
+    // CushionShading only has floats and ints, so there is no padding to
+    // compare.
+
+    return rect		  == other.rect			 &&
+	   ensureContrast == other.ensureContrast	 &&
+	   memcmp( &shading, &other.shading, sizeof( CushionShading ) ) == 0;
+}
+
+
+uint QDirStat::qHash( const CushionCacheKey & key )
+{
+    QByteArray shading = QByteArray::fromRawData( (const char *) &key.shading,
+						   sizeof( CushionShading ) );
+    uint hash = qHash( shading );
+
+    hash ^= key.rect.x() * 31 + key.rect.y();
+    hash ^= ( key.rect.width() * 31 + key.rect.height() ) << 16;
+
+    return key.ensureContrast ? ~hash : hash;
+}
+
+
+CushionCache::CushionCache()
+{
+    setMaxBytes( DefaultMaxBytes );
+}
+
+
+QImage CushionCache::find( const CushionShading & shading,
+			   const QRect		& rect,
+			   bool			  ensureContrast )
+{
+    QImage * image = _cache.object( CushionCacheKey( shading, rect, ensureContrast ) );
+
+    return image ? *image : QImage();
+}
+
+
+void CushionCache::insert( const CushionShading & shading,
+			   const QRect		& rect,
+			   bool			  ensureContrast,
+			   const QImage		& image )
+{
+    if ( image.isNull() )
+	return;
+
+    QImage * copy = new QImage( image );	// Implicitly shared; owned by the cache
+    CHECK_NEW( copy );
+
+    int cost = (int) ( (qint64) image.bytesPerLine() * image.height() / 1024 ) + 1;
+    _cache.insert( CushionCacheKey( shading, rect, ensureContrast ), copy, cost );
+}
+
+
+void CushionCache::setMaxBytes( qint64 bytes )
+{
+    _cache.setMaxCost( (int) qMin( bytes / 1024, (qint64) INT_MAX ) );
+}
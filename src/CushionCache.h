@@ -0,0 +1,129 @@
+/*
+ *   File name: CushionCache.h
+ *   Summary:	Cache for rendered treemap cushions
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef CushionCache_h
+#define CushionCache_h
+
+
+#include <QCache>
+#include <QImage>
+#include <QRect>
+
+#include "CushionKernel.h"	// CushionShading
+
+
+namespace QDirStat
+{
+    /**
+     * Key of a cushion in the CushionCache: Everything that the pixels of
+     * a cushion depend on.
+     **/
+    struct CushionCacheKey
+    {
+	CushionCacheKey():
+	    ensureContrast( false )
+	    {}
+
+	CushionCacheKey( const CushionShading & shading,
+			 const QRect	      & rect,
+			 bool		        ensureContrast ):
+	    shading( shading ),
+	    rect( rect ),
+	    ensureContrast( ensureContrast )
+	    {}
+
+	bool operator==( const CushionCacheKey & other ) const;
+
+	CushionShading	shading;
+	QRect		rect;		// In treemap coordinates
+	bool		ensureContrast;
+    };
+
+
+    /**
+     * Hash function for a CushionCacheKey for QCache.
+     **/
+    uint qHash( const CushionCacheKey & key );
+
+
+    /**
+     * Cache for rendered cushions that survives rebuilding the treemap:
+     * After a small refresh, or when only the colors of a few tiles
+     * change, most tiles get exactly the same rectangle and the same
+     * shading as before, so their cushions don't need to be rendered
+     * again; copying them is much cheaper.
+     *
+     * The key is what the pixels depend on: The rectangle in treemap
+     * coordinates and the CushionShading (the coefficients of the cushion
+     * surface, the light source and the tile color). Not the FileInfo: A
+     * tile with the same geometry and color has the same cushion no matter
+     * which file it is for, and a pointer to a deleted node could be
+     * reused by a new one anyway. Nothing ever needs to be invalidated;
+     * the least recently used cushions are dropped when the cache is over
+     * its size.
+     *
+     * This is only for the GUI thread.
+     **/
+    class CushionCache
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	CushionCache();
+
+	/**
+	 * Return the cushion for 'shading' and 'rect' or a null image if it
+	 * is not in the cache.
+	 **/
+	QImage find( const CushionShading & shading,
+		     const QRect	  & rect,
+		     bool		    ensureContrast );
+
+	/**
+	 * Add the rendered cushion 'image' for 'shading' and 'rect'.
+	 **/
+	void insert( const CushionShading & shading,
+		     const QRect	  & rect,
+		     bool		    ensureContrast,
+		     const QImage	  & image );
+
+	/**
+	 * Set the maximum size of the cache in bytes.
+	 **/
+	void setMaxBytes( qint64 bytes );
+
+	/**
+	 * Return the maximum size of the cache in bytes.
+	 **/
+	qint64 maxBytes() const { return _cache.maxCost() * 1024LL; }
+
+	/**
+	 * Return the size of all cushions in the cache in bytes.
+	 **/
+	qint64 bytes() const { return _cache.totalCost() * 1024LL; }
+
+	/**
+	 * Drop all cushions.
+	 **/
+	void clear() { _cache.clear(); }
+
+
+    protected:
+
+	// The cost of each cushion is in kB: QCache only has an int for it.
+
+	QCache<CushionCacheKey, QImage> _cache;
+    };
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef CushionCache_h
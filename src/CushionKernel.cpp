@@ -0,0 +1,320 @@
+/*
+ *   File name: CushionKernel.cpp
+ *   Summary:	Pixel kernel for treemap cushion shading
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <math.h>
+
+#include "CushionKernel.h"
+
+#if defined( __SSE2__ )
+#  include <emmintrin.h>
+#  define HAVE_SSE2_KERNEL 1
+#endif
+
+#if defined( __x86_64__ ) && ( defined( __clang__ ) || ( defined( __GNUC__ ) && __GNUC__ >= 5 ) )
+#  include <immintrin.h>
+#  define HAVE_AVX2_KERNEL 1
+#endif
+
+#if defined( __aarch64__ ) && defined( __ARM_NEON )
+#  include <arm_neon.h>
+#  define HAVE_NEON_KERNEL 1
+#endif
+
+
+using namespace QDirStat;
+
+
+const char *		   CushionKernel::_name	       = "scalar";
+CushionKernel::RowFunction CushionKernel::_rowFunction = CushionKernel::selectRowFunction();
+
+
+/**
+ * Shade one pixel. This is the reference for all the vectorized versions,
+ * and they use it for the pixels at the end of a row that don't fill a
+ * complete vector.
+ **/
+static inline QRgb shadePixel( const CushionShading & shading,
+			       float nx,
+			       float nyLight,
+			       float nyNorm )
+{
+    float cosa = ( nx * shading.lightX + nyLight ) / sqrtf( nx*nx + nyNorm );
+
+    int red   = (int) ( shading.maxRed	 * cosa + 0.5f );
+    int green = (int) ( shading.maxGreen * cosa + 0.5f );
+    int blue  = (int) ( shading.maxBlue	 * cosa + 0.5f );
+
+    if ( red   < 0 )	red   = 0;
+    if ( green < 0 )	green = 0;
+    if ( blue  < 0 )	blue  = 0;
+
+    return qRgb( red   + shading.ambientLight,
+		 green + shading.ambientLight,
+		 blue  + shading.ambientLight );
+}
+
+
+#if ! defined( HAVE_SSE2_KERNEL ) && ! defined( HAVE_NEON_KERNEL )
+
+static void renderRowScalar( const CushionShading & shading,
+			     int    x0,
+			     int    y,
+			     int    width,
+			     QRgb * row )
+{
+    // The y part of the normal is the same for the complete row
+
+    float ny	  = 2.0f * shading.yy2 * y + shading.yy1;
+    float nyLight = ny * shading.lightY + shading.lightZ;
+    float nyNorm  = ny * ny + 1.0f;
+
+    for ( int x = 0; x < width; x++ )
+    {
+	float nx = 2.0f * shading.xx2 * ( x + x0 ) + shading.xx1;
+	row[ x ] = shadePixel( shading, nx, nyLight, nyNorm );
+    }
+}
+
+#endif
+
+
+#ifdef HAVE_SSE2_KERNEL
+
+static void renderRowSSE2( const CushionShading & shading,
+			   int	  x0,
+			   int	  y,
+			   int	  width,
+			   QRgb * row )
+{
+    float ny	  = 2.0f * shading.yy2 * y + shading.yy1;
+    float nyLight = ny * shading.lightY + shading.lightZ;
+    float nyNorm  = ny * ny + 1.0f;
+
+    const __m128  xx2x2	  = _mm_set1_ps( 2.0f * shading.xx2 );
+    const __m128  xx1	  = _mm_set1_ps( shading.xx1 );
+    const __m128  lightX  = _mm_set1_ps( shading.lightX );
+    const __m128  nyL	  = _mm_set1_ps( nyLight );
+    const __m128  nyN	  = _mm_set1_ps( nyNorm );
+    const __m128  maxRed  = _mm_set1_ps( shading.maxRed	  );
+    const __m128  maxGreen= _mm_set1_ps( shading.maxGreen );
+    const __m128  maxBlue = _mm_set1_ps( shading.maxBlue  );
+    const __m128  half	  = _mm_set1_ps( 0.5f );
+    const __m128  zero	  = _mm_setzero_ps();
+    const __m128  four	  = _mm_set1_ps( 4.0f );
+    const __m128i ambient = _mm_set1_epi32( shading.ambientLight );
+    const __m128i alpha	  = _mm_set1_epi32( (int) 0xFF000000 );
+
+    __m128 xs = _mm_setr_ps( x0, x0 + 1, x0 + 2, x0 + 3 );
+    int x = 0;
+
+    for ( ; x + 4 <= width; x += 4 )
+    {
+	__m128 nx   = _mm_add_ps( _mm_mul_ps( xx2x2, xs ), xx1 );
+	__m128 cosa = _mm_div_ps( _mm_add_ps( _mm_mul_ps( nx, lightX ), nyL ),
+				  _mm_sqrt_ps( _mm_add_ps( _mm_mul_ps( nx, nx ), nyN ) ) );
+
+	__m128i red   = _mm_cvttps_epi32( _mm_max_ps( _mm_add_ps( _mm_mul_ps( maxRed,   cosa ), half ), zero ) );
+	__m128i green = _mm_cvttps_epi32( _mm_max_ps( _mm_add_ps( _mm_mul_ps( maxGreen, cosa ), half ), zero ) );
+	__m128i blue  = _mm_cvttps_epi32( _mm_max_ps( _mm_add_ps( _mm_mul_ps( maxBlue,  cosa ), half ), zero ) );
+
+	__m128i pixels = _mm_or_si128( alpha, _mm_slli_epi32( _mm_add_epi32( red, ambient ), 16 ) );
+	pixels = _mm_or_si128( pixels, _mm_slli_epi32( _mm_add_epi32( green, ambient ), 8 ) );
+	pixels = _mm_or_si128( pixels, _mm_add_epi32( blue, ambient ) );
+
+	_mm_storeu_si128( reinterpret_cast<__m128i *>( row + x ), pixels );
+	xs = _mm_add_ps( xs, four );
+    }
+
+    for ( ; x < width; x++ )
+    {
+	float nx = 2.0f * shading.xx2 * ( x + x0 ) + shading.xx1;
+	row[ x ] = shadePixel( shading, nx, nyLight, nyNorm );
+    }
+}
+
+#endif	// HAVE_SSE2_KERNEL
+
+
+#ifdef HAVE_AVX2_KERNEL
+
+__attribute__(( target( "avx2" ) ))
+static void renderRowAVX2( const CushionShading & shading,
+			   int	  x0,
+			   int	  y,
+			   int	  width,
+			   QRgb * row )
+{
+    float ny	  = 2.0f * shading.yy2 * y + shading.yy1;
+    float nyLight = ny * shading.lightY + shading.lightZ;
+    float nyNorm  = ny * ny + 1.0f;
+
+    const __m256  xx2x2	  = _mm256_set1_ps( 2.0f * shading.xx2 );
+    const __m256  xx1	  = _mm256_set1_ps( shading.xx1 );
+    const __m256  lightX  = _mm256_set1_ps( shading.lightX );
+    const __m256  nyL	  = _mm256_set1_ps( nyLight );
+    const __m256  nyN	  = _mm256_set1_ps( nyNorm );
+    const __m256  maxRed  = _mm256_set1_ps( shading.maxRed   );
+    const __m256  maxGreen= _mm256_set1_ps( shading.maxGreen );
+    const __m256  maxBlue = _mm256_set1_ps( shading.maxBlue  );
+    const __m256  half	  = _mm256_set1_ps( 0.5f );
+    const __m256  zero	  = _mm256_setzero_ps();
+    const __m256  eight	  = _mm256_set1_ps( 8.0f );
+    const __m256i ambient = _mm256_set1_epi32( shading.ambientLight );
+    const __m256i alpha	  = _mm256_set1_epi32( (int) 0xFF000000 );
+
+    __m256 xs = _mm256_setr_ps( x0,	x0 + 1, x0 + 2, x0 + 3,
+				x0 + 4, x0 + 5, x0 + 6, x0 + 7 );
+    int x = 0;
+
+    for ( ; x + 8 <= width; x += 8 )
+    {
+	__m256 nx   = _mm256_add_ps( _mm256_mul_ps( xx2x2, xs ), xx1 );
+	__m256 cosa = _mm256_div_ps( _mm256_add_ps( _mm256_mul_ps( nx, lightX ), nyL ),
+				     _mm256_sqrt_ps( _mm256_add_ps( _mm256_mul_ps( nx, nx ), nyN ) ) );
+
+	__m256i red   = _mm256_cvttps_epi32( _mm256_max_ps( _mm256_add_ps( _mm256_mul_ps( maxRed,   cosa ), half ), zero ) );
+	__m256i green = _mm256_cvttps_epi32( _mm256_max_ps( _mm256_add_ps( _mm256_mul_ps( maxGreen, cosa ), half ), zero ) );
+	__m256i blue  = _mm256_cvttps_epi32( _mm256_max_ps( _mm256_add_ps( _mm256_mul_ps( maxBlue,  cosa ), half ), zero ) );
+
+	__m256i pixels = _mm256_or_si256( alpha, _mm256_slli_epi32( _mm256_add_epi32( red, ambient ), 16 ) );
+	pixels = _mm256_or_si256( pixels, _mm256_slli_epi32( _mm256_add_epi32( green, ambient ), 8 ) );
+	pixels = _mm256_or_si256( pixels, _mm256_add_epi32( blue, ambient ) );
+
+	_mm256_storeu_si256( reinterpret_cast<__m256i *>( row + x ), pixels );
+	xs = _mm256_add_ps( xs, eight );
+    }
+
+    for ( ; x < width; x++ )
+    {
+	float nx = 2.0f * shading.xx2 * ( x + x0 ) + shading.xx1;
+	row[ x ] = shadePixel( shading, nx, nyLight, nyNorm );
+    }
+}
+
+#endif	// HAVE_AVX2_KERNEL
+
+
+#ifdef HAVE_NEON_KERNEL
+
+static void renderRowNEON( const CushionShading & shading,
+			   int	  x0,
+			   int	  y,
+			   int	  width,
+			   QRgb * row )
+{
+    float ny	  = 2.0f * shading.yy2 * y + shading.yy1;
+    float nyLight = ny * shading.lightY + shading.lightZ;
+    float nyNorm  = ny * ny + 1.0f;
+
+    const float32x4_t xx2x2    = vdupq_n_f32( 2.0f * shading.xx2 );
+    const float32x4_t xx1      = vdupq_n_f32( shading.xx1 );
+    const float32x4_t lightX   = vdupq_n_f32( shading.lightX );
+    const float32x4_t nyL      = vdupq_n_f32( nyLight );
+    const float32x4_t nyN      = vdupq_n_f32( nyNorm );
+    const float32x4_t maxRed   = vdupq_n_f32( shading.maxRed   );
+    const float32x4_t maxGreen = vdupq_n_f32( shading.maxGreen );
+    const float32x4_t maxBlue  = vdupq_n_f32( shading.maxBlue  );
+    const float32x4_t half     = vdupq_n_f32( 0.5f );
+    const float32x4_t zero     = vdupq_n_f32( 0.0f );
+    const float32x4_t four     = vdupq_n_f32( 4.0f );
+    const uint32x4_t  ambient  = vdupq_n_u32( shading.ambientLight );
+    const uint32x4_t  alpha    = vdupq_n_u32( 0xFF000000 );
+
+    const float initX[ 4 ] = { (float) x0, (float) x0 + 1, (float) x0 + 2, (float) x0 + 3 };
+    float32x4_t xs = vld1q_f32( initX );
+    int x = 0;
+
+    for ( ; x + 4 <= width; x += 4 )
+    {
+	float32x4_t nx	 = vaddq_f32( vmulq_f32( xx2x2, xs ), xx1 );
+	float32x4_t cosa = vdivq_f32( vaddq_f32( vmulq_f32( nx, lightX ), nyL ),
+				      vsqrtq_f32( vaddq_f32( vmulq_f32( nx, nx ), nyN ) ) );
+
+	uint32x4_t red	 = vcvtq_u32_f32( vmaxq_f32( vaddq_f32( vmulq_f32( maxRed,   cosa ), half ), zero ) );
+	uint32x4_t green = vcvtq_u32_f32( vmaxq_f32( vaddq_f32( vmulq_f32( maxGreen, cosa ), half ), zero ) );
+	uint32x4_t blue	 = vcvtq_u32_f32( vmaxq_f32( vaddq_f32( vmulq_f32( maxBlue,  cosa ), half ), zero ) );
+
+	uint32x4_t pixels = vorrq_u32( alpha, vshlq_n_u32( vaddq_u32( red, ambient ), 16 ) );
+	pixels = vorrq_u32( pixels, vshlq_n_u32( vaddq_u32( green, ambient ), 8 ) );
+	pixels = vorrq_u32( pixels, vaddq_u32( blue, ambient ) );
+
+	vst1q_u32( row + x, pixels );
+	xs = vaddq_f32( xs, four );
+    }
+
+    for ( ; x < width; x++ )
+    {
+	float nx = 2.0f * shading.xx2 * ( x + x0 ) + shading.xx1;
+	row[ x ] = shadePixel( shading, nx, nyLight, nyNorm );
+    }
+}
+
+#endif	// HAVE_NEON_KERNEL
+
+
+CushionKernel::RowFunction CushionKernel::selectRowFunction()
+{
+#ifdef HAVE_AVX2_KERNEL
+
+    __builtin_cpu_init();
+
+    if ( __builtin_cpu_supports( "avx2" ) )
+    {
+	_name = "AVX2";
+	return renderRowAVX2;
+    }
+
+#endif
+
+#if defined( HAVE_SSE2_KERNEL )
+
+    _name = "SSE2";
+    return renderRowSSE2;
+
+#elif defined( HAVE_NEON_KERNEL )
+
+    _name = "NEON";
+    return renderRowNEON;
+
+#else
+
+    _name = "scalar";
+    return renderRowScalar;
+
+#endif
+}
+
+
+void CushionKernel::renderRow( const CushionShading & shading,
+			       int		      x0,
+			       int		      y,
+			       int		      width,
+			       QRgb		    * row )
+{
+    _rowFunction( shading, x0, y, width, row );
+}
+
+
+void CushionKernel::renderCushion( const CushionShading & shading,
+				   const QRect		& rect,
+				   uchar		* bits,
+				   int			  bytesPerLine )
+{
+    for ( int y = 0; y < rect.height(); y++ )
+    {
+	QRgb * row = reinterpret_cast<QRgb *>( bits + y * bytesPerLine );
+	_rowFunction( shading, rect.x(), rect.y() + y, rect.width(), row );
+    }
+}
+
+
+const char * CushionKernel::name()
+{
+    return _name;
+}
@@ -0,0 +1,109 @@
+/*
+ *   File name: CushionKernel.h
+ *   Summary:	Pixel kernel for treemap cushion shading
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef CushionKernel_h
+#define CushionKernel_h
+
+
+#include <QColor>	// QRgb
+#include <QRect>
+
+
+namespace QDirStat
+{
+    /**
+     * Parameters for shading one cushion: The polynome coefficients of the
+     * CushionSurface, the light source and the base color of the tile.
+     **/
+    struct CushionShading
+    {
+	float	xx2;
+	float	xx1;
+	float	yy2;
+	float	yy1;
+
+	float	lightX;
+	float	lightY;
+	float	lightZ;
+
+	int	ambientLight;
+	int	maxRed;		// Tile color minus ambient light
+	int	maxGreen;
+	int	maxBlue;
+    };
+
+
+    /**
+     * Pixel kernel for cushion shading.
+     *
+     * For each pixel, this computes the normal of the cushion surface and
+     * the cosine of the angle to the light source, and it shades the tile
+     * color with it. This is where rendering a treemap spends almost all of
+     * its time, so there are vectorized versions for SSE2 and AVX2 (x86)
+     * and NEON (ARM 64 bit). The best one for this CPU is selected at
+     * runtime. They all use float math; the result is the same as with
+     * the scalar version within rounding.
+     **/
+    class CushionKernel
+    {
+    public:
+
+	/**
+	 * Render 'width' pixels of row 'y' of a cushion with 'shading' to
+	 * 'row'. 'x0' is the x coordinate of the first pixel. Both 'x0'
+	 * and 'y' are in treemap coordinates since that is what the
+	 * cushion surface uses.
+	 **/
+	static void renderRow( const CushionShading & shading,
+			       int		      x0,
+			       int		      y,
+			       int		      width,
+			       QRgb		    * row );
+
+	/**
+	 * Render the cushion for 'rect' (in treemap coordinates) with
+	 * 'shading' to an RGB32 pixel buffer. 'bits' points to the pixel for
+	 * the top left corner of 'rect', 'bytesPerLine' is the distance
+	 * between two rows of the buffer.
+	 *
+	 * This does not use any QImage methods, so different threads can
+	 * render different rectangles of the same buffer at the same time.
+	 **/
+	static void renderCushion( const CushionShading & shading,
+				   const QRect		& rect,
+				   uchar		* bits,
+				   int			  bytesPerLine );
+
+	/**
+	 * Return the name of the kernel that renderRow() uses.
+	 **/
+	static const char * name();
+
+
+    protected:
+
+	typedef void (*RowFunction)( const CushionShading & shading,
+				     int  x0,
+				     int  y,
+				     int  width,
+				     QRgb * row );
+
+	/**
+	 * Select the best row function for this CPU.
+	 **/
+	static RowFunction selectRowFunction();
+
+	static RowFunction  _rowFunction;
+	static const char * _name;
+    };
+
+}	// namespace QDirStat
+
+
+#endif // ifndef CushionKernel_h
@@ -65,7 +65,11 @@ const DataColumnList DataColumns::defaultColumns() const
 	    << TotalItemsCol
 	    << TotalFilesCol
 	    << TotalSubDirsCol
-	    << LatestMTimeCol;
+	    << LatestMTimeCol
+	    << MainCategoryCol
+	    << GrowthCol
+	    << ExclusiveSizeCol
+	    << ReadTimeCol;
 
     return columns;
 }
@@ -103,6 +107,30 @@ void DataColumns::setColumns( const DataColumnList & newColumns )
 }
 
 
+int DataColumns::aggregates( DataColumn col )
+{
+    switch ( col )
+    {
+	case MainCategoryCol:	return TypeSummaryAggregate;
+	case ExclusiveSizeCol:	return ExtentAggregate;
+	case ReadTimeCol:	return ReadTimeAggregate;
+
+	default:		return NoAggregates;
+    }
+}
+
+
+int DataColumns::aggregates( const DataColumnList & columns )
+{
+    int result = NoAggregates;
+
+    foreach ( DataColumn col, columns )
+	result |= aggregates( col );
+
+    return result;
+}
+
+
 DataColumn DataColumns::mappedCol( DataColumn viewCol ) const
 {
     if ( viewCol < 0 || viewCol >= colCount() )
@@ -137,6 +165,10 @@ QString DataColumns::toString( DataColumn col )
 	case TotalFilesCol:	return "TotalFilesCol";
 	case TotalSubDirsCol:	return "TotalSubDirsCol";
 	case LatestMTimeCol:	return "LatestMTimeCol";
+	case MainCategoryCol:	return "MainCategoryCol";
+	case GrowthCol:		return "GrowthCol";
+	case ExclusiveSizeCol:	return "ExclusiveSizeCol";
+	case ReadTimeCol:	return "ReadTimeCol";
 	case ReadJobsCol:	return "ReadJobsCol";
 	case UndefinedCol:	return "UndefinedCol";
 
@@ -32,6 +32,10 @@ namespace QDirStat
 	TotalFilesCol,		// Total number of files    in subtree
 	TotalSubDirsCol,	// Total number of subdirs  in subtree
 	LatestMTimeCol,		// Latest modification time in subtree
+	MainCategoryCol,	// MIME category with the most disk space in subtree
+	GrowthCol,		// Size delta to an older cache file (see CacheDiff)
+	ExclusiveSizeCol,	// Disk space not shared with other files (see ExtentStats)
+	ReadTimeCol,		// Time it took to read the directory (see DirReadTimes)
 	ReadJobsCol,		// Number of pending read jobs in subtree
 	UndefinedCol
     };
@@ -41,6 +45,26 @@ namespace QDirStat
 #define DataColumnEnd	UndefinedCol
 
 
+    /**
+     * Optional aggregates that a column needs in addition to the totals that
+     * each directory always keeps. Each DirTreeModel only maintains them
+     * while its view shows a column that needs them (see
+     * DirTreeModel::setVisibleColumns()).
+     *
+     * The read times can't be measured after the fact, so they are only
+     * recorded for the directories read while their column is visible. The
+     * "Growth" column has none: It needs an older cache file to compare
+     * with that only the user can choose.
+     **/
+    enum Aggregate
+    {
+	NoAggregates	     = 0,
+	TypeSummaryAggregate = 1,	// See DirInfo::typeSummary()
+	ExtentAggregate	     = 2,	// See ExtentStats
+	ReadTimeAggregate    = 4	// See DirReadTimes
+    };
+
+
     typedef QList<DataColumn> DataColumnList;
 
 
@@ -151,6 +175,16 @@ namespace QDirStat
 	 **/
 	static DataColumnList fixup( const DataColumnList & colList );
 
+	/**
+	 * Return the Aggregate flags of what column 'col' needs.
+	 **/
+	static int aggregates( DataColumn col );
+
+	/**
+	 * Return the Aggregate flags of what all of 'columns' need.
+	 **/
+	static int aggregates( const DataColumnList & columns );
+
 
     public slots:
 
@@ -7,12 +7,11 @@
  */
 
 
-#include <QTimer>
-
 #include "DelayedRebuilder.h"
 #include "Logger.h"
 
 #define DefaultRebuildDelayMillisec 200
+#define MaxRebuildDelayMillisec	    1500
 
 using namespace QDirStat;
 
@@ -21,9 +20,14 @@ DelayedRebuilder::DelayedRebuilder( QObject * parent ):
     QObject( parent ),
     _firstRebuild( true ),
     _pendingRebuildCount(0),
-    _delayMillisec( DefaultRebuildDelayMillisec )
+    _delayMillisec( DefaultRebuildDelayMillisec ),
+    _inBackground( false ),
+    _averageRebuildMillisec( 0 )
 {
+    _timer.setSingleShot( true );
 
+    connect( &_timer, SIGNAL( timeout()	       ),
+             this,    SLOT  ( rebuildDelayed() ) );
 }
 
 
@@ -33,19 +37,78 @@ DelayedRebuilder::~DelayedRebuilder()
 }
 
 
+int DelayedRebuilder::delay() const
+{
+    // Waiting a little longer than necessary is much cheaper than doing an
+    // expensive rebuild only to throw it away right afterwards.
+
+    qint64 delay = qMax( (qint64) _delayMillisec, _averageRebuildMillisec / 2 );
+
+    return (int) qMin( delay, (qint64) qMax( _delayMillisec, MaxRebuildDelayMillisec ) );
+}
+
+
 void DelayedRebuilder::scheduleRebuild()
 {
+    if ( _inBackground )
+    {
+        // Still busy with the previous one, but that one is outdated now.
+        // It has taken that long already, which is worth remembering if
+        // it is more than usual.
+
+        qint64 elapsed = _rebuildTime.elapsed();
+        _inBackground = false;
+
+        if ( elapsed > _averageRebuildMillisec )
+            addRebuildTime( elapsed );
+
+        emit cancelRebuild();
+    }
+
+    // Restarting the timer drops the previous request
+
     ++_pendingRebuildCount;
-    QTimer::singleShot( _delayMillisec, this, SLOT( rebuildDelayed() ) );
+    _timer.start( delay() );
 }
 
 
 void DelayedRebuilder::rebuildDelayed()
 {
-    if ( --_pendingRebuildCount > 0 ) // Yet another rebuild scheduled (by timer)?
-        return;                       // -> do nothing, it will be in vain anyway
-
     _pendingRebuildCount = 0;
-    _firstRebuild       = false;
+    _firstRebuild	 = false;
+    _inBackground	 = false;
+    _rebuildTime.start();
+
     emit rebuild();
+
+    if ( ! _inBackground )
+        addRebuildTime( _rebuildTime.elapsed() );
+}
+
+
+void DelayedRebuilder::rebuildFinished()
+{
+    if ( ! _inBackground )
+        return;
+
+    _inBackground = false;
+    addRebuildTime( _rebuildTime.elapsed() );
+}
+
+
+void DelayedRebuilder::addRebuildTime( qint64 millisec )
+{
+    // Moving average: Quick to follow, but not thrown off by a single
+    // cheap rebuild, e.g. from a cached layout
+
+    if ( _averageRebuildMillisec == 0 )
+        _averageRebuildMillisec = millisec;
+    else
+        _averageRebuildMillisec = ( 3 * _averageRebuildMillisec + millisec ) / 4;
+
+    if ( millisec > _delayMillisec )
+    {
+        logDebug() << "Rebuild took " << millisec << " ms; next delay: "
+                   << delay() << " ms" << endl;
+    }
 }
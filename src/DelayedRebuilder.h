@@ -12,6 +12,8 @@
 
 
 #include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
 
 
 namespace QDirStat
@@ -23,6 +25,16 @@ namespace QDirStat
      * in case another rebuild is requested immediately. This is useful for
      * resize events to prevent doing expensive widget rebuilds more often than
      * necessary.
+     *
+     * The delay adapts to how long the previous rebuilds took: The more
+     * expensive a rebuild is, the longer it waits for the requests to stop
+     * coming in, up to a limit. Any number of requests while waiting result
+     * in just one rebuild.
+     *
+     * A rebuild that continues in the background after rebuild() returns
+     * can be reported with rebuildInBackground() and rebuildFinished(). If
+     * another rebuild is requested meanwhile, cancelRebuild() is emitted,
+     * so the receiver can stop the one that is no longer needed.
      **/
     class DelayedRebuilder: public QObject
     {
@@ -50,10 +62,35 @@ namespace QDirStat
         int pendingRebuildCount() const { return _pendingRebuildCount; }
 
         /**
-         * Change the default 200 millisec delay to a new value.
+         * Change the default 200 millisec delay to a new value. This is the
+         * minimum; for expensive rebuilds, the delay is longer.
          **/
         void setDelay( int delayMillisec ) { _delayMillisec = delayMillisec; }
 
+        /**
+         * Return the delay for the next rebuild: The minimum delay or half
+         * of the average time of the recent rebuilds, but not more than
+         * 1.5 seconds.
+         **/
+        int delay() const;
+
+        /**
+         * Return the average time of the recent rebuilds in milliseconds.
+         **/
+        qint64 averageRebuildMillisec() const { return _averageRebuildMillisec; }
+
+        /**
+         * Notification that the rebuild that was started with the rebuild()
+         * signal continues in the background. Call this from the slot
+         * connected to rebuild(), then rebuildFinished() when it is done.
+         **/
+        void rebuildInBackground() { _inBackground = true; }
+
+        /**
+         * Return 'true' if a rebuild is running in the background.
+         **/
+        bool isRebuilding() const { return _inBackground; }
+
     public slots:
 
         /**
@@ -63,6 +100,14 @@ namespace QDirStat
          **/
         void scheduleRebuild();
 
+        /**
+         * Notification that a rebuild in the background is finished. The
+         * time since the rebuild() signal counts as the time of the
+         * rebuild. This does nothing if there is no rebuild in the
+         * background.
+         **/
+        void rebuildFinished();
+
     signals:
         /**
          * Emitted when the rebuild should really be done: When the timeout is
@@ -70,19 +115,36 @@ namespace QDirStat
          **/
         void rebuild();
 
+        /**
+         * Emitted when another rebuild is scheduled while one is still
+         * running in the background (see rebuildInBackground()): That one
+         * is no longer needed.
+         **/
+        void cancelRebuild();
+
     protected slots:
 
         /**
          * Slot that is called when the timeout is over: This will emit a
-         * rebuild() signal if there are no more pending rebuilds.
+         * rebuild() signal and measure how long it takes.
          **/
         void rebuildDelayed();
 
     protected:
 
-        bool _firstRebuild;
-        int  _pendingRebuildCount;
-        int  _delayMillisec;
+        /**
+         * Add the time of a rebuild to the average.
+         **/
+        void addRebuildTime( qint64 millisec );
+
+
+        bool          _firstRebuild;
+        int           _pendingRebuildCount;
+        int           _delayMillisec;
+        bool          _inBackground;
+        qint64        _averageRebuildMillisec;
+        QTimer        _timer;
+        QElapsedTimer _rebuildTime;
     };
 
 }	// namespace QDirStat
@@ -0,0 +1,314 @@
+/*
+ *   File name: DeleteJob.cpp
+ *   Summary:	Deleting files and directories in a worker thread
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <string.h>	// strcmp()
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "DeleteJob.h"
+#include "DirTree.h"
+#include "FileInfoSet.h"
+#include "Refresher.h"
+#include "Trash.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+DeleteJob::DeleteJob( Mode mode, QObject * parent ):
+    QObject( parent ),
+    _mode( mode ),
+    _canceled( 0 ),
+    _busy( false )
+{
+    _threadPool.setMaxThreadCount( 1 );
+
+    connect( this, SIGNAL( workerItemDone( QString, QString ) ),
+	     this, SLOT	 ( itemDone	 ( QString, QString ) ),
+	     Qt::QueuedConnection );
+
+    connect( this, SIGNAL( workerDone() ),
+	     this, SLOT	 ( done()	),
+	     Qt::QueuedConnection );
+}
+
+
+DeleteJob::~DeleteJob()
+{
+    cancel();
+    _threadPool.waitForDone();
+}
+
+
+void DeleteJob::addItems( const FileInfoSet & items )
+{
+    foreach ( FileInfo * item, items.normalized() )
+    {
+	if ( item->isDotEntry() )
+	    continue;
+
+	if ( ! _tree )
+	    _tree = item->tree();
+
+	_paths << item->url();
+    }
+}
+
+
+void DeleteJob::start()
+{
+    if ( _busy )
+	return;
+
+    if ( _paths.isEmpty() )
+    {
+	emit finished();
+	return;
+    }
+
+    if ( _mode == MoveToTrash )
+	(void) Trash::instance(); // Create the singleton in the main thread
+
+    logInfo() << ( _mode == MoveToTrash ? "Moving " : "Deleting " )
+	      << _paths.size() << " items" << endl;
+
+    _busy = true;
+
+    DeleteWorker * worker = new DeleteWorker( this );
+    CHECK_NEW( worker );
+    _threadPool.start( worker );	// The thread pool takes ownership
+}
+
+
+static bool isSet( const QAtomicInt * flag )
+{
+    if ( ! flag )
+	return false;
+
+#if (QT_VERSION < QT_VERSION_CHECK( 5, 0, 0 ))
+    return (int) *flag != 0;
+#else
+    return flag->load() != 0;
+#endif
+}
+
+
+bool DeleteJob::isCanceled() const
+{
+    return isSet( &_canceled );
+}
+
+
+void DeleteJob::work()
+{
+    foreach ( const QString & path, _paths )
+    {
+	if ( isCanceled() )
+	    break;
+
+	QString error;
+
+	if ( _mode == MoveToTrash )
+	{
+	    if ( ! Trash::trash( path ) )
+		error = tr( "Move to trash failed for %1" ).arg( path );
+	}
+	else
+	{
+	    error = removeTree( path.toUtf8(), &_canceled );
+	}
+
+	emit workerItemDone( path, error );
+    }
+
+    emit workerDone();
+
+    // Don't touch anything after this: The job might be deleted in the
+    // main thread as soon as the workerDone() signal arrives.
+}
+
+
+QString DeleteJob::removeTree( const QByteArray & path,
+			       const QAtomicInt * canceled )
+{
+    struct stat statInfo;
+
+    if ( lstat( path, &statInfo ) < 0 )
+	return tr( "Can't delete %1: %2" ).arg( QString::fromUtf8( path ) ).arg( formatErrno() );
+
+    if ( S_ISDIR( statInfo.st_mode ) )
+    {
+	int dirFd = open( path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW );
+
+	if ( dirFd < 0 )
+	    return tr( "Can't open %1: %2" ).arg( QString::fromUtf8( path ) ).arg( formatErrno() );
+
+	QString error = removeContents( dirFd, path, canceled );
+
+	if ( ! error.isEmpty() )
+	    return error;
+
+	if ( rmdir( path ) < 0 )
+	    return tr( "Can't delete %1: %2" ).arg( QString::fromUtf8( path ) ).arg( formatErrno() );
+    }
+    else if ( unlink( path ) < 0 )
+    {
+	return tr( "Can't delete %1: %2" ).arg( QString::fromUtf8( path ) ).arg( formatErrno() );
+    }
+
+    return QString();
+}
+
+
+QString DeleteJob::removeContents( int		     dirFd,
+				   const QByteArray & dirPath,
+				   const QAtomicInt * canceled )
+{
+    DIR * dir = fdopendir( dirFd );
+
+    if ( ! dir )
+    {
+	QString error = tr( "Can't open %1: %2" ).arg( QString::fromUtf8( dirPath ) ).arg( formatErrno() );
+	close( dirFd );
+
+	return error;
+    }
+
+    QString firstError;
+    struct dirent * entry;
+
+    while ( ( entry = readdir( dir ) ) != 0 )
+    {
+	if ( isSet( canceled ) )
+	{
+	    firstError = tr( "Canceled" );
+	    break;
+	}
+
+	if ( strcmp( entry->d_name, "." ) == 0 || strcmp( entry->d_name, ".." ) == 0 )
+	    continue;
+
+	// Just try to unlink it: This works for anything but directories,
+	// and it saves a stat() call for each file.
+
+	if ( unlinkat( dirFd, entry->d_name, 0 ) == 0 )
+	    continue;
+
+	int unlinkErrno = errno;
+	QByteArray path = dirPath + "/" + entry->d_name;
+	QString error;
+
+	if ( unlinkErrno == EISDIR || unlinkErrno == EPERM )
+	{
+	    int subDirFd = openat( dirFd, entry->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW );
+
+	    if ( subDirFd >= 0 )
+	    {
+		error = removeContents( subDirFd, path, canceled );
+
+		if ( error.isEmpty() && unlinkat( dirFd, entry->d_name, AT_REMOVEDIR ) < 0 )
+		    error = tr( "Can't delete %1: %2" ).arg( QString::fromUtf8( path ) ).arg( formatErrno() );
+	    }
+	    else
+	    {
+		if ( errno != ENOTDIR )
+		    unlinkErrno = errno;
+
+		errno = unlinkErrno;
+		error = tr( "Can't delete %1: %2" ).arg( QString::fromUtf8( path ) ).arg( formatErrno() );
+	    }
+	}
+	else
+	{
+	    error = tr( "Can't delete %1: %2" ).arg( QString::fromUtf8( path ) ).arg( formatErrno() );
+	}
+
+	if ( ! error.isEmpty() )
+	{
+	    // Continue with the rest anyway like "rm -rf" does
+
+	    logWarning() << error << endl;
+
+	    if ( firstError.isEmpty() )
+		firstError = error;
+	}
+    }
+
+    closedir( dir ); // This also closes dirFd
+
+    return firstError;
+}
+
+
+void DeleteJob::itemDone( const QString & path, const QString & error )
+{
+    if ( error.isEmpty() )
+    {
+	emit progress( _mode == MoveToTrash ?
+		       tr( "Moved to trash: %1" ).arg( path ) :
+		       tr( "Deleted: %1" ).arg( path ) );
+
+	FileInfo * item = _tree ? _tree->locate( path ) : 0;
+
+	if ( item )
+	    _tree->deleteSubtree( item );
+    }
+    else
+    {
+	emit errorMessage( error );
+
+	// A failed move to the trash didn't change anything, but a failed
+	// delete might have deleted a part of the subtree.
+
+	if ( _mode == Delete )
+	    _failedPaths << path;
+    }
+}
+
+
+void DeleteJob::done()
+{
+    _busy = false;
+
+    if ( _tree && ! _failedPaths.isEmpty() )
+    {
+	FileInfoSet refreshSet;
+
+	foreach ( const QString & path, _failedPaths )
+	{
+	    FileInfo * item = _tree->locate( path );
+
+	    if ( item )
+		refreshSet << item;
+	}
+
+	if ( ! refreshSet.isEmpty() )
+	{
+	    Refresher * refresher = new Refresher( refreshSet, _tree );
+	    CHECK_NEW( refresher );
+	    refresher->refresh(); // This deletes the refresher
+	}
+    }
+
+    _failedPaths.clear();
+    emit finished();
+}
+
+
+
+
+void DeleteWorker::run()
+{
+    _job->work();
+}
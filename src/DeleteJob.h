@@ -0,0 +1,214 @@
+/*
+ *   File name: DeleteJob.h
+ *   Summary:	Deleting files and directories in a worker thread
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef DeleteJob_h
+#define DeleteJob_h
+
+
+#include <QObject>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QStringList>
+#include <QAtomicInt>
+#include <QPointer>
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class FileInfoSet;
+
+
+    /**
+     * Job to delete files and directories or to move them to the trash
+     * without starting any external process: Deleting is done with
+     * unlinkat() / openat() directly, moving to the trash with
+     * Trash::trash(). This is all done in a worker thread, so the GUI stays
+     * responsive even for very large subtrees.
+     *
+     * As soon as an item is gone, it is also removed from the DirTree, so
+     * there is no need to refresh anything afterwards. Only items that
+     * could not be deleted completely are refreshed at the end.
+     *
+     * This can be added to an OutputWindow with OutputWindow::addJob(): It
+     * reports each item there and it can be canceled with the window's
+     * "Kill" button.
+     *
+     * The parent takes ownership as usual; deleting the job cancels it and
+     * waits for the worker thread.
+     **/
+    class DeleteJob: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	enum Mode
+	{
+	    Delete,
+	    MoveToTrash
+	};
+
+	/**
+	 * Constructor.
+	 **/
+	DeleteJob( Mode mode, QObject * parent = 0 );
+
+	/**
+	 * Destructor. This cancels the job and waits for the worker thread.
+	 **/
+	virtual ~DeleteJob();
+
+	/**
+	 * Add items to delete. They all have to belong to the same DirTree.
+	 * Items in the subtree of any other item are ignored. This has to be
+	 * called before start().
+	 **/
+	void addItems( const FileInfoSet & items );
+
+	/**
+	 * Start the worker thread.
+	 **/
+	void start();
+
+	/**
+	 * Return the mode of this job.
+	 **/
+	Mode mode() const { return _mode; }
+
+	/**
+	 * Return 'true' if the worker is still busy.
+	 **/
+	bool isBusy() const { return _busy; }
+
+	/**
+	 * Return 'true' if the job was canceled.
+	 **/
+	bool isCanceled() const;
+
+	/**
+	 * Do the work. This is called in the worker thread.
+	 **/
+	void work();
+
+	/**
+	 * Delete 'path' with everything below it. Return an empty string on
+	 * success and an error message otherwise. If 'canceled' is non-null,
+	 * stop as soon as it is set.
+	 *
+	 * This can be used from any thread.
+	 **/
+	static QString removeTree( const QByteArray & path,
+				   const QAtomicInt * canceled = 0 );
+
+    public slots:
+
+	/**
+	 * Cancel the job. The worker stops as soon as possible; an item that
+	 * is only partly deleted at that moment is refreshed.
+	 **/
+	void cancel() { _canceled.ref(); }
+
+    signals:
+
+	/**
+	 * Emitted for each item that is done.
+	 **/
+	void progress( const QString & text );
+
+	/**
+	 * Emitted for any error.
+	 **/
+	void errorMessage( const QString & text );
+
+	/**
+	 * Emitted when the job is finished or canceled.
+	 **/
+	void finished();
+
+	/**
+	 * Emitted in the worker thread when one item is done. 'error' is
+	 * empty on success.
+	 **/
+	void workerItemDone( const QString & path, const QString & error );
+
+	/**
+	 * Emitted in the worker thread when it is done.
+	 **/
+	void workerDone();
+
+    protected slots:
+
+	/**
+	 * One item is done: Remove it from the tree if it is gone.
+	 **/
+	void itemDone( const QString & path, const QString & error );
+
+	/**
+	 * The worker is done: Refresh the items that could not be deleted
+	 * completely.
+	 **/
+	void done();
+
+    protected:
+
+	/**
+	 * Delete everything in the directory opened as 'dirFd', which is
+	 * 'dirPath'. This takes over 'dirFd' and closes it.
+	 **/
+	static QString removeContents( int		  dirFd,
+				       const QByteArray & dirPath,
+				       const QAtomicInt * canceled );
+
+
+	// Data members
+
+	Mode			_mode;
+	QPointer<DirTree>	_tree;
+	QStringList		_paths;
+	QStringList		_failedPaths;
+	QThreadPool		_threadPool;
+	QAtomicInt		_canceled;
+	bool			_busy;
+
+    };	// class DeleteJob
+
+
+    /**
+     * Runnable for a QThreadPool that does the work of a DeleteJob.
+     **/
+    class DeleteWorker: public QRunnable
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	DeleteWorker( DeleteJob * job ):
+	    QRunnable(),
+	    _job( job )
+	    { setAutoDelete( true ); }
+
+	/**
+	 * Do the work. This is called in a worker thread.
+	 *
+	 * Reimplemented from QRunnable.
+	 **/
+	virtual void run() Q_DECL_OVERRIDE;
+
+    protected:
+
+	DeleteJob * _job;
+
+    };	// class DeleteWorker
+
+}	// namespace QDirStat
+
+
+#endif // ifndef DeleteJob_h
@@ -9,15 +9,89 @@
 
 #include <algorithm>
 
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+
 #include "DirInfo.h"
 #include "DirTree.h"
+#include "CacheBudget.h"
+#include "ChildColumns.h"
 #include "FileInfoIterator.h"
 #include "FileInfoSorter.h"
+#include "ColdSubtree.h"
+#include "TreeSnapshot.h"
+#include "MimeCategorizer.h"
 #include "Exception.h"
 
+
+// Subtrees with fewer items are finished in one thread
+#define MIN_PARALLEL_FINISH_ITEMS	50000
+
+// Subtrees with fewer items are not split up any further
+#define MIN_FINISH_TASK_ITEMS		5000
+
+
+// Build a name index for findChild() for directories with at least this
+// many direct children
+#define MIN_INDEXED_CHILDREN	64
+
+// Keep an index of the rows of sorted children from this many children on
+#define MIN_INDEXED_ROWS	32
+
 using namespace QDirStat;
 
 
+FoldedFiles::FoldedFiles():
+    size( 0 ),
+    blocks( 0 ),
+    items( 0 ),
+    files( 0 ),
+    latestMtime( 0 ),
+    ownerIndex( 0 )
+{
+    for ( int i=0; i < SizeBucketCount; ++i )
+	sizeBuckets[i] = 0;
+}
+
+
+void FoldedFiles::add( const FileInfo * file )
+{
+    FileSize fileSize = file->size();
+
+    if ( items == 0 )
+	ownerIndex = file->ownerIndex();
+
+    size   += fileSize;
+    blocks += file->countedBlocks();
+    items++;
+
+    if ( file->isFile() )
+	files++;
+
+    if ( file->mtime() > latestMtime )
+	latestMtime = file->mtime();
+
+    sizeBuckets[ sizeBucket( fileSize ) ]++;
+}
+
+
+int FoldedFiles::sizeBucket( FileSize size )
+{
+    int bucket = 0;
+
+    while ( size > 0 && bucket < SizeBucketCount - 1 )
+    {
+	size >>= 1;
+	++bucket;
+    }
+
+    return bucket;
+}
+
+
+
+
 DirInfo::DirInfo( DirTree * tree,
 		  DirInfo * parent,
 		  bool	    asDotEntry )
@@ -31,7 +105,10 @@ DirInfo::DirInfo( DirTree * tree,
 	_name	    = dotEntryName();
 
         if ( parent )
-            _device = parent->device();
+        {
+            _deviceIndex = parent->_deviceIndex;
+            _ownerIndex  = parent->_ownerIndex;
+        }
     }
     else
     {
@@ -84,16 +161,29 @@ void DirInfo::init()
     _pendingReadJobs = 0;
     _dotEntry	     = 0;
     _firstChild	     = 0;
+    _childIndex	     = 0;
+    _childArray	     = 0;
+    _childColumns    = 0;
     _totalSize	     = _size;
     _totalBlocks     = _blocks;
     _totalItems	     = 0;
     _totalSubDirs    = 0;
     _totalFiles	     = 0;
     _latestMtime     = _mtime;
+    _summaryDelta    = 0;
+    _foldedFiles     = 0;
+    _coldSubtree     = 0;
+    _snapshotDir     = 0;
+    _typeSummary     = 0;
     _readState	     = DirQueued;
     _sortedChildren  = 0;
+    _sortedChildRows = 0;
     _lastSortCol     = UndefinedCol;
     _lastSortOrder   = Qt::AscendingOrder;
+    _prevSortedChildren = 0;
+    _prevSortCol     = UndefinedCol;
+    _prevSortOrder   = Qt::AscendingOrder;
+    _sizeSortedChildren = 0;
 }
 
 
@@ -106,6 +196,7 @@ DirInfo::~DirInfo()
 void DirInfo::clear()
 {
     _deletingAll = true;
+    dropChildArray();
 
     // Recursively delete all children.
 
@@ -113,7 +204,10 @@ void DirInfo::clear()
     {
 	FileInfo * nextChild = _firstChild->next();
 
-	if ( _parent )
+	// If the parent is deleting all its children, too, the ancestors
+	// already know about this complete subtree.
+
+	if ( _parent && ! _parent->_deletingAll )
 	    _parent->deletingChild( _firstChild );
 
 	delete _firstChild;
@@ -129,8 +223,122 @@ void DirInfo::clear()
 	_dotEntry = 0;
     }
 
+    if ( _summaryDelta )
+    {
+	delete _summaryDelta;
+	_summaryDelta = 0;
+    }
+
+    if ( _foldedFiles )
+    {
+	delete _foldedFiles;
+	_foldedFiles = 0;
+    }
+
+    if ( _coldSubtree )
+    {
+	delete _coldSubtree;
+	_coldSubtree = 0;
+    }
+
+    dropChildIndex();
+    dropSnapshotDir();
+
     _summaryDirty = true;
     dropSortCache();
+    dropSizeSortCache();
+    dropTypeSummary();
+
+    if ( _parent && ! _parent->_deletingAll )
+    {
+	// The children of the dot entry didn't tell the ancestors
+
+	for ( DirInfo * dir = _parent; dir; dir = dir->parent() )
+	{
+	    dir->_summaryDirty = true;
+	    dir->dropSizeSortCache();
+	    dir->dropTypeSummary();
+	}
+    }
+
+    _deletingAll = false;
+}
+
+
+DirInfo * DirInfo::detachChildren()
+{
+    DirInfo * holder = new DirInfo( _tree );
+    CHECK_NEW( holder );
+
+    holder->_firstChild = _firstChild;
+    holder->_dotEntry	= _dotEntry;
+    holder->_treeLevel	= _treeLevel;	// The levels of the children stay the same
+
+    for ( FileInfo * child = _firstChild; child; child = child->next() )
+	child->setParent( holder );
+
+    if ( _dotEntry )
+	_dotEntry->setParent( holder );
+
+    _firstChild = 0;
+    _dotEntry	= 0;
+
+    // Drop all caches and summaries just like when the children are deleted
+
+    clear();
+
+    return holder;
+}
+
+
+void DirInfo::setColdSubtree( ColdSubtree * cold )
+{
+    if ( _coldSubtree )
+	delete _coldSubtree;
+
+    _coldSubtree  = cold;
+    _summaryDirty = true;
+}
+
+
+void DirInfo::setSnapshotDir( SnapshotDir * snapshotDir )
+{
+    // The other references may be in other threads, so whoever drops the
+    // last one deletes it.
+
+    if ( snapshotDir )
+	snapshotDir->ref.ref();
+
+    if ( _snapshotDir && ! _snapshotDir->ref.deref() )
+	delete _snapshotDir;
+
+    _snapshotDir = snapshotDir;
+}
+
+
+void DirInfo::thaw()
+{
+    if ( ! _coldSubtree )
+	return;
+
+    ColdSubtree * cold = _coldSubtree;
+    _coldSubtree = 0;
+
+    if ( ! cold->inflate( this ) )
+	logError() << "Could not restore all of " << this << endl;
+
+    delete cold;
+    _summaryDirty = true;
+
+    // The restored directories don't have their child arrays and columns yet
+
+    finishSubtree( true );
+}
+
+
+bool DirInfo::hasChildren() const
+{
+    return _coldSubtree || FileInfo::hasChildren();
 }
 
 
@@ -139,7 +347,7 @@ void DirInfo::reset()
     if ( _isDotEntry )
 	return;
 
-    if ( _firstChild || _dotEntry )
+    if ( _firstChild || _dotEntry || _coldSubtree )
 	clear();
 
     _readState	     = DirQueued;
@@ -154,6 +362,7 @@ void DirInfo::reset()
 
     recalc();
     dropSortCache();
+    dropSizeSortCache();
 }
 
 
@@ -168,34 +377,98 @@ void DirInfo::recalc()
     _totalFiles	  = 0;
     _latestMtime  = _mtime;
 
-    FileInfoIterator it( this );
+    if ( _coldSubtree )
+    {
+	_totalSize     = _coldSubtree->totalSize();
+	_totalBlocks   = _coldSubtree->totalBlocks();
+	_totalItems    = _coldSubtree->totalItems();
+	_totalSubDirs  = _coldSubtree->totalSubDirs();
+	_totalFiles    = _coldSubtree->totalFiles();
+	_latestMtime   = _coldSubtree->latestMtime();
+	_summaryDirty  = false;
 
-    while ( *it )
+	return;
+    }
+
+    if ( _childColumns )
     {
-	_totalSize    += (*it)->totalSize();
-	_totalBlocks  += (*it)->totalBlocks();
-	_totalItems   += (*it)->totalItems() + 1;
-	_totalSubDirs += (*it)->totalSubDirs();
-	_totalFiles   += (*it)->totalFiles();
+	// Add up the files from the arrays, only the subdirectories one by one
 
-	if ( (*it)->isDir() )
-	    _totalSubDirs++;
+	_totalSize    += _childColumns->totalSize();
+	_totalBlocks  += _childColumns->totalBlocks();
+	_totalItems   += _childColumns->count();
+	_totalSubDirs += _childColumns->subDirs();
+	_totalFiles   += _childColumns->files();
+	_latestMtime   = qMax( _latestMtime, _childColumns->latestMtime() );
 
-	if ( (*it)->isFile() )
-	    _totalFiles++;
+	foreach ( DirInfo * dir, _childColumns->dirs() )
+	    addChildTotals( dir );
 
-	time_t childLatestMtime = (*it)->latestMtime();
+	if ( _dotEntry )
+	    addChildTotals( _dotEntry );
+    }
+    else
+    {
+	FileInfoIterator it( this );
 
-	if ( childLatestMtime > _latestMtime )
-	    _latestMtime = childLatestMtime;
+	while ( *it )
+	{
+	    addChildTotals( *it );
+	    ++it;
+	}
+    }
 
-	++it;
+    if ( _foldedFiles )
+    {
+	_totalSize   += _foldedFiles->size;
+	_totalBlocks += _foldedFiles->blocks;
+	_totalItems  += _foldedFiles->items;
+	_totalFiles  += _foldedFiles->files;
+	_latestMtime  = qMax( _latestMtime, _foldedFiles->latestMtime );
     }
 
     _summaryDirty = false;
 }
 
 
+void DirInfo::addChildTotals( FileInfo * child )
+{
+    _totalSize	  += child->totalSize();
+    _totalBlocks  += child->totalBlocks();
+    _totalItems	  += child->totalItems() + 1;
+    _totalSubDirs += child->totalSubDirs();
+    _totalFiles	  += child->totalFiles();
+
+    if ( child->isDir() )
+	_totalSubDirs++;
+
+    if ( child->isFile() )
+	_totalFiles++;
+
+    if ( child->isDirInfo() )
+    {
+	// Don't count what a subdirectory is still going to push up in
+	// lazy summary mode.
+
+	const SummaryDelta * delta = child->toDirInfo()->_summaryDelta;
+
+	if ( delta )
+	{
+	    _totalSize	  -= delta->size;
+	    _totalBlocks  -= delta->blocks;
+	    _totalItems	  -= delta->items;
+	    _totalSubDirs -= delta->subDirs;
+	    _totalFiles	  -= delta->files;
+	}
+    }
+
+    time_t childLatestMtime = child->latestMtime();
+
+    if ( childLatestMtime > _latestMtime )
+	_latestMtime = childLatestMtime;
+}
+
+
 void DirInfo::setMountPoint( bool isMountPoint )
 {
     _isMountPoint = isMountPoint;
@@ -288,6 +561,10 @@ bool DirInfo::isBusy()
 
 void DirInfo::setDotEntry( FileInfo *newDotEntry )
 {
+    dropSizeSortCache();
+    dropTypeSummary();
+    dropAncestorTypeSummaries();
+
     if ( newDotEntry )
 	_dotEntry = newDotEntry->toDirInfo();
     else
@@ -319,6 +596,16 @@ void DirInfo::insertChild( FileInfo *newChild )
 	newChild->setNext( _firstChild );
 	_firstChild = newChild;
 	newChild->setParent( this );	// make sure the parent pointer is correct
+	dropChildArray();
+
+	if ( _childIndex )
+	    _childIndex->insert( newChild->compactName().hash(), newChild );
+
+	if ( _tree && _tree->countOwners() )
+	    _tree->ownerAdded( newChild );
+
+	if ( _tree && _tree->precomputeStats() )
+	    _tree->statsAdded( newChild );
 
 	childAdded( newChild );		// update summaries
     }
@@ -333,150 +620,648 @@ void DirInfo::insertChild( FileInfo *newChild )
 }
 
 
-void DirInfo::childAdded( FileInfo *newChild )
+FileInfo * DirInfo::findChild( const QString & name )
 {
-    if ( ! _summaryDirty )
+    QByteArray utf8 = name.toUtf8();
+
+    if ( ! _childIndex )
     {
-	_totalSize   += newChild->size();
-	_totalBlocks += newChild->blocks();
-	_totalItems++;
+	// Few children: Just search the list
 
-	if ( newChild->isDir() )
-	    _totalSubDirs++;
+	int count = 0;
+	FileInfo * child = _firstChild;
 
-	if ( newChild->isFile() )
-	    _totalFiles++;
+	while ( child && count < MIN_INDEXED_CHILDREN )
+	{
+	    if ( child->compactName().equals( utf8.constData(), utf8.size() ) )
+		return child;
 
-	if ( newChild->mtime() > _latestMtime )
-	    _latestMtime = newChild->mtime();
+	    child = child->next();
+	    ++count;
+	}
+
+	if ( ! child )
+	    return 0;
+
+	buildChildIndex();
     }
-    else
+
+    uint hash = CompactName::hash( utf8.constData(), utf8.size() );
+    QMultiHash<uint, FileInfo *>::const_iterator it = _childIndex->constFind( hash );
+
+    while ( it != _childIndex->constEnd() && it.key() == hash )
     {
-	// NOP
+	if ( it.value()->compactName().equals( utf8.constData(), utf8.size() ) )
+	    return it.value();
 
-	/*
-	 * Don't bother updating the summary fields if the summary is dirty
-	 * (i.e. outdated) anyway: As soon as anybody wants to know some exact
-	 * value a complete recalculation of the entire subtree will be
-	 * triggered. On the other hand, if nobody wants to know (which is very
-	 * likely) we can save this effort.
-	 */
+	++it;
     }
 
-    if ( _lastSortCol != ReadJobsCol )
-	dropSortCache();
+    return 0;
+}
 
-    if ( _parent )
-	_parent->childAdded( newChild );
+
+void DirInfo::buildChildIndex()
+{
+    if ( ! _childIndex )
+    {
+	_childIndex = new QMultiHash<uint, FileInfo *>();
+	CHECK_NEW( _childIndex );
+    }
+
+    _childIndex->clear();
+
+    for ( FileInfo * child = _firstChild; child; child = child->next() )
+	_childIndex->insert( child->compactName().hash(), child );
 }
 
 
-void DirInfo::deletingChild( FileInfo * child )
+void DirInfo::compactChildren()
 {
-    /**
-     * When children are deleted, things go downhill: Marking the summary
-     * fields as dirty (i.e. outdated) is the only thing that can be done here.
-     *
-     * The accumulated sizes could be updated (by subtracting this deleted
-     * child's values from them), but the latest mtime definitely has to be
-     * recalculated: The child now being deleted might just be the one with the
-     * latest mtime, and figuring out the second-latest cannot easily be
-     * done. So we merely mark the summary as dirty and wait until a recalc()
-     * will be triggered from outside - which might as well never happen when
-     * nobody wants to know some summary field anyway.
-     **/
+    dropChildArray();
 
-    _summaryDirty = true;
+    int count = 0;
 
-    if ( _parent )
-	_parent->deletingChild( child );
+    for ( FileInfo * child = _firstChild; child; child = child->next() )
+	++count;
 
-    if ( child->parent() == this )
-    {
-	if ( ! _deletingAll )
-	{
-	    /**
-	     * Unlink the child from the children's list - but only if this
-	     * doesn't happen recursively for all children of this object: No
-	     * use bothering about the validity of the children's list if this
-	     * will all be history anyway in a moment.
-	     **/
+    if ( count == 0 )
+	return;
 
-	    unlinkChild( child );
-	}
-	else
-	{
-	    dropSortCache();
-	}
-    }
+    _childArray = new FileInfo *[ count + 1 ];
+    CHECK_NEW( _childArray );
+
+    FileInfo ** slot = _childArray;
+
+    for ( FileInfo * child = _firstChild; child; child = child->next() )
+	*slot++ = child;
+
+    *slot = 0;
 }
 
 
-void DirInfo::unlinkChild( FileInfo *deletedChild )
+void DirInfo::buildChildColumns()
 {
-    if ( deletedChild->parent() != this )
+    if ( _childColumns )
+	delete _childColumns;
+
+    _childColumns = new ChildColumns( this );
+    CHECK_NEW( _childColumns );
+}
+
+
+void DirInfo::dropChildArray()
+{
+    if ( _childArray )
     {
-	logError() << deletedChild << " is not a child of " << this
-		   << " - cannot unlink from children list!" << endl;
-	return;
+	delete [] _childArray;
+	_childArray = 0;
     }
 
-    dropSortCache();
-
-    if ( deletedChild == _firstChild )
+    if ( _childColumns )
     {
-	logDebug() << "Unlinking first child " << deletedChild << endl;
-	_firstChild = deletedChild->next();
-	return;
+	delete _childColumns;
+	_childColumns = 0;
     }
+}
 
-    FileInfo *child = firstChild();
 
-    while ( child )
+void DirInfo::appendChildren( FileInfoList * list ) const
+{
+    if ( _childArray )
     {
-	if ( child->next() == deletedChild )
-	{
-	    logDebug() << "Unlinking " << deletedChild << endl;
-	    child->setNext( deletedChild->next() );
+	FileInfo * const * end = _childArray;
 
-	    return;
-	}
+	while ( *end )
+	    ++end;
 
-	child = child->next();
+	list->reserve( list->size() + ( end - _childArray ) + 1 );
+
+	for ( FileInfo * const * slot = _childArray; slot != end; ++slot )
+	    list->append( *slot );
+    }
+    else
+    {
+	for ( FileInfo * child = _firstChild; child; child = child->next() )
+	    list->append( child );
     }
 
-    logError() << "Couldn't unlink " << deletedChild << " from "
-	       << this << " children list" << endl;
+    if ( _dotEntry )
+	list->append( _dotEntry );
 }
 
 
-void DirInfo::readJobAdded()
+void DirInfo::dropChildIndex()
 {
-    _pendingReadJobs++;
+    if ( _childIndex )
+    {
+	delete _childIndex;
+	_childIndex = 0;
+    }
+}
 
-    if ( _lastSortCol == ReadJobsCol )
-	dropSortCache();
 
-    if ( _parent )
-	_parent->readJobAdded();
+void DirInfo::childAdded( FileInfo *newChild )
+{
+    subtreeChildAdded( newChild, newChild );
 }
 
 
-void DirInfo::readJobFinished()
+void DirInfo::subtreeChildAdded( FileInfo * newChild, FileInfo * changedChild )
 {
-    _pendingReadJobs--;
+    dropSizeSortCache();
 
-    if ( _lastSortCol == ReadJobsCol )
-	dropSortCache();
+    if ( _typeSummary )
+	addToTypeSummary( newChild, _tree ? _tree->typeSummaryCategorizer() : 0 );
 
-    if ( _parent )
-	_parent->readJobFinished();
+    addToTotals( newChild );
+
+    if ( _sortedChildren && _lastSortCol != ReadJobsCol )
+    {
+	if ( changedChild == newChild )
+	    insertSortedChild( newChild );
+	else
+	    repositionSortedChild( changedChild );
+    }
+
+    propagateChildAdded( newChild );
 }
 
 
-void DirInfo::readJobAborted()
+void DirInfo::addToTotals( FileInfo * newChild )
 {
-    _readState = DirAborted;
+    if ( ! _summaryDirty )
+    {
+	_totalSize   += newChild->size();
+	_totalBlocks += newChild->countedBlocks();
+	_totalItems++;
+
+	if ( newChild->isDir() )
+	    _totalSubDirs++;
+
+	if ( newChild->isFile() )
+	    _totalFiles++;
+
+	if ( newChild->mtime() > _latestMtime )
+	    _latestMtime = newChild->mtime();
+    }
+    else
+    {
+	// NOP
+
+	/*
+	 * Don't bother updating the summary fields if the summary is dirty
+	 * (i.e. outdated) anyway: As soon as anybody wants to know some exact
+	 * value a complete recalculation of the entire subtree will be
+	 * triggered. On the other hand, if nobody wants to know (which is very
+	 * likely) we can save this effort.
+	 */
+    }
+}
+
+
+void DirInfo::propagateChildAdded( FileInfo * newChild )
+{
+    if ( _parent )
+    {
+	if ( ! _isDotEntry && _tree && _tree->lazySummaries() )
+	{
+	    addToSummaryDelta( newChild ); // pushed up in finalizeLocal()
+
+	    // The type summaries are not part of the delta, so the
+	    // ancestors will merge them again from their children.
+
+	    dropAncestorTypeSummaries();
+	}
+	else
+	    _parent->subtreeChildAdded( newChild, this );
+    }
+}
+
+
+void DirInfo::foldChild( FileInfo * child )
+{
+    CHECK_PTR( child );
+
+    if ( _dotEntry && ! _isDotEntry )
+    {
+	_dotEntry->foldChild( child );
+	return;
+    }
+
+    if ( ! _foldedFiles )
+    {
+	_foldedFiles = new FoldedFiles();
+	CHECK_NEW( _foldedFiles );
+    }
+
+    _foldedFiles->add( child );
+
+    if ( _tree && _tree->countOwners() )
+	_tree->ownerAdded( child );
+
+    // Like subtreeChildAdded(), but there is no new child in the children
+    // list or the sort cache; only this one changed in its parent's.
+
+    if ( _typeSummary )
+	addToTypeSummary( child, _tree ? _tree->typeSummaryCategorizer() : 0 );
+
+    addToTotals( child );
+    propagateChildAdded( child );
+
+    // There is no new child to notify the tree about, but the totals of
+    // the ancestors changed
+
+    for ( DirInfo * dir = this; dir && dir->snapshotDir(); dir = dir->parent() )
+	dir->dropSnapshotDir();
+
+    // The caller deletes the temporary 'child', and its name goes to the
+    // NodePool's retired nodes. Without this, they would pile up until the
+    // next reclaim: One for each file of the tree.
+
+    if ( _tree )
+	_tree->scheduleReclaim();
+}
+
+
+void DirInfo::dropFoldedFiles()
+{
+    if ( ! _foldedFiles )
+	return;
+
+    delete _foldedFiles;
+    _foldedFiles = 0;
+
+    if ( _tree )
+	_tree->dropOwnerTotals();
+
+    // Just like deleting children: All ancestors have to add up their
+    // summaries again.
+
+    for ( DirInfo * dir = this; dir; dir = dir->parent() )
+    {
+	dir->_summaryDirty = true;
+	dir->dropSizeSortCache();
+	dir->dropTypeSummary();
+    }
+}
+
+
+void DirInfo::addToSummaryDelta( FileInfo * newChild )
+{
+    if ( ! _summaryDelta )
+    {
+	_summaryDelta = new SummaryDelta();
+	CHECK_NEW( _summaryDelta );
+    }
+
+    _summaryDelta->size   += newChild->size();
+    _summaryDelta->blocks += newChild->countedBlocks();
+    _summaryDelta->items++;
+
+    if ( newChild->isDir() )
+	_summaryDelta->subDirs++;
+
+    if ( newChild->isFile() )
+	_summaryDelta->files++;
+
+    if ( newChild->mtime() > _summaryDelta->latestMtime )
+	_summaryDelta->latestMtime = newChild->mtime();
+}
+
+
+void DirInfo::pushSummaryDelta()
+{
+    if ( ! _summaryDelta )
+	return;
+
+    FileInfo * changedChild = this;
+
+    for ( DirInfo * dir = _parent; dir; dir = dir->parent() )
+    {
+	if ( ! dir->_summaryDirty )
+	{
+	    dir->_totalSize    += _summaryDelta->size;
+	    dir->_totalBlocks  += _summaryDelta->blocks;
+	    dir->_totalItems   += _summaryDelta->items;
+	    dir->_totalSubDirs += _summaryDelta->subDirs;
+	    dir->_totalFiles   += _summaryDelta->files;
+
+	    if ( _summaryDelta->latestMtime > dir->_latestMtime )
+		dir->_latestMtime = _summaryDelta->latestMtime;
+	}
+
+	if ( dir->_sortedChildren && dir->_lastSortCol != ReadJobsCol )
+	    dir->repositionSortedChild( changedChild );
+
+	dir->dropSizeSortCache();
+	changedChild = dir;
+    }
+
+    delete _summaryDelta;
+    _summaryDelta = 0;
+}
+
+
+void DirInfo::setMtime( time_t mtime )
+{
+    if ( mtime == _mtime )
+	return;
+
+    _mtime = mtime;
+
+    // The latest mtime of the complete subtree above might change
+
+    for ( DirInfo * dir = this; dir; dir = dir->parent() )
+	dir->_summaryDirty = true;
+
+    if ( _parent )
+	_parent->dropSortCache();
+}
+
+
+void DirInfo::deletingChild( FileInfo * child )
+{
+    /**
+     * When children are deleted, things go downhill: Marking the summary
+     * fields as dirty (i.e. outdated) is the only thing that can be done here.
+     *
+     * The accumulated sizes could be updated (by subtracting this deleted
+     * child's values from them), but the latest mtime definitely has to be
+     * recalculated: The child now being deleted might just be the one with the
+     * latest mtime, and figuring out the second-latest cannot easily be
+     * done. So we merely mark the summary as dirty and wait until a recalc()
+     * will be triggered from outside - which might as well never happen when
+     * nobody wants to know some summary field anyway.
+     **/
+
+    _summaryDirty = true;
+    dropSizeSortCache();
+    dropTypeSummary();
+
+    if ( _parent )
+	_parent->deletingChild( child );
+
+    if ( child->parent() == this )
+    {
+	if ( ! _deletingAll )
+	{
+	    /**
+	     * Unlink the child from the children's list - but only if this
+	     * doesn't happen recursively for all children of this object: No
+	     * use bothering about the validity of the children's list if this
+	     * will all be history anyway in a moment.
+	     **/
+
+	    unlinkChild( child );
+	}
+	else
+	{
+	    dropSortCache();
+	}
+    }
+}
+
+
+void DirInfo::unlinkChild( FileInfo *deletedChild )
+{
+    if ( deletedChild->parent() != this )
+    {
+	logError() << deletedChild << " is not a child of " << this
+		   << " - cannot unlink from children list!" << endl;
+	return;
+    }
+
+    dropSortCache();
+    dropChildArray();
+
+    if ( _childIndex )
+	_childIndex->remove( deletedChild->compactName().hash(), deletedChild );
+
+    if ( deletedChild == _firstChild )
+    {
+	logDebug() << "Unlinking first child " << deletedChild << endl;
+	_firstChild = deletedChild->next();
+	return;
+    }
+
+    FileInfo *child = firstChild();
+
+    while ( child )
+    {
+	if ( child->next() == deletedChild )
+	{
+	    logDebug() << "Unlinking " << deletedChild << endl;
+	    child->setNext( deletedChild->next() );
+
+	    return;
+	}
+
+	child = child->next();
+    }
+
+    logError() << "Couldn't unlink " << deletedChild << " from "
+	       << this << " children list" << endl;
+}
+
+
+const CategoryTotals * DirInfo::typeSummary()
+{
+    MimeCategorizer * categorizer = _tree ? _tree->typeSummaryCategorizer() : 0;
+
+    if ( ! categorizer )
+	return 0;
+
+    // This drops all type summaries if the categories changed
+
+    categorizer->checkCategoryCache( _tree );
+
+    if ( ! _typeSummary )
+	recalcTypeSummary( categorizer );
+
+    return _typeSummary;
+}
+
+
+MimeCategory * DirInfo::mainCategory( FileSize * size_ret )
+{
+    MimeCategory * category = 0;
+    FileSize	   maxSum   = 0LL;
+    const CategoryTotals * summary = typeSummary();
+
+    if ( summary )
+    {
+	CategoryTotals::const_iterator it = summary->constBegin();
+
+	while ( it != summary->constEnd() )
+	{
+	    if ( it.value().sum > maxSum )
+	    {
+		category = it.key();
+		maxSum	 = it.value().sum;
+	    }
+
+	    ++it;
+	}
+    }
+
+    if ( size_ret )
+	*size_ret = maxSum;
+
+    return category;
+}
+
+
+void DirInfo::dropTypeSummary( bool recursive )
+{
+    if ( _typeSummary )
+    {
+	delete _typeSummary;
+	_typeSummary = 0;
+    }
+
+    if ( recursive )
+    {
+	for ( FileInfo * child = _firstChild; child; child = child->next() )
+	{
+	    if ( child->isDirInfo() )
+		child->toDirInfo()->dropTypeSummary( true );
+	}
+
+	if ( _dotEntry )
+	    _dotEntry->dropTypeSummary( true );
+    }
+}
+
+
+void DirInfo::dropAncestorTypeSummaries()
+{
+    // A directory only has a type summary if all its descendants have one
+    // (see recalcTypeSummary() and addToTypeSummary()), so if this
+    // ancestor has none, no further one has.
+
+    for ( DirInfo * dir = _parent; dir && dir->_typeSummary; dir = dir->parent() )
+	dir->dropTypeSummary();
+}
+
+
+void DirInfo::recalcTypeSummary( MimeCategorizer * categorizer )
+{
+    // The ColdSubtree only has the totals
+
+    thaw();
+
+    _typeSummary = new CategoryTotals();
+    CHECK_NEW( _typeSummary );
+
+    FileInfoIterator it( this );
+
+    while ( *it )
+    {
+	FileInfo * child = *it;
+
+	if ( child->isDirInfo() )
+	{
+	    // Just a shallow merge of the children's summaries
+
+	    const CategoryTotals * childSummary = child->toDirInfo()->typeSummary();
+
+	    if ( childSummary )
+	    {
+		CategoryTotals::const_iterator childIt = childSummary->constBegin();
+
+		while ( childIt != childSummary->constEnd() )
+		{
+		    FileTypeTotal & total = (*_typeSummary)[ childIt.key() ];
+		    total.sum	+= childIt.value().sum;
+		    total.count += childIt.value().count;
+		    ++childIt;
+		}
+	    }
+	}
+	else if ( child->isFile() )
+	{
+	    FileTypeTotal & total = (*_typeSummary)[ categorizer->category( child ) ];
+	    total.sum += child->size();
+	    ++total.count;
+	}
+
+	++it;
+    }
+}
+
+
+void DirInfo::addToTypeSummary( FileInfo * newChild, MimeCategorizer * categorizer )
+{
+    if ( ! categorizer )
+    {
+	dropTypeSummary();
+	return;
+    }
+
+    if ( newChild->isDirInfo() )
+    {
+	// A new directory is normally still empty. Calculate its summary
+	// anyway: Each directory with a summary needs one in all its
+	// descendants.
+
+	CategoryTotals childSummary = *newChild->toDirInfo()->typeSummary();
+
+	if ( ! _typeSummary )	// The categories changed meanwhile
+	    return;
+
+	CategoryTotals::const_iterator it = childSummary.constBegin();
+
+	while ( it != childSummary.constEnd() )
+	{
+	    FileTypeTotal & total = (*_typeSummary)[ it.key() ];
+	    total.sum	+= it.value().sum;
+	    total.count += it.value().count;
+	    ++it;
+	}
+    }
+    else if ( newChild->isFile() )
+    {
+	MimeCategory * category = categorizer->category( newChild );
+
+	if ( ! _typeSummary )	// The categories changed meanwhile
+	    return;
+
+	FileTypeTotal & total = (*_typeSummary)[ category ];
+	total.sum += newChild->size();
+	++total.count;
+    }
+}
+
+
+void DirInfo::readJobAdded()
+{
+    _pendingReadJobs++;
+
+    if ( _lastSortCol == ReadJobsCol || _prevSortCol == ReadJobsCol )
+	dropSortCache();
+
+    if ( _parent )
+	_parent->readJobAdded();
+}
+
+
+void DirInfo::readJobFinished()
+{
+    _pendingReadJobs--;
+
+    if ( _lastSortCol == ReadJobsCol || _prevSortCol == ReadJobsCol )
+	dropSortCache();
+
+    if ( _parent )
+	_parent->readJobFinished();
+}
+
+
+void DirInfo::readJobAborted()
+{
+    _readState = DirAborted;
+    pushSummaryDelta();
 
     if ( _parent )
 	_parent->readJobAborted();
@@ -487,6 +1272,35 @@ void DirInfo::finalizeLocal()
 {
     // logDebug() << this << endl;
     cleanupDotEntries();
+    pushSummaryDelta();
+
+    if ( _tree && ! _tree->deferChildArrays() )
+	buildChildArrays();
+}
+
+
+void DirInfo::buildChildArrays()
+{
+    if ( ! _tree )
+	return;
+
+    if ( _tree->compactChildren() )
+    {
+	if ( ! _childArray )
+	    compactChildren();
+
+	if ( _dotEntry && ! _dotEntry->_childArray )
+	    _dotEntry->compactChildren();
+    }
+
+    if ( _tree->childColumns() )
+    {
+	if ( ! _childColumns )
+	    buildChildColumns();
+
+	if ( _dotEntry && ! _dotEntry->_childColumns )
+	    _dotEntry->buildChildColumns();
+    }
 }
 
 
@@ -495,6 +1309,14 @@ void DirInfo::finalizeAll()
     if ( _isDotEntry )
 	return;
 
+    // Only the outermost call builds the child arrays, in parallel, when
+    // everything is finalized.
+
+    bool outermost = _tree && ! _tree->deferChildArrays();
+
+    if ( outermost )
+	_tree->setDeferChildArrays( true );
+
     FileInfo *child = firstChild();
 
     while ( child )
@@ -518,6 +1340,150 @@ void DirInfo::finalizeAll()
 
      _tree->sendFinalizeLocal( this ); // Must be sent _before_ finalizeLocal()!
     finalizeLocal();
+
+    if ( outermost )
+    {
+	_tree->setDeferChildArrays( false );
+	finishSubtree( true );
+    }
+}
+
+
+namespace
+{
+    /**
+     * Worker for DirInfo::finishSubtree(): Finish one subtree.
+     **/
+    class FinishSubtreeWorker: public QRunnable
+    {
+    public:
+
+	FinishSubtreeWorker( DirInfo * subtree, bool buildArrays ):
+	    QRunnable(),
+	    _subtree( subtree ),
+	    _buildArrays( buildArrays )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	    { _subtree->finishSubtreeLocal( _buildArrays ); }
+
+    protected:
+
+	DirInfo * _subtree;
+	bool	  _buildArrays;
+    };
+
+}	// namespace
+
+
+void DirInfo::finishSubtree( bool buildArrays )
+{
+    buildArrays = buildArrays && _tree &&
+	( _tree->compactChildren() || _tree->childColumns() );
+
+    if ( ! buildArrays && ! _summaryDirty )
+	return;
+
+    int threads = QThread::idealThreadCount();
+
+    // _totalItems might be outdated if the summary is dirty, but it is
+    // good enough to decide how to split up the work; totalItems() would
+    // already do the complete recalc() here.
+
+    if ( threads < 2 || _totalItems < MIN_PARALLEL_FINISH_ITEMS )
+    {
+	finishSubtreeLocal( buildArrays );
+	return;
+    }
+
+
+    // Split up the large directories breadth first until there are enough
+    // subtrees for the threads. The split directories are finished here
+    // afterwards.
+
+    QList<DirInfo *> upper;
+    QList<DirInfo *> tasks;
+    tasks << this;
+
+    bool split = true;
+
+    while ( split && tasks.size() < 4 * threads )
+    {
+	QList<DirInfo *> nextTasks;
+	split = false;
+
+	foreach ( DirInfo * dir, tasks )
+	{
+	    if ( dir->_isDotEntry || dir->_totalItems < MIN_FINISH_TASK_ITEMS ||
+		 ( ! buildArrays && ! dir->_summaryDirty ) )
+	    {
+		nextTasks << dir;
+		continue;
+	    }
+
+	    upper << dir;
+	    split = true;
+
+	    for ( FileInfo * child = dir->_firstChild; child; child = child->next() )
+	    {
+		if ( child->isDirInfo() )
+		    nextTasks << child->toDirInfo();
+	    }
+
+	    if ( dir->_dotEntry )
+		nextTasks << dir->_dotEntry;
+	}
+
+	tasks = nextTasks;
+    }
+
+    logDebug() << "Finishing " << this << " in " << tasks.size() << " subtrees" << endl;
+
+    QThreadPool pool;
+    pool.setMaxThreadCount( threads );
+
+    foreach ( DirInfo * dir, tasks )
+	pool.start( new FinishSubtreeWorker( dir, buildArrays ) );
+
+    pool.waitForDone();
+
+
+    // Bottom up: The split directories were added breadth first
+
+    for ( int i = upper.size() - 1; i >= 0; --i )
+    {
+	DirInfo * dir = upper.at( i );
+
+	if ( buildArrays )
+	    dir->buildChildArrays();
+
+	if ( dir->_summaryDirty )
+	    dir->recalc();
+    }
+}
+
+
+void DirInfo::finishSubtreeLocal( bool buildArrays )
+{
+    // If a directory is not dirty, none in its subtree is
+
+    if ( ! buildArrays && ! _summaryDirty )
+	return;
+
+    for ( FileInfo * child = _firstChild; child; child = child->next() )
+    {
+	if ( child->isDirInfo() )
+	    child->toDirInfo()->finishSubtreeLocal( buildArrays );
+    }
+
+    if ( _dotEntry )
+	_dotEntry->finishSubtreeLocal( buildArrays );
+
+    if ( buildArrays )
+	buildChildArrays();
+
+    if ( _summaryDirty )
+	recalc();
 }
 
 
@@ -545,7 +1511,10 @@ void DirInfo::cleanupDotEntries()
 	{
 	    // logDebug() << "Reparenting children of solo dot entry " << this << endl;
 	    _firstChild = child;	    // Move the entire children chain here.
+	    dropChildIndex();
+	    dropChildArray();
 	    _dotEntry->setFirstChild( 0 );  // _dotEntry will be deleted below.
+	    dropSizeSortCache();
 
 	    while ( child )
 	    {
@@ -561,12 +1530,13 @@ void DirInfo::cleanupDotEntries()
     // This also affects dot entries that were just disowned because they had
     // no siblings (i.e., there are no subdirectories on this level).
 
-    if ( ! _dotEntry->firstChild() )
+    if ( ! _dotEntry->firstChild() && ! _dotEntry->foldedFiles() )
     {
 	// logDebug() << "Removing empty dot entry " << this << endl;
 
 	delete _dotEntry;
 	_dotEntry = 0;
+	dropSizeSortCache();
     }
 }
 
@@ -597,47 +1567,274 @@ const FileInfoList & DirInfo::sortedChildren( DataColumn    sortCol,
 					      Qt::SortOrder sortOrder )
 {
     if ( _sortedChildren && sortCol == _lastSortCol && sortOrder == _lastSortOrder )
+    {
+	if ( CacheBudget::isEnabled() )
+	    CacheBudget::instance()->touch( this );
+
 	return *_sortedChildren;
+    }
 
+    if ( _prevSortedChildren && sortCol == _prevSortCol && sortOrder == _prevSortOrder )
+    {
+	// Switching back to the previous sort order: Just swap the lists.
 
-    // Clean old sorted children list and create a new one
+	qSwap( _sortedChildren, _prevSortedChildren );
+	qSwap( _lastSortCol,	_prevSortCol	    );
+	qSwap( _lastSortOrder,	_prevSortOrder	    );
+	dropSortedChildRows();
 
-    dropSortCache( true ); // recursive
-    _sortedChildren = new FileInfoList();
-    CHECK_NEW( _sortedChildren );
+	if ( CacheBudget::isEnabled() )
+	    CacheBudget::instance()->touch( this );
 
+	return *_sortedChildren;
+    }
 
-    // Populate with unsorted children list
+    FileInfoList * sorted = 0;
 
-    FileInfo * child = _firstChild;
+    if ( sortCol == TotalSizeCol && sortOrder == Qt::DescendingOrder && _sizeSortedChildren )
+    {
+	// The treemap already sorted them that way: Take over that list.
 
-    while ( child )
+	sorted = _sizeSortedChildren;
+	_sizeSortedChildren = 0;
+    }
+    else if ( _sortedChildren && sortCol == _lastSortCol )
     {
-	_sortedChildren->append( child );
-	child = child->next();
+	// Only the sort order changed: The list in reverse order will do.
+
+	sorted = reversedList( *_sortedChildren );
+    }
+    else if ( _prevSortedChildren && sortCol == _prevSortCol )
+    {
+	sorted = reversedList( *_prevSortedChildren );
     }
+    else
+    {
+	sorted = new FileInfoList();
+	CHECK_NEW( sorted );
 
-    if ( _dotEntry )
-	_sortedChildren->append( _dotEntry );
 
+	// Populate with unsorted children list
+
+	appendChildren( sorted );
+
+
+	// Sort
+
+	// logDebug() << "Sorting children of " << this << " by " << sortCol << endl;
 
-    // Sort
+	FileInfoSorter::sort( *sorted, sortCol, sortOrder );
+    }
+
+    // Keep the old list for switching back to it later. Only one old list
+    // is kept, and the subdirectories keep theirs as well, so toggling the
+    // sort order or sorting by another column and back again doesn't sort
+    // anything again.
 
-    // logDebug() << "Sorting children of " << this << " by " << sortCol << endl;
+    if ( _prevSortedChildren )
+	delete _prevSortedChildren;
 
-    std::stable_sort( _sortedChildren->begin(),
-		      _sortedChildren->end(),
-		      FileInfoSorter( sortCol, sortOrder ) );
+    _prevSortedChildren = _sortedChildren;
+    _prevSortCol	= _lastSortCol;
+    _prevSortOrder	= _lastSortOrder;
 
-    _lastSortCol   = sortCol;
-    _lastSortOrder = sortOrder;
+    dropSortedChildRows();
+    _sortedChildren = sorted;
+    _lastSortCol    = sortCol;
+    _lastSortOrder  = sortOrder;
+
+    if ( CacheBudget::isEnabled() )
+	CacheBudget::instance()->touch( this );
 
     return *_sortedChildren;
 }
 
 
+FileInfoList * DirInfo::reversedList( const FileInfoList & list )
+{
+    FileInfoList * reversed = new FileInfoList();
+    CHECK_NEW( reversed );
+    reversed->reserve( list.size() );
+
+    for ( int i = list.size() - 1; i >= 0; --i )
+	reversed->append( list.at( i ) );
+
+    return reversed;
+}
+
+
+const FileInfoList & DirInfo::sizeSortedChildren()
+{
+    thaw();	// The treemap reached a cold directory
+
+    if ( _sortedChildren && _lastSortCol == TotalSizeCol && _lastSortOrder == Qt::DescendingOrder )
+	return *_sortedChildren;
+
+    if ( _prevSortedChildren && _prevSortCol == TotalSizeCol && _prevSortOrder == Qt::DescendingOrder )
+	return *_prevSortedChildren;
+
+    if ( ! _sizeSortedChildren )
+    {
+	_sizeSortedChildren = new FileInfoList();
+	CHECK_NEW( _sizeSortedChildren );
+
+	appendChildren( _sizeSortedChildren );
+
+	FileInfoSorter::sort( *_sizeSortedChildren, TotalSizeCol, Qt::DescendingOrder );
+    }
+
+    return *_sizeSortedChildren;
+}
+
+
+void DirInfo::dropSizeSortCache()
+{
+    if ( _sizeSortedChildren )
+    {
+	delete _sizeSortedChildren;
+	_sizeSortedChildren = 0;
+    }
+}
+
+
+int DirInfo::sortedChildRow( FileInfo *	   child,
+			     DataColumn	   sortCol,
+			     Qt::SortOrder sortOrder )
+{
+    const FileInfoList & children = sortedChildren( sortCol, sortOrder );
+
+    if ( children.size() < MIN_INDEXED_ROWS )
+	return children.indexOf( child );
+
+    if ( ! _sortedChildRows )
+    {
+	_sortedChildRows = new QHash<FileInfo *, int>();
+	CHECK_NEW( _sortedChildRows );
+	_sortedChildRows->reserve( children.size() );
+
+	for ( int row = 0; row < children.size(); ++row )
+	    _sortedChildRows->insert( children.at( row ), row );
+    }
+
+    return _sortedChildRows->value( child, -1 );
+}
+
+
+bool DirInfo::sortDependsOnSubtree( DataColumn sortCol )
+{
+    switch ( sortCol )
+    {
+	case NameCol:
+	case OwnSizeCol:
+	    return false;
+
+	default:
+	    return true;
+    }
+}
+
+
+void DirInfo::insertSortedChild( FileInfo * child )
+{
+    dropPrevSortCache();
+
+    if ( ! _sortedChildren )
+	return;
+
+    if ( _lastSortCol == PercentBarCol || _lastSortCol == PercentNumCol )
+    {
+	// The percentages of all children change with the parent's total.
+	dropSortCache();
+	return;
+    }
+
+    FileInfoList::iterator pos = std::upper_bound( _sortedChildren->begin(),
+						   _sortedChildren->end(),
+						   child,
+						   FileInfoSorter( _lastSortCol, _lastSortOrder ) );
+    int row = pos - _sortedChildren->begin();
+    _sortedChildren->insert( row, child );
+    updateSortedChildRows( row, _sortedChildren->size() - 1 );
+}
+
+
+void DirInfo::repositionSortedChild( FileInfo * child )
+{
+    dropPrevSortCache();
+
+    if ( ! _sortedChildren || ! sortDependsOnSubtree( _lastSortCol ) )
+	return;
+
+    if ( _lastSortCol == PercentBarCol || _lastSortCol == PercentNumCol )
+    {
+	dropSortCache();
+	return;
+    }
+
+    int oldRow = _sortedChildRows ?
+	_sortedChildRows->value( child, -1 ) : _sortedChildren->indexOf( child );
+
+    if ( oldRow < 0 )
+    {
+	dropSortCache();
+	return;
+    }
+
+    // All other children are still in sort order, so only this one needs
+    // to move to its new place.
+
+    _sortedChildren->removeAt( oldRow );
+
+    FileInfoList::iterator pos = std::upper_bound( _sortedChildren->begin(),
+						   _sortedChildren->end(),
+						   child,
+						   FileInfoSorter( _lastSortCol, _lastSortOrder ) );
+    int newRow = pos - _sortedChildren->begin();
+    _sortedChildren->insert( newRow, child );
+
+    if ( newRow != oldRow )
+	updateSortedChildRows( qMin( oldRow, newRow ), qMax( oldRow, newRow ) );
+}
+
+
+void DirInfo::updateSortedChildRows( int fromRow, int toRow )
+{
+    if ( ! _sortedChildRows )
+	return;
+
+    for ( int row = fromRow; row <= toRow; ++row )
+	_sortedChildRows->insert( _sortedChildren->at( row ), row );
+}
+
+
+void DirInfo::dropSortedChildRows()
+{
+    if ( _sortedChildRows )
+    {
+	delete _sortedChildRows;
+	_sortedChildRows = 0;
+    }
+}
+
+
+void DirInfo::dropPrevSortCache()
+{
+    if ( _prevSortedChildren )
+    {
+	delete _prevSortedChildren;
+	_prevSortedChildren = 0;
+    }
+}
+
+
 void DirInfo::dropSortCache( bool recursive )
 {
+    if ( CacheBudget::isEnabled() )
+	CacheBudget::instance()->remove( this );
+
+    dropSortedChildRows();
+    dropPrevSortCache();
+
     if ( _sortedChildren )
     {
 	// logDebug() << "Dropping sort cache for " << this << endl;
@@ -678,6 +1875,77 @@ void DirInfo::dropSortCache( bool recursive )
 }
 
 
+void DirInfo::dropAllSortCaches()
+{
+    // Not dropSortCache( true ): The budget may have dropped the cache of a
+    // parent, but not those of its children.
+
+    dropSortCache();
+
+    for ( FileInfo * child = _firstChild; child; child = child->next() )
+    {
+	if ( child->isDirInfo() )
+	    child->toDirInfo()->dropAllSortCaches();
+    }
+
+    if ( _dotEntry )
+	_dotEntry->dropAllSortCaches();
+}
+
+
+qint64 DirInfo::sortCacheBytes( bool includeSizeSorted ) const
+{
+    // A QList of pointers is one array of pointers plus a header; each
+    // entry of a QHash is a separate node plus a pointer in the bucket
+    // array. These are estimates, but close enough for Qt 4 and Qt 5.
+
+    const int listHeader = 24;
+    const int hashNode	 = 32;
+
+    qint64 bytes = 0;
+
+    if ( _sortedChildren )
+	bytes += listHeader + _sortedChildren->size() * sizeof( FileInfo * );
+
+    if ( _prevSortedChildren )
+	bytes += listHeader + _prevSortedChildren->size() * sizeof( FileInfo * );
+
+    if ( _sizeSortedChildren && includeSizeSorted )
+	bytes += listHeader + _sizeSortedChildren->size() * sizeof( FileInfo * );
+
+    if ( _sortedChildRows )
+	bytes += _sortedChildRows->size() * hashNode;
+
+    return bytes;
+}
+
+
+qint64 DirInfo::childIndexBytes() const
+{
+    const int hashNode = 32;	// See sortCacheBytes()
+
+    return _childIndex ? _childIndex->size() * hashNode : 0;
+}
+
+
+qint64 DirInfo::childArrayBytes() const
+{
+    qint64 bytes = _childColumns ? _childColumns->bytes() : 0;
+
+    if ( _childArray )
+    {
+	FileInfo * const * slot = _childArray;
+
+	while ( *slot )
+	    ++slot;
+
+	bytes += ( slot - _childArray + 1 ) * sizeof( FileInfo * );
+    }
+
+    return bytes;
+}
+
+
 const DirInfo * DirInfo::findNearestMountPoint() const
 {
     const DirInfo * dir = this;
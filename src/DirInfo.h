@@ -11,6 +11,9 @@
 #define DirInfo_h
 
 
+#include <QHash>
+#include <QMultiHash>
+
 #include "Logger.h"
 #include "FileInfo.h"
 #include "DataColumns.h"
@@ -20,6 +23,80 @@ namespace QDirStat
 {
     // Forward declarations
     class DirTree;
+    class ChildColumns;
+    class ColdSubtree;
+    class SnapshotDir;
+    class MimeCategorizer;
+    class MimeCategory;
+
+    /**
+     * Summary changes of a directory that are not yet propagated to its
+     * ancestors. See DirTree::lazySummaries().
+     **/
+    struct SummaryDelta
+    {
+	SummaryDelta():
+	    size( 0 ), blocks( 0 ), items( 0 ), subDirs( 0 ), files( 0 ), latestMtime( 0 )
+	    {}
+
+	FileSize	size;
+	FileSize	blocks;
+	int		items;
+	int		subDirs;
+	int		files;
+	time_t		latestMtime;
+    };
+
+    /**
+     * The files of a directory that were folded into its dot entry in
+     * aggregate-only mode (see DirTree::aggregateOnly()) instead of getting
+     * a FileInfo each: Only the totals and a histogram of their sizes.
+     **/
+    struct FoldedFiles
+    {
+	enum { SizeBucketCount = 48 };
+
+	FoldedFiles();
+
+	/**
+	 * Add 'file'.
+	 **/
+	void add( const FileInfo * file );
+
+	/**
+	 * Return the histogram bucket for 'size': 0 for 0 bytes, otherwise
+	 * n for up to 2^n - 1 bytes.
+	 **/
+	static int sizeBucket( FileSize size );
+
+	FileSize	size;
+	FileSize	blocks;
+	int		items;
+	int		files;
+	time_t		latestMtime;
+	unsigned short	ownerIndex;	// Owner of the first one; see OwnerTotals
+	int		sizeBuckets[ SizeBucketCount ];	// Items by log2 of their size
+    };
+
+    /**
+     * Total size and number of files, e.g. of one MIME category.
+     **/
+    struct FileTypeTotal
+    {
+	FileTypeTotal():
+	    sum( 0LL ),
+	    count( 0 )
+	    {}
+
+	FileSize	sum;
+	int		count;
+    };
+
+    /**
+     * File totals by MIME category. Files without any category have
+     * category 0.
+     **/
+    typedef QHash<MimeCategory *, FileTypeTotal> CategoryTotals;
 
     /**
      * A more specialized version of @ref FileInfo: This class can actually
@@ -31,6 +108,8 @@ namespace QDirStat
      **/
     class DirInfo: public FileInfo
     {
+	friend class ColdSubtree;
+
     public:
 	/**
 	 * Default constructor.
@@ -188,7 +267,7 @@ namespace QDirStat
 	 * Reimplemented - inherited from @ref FileInfo.
 	 **/
 	virtual void setFirstChild( FileInfo *newfirstChild ) Q_DECL_OVERRIDE
-	    { _firstChild = newfirstChild; }
+	    { _firstChild = newfirstChild; dropChildIndex(); dropChildArray(); }
 
 	/**
 	 * Insert a child into the children list.
@@ -198,6 +277,27 @@ namespace QDirStat
 	 **/
 	virtual void insertChild( FileInfo *newChild ) Q_DECL_OVERRIDE;
 
+	/**
+	 * Add the totals of 'child' to the dot entry of this directory (or to
+	 * this one if it is a dot entry) without keeping 'child' itself: It
+	 * can be a temporary object that is gone right after this call. The
+	 * summaries of all ancestors are updated as if it were inserted.
+	 *
+	 * This is for aggregate-only mode; see DirTree::aggregateOnly().
+	 **/
+	void foldChild( FileInfo * child );
+
+	/**
+	 * Return the totals of the children that were folded into this dot
+	 * entry with foldChild() or 0 if there are none.
+	 **/
+	const FoldedFiles * foldedFiles() const { return _foldedFiles; }
+
+	/**
+	 * Forget the folded children, e.g. before they are read again.
+	 **/
+	void dropFoldedFiles();
+
 	/**
 	 * Get the "Dot Entry" for this node if there is one (or 0 otherwise):
 	 * This is a pseudo entry that directory nodes use to store
@@ -222,6 +322,86 @@ namespace QDirStat
 	virtual bool isDotEntry() const Q_DECL_OVERRIDE
 	    { return _isDotEntry; }
 
+	/**
+	 * Find the direct child (not in the dot entry) with name 'name'.
+	 * Returns 0 if there is no such child.
+	 *
+	 * For directories with many children, this builds a name index on
+	 * first use, so further lookups are a single hash lookup.
+	 **/
+	FileInfo * findChild( const QString & name );
+
+	/**
+	 * Drop the name index (if there is one). It is rebuilt when needed.
+	 **/
+	void dropChildIndex();
+
+	/**
+	 * Return the direct children (not the dot entry) as an array that is
+	 * terminated by 0, or 0 if there is no such array.
+	 *
+	 * If DirTree::compactChildren() is enabled, the array is built when
+	 * this directory is finalized, and it is dropped again as soon as
+	 * any child is added or removed. Iterating over it does not need to
+	 * load each child before the address of the next one is known, so
+	 * this is a lot more cache friendly than the children list. The
+	 * list still has all the children in the same order.
+	 **/
+	FileInfo * const * childArray() const { return _childArray; }
+
+	/**
+	 * Build the array of the children from the children list.
+	 **/
+	void compactChildren();
+
+	/**
+	 * Return the sizes etc. of the direct children (not the dot entry) in
+	 * contiguous arrays or 0 if there are none. Like the child array,
+	 * they are built when this directory is finalized if
+	 * DirTree::childColumns() is enabled, and they are dropped when any
+	 * child is added or removed.
+	 **/
+	const ChildColumns * childColumns() const { return _childColumns; }
+
+	/**
+	 * Build the child columns from the children list.
+	 **/
+	void buildChildColumns();
+
+	/**
+	 * Drop the array and the columns of the children if there are any.
+	 **/
+	void dropChildArray();
+
+	/**
+	 * Return the size and number of the files in this subtree for each
+	 * MIME category or 0 if the DirTree has no type summaries (see
+	 * DirTree::typeSummaries()).
+	 *
+	 * This is calculated from the children's summaries on the first
+	 * call. After that, it is updated with each file that is added to
+	 * the subtree. When anything is deleted, the summaries of its
+	 * ancestors are dropped and merged again from their children the
+	 * next time they are needed, so this never needs a full walk of the
+	 * subtree more than once.
+	 **/
+	const CategoryTotals * typeSummary();
+
+	/**
+	 * Return the MIME category that uses the most disk space in this
+	 * subtree. This returns 0 if that is files without a category, if
+	 * there are no files or if there are no type summaries. If
+	 * 'size_ret' is non-null, it returns the total size of the files of
+	 * that category.
+	 **/
+	MimeCategory * mainCategory( FileSize * size_ret = 0 );
+
+	/**
+	 * Drop the type summary of this directory and, if 'recursive' is
+	 * 'true', of its subtree. It is calculated again when it is needed.
+	 **/
+	void dropTypeSummary( bool recursive = false );
+
 	/**
 	 * Notification that a child has been added somewhere in the subtree.
 	 *
@@ -271,16 +451,39 @@ namespace QDirStat
 	 * This does _not_ mean reading reading all subdirectories is completed
 	 * as well!
 	 *
-	 * Clean up unneeded dot entries.
+	 * Clean up unneeded dot entries and push any pending summary changes
+	 * up to the ancestors.
 	 **/
 	virtual void finalizeLocal();
 
 	/**
 	 * Recursively finalize all directories from here on -
 	 * call finalizeLocal() recursively.
+	 *
+	 * The child arrays and columns are built afterwards, and the dirty
+	 * summaries are recalculated, with finishSubtree().
 	 **/
 	void finalizeAll();
 
+	/**
+	 * Recalculate the summaries of all directories in this subtree that
+	 * are dirty and, if 'buildArrays' is set, build the child arrays
+	 * and columns that are enabled in the DirTree and not there yet.
+	 *
+	 * Large subtrees are split up among several threads, each one
+	 * processing a few complete subtrees bottom up; the directories
+	 * above them are done in this thread at the end. This must only be
+	 * called when nothing else uses this subtree. It doesn't send any
+	 * signals.
+	 **/
+	void finishSubtree( bool buildArrays = false );
+
+	/**
+	 * The same as finishSubtree(), but only in this thread. This is what
+	 * each thread of finishSubtree() does.
+	 **/
+	void finishSubtreeLocal( bool buildArrays );
+
 	/**
 	 * Get the current state of the directory reading process:
 	 *
@@ -305,17 +508,95 @@ namespace QDirStat
 	 * 'sortOrder' (Qt::AscendingOrder or Qt::DescendingOrder).
 	 *
 	 * This might return cached information if the sort column and order
-	 * are the same as for the last call to this function, and there were
-	 * no children added or removed in the meantime.
+	 * are the same as for the last call to this function. Children that
+	 * are added in the meantime are inserted at the right place of the
+	 * cached list, and children whose subtree changed are moved to their
+	 * new place, so the list is not sorted from scratch every time.
+	 *
+	 * The list for the sort order before that is kept as well as long as
+	 * no children change, so switching back to it only swaps the lists.
+	 * For the same column in the other sort order, the cached list is
+	 * simply reversed.
 	 **/
 	const FileInfoList & sortedChildren( DataColumn	   sortCol,
 					     Qt::SortOrder sortOrder );
 
+	/**
+	 * Return the position of 'child' in the list of children sorted by
+	 * 'sortCol' and 'sortOrder' or -1 if it is not a child of this
+	 * directory.
+	 *
+	 * For long lists, this keeps an index of the rows along with the
+	 * sorted children, so this is constant time rather than a linear
+	 * search.
+	 **/
+	int sortedChildRow( FileInfo *	  child,
+			    DataColumn	  sortCol,
+			    Qt::SortOrder sortOrder );
+
 	/**
 	 * Drop all cached information about children sorting.
+	 *
+	 * This does not affect the cache for sizeSortedChildren().
 	 **/
 	void dropSortCache( bool recursive = false );
 
+	/**
+	 * Drop the sort caches of this directory and of all directories
+	 * below it. Unlike dropSortCache( true ), this always visits the
+	 * complete subtree.
+	 *
+	 * This is needed before a subtree is deleted in a worker thread: Its
+	 * caches must no longer be in the CacheBudget then.
+	 **/
+	void dropAllSortCaches();
+
+	/**
+	 * Return the approximate number of bytes of the sort caches of this
+	 * directory (not recursive): The sorted lists of the children and
+	 * the row index. 'includeSizeSorted' also counts the size-sorted list
+	 * of the treemap which dropSortCache() doesn't drop.
+	 **/
+	qint64 sortCacheBytes( bool includeSizeSorted = true ) const;
+
+	/**
+	 * Return the approximate number of bytes of the name index of the
+	 * children or 0 if there is none.
+	 **/
+	qint64 childIndexBytes() const;
+
+	/**
+	 * Return the number of bytes of the array and the columns of the
+	 * children or 0 if there are none.
+	 **/
+	qint64 childArrayBytes() const;
+
+	/**
+	 * Drop the list for the previous sort order that sortedChildren()
+	 * keeps.
+	 **/
+	void dropPrevSortCache();
+
+	/**
+	 * Return a list of (direct) children sorted by total size in
+	 * descending order. This is what the treemap needs for each
+	 * directory whenever it is rebuilt.
+	 *
+	 * This is cached separately so the tree view sorting by another
+	 * column doesn't throw it away. But if the last sortedChildren() call
+	 * was for this order, that list is used, and sortedChildren() takes
+	 * over this one if it needs that order, so both share the same list.
+	 *
+	 * The cache is dropped whenever a child is added or deleted
+	 * anywhere in the subtree since that changes the sizes.
+	 **/
+	const FileInfoList & sizeSortedChildren();
+
+	/**
+	 * Drop the cached list of sizeSortedChildren().
+	 **/
+	void dropSizeSortCache();
+
 	/**
 	 * Check if this directory is locked. This is purely a user lock
 	 * that can be used by the application. The DirInfo does not care
@@ -338,6 +619,15 @@ namespace QDirStat
 	 **/
 	void clear();
 
+	/**
+	 * Move all children (including the dot entry) to a new DirInfo that
+	 * is not part of the tree and return that. This leaves this
+	 * directory empty like clear(), but deleting the children is up to
+	 * the caller: Since nothing in them refers to the tree anymore, that
+	 * can be done in another thread. See DirTree::deleteInBackground().
+	 **/
+	DirInfo * detachChildren();
+
 	/**
 	 * Reset to the same status like just after construction in preparation
 	 * of refreshing the tree from this point on:
@@ -348,6 +638,13 @@ namespace QDirStat
 	 **/
 	void reset();
 
+	/**
+	 * Set the modification time of this directory. This is used when the
+	 * directory was checked against the disk again, but not read again
+	 * from scratch.
+	 **/
+	void setMtime( time_t mtime );
+
 	/**
 	 * Mark this directory as 'touched'. Item models can use this to keep
 	 * track of which items were ever used by a connected view to minimize
@@ -367,6 +664,57 @@ namespace QDirStat
 	 **/
 	void clearTouched( bool recursive = false );
 
+	/**
+	 * Return 'true' if the children of this directory are compacted to
+	 * a ColdSubtree (see DirTree::freezeColdSubtrees()): Then there are
+	 * no children and no dot entry, only the totals of the subtree.
+	 **/
+	bool isCold() const { return _coldSubtree != 0; }
+
+	/**
+	 * Return the ColdSubtree or 0 if this directory is not cold.
+	 **/
+	const ColdSubtree * coldSubtree() const { return _coldSubtree; }
+
+	/**
+	 * Take over 'cold' for the children, which must have been detached
+	 * (see detachChildren()). The totals stay the same.
+	 **/
+	void setColdSubtree( ColdSubtree * cold );
+
+	/**
+	 * Create the children from the ColdSubtree again if this directory
+	 * is cold. This does not send any signals; since nothing about the
+	 * children was ever visible, nobody needs to know.
+	 **/
+	void thaw();
+
+	/**
+	 * Return the children of this directory as a TreeSnapshot copied
+	 * them last time or 0 if anything in the subtree changed since then.
+	 **/
+	SnapshotDir * snapshotDir() const { return _snapshotDir; }
+
+	/**
+	 * Keep 'snapshotDir' with the children for the next TreeSnapshot.
+	 * This takes a reference; 0 drops it.
+	 **/
+	void setSnapshotDir( SnapshotDir * snapshotDir );
+
+	/**
+	 * Drop the children copied by the last TreeSnapshot. The tree calls
+	 * this when anything in this subtree changes.
+	 **/
+	void dropSnapshotDir() { if ( _snapshotDir ) setSnapshotDir( 0 ); }
+
+	/**
+	 * Return 'true' if this directory has any children, including when
+	 * they are compacted to a ColdSubtree.
+	 *
+	 * Reimplemented - inherited from @ref FileInfo.
+	 **/
+	virtual bool hasChildren() const Q_DECL_OVERRIDE;
+
 	/**
 	 * Returns true if this is a @ref DirInfo object.
 	 *
@@ -398,6 +746,92 @@ namespace QDirStat
 	 **/
 	void cleanupDotEntries();
 
+	/**
+	 * Add the summary changes that were accumulated in lazy summary mode
+	 * to all ancestors in one go and discard them.
+	 **/
+	void pushSummaryDelta();
+
+	/**
+	 * Build the child arrays and columns of this directory and its dot
+	 * entry that are enabled in the DirTree and not there yet.
+	 **/
+	void buildChildArrays();
+
+	/**
+	 * Add the summary fields of a new child to the pending summary
+	 * changes.
+	 **/
+	void addToSummaryDelta( FileInfo * newChild );
+
+	/**
+	 * Calculate the type summary from the children.
+	 **/
+	void recalcTypeSummary( MimeCategorizer * categorizer );
+
+	/**
+	 * Add 'newChild' to the type summary if there is one.
+	 **/
+	void addToTypeSummary( FileInfo * newChild, MimeCategorizer * categorizer );
+
+	/**
+	 * Drop the type summaries of all ancestors.
+	 **/
+	void dropAncestorTypeSummaries();
+
+	/**
+	 * Update the summary fields and the sort cache after 'newChild' was
+	 * added somewhere in the subtree. 'changedChild' is the direct child
+	 * of this directory that 'newChild' was added to (or 'newChild'
+	 * itself if it is a direct child).
+	 **/
+	void subtreeChildAdded( FileInfo * newChild, FileInfo * changedChild );
+
+	/**
+	 * Add the values of 'newChild' to the summary fields if they are
+	 * not dirty.
+	 **/
+	void addToTotals( FileInfo * newChild );
+
+	/**
+	 * Tell the parent that 'newChild' was added to the subtree of this
+	 * directory, or add it to the summary delta in lazy summary mode.
+	 **/
+	void propagateChildAdded( FileInfo * newChild );
+
+	/**
+	 * Insert a new direct child at the right place of the sort cache.
+	 **/
+	void insertSortedChild( FileInfo * child );
+
+	/**
+	 * Move a direct child whose summary fields changed to its new place
+	 * in the sort cache.
+	 **/
+	void repositionSortedChild( FileInfo * child );
+
+	/**
+	 * Update the row index of the sort cache for rows 'fromRow' to
+	 * 'toRow' (including).
+	 **/
+	void updateSortedChildRows( int fromRow, int toRow );
+
+	/**
+	 * Drop the row index of the sort cache.
+	 **/
+	void dropSortedChildRows();
+
+	/**
+	 * Return a new list with the items of 'list' in reverse order.
+	 **/
+	static FileInfoList * reversedList( const FileInfoList & list );
+
+	/**
+	 * Return 'true' if sorting by 'sortCol' depends on the subtree of
+	 * each child, not only on the child itself.
+	 **/
+	static bool sortDependsOnSubtree( DataColumn sortCol );
+
 
 	//
 	// Data members
@@ -416,6 +850,9 @@ namespace QDirStat
 
 	FileInfo *	_firstChild;		// pointer to the first child
 	DirInfo	 *	_dotEntry;		// pseudo entry to hold non-dir children
+	QMultiHash<uint, FileInfo *> * _childIndex; // name hash -> child
+	FileInfo **	_childArray;		// 0-terminated copy of the children list
+	ChildColumns *	_childColumns;		// Sizes etc. of the children
 
 	// Some cached values
 
@@ -425,10 +862,20 @@ namespace QDirStat
 	int		_totalSubDirs;
 	int		_totalFiles;
 	time_t		_latestMtime;
+	SummaryDelta *	_summaryDelta;		// Not yet propagated to ancestors
+	FoldedFiles *	_foldedFiles;		// Only in aggregate-only mode
+	ColdSubtree *	_coldSubtree;		// The compacted children, if cold
+	SnapshotDir *	_snapshotDir;		// Shared with the TreeSnapshots
+	CategoryTotals * _typeSummary;		// See typeSummary()
 
 	FileInfoList *	_sortedChildren;
+	QHash<FileInfo *, int> * _sortedChildRows;
 	DataColumn	_lastSortCol;
 	Qt::SortOrder	_lastSortOrder;
+	FileInfoList *	_prevSortedChildren;	// For the sort order before the last one
+	DataColumn	_prevSortCol;
+	Qt::SortOrder	_prevSortOrder;
+	FileInfoList *	_sizeSortedChildren;
 
 	DirReadState	_readState;
 
@@ -437,6 +884,21 @@ namespace QDirStat
 
 	void init();
 
+	/**
+	 * Append the direct children and the dot entry to 'list'.
+	 **/
+	void appendChildren( FileInfoList * list ) const;
+
+	/**
+	 * Add the summaries of 'child' to the summaries of this directory.
+	 **/
+	void addChildTotals( FileInfo * child );
+
+	/**
+	 * Build the name index for the children.
+	 **/
+	void buildChildIndex();
+
     };	// class DirInfo
 
 }	// namespace QDirStat
@@ -9,18 +9,39 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
 
 #include <QMutableListIterator>
+#include <QElapsedTimer>
+#include <QHash>
 
 #include "DirTree.h"
 #include "DirReadJob.h"
 #include "DirTreeCache.h"
+#include "BinaryCache.h"
 #include "ExcludeRules.h"
 #include "MountPoints.h"
+#include "IoUringStat.h"
+#include "Statx.h"
+#include "DirentReader.h"
+#include "ScanStats.h"
+#include "ScanThrottle.h"
+#include "DirReadTimes.h"
+#include "QuotaEstimates.h"
+#include "InodeSet.h"
 #include "Exception.h"
 
+#define MAX_READ_THREADS	64	// For all devices together
+#define MAX_PENDING_DIRS	100000	// Then read depth first
+#define READ_CHUNK_SIZE		2000	// Entries per time slice
+#define TIME_SLICE_MILLISEC	10
+
 using namespace QDirStat;
 
 
@@ -94,12 +115,25 @@ bool DirReadJob::crossingFileSystems( DirInfo * parent, DirInfo * child )
     if ( parent->device() == child->device() )
         return false;
 
-    QString childDevice  = device( child );
-    QString parentDevice = device( parent->findNearestMountPoint() );;
+    QString parentDevice = device( parent->findNearestMountPoint() );
 
     if ( parentDevice.isEmpty() )
         parentDevice = _tree->device();
 
+    return crossingFileSystems( parent->device(), parentDevice,
+                                child->device(), child->url() );
+}
+
+
+bool DirReadJob::crossingFileSystems( dev_t		parentDev,
+                                      const QString &	parentDevice,
+                                      dev_t		childDev,
+                                      const QString &	childPath )
+{
+    if ( parentDev == childDev )
+        return false;
+
+    QString childDevice = mountPointDevice( childPath );
     bool crossing = true;
 
     if ( ! parentDevice.isEmpty() && ! childDevice.isEmpty() )
@@ -107,13 +141,13 @@ bool DirReadJob::crossingFileSystems( DirInfo * parent, DirInfo * child )
 
     if ( crossing )
     {
-            logInfo() << "File system boundary at mount point " << child
+            logInfo() << "File system boundary at mount point " << childPath
                       << " on device " << ( childDevice.isEmpty() ? "<unknown>" : childDevice )
                       << endl;
     }
     else
     {
-        logInfo() << "Mount point " << child
+        logInfo() << "Mount point " << childPath
                   << " is still on the same device " << childDevice << endl;
     }
 
@@ -123,15 +157,17 @@ bool DirReadJob::crossingFileSystems( DirInfo * parent, DirInfo * child )
 
 QString DirReadJob::device( const DirInfo * dir ) const
 {
-    QString device;
+    return dir ? mountPointDevice( dir->url() ) : QString();
+}
 
-    if ( dir )
-    {
-        const MountPoint * mountPoint = MountPoints::findByPath( dir->url() );
 
-        if ( mountPoint )
-            device = mountPoint->device();
-    }
+QString DirReadJob::mountPointDevice( const QString & path )
+{
+    QString device;
+    const MountPoint * mountPoint = MountPoints::findByPath( path );
+
+    if ( mountPoint )
+        device = mountPoint->device();
 
     return device;
 }
@@ -143,423 +179,1752 @@ QString DirReadJob::device( const DirInfo * dir ) const
 LocalDirReadJob::LocalDirReadJob( DirTree * tree,
 				  DirInfo * dir )
     : DirReadJob( tree, dir )
+    , _pendingResult( 0 )
+    , _keepExistingSubDirs( false )
     , _diskDir( 0 )
+    , _readNsec( 0 )
+    , _readEntries( 0 )
 {
 }
 
 
 LocalDirReadJob::~LocalDirReadJob()
 {
+    if ( _diskDir )
+	delete _diskDir;
+
+    // If a worker thread is still busy with this job, make sure its result
+    // will be discarded when it arrives.
+
+    if ( _pendingResult )
+	_pendingResult->cancel();
 }
 
 
 void LocalDirReadJob::startReading()
 {
-    struct dirent *	entry;
-    struct stat		statInfo;
-    QString		dirName		 = _dir->url();
-    QString		defaultCacheName = DEFAULT_CACHE_NAME;
+    QString dirName = _dir->url();
 
     // logDebug() << _dir << endl;
 
-    bool ok = true;
-
-    if ( access( dirName.toUtf8(), X_OK | R_OK ) != 0 )
+    if ( _queue && _queue->isThreaded() )
     {
-        ok = false;
-        logWarning() << "No permission to read directory " << dirName << endl;
-	_dir->setReadState( DirError );
-	finishReading( _dir );
+	// Let a worker thread do the system calls; processResult() will be
+	// called when it is done.
+
+	_dir->setReadState( DirReading );
+	_pendingResult = new DirReadResult( this, dirName, _tree->fastScan(), _tree->scanBackend() );
+	CHECK_NEW( _pendingResult );
+	_queue->startWorker( _pendingResult );
+	return;
     }
 
-    if ( ok )
-    {
-        _diskDir = opendir( dirName.toUtf8() );
+    qint64 startNsec = ScanStats::now();
+    LocalDirReadStatus status = openDir( dirName, &_diskDir );
+    _readNsec += ScanStats::now() - startNsec;
 
-        if ( ! _diskDir )
-        {
-            ok = false;
-            _dir->setReadState( DirError );
-            logWarning() << "opendir(" << dirName << ") failed" << endl;
-            // opendir() doesn't set 'errno' according to POSIX  :-(
-            finishReading( _dir );
-        }
+    if ( status != LocalDirReadOk )
+    {
+	processEntries( dirName, status, _entries );
+	return;
     }
 
-    if ( ok )
+    _dir->setReadState( DirReading );
+    read();	// The first part
+}
+
+
+void LocalDirReadJob::read()
+{
+    if ( ! _started )
     {
-	_dir->setReadState( DirReading );
+	DirReadJob::read();	// This calls startReading()
+	return;
+    }
 
-	while ( ( entry = readdir( _diskDir ) ) )
-	{
-	    QString entryName = QString::fromUtf8( entry->d_name );
+    if ( ! _diskDir )
+	return;
 
-	    if ( entryName != "."  &&
-		 entryName != ".."   )
-	    {
-		QString fullName = dirName == "/" ? "" : dirName; // Avoid leading // when in root dir
-                fullName += "/" + entryName;
+    qint64 startNsec = ScanStats::now();
+    bool   done	     = readNextEntries( _diskDir, _entries, _tree->fastScan(),
+					_tree->scanBackend(), READ_CHUNK_SIZE );
+    _readNsec += ScanStats::now() - startNsec;
 
-		if ( lstat( fullName.toUtf8(), &statInfo ) == 0 )	      // lstat() OK
-		{
-		    if ( S_ISDIR( statInfo.st_mode ) )	// directory child?
-		    {
-			DirInfo *subDir = new DirInfo( entryName, &statInfo, _tree, _dir );
-			CHECK_NEW( subDir );
+    if ( ! done )
+	return;	 // Continue with the next time slice
 
-			_dir->insertChild( subDir );
-			childAdded( subDir );
+    delete _diskDir;
+    _diskDir = 0;
 
-			if ( ExcludeRules::instance()->match( fullName, entryName ) )
-			{
-			    subDir->setExcluded();
-			    subDir->setReadState( DirOnRequestOnly );
-			    finishReading( subDir );
-			}
-			else // No exclude rule matched
-			{
-			    if ( ! crossingFileSystems(_dir, subDir ) )	// normal case
-			    {
-				LocalDirReadJob * job = new LocalDirReadJob( _tree, subDir );
-				CHECK_NEW( job );
-				_tree->addJob( job );
-			    }
-			    else	// The subdirectory we just found is a mount point.
-			    {
-				subDir->setMountPoint();
-
-				if ( _tree->crossFileSystems() )
-				{
-				    LocalDirReadJob * job = new LocalDirReadJob( _tree, subDir );
-				    CHECK_NEW( job );
-				    _tree->addJob( job );
-				}
-				else
-				{
-				    subDir->setReadState( DirOnRequestOnly );
-				    finishReading( subDir );
-				}
-			    }
-			}
-		    }
-		    else		// non-directory child
-		    {
-			if ( entryName == defaultCacheName )	// .qdirstat.cache.gz found?
-			{
-			    logDebug() << "Found cache file " << defaultCacheName << endl;
+    processEntries( _dir->url(), LocalDirReadOk, _entries );
 
-			    //
-			    // Read content of this subdirectory from cache file
-			    //
+    // Don't add anything after processEntries() since this deletes this job!
+}
 
-			    CacheReadJob * cacheReadJob = new CacheReadJob( _tree, _dir->parent(), fullName );
-			    CHECK_NEW( cacheReadJob );
-			    QString firstDirInCache = cacheReadJob->reader()->firstDir();
 
-			    if ( firstDirInCache == dirName )	// Does this cache file match this directory?
-			    {
-				logDebug() << "Using cache file " << fullName << " for " << dirName << endl;
+LocalDirReadStatus LocalDirReadJob::readEntries( const QString	   & dirName,
+						 LocalDirEntryList & entries,
+						 bool		     deferFileStat,
+						 LocalScanBackend    backend )
+{
+    DirentReader * diskDir = 0;
+    LocalDirReadStatus status = openDir( dirName, &diskDir );
 
-				cacheReadJob->reader()->rewind();  // Read offset was moved by firstDir()
-				_tree->addJob( cacheReadJob );	   // Job queue will assume ownership of cacheReadJob
+    if ( status != LocalDirReadOk )
+	return status;
 
-				if ( _dir->parent() )
-				    _dir->parent()->setReadState( DirReading );
+    readNextEntries( diskDir, entries, deferFileStat, backend );
+    delete diskDir;	// This also closes its file descriptor
 
-				//
-				// Clean up partially read directory content
-				//
+    return LocalDirReadOk;
+}
 
-				DirTree * tree = _tree;	 // Copy data members to local variables:
-				DirInfo * dir  = _dir;	 // This object will be deleted soon by killAll()
 
-				_queue->killAll( _dir, cacheReadJob );	// Will delete this job as well!
-				// All data members of this object are invalid from here on!
+LocalDirReadStatus LocalDirReadJob::openDir( const QString & dirName,
+					     DirentReader ** diskDir )
+{
+    QByteArray dirPath = dirName.toUtf8();
 
-				logDebug() << "Deleting subtree " << dir << endl;
-				tree->deleteSubtree( dir );
+    if ( access( dirPath, X_OK | R_OK ) != 0 )
+	return LocalDirNoPermission;
 
-				return;
-			    }
-			    else
-			    {
-				logWarning() << "NOT using cache file " << fullName
-					     << " with dir " << firstDirInCache
-					     << " for " << dirName
-					     << endl;
+    // Keep the directory open and stat the entries relative to its file
+    // descriptor: This saves the kernel from walking the complete path
+    // again for each entry, and it saves us from building that path.
 
-				delete cacheReadJob;
-			    }
-			}
-			else
-			{
-			    FileInfo *child = new FileInfo( entryName, &statInfo, _tree, _dir );
-			    CHECK_NEW( child );
-			    _dir->insertChild( child );
-			    childAdded( child );
-			}
-		    }
-		}
-		else			// lstat() error
-		{
-		    logWarning() << "lstat(" << fullName << ") failed: " << formatErrno() << endl;
-
-		    /*
-		     * Not much we can do when lstat() didn't work; let's at
-		     * least create an (almost empty) entry as a placeholder.
-		     */
-		    DirInfo *child = new DirInfo( _tree, _dir, entryName,
-						  0,   // mode
-						  0,   // size
-						  0 ); // mtime
-		    CHECK_NEW( child );
-		    child->finalizeLocal();
-		    child->setReadState( DirError );
-		    _dir->insertChild( child );
-		    childAdded( child );
-		}
-	    }
-	}
+    int dirFd = open( dirPath, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
 
-	closedir( _diskDir );
-	_dir->setReadState( DirFinished );
-	finishReading( _dir );
-    }
+    if ( dirFd < 0 )
+	return LocalDirOpenFailed;
 
-    finished();
-    // Don't add anything after finished() since this deletes this job!
-}
+    *diskDir = new DirentReader( dirFd );	// This takes over dirFd
+    CHECK_NEW( *diskDir );
 
+    if ( ! (*diskDir)->ok() )
+    {
+	delete *diskDir;
+	*diskDir = 0;
 
-void LocalDirReadJob::finishReading( DirInfo * dir )
-{
-    // logDebug() << dir << endl;
+	return LocalDirOpenFailed;
+    }
 
-    _tree->sendFinalizeLocal( dir );
-    dir->finalizeLocal();
-    _tree->sendReadJobFinished( dir );
+    return LocalDirReadOk;
 }
 
 
-
-FileInfo * LocalDirReadJob::stat( const QString & url,
-				  DirTree	* tree,
-				  DirInfo	* parent )
+bool LocalDirReadJob::readNextEntries( DirentReader	 * diskDir,
+				       LocalDirEntryList & entries,
+				       bool		   deferFileStat,
+				       LocalScanBackend	   backend,
+				       int		   maxEntries )
 {
-    struct stat statInfo;
-    logDebug() << "url: \"" << url << "\"" << endl;
-
-    if ( lstat( url.toUtf8(), &statInfo ) == 0 ) // lstat() OK
+    int dirFd = diskDir->fd();
+    bool batched = backend == IoUringScanBackend && IoUringStat::forCurrentThread();
+    QVector<int> batch;
+    const char * name = 0;
+    unsigned char type = DT_UNKNOWN;
+    int count = 0;
+    ScanLatencies latencies;
+    qint64 startNsec = ScanStats::now();
+
+    // The DirentReader already skips "." and ".."
+
+    while ( ( maxEntries < 0 || count < maxEntries ) &&
+	    ( name = diskDir->next( &type ) ) )
     {
-	if ( S_ISDIR( statInfo.st_mode ) )	// directory?
+	LocalDirEntry dirEntry;
+	dirEntry.name	     = QString::fromUtf8( name );
+	dirEntry.statErrno   = 0;
+	dirEntry.type	     = type;
+	dirEntry.statPending = false;
+
+	// If getdents() already tells us that this is not a directory, the
+	// lstat() can wait until all subdirectories are queued. A cache file
+	// is still handled right away since it may replace this directory.
+
+	if ( deferFileStat &&
+	     type != DT_DIR &&
+	     type != DT_UNKNOWN &&
+	     strcmp( name, DEFAULT_CACHE_NAME ) != 0 )
 	{
-	    DirInfo * dir = new DirInfo( url, &statInfo, tree, parent );
-	    CHECK_NEW( dir );
-
-	    if ( parent )
-		parent->insertChild( dir );
-
-	    if ( dir && parent &&
-		 ! tree->isTopLevel( dir )
-		 && dir->device() != parent->device() )
-	    {
-		logDebug() << dir << " is a mount point" << endl;
-		dir->setMountPoint();
-	    }
-
-	    return dir;
+	    dirEntry.statPending = true;
 	}
-	else					// no directory
+	else if ( batched )
 	{
-	    FileInfo * file = new FileInfo( url, &statInfo, tree, parent );
-	    CHECK_NEW( file );
-
-	    if ( parent )
-		parent->insertChild( file );
-
-	    return file;
+	    dirEntry.statPending = true;
+	    batch.append( entries.size() );
 	}
-    }
-    else // lstat() failed
-    {
-        THROW( SysCallFailedException( "lstat", url ) );
-	return 0; // NOTREACHED
-    }
-}
-
+	else
+	{
+	    qint64 statNsec = ScanStats::now();
 
+	    dirEntry.statErrno = Statx::lstatAt( dirFd, name, &dirEntry.statInfo );
 
+	    latencies.add( ScanStats::now() - statNsec );
+	}
 
+	entries.append( dirEntry );
+	++count;
+    }
 
+    ScanStats::instance()->addSyscalls( latencies, ScanStats::now() - startNsec );
+    ScanThrottle::instance()->throttle( latencies );
 
-CacheReadJob::CacheReadJob( DirTree	* tree,
-			    DirInfo	* parent,
-			    CacheReader * reader )
-    : ObjDirReadJob( tree, parent )
-    , _reader( reader )
-{
-    if ( _reader )
-	_reader->rewind();
+    if ( ! batch.isEmpty() )
+	lstatEntries( dirFd, entries, batch, backend );
 
-    init();
+    return maxEntries < 0 || count < maxEntries;
 }
 
 
-CacheReadJob::CacheReadJob( DirTree	  * tree,
-			    DirInfo	  * parent,
-			    const QString & cacheFileName )
-    : ObjDirReadJob( tree, parent )
+void LocalDirReadJob::statEntries( const QString     & dirName,
+				   LocalDirEntryList & entries,
+				   LocalScanBackend    backend )
 {
-    _reader = new CacheReader( cacheFileName, tree, parent );
-    CHECK_NEW( _reader );
+    QVector<int> pending;
 
-    init();
-}
+    for ( int i=0; i < entries.size(); ++i )
+    {
+	if ( entries.at( i ).statPending )
+	    pending.append( i );
+    }
 
+    int dirFd = open( dirName.toUtf8(), O_RDONLY | O_DIRECTORY | O_CLOEXEC );
 
-void CacheReadJob::init()
-{
-    if ( _reader )
+    if ( dirFd < 0 )
     {
-	if ( _reader->ok() )
-	{
-	    connect( _reader,	SIGNAL( childAdded    ( FileInfo * ) ),
-		     this,	SLOT  ( slotChildAdded( FileInfo * ) ) );
-	}
-	else
+	int dirErrno = errno;
+
+	foreach ( int i, pending )
 	{
-	    delete _reader;
-	    _reader = 0;
+	    entries[i].statPending = false;
+	    entries[i].statErrno   = dirErrno;
 	}
-    }
-}
 
+	return;
+    }
 
-CacheReadJob::~CacheReadJob()
-{
-    if ( _reader )
-	delete _reader;
+    lstatEntries( dirFd, entries, pending, backend );
+    close( dirFd );
 }
 
 
-void
-CacheReadJob::read()
+void LocalDirReadJob::lstatEntries( int			dirFd,
+				    LocalDirEntryList & entries,
+				    const QVector<int>	& indices,
+				    LocalScanBackend	backend )
 {
-    /*
-     * This will be called repeatedly from DirTree::timeSlicedRead() until
-     * finished() is called.
-     */
-
-    if ( ! _reader )
-	finished();
+    IoUringStat * uring = backend == IoUringScanBackend ?
+	IoUringStat::forCurrentThread() : 0;
 
-    // logDebug() << "Reading 1000 cache lines" << endl;
-    _reader->read( 1000 );
+    ScanLatencies latencies;
+    qint64 startNsec = ScanStats::now();
 
-    if ( _reader->eof() || ! _reader->ok() )
+    if ( uring && indices.size() > 1 )
     {
-	// logDebug() << "Cache reading finished - ok: " << _reader->ok() << endl;
-	finished();
-    }
-}
-
+	int count = indices.size();
+	QVector<QByteArray>   names( count );
+	QVector<const char *> namePtr( count );
+	QVector<struct stat>  statInfo( count );
+	QVector<int>	      errors( count );
 
+	for ( int i=0; i < count; ++i )
+	{
+	    names[i]   = entries.at( indices.at( i ) ).name.toUtf8();
+	    namePtr[i] = names.at( i ).constData();
+	}
 
+	if ( uring->lstatBatch( dirFd, namePtr.constData(), count,
+				statInfo.data(), errors.data() ) )
+	{
+	    for ( int i=0; i < count; ++i )
+	    {
+		LocalDirEntry & entry = entries[ indices.at( i ) ];
+		entry.statInfo	  = statInfo.at( i );
+		entry.statErrno	  = errors.at( i );
+		entry.statPending = false;
+	    }
 
+	    // Only the average for each entry of a batch is known
 
-DirReadJobQueue::DirReadJobQueue()
-    : QObject()
-{
-    connect( &_timer, SIGNAL( timeout() ),
-	     this,    SLOT  ( timeSlicedRead() ) );
-}
+	    qint64 nsec = ScanStats::now() - startNsec;
 
+	    for ( int i=0; i < count; ++i )
+		latencies.add( nsec / count );
 
-DirReadJobQueue::~DirReadJobQueue()
-{
-    clear();
-}
+	    ScanStats::instance()->addSyscalls( latencies, nsec );
+	    ScanThrottle::instance()->throttle( latencies );
+	    return;
+	}
 
+	// io_uring failed: Fall back to single statx() calls
+    }
 
-void DirReadJobQueue::enqueue( DirReadJob * job )
-{
-    if ( job )
+    foreach ( int i, indices )
     {
-	_queue.append( job );
-	job->setQueue( this );
+	LocalDirEntry & entry = entries[i];
+	entry.statPending = false;
 
-	if ( ! _timer.isActive() )
-	{
-	    // logDebug() << "First job queued" << endl;
-	    emit startingReading();
-	    _timer.start( 0 );
-	}
+	qint64 statNsec = ScanStats::now();
+	entry.statErrno = Statx::lstatAt( dirFd, entry.name.toUtf8(), &entry.statInfo );
+
+	latencies.add( ScanStats::now() - statNsec );
     }
+
+    ScanStats::instance()->addSyscalls( latencies, ScanStats::now() - startNsec );
+    ScanThrottle::instance()->throttle( latencies );
 }
 
 
-DirReadJob * DirReadJobQueue::dequeue()
+void LocalDirReadJob::processResult( DirReadResult * result )
 {
-    DirReadJob * job = _queue.first();
-    _queue.removeFirst();
-
-    if ( job )
-	job->setQueue( 0 );
+    _pendingResult = 0;
+    _readNsec += result->nsec();
+    processEntries( result->dirName(), result->status(), result->entries() );
 
-    return job;
+    // Don't add anything after processEntries() since this deletes this job!
 }
 
 
-void DirReadJobQueue::clear()
+void LocalDirReadJob::processEntries( const QString	      & dirName,
+				      LocalDirReadStatus	status,
+				      const LocalDirEntryList & entries )
 {
-    qDeleteAll( _queue );
-    _queue.clear();
-}
+    QString defaultCacheName = DEFAULT_CACHE_NAME;
 
-
-void DirReadJobQueue::abort()
-{
-    foreach ( DirReadJob * job, _queue )
+    switch ( status )
     {
-	if ( job->dir() )
-	    job->dir()->readJobAborted();
+	case LocalDirReadOk:
+	    break;
+
+	case LocalDirNoPermission:
+	    logWarning() << "No permission to read directory " << dirName << endl;
+	    _dir->setReadState( DirError );
+	    recordReadTime();
+	    finishReading( _dir );
+	    finished();
+	    return;
+
+	case LocalDirOpenFailed:
+	    _dir->setReadState( DirError );
+	    logWarning() << "opendir(" << dirName << ") failed" << endl;
+	    // opendir() doesn't set 'errno' according to POSIX  :-(
+	    recordReadTime();
+	    finishReading( _dir );
+	    finished();
+	    return;
     }
 
-    clear();
-}
+    _dir->setReadState( DirReading );
+    qint64 startNsec = ScanStats::now();
 
+    // The full path of an entry is only needed in a few cases (exclude
+    // rules, cache files, error messages), so it is only built on demand.
 
-void DirReadJobQueue::killAll( DirInfo * subtree, DirReadJob * exceptJob )
-{
-    if ( ! subtree )
-	return;
+    QString pathPrefix = dirName == "/" ? "" : dirName; // Avoid leading // when in root dir
+    pathPrefix += "/";
 
-    QMutableListIterator<DirReadJob *> it( _queue );
+    LocalDirEntryList pendingEntries;
 
-    while ( it.hasNext() )
+    foreach ( const LocalDirEntry & entry, entries )
     {
-	DirReadJob * job = it.next();
+	const QString & entryName = entry.name;
 
-	if ( exceptJob && job == exceptJob )
+	if ( entry.statPending )
 	{
-	    logDebug() << "NOT killing read job " << job->dir() << endl;
+	    pendingEntries.append( entry );
 	    continue;
 	}
 
-	if ( job->dir() && job->dir()->isInSubtree( subtree ) )
+	if ( entry.statErrno == 0 )	      // lstat() OK
 	{
-	    // logDebug() << "Killing read job " << job->dir() << endl;
-	    it.remove();
-	    delete job;
-	}
-    }
-}
+	    struct stat statInfo = entry.statInfo;
 
+	    if ( S_ISDIR( statInfo.st_mode ) )	// directory child?
+	    {
+		if ( _keepExistingSubDirs && _dir->findChild( entryName ) )
+		    continue;
 
-void DirReadJobQueue::timeSlicedRead()
-{
-    if ( ! _queue.isEmpty() )
-	_queue.first()->read();
+		DirInfo *subDir = new DirInfo( entryName, &statInfo, _tree, _dir );
+		CHECK_NEW( subDir );
+
+		_dir->insertChild( subDir );
+		childAdded( subDir );
+
+		if ( ExcludeRules::instance()->match( pathPrefix + entryName, entryName ) )
+		{
+		    subDir->setExcluded();
+		    subDir->setReadState( DirOnRequestOnly );
+		    finishReading( subDir );
+		}
+		else // No exclude rule matched
+		{
+		    if ( _tree->quotaEstimates() )
+			_tree->quotaEstimates()->check( subDir, pathPrefix + entryName, &statInfo );
+
+		    if ( ! crossingFileSystems(_dir, subDir ) )	// normal case
+		    {
+			_tree->addReadJob( subDir );
+		    }
+		    else	// The subdirectory we just found is a mount point.
+		    {
+			subDir->setMountPoint();
+
+			if ( _tree->crossFileSystems() )
+			{
+			    _tree->addReadJob( subDir );
+			}
+			else
+			{
+			    subDir->setReadState( DirOnRequestOnly );
+			    finishReading( subDir );
+			}
+		    }
+		}
+	    }
+	    else		// non-directory child
+	    {
+		if ( entryName == defaultCacheName && ! _keepExistingSubDirs )	// .qdirstat.cache.gz found?
+		{
+		    logDebug() << "Found cache file " << defaultCacheName << endl;
+		    QString fullName = pathPrefix + entryName;
+
+		    //
+		    // Read content of this subdirectory from cache file
+		    //
+
+		    CacheReadJob * cacheReadJob = new CacheReadJob( _tree, _dir->parent(), fullName );
+		    CHECK_NEW( cacheReadJob );
+		    QString firstDirInCache = cacheReadJob->firstDir();
+
+		    if ( firstDirInCache == dirName )	// Does this cache file match this directory?
+		    {
+			logDebug() << "Using cache file " << fullName << " for " << dirName << endl;
+
+			cacheReadJob->rewind();	 // Read offset was moved by firstDir()
+			_tree->addJob( cacheReadJob );	   // Job queue will assume ownership of cacheReadJob
+
+			if ( _dir->parent() )
+			    _dir->parent()->setReadState( DirReading );
+
+			//
+			// Clean up partially read directory content
+			//
+
+			DirTree * tree = _tree;	 // Copy data members to local variables:
+			DirInfo * dir  = _dir;	 // This object will be deleted soon by killAll()
+
+			_queue->killAll( _dir, cacheReadJob );	// Will delete this job as well!
+			// All data members of this object are invalid from here on!
+
+			logDebug() << "Deleting subtree " << dir << endl;
+			tree->deleteSubtree( dir );
+
+			return;
+		    }
+		    else
+		    {
+			logWarning() << "NOT using cache file " << fullName
+				     << " with dir " << firstDirInCache
+				     << " for " << dirName
+				     << endl;
+
+			delete cacheReadJob;
+		    }
+		}
+		else if ( _tree->aggregateOnly() )
+		{
+		    // Only the totals: No node for this file
+
+		    FileInfo file( entryName, &statInfo, _tree, _dir );
+
+		    if ( statInfo.st_nlink > 1 && _tree->inodeSet() )
+			file.setHardLinkCounted( _tree->inodeSet()->insert( statInfo.st_dev, statInfo.st_ino ) );
+
+		    _dir->foldChild( &file );
+		}
+		else
+		{
+		    FileInfo *child = new FileInfo( entryName, &statInfo, _tree, _dir );
+		    CHECK_NEW( child );
+
+		    if ( statInfo.st_nlink > 1 && _tree->inodeSet() )
+			child->setHardLinkCounted( _tree->inodeSet()->insert( statInfo.st_dev, statInfo.st_ino ) );
+
+		    _dir->insertChild( child );
+		    childAdded( child );
+		}
+	    }
+	}
+	else			// lstat() error
+	{
+	    errno = entry.statErrno;	// for formatErrno()
+	    logWarning() << "lstat(" << pathPrefix + entryName << ") failed: " << formatErrno() << endl;
+
+	    /*
+	     * Not much we can do when lstat() didn't work; let's at
+	     * least create an (almost empty) entry as a placeholder.
+	     */
+	    DirInfo *child = new DirInfo( _tree, _dir, entryName,
+					  0,   // mode
+					  0,   // size
+					  0 ); // mtime
+	    CHECK_NEW( child );
+	    child->finalizeLocal();
+	    child->setReadState( DirError );
+	    _dir->insertChild( child );
+	    childAdded( child );
+	}
+    }
+
+    qint64 processNsec = ScanStats::now() - startNsec;
+    int	   processed   = entries.size() - pendingEntries.size();
+
+    ScanStats::instance()->addDir( _dir, processed, processNsec,
+				   pendingEntries.isEmpty() );
+    _readNsec	 += processNsec;
+    _readEntries += processed;
+
+    if ( ! pendingEntries.isEmpty() )
+    {
+	// All subdirectories are queued now; stat() the rest.
+
+	if ( _queue && _queue->isThreaded() )
+	{
+	    _pendingResult = new DirReadResult( this, dirName, pendingEntries,
+						_tree->scanBackend() );
+	    CHECK_NEW( _pendingResult );
+	    _queue->startWorker( _pendingResult );
+	}
+	else
+	{
+	    qint64 statNsec = ScanStats::now();
+	    statEntries( dirName, pendingEntries, _tree->scanBackend() );
+	    _readNsec += ScanStats::now() - statNsec;
+
+	    processEntries( dirName, LocalDirReadOk, pendingEntries );
+	}
+
+	return;
+    }
+
+    _dir->setReadState( DirFinished );
+    recordReadTime();
+    finishReading( _dir );
+    finished();
+    // Don't add anything after finished() since this deletes this job!
+}
+
+
+void LocalDirReadJob::recordReadTime()
+{
+    if ( _tree->readTimes() )
+	_tree->readTimes()->add( _dir, _readNsec, _readEntries );
+}
+
+
+void LocalDirReadJob::finishReading( DirInfo * dir )
+{
+    // logDebug() << dir << endl;
+
+    _tree->sendFinalizeLocal( dir );
+    dir->finalizeLocal();
+    _tree->sendReadJobFinished( dir );
+}
+
+
+
+LocalDirVerifyJob::LocalDirVerifyJob( DirTree * tree,
+				      DirInfo * dir,
+				      bool	full )
+    : LocalDirReadJob( tree, dir )
+    , _full( full )
+    , _recursive( true )
+{
+    // The subdirectories that are already there are checked with jobs of
+    // their own.
+
+    setKeepExistingSubDirs( true );
+}
+
+
+void LocalDirVerifyJob::startReading()
+{
+    if ( _full )
+	verifyEntries();
+    else
+	verifySubDirs();
+
+    // Don't add anything after this since both delete this job!
+}
+
+
+void LocalDirVerifyJob::verifySubDirs()
+{
+    QList<DirInfo *> subDirs;
+    QList<DirInfo *> changedSubDirs;
+
+    for ( FileInfo * child = _dir->firstChild(); child; child = child->next() )
+    {
+	if ( ! child->isDirInfo() || child->isDotEntry() )
+	    continue;
+
+	struct stat statInfo;
+
+	if ( lstat( child->url().toUtf8(), &statInfo ) != 0 ||
+	     ! S_ISDIR( statInfo.st_mode ) )
+	{
+	    // The mtime of this directory should have changed, too, but it
+	    // might not have if it has only a resolution of seconds.
+
+	    verifyEntries();
+	    return;
+	}
+
+	if ( statInfo.st_mtime == child->mtime() )
+	    subDirs << child->toDirInfo();
+	else
+	    changedSubDirs << child->toDirInfo();
+    }
+
+    foreach ( DirInfo * subDir, subDirs )
+	addVerifyJob( subDir, false );
+
+    foreach ( DirInfo * subDir, changedSubDirs )
+	addVerifyJob( subDir, true );
+
+    finished();
+    // Don't add anything after finished() since this deletes this job!
+}
+
+
+void LocalDirVerifyJob::verifyEntries()
+{
+    QString dirName = _dir->url();
+    struct stat dirStat;
+
+    if ( lstat( dirName.toUtf8(), &dirStat ) != 0 || ! S_ISDIR( dirStat.st_mode ) )
+    {
+	logInfo() << dirName << " is gone" << endl;
+
+	DirTree * tree = _tree;	 // Copy data members to local variables:
+	DirInfo * dir  = _dir;	 // This object will be deleted by finished()
+
+	finished();
+
+	if ( dir != tree->firstToplevel() )
+	    tree->deleteSubtree( dir );
+
+	return;
+    }
+
+    // The view has to forget about the children before any of them are
+    // added or deleted; it gets them back with the readJobFinished()
+    // signal from processEntries().
+
+    _tree->sendChildrenChanging( _dir );
+    _dir->setReadState( DirReading );
+    _dir->setMtime( dirStat.st_mtime );
+
+    LocalDirEntryList entries;
+    LocalDirReadStatus status = readEntries( dirName, entries, false, _tree->scanBackend() );
+
+    if ( status != LocalDirReadOk )
+    {
+	processEntries( dirName, status, entries );
+	return;
+    }
+
+    // Index the existing children by name, including those in the dot entry
+
+    QHash<QString, FileInfo *> children;
+
+    for ( FileInfo * child = _dir->firstChild(); child; child = child->next() )
+    {
+	if ( ! child->isDotEntry() )
+	    children.insert( child->name(), child );
+    }
+
+    if ( _dir->dotEntry() )
+    {
+	for ( FileInfo * child = _dir->dotEntry()->firstChild(); child; child = child->next() )
+	    children.insert( child->name(), child );
+    }
+
+    // Folded files have no names to compare with: Fold them all again
+
+    if ( _dir->dotEntry() )
+	_dir->dotEntry()->dropFoldedFiles();
+
+    QList<FileInfo *> obsolete;
+    QList<DirInfo *>  subDirs;
+    QList<DirInfo *>  changedSubDirs;
+    LocalDirEntryList newEntries;
+
+    foreach ( const LocalDirEntry & entry, entries )
+    {
+	FileInfo * child = children.take( entry.name );
+
+	if ( child && entry.statErrno == 0 )
+	{
+	    const struct stat & statInfo = entry.statInfo;
+
+	    if ( S_ISDIR( statInfo.st_mode ) && child->isDirInfo() &&
+		 child->readState() != DirError )
+	    {
+		if ( statInfo.st_mtime == child->mtime() )
+		    subDirs << child->toDirInfo();
+		else
+		    changedSubDirs << child->toDirInfo();
+
+		continue;
+	    }
+
+	    if ( ! S_ISDIR( statInfo.st_mode ) && ! child->isDirInfo() &&
+		 child->mode()	 == statInfo.st_mode   &&
+		 child->size()	 == statInfo.st_size   &&
+		 child->blocks() == statInfo.st_blocks &&
+		 child->mtime()	 == statInfo.st_mtime )
+	    {
+		continue;	// Unchanged file
+	    }
+	}
+
+	// Changed entries are created from scratch just like new ones
+
+	if ( child )
+	    obsolete << child;
+
+	newEntries << entry;
+    }
+
+    obsolete << children.values();	// Gone from disk
+
+    foreach ( FileInfo * child, obsolete )
+	_tree->deleteSubtree( child );
+
+    if ( _recursive )
+    {
+	foreach ( DirInfo * subDir, subDirs )
+	    addVerifyJob( subDir, false );
+    }
+
+    foreach ( DirInfo * subDir, changedSubDirs )
+	addVerifyJob( subDir, true );
+
+    processEntries( dirName, LocalDirReadOk, newEntries );
+    // Don't add anything after processEntries() since this deletes this job!
+}
+
+
+void LocalDirVerifyJob::addVerifyJob( DirInfo * subDir, bool full )
+{
+    // Excluded directories, mount points that are not read and directories
+    // that could not be read are left alone.
+
+    if ( subDir->readState() != DirFinished &&
+	 subDir->readState() != DirCached )
+    {
+	return;
+    }
+
+    LocalDirVerifyJob * job = new LocalDirVerifyJob( _tree, subDir, full );
+    CHECK_NEW( job );
+    job->setRecursive( _recursive );
+    _tree->addJob( job );
+}
+
+
+
+FileInfo * LocalDirReadJob::stat( const QString & url,
+				  DirTree	* tree,
+				  DirInfo	* parent )
+{
+    struct stat statInfo;
+    logDebug() << "url: \"" << url << "\"" << endl;
+
+    if ( lstat( url.toUtf8(), &statInfo ) == 0 ) // lstat() OK
+    {
+	if ( S_ISDIR( statInfo.st_mode ) )	// directory?
+	{
+	    DirInfo * dir = new DirInfo( url, &statInfo, tree, parent );
+	    CHECK_NEW( dir );
+
+	    if ( parent )
+		parent->insertChild( dir );
+
+	    if ( dir && parent &&
+		 ! tree->isTopLevel( dir )
+		 && dir->device() != parent->device() )
+	    {
+		logDebug() << dir << " is a mount point" << endl;
+		dir->setMountPoint();
+	    }
+
+	    return dir;
+	}
+	else					// no directory
+	{
+	    FileInfo * file = new FileInfo( url, &statInfo, tree, parent );
+	    CHECK_NEW( file );
+
+	    if ( parent )
+		parent->insertChild( file );
+
+	    return file;
+	}
+    }
+    else // lstat() failed
+    {
+        THROW( SysCallFailedException( "lstat", url ) );
+	return 0; // NOTREACHED
+    }
+}
+
+
+
+
+
+
+CacheReadJob::CacheReadJob( DirTree	* tree,
+			    DirInfo	* parent,
+			    CacheReader * reader )
+    : ObjDirReadJob( tree, parent )
+    , _reader( reader )
+    , _binaryReader( 0 )
+{
+    if ( _reader )
+	_reader->rewind();
+
+    init();
+}
+
+
+CacheReadJob::CacheReadJob( DirTree	  * tree,
+			    DirInfo	  * parent,
+			    const QString & cacheFileName )
+    : ObjDirReadJob( tree, parent )
+    , _reader( 0 )
+    , _binaryReader( 0 )
+{
+    if ( BinaryCacheReader::isBinaryCache( cacheFileName ) )
+    {
+	_binaryReader = new BinaryCacheReader( cacheFileName, tree, parent );
+	CHECK_NEW( _binaryReader );
+    }
+    else
+    {
+	_reader = new CacheReader( cacheFileName, tree, parent );
+	CHECK_NEW( _reader );
+    }
+
+    init();
+}
+
+
+void CacheReadJob::init()
+{
+    if ( _reader )
+    {
+	if ( _reader->ok() )
+	{
+	    connect( _reader,	SIGNAL( childAdded    ( FileInfo * ) ),
+		     this,	SLOT  ( slotChildAdded( FileInfo * ) ) );
+	}
+	else
+	{
+	    delete _reader;
+	    _reader = 0;
+	}
+    }
+
+    if ( _binaryReader && ! _binaryReader->ok() )
+    {
+	delete _binaryReader;
+	_binaryReader = 0;
+    }
+}
+
+
+CacheReadJob::~CacheReadJob()
+{
+    if ( _reader )
+	delete _reader;
+
+    if ( _binaryReader )
+	delete _binaryReader;
+}
+
+
+void CacheReadJob::setRefresh( bool refresh )
+{
+    if ( _reader )
+	_reader->setRefresh( refresh );
+
+    if ( _binaryReader )
+	_binaryReader->setRefresh( refresh );
+}
+
+
+void CacheReadJob::setSubtree( const QString & path )
+{
+    if ( _reader )
+	_reader->setSubtree( path );
+
+    if ( _binaryReader && ! path.isEmpty() )
+    {
+	logWarning() << "Reading a subtree of a binary cache is not supported - "
+		     << "reading all of " << path << endl;
+    }
+}
+
+
+QString CacheReadJob::firstDir()
+{
+    if ( _reader )
+	return _reader->firstDir();
+
+    if ( _binaryReader )
+	return _binaryReader->firstDir();
+
+    return "";
+}
+
+
+void CacheReadJob::rewind()
+{
+    if ( _reader )
+	_reader->rewind();
+
+    if ( _binaryReader )
+	_binaryReader->rewind();
+}
+
+
+void
+CacheReadJob::read()
+{
+    /*
+     * This will be called repeatedly from DirTree::timeSlicedRead() until
+     * finished() is called.
+     */
+
+    if ( _binaryReader )
+    {
+	// The nodes are already in memory, so many more of them fit into
+	// one time slice.
+
+	_binaryReader->read( 10000 );
+
+	if ( _binaryReader->eof() )
+	{
+	    if ( _binaryReader->ok() )
+		_binaryReader->queueRefreshJobs();
+
+	    finished();
+	}
+
+	return;
+    }
+
+    if ( ! _reader )
+    {
+	finished();
+	return;
+    }
+
+    // logDebug() << "Reading 1000 cache lines" << endl;
+    _reader->read( 1000 );
+
+    if ( _reader->eof() || ! _reader->ok() )
+    {
+	// logDebug() << "Cache reading finished - ok: " << _reader->ok() << endl;
+
+	if ( _reader->ok() )
+	    _reader->queueRefreshJobs();
+
+	finished();
+    }
+}
+
+
+
+
+
+MergeCacheReadJob::MergeCacheReadJob( DirTree *	    tree,
+				      const QStringList & cacheFileNames )
+    : ObjDirReadJob( tree, 0 )
+{
+    foreach ( const QString & fileName, cacheFileNames )
+    {
+	if ( BinaryCacheReader::isBinaryCache( fileName ) )
+	{
+	    logError() << "Can't merge binary cache file " << fileName << endl;
+	    continue;
+	}
+
+	CacheReader * reader = new CacheReader( fileName, tree, 0 );
+	CHECK_NEW( reader );
+
+	if ( ! reader->ok() )
+	{
+	    delete reader;
+	    continue;
+	}
+
+	connect( reader, SIGNAL( childAdded    ( FileInfo * ) ),
+		 this,	 SLOT  ( slotChildAdded( FileInfo * ) ) );
+
+	reader->prefetch();
+	_readers << reader;
+    }
+}
+
+
+MergeCacheReadJob::~MergeCacheReadJob()
+{
+    qDeleteAll( _readers );
+}
+
+
+void MergeCacheReadJob::read()
+{
+    QMutableListIterator<CacheReader *> it( _readers );
+
+    while ( it.hasNext() )
+    {
+	CacheReader * reader = it.next();
+	reader->read( 1000 );
+
+	if ( reader->eof() || ! reader->ok() )
+	{
+	    if ( reader->ok() )
+		reader->queueRefreshJobs();
+
+	    delete reader;	// This finalizes its part of the tree
+	    it.remove();
+	}
+    }
+
+    if ( _readers.isEmpty() )
+	finished();
+}
+
+
+
+
+
+static QString remoteCommandName = "qdirstat";
+
+
+RemoteDirReadJob::RemoteDirReadJob( DirTree *	    tree,
+				    const QString & host,
+				    const QString & dirName )
+    : CacheReadJob( tree, 0, (CacheReader *) 0 )
+    , _pid( -1 )
+{
+    int fd = startAgent( host, dirName );
+
+    if ( fd >= 0 )
+    {
+	_reader = new CacheReader( fd, host + ":" + dirName, tree, 0 );
+	CHECK_NEW( _reader );
+	init();
+    }
+}
+
+
+RemoteDirReadJob::~RemoteDirReadJob()
+{
+    if ( _pid <= 0 )
+	return;
+
+    int status = 0;
+
+    if ( waitpid( _pid, &status, WNOHANG ) == 0 )
+    {
+	// Still running: The job was aborted
+
+	kill( _pid, SIGTERM );
+	waitpid( _pid, &status, 0 );
+    }
+    else if ( WIFEXITED( status ) && WEXITSTATUS( status ) != 0 )
+    {
+	logError() << "Scan agent exited with " << WEXITSTATUS( status ) << endl;
+    }
+
+    // The parser thread of the reader now gets EOF, so the reader can be
+    // deleted by the base class.
+}
+
+
+QString RemoteDirReadJob::remoteCommand()
+{
+    return remoteCommandName;
+}
+
+
+void RemoteDirReadJob::setRemoteCommand( const QString & command )
+{
+    remoteCommandName = command.isEmpty() ? QString( "qdirstat" ) : command;
+}
+
+
+QString RemoteDirReadJob::shellQuoted( const QString & arg )
+{
+    QString quoted = arg;
+    quoted.replace( "'", "'\\''" );
+
+    return "'" + quoted + "'";
+}
+
+
+int RemoteDirReadJob::startAgent( const QString & host, const QString & dirName )
+{
+    QString command = remoteCommandName + " --scan-to-cache " + shellQuoted( dirName ) + " -";
+    logInfo() << "Starting on " << host << ": " << command << endl;
+
+    // Prepare everything for exec() before fork(): The child may only
+    // use async-signal-safe functions.
+
+    QList<QByteArray> args;
+    args << "ssh" << "-T" << "-o" << "BatchMode=yes" << host.toUtf8() << command.toUtf8();
+
+    QVector<char *> argv;
+
+    for ( int i=0; i < args.size(); ++i )
+	argv << args[i].data();
+
+    argv << (char *) 0;
+
+    int pipeFd[2];
+
+    if ( pipe2( pipeFd, O_CLOEXEC ) != 0 )
+    {
+	logError() << "pipe2() failed: " << formatErrno() << endl;
+	return -1;
+    }
+
+    _pid = fork();
+
+    if ( _pid < 0 )
+    {
+	logError() << "fork() failed: " << formatErrno() << endl;
+	close( pipeFd[0] );
+	close( pipeFd[1] );
+	return -1;
+    }
+
+    if ( _pid == 0 )
+    {
+	// Child process
+
+	int nullFd = open( "/dev/null", O_RDONLY );
+
+	if ( nullFd >= 0 )
+	    dup2( nullFd, STDIN_FILENO );
+
+	dup2( pipeFd[1], STDOUT_FILENO );	// This clears O_CLOEXEC
+	execvp( argv[0], argv.data() );
+	_exit( 127 );
+    }
+
+    close( pipeFd[1] );
+
+    return pipeFd[0];
+}
+
+
+
+
+
+// The queues that are reading right now and share the worker threads
+
+static QList<DirReadJobQueue *> activeQueues;
+
+
+DirReadJobQueue::DirReadJobQueue()
+    : QObject()
+    , _threadCount( 1 )
+    , _nextDevice( 0 )
+    , _depthFirst( false )
+    , _priorityDir( 0 )
+    , _pendingDirCount( 0 )
+    , _currentJob( 0 )
+{
+    connect( &_timer, SIGNAL( timeout() ),
+	     this,    SLOT  ( timeSlicedRead() ) );
+}
+
+
+DirReadJobQueue::~DirReadJobQueue()
+{
+    clear();
+
+    // Wait for the worker threads that are still busy with results of this
+    // queue; those results are no longer needed. The other queues go on
+    // using the pool.
+
+    _runningWorkers.waitForAll();
+
+    qDeleteAll( _pendingResults );
+    _pendingResults.clear();
+}
+
+
+QThreadPool * DirReadJobQueue::threadPool()
+{
+    static QThreadPool pool;
+
+    if ( pool.maxThreadCount() != MAX_READ_THREADS )
+	pool.setMaxThreadCount( MAX_READ_THREADS );
+
+    return &pool;
+}
+
+
+void DirReadJobQueue::setThreadCount( int threadCount )
+{
+    _threadCount = qMax( 1, threadCount );
+}
+
+
+int DirReadJobQueue::workerLimit() const
+{
+    int queues = 0;
+
+    foreach ( DirReadJobQueue * queue, activeQueues )
+    {
+	if ( queue->isThreaded() )
+	    ++queues;
+    }
+
+    return qMax( 1, _threadCount / qMax( 1, queues ) );
+}
+
+
+void DirReadJobQueue::setActive( bool active )
+{
+    if ( active && ! activeQueues.contains( this ) )
+	activeQueues.append( this );
+    else if ( ! active )
+	activeQueues.removeAll( this );
+}
+
+
+static dev_t jobDevice( DirReadJob * job )
+{
+    return job && job->dir() ? job->dir()->device() : 0;
+}
+
+
+void DirReadJobQueue::startWorker( DirReadResult * result )
+{
+    CHECK_PTR( result );
+
+    connect( result, SIGNAL( done()	  ),
+	     this,   SLOT  ( workerDone() ),
+	     Qt::QueuedConnection );
+
+    dev_t device = jobDevice( result->job() );
+    _pendingResults.insert( result, device );
+    ++_busyWorkers[ device ];
+
+    // Each device gets its own share of worker threads; nextJob() keeps
+    // each tree within its share of the pool.
+
+    DirReadWorker * worker = new DirReadWorker( result, &_runningWorkers );
+    CHECK_NEW( worker );
+    _runningWorkers.started();
+    threadPool()->start( worker );	// The thread pool takes ownership
+}
+
+
+void DirReadJobQueue::workerDone()
+{
+    DirReadResult * result = qobject_cast<DirReadResult *>( sender() );
+
+    if ( ! result || ! _pendingResults.contains( result ) )
+	return;
+
+    dev_t device = _pendingResults.take( result );
+
+    if ( --_busyWorkers[ device ] <= 0 )
+	_busyWorkers.remove( device );
+
+    LocalDirReadJob * job = result->job();
+
+    if ( job )		  // Not cancelled?
+	job->processResult( result ); // This will delete the job
+
+    result->deleteLater();
+
+    // A worker thread is available again: Continue with the next job.
+
+    if ( ! isEmpty() && ! _timer.isActive() )
+	_timer.start( 0 );
+}
+
+
+void DirReadJobQueue::enqueue( DirReadJob * job )
+{
+    if ( job )
+    {
+	_queue.append( job );
+	job->setQueue( this );
+
+	dev_t device = jobDevice( job );
+	_jobDevice.insert( job, device );
+
+	if ( ! _deviceJobs.contains( device ) && ! _pendingDirs.contains( device ) )
+	    _deviceOrder.append( device );
+
+	_deviceJobs[ device ].append( job );
+
+	if ( isPriorityJob( job ) )
+	    _priorityJobs.append( job );
+
+	wakeUp();
+    }
+}
+
+
+void DirReadJobQueue::enqueueDir( DirInfo * dir )
+{
+    CHECK_PTR( dir );
+
+    dir->readJobAdded();	  // Just like a job would do
+    ++_pendingDirCount;
+    addPendingDir( dir );
+    wakeUp();
+}
+
+
+void DirReadJobQueue::wakeUp()
+{
+    if ( ! _timer.isActive() )
+    {
+	// logDebug() << "First job queued" << endl;
+
+	if ( _pendingResults.isEmpty() ) // Timer not just paused for workers?
+	{
+	    // The statistics are for all trees that are read at the same time
+
+	    if ( activeQueues.isEmpty() )
+	    {
+		ScanStats::instance()->reset();
+		ScanThrottle::instance()->reset();
+	    }
+
+	    setActive( true );
+	    emit startingReading();
+	}
+
+	_timer.start( 0 );
+    }
+}
+
+
+void DirReadJobQueue::addPendingDir( DirInfo * dir )
+{
+    if ( _priorityDir && dir->isInSubtree( _priorityDir ) )
+    {
+	_priorityDirs.append( dir );
+	return;
+    }
+
+    dev_t device = dir->device();
+
+    if ( ! _deviceJobs.contains( device ) && ! _pendingDirs.contains( device ) )
+	_deviceOrder.append( device );
+
+    _pendingDirs[ device ].append( dir );
+}
+
+
+DirInfo * DirReadJobQueue::takePendingDir( QList<DirInfo *> & dirs )
+{
+    if ( _depthFirst || _pendingDirCount > MAX_PENDING_DIRS )
+	return dirs.takeLast();
+    else
+	return dirs.takeFirst();
+}
+
+
+void DirReadJobQueue::createJob( DirInfo * dir )
+{
+    --_pendingDirCount;
+
+    LocalDirReadJob * job = new LocalDirReadJob( dir->tree(), dir );
+    CHECK_NEW( job );
+    dir->readJobFinished();	// The job counts itself now
+    enqueue( job );
+}
+
+
+void DirReadJobQueue::fillJobs( dev_t device )
+{
+    QHash<dev_t, QList<DirInfo *> >::iterator it = _pendingDirs.find( device );
+
+    if ( it == _pendingDirs.end() )
+	return;
+
+    // Enough jobs to keep all worker threads of the device busy and to
+    // start a new one as soon as one worker is done
+
+    while ( _deviceJobs.value( device ).size() < 2 * _threadCount && ! it.value().isEmpty() )
+	createJob( takePendingDir( it.value() ) );
+
+    if ( it.value().isEmpty() )
+	_pendingDirs.erase( it );
+}
+
+
+void DirReadJobQueue::removePendingDirs( DirInfo * subtree )
+{
+    QMutableListIterator<DirInfo *> prioIt( _priorityDirs );
+
+    while ( prioIt.hasNext() )
+    {
+	DirInfo * dir = prioIt.next();
+
+	if ( ! subtree || dir->isInSubtree( subtree ) )
+	{
+	    prioIt.remove();
+	    dir->readJobFinished();
+	    --_pendingDirCount;
+	}
+    }
+
+    foreach ( dev_t device, _pendingDirs.keys() )
+    {
+	QList<DirInfo *> & dirs = _pendingDirs[ device ];
+	QMutableListIterator<DirInfo *> it( dirs );
+
+	while ( it.hasNext() )
+	{
+	    DirInfo * dir = it.next();
+
+	    if ( ! subtree || dir->isInSubtree( subtree ) )
+	    {
+		it.remove();
+		dir->readJobFinished();
+		--_pendingDirCount;
+	    }
+	}
+
+	if ( dirs.isEmpty() )
+	{
+	    _pendingDirs.remove( device );
+	    removeDeviceIfIdle( device );
+	}
+    }
+}
+
+
+DirReadJob * DirReadJobQueue::dequeue()
+{
+    DirReadJob * job = _queue.first();
+    _queue.removeFirst();
+
+    if ( job )
+    {
+	removeFromDevice( job );
+	job->setQueue( 0 );
+    }
+
+    return job;
+}
+
+
+bool DirReadJobQueue::isReadingCache() const
+{
+    // Only a few jobs at a time are real job objects, so this is cheap.
+
+    foreach ( DirReadJob * job, _queue )
+    {
+	if ( dynamic_cast<CacheReadJob *>( job ) )
+	    return true;
+    }
+
+    return false;
+}
+
+
+void DirReadJobQueue::clear()
+{
+    removePendingDirs( 0 );
+    qDeleteAll( _queue );
+    _queue.clear();
+    _deviceJobs.clear();
+    _jobDevice.clear();
+    _deviceOrder.clear();
+    _nextDevice = 0;
+    _priorityJobs.clear();
+    _priorityDir = 0;
+    _currentJob	 = 0;
+    setActive( false );
+}
+
+
+void DirReadJobQueue::setPriorityDir( DirInfo * dir )
+{
+    if ( dir == _priorityDir )
+	return;
+
+    _priorityDir = dir;
+    _priorityJobs.clear();
+
+    QList<DirInfo *> oldPriorityDirs = _priorityDirs;
+    _priorityDirs.clear();
+
+    if ( _priorityDir )
+    {
+	foreach ( DirReadJob * job, _queue )
+	{
+	    if ( isPriorityJob( job ) )
+		_priorityJobs.append( job );
+	}
+
+	// Move the waiting directories of the new priority subtree out of
+	// the queues of their devices
+
+	foreach ( dev_t device, _pendingDirs.keys() )
+	{
+	    QList<DirInfo *> & dirs = _pendingDirs[ device ];
+	    QMutableListIterator<DirInfo *> it( dirs );
+
+	    while ( it.hasNext() )
+	    {
+		DirInfo * pendingDir = it.next();
+
+		if ( pendingDir->isInSubtree( _priorityDir ) )
+		{
+		    it.remove();
+		    _priorityDirs.append( pendingDir );
+		}
+	    }
+
+	    if ( dirs.isEmpty() )
+	    {
+		_pendingDirs.remove( device );
+		removeDeviceIfIdle( device );
+	    }
+	}
+    }
+
+    foreach ( DirInfo * pendingDir, oldPriorityDirs )
+	addPendingDir( pendingDir );
+}
+
+
+bool DirReadJobQueue::isPriorityJob( DirReadJob * job ) const
+{
+    return _priorityDir && job->dir() && job->dir()->isInSubtree( _priorityDir );
+}
+
+
+void DirReadJobQueue::removeFromDevice( DirReadJob * job )
+{
+    QHash<DirReadJob *, dev_t>::iterator it = _jobDevice.find( job );
+
+    if ( it == _jobDevice.end() )
+	return;
+
+    dev_t device = it.value();
+    _jobDevice.erase( it );
+
+    if ( job == _currentJob )
+	_currentJob = 0;
+
+    if ( _priorityDir )
+	_priorityJobs.removeOne( job );
+
+    QList<DirReadJob *> & jobs = _deviceJobs[ device ];
+    jobs.removeOne( job );
+
+    if ( jobs.isEmpty() )
+    {
+	_deviceJobs.remove( device );
+	removeDeviceIfIdle( device );
+    }
+}
+
+
+void DirReadJobQueue::removeDeviceIfIdle( dev_t device )
+{
+    if ( _deviceJobs.contains( device ) || _pendingDirs.contains( device ) )
+	return;
+
+    int index = _deviceOrder.indexOf( device );
+
+    if ( index >= 0 )
+    {
+	_deviceOrder.removeAt( index );
+
+	if ( index < _nextDevice )
+	    --_nextDevice;
+    }
+}
+
+
+void DirReadJobQueue::abort()
+{
+    foreach ( DirReadJob * job, _queue )
+    {
+	if ( job->dir() )
+	    job->dir()->readJobAborted();
+    }
+
+    foreach ( DirInfo * dir, _priorityDirs )
+	dir->readJobAborted();
+
+    foreach ( const QList<DirInfo *> & dirs, _pendingDirs )
+    {
+	foreach ( DirInfo * dir, dirs )
+	    dir->readJobAborted();
+    }
+
+    clear();
+}
+
+
+void DirReadJobQueue::killAll( DirInfo * subtree, DirReadJob * exceptJob )
+{
+    if ( ! subtree )
+	return;
+
+    removePendingDirs( subtree );
+    QMutableListIterator<DirReadJob *> it( _queue );
+
+    while ( it.hasNext() )
+    {
+	DirReadJob * job = it.next();
+
+	if ( exceptJob && job == exceptJob )
+	{
+	    logDebug() << "NOT killing read job " << job->dir() << endl;
+	    continue;
+	}
+
+	if ( job->dir() && job->dir()->isInSubtree( subtree ) )
+	{
+	    // logDebug() << "Killing read job " << job->dir() << endl;
+	    it.remove();
+	    removeFromDevice( job );
+	    delete job;
+	}
+    }
+}
+
+
+void DirReadJobQueue::timeSlicedRead()
+{
+    // Read as much as fits into one time slice: Going back to the event
+    // loop after each job would cost more than many small directories.
+
+    QElapsedTimer stopWatch;
+    stopWatch.start();
+    ScanStats::instance()->setQueueDepth( count(), _pendingResults.size() );
+
+    if ( _timer.interval() > 0 )	// Was waiting for the scan throttle
+	_timer.setInterval( 0 );
+
+    while ( ! isEmpty() )
+    {
+	// The main thread must not sleep for the rate limit or the backoff
+	// of the scan throttle: Come back when the next system call is due.
+
+	int delay = ScanThrottle::instance()->delayMillisec();
+
+	if ( delay > 0 )
+	{
+	    _timer.start( delay );
+	    return;
+	}
+
+	DirReadJob * job = nextJob();
+
+	if ( ! job )
+	{
+	    // All worker threads are busy, or all jobs are waiting for their
+	    // workers: No need to poll until a worker is done.
+
+	    _timer.stop();
+	    return;
+	}
+
+	_currentJob = job;
+	job->read();
+
+	// Don't touch 'job' after read(): It might be deleted already.
+
+	if ( stopWatch.elapsed() >= TIME_SLICE_MILLISEC )
+	    return;
+    }
+}
+
+
+DirReadJob * DirReadJobQueue::nextJob()
+{
+    // Continue with a job that is only partly done, e.g. a large
+    // directory that is read in parts
+
+    if ( _currentJob && ! _currentJob->isWaitingForWorker() )
+	return _currentJob;
+
+    while ( _priorityJobs.size() < 2 * _threadCount && ! _priorityDirs.isEmpty() )
+	createJob( takePendingDir( _priorityDirs ) );
+
+    DirReadJob * job = firstRunnable( _priorityJobs );
+
+    if ( job )
+	return job;
+
+    // Take turns between the devices, so a slow device (e.g. a network
+    // mount) can't hold up all the others.
+
+    int limit = workerLimit();
+
+    for ( int i=0; i < _deviceOrder.size(); ++i )
+    {
+	if ( _nextDevice >= _deviceOrder.size() )
+	    _nextDevice = 0;
+
+	dev_t device = _deviceOrder.at( _nextDevice++ );
+
+	if ( isThreaded() && _busyWorkers.value( device ) >= limit )
+	    continue;
+
+	fillJobs( device );
+	job = firstRunnable( _deviceJobs.value( device ) );
+
+	if ( job )
+	    return job;
+    }
+
+    return 0;
+}
+
+
+DirReadJob * DirReadJobQueue::firstRunnable( const QList<DirReadJob *> & jobs ) const
+{
+    int limit = workerLimit();
+
+    for ( int i=0; i < jobs.size(); ++i )
+    {
+	DirReadJob * job = jobs.at( _depthFirst ? jobs.size() - 1 - i : i );
+
+	if ( job->isWaitingForWorker() )
+	    continue;
+
+	if ( isThreaded() && _busyWorkers.value( _jobDevice.value( job ) ) >= limit )
+	    continue;
+
+	return job;
+    }
+
+    return 0;
 }
 
 
@@ -568,13 +1933,15 @@ void DirReadJobQueue::jobFinishedNotify( DirReadJob *job )
     // Get rid of the old (finished) job.
 
     _queue.removeOne( job );
+    removeFromDevice( job );
     delete job;
 
     // The timer will start a new job when it fires.
 
-    if ( _queue.isEmpty() )	// No new job available - we're done.
+    if ( isEmpty() )	// No new job available - we're done.
     {
 	_timer.stop();
+	setActive( false );
 	// logDebug() << "No more jobs - finishing" << endl;
 	emit finished();
     }
@@ -13,8 +13,12 @@
 
 #include <dirent.h>
 #include <QTimer>
+#include <QThreadPool>
+#include <QHash>
+#include <QStringList>
 
 #include "Logger.h"
+#include "DirReadWorker.h"
 
 
 namespace QDirStat
@@ -24,7 +28,9 @@ namespace QDirStat
     class DirInfo;
     class DirTree;
     class CacheReader;
+    class BinaryCacheReader;
     class DirReadJobQueue;
+    class DirentReader;
 
 
     /**
@@ -96,6 +102,15 @@ namespace QDirStat
 	 **/
 	void setQueue( DirReadJobQueue * queue ) { _queue = queue; }
 
+	/**
+	 * Return 'true' if this job is currently waiting for a worker thread
+	 * to deliver its results. The queue will not call read() for such a
+	 * job.
+	 *
+	 * This default implementation always returns 'false'.
+	 **/
+	virtual bool isWaitingForWorker() const { return false; }
+
 
     protected:
 
@@ -145,6 +160,29 @@ namespace QDirStat
          **/
         QString device( const DirInfo * dir ) const;
 
+    public:
+
+        /**
+         * Check if going from a parent directory on device number
+         * 'parentDev' (with device name 'parentDevice') to the child
+         * directory 'childPath' on device number 'childDev' would cross
+         * a file system boundary. This is the part of
+         * crossingFileSystems() that doesn't need any tree items, so it
+         * can also be used without a DirTree.
+         **/
+        static bool crossingFileSystems( dev_t		 parentDev,
+                                         const QString & parentDevice,
+                                         dev_t		 childDev,
+                                         const QString & childPath );
+
+        /**
+         * Return the device name of the mount point 'path' or an empty
+         * string if 'path' is not a mount point.
+         **/
+        static QString mountPointDevice( const QString & path );
+
+    protected:
+
 
 	DirTree *	   _tree;
 	DirInfo *	   _dir;
@@ -215,6 +253,85 @@ namespace QDirStat
 				DirTree	      * tree,
 				DirInfo	      * parent = 0 );
 
+	/**
+	 * Read the entries of directory 'dirName' from disk and lstat() each
+	 * of them. This only does the system calls; it does not touch any
+	 * tree, so it is safe to call this from a worker thread.
+	 *
+	 * If 'deferFileStat' is 'true', entries that readdir() already
+	 * reports as something other than a directory are not stat()ed yet;
+	 * they are marked as 'statPending' and need to be handled with
+	 * statEntries() later.
+	 *
+	 * With the io_uring backend, the entries are collected first and
+	 * then stat()ed in batches; if io_uring is not available, this falls
+	 * back to fstatat().
+	 **/
+	static LocalDirReadStatus readEntries( const QString	 & dirName,
+					       LocalDirEntryList & entries,
+					       bool		   deferFileStat = false,
+					       LocalScanBackend	   backend = LstatScanBackend );
+
+	/**
+	 * stat() all entries of 'entries' that are marked as 'statPending'.
+	 * Like readEntries(), this is safe to call from a worker thread.
+	 **/
+	static void statEntries( const QString	   & dirName,
+				 LocalDirEntryList & entries,
+				 LocalScanBackend    backend = LstatScanBackend );
+
+	/**
+	 * Open directory 'dirName' for readNextEntries(). Delete the
+	 * DirentReader when done.
+	 **/
+	static LocalDirReadStatus openDir( const QString & dirName,
+					   DirentReader ** diskDir );
+
+	/**
+	 * Read up to 'maxEntries' more entries (all if 'maxEntries' is
+	 * negative) from 'diskDir' like readEntries() and append them to
+	 * 'entries'. Return 'true' if there are no more entries.
+	 **/
+	static bool readNextEntries( DirentReader	 * diskDir,
+				     LocalDirEntryList & entries,
+				     bool		 deferFileStat,
+				     LocalScanBackend	 backend,
+				     int		 maxEntries = -1 );
+
+	/**
+	 * Read the next part of the directory. Without worker threads, a
+	 * directory is read in parts, so a very large one doesn't block
+	 * everything else for long.
+	 *
+	 * Reimplemented from DirReadJob.
+	 **/
+	virtual void read() Q_DECL_OVERRIDE;
+
+	/**
+	 * Process the result of a worker thread that read this job's
+	 * directory. This is called from the job queue in the main thread.
+	 *
+	 * Caution: This will delete this job.
+	 **/
+	void processResult( DirReadResult * result );
+
+	/**
+	 * Return 'true' if this job is currently waiting for a worker thread.
+	 *
+	 * Reimplemented from DirReadJob.
+	 **/
+	virtual bool isWaitingForWorker() const Q_DECL_OVERRIDE
+	    { return _pendingResult != 0; }
+
+	/**
+	 * Set if subdirectories that are already in the tree should be kept
+	 * as they are. This is used for refreshing a directory that was
+	 * read from a cache file: Its files and new subdirectories are read
+	 * from disk, but the subdirectories from the cache file are checked
+	 * separately.
+	 **/
+	void setKeepExistingSubDirs( bool keep ) { _keepExistingSubDirs = keep; }
+
     protected:
 
 	/**
@@ -224,19 +341,123 @@ namespace QDirStat
 	 **/
 	virtual void startReading();
 
+	/**
+	 * Create tree items for the directory entries that were read from
+	 * disk, either directly by startReading() or by a worker thread.
+	 *
+	 * Entries that are still 'statPending' are stat()ed in a second pass
+	 * after all subdirectories are processed and their read jobs are
+	 * queued.
+	 *
+	 * Caution: This will delete this job.
+	 **/
+	void processEntries( const QString	     & dirName,
+			     LocalDirReadStatus	       status,
+			     const LocalDirEntryList & entries );
+
 	/**
 	 * Finish reading the directory: Send signals and finalize the
 	 * directory (clean up dot entries etc.).
 	 **/
 	void finishReading( DirInfo * dir );
 
+	/**
+	 * Record how long reading this directory took if the tree records
+	 * that (see DirReadTimes).
+	 **/
+	void recordReadTime();
+
+	/**
+	 * lstat() the entries with indices 'indices' of 'entries' relative
+	 * to directory file descriptor 'dirFd' and clear their 'statPending'
+	 * flag.
+	 **/
+	static void lstatEntries( int			dirFd,
+				  LocalDirEntryList   & entries,
+				  const QVector<int>  & indices,
+				  LocalScanBackend	backend );
+
 
-	DIR * _diskDir;
+	DirReadResult *	  _pendingResult;
+	bool		  _keepExistingSubDirs;
+	DirentReader *	  _diskDir;	// While reading in parts
+	LocalDirEntryList _entries;	// Read so far
+	qint64		  _readNsec;	// System calls and creating the nodes
+	int		  _readEntries;
 
     };	// LocalDirReadJob
 
 
 
+    /**
+     * Job that checks a directory that was already read against the disk
+     * and updates only what changed.
+     *
+     * In "full" mode, all entries of the directory are stat()ed again and
+     * compared to the existing children: Children that are gone or that
+     * changed are deleted, new and changed entries are added like in
+     * LocalDirReadJob. Subdirectories that were there before are kept;
+     * they are checked with another LocalDirVerifyJob, in full mode only
+     * if their mtime changed.
+     *
+     * Otherwise (the directory's mtime didn't change, so no entries were
+     * added or removed), only its known subdirectories are stat()ed.
+     *
+     * Notice that this does not find files that were changed in place in
+     * a directory below the one the job was started for: That doesn't
+     * change the directory's mtime.
+     **/
+    class LocalDirVerifyJob: public LocalDirReadJob
+    {
+    public:
+	/**
+	 * Constructor. If 'full' is 'true', all entries of 'dir' are
+	 * checked, otherwise only its subdirectories.
+	 **/
+	LocalDirVerifyJob( DirTree * tree, DirInfo * dir, bool full );
+
+	/**
+	 * Set if the subdirectories of the directory should be checked even
+	 * if their mtime didn't change. This is the default. If not, only the
+	 * directory's own entries and the subdirectories with a changed mtime
+	 * are checked. This is enough if changes are reported for each
+	 * directory anyway, like by a DirTreeWatcher.
+	 **/
+	void setRecursive( bool recursive ) { _recursive = recursive; }
+
+    protected:
+
+	/**
+	 * Check the directory. This deletes this job when it is done.
+	 *
+	 * Reimplemented from LocalDirReadJob.
+	 **/
+	virtual void startReading() Q_DECL_OVERRIDE;
+
+	/**
+	 * Check all entries of the directory.
+	 **/
+	void verifyEntries();
+
+	/**
+	 * Check the known subdirectories of the directory.
+	 **/
+	void verifySubDirs();
+
+	/**
+	 * Queue a job to check subdirectory 'subDir' unless it was not read
+	 * at all (on request only, read error).
+	 **/
+	void addVerifyJob( DirInfo * subDir, bool full );
+
+
+	bool _full;
+	bool _recursive;
+
+    };	// LocalDirVerifyJob
+
+
+
     class CacheReadJob: public ObjDirReadJob
     {
 	Q_OBJECT
@@ -258,7 +479,8 @@ namespace QDirStat
 		      CacheReader * reader );
 
 	/**
-	 * Constructor that uses a cache file that is not open yet.
+	 * Constructor that uses a cache file that is not open yet. This may
+	 * be a text or a binary cache file.
 	 *
 	 * If 'parent' is 0, the content of the cache file will replace all
 	 * current tree items.
@@ -280,10 +502,43 @@ namespace QDirStat
 	virtual void read();
 
 	/**
-	 * Return the associated cache reader.
+	 * Return the associated cache reader. This is 0 for a binary cache
+	 * file.
 	 **/
 	CacheReader * reader() const { return _reader; }
 
+	/**
+	 * Return the associated binary cache reader. This is 0 for a text
+	 * cache file.
+	 **/
+	BinaryCacheReader * binaryReader() const { return _binaryReader; }
+
+	/**
+	 * Return the absolute path of the first directory in the cache file
+	 * (text or binary). See CacheReader::firstDir().
+	 **/
+	QString firstDir();
+
+	/**
+	 * Reset the reader to read the cache file from the beginning.
+	 **/
+	void rewind();
+
+	/**
+	 * Set refresh mode: Check the directories from the cache file
+	 * against the directories on disk and read the changed ones from
+	 * disk. See CacheReader::setRefresh(). This has to be set before
+	 * the job is started.
+	 **/
+	void setRefresh( bool refresh );
+
+	/**
+	 * Read only the subtree 'path' of the cache file. See
+	 * CacheReader::setSubtree(). This is not supported for binary cache
+	 * files; they are always read completely.
+	 **/
+	void setSubtree( const QString & path );
+
 
     protected:
 
@@ -293,16 +548,175 @@ namespace QDirStat
 	void init();
 
 
-	CacheReader * _reader;
+	CacheReader *	    _reader;
+	BinaryCacheReader * _binaryReader;
 
     };	// class CacheReadJob
 
 
 
+    /**
+     * Job that reads several text cache files into one tree at the same
+     * time, e.g. the shards of one directory tree that were scanned on
+     * different machines in parallel (qdirstat-scan -s). Each shard has
+     * the same toplevel directory, but different subtrees below it; they
+     * are all merged into one toplevel directory (see CacheReader).
+     *
+     * All cache files are decompressed and parsed in parallel in the parser
+     * threads of their readers; the items are added to the tree in turns
+     * in the main thread.
+     **/
+    class MergeCacheReadJob: public ObjDirReadJob
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor. Binary cache files are not supported here.
+	 **/
+	MergeCacheReadJob( DirTree *	       tree,
+			   const QStringList & cacheFileNames );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~MergeCacheReadJob();
+
+	/**
+	 * Read the next part of each cache file.
+	 *
+	 * Inherited and reimplemented from @ref DirReadJob.
+	 **/
+	virtual void read();
+
+    protected:
+
+	QList<CacheReader *> _readers;
+
+    };	// class MergeCacheReadJob
+
+
+
+    /**
+     * Job that reads a directory tree on another machine: It starts
+     * "qdirstat --scan-to-cache <dir> -" there with ssh, and that scan
+     * agent streams the cache file format to its stdout. This job reads it
+     * from the pipe as it arrives, so the tree builds up while the remote
+     * machine is still scanning - without any intermediate file and
+     * without an X server on the remote machine.
+     *
+     * The remote machine needs the qdirstat binary (see
+     * setRemoteCommand()), and ssh must work without a password prompt
+     * (e.g. with ssh-agent) since there is no terminal for it.
+     **/
+    class RemoteDirReadJob: public CacheReadJob
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor. This starts the scan agent for directory 'dirName'
+	 * on 'host' (anything that ssh accepts, e.g. "user@host").
+	 **/
+	RemoteDirReadJob( DirTree *	  tree,
+			  const QString & host,
+			  const QString & dirName );
+
+	/**
+	 * Destructor. This stops the scan agent if it is still running.
+	 **/
+	virtual ~RemoteDirReadJob();
+
+	/**
+	 * Return the command that starts the scan agent on the remote
+	 * machine. The default is "qdirstat".
+	 **/
+	static QString remoteCommand();
+
+	/**
+	 * Set the command that starts the scan agent on the remote
+	 * machine, e.g. the full path of the qdirstat binary there.
+	 **/
+	static void setRemoteCommand( const QString & command );
+
+    protected:
+
+	/**
+	 * Start ssh with the scan agent. Return the file descriptor of its
+	 * stdout or -1 upon error.
+	 **/
+	int startAgent( const QString & host, const QString & dirName );
+
+	/**
+	 * Return 'arg' quoted for the shell on the remote machine.
+	 **/
+	static QString shellQuoted( const QString & arg );
+
+
+	pid_t	_pid;
+
+    };	// class RemoteDirReadJob
+
+
+
     /**
      * Queue for read jobs
      *
      * Handles time-sliced reading automatically.
+     *
+     * If a thread count greater than 1 is set, local directories are read
+     * by a pool of worker threads: The workers do the opendir() / readdir()
+     * / lstat() system calls, and the results are handed back to the main
+     * thread which creates the tree items and new read jobs. This keeps the
+     * main thread responsive and keeps several I/O requests in flight at
+     * the same time, which helps a lot on network file systems and on
+     * fast SSDs.
+     *
+     * The jobs are scheduled separately for each device: Each one has its
+     * own queue, and the devices take turns. With worker threads, each
+     * device may use up to threadCount() of them, independent of all
+     * others, so a slow network mount doesn't keep a fast local disk
+     * waiting.
+     *
+     * The queues of all trees share one pool of worker threads. While
+     * several trees are read at the same time, each of them gets an equal
+     * share of threadCount() for each device (see workerLimit()), so one
+     * big scan doesn't starve the others.
+     *
+     * Apart from that pool, this is what the trees that are read at the
+     * same time share:
+     *
+     * - The list of the queues that are reading right now: Only used in
+     *   the main thread, by workerLimit() and to reset the statistics
+     *   when the first queue starts reading.
+     *
+     * - ScanStats and ScanThrottle: For all trees together; both are
+     *   protected by a mutex since the workers use them, too.
+     *
+     * - The singletons that the trees and their views use: DataColumns
+     *   (only in the main thread) and CacheBudget (also from the thread
+     *   that deletes subtrees in the background, so it has a mutex).
+     *
+     * Everything else belongs to one tree. Each queue waits only for its
+     * own workers when it is deleted (see DirReadWorkerCount).
+     *
+     * Within each device, the jobs are read in the order they were added
+     * (breadth first) or newest first (depth first; see setDepthFirst()).
+     * Jobs for the subtree of the priority directory (see
+     * setPriorityDir()) come before all others.
+     *
+     * Directories that are added with enqueueDir() don't get a job object
+     * until they are almost due; only a few jobs per device are kept
+     * ready. If very many directories are waiting, the newest ones are
+     * read first even when reading breadth first, so the queue doesn't
+     * grow without bounds.
+     *
+     * Each time slice reads jobs until about 10 milliseconds are used up.
+     * A job that is only partly done (a large directory without worker
+     * threads or a cache file) is continued in the next time slice before
+     * any other job.
      **/
     class DirReadJobQueue: public QObject
     {
@@ -326,6 +740,14 @@ namespace QDirStat
 	 **/
 	void enqueue( DirReadJob * job );
 
+	/**
+	 * Add reading directory 'dir' from disk to the queue. This is the
+	 * same as enqueuing a new LocalDirReadJob for 'dir', but the job is
+	 * only created when it is almost due, so millions of waiting
+	 * directories don't need millions of job objects.
+	 **/
+	void enqueueDir( DirInfo * dir );
+
 	/**
 	 * Remove the head of the queue and return it.
 	 **/
@@ -339,12 +761,18 @@ namespace QDirStat
 	/**
 	 * Count the number of pending jobs in the queue.
 	 **/
-	int count() const   { return _queue.count(); }
+	int count() const   { return _queue.count() + _pendingDirCount; }
 
 	/**
 	 * Check if the queue is empty.
 	 **/
-	bool isEmpty() const { return _queue.isEmpty(); }
+	bool isEmpty() const { return count() == 0; }
+
+	/**
+	 * Return 'true' if there is a job for reading a cache file in the
+	 * queue.
+	 **/
+	bool isReadingCache() const;
 
 	/**
 	 * Clear the queue: Remove all pending jobs from the queue and destroy them.
@@ -368,6 +796,74 @@ namespace QDirStat
 	 **/
 	void jobFinishedNotify( DirReadJob *job );
 
+	/**
+	 * Set the number of worker threads for reading local directories.
+	 * 1 (or less) means no worker threads: Read everything in the main
+	 * thread.
+	 **/
+	void setThreadCount( int threadCount );
+
+	/**
+	 * Return the number of worker threads for reading local directories.
+	 * This is the limit for each device.
+	 **/
+	int threadCount() const { return _threadCount; }
+
+	/**
+	 * Return the number of worker threads that may read each device
+	 * right now: The worker threads are in one pool for the queues of
+	 * all trees, and the trees that are read at the same time take
+	 * turns with equal shares of threadCount().
+	 **/
+	int workerLimit() const;
+
+	/**
+	 * Return the pool of worker threads that all queues share.
+	 **/
+	static QThreadPool * threadPool();
+
+	/**
+	 * Return 'true' if worker threads are used for reading local
+	 * directories.
+	 **/
+	bool isThreaded() const { return _threadCount > 1; }
+
+	/**
+	 * Return 'true' if the newest jobs are read first, i.e. the tree is
+	 * read depth first. This keeps fewer jobs in the queue, and the
+	 * directories that are read one after another are usually close
+	 * together on disk.
+	 **/
+	bool depthFirst() const { return _depthFirst; }
+
+	/**
+	 * Read depth first (newest jobs first) or breadth first (oldest jobs
+	 * first).
+	 **/
+	void setDepthFirst( bool depthFirst ) { _depthFirst = depthFirst; }
+
+	/**
+	 * Return the directory whose subtree is read first or 0 if there is
+	 * none.
+	 **/
+	DirInfo * priorityDir() const { return _priorityDir; }
+
+	/**
+	 * Read the subtree of 'dir' before anything else, e.g. because the
+	 * user is looking at it right now. 0 means no priority. 'dir' must
+	 * remain valid until it is set to something else (or the queue is
+	 * cleared).
+	 **/
+	void setPriorityDir( DirInfo * dir );
+
+	/**
+	 * Start a worker thread that fills 'result'. The queue takes over
+	 * ownership of 'result'; it will be passed to
+	 * LocalDirReadJob::processResult() in the main thread when it is
+	 * ready.
+	 **/
+	void startWorker( DirReadResult * result );
+
     signals:
 
 	/**
@@ -387,8 +883,8 @@ namespace QDirStat
 
 	/**
 	 * Time-sliced work procedure to be performed while the application is
-	 * in the main loop: Read some directory entries, but relinquish
-	 * control back to the application so it can maintain some
+	 * in the main loop: Read directories for a few milliseconds, but
+	 * relinquish control back to the application so it can maintain some
 	 * responsiveness. This method uses a timer of minimal duration to
 	 * activate itself as soon as there are no more user events to
 	 * process. Call this only once directly after inserting a read job
@@ -396,11 +892,108 @@ namespace QDirStat
 	 **/
 	void timeSlicedRead();
 
+	/**
+	 * Notification that a worker thread is done. The sender() is the
+	 * DirReadResult.
+	 **/
+	void workerDone();
+
 
     protected:
 
-	QList<DirReadJob *>  _queue;
-	QTimer		     _timer;
+	/**
+	 * Return the next job to read() or 0 if there is none right now:
+	 * The first one of the next device in turn that has a job that is
+	 * not waiting for a worker thread, and that doesn't use all its
+	 * worker threads yet.
+	 **/
+	DirReadJob * nextJob();
+
+	/**
+	 * Return the first job in 'jobs' (or the last one if depthFirst())
+	 * that can be read right now or 0 if there is none.
+	 **/
+	DirReadJob * firstRunnable( const QList<DirReadJob *> & jobs ) const;
+
+	/**
+	 * Return 'true' if 'job' belongs to the subtree of the priority
+	 * directory.
+	 **/
+	bool isPriorityJob( DirReadJob * job ) const;
+
+	/**
+	 * Remove 'job' from the queue of its device and from the priority
+	 * jobs.
+	 **/
+	void removeFromDevice( DirReadJob * job );
+
+	/**
+	 * Remove 'device' from the round robin if it has neither jobs nor
+	 * waiting directories anymore.
+	 **/
+	void removeDeviceIfIdle( dev_t device );
+
+	/**
+	 * Add this queue to the queues that share the worker threads or
+	 * remove it when it is no longer reading.
+	 **/
+	void setActive( bool active );
+
+	/**
+	 * Start the timer for time-sliced reading if it isn't running yet.
+	 **/
+	void wakeUp();
+
+	/**
+	 * Add 'dir' to the waiting directories of its device or to the
+	 * waiting priority directories.
+	 **/
+	void addPendingDir( DirInfo * dir );
+
+	/**
+	 * Take the next directory from 'dirs': The newest one when reading
+	 * depth first or when there are too many waiting directories, the
+	 * oldest one otherwise.
+	 **/
+	DirInfo * takePendingDir( QList<DirInfo *> & dirs );
+
+	/**
+	 * Create a read job for the waiting directory 'dir' and add it to
+	 * the queue.
+	 **/
+	void createJob( DirInfo * dir );
+
+	/**
+	 * Create jobs for the waiting directories of 'device' until it has
+	 * enough to keep its worker threads busy.
+	 **/
+	void fillJobs( dev_t device );
+
+	/**
+	 * Forget the waiting directories in 'subtree' or all of them if
+	 * 'subtree' is 0.
+	 **/
+	void removePendingDirs( DirInfo * subtree );
+
+
+	QList<DirReadJob *>	_queue;
+	QTimer			_timer;
+	int			_threadCount;
+	DirReadWorkerCount	_runningWorkers;	// Also cancelled ones
+	QHash<DirReadResult *, dev_t> _pendingResults;
+
+	QHash<dev_t, QList<DirReadJob *> > _deviceJobs;
+	QHash<DirReadJob *, dev_t>	   _jobDevice;
+	QHash<dev_t, int>		   _busyWorkers;
+	QList<dev_t>			   _deviceOrder;	// Round robin
+	int				   _nextDevice;
+	bool				   _depthFirst;
+	DirInfo *			   _priorityDir;
+	QList<DirReadJob *>		   _priorityJobs;
+	QHash<dev_t, QList<DirInfo *> >	   _pendingDirs;	// No jobs yet
+	QList<DirInfo *>		   _priorityDirs;	// No jobs yet
+	int				   _pendingDirCount;
+	DirReadJob *			   _currentJob;		// Read last
     };
 
 
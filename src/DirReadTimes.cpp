@@ -0,0 +1,176 @@
+/*
+ *   File name: DirReadTimes.cpp
+ *   Summary:	How long reading each directory took
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include "DirReadTimes.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+DirReadTimes::DirReadTimes( DirTree * tree ):
+    QObject( tree ),
+    _tree( tree )
+{
+    CHECK_PTR( _tree );
+
+    connect( _tree,   SIGNAL( deletingChild  ( FileInfo * ) ),
+	     this,    SLOT  ( deletingChild  ( FileInfo * ) ) );
+
+    connect( _tree,   SIGNAL( clearingSubtree( DirInfo *  ) ),
+	     this,    SLOT  ( clearingSubtree( DirInfo *  ) ) );
+
+    connect( _tree,   SIGNAL( clearing() ),
+	     this,    SLOT  ( clear()	 ) );
+}
+
+
+DirReadTimes::~DirReadTimes()
+{
+}
+
+
+void DirReadTimes::add( DirInfo * dir, qint64 nsec, int entries )
+{
+    if ( ! dir )
+	return;
+
+    qint64 usec = nsec / 1000;
+
+    DirReadTime & readTime = _times[ dir ];
+    readTime.usec    = (quint32) qBound( 0LL, usec, (qint64) 0xFFFFFFFFLL );
+    readTime.entries = (quint32) qMax( 0, entries );
+
+    if ( _slowest.size() >= SLOWEST_DIRS && usec <= _slowest.last().usec )
+	return;
+
+    // Only now it is worthwhile to build the URL
+
+    SlowDir slowDir;
+    slowDir.url	    = dir->url();
+    slowDir.usec    = usec;
+    slowDir.entries = entries;
+
+    for ( int i=0; i < _slowest.size(); ++i )
+    {
+	if ( _slowest.at( i ).url == slowDir.url )	// Read again
+	{
+	    _slowest.removeAt( i );
+	    break;
+	}
+    }
+
+    int pos = 0;
+
+    while ( pos < _slowest.size() && _slowest.at( pos ).usec >= usec )
+	++pos;
+
+    _slowest.insert( pos, slowDir );
+
+    while ( _slowest.size() > SLOWEST_DIRS )
+	_slowest.removeLast();
+}
+
+
+bool DirReadTimes::contains( FileInfo * item ) const
+{
+    return item && item->isDirInfo() && _times.contains( item->toDirInfo() );
+}
+
+
+DirReadTime DirReadTimes::readTime( FileInfo * item ) const
+{
+    if ( ! item || ! item->isDirInfo() )
+	return DirReadTime();
+
+    return _times.value( item->toDirInfo() );
+}
+
+
+void DirReadTimes::logSlowest( int count ) const
+{
+    if ( _slowest.isEmpty() )
+	return;
+
+    logInfo() << "Slowest directories:" << endl;
+
+    for ( int i=0; i < _slowest.size() && i < count; ++i )
+    {
+	const SlowDir & slowDir = _slowest.at( i );
+
+	logInfo() << "  " << formatReadTime( slowDir.usec )
+		  << " for " << slowDir.entries << " entries: "
+		  << slowDir.url << endl;
+    }
+}
+
+
+QString DirReadTimes::formatReadTime( qint64 usec )
+{
+    if ( usec < 1000 )
+	return QString( "%1 us" ).arg( usec );
+
+    if ( usec < 1000000 )
+	return QString( "%1 ms" ).arg( usec / 1000.0, 0, 'f', 1 );
+
+    return QString( "%1 sec" ).arg( usec / 1000000.0, 0, 'f', 2 );
+}
+
+
+void DirReadTimes::clear()
+{
+    _times.clear();
+    _slowest.clear();
+}
+
+
+void DirReadTimes::deletingChild( FileInfo * child )
+{
+    if ( ! child || ! child->isDirInfo() || _times.isEmpty() )
+	return;
+
+    _times.remove( child->toDirInfo() );
+    removeChildren( child );
+
+    // This is gone for good, so it is not one of the slowest anymore
+
+    QString url	   = child->url();
+    QString prefix = url + "/";
+
+    for ( int i = _slowest.size() - 1; i >= 0; --i )
+    {
+	const QString & slowUrl = _slowest.at( i ).url;
+
+	if ( slowUrl == url || slowUrl.startsWith( prefix ) )
+	    _slowest.removeAt( i );
+    }
+}
+
+
+void DirReadTimes::clearingSubtree( DirInfo * subtree )
+{
+    if ( subtree && ! _times.isEmpty() )
+	removeChildren( subtree );
+}
+
+
+void DirReadTimes::removeChildren( FileInfo * subtree )
+{
+    for ( FileInfo * child = subtree->firstChild(); child; child = child->next() )
+    {
+	if ( child->isDirInfo() && ! child->isDotEntry() )
+	{
+	    _times.remove( child->toDirInfo() );
+	    removeChildren( child );
+	}
+    }
+}
@@ -0,0 +1,163 @@
+/*
+ *   File name: DirReadTimes.h
+ *   Summary:	How long reading each directory took
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef DirReadTimes_h
+#define DirReadTimes_h
+
+
+#include <QObject>
+#include <QString>
+#include <QHash>
+#include <QList>
+
+
+#define SLOWEST_DIRS	100
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class DirInfo;
+    class FileInfo;
+
+
+    /**
+     * How long reading one directory took and how many entries it had.
+     **/
+    struct DirReadTime
+    {
+	DirReadTime():
+	    usec( 0 ),
+	    entries( 0 )
+	    {}
+
+	quint32 usec;		// Up to 71 minutes; longer is cut off
+	quint32 entries;
+    };
+
+
+    /**
+     * One of the slowest directories.
+     **/
+    struct SlowDir
+    {
+	QString url;
+	qint64	usec;
+	int	entries;
+    };
+
+
+    /**
+     * Per-directory instrumentation for reading directory trees: How long
+     * the system calls and creating the nodes took for each directory that
+     * was read from disk. A slow scan is usually caused by a few
+     * pathological directories (huge mail directories, hanging network
+     * mounts); this finds them so they can be excluded or fixed.
+     *
+     * This is optional (see DirTree::setRecordReadTimes()). Only a few
+     * bytes are added for each directory in a hash; the SLOWEST_DIRS
+     * slowest ones are also kept by URL so they survive refreshing or
+     * compacting (see ColdSubtree) their parents.
+     *
+     * Everything happens in the main thread.
+     **/
+    class DirReadTimes: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor. This is a child of 'tree'.
+	 **/
+	DirReadTimes( DirTree * tree );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~DirReadTimes();
+
+	/**
+	 * Record that reading directory 'dir' with 'entries' entries took
+	 * 'nsec' nanoseconds.
+	 **/
+	void add( DirInfo * dir, qint64 nsec, int entries );
+
+	/**
+	 * Return 'true' if there is a read time for 'item'.
+	 **/
+	bool contains( FileInfo * item ) const;
+
+	/**
+	 * Return the read time of 'item' or an empty one if there is none.
+	 **/
+	DirReadTime readTime( FileInfo * item ) const;
+
+	/**
+	 * Return the number of directories with a read time.
+	 **/
+	int count() const { return _times.size(); }
+
+	/**
+	 * Return the slowest directories, the slowest first.
+	 **/
+	const QList<SlowDir> & slowest() const { return _slowest; }
+
+	/**
+	 * Write the 'count' slowest directories to the log.
+	 **/
+	void logSlowest( int count = 10 ) const;
+
+	/**
+	 * Format a read time in microseconds human-readable.
+	 **/
+	static QString formatReadTime( qint64 usec );
+
+
+    public slots:
+
+	/**
+	 * Drop everything.
+	 **/
+	void clear();
+
+
+    protected slots:
+
+	/**
+	 * Drop the read times of a deleted subtree.
+	 **/
+	void deletingChild( FileInfo * child );
+
+	/**
+	 * Drop the read times of a subtree that is cleared, e.g. for
+	 * refreshing or compacting it. The slowest directories stay.
+	 **/
+	void clearingSubtree( DirInfo * subtree );
+
+
+    protected:
+
+	/**
+	 * Remove the read times of everything below 'subtree' from the hash.
+	 **/
+	void removeChildren( FileInfo * subtree );
+
+
+	// Data members
+
+	DirTree *			_tree;
+	QHash<DirInfo *, DirReadTime>	_times;
+	QList<SlowDir>			_slowest;	// Slowest first
+    };
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef DirReadTimes_h
@@ -0,0 +1,146 @@
+/*
+ *   File name: DirReadWorker.cpp
+ *   Summary:	Worker thread support for directory reading
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include "DirReadWorker.h"
+#include "DirReadJob.h"
+#include "ScanThrottle.h"
+#include "ScanStats.h"
+
+using namespace QDirStat;
+
+
+QString QDirStat::scanBackendName( LocalScanBackend backend )
+{
+    switch ( backend )
+    {
+	case LstatScanBackend:	 return "lstat";
+	case IoUringScanBackend: return "io_uring";
+    }
+
+    return "lstat";
+}
+
+
+LocalScanBackend QDirStat::scanBackendFromName( const QString & name )
+{
+    if ( name == "io_uring" )
+	return IoUringScanBackend;
+
+    return LstatScanBackend;
+}
+
+
+
+
+DirReadResult::DirReadResult( LocalDirReadJob * job,
+			      const QString   & dirName,
+			      bool		deferFileStat,
+			      LocalScanBackend	backend ):
+    QObject(),
+    _job( job ),
+    _dirName( dirName ),
+    _status( LocalDirReadOk ),
+    _deferFileStat( deferFileStat ),
+    _statOnly( false ),
+    _backend( backend ),
+    _nsec( 0 )
+{
+}
+
+
+DirReadResult::DirReadResult( LocalDirReadJob	      * job,
+			      const QString	      & dirName,
+			      const LocalDirEntryList & entries,
+			      LocalScanBackend	        backend ):
+    QObject(),
+    _job( job ),
+    _dirName( dirName ),
+    _status( LocalDirReadOk ),
+    _entries( entries ),
+    _deferFileStat( false ),
+    _statOnly( true ),
+    _backend( backend ),
+    _nsec( 0 )
+{
+}
+
+
+DirReadResult::~DirReadResult()
+{
+}
+
+
+void DirReadResult::readEntries()
+{
+    qint64 startNsec = ScanStats::now();
+
+    if ( _statOnly )
+	LocalDirReadJob::statEntries( _dirName, _entries, _backend );
+    else
+	_status = LocalDirReadJob::readEntries( _dirName, _entries, _deferFileStat, _backend );
+
+    _nsec = ScanStats::now() - startNsec;
+}
+
+
+
+
+void DirReadWorkerCount::started()
+{
+    QMutexLocker locker( &_mutex );
+    ++_count;
+}
+
+
+void DirReadWorkerCount::done()
+{
+    QMutexLocker locker( &_mutex );
+
+    if ( --_count == 0 )
+	_allDone.wakeAll();
+}
+
+
+void DirReadWorkerCount::waitForAll()
+{
+    QMutexLocker locker( &_mutex );
+
+    while ( _count > 0 )
+	_allDone.wait( &_mutex );
+}
+
+
+
+
+DirReadWorker::DirReadWorker( DirReadResult * result, DirReadWorkerCount * running ):
+    QRunnable(),
+    _result( result ),
+    _running( running )
+{
+    setAutoDelete( true );
+}
+
+
+DirReadWorker::~DirReadWorker()
+{
+}
+
+
+void DirReadWorker::run()
+{
+    ScanThrottle::instance()->workerStarted();
+    _result->readEntries();
+    _result->sendDone();
+
+    // Don't touch _result after this: It is deleted in the main thread
+    // when the done() signal arrives. The queue waits for this before it
+    // is deleted.
+
+    _running->done();
+}
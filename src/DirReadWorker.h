@@ -0,0 +1,270 @@
+/*
+ *   File name: DirReadWorker.h
+ *   Summary:	Worker thread support for directory reading
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef DirReadWorker_h
+#define DirReadWorker_h
+
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <QObject>
+#include <QRunnable>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QString>
+#include <QVector>
+
+
+namespace QDirStat
+{
+    class LocalDirReadJob;
+
+
+    /**
+     * Status of reading one directory from disk.
+     **/
+    enum LocalDirReadStatus
+    {
+	LocalDirReadOk,		// Directory read successfully
+	LocalDirNoPermission,	// access() failed
+	LocalDirOpenFailed	// opendir() failed
+    };
+
+
+    /**
+     * System call backend for reading local directories.
+     **/
+    enum LocalScanBackend
+    {
+	LstatScanBackend,	// One fstatat() call per entry
+	IoUringScanBackend	// Batches of statx() requests via io_uring
+    };
+
+
+    /**
+     * Return the name of a scan backend for the config file and the
+     * command line: "lstat" or "io_uring".
+     **/
+    QString scanBackendName( LocalScanBackend backend );
+
+    /**
+     * Return the scan backend with name 'name' or LstatScanBackend if
+     * there is no such backend.
+     **/
+    LocalScanBackend scanBackendFromName( const QString & name );
+
+
+    /**
+     * Raw information about one directory entry as obtained from the
+     * system calls. This does not create any FileInfo or DirInfo yet, so it
+     * can safely be collected in a worker thread.
+     **/
+    struct LocalDirEntry
+    {
+	QString	      name;
+	struct stat   statInfo;
+	int	      statErrno;   // 0 if lstat() was successful
+	unsigned char type;	   // d_type from readdir()
+	bool	      statPending; // 'true' if not stat()ed yet
+    };
+
+    typedef QVector<LocalDirEntry> LocalDirEntryList;
+
+
+    /**
+     * Result of reading one directory in a worker thread.
+     *
+     * Objects of this class live in the main thread. The worker only fills
+     * in the entries and then sends the done() signal which is delivered
+     * through a queued connection. All tree operations (creating FileInfo
+     * and DirInfo objects, inserting them into the tree, creating new read
+     * jobs) happen in the main thread when that signal arrives.
+     *
+     * If the read job that requested this result is destroyed while the
+     * worker is still busy, the result is cancelled; it will then simply be
+     * discarded when it arrives.
+     **/
+    class DirReadResult: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor for reading directory 'dirName'. If 'deferFileStat'
+	 * is 'true', only subdirectories (and entries of unknown type) are
+	 * stat()ed; see LocalDirReadJob::readEntries().
+	 **/
+	DirReadResult( LocalDirReadJob * job,
+		       const QString   & dirName,
+		       bool		 deferFileStat = false,
+		       LocalScanBackend	 backend       = LstatScanBackend );
+
+	/**
+	 * Constructor for only stat()ing the pending entries of 'entries'
+	 * that were previously read from directory 'dirName'.
+	 **/
+	DirReadResult( LocalDirReadJob	       * job,
+		       const QString	       & dirName,
+		       const LocalDirEntryList & entries,
+		       LocalScanBackend		 backend = LstatScanBackend );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~DirReadResult();
+
+	/**
+	 * Return the job that requested this result or 0 if it was
+	 * cancelled.
+	 **/
+	LocalDirReadJob * job() const { return _job; }
+
+	/**
+	 * Cancel this result: The requesting job is no longer interested.
+	 * Call this only from the main thread.
+	 **/
+	void cancel() { _job = 0; }
+
+	/**
+	 * Return the name of the directory to read.
+	 **/
+	const QString & dirName() const { return _dirName; }
+
+	/**
+	 * Return the status of reading the directory.
+	 **/
+	LocalDirReadStatus status() const { return _status; }
+
+	/**
+	 * Return the entries read from the directory.
+	 **/
+	LocalDirEntryList & entries() { return _entries; }
+
+	/**
+	 * Return the nanoseconds that readEntries() took.
+	 **/
+	qint64 nsec() const { return _nsec; }
+
+	/**
+	 * Read the directory or stat() the pending entries, depending on the
+	 * constructor. This is called in the worker thread.
+	 **/
+	void readEntries();
+
+	/**
+	 * Send the done() signal. This is called in the worker thread.
+	 **/
+	void sendDone() { emit done(); }
+
+    signals:
+
+	/**
+	 * Emitted when reading the directory is finished.
+	 **/
+	void done();
+
+    protected:
+
+	LocalDirReadJob *   _job;
+	QString		    _dirName;
+	LocalDirReadStatus  _status;
+	LocalDirEntryList   _entries;
+	bool		    _deferFileStat;
+	bool		    _statOnly;
+	LocalScanBackend    _backend;
+	qint64		    _nsec;
+
+    };	// class DirReadResult
+
+
+
+    /**
+     * The number of DirReadWorkers that are still busy for one
+     * DirReadJobQueue, so the queue can wait for them before it is
+     * deleted: The workers of all queues are in one thread pool, so
+     * QThreadPool::waitForDone() would wait for the other trees, too.
+     **/
+    class DirReadWorkerCount
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	DirReadWorkerCount(): _count( 0 ) {}
+
+	/**
+	 * A worker is about to start. Call this in the main thread.
+	 **/
+	void started();
+
+	/**
+	 * A worker is done. Call this in the worker thread as the very last
+	 * thing it does.
+	 **/
+	void done();
+
+	/**
+	 * Wait until all workers are done.
+	 **/
+	void waitForAll();
+
+    protected:
+
+	QMutex		_mutex;
+	QWaitCondition	_allDone;
+	int		_count;
+
+    };	// class DirReadWorkerCount
+
+
+
+    /**
+     * Runnable for a QThreadPool that reads one directory into a
+     * DirReadResult.
+     *
+     * The thread pool takes ownership of this object and deletes it when
+     * it is done; the result is owned by the DirReadJobQueue.
+     **/
+    class DirReadWorker: public QRunnable
+    {
+    public:
+
+	/**
+	 * Constructor. 'running' is told when the worker is done with
+	 * 'result', so the queue can wait for its own workers in a pool that
+	 * is shared with other queues.
+	 **/
+	DirReadWorker( DirReadResult * result, DirReadWorkerCount * running );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~DirReadWorker();
+
+	/**
+	 * Do the work. This is called in a worker thread.
+	 *
+	 * Reimplemented from QRunnable.
+	 **/
+	virtual void run() Q_DECL_OVERRIDE;
+
+    protected:
+
+	DirReadResult * _result;
+	DirReadWorkerCount * _running;
+
+    };	// class DirReadWorker
+
+}	// namespace QDirStat
+
+
+#endif // ifndef DirReadWorker_h
@@ -7,14 +7,40 @@
  */
 
 
+#include <stdio.h>	// rename()
+
 #include <QDir>
+#include <QTimer>
 #include <QFileInfo>
+#include <QFile>
 
 #include "DirTree.h"
 #include "FileInfoSet.h"
 #include "Exception.h"
 #include "DirTreeCache.h"
+#include "CacheSnapshot.h"
+#include "BinaryCache.h"
 #include "MountPoints.h"
+#include "MimeCategorizer.h"
+#include "SuffixIndex.h"
+#include "DirTreeWatcher.h"
+#include "NameIndex.h"
+#include "CacheDiff.h"
+#include "ExtentStats.h"
+#include "DirReadTimes.h"
+#include "QuotaEstimates.h"
+#include "ScanStats.h"
+#include "InodeSet.h"
+#include "NodePool.h"
+#include "ColdSubtree.h"
+#include "TreeSnapshot.h"
+#include "ScanMetrics.h"
+#include "CacheBudget.h"
+
+
+// Compact cold subtrees this long after reading is finished, so the user
+// has a chance to open the interesting ones first
+#define COLD_SUBTREE_DELAY_MILLISEC	10000
 
 using namespace QDirStat;
 
@@ -24,18 +50,70 @@ DirTree::DirTree()
 {
     _isBusy           = false;
     _crossFileSystems = false;
+    _fastScan	      = false;
+    _lazySummaries    = false;
+    _aggregateOnly    = false;
+    _compactColdSubtrees = false;
+    _countOwners      = true;
+    _ownerTotalsDirty = false;
+    _precomputeStats  = false;
+    _precomputedStatsDirty = false;
+    _compactChildren  = false;
+    _childColumns     = false;
+    _deferChildArrays = false;
+    _scanBackend      = LstatScanBackend;
+    _writeCacheIndex  = false;
+    _cacheWriterThread = 0;
+    _autoCachePending = false;
+    _generation	      = 0;
+    _mimeCategoryStamp = 0;
+    _mimeCategorizer  = 0;
+    _typeSummaries    = false;
+    _suffixIndex      = 0;
+    _nameIndex	      = 0;
+    _cacheDiff	      = 0;
+    _extentStats      = 0;
+    _readTimes	      = 0;
+    _metrics	      = 0;
+    _quotaEstimates   = 0;
+    _inodeSet	      = 0;
+    _watcher	      = 0;
+    _reclaimPending   = false;
+    _deletePool.setMaxThreadCount( 1 );
     _root = new DirInfo( this );
     CHECK_NEW( _root );
 
     connect( & _jobQueue, SIGNAL( finished()	 ),
 	     this,	  SLOT	( slotFinished() ) );
+
+    connect( this,		SIGNAL( startingReading()  ),
+	     this,		SLOT  ( startCheckpoints() ) );
+
+    connect( this,		SIGNAL( startingReading()  ),
+	     this,		SLOT  ( startMetrics()	   ) );
+
+    connect( &_checkpointTimer, SIGNAL( timeout()    ),
+	     this,		SLOT  ( checkpoint() ) );
 }
 
 
 DirTree::~DirTree()
 {
+    _jobQueue.clear();	// The jobs refer to the nodes of the tree
+
+    foreach ( TreeSnapshot * snapshot, _snapshots )
+	snapshot->detach();
+
+    _snapshots.clear();
+    _deletePool.waitForDone();
+    delete _cacheWriterThread;	// This waits until the file is written
+
     if ( _root )
 	delete _root;
+
+    delete _inodeSet;
+    delete _metrics;
+    NodePool::reclaim();
 }
 
 
@@ -43,12 +121,16 @@ void DirTree::setRoot( DirInfo *newRoot )
 {
     if ( _root )
     {
+	treeChanged( 0 );
 	emit deletingChild( _root );
 	delete _root;
 	emit childDeleted();
+	scheduleReclaim();
     }
 
     _root = newRoot;
+    dropOwnerTotals();
+    dropPrecomputedStats();
 }
 
 
@@ -78,12 +160,77 @@ void DirTree::clear()
 
     if ( _root )
     {
+	treeChanged( 0 );
 	emit clearing();
-	_root->clear();
+
+	if ( _root->hasChildren() )
+	    deleteInBackground( _root->detachChildren() );
+	else
+	    _root->clear();
     }
 
+    if ( _inodeSet )
+	_inodeSet->clear();
+
+    _ownerTotals.clear();
+    _ownerTotalsDirty = false;
+    _precomputedStats.clear();
+    _precomputedStatsDirty = false;
+
+    clearCacheDiff();
     _isBusy = false;
+    _autoCachePending = false;
+    _scanProgress.clear();
     _device.clear();
+    _remoteHost.clear();
+}
+
+
+const OwnerTotals & DirTree::ownerTotals()
+{
+    if ( _ownerTotalsDirty || ! _countOwners )
+    {
+	// Collect them from the tree: No need to thaw cold subtrees, they
+	// keep their owner totals.
+
+	_ownerTotals.clear();
+
+	for ( FileInfo * toplevel = firstToplevel(); toplevel; toplevel = toplevel->next() )
+	    _ownerTotals.collect( toplevel );
+
+	_ownerTotalsDirty = false;
+    }
+
+    return _ownerTotals;
+}
+
+
+void DirTree::setPrecomputeStats( bool enable )
+{
+    if ( enable == _precomputeStats )
+	return;
+
+    // Whatever is in the tree now was not added up
+
+    _precomputeStats = enable;
+    dropPrecomputedStats();
+}
+
+
+const PrecomputedStats * DirTree::precomputedStats( FileInfo * subtree ) const
+{
+    if ( ! _precomputeStats || _precomputedStatsDirty || _isBusy || ! subtree )
+	return 0;
+
+    FileInfo * toplevel = firstToplevel();
+
+    if ( ! toplevel || toplevel->next() )
+	return 0;
+
+    if ( subtree != _root && subtree != toplevel )
+	return 0;
+
+    return &_precomputedStats;
 }
 
 
@@ -100,7 +247,10 @@ void DirTree::startReading( const QString & rawUrl )
     if ( _root->hasChildren() )
 	clear();
 
+    _remoteHost.clear();
     _isBusy = true;
+    _autoCachePending = ! _autoCacheFile.isEmpty();
+    _scanProgress.start( url, _crossFileSystems );
     emit startingReading();
 
     FileInfo * item = LocalDirReadJob::stat( url, this, _root );
@@ -112,6 +262,9 @@ void DirTree::startReading( const QString & rawUrl )
 
 	if ( item->isDirInfo() )
 	{
+	    if ( _quotaEstimates )
+		_quotaEstimates->check( item->toDirInfo(), url );
+
 	    addJob( new LocalDirReadJob( this, item->toDirInfo() ) );
 	    emit readJobFinished( _root );
 	}
@@ -157,6 +310,12 @@ void DirTree::refresh( DirInfo * subtree )
     if ( ! _root )
 	return;
 
+    if ( isRemote() )
+    {
+	logWarning() << "Can't refresh a tree from " << _remoteHost << endl;
+	return;
+    }
+
     if ( ! subtree->checkMagicNumber() )
     {
 	// Not using CHECK_MAGIC() here which would throw an exception since
@@ -188,8 +347,15 @@ void DirTree::refresh( DirInfo * subtree )
 
 	if ( subtree->hasChildren() )
 	{
+	    treeChanged( subtree );
 	    emit clearingSubtree( subtree );
-	    subtree->clear();
+	    dropOwnerTotals();
+	    dropPrecomputedStats();
+
+	    if ( readPriority() && readPriority()->isInSubtree( subtree ) )
+		_jobQueue.setPriorityDir( subtree );
+
+	    deleteInBackground( subtree->detachChildren() );
 	    emit subtreeCleared( subtree );
 	}
 
@@ -197,6 +363,8 @@ void DirTree::refresh( DirInfo * subtree )
 	subtree->setExcluded( false );
 
 	_isBusy = true;
+	_autoCachePending = ! _autoCacheFile.isEmpty();
+	_scanProgress.clear();	// Only for a complete filesystem
 	subtree->setReadState( DirReading );
 	emit startingReading();
 	addJob( new LocalDirReadJob( this, subtree ) );
@@ -204,6 +372,59 @@ void DirTree::refresh( DirInfo * subtree )
 }
 
 
+void DirTree::verify( const FileInfoSet & items, bool recursive )
+{
+    if ( ! _root || isRemote() )
+	return;
+
+    FileInfoSet dirs;
+
+    foreach ( FileInfo * item, items.invalidRemoved() )
+    {
+	DirInfo * dir = item->isDirInfo() ? item->toDirInfo() : item->parent();
+
+	if ( dir && dir->isDotEntry() )
+	    dir = dir->parent();
+
+	if ( dir && dir != _root )
+	    dirs << dir;
+    }
+
+    foreach ( FileInfo * item, dirs.normalized() )
+    {
+	DirInfo * dir = item->toDirInfo();
+
+	switch ( dir->readState() )
+	{
+	    case DirFinished:
+	    case DirCached:
+		break;
+
+	    case DirQueued:
+	    case DirReading:
+		logWarning() << "Not verifying " << dir << " while it is being read" << endl;
+		continue;
+
+	    default:
+		// Excluded, aborted, error: There is nothing to compare to.
+		refresh( dir );
+		continue;
+	}
+
+	if ( ! _isBusy )
+	{
+	    _isBusy = true;
+	    emit startingReading();
+	}
+
+	LocalDirVerifyJob * job = new LocalDirVerifyJob( this, dir, true );
+	CHECK_NEW( job );
+	job->setRecursive( recursive );
+	addJob( job );
+    }
+}
+
+
 void DirTree::abortReading()
 {
     if ( _jobQueue.isEmpty() )
@@ -212,6 +433,14 @@ void DirTree::abortReading()
     _jobQueue.abort();
 
     _isBusy = false;
+    _autoCachePending = false;
+
+    if ( _checkpointTimer.isActive() )
+    {
+	_checkpointTimer.stop();
+	writeCheckpoint();	// The aborted directories are marked as unread
+    }
+
     emit aborted();
 }
 
@@ -219,23 +448,489 @@ void DirTree::abortReading()
 void DirTree::slotFinished()
 {
     _isBusy = false;
+
+    if ( _checkpointTimer.isActive() )
+    {
+	_checkpointTimer.stop();
+	QFile::remove( _checkpointFile );
+    }
+
+    ScanStats::instance()->finish();
+    ScanStats::instance()->logSummary();
+
+    if ( _readTimes )
+	_readTimes->logSlowest();
+
+    if ( _metrics )
+    {
+	_metrics->readingFinished( this );
+	_metrics->write( _metricsFile );
+    }
+
     emit finished();
+
+    if ( _autoCachePending )
+    {
+	_autoCachePending = false;
+	writeCacheInBackground( _autoCacheFile );
+    }
+
+    if ( _compactColdSubtrees )
+	QTimer::singleShot( COLD_SUBTREE_DELAY_MILLISEC, this, SLOT( freezeColdSubtrees() ) );
+}
+
+
+int DirTree::freezeColdSubtrees( int minItems )
+{
+    if ( _isBusy || ! _root )
+	return 0;
+
+    // The views may still have pointers into subtrees that were never
+    // displayed in the tree view, e.g. the treemap tiles. Those subtrees
+    // are not cold, and deleting their nodes would leave them dangling.
+
+    UsedNodes usedNodes;
+    emit collectingUsedNodes( &usedNodes );
+
+    if ( usedNodes.busy )
+	return 0;
+
+    QSet<DirInfo *> used;
+
+    foreach ( FileInfo * node, usedNodes.nodes )
+    {
+	DirInfo * dir = node->isDirInfo() ? node->toDirInfo() : node->parent();
+
+	while ( dir && ! used.contains( dir ) )
+	{
+	    used.insert( dir );
+	    dir = dir->parent();
+	}
+    }
+
+    int count = 0;
+
+    for ( FileInfo * toplevel = _root->firstChild(); toplevel; toplevel = toplevel->next() )
+    {
+	if ( toplevel->isDirInfo() )
+	    count += freezeColdChildren( toplevel->toDirInfo(), minItems, used );
+    }
+
+    if ( count > 0 )
+    {
+	logInfo() << "Compacted " << count << " cold subtrees" << endl;
+	scheduleReclaim();
+    }
+
+    return count;
+}
+
+
+int DirTree::freezeColdChildren( DirInfo * dir, int minItems, const QSet<DirInfo *> & used )
+{
+    // Only the subdirectories of directories that were displayed can be
+    // cold: Anything below an untouched and unused one was never displayed
+    // either.
+
+    if ( dir->isCold() || ( ! dir->isTouched() && ! used.contains( dir ) ) )
+	return 0;
+
+    int count = 0;
+    FileInfo * child = dir->firstChild();
+
+    while ( child )
+    {
+	FileInfo * next = child->next();
+
+	if ( child->isDirInfo() && ! child->isDotEntry() )
+	{
+	    DirInfo * subDir = child->toDirInfo();
+
+	    if ( subDir->isTouched() || used.contains( subDir ) )
+		count += freezeColdChildren( subDir, minItems, used );
+	    else if ( ! subDir->isCold()   &&
+		      ! subDir->isLocked() &&
+		      ! subDir->isBusy()   &&
+		      ( subDir->readState() == DirFinished ||
+			subDir->readState() == DirCached ) &&
+		      subDir->totalItems() >= minItems )
+	    {
+		// Just like refreshing it, except that the totals stay
+
+		treeChanged( subDir );
+		emit clearingSubtree( subDir );
+		ColdSubtree * cold = new ColdSubtree( subDir );
+		CHECK_NEW( cold );
+
+		deleteInBackground( subDir->detachChildren() );
+		subDir->setColdSubtree( cold );
+		emit subtreeCleared( subDir );
+
+		++count;
+	    }
+	}
+
+	child = next;
+    }
+
+    return count;
+}
+
+
+void DirTree::thaw( FileInfo * subtree )
+{
+    if ( ! subtree )
+	subtree = _root;
+
+    if ( ! subtree || ! subtree->isDirInfo() )
+	return;
+
+    DirInfo * dir = subtree->toDirInfo();
+
+    if ( dir->isCold() )
+    {
+	dir->thaw();	// Nothing below it can be cold
+	return;
+    }
+
+    for ( FileInfo * child = dir->firstChild(); child; child = child->next() )
+    {
+	if ( child->isDirInfo() )
+	    thaw( child );
+    }
+}
+
+
+void DirTree::setCheckpoints( const QString & fileName, int seconds )
+{
+    _checkpointFile = fileName;
+    _checkpointTimer.setInterval( qMax( 0, seconds ) * 1000 );
+
+    if ( _checkpointFile.isEmpty() || seconds <= 0 )
+	_checkpointTimer.stop();
+    else if ( _isBusy && ! _checkpointTimer.isActive() )
+	_checkpointTimer.start();
+}
+
+
+void DirTree::startMetrics()
+{
+    if ( _metrics )
+	_metrics->readingStarted();
+}
+
+
+void DirTree::startCheckpoints()
+{
+    if ( ! _checkpointFile.isEmpty() && _checkpointTimer.interval() > 0 &&
+	 ! _checkpointTimer.isActive() )
+    {
+	_checkpointTimer.start();
+    }
+}
+
+
+void DirTree::checkpoint()
+{
+    // While a cache file is read, its directories are not finished yet,
+    // so they would all be marked as unread.
+
+    if ( _jobQueue.isReadingCache() )
+	return;
+
+    writeCheckpoint();
+}
+
+
+QString DirTree::defaultCheckpointFile()
+{
+    return QDir::homePath() + "/.qdirstat-checkpoint.cache.gz";
+}
+
+
+bool DirTree::writeCheckpoint()
+{
+    if ( _checkpointFile.isEmpty() || ! firstToplevel() )
+	return false;
+
+    // Write to a temporary file first: A crash while writing must not
+    // destroy the last checkpoint.
+
+    QString tmpName = _checkpointFile + ".new";
+    CacheWriter writer( tmpName, this );
+
+    if ( ! writer.ok() || ::rename( tmpName.toUtf8(), _checkpointFile.toUtf8() ) != 0 )
+    {
+	logError() << "Can't write checkpoint " << _checkpointFile << endl;
+	QFile::remove( tmpName );
+	return false;
+    }
+
+    logInfo() << "Checkpoint written to " << _checkpointFile << endl;
+
+    return true;
+}
+
+
+void DirTree::setMimeCategorizer( MimeCategorizer * categorizer )
+{
+    if ( categorizer == _mimeCategorizer )
+	return;
+
+    // The type summaries use the categories of the old categorizer
+
+    _root->dropTypeSummary( true ); // recursive
+    _mimeCategorizer = categorizer;
+}
+
+
+void DirTree::setTypeSummaries( bool enable )
+{
+    if ( ! enable )
+	_root->dropTypeSummary( true ); // recursive
+
+    _typeSummaries = enable;
+}
+
+
+MimeCategory * DirTree::mainCategory( FileInfo * item )
+{
+    MimeCategorizer * categorizer = typeSummaryCategorizer();
+
+    if ( ! categorizer || ! item )
+	return 0;
+
+    if ( item->isDirInfo() )
+	return item->toDirInfo()->mainCategory();
+
+    return item->isFile() ? categorizer->category( item ) : 0;
+}
+
+
+QString DirTree::mainCategoryName( FileInfo * item )
+{
+    if ( ! typeSummaryCategorizer() || ! item )
+	return QString();
+
+    MimeCategory * category = mainCategory( item );
+
+    if ( category )
+	return category->name();
+
+    if ( item->isDirInfo() )
+    {
+	const CategoryTotals * summary = item->toDirInfo()->typeSummary();
+
+	if ( ! summary || summary->isEmpty() )
+	    return QString();
+    }
+    else if ( ! item->isFile() )
+    {
+	return QString();
+    }
+
+    return tr( "Other" );
+}
+
+
+void DirTree::setCountHardLinksOnce( bool enable )
+{
+    if ( enable == countHardLinksOnce() )
+	return;
+
+    if ( enable )
+    {
+	_inodeSet = new InodeSet();
+	CHECK_NEW( _inodeSet );
+    }
+    else
+    {
+	delete _inodeSet;
+	_inodeSet = 0;
+    }
+}
+
+
+void DirTree::setWatchFileSystem( bool enable )
+{
+    if ( enable == watchFileSystem() )
+	return;
+
+    if ( enable )
+    {
+	_watcher = new DirTreeWatcher( this );	// Deleted as a child of this
+	CHECK_NEW( _watcher );
+    }
+    else
+    {
+	delete _watcher;
+	_watcher = 0;
+    }
+}
+
+
+void DirTree::setReadPriority( FileInfo * item )
+{
+    if ( item && item->tree() != this )
+	item = 0;
+
+    if ( item && ! item->isDirInfo() )
+	item = item->parent();
+
+    if ( item && item->isDotEntry() )
+	item = item->parent();
+
+    _jobQueue.setPriorityDir( item ? item->toDirInfo() : 0 );
+}
+
+
+SuffixIndex * DirTree::suffixIndex()
+{
+    if ( ! _suffixIndex )
+    {
+	_suffixIndex = new SuffixIndex( this );	// Deleted as a child of this
+	CHECK_NEW( _suffixIndex );
+    }
+
+    return _suffixIndex;
+}
+
+
+NameIndex * DirTree::nameIndex()
+{
+    if ( ! _nameIndex )
+    {
+	_nameIndex = new NameIndex( this );	// Deleted as a child of this
+	CHECK_NEW( _nameIndex );
+    }
+
+    return _nameIndex;
+}
+
+
+bool DirTree::compareWithCache( const QString & fileName )
+{
+    if ( ! _cacheDiff )
+    {
+	_cacheDiff = new CacheDiff( this );	// Deleted as a child of this
+	CHECK_NEW( _cacheDiff );
+    }
+
+    bool ok = _cacheDiff->load( fileName );
+
+    if ( ! ok )
+    {
+	delete _cacheDiff;
+	_cacheDiff = 0;
+    }
+
+    emit cacheDiffChanged();
+
+    return ok;
+}
+
+
+void DirTree::clearCacheDiff()
+{
+    if ( ! _cacheDiff )
+	return;
+
+    delete _cacheDiff;
+    _cacheDiff = 0;
+
+    emit cacheDiffChanged();
+}
+
+
+void DirTree::countExtents( FileInfo * subtree )
+{
+    if ( ! _extentStats )
+    {
+	_extentStats = new ExtentStats( this );	// Deleted as a child of this
+	CHECK_NEW( _extentStats );
+
+	connect( _extentStats, SIGNAL( finished()	    ),
+		 this,	       SIGNAL( extentStatsChanged() ) );
+
+	connect( _extentStats, SIGNAL( cleared()	    ),
+		 this,	       SIGNAL( extentStatsChanged() ) );
+    }
+
+    _extentStats->start( subtree );
+}
+
+
+void DirTree::setQuickEstimates( bool enable )
+{
+    if ( enable && ! _quotaEstimates )
+    {
+	_quotaEstimates = new QuotaEstimates( this );	// Deleted as a child of this
+	CHECK_NEW( _quotaEstimates );
+    }
+    else if ( ! enable && _quotaEstimates )
+    {
+	delete _quotaEstimates;
+	_quotaEstimates = 0;
+    }
+}
+
+
+void DirTree::setMetricsFile( const QString & fileName )
+{
+    _metricsFile = fileName;
+
+    if ( ! _metricsFile.isEmpty() && ! _metrics )
+    {
+	_metrics = new ScanMetrics();
+	CHECK_NEW( _metrics );
+    }
+    else if ( _metricsFile.isEmpty() && _metrics )
+    {
+	delete _metrics;
+	_metrics = 0;
+    }
+}
+
+
+void DirTree::setRecordReadTimes( bool record )
+{
+    if ( record && ! _readTimes )
+    {
+	_readTimes = new DirReadTimes( this );	// Deleted as a child of this
+	CHECK_NEW( _readTimes );
+    }
+    else if ( ! record && _readTimes )
+    {
+	delete _readTimes;
+	_readTimes = 0;
+    }
 }
 
 
 void DirTree::childAddedNotify( FileInfo * newChild )
 {
+    qint64 startNsec = ScanStats::now();
+
+    treeChanged( newChild );
     emit childAdded( newChild );
 
     if ( newChild->dotEntry() )
 	emit childAdded( newChild->dotEntry() );
+
+    ScanStats::instance()->addNotifyTime( ScanStats::now() - startNsec );
 }
 
 
 void DirTree::deletingChildNotify( FileInfo * deletedChild )
 {
     logDebug() << "Deleting child " << deletedChild << endl;
+    treeChanged( deletedChild );
     emit deletingChild( deletedChild );
+    dropOwnerTotals();
+    dropPrecomputedStats();
+
+    if ( readPriority() && readPriority()->isInSubtree( deletedChild ) )
+	_jobQueue.setPriorityDir( 0 );
 
     if ( deletedChild == _root )
 	_root = 0;
@@ -298,7 +993,19 @@ void DirTree::deleteSubtree( FileInfo *subtree )
 	parent->deletingChild( subtree );
     }
 
-    delete subtree;
+    if ( subtree->isDirInfo() && parent )
+    {
+	// The ancestors are already notified, so the subtree doesn't need
+	// its parent anymore while it is deleted.
+
+	subtree->setParent( 0 );
+	deleteInBackground( subtree );
+    }
+    else
+    {
+	delete subtree;
+	scheduleReclaim();
+    }
 
     if ( subtree == _root )
     {
@@ -309,12 +1016,108 @@ void DirTree::deleteSubtree( FileInfo *subtree )
 }
 
 
+void DirTree::deleteInBackground( FileInfo * subtree )
+{
+    // Deleting millions of nodes takes a while, so this is done in a
+    // worker thread. The subtree is no longer linked to the tree. The
+    // destructors don't use the tree, but they do use some global state:
+    //
+    // - The CacheBudget: Drop the sort caches of the subtree here in the
+    //   main thread, so that no node of it is in the budget any more.
+    //
+    // - The NodePool (for the nodes and the private names) and the pool
+    //   of interned names: Both are protected by a mutex. The nodes are
+    //   only retired, not reused, until reclaimNodes() runs in the main
+    //   thread.
+    //
+    // Everything else that is deleted (the child arrays and indexes, the
+    // sort caches, the type summaries, the folded files and the cold
+    // subtrees) belongs to the nodes alone.
+
+    if ( subtree && subtree->isDirInfo() && CacheBudget::isEnabled() )
+	subtree->toDirInfo()->dropAllSortCaches();
+
+    NodeDeleter * deleter = new NodeDeleter( this, subtree );
+    CHECK_NEW( deleter );
+    _deletePool.start( deleter );	// The thread pool takes ownership
+}
+
+
+void DirTree::addSnapshot( TreeSnapshot * snapshot )
+{
+    if ( snapshot && ! _snapshots.contains( snapshot ) )
+	_snapshots << snapshot;
+}
+
+
+void DirTree::removeSnapshot( TreeSnapshot * snapshot )
+{
+    _snapshots.removeAll( snapshot );
+}
+
+
+void DirTree::treeChanged( FileInfo * item )
+{
+    ++_generation;
+
+    // A directory only keeps its copied children while all of its
+    // subdirectories keep theirs, so the ancestors are done at the first
+    // one that has none.
+
+    FileInfo * changed = item ? item : _root;
+
+    if ( changed && changed->isDirInfo() )
+	changed->toDirInfo()->dropSnapshotDir();
+
+    for ( DirInfo * dir = changed ? changed->parent() : 0; dir && dir->snapshotDir(); dir = dir->parent() )
+	dir->dropSnapshotDir();
+
+    if ( _snapshots.isEmpty() )
+	return;
+
+    foreach ( TreeSnapshot * snapshot, _snapshots )
+    {
+	if ( ! snapshot->isStale() && ( ! item || snapshot->affectedBy( item ) ) )
+	{
+	    snapshot->setStale();
+	    emit snapshotStale( snapshot );
+	}
+    }
+}
+
+
+void DirTree::scheduleReclaim()
+{
+    // Whoever deleted the nodes might still check pointers to them, so the
+    // nodes are reclaimed only when control is back in the event loop.
+
+    if ( ! _reclaimPending )
+    {
+	_reclaimPending = true;
+	QTimer::singleShot( 0, this, SLOT( reclaimNodes() ) );
+    }
+}
+
+
+void DirTree::reclaimNodes()
+{
+    _reclaimPending = false;
+    NodePool::reclaim();
+}
+
+
 void DirTree::addJob( DirReadJob * job )
 {
     _jobQueue.enqueue( job );
 }
 
 
+void DirTree::addReadJob( DirInfo * dir )
+{
+    _jobQueue.enqueueDir( dir );
+}
+
+
 void DirTree::sendFinalizeLocal( DirInfo *dir )
 {
     emit finalizeLocal( dir );
@@ -348,22 +1151,183 @@ void DirTree::sendStartingReading( DirInfo * dir )
 void DirTree::sendReadJobFinished( DirInfo * dir )
 {
     // logDebug() << dir << endl;
+    qint64 startNsec = ScanStats::now();
+
+    treeChanged( dir );	// The totals might have changed without new children
     emit readJobFinished( dir );
+
+    ScanStats::instance()->addNotifyTime( ScanStats::now() - startNsec );
+}
+
+
+void DirTree::sendChildrenChanging( DirInfo * dir )
+{
+    treeChanged( dir );
+    emit childrenChanging( dir );
 }
 
 
 bool DirTree::writeCache( const QString & cacheFileName )
 {
-    CacheWriter writer( cacheFileName.toUtf8(), this );
+    if ( BinaryCacheWriter::isBinaryCacheName( cacheFileName ) )
+    {
+	BinaryCacheWriter writer( cacheFileName, this,
+				  BinaryCacheWriter::isCompressedBinaryCacheName( cacheFileName ) );
+	return writer.ok();
+    }
+
+    CacheWriter writer( cacheFileName.toUtf8(), this, true, _writeCacheIndex );
     return writer.ok();
 }
 
 
-void DirTree::readCache( const QString & cacheFileName )
+bool DirTree::writeCacheInBackground( const QString & cacheFileName )
+{
+    if ( ! firstToplevel() )
+	return false;
+
+    if ( BinaryCacheWriter::isBinaryCacheName( cacheFileName ) )
+    {
+	// No snapshot for the binary format: It is fast enough anyway
+
+	if ( _metrics )
+	    _metrics->cacheWriteStarted();
+
+	bool ok = writeCache( cacheFileName );
+	metricsCacheWritten( cacheFileName, ok );
+	emit cacheWritten( cacheFileName, ok );
+
+	return ok;
+    }
+
+    if ( _cacheWriterThread )
+    {
+	logWarning() << "Still writing " << _cacheWriterThread->fileName()
+		     << " - not writing " << cacheFileName << endl;
+	return false;
+    }
+
+    if ( _metrics )
+	_metrics->cacheWriteStarted();
+
+    // The snapshot is taken right here in the main thread where the tree
+    // is changed, so it is consistent even while reading.
+
+    CacheSnapshot * snapshot = new CacheSnapshot( this );
+    CHECK_NEW( snapshot );
+
+    _cacheWriterThread = new CacheWriterThread( snapshot, cacheFileName, _writeCacheIndex );
+    CHECK_NEW( _cacheWriterThread );
+
+    connect( _cacheWriterThread, SIGNAL( finished()		  ),
+	     this,		 SLOT  ( cacheWriterFinished() ) );
+
+    _cacheWriterThread->start();
+
+    return true;
+}
+
+
+void DirTree::cacheWriterFinished()
+{
+    if ( ! _cacheWriterThread )
+	return;
+
+    QString fileName = _cacheWriterThread->fileName();
+    bool    ok	     = _cacheWriterThread->ok();
+
+    delete _cacheWriterThread;
+    _cacheWriterThread = 0;
+
+    metricsCacheWritten( fileName, ok );
+    emit cacheWritten( fileName, ok );
+}
+
+
+void DirTree::metricsCacheWritten( const QString & fileName, bool ok )
+{
+    // The metrics of the scan are already written, so write them again
+    // with the cache file.
+
+    if ( _metrics && ok && ! _metrics->isEmpty() )
+    {
+	_metrics->cacheWritten( fileName );
+	_metrics->write( _metricsFile );
+    }
+}
+
+
+void DirTree::readCache( const QString & cacheFileName,
+			 const QString & subtree )
 {
     _isBusy = true;
     emit startingReading();
-    addJob( new CacheReadJob( this, 0, cacheFileName ) );
+
+    if ( _metrics )
+	_metrics->cacheReadStarted( QStringList() << cacheFileName );
+
+    CacheReadJob * job = new CacheReadJob( this, 0, cacheFileName );
+    CHECK_NEW( job );
+
+    if ( ! subtree.isEmpty() )
+	job->setSubtree( subtree );
+
+    addJob( job );
+}
+
+
+void DirTree::refreshFromCache( const QString & cacheFileName )
+{
+    _isBusy = true;
+    emit startingReading();
+
+    if ( _metrics )
+	_metrics->cacheReadStarted( QStringList() << cacheFileName );
+
+    CacheReadJob * job = new CacheReadJob( this, 0, cacheFileName );
+    CHECK_NEW( job );
+    job->setRefresh( true );
+    addJob( job );
+}
+
+
+void DirTree::mergeCaches( const QStringList & cacheFileNames )
+{
+    _isBusy = true;
+    emit startingReading();
+
+    if ( _metrics )
+	_metrics->cacheReadStarted( cacheFileNames );
+
+    MergeCacheReadJob * job = new MergeCacheReadJob( this, cacheFileNames );
+    CHECK_NEW( job );
+    addJob( job );
+}
+
+
+void DirTree::readRemote( const QString & host, const QString & dirName )
+{
+    _remoteHost = host;
+    _isBusy = true;
+    emit startingReading();
+
+    RemoteDirReadJob * job = new RemoteDirReadJob( this, host, dirName );
+    CHECK_NEW( job );
+    addJob( job );
+}
+
+
+
+
+
+
+void NodeDeleter::run()
+{
+    delete _subtree;
+
+    // Only the tree knows when it is safe to reclaim the nodes
+
+    QMetaObject::invokeMethod( _tree, "reclaimNodes", Qt::QueuedConnection );
 }
 
 
@@ -16,15 +16,52 @@
 #include <dirent.h>
 #include <stdlib.h>
 
+#include <QThreadPool>
+#include <QRunnable>
+
 #include "Logger.h"
 #include "DirInfo.h"
 #include "DirReadJob.h"
+#include "OwnerTotals.h"
+#include "PrecomputedStats.h"
+#include "ScanProgress.h"
+#include "FileInfoSet.h"
 
 
 namespace QDirStat
 {
     class DirReadJob;
     class FileInfoSet;
+    class MimeCategorizer;
+    class SuffixIndex;
+    class NameIndex;
+    class DirTreeWatcher;
+    class CacheDiff;
+    class ExtentStats;
+    class DirReadTimes;
+    class QuotaEstimates;
+    class ScanMetrics;
+    class MimeCategory;
+    class InodeSet;
+    class CacheWriterThread;
+    class TreeSnapshot;
+
+
+    /**
+     * The nodes that anything outside of the tree still keeps pointers to,
+     * like the tiles of a treemap or the selected items. The tree collects
+     * them with the collectingUsedNodes() signal before it compacts cold
+     * subtrees: Neither a used node nor any directory above it is compacted.
+     **/
+    struct UsedNodes
+    {
+	UsedNodes():
+	    busy( false )
+	    {}
+
+	FileInfoSet nodes;
+	bool	    busy;	// Someone can't tell right now: Compact nothing
+    };
 
 
     /**
@@ -45,6 +82,12 @@ namespace QDirStat
 	Q_OBJECT
 
     public:
+
+	enum
+	{
+	    MinColdSubtreeItems = 1000	// See freezeColdSubtrees()
+	};
+
 	/**
 	 * Constructor.
 	 *
@@ -77,6 +120,21 @@ namespace QDirStat
 	 **/
 	void abortReading();
 
+	/**
+	 * Compact each subtree that was never touched (see
+	 * DirInfo::isTouched()) and that has at least 'minItems' items to a
+	 * ColdSubtree: Only its directory with its totals remains. Anything
+	 * that needs the children again restores them with
+	 * DirInfo::thaw().
+	 *
+	 * Subtrees that anything outside of the tree still refers to are
+	 * left alone (see UsedNodes).
+	 *
+	 * This does nothing while the tree is being read. Return the number
+	 * of directories that were compacted.
+	 **/
+	int freezeColdSubtrees( int minItems = MinColdSubtreeItems );
+
 	/**
 	 * Refresh a subtree, i.e. read its contents from disk again.
 	 *
@@ -95,11 +153,31 @@ namespace QDirStat
 	 **/
 	void refresh( const FileInfoSet & refreshSet );
 
+	/**
+	 * Check a number of subtrees against the disk and update only what
+	 * changed: The entries of each of them are stat()ed again and
+	 * compared to the existing children; below that, only directories
+	 * with a changed mtime are read again. All other children stay as
+	 * they are, so unlike refresh(), pointers to them remain valid.
+	 *
+	 * For files, this checks their parent directory.
+	 *
+	 * If 'recursive' is 'false', subdirectories with an unchanged mtime
+	 * are not checked at all.
+	 **/
+	void verify( const FileInfoSet & items, bool recursive = true );
+
 	/**
 	 * Delete a subtree.
 	 **/
 	void deleteSubtree( FileInfo * subtree );
 
+	/**
+	 * Reclaim the nodes that were deleted (see NodePool::reclaim()) as
+	 * soon as the event loop is reached again.
+	 **/
+	void scheduleReclaim();
+
 
     public:
 
@@ -163,6 +241,13 @@ namespace QDirStat
 	 **/
 	void addJob( DirReadJob * job );
 
+	/**
+	 * Add reading directory 'dir' from disk to the queue. This is
+	 * cheaper than adding a new LocalDirReadJob: The job is only created
+	 * when it is almost due.
+	 **/
+	void addReadJob( DirInfo * dir );
+
 	/**
 	 * Should directory scans cross file systems?
 	 *
@@ -178,6 +263,423 @@ namespace QDirStat
 	void setCrossFileSystems( bool doCross )
 	    { _crossFileSystems = doCross; }
 
+	/**
+	 * Return 'true' if the "fast scan" mode is active: Use the file type
+	 * that readdir() reports to queue subdirectories right away and
+	 * defer the lstat() calls for all other entries of a directory.
+	 **/
+	bool fastScan() const { return _fastScan; }
+
+	/**
+	 * Set or unset the "fast scan" mode.
+	 **/
+	void setFastScan( bool fastScan ) { _fastScan = fastScan; }
+
+	/**
+	 * Return 'true' if summary propagation is lazy: While a directory is
+	 * being read, its new children are only added up in that directory
+	 * itself, and the accumulated totals are pushed up to all its
+	 * ancestors in one go when the directory is finalized. The ancestors
+	 * thus lag behind a little while reading, but adding a child no
+	 * longer walks up the complete parent chain.
+	 **/
+	bool lazySummaries() const { return _lazySummaries; }
+
+	/**
+	 * Set or unset lazy summary propagation.
+	 **/
+	void setLazySummaries( bool lazy ) { _lazySummaries = lazy; }
+
+	/**
+	 * Return 'true' if only the totals of the files are kept: Reading
+	 * directories or cache files folds each file into the summary of the
+	 * dot entry of its directory (see DirInfo::foldChild()) instead of
+	 * creating a FileInfo for it. The directories are all there, but
+	 * there are no nodes for the files, which saves most of the memory
+	 * of a huge tree.
+	 **/
+	bool aggregateOnly() const { return _aggregateOnly; }
+
+	/**
+	 * Enable or disable aggregate-only mode. Set this before reading.
+	 **/
+	void setAggregateOnly( bool aggregate ) { _aggregateOnly = aggregate; }
+
+	/**
+	 * Return 'true' if subtrees that the user never opened are compacted
+	 * to a ColdSubtree some time after reading is finished. See
+	 * freezeColdSubtrees().
+	 **/
+	bool compactColdSubtrees() const { return _compactColdSubtrees; }
+
+	/**
+	 * Enable or disable compacting cold subtrees.
+	 **/
+	void setCompactColdSubtrees( bool compact ) { _compactColdSubtrees = compact; }
+
+	/**
+	 * Return 'true' if the totals by owner are kept up to date while
+	 * reading. See ownerTotals().
+	 **/
+	bool countOwners() const { return _countOwners; }
+
+	/**
+	 * Enable or disable counting the owners.
+	 **/
+	void setCountOwners( bool count ) { _countOwners = count; }
+
+	/**
+	 * Return the totals of the complete tree by owner. They are added
+	 * up as items are inserted while reading (if countOwners() is
+	 * set); otherwise, and after anything was removed from the tree,
+	 * they are collected from the tree on demand.
+	 **/
+	const OwnerTotals & ownerTotals();
+
+	/**
+	 * Add 'item' to the owner totals. This is called by DirInfo for each
+	 * new child.
+	 **/
+	void ownerAdded( FileInfo * item )
+	    { if ( ! _ownerTotalsDirty ) _ownerTotals.add( item ); }
+
+	/**
+	 * Mark the owner totals as outdated because something was removed.
+	 **/
+	void dropOwnerTotals() { _ownerTotalsDirty = true; }
+
+	/**
+	 * Return 'true' if the file size, age and type statistics of the
+	 * complete tree are added up while reading. See precomputedStats().
+	 **/
+	bool precomputeStats() const { return _precomputeStats; }
+
+	/**
+	 * Enable or disable precomputing the statistics. This takes effect
+	 * with the next complete read.
+	 **/
+	void setPrecomputeStats( bool enable );
+
+	/**
+	 * Return the statistics that were added up while reading if they
+	 * are complete and valid for 'subtree', i.e. if 'subtree' is the
+	 * complete tree (the root or the only toplevel item), nothing was
+	 * removed since, and reading is finished. Otherwise, return 0; then
+	 * the statistics have to be collected from the tree.
+	 **/
+	const PrecomputedStats * precomputedStats( FileInfo * subtree ) const;
+
+	/**
+	 * Return the estimate how far reading from disk is. There is only an
+	 * estimate when reading a complete filesystem; see ScanProgress.
+	 * Call update() on a copy to get the current numbers.
+	 **/
+	const ScanProgress & scanProgress() const { return _scanProgress; }
+
+	/**
+	 * Add 'item' to the precomputed statistics. This is called by
+	 * DirInfo for each new child.
+	 **/
+	void statsAdded( FileInfo * item )
+	    { if ( ! _precomputedStatsDirty ) _precomputedStats.add( item, _mimeCategorizer ); }
+
+	/**
+	 * Mark the precomputed statistics as outdated because something was
+	 * removed.
+	 **/
+	void dropPrecomputedStats() { _precomputedStatsDirty = true; }
+
+	/**
+	 * Restore the nodes of all cold directories in 'subtree' (see
+	 * DirInfo::thaw()), e.g. before anything walks through all of it.
+	 * 0 means the complete tree.
+	 **/
+	void thaw( FileInfo * subtree = 0 );
+
+	/**
+	 * Return 'true' if directories keep an array of their children in
+	 * addition to the children list once they are finalized. Iterating
+	 * over the children uses that array, so walking the complete tree no
+	 * longer has to follow one 'next' pointer after the other. See
+	 * DirInfo::childArray().
+	 **/
+	bool compactChildren() const { return _compactChildren; }
+
+	/**
+	 * Enable or disable the child arrays. This takes effect for
+	 * directories that are finalized after this call.
+	 **/
+	void setCompactChildren( bool compact ) { _compactChildren = compact; }
+
+	/**
+	 * Return 'true' if directories keep the sizes etc. of their children
+	 * in contiguous arrays once they are finalized, so their summaries
+	 * and the file size statistics are calculated from those arrays.
+	 * See DirInfo::childColumns().
+	 **/
+	bool childColumns() const { return _childColumns; }
+
+	/**
+	 * Enable or disable the child columns. This takes effect for
+	 * directories that are finalized after this call.
+	 **/
+	void setChildColumns( bool enable ) { _childColumns = enable; }
+
+	/**
+	 * Return 'true' if DirInfo::finalizeLocal() does not build the child
+	 * arrays and columns because they are built for a complete subtree
+	 * in parallel afterwards (see DirInfo::finishSubtree()).
+	 **/
+	bool deferChildArrays() const { return _deferChildArrays; }
+
+	/**
+	 * Set or unset deferring the child arrays. This is for the readers
+	 * that finalize a complete subtree at once.
+	 **/
+	void setDeferChildArrays( bool defer ) { _deferChildArrays = defer; }
+
+	/**
+	 * Return 'true' if files with multiple hard links are counted only
+	 * once per inode: With the first link that is found with its
+	 * complete size, with all others not at all. Otherwise each link
+	 * counts with its share of the size (size / number of links).
+	 *
+	 * This only works for directories that are read from disk, not from
+	 * a cache file. It takes effect with the next read; refreshing a
+	 * subtree does not forget the inodes counted there, so the totals
+	 * are only exact after reading the complete tree again.
+	 **/
+	bool countHardLinksOnce() const { return _inodeSet != 0; }
+
+	/**
+	 * Enable or disable counting each inode only once.
+	 **/
+	void setCountHardLinksOnce( bool enable );
+
+	/**
+	 * Return the set of the inodes with multiple links found so far or 0
+	 * if countHardLinksOnce() is disabled.
+	 **/
+	InodeSet * inodeSet() const { return _inodeSet; }
+
+	/**
+	 * Return 'true' if the directories of this tree are watched for
+	 * changes, so the tree is updated automatically. See DirTreeWatcher.
+	 **/
+	bool watchFileSystem() const { return _watcher != 0; }
+
+	/**
+	 * Enable or disable watching the directories for changes.
+	 **/
+	void setWatchFileSystem( bool enable );
+
+	/**
+	 * Return the watcher of this tree or 0 if watchFileSystem() is
+	 * disabled.
+	 **/
+	DirTreeWatcher * watcher() const { return _watcher; }
+
+	/**
+	 * Return the system call backend for reading local directories.
+	 **/
+	LocalScanBackend scanBackend() const { return _scanBackend; }
+
+	/**
+	 * Set the system call backend for reading local directories.
+	 **/
+	void setScanBackend( LocalScanBackend backend ) { _scanBackend = backend; }
+
+	/**
+	 * Return 'true' if text cache files are written with an index that
+	 * allows reading a subtree without reading the complete file.
+	 **/
+	bool writeCacheIndex() const { return _writeCacheIndex; }
+
+	/**
+	 * Set if text cache files should be written with an index.
+	 **/
+	void setWriteCacheIndex( bool writeIndex ) { _writeCacheIndex = writeIndex; }
+
+	/**
+	 * Return 'true' if the time it takes to read each directory from
+	 * disk is recorded.
+	 **/
+	bool recordReadTimes() const { return _readTimes != 0; }
+
+	/**
+	 * Set if the time it takes to read each directory from disk should
+	 * be recorded. Switching this off drops everything recorded so far.
+	 * See DirReadTimes.
+	 **/
+	void setRecordReadTimes( bool record );
+
+	/**
+	 * Return the read times of the directories or 0 if they are not
+	 * recorded.
+	 **/
+	DirReadTimes * readTimes() const { return _readTimes; }
+
+	/**
+	 * Return 'true' if the sizes that the filesystem already knows
+	 * (Btrfs qgroups, project quotas) are shown for the directories that
+	 * are still being read.
+	 **/
+	bool quickEstimates() const { return _quotaEstimates != 0; }
+
+	/**
+	 * Set if the sizes that the filesystem already knows should be
+	 * queried for each directory that is read. See QuotaEstimates.
+	 **/
+	void setQuickEstimates( bool enable );
+
+	/**
+	 * Return the sizes that the filesystem already knows or 0 if they
+	 * are not queried.
+	 **/
+	QuotaEstimates * quotaEstimates() const { return _quotaEstimates; }
+
+	/**
+	 * Return the stamp of the MimeCategorizer that the cached MIME
+	 * categories of the items in this tree belong to (0 if none). See
+	 * MimeCategorizer::category().
+	 **/
+	uint mimeCategoryStamp() const { return _mimeCategoryStamp; }
+
+	/**
+	 * Set the MimeCategorizer stamp.
+	 **/
+	void setMimeCategoryStamp( uint stamp ) { _mimeCategoryStamp = stamp; }
+
+	/**
+	 * Return the MimeCategorizer for the type summaries of this tree or 0
+	 * if there is none.
+	 **/
+	MimeCategorizer * mimeCategorizer() const { return _mimeCategorizer; }
+
+	/**
+	 * Set the MimeCategorizer for the type summaries. This tree does not
+	 * take ownership of it. The categorizer has to be used only in the
+	 * main thread while it is set here.
+	 **/
+	void setMimeCategorizer( MimeCategorizer * categorizer );
+
+	/**
+	 * Return 'true' if the directories of this tree keep the size and
+	 * number of their files for each MIME category. See
+	 * DirInfo::typeSummary().
+	 **/
+	bool typeSummaries() const { return _typeSummaries; }
+
+	/**
+	 * Enable or disable type summaries.
+	 **/
+	void setTypeSummaries( bool enable );
+
+	/**
+	 * Return the MimeCategorizer for the type summaries if they are
+	 * enabled or 0 if not.
+	 **/
+	MimeCategorizer * typeSummaryCategorizer() const
+	    { return _typeSummaries ? _mimeCategorizer : 0; }
+
+	/**
+	 * Return the MIME category of 'item' if it is a file or the category
+	 * that uses the most disk space in its subtree if it is a directory.
+	 * Return 0 if there is none or if type summaries are disabled; see
+	 * DirInfo::mainCategory().
+	 **/
+	MimeCategory * mainCategory( FileInfo * item );
+
+	/**
+	 * Return the name of mainCategory() of 'item', "Other" if it has
+	 * files, but none of them has a category, and an empty string if
+	 * there are no files or no type summaries.
+	 **/
+	QString mainCategoryName( FileInfo * item );
+
+	/**
+	 * Return the index of the files of this tree by their suffix. It is
+	 * created with the first call, and the index itself is built with
+	 * the first query; see SuffixIndex.
+	 **/
+	SuffixIndex * suffixIndex();
+
+	/**
+	 * Return the trigram index of the names of this tree. It is created
+	 * with the first call, but it still has to be built; see NameIndex.
+	 **/
+	NameIndex * nameIndex();
+
+	/**
+	 * Compare this tree with the older cache file 'fileName', e.g. to find
+	 * out what grew since the cache file was written. This replaces any
+	 * previous comparison. Returns 'true' if OK, 'false' upon error.
+	 * See CacheDiff.
+	 **/
+	bool compareWithCache( const QString & fileName );
+
+	/**
+	 * Return the comparison with an older cache file or 0 if there is
+	 * none.
+	 **/
+	CacheDiff * cacheDiff() const { return _cacheDiff; }
+
+	/**
+	 * Stop comparing with an older cache file. This is also done when the
+	 * tree is cleared.
+	 **/
+	void clearCacheDiff();
+
+	/**
+	 * Start counting the exclusive and shared disk space of the files of
+	 * 'subtree' in the background. extentStatsChanged() is emitted when
+	 * this is done. See ExtentStats.
+	 **/
+	void countExtents( FileInfo * subtree );
+
+	/**
+	 * Return the exclusive and shared disk space of the files or 0 if
+	 * countExtents() was never called.
+	 **/
+	ExtentStats * extentStats() const { return _extentStats; }
+
+	/**
+	 * Return the number of worker threads for reading local directories.
+	 * 1 means reading everything in the main thread.
+	 **/
+	int scannerThreads() const { return _jobQueue.threadCount(); }
+
+	/**
+	 * Set the number of worker threads for reading local directories.
+	 **/
+	void setScannerThreads( int threadCount )
+	    { _jobQueue.setThreadCount( threadCount ); }
+
+	/**
+	 * Return 'true' if directories are read depth first rather than
+	 * breadth first.
+	 **/
+	bool depthFirstReading() const { return _jobQueue.depthFirst(); }
+
+	/**
+	 * Read directories depth first or breadth first.
+	 **/
+	void setDepthFirstReading( bool depthFirst )
+	    { _jobQueue.setDepthFirst( depthFirst ); }
+
+	/**
+	 * Return the directory whose subtree is read before everything else
+	 * or 0 if there is none.
+	 **/
+	DirInfo * readPriority() const { return _jobQueue.priorityDir(); }
+
+	/**
+	 * Read the subtree of 'item' (or of its directory if it is a file)
+	 * before everything else, e.g. because the user is looking at it.
+	 * 0 means no priority.
+	 **/
+	void setReadPriority( FileInfo * item );
+
 	/**
 	 * Notification that a child has been added.
 	 *
@@ -229,6 +731,11 @@ namespace QDirStat
 	 **/
 	void sendReadJobFinished( DirInfo * dir );
 
+	/**
+	 * Send a @ref childrenChanging( DirInfo * ) signal.
+	 **/
+	void sendChildrenChanging( DirInfo * dir );
+
 	/**
 	 * Send a @ref finalizeLocal() signal to give views a chance to
 	 * finalize the display of this directory level - e.g. clean up dot
@@ -242,16 +749,162 @@ namespace QDirStat
 	bool isBusy() { return _isBusy; }
 
 	/**
-	 * Write the complete tree to a cache file.
+	 * Write the complete tree to a cache file. If the file name ends
+	 * with BINARY_CACHE_SUFFIX or COMPRESSED_BINARY_CACHE_SUFFIX, this
+	 * uses the binary cache format.
 	 *
 	 * Returns true if OK, false upon error.
 	 **/
 	bool writeCache( const QString & cacheFileName );
 
 	/**
-	 * Read a cache file.
+	 * Write the complete tree to a cache file in a worker thread:
+	 * Only a snapshot of the tree is taken right away (see
+	 * CacheSnapshot), so the tree may be read or refreshed while the
+	 * file is written. cacheWritten() is emitted when it is done.
+	 *
+	 * Binary cache files are written right away with writeCache().
+	 *
+	 * Returns 'false' if there is nothing to write or if another cache
+	 * file is still being written.
+	 **/
+	bool writeCacheInBackground( const QString & cacheFileName );
+
+	/**
+	 * Return 'true' if a cache file is being written in the background.
+	 **/
+	bool isWritingCache() const { return _cacheWriterThread != 0; }
+
+	/**
+	 * Return the cache file that is written automatically after reading
+	 * from disk is finished or an empty string if there is none.
+	 **/
+	const QString & autoCacheFile() const { return _autoCacheFile; }
+
+	/**
+	 * Write cache file 'fileName' with writeCacheInBackground() every
+	 * time reading or refreshing from disk is finished (but not when it
+	 * was aborted). An empty file name disables this.
+	 **/
+	void setAutoCacheFile( const QString & fileName ) { _autoCacheFile = fileName; }
+
+	/**
+	 * Return the file that the metrics of each scan are written to or an
+	 * empty string if there is none.
+	 **/
+	const QString & metricsFile() const { return _metricsFile; }
+
+	/**
+	 * Write the metrics of each scan (see ScanMetrics) to 'fileName'
+	 * every time reading is finished, and again after the automatic
+	 * cache file is written. A name ending with ".json" gets JSON,
+	 * anything else gets the Prometheus text format. An empty file name
+	 * disables this.
+	 **/
+	void setMetricsFile( const QString & fileName );
+
+	/**
+	 * Return the generation of this tree: This counts up whenever
+	 * anything is added to the tree or removed from it.
+	 **/
+	quint64 generation() const { return _generation; }
+
+	/**
+	 * Register a TreeSnapshot so it is marked as stale when its subtree
+	 * changes. This is called by the TreeSnapshot itself.
+	 **/
+	void addSnapshot( TreeSnapshot * snapshot );
+
+	/**
+	 * Unregister a TreeSnapshot. This is called by the TreeSnapshot
+	 * itself when it is deleted.
+	 **/
+	void removeSnapshot( TreeSnapshot * snapshot );
+
+	/**
+	 * Read a cache file. Both the text and the binary format are
+	 * supported.
+	 *
+	 * If 'subtree' is not empty, read only that directory and everything
+	 * below it. This is fast for text cache files that were written with
+	 * an index (see setWriteCacheIndex()).
+	 **/
+	void readCache( const QString & cacheFileName,
+			const QString & subtree = QString() );
+
+	/**
+	 * Read several text cache files into one tree at the same time. This
+	 * is meant for the shards of a tree that were written with
+	 * "qdirstat-scan -s" (possibly on different machines): They all have
+	 * the same toplevel directory, and they are merged into one.
+	 **/
+	void mergeCaches( const QStringList & cacheFileNames );
+
+	/**
+	 * Read directory 'dirName' on another machine: This starts the scan
+	 * agent ("qdirstat --scan-to-cache <dir> -", see
+	 * RemoteDirReadJob::setRemoteCommand()) on 'host' with ssh and reads
+	 * the cache stream it writes to its stdout, so the tree grows while
+	 * the remote machine is still reading.
+	 *
+	 * ssh has to work without asking for a password, e.g. with a key in
+	 * the ssh agent.
+	 **/
+	void readRemote( const QString & host, const QString & dirName );
+
+	/**
+	 * Return the host the tree was read from with readRemote() or an
+	 * empty string if it is a local tree or was read from a cache file.
+	 * There is nothing on the local disk to refresh or to watch for a
+	 * remote tree.
+	 **/
+	const QString & remoteHost() const { return _remoteHost; }
+
+	/**
+	 * Return 'true' if the tree was read from another machine.
+	 **/
+	bool isRemote() const { return ! _remoteHost.isEmpty(); }
+
+	/**
+	 * Read a cache file and update it from disk: Directories that changed
+	 * since the cache file was written (i.e. that have a different mtime
+	 * now) are read from disk again, all others are taken from the
+	 * cache file. See CacheReader::setRefresh().
+	 **/
+	void refreshFromCache( const QString & cacheFileName );
+
+	/**
+	 * Return the file name for checkpoints or an empty string if there
+	 * are no checkpoints.
+	 **/
+	const QString & checkpointFile() const { return _checkpointFile; }
+
+	/**
+	 * Return the interval between two checkpoints in seconds.
 	 **/
-	void readCache( const QString & cacheFileName );
+	int checkpointInterval() const { return _checkpointTimer.interval() / 1000; }
+
+	/**
+	 * Write checkpoints to cache file 'fileName' every 'seconds' seconds
+	 * while reading, and when reading is aborted: The directories that
+	 * are read so far with all their files, and all others with an
+	 * "unread" mark. Reading that cache file with readCache() resumes
+	 * reading: Only the unread directories are read from disk.
+	 *
+	 * The checkpoint file is removed when reading is finished. An empty
+	 * file name or 0 seconds disables checkpoints.
+	 **/
+	void setCheckpoints( const QString & fileName, int seconds );
+
+	/**
+	 * Write a checkpoint now. Returns 'true' if OK, 'false' upon error.
+	 **/
+	bool writeCheckpoint();
+
+	/**
+	 * Return the default file name for checkpoints.
+	 **/
+	static QString defaultCheckpointFile();
 
 
     signals:
@@ -291,6 +944,13 @@ namespace QDirStat
 	 **/
 	void subtreeCleared( DirInfo * subtree );
 
+	/**
+	 * Emitted before compacting cold subtrees: Anything that keeps
+	 * pointers to nodes of the tree has to add them to 'usedNodes' (or
+	 * set its 'busy' flag). This is only for direct connections.
+	 **/
+	void collectingUsedNodes( QDirStat::UsedNodes * usedNodes );
+
 	/**
 	 * Emitted when reading is started.
 	 **/
@@ -306,6 +966,31 @@ namespace QDirStat
 	 **/
 	void aborted();
 
+	/**
+	 * Emitted when the comparison with an older cache file was started or
+	 * stopped. See cacheDiff().
+	 **/
+	void cacheDiffChanged();
+
+	/**
+	 * Emitted when writeCacheInBackground() is done. 'ok' is 'false' if
+	 * there was an error.
+	 **/
+	void cacheWritten( const QString & fileName, bool ok );
+
+	/**
+	 * Emitted when something changed in the subtree of 'snapshot', so it
+	 * is stale now (see TreeSnapshot::isStale()). This is only sent once
+	 * for each snapshot.
+	 **/
+	void snapshotStale( TreeSnapshot * snapshot );
+
+	/**
+	 * Emitted when counting the extents is done or when the result was
+	 * dropped. See extentStats().
+	 **/
+	void extentStatsChanged();
+
 	/**
 	 * Emitted when reading the specified directory is started.
 	 **/
@@ -317,6 +1002,17 @@ namespace QDirStat
 	 **/
 	void readJobFinished( DirInfo * dir );
 
+	/**
+	 * Emitted when children of a directory that was already read are
+	 * about to be added and removed because it was checked against the
+	 * disk again. The directory is marked as being read right after this
+	 * signal, and readJobFinished( dir ) is sent when it is done.
+	 *
+	 * Views should forget about all children of 'dir' now and pick them
+	 * up again with that readJobFinished() signal.
+	 **/
+	void childrenChanging( DirInfo * dir );
+
 	/**
 	 * Emitted when reading a directory is finished.
 	 * This does _not_ mean reading all subdirectories is finished, too -
@@ -349,17 +1045,143 @@ namespace QDirStat
 	 **/
 	void slotFinished();
 
+	/**
+	 * Give the nodes that were deleted back to the NodePool.
+	 **/
+	void reclaimNodes();
+
+	/**
+	 * Checkpoint timer expired: Write a checkpoint unless a cache file is
+	 * being read right now.
+	 **/
+	void checkpoint();
+
+	/**
+	 * Reading started: Start writing checkpoints if enabled.
+	 **/
+	void startCheckpoints();
+
+	/**
+	 * Reading started: Start taking the scan metrics if enabled.
+	 **/
+	void startMetrics();
+
+	/**
+	 * The cache writer thread of writeCacheInBackground() is finished.
+	 **/
+	void cacheWriterFinished();
+
 
     protected:
 
+	/**
+	 * Add writing cache file 'fileName' to the scan metrics if enabled
+	 * and 'ok'.
+	 **/
+	void metricsCacheWritten( const QString & fileName, bool ok );
+
+	/**
+	 * Delete 'subtree' in a worker thread. It must not be linked to the
+	 * tree anymore, not even to its parent.
+	 **/
+	void deleteInBackground( FileInfo * subtree );
+
+	/**
+	 * Count up the generation and mark all snapshots as stale that
+	 * 'item' is in or that are in the subtree of 'item'. 0 means all of
+	 * them.
+	 *
+	 * This also drops the children that the last TreeSnapshot copied
+	 * (see DirInfo::snapshotDir()) of 'item' and all its ancestors.
+	 **/
+	void treeChanged( FileInfo * item );
+
+	/**
+	 * Compact the cold subtrees below 'dir' except the directories in
+	 * 'used'. Return the number of directories that were compacted.
+	 **/
+	int freezeColdChildren( DirInfo * dir, int minItems, const QSet<DirInfo *> & used );
+
+
 	DirInfo *	_root;
 	DirReadJobQueue _jobQueue;
 	bool		_crossFileSystems;
+	bool		_fastScan;
+	bool		_lazySummaries;
+	bool		_aggregateOnly;
+	bool		_compactColdSubtrees;
+	bool		_countOwners;
+	bool		_ownerTotalsDirty;
+	OwnerTotals	_ownerTotals;
+	bool		_precomputeStats;
+	bool		_precomputedStatsDirty;
+	PrecomputedStats _precomputedStats;
+	ScanProgress	_scanProgress;
+	bool		_compactChildren;
+	bool		_childColumns;
+	bool		_deferChildArrays;
+	LocalScanBackend _scanBackend;
+	bool		_writeCacheIndex;
+	uint		_mimeCategoryStamp;
+	MimeCategorizer * _mimeCategorizer;
+	bool		_typeSummaries;
+	SuffixIndex *	_suffixIndex;
+	NameIndex *	_nameIndex;
+	CacheDiff *	_cacheDiff;
+	ExtentStats *	_extentStats;
+	DirReadTimes *	_readTimes;
+	QuotaEstimates * _quotaEstimates;
+	InodeSet *	_inodeSet;
+	DirTreeWatcher * _watcher;
+	bool		_reclaimPending;
+	QThreadPool	_deletePool;
+	QString		_checkpointFile;
+	CacheWriterThread * _cacheWriterThread;
+	QString		_autoCacheFile;
+	bool		_autoCachePending;
+	ScanMetrics *	_metrics;
+	QString		_metricsFile;
+	quint64		_generation;
+	QList<TreeSnapshot *> _snapshots;
+	QString		_remoteHost;
+	QTimer		_checkpointTimer;
 	bool		_isBusy;
         QString         _device;
 
     };	// class DirTree
 
+
+    /**
+     * Runnable for a QThreadPool that deletes a subtree that was detached
+     * from its DirTree.
+     **/
+    class NodeDeleter: public QRunnable
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	NodeDeleter( DirTree * tree, FileInfo * subtree ):
+	    QRunnable(),
+	    _tree( tree ),
+	    _subtree( subtree )
+	    { setAutoDelete( true ); }
+
+	/**
+	 * Delete the subtree. This is called in a worker thread.
+	 *
+	 * Reimplemented from QRunnable.
+	 **/
+	virtual void run() Q_DECL_OVERRIDE;
+
+    protected:
+
+	DirTree *  _tree;
+	FileInfo * _subtree;
+
+    };	// class NodeDeleter
+
 }	// namespace QDirStat
 
 
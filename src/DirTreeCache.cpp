@@ -8,12 +8,16 @@
 
 
 #include <ctype.h>
-#include <QUrl>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "Logger.h"
 #include "DirTreeCache.h"
 #include "DirTree.h"
 #include "ExcludeRules.h"
+#include "DirReadJob.h"
 #include "Exception.h"
 
 #define KB 1024LL
@@ -22,6 +26,7 @@
 #define TB (1024LL*1024*1024*1024)
 
 #define MAX_ERROR_COUNT			1000
+#define STREAM_FLUSH_MILLISEC		500
 
 #define VERBOSE_READ			0
 #define VERBOSE_CACHE_DIRS		0
@@ -31,46 +36,196 @@
 using namespace QDirStat;
 
 
-CacheWriter::CacheWriter( const QString & fileName, DirTree *tree )
+CacheWriter::CacheWriter( const QString & fileName,
+			  DirTree *	  tree,
+			  bool		  compressInThread,
+			  bool		  writeIndex ):
+    _ok( false ),
+    _compressInThread( compressInThread ),
+    _writeIndex( writeIndex ),
+    _compression( GzipCompression ),
+    _written( 0 ),
+    _compressor( 0 ),
+    _streaming( false )
 {
     _ok = writeCache( fileName, tree );
 }
 
 
-CacheWriter::~CacheWriter()
+CacheWriter::CacheWriter():
+    _ok( false ),
+    _compressInThread( true ),
+    _writeIndex( false ),
+    _compression( GzipCompression ),
+    _written( 0 ),
+    _compressor( 0 ),
+    _streaming( false )
 {
     // NOP
 }
 
 
+CacheWriter::~CacheWriter()
+{
+    if ( _compressor )
+	close();
+}
+
+
 bool CacheWriter::writeCache( const QString & fileName, DirTree *tree )
 {
     if ( ! tree || ! tree->root() )
 	return false;
 
-    gzFile cache = gzopen( (const char *) fileName.toUtf8(), "w" );
+    if ( ! open( fileName, _compressInThread, _writeIndex ) )
+	return false;
+
+    tree->thaw();
+    writeTree( tree->root()->firstChild() );
+
+    if ( ! close() )
+    {
+	logError() << "Error writing " << fileName << endl;
+	return false;
+    }
+
+    return true;
+}
+
+
+bool CacheWriter::open( const QString & fileName,
+			bool		compressInThread,
+			bool		writeIndex )
+{
+    _streaming = fileName == "-";
+
+    if ( _streaming )
+	writeIndex = false;
 
-    if ( cache == 0 )
+    int fd = _streaming ? dup( STDOUT_FILENO ) :
+	::open( (const char *) fileName.toUtf8(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+
+    if ( fd < 0 )
     {
 	logError() << "Can't open " << fileName << ": " << formatErrno() << endl;
+	_ok = false;
 	return false;
     }
 
-    gzprintf( cache, "[qdirstat %s cache file]\n", CACHE_FORMAT_VERSION );
-    gzprintf( cache,
-	     "# Do not edit!\n"
-	     "#\n"
-	     "# Type\tpath\t\tsize\tmtime\t\t<optional fields>\n"
-	     "\n" );
+    _ok		      = true;
+    _compressInThread = compressInThread;
+    _writeIndex	      = writeIndex;
+    _written	      = 0;
+    _buffer.reserve( CACHE_WRITE_BUFFER_SIZE + MAX_CACHE_LINE_LEN );
+
+    _compression = compressionForFile( fileName, _compression );
+    _compressor	 = new CacheCompressorThread( fd, _writeIndex, _streaming, _compression,
+					      compressInThread ? QThread::idealThreadCount() : 1 );
+    CHECK_NEW( _compressor );
+
+    if ( _streaming )
+	_flushTimer.start();
 
-    writeTree( cache, tree->root()->firstChild() );
-    gzclose( cache );
+    if ( _compressInThread )
+	_compressor->start();
+
+    if ( _writeIndex )
+    {
+	_indexFile.setFileName( fileName + CACHE_INDEX_SUFFIX );
+
+	if ( ! _indexFile.open( QIODevice::WriteOnly | QIODevice::Truncate ) )
+	{
+	    logError() << "Can't open " << _indexFile.fileName() << ": "
+		       << _indexFile.errorString() << endl;
+	    _writeIndex = false;
+	}
+	else
+	{
+	    _indexBuffer = "[qdirstat " CACHE_FORMAT_VERSION " cache index]\n";
+	}
+    }
+
+    writeHeader();
 
     return true;
 }
 
 
-void CacheWriter::writeTree( gzFile cache, FileInfo * item )
+void CacheWriter::writeHeader()
+{
+    append( "[qdirstat " CACHE_FORMAT_VERSION " cache file]\n" );
+    append( "# Do not edit!\n"
+	    "#\n"
+	    "# Type\tpath\t\tsize\tmtime\t\t<optional fields>\n"
+	    "\n" );
+}
+
+
+bool CacheWriter::close()
+{
+    if ( ! _compressor )
+	return _ok;
+
+    flush( true );
+
+    if ( ! _compressor->finish() )
+	_ok = false;
+
+    if ( _writeIndex && ! closeIndex() )
+	_ok = false;
+
+    delete _compressor;
+    _compressor = 0;
+
+    return _ok;
+}
+
+
+void CacheWriter::addToIndex( const char * path, int len )
+{
+    // Index line:  D <offset in the uncompressed data> <path>
+
+    _indexBuffer.append( "D " );
+    _indexBuffer.append( QByteArray::number( _written + _buffer.size() ) );
+    _indexBuffer.append( ' ' );
+    urlEncode( _indexBuffer, path, len );
+    _indexBuffer.append( '\n' );
+
+    if ( _indexBuffer.size() >= CACHE_WRITE_BUFFER_SIZE / 16 )
+    {
+	if ( _indexFile.write( _indexBuffer ) != _indexBuffer.size() )
+	    _ok = false;
+
+	_indexBuffer.resize( 0 );
+    }
+}
+
+
+bool CacheWriter::closeIndex()
+{
+    // Sync point lines:  S <offset in the uncompressed data> <offset in the file>
+
+    foreach ( const CacheSyncPoint & syncPoint, _compressor->syncPoints() )
+    {
+	_indexBuffer.append( "S " );
+	_indexBuffer.append( QByteArray::number( syncPoint.uncompressed ) );
+	_indexBuffer.append( ' ' );
+	_indexBuffer.append( QByteArray::number( syncPoint.compressed ) );
+	_indexBuffer.append( '\n' );
+    }
+
+    bool ok = _indexFile.write( _indexBuffer ) == _indexBuffer.size();
+    _indexBuffer.clear();
+    _indexFile.close();
+
+    if ( ! ok )
+	logError() << "Error writing " << _indexFile.fileName() << endl;
+
+    return ok;
+}
+
+
+void CacheWriter::writeTree( FileInfo * item )
 {
     if ( ! item )
 	return;
@@ -80,14 +235,14 @@ void CacheWriter::writeTree( gzFile cache, FileInfo * item )
     //
 
     if ( ! item->isDotEntry() )
-	writeItem( cache, item );
+	writeItem( item );
 
     //
     // Write file children
     //
 
-    if ( item->dotEntry() )
-	writeTree( cache, item->dotEntry() );
+    if ( item->dotEntry() && ! isUnread( item ) )
+	writeTree( item->dotEntry() );
 
     //
     // Recurse through subdirectories
@@ -97,221 +252,1050 @@ void CacheWriter::writeTree( gzFile cache, FileInfo * item )
 
     while ( child )
     {
-	writeTree( cache, child );
+	writeTree( child );
 	child = child->next();
     }
 }
 
 
-void CacheWriter::writeItem( gzFile cache, FileInfo * item )
+void CacheWriter::writeItem( FileInfo * item )
 {
     if ( ! item )
 	return;
 
+    int len;
+    const char * name;
+    QByteArray	 url;
+
+    if ( item->isDirInfo() && ! item->isDotEntry() )
+    {
+	// Use absolute path
+
+	url  = item->url().toUtf8();
+	name = url.constData();
+	len  = url.size();
+    }
+    else
+    {
+	// Use relative path. Use the UTF-8 bytes of the name directly
+	// to avoid creating a QString for each file.
+
+	name = item->compactName().utf8( &len );
+    }
+
+    writeEntry( item->mode(), name, len,
+		item->size(),
+		item->mtime(),
+		item->isSparseFile() ? item->blocks() : -1,
+		item->isFile()	     ? item->links()  : 1,
+		isUnread( item ) );
+}
+
+
+bool CacheWriter::isUnread( FileInfo * item )
+{
+    if ( ! item->isDirInfo() || item->isDotEntry() )
+	return false;
+
+    switch ( item->readState() )
+    {
+	case DirQueued:
+	case DirReading:
+	case DirAborted:
+	    return true;
+
+	default:
+	    return false;
+    }
+}
+
+
+const char * CacheWriter::fileType( mode_t mode )
+{
+    if	    ( S_ISREG ( mode ) )	return "F";
+    else if ( S_ISDIR ( mode ) )	return "D";
+    else if ( S_ISLNK ( mode ) )	return "L";
+    else if ( S_ISBLK ( mode ) )	return "BlockDev";
+    else if ( S_ISCHR ( mode ) )	return "CharDev";
+    else if ( S_ISFIFO( mode ) )	return "FIFO";
+    else if ( S_ISSOCK( mode ) )	return "Socket";
+
+    return "";
+}
+
+
+void CacheWriter::writeEntry( mode_t	   mode,
+			      const char * path,
+			      int	   len,
+			      FileSize	   size,
+			      time_t	   mtime,
+			      FileSize	   blocks,
+			      int	   links,
+			      bool	   unread )
+{
+    if ( ! _compressor )
+	return;
+
+    if ( _writeIndex && S_ISDIR( mode ) )
+	addToIndex( path, len );
+
     // Write file type
 
-    const char * file_type = "";
-    if	    ( item->isFile()		)	file_type = "F";
-    else if ( item->isDir()		)	file_type = "D";
-    else if ( item->isSymLink()		)	file_type = "L";
-    else if ( item->isBlockDevice()	)	file_type = "BlockDev";
-    else if ( item->isCharDevice()	)	file_type = "CharDev";
-    else if ( item->isFifo()		)	file_type = "FIFO";
-    else if ( item->isSocket()		)	file_type = "Socket";
+    append( fileType( mode ) );
 
-    gzprintf( cache, "%s", file_type );
+    // Write name: Directories with absolute path, everything else with
+    // relative path
 
-    // Write name
+    _buffer.append( S_ISDIR( mode ) ? ' ' : '\t' );
+    appendUrlEncoded( path, len );
 
-    if ( item->isDirInfo() && ! item->isDotEntry() )
+
+    // Write size
+
+    _buffer.append( '\t' );
+    appendSize( size );
+
+
+    // Write mtime
+
+    _buffer.append( '\t' );
+    appendHex( (unsigned long) mtime );
+
+    // Optional fields
+
+    if ( blocks >= 0 )
     {
-	// Use absolute path
+	append( "\tblocks: " );
+	appendNumber( blocks );
+    }
+
+    if ( links > 1 )
+    {
+	append( "\tlinks: " );
+	appendNumber( links );
+    }
+
+    if ( unread )
+	append( "\tunread: 1" );
+
+    _buffer.append( '\n' );
+    flush();
+}
+
+
+void CacheWriter::append( const char * str )
+{
+    _buffer.append( str );
+}
+
+
+void CacheWriter::appendNumber( qint64 num )
+{
+    char   digits[ 24 ];
+    char * end = digits + sizeof( digits );
+    char * ptr = end;
+    bool   negative = num < 0;
+
+    // Don't negate 'num' itself: That would overflow for the smallest
+    // qint64.
+
+    quint64 val = negative ? 0ULL - (quint64) num : (quint64) num;
+
+    do
+    {
+	*--ptr = '0' + val % 10;
+	val /= 10;
+    } while ( val > 0 );
+
+    if ( negative )
+	*--ptr = '-';
+
+    _buffer.append( ptr, end - ptr );
+}
+
+
+void CacheWriter::appendHex( quint64 num )
+{
+    static const char hexDigits[] = "0123456789abcdef";
+
+    char   digits[ 24 ];
+    char * end = digits + sizeof( digits );
+    char * ptr = end;
+
+    do
+    {
+	*--ptr = hexDigits[ num & 0xf ];
+	num >>= 4;
+    } while ( num > 0 );
+
+    *--ptr = 'x';
+    *--ptr = '0';
+
+    _buffer.append( ptr, end - ptr );
+}
+
+
+void CacheWriter::appendSize( FileSize size )
+{
+    if	    ( size >= TB && size % TB == 0 ) { appendNumber( size / TB ); _buffer.append( 'T' ); }
+    else if ( size >= GB && size % GB == 0 ) { appendNumber( size / GB ); _buffer.append( 'G' ); }
+    else if ( size >= MB && size % MB == 0 ) { appendNumber( size / MB ); _buffer.append( 'M' ); }
+    else if ( size >= KB && size % KB == 0 ) { appendNumber( size / KB ); _buffer.append( 'K' ); }
+    else appendNumber( size );
+}
+
+
+void CacheWriter::appendUrlEncoded( const char * path, int len )
+{
+    urlEncode( _buffer, path, len );
+}
+
+
+void CacheWriter::urlEncode( QByteArray & target, const char * path, int len )
+{
+    static const char hexDigits[] = "0123456789ABCDEF";
+
+    if ( len == 0 )
+    {
+        logError() << "Invalid file/dir name: \"\"" << endl;
+	return;
+    }
+
+    // Leave the same characters unescaped that QUrl leaves unescaped in
+    // a path: The "unreserved" and "sub-delims" characters of RFC 3986
+    // plus ":", "@" and "/". Everything else (in particular whitespace,
+    // "%", "#", "?" and all non-ASCII bytes) is escaped.
+
+    for ( int i=0; i < len; ++i )
+    {
+	unsigned char c = path[i];
+
+	if ( ( c >= 'a' && c <= 'z' ) ||
+	     ( c >= 'A' && c <= 'Z' ) ||
+	     ( c >= '0' && c <= '9' ) ||
+	     ( c && strchr( "-._~/!$&'()*+,;=:@", c ) ) )
+	{
+	    target.append( (char) c );
+	}
+	else
+	{
+	    target.append( '%' );
+	    target.append( hexDigits[ c >> 4  ] );
+	    target.append( hexDigits[ c & 0xf ] );
+	}
+    }
+}
+
+
+QByteArray CacheWriter::urlEncoded( const QString & path )
+{
+    QByteArray utf8 = path.toUtf8();
+    QByteArray saved;
+    saved.swap( _buffer );
+
+    appendUrlEncoded( utf8.constData(), utf8.size() );
+
+    QByteArray encoded;
+    encoded.swap( _buffer );
+    _buffer.swap( saved );
+
+    return encoded;
+}
+
+
+void CacheWriter::flush( bool force )
+{
+    if ( _streaming && _flushTimer.elapsed() >= STREAM_FLUSH_MILLISEC )
+    {
+	force = true;
+	_flushTimer.restart();
+    }
+
+    if ( _buffer.isEmpty() || ( ! force && _buffer.size() < CACHE_WRITE_BUFFER_SIZE ) )
+	return;
+
+    if ( _ok && ! _compressor->write( _buffer ) )
+	_ok = false;
+
+    _written += _buffer.size();
+
+    if ( _compressInThread )
+    {
+	// The compressor thread now shares the data of the buffer, so
+	// start a new one instead of detaching it with each append().
+
+	_buffer = QByteArray();
+	_buffer.reserve( CACHE_WRITE_BUFFER_SIZE + MAX_CACHE_LINE_LEN );
+    }
+    else
+    {
+	_buffer.resize( 0 );	// Keeps the allocated memory
+    }
+}
+
+
+QString CacheWriter::formatSize( FileSize size )
+{
+    QByteArray saved;
+    saved.swap( _buffer );
+
+    appendSize( size );
+
+    QString str = QString::fromLatin1( _buffer );
+    _buffer.swap( saved );
+
+    return str;
+}
+
+
+
+
+CacheCompressorThread::CacheCompressorThread( int		   fd,
+					      bool		   syncPoints,
+					      bool		   streaming,
+					      CacheCompression	   compression,
+					      int		   threads ):
+    QThread(),
+    _fd( fd ),
+    _compression( compression ),
+    _threads( threads ),
+    _useSyncPoints( syncPoints ),
+    _streaming( streaming ),
+    _uncompressedSize( 0 ),
+    _compressedSize( 0 ),
+    _finished( false ),
+    _ok( true )
+{
+#ifdef HAVE_ZSTD
+    _zstd = 0;
+
+    if ( _compression == ZstdCompression )
+    {
+	_zstd = new ZstdCompressor( threads );
+	CHECK_NEW( _zstd );
+    }
+#else
+    if ( _compression == ZstdCompression )
+	_compression = GzipCompression;
+#endif
+}
+
+
+CacheCompressorThread::~CacheCompressorThread()
+{
+#ifdef HAVE_ZSTD
+    delete _zstd;
+#endif
+}
+
+
+bool CacheCompressorThread::write( const QByteArray & buffer )
+{
+    if ( ! isRunning() )
+    {
+	// Not threaded: Write directly
+
+	if ( _ok && ! writeBuffers( QList<QByteArray>() << buffer ) )
+	    _ok = false;
+
+	return _ok;
+    }
+
+    QMutexLocker locker( &_mutex );
+
+    while ( _buffers.size() >= MAX_CACHE_WRITE_BUFFERS && _ok )
+	_bufferTaken.wait( &_mutex );
+
+    if ( ! _ok )
+	return false;
+
+    _buffers.append( buffer );
+    _bufferQueued.wakeOne();
+
+    return true;
+}
+
+
+bool CacheCompressorThread::finish()
+{
+    if ( isRunning() )
+    {
+	{
+	    QMutexLocker locker( &_mutex );
+	    _finished = true;
+	    _bufferQueued.wakeOne();
+	}
+
+	wait();
+    }
 
-	gzprintf( cache, " %s", urlEncoded( item->url() ).data() );
+#ifdef HAVE_ZSTD
+    if ( _zstd && _ok )
+    {
+	QByteArray rest;
+
+	if ( ! _zstd->finish( rest ) || ! writeAll( rest ) )
+	    _ok = false;
+    }
+#endif
+
+    if ( _fd >= 0 && ::close( _fd ) != 0 )
+	_ok = false;
+
+    _fd = -1;
+
+    return _ok;
+}
+
+
+bool CacheCompressorThread::writeBuffers( const QList<QByteArray> & buffers )
+{
+    if ( _fd < 0 )
+	return false;
+
+    // Each buffer is a gzip member of its own, so they can be compressed
+    // in parallel; this also makes each one a possible sync point. Zstd
+    // uses worker threads of its own, and with sync points, each buffer
+    // ends a zstd frame.
+
+    QVector<QByteArray> compressed;
+
+    if ( _compression == GzipCompression &&
+	 ! gzipCompress( buffers, compressed, _threads ) )
+    {
+	logError() << "gzip compression failed" << endl;
+	return false;
+    }
+
+    for ( int i=0; i < buffers.size(); ++i )
+    {
+	const QByteArray & buffer = buffers.at( i );
+
+#ifdef HAVE_ZSTD
+	if ( _zstd )
+	{
+	    compressed.append( QByteArray() );
+
+	    if ( ! _zstd->compress( buffer, compressed.last(), _useSyncPoints, _streaming ) )
+		return false;
+	}
+#endif
+
+	if ( _compression == NoCompression )
+	    compressed.append( buffer );
+
+	if ( _useSyncPoints && _uncompressedSize > 0 )
+	{
+	    CacheSyncPoint syncPoint;
+	    syncPoint.uncompressed = _uncompressedSize;
+	    syncPoint.compressed   = _compressedSize;
+	    _syncPoints.append( syncPoint );
+	}
+
+	if ( ! writeAll( compressed.at( i ) ) )
+	    return false;
+
+	_uncompressedSize += buffer.size();
+    }
+
+    return true;
+}
+
+
+bool CacheCompressorThread::writeAll( const QByteArray & data )
+{
+    const char * start = data.constData();
+    qint64	 len   = data.size();
+
+    while ( len > 0 )
+    {
+	ssize_t written = ::write( _fd, start, len );
+
+	if ( written < 0 )
+	{
+	    if ( errno == EINTR )
+		continue;
+
+	    logError() << "Write error: " << formatErrno() << endl;
+	    return false;
+	}
+
+	start += written;
+	len   -= written;
+    }
+
+    _compressedSize += data.size();
+
+    return true;
+}
+
+
+void CacheCompressorThread::run()
+{
+    while ( true )
+    {
+	QList<QByteArray> buffers;
+
+	{
+	    QMutexLocker locker( &_mutex );
+
+	    while ( _buffers.isEmpty() && ! _finished )
+		_bufferQueued.wait( &_mutex );
+
+	    if ( _buffers.isEmpty() )
+		return;		// finished
+
+	    // Take all that are there to compress them in parallel
+
+	    buffers.swap( _buffers );
+	    _bufferTaken.wakeOne();
+	}
+
+	if ( ! writeBuffers( buffers ) )
+	{
+	    QMutexLocker locker( &_mutex );
+	    _ok = false;
+	    _buffers.clear();
+	    _bufferTaken.wakeAll();
+	    return;
+	}
+    }
+}
+
+
+
+
+
+
+/**
+ * Open cache file 'fileName' for reading. Return 0 upon error.
+ **/
+static CacheInput * openCacheFile( const QString & fileName )
+{
+    int fd = ::open( fileName.toUtf8(), O_RDONLY | O_CLOEXEC );
+
+    if ( fd < 0 )
+	return 0;
+
+    CacheInput * input = new CacheInput( fd );
+    CHECK_NEW( input );
+
+    return input;
+}
+
+
+CacheReader::CacheReader( const QString & fileName,
+			  DirTree *	  tree,
+			  DirInfo *	  parent ):
+    QObject()
+{
+    _fileName		= fileName;
+    _buffer[0]		= 0;
+    _line		= _buffer;
+    _lineNo		= 0;
+    _ok			= true;
+    _errorCount         = 0;
+    _tree		= tree;
+    _toplevel		= parent;
+    _lastDir		= 0;
+    _lastExcludedDir	= 0;
+    _readError		= false;
+    _refresh		= false;
+    _skipFiles		= false;
+    _subtreeStarted	= false;
+    _parserThread	= 0;
+    _parserFinished	= false;
+    _stopParser		= false;
+    _streaming		= false;
+    _headerPending	= false;
+
+    _cache = openCacheFile( fileName );
+
+    if ( _cache == 0 )
+    {
+	logError() << "Can't open " << fileName << ": " << formatErrno() << endl;
+	_ok = false;
+	emit error();
+	return;
+    }
+
+    // logDebug() << "Opening " << fileName << " OK" << endl;
+    checkHeader();
+}
+
+
+CacheReader::~CacheReader()
+{
+    stopParser();
+
+    delete _cache;
+
+    logDebug() << "Cache reading finished" << endl;
+
+    if ( _toplevel )
+    {
+	// logDebug() << "Finalizing recursive for " << _toplevel << endl;
+
+	// finalizeAll() builds the child arrays for everything in parallel
+
+	_tree->setDeferChildArrays( true );
+	finalizeRecursive( _toplevel );
+	_tree->setDeferChildArrays( false );
+	_toplevel->finalizeAll();
+    }
+
+    emit finished();
+}
+
+
+CacheReader::CacheReader( int		  fd,
+			  const QString & name,
+			  DirTree *	  tree,
+			  DirInfo *	  parent ):
+    QObject()
+{
+    _fileName		= name;
+    _buffer[0]		= 0;
+    _line		= _buffer;
+    _lineNo		= 0;
+    _ok			= true;
+    _errorCount         = 0;
+    _tree		= tree;
+    _toplevel		= parent;
+    _lastDir		= 0;
+    _lastExcludedDir	= 0;
+    _readError		= false;
+    _refresh		= false;
+    _skipFiles		= false;
+    _subtreeStarted	= false;
+    _parserThread	= 0;
+    _parserFinished	= false;
+    _stopParser		= false;
+    _streaming		= true;
+    _headerPending	= true;
+
+    _cache = new CacheInput( fd );
+    CHECK_NEW( _cache );
+}
+
+
+void CacheReader::rewind()
+{
+    if ( _streaming )
+	return;		// Nothing read yet or too late anyway
+
+    stopParser();
+
+    if ( _cache )
+    {
+	_readError = false;
+	_skipFiles = false;
+	_skippedDirUrl.clear();
+	_refreshDirs.clear();
+
+	if ( ! _subtree.isEmpty() )
+	{
+	    seekToSubtree();
+	}
+	else
+	{
+	    _cache->rewind();
+	    checkHeader();	// skip cache header
+	}
+    }
+}
+
+
+void CacheReader::setSubtree( const QString & path )
+{
+    if ( _streaming )
+    {
+	logWarning() << "Can't read a subtree of " << _fileName << endl;
+	return;
+    }
+
+    stopParser();
+    _subtree = path;
+
+    while ( _subtree.size() > 1 && _subtree.endsWith( "/" ) )
+	_subtree.chop( 1 );
+
+    if ( _cache && ! _subtree.isEmpty() )
+	seekToSubtree();
+}
+
+
+bool CacheReader::seekToSubtree()
+{
+    _subtreeStarted = false;
+
+    // Start over to get rid of any previous seek
+
+    delete _cache;
+    _cache  = openCacheFile( _fileName );
+    _lineNo = 0;
+
+    if ( ! _cache || ! checkHeader() )
+    {
+	logError() << "Can't reopen " << _fileName << endl;
+	_ok = false;
+	emit error();
+	return false;
+    }
+
+    QFile indexFile( _fileName + CACHE_INDEX_SUFFIX );
+
+    if ( ! indexFile.open( QIODevice::ReadOnly ) )
+    {
+	logInfo() << "No index for " << _fileName << " - reading sequentially" << endl;
+	return false;
+    }
+
+    if ( ! indexFile.readLine().startsWith( "[qdirstat " ) )
+    {
+	logWarning() << "Bad index file " << indexFile.fileName() << endl;
+	return false;
+    }
+
+    QByteArray wanted;
+    QByteArray subtreeUtf8 = _subtree.toUtf8();
+    CacheWriter::urlEncode( wanted, subtreeUtf8.constData(), subtreeUtf8.size() );
+
+    qint64 offset    = -1;
+    CacheSyncPoint syncPoint;
+    syncPoint.uncompressed = 0;
+    syncPoint.compressed   = 0;
+
+    while ( ! indexFile.atEnd() )
+    {
+	QByteArray line = indexFile.readLine();
+
+	if ( line.endsWith( '\n' ) )
+	    line.chop( 1 );
+
+	QList<QByteArray> fields = line.split( ' ' );
+
+	if ( fields.size() != 3 )
+	    continue;
+
+	if ( fields.at( 0 ) == "D" && offset < 0 && fields.at( 2 ) == wanted )
+	{
+	    offset = fields.at( 1 ).toLongLong();
+	}
+	else if ( fields.at( 0 ) == "S" )
+	{
+	    // Use the last sync point before the subtree. The sync points
+	    // are at the end of the index file.
+
+	    qint64 uncompressed = fields.at( 1 ).toLongLong();
+
+	    if ( offset >= 0 && uncompressed <= offset && uncompressed > syncPoint.uncompressed )
+	    {
+		syncPoint.uncompressed = uncompressed;
+		syncPoint.compressed   = fields.at( 2 ).toLongLong();
+	    }
+	}
+    }
+
+    if ( offset < 0 )
+    {
+	logInfo() << _subtree << " not in index of " << _fileName
+		  << " - reading sequentially" << endl;
+	return false;
+    }
+
+    if ( syncPoint.compressed > 0 )
+    {
+	// Continue reading with the gzip member or zstd frame that starts
+	// at the sync point.
+
+	int fd = ::open( _fileName.toUtf8(), O_RDONLY | O_CLOEXEC );
+
+	if ( fd < 0 || lseek( fd, syncPoint.compressed, SEEK_SET ) < 0 )
+	{
+	    if ( fd >= 0 )
+		::close( fd );
+
+	    logError() << "Can't seek in " << _fileName << ": " << formatErrno() << endl;
+	    return false;
+	}
+
+	delete _cache;
+	_cache = new CacheInput( fd );
+	CHECK_NEW( _cache );
+    }
+
+    // Skip the rest up to the subtree. The current position is 0 right
+    // after opening at the sync point, and behind the header otherwise.
+
+    qint64 skip = offset - syncPoint.uncompressed;
+
+    if ( ! _cache->seek( syncPoint.compressed > 0 ? skip : offset ) )
+    {
+	logError() << "Seeking failed in " << _fileName << endl;
+	_ok = false;
+	emit error();
+	return false;
+    }
+
+    logInfo() << "Reading " << _subtree << " from offset " << offset
+	      << " of " << _fileName << endl;
+
+    return true;
+}
+
+
+bool CacheReader::checkSubtree( const CacheRecord & record, bool & skip_ret )
+{
+    skip_ret = false;
+
+    if ( _subtree.isEmpty() )
+	return true;
+
+    if ( record.isDir && ! record.syntaxError )
+    {
+	QString path = buildPath( record.path, record.name );
+	bool inSubtree = path == _subtree ||
+	    path.startsWith( _subtree == "/" ? _subtree : _subtree + "/" );
+
+	if ( ! _subtreeStarted )
+	{
+	    if ( path != _subtree )
+	    {
+		skip_ret = true;
+		return true;
+	    }
+
+	    _subtreeStarted = true;
+	}
+	else if ( ! inSubtree )
+	{
+	    return false;	// The subtree is complete
+	}
     }
-    else
+    else if ( ! _subtreeStarted )
     {
-	// Use relative path
-
-	gzprintf( cache, "\t%s", urlEncoded( item->name() ).data() );
+	skip_ret = true;
     }
 
+    return true;
+}
 
-    // Write size
-
-    gzprintf( cache, "\t%s", formatSize( item->size() ).toUtf8().data() );
-
-
-    // Write mtime
 
-    gzprintf( cache, "\t0x%lx", (unsigned long) item->mtime() );
+void CacheReader::startParser()
+{
+    _parserFinished = false;
+    _stopParser	    = false;
 
-    // Optional fields
+    _parserThread = new CacheParserThread( this );
+    CHECK_NEW( _parserThread );
 
-    if ( item->isSparseFile() )
-	gzprintf( cache, "\tblocks: %lld", item->blocks() );
+    _parserThread->start();
+}
 
-    if ( item->isFile() && item->links() > 1 )
-	gzprintf( cache, "\tlinks: %u", (unsigned) item->links() );
 
-    gzputc( cache, '\n' );
+void CacheReader::prefetch()
+{
+    if ( _ok && _cache && ! _parserThread )
+	startParser();
 }
 
 
-QByteArray CacheWriter::urlEncoded( const QString & path )
+void CacheReader::stopParser()
 {
-    // Using a protocol ("scheme") part to avoid directory names with a colon
-    // ":" being cut off because it looks like a URL protocol.
-    QUrl url;
-    url.setScheme( "foo" );
-    url.setPath( path );
-
-    QByteArray encoded = url.toEncoded( QUrl::RemoveScheme );
+    if ( ! _parserThread )
+	return;
 
-    if ( encoded.isEmpty() )
     {
-        logError() << "Invalid file/dir name: " << path << endl;
+	QMutexLocker locker( &_batchMutex );
+	_stopParser = true;
+	_batchTaken.wakeAll();
     }
 
-    return encoded;
+    _parserThread->wait();
+    delete _parserThread;
+    _parserThread = 0;
 
+    _batches.clear();
+    _parserFinished = false;
+    _stopParser	    = false;
 }
 
 
-QString CacheWriter::formatSize( FileSize size )
+void CacheParserThread::run()
 {
-    QString str;
-
-    if ( size >= TB && size % TB == 0 )
-    {
-	str.sprintf( "%lldT", size / TB );
-	return str;
-    }
+    _reader->parseLines();
+}
 
-    if ( size >= GB && size % GB == 0 )
-    {
-	str.sprintf( "%lldG", size / GB );
-	return str;
-    }
 
-    if ( size >= MB && size % MB == 0 )
-    {
-	str.sprintf( "%lldM", size / MB );
-	return str;
-    }
+void CacheReader::parseLines()
+{
+    CacheRecordList batch;
+    batch.reserve( CACHE_BATCH_SIZE );
 
-    if ( size >= KB && size % KB == 0 )
+    if ( _headerPending )
     {
-	str.sprintf( "%lldK", size / KB );
-	return str;
-    }
+	_headerPending = false;
 
-    str.sprintf( "%lld", size );
-    return str;
-}
+	if ( readNextLine() )
+	    splitLine();
 
+	if ( _readError || ! isHeader() )
+	    _readError = true;	// This is reported by read()
+    }
 
+    while ( ! _cache->eof() && ! _readError )
+    {
+	if ( readNextLine() )
+	{
+	    splitLine();
+	    batch.append( CacheRecord() );
+	    CacheRecord & record = batch.last();
+	    parseRecord( record );
 
+	    bool skip;
 
+	    if ( ! checkSubtree( record, skip ) )
+	    {
+		batch.removeLast();
+		break;
+	    }
 
+	    if ( skip )
+	    {
+		batch.removeLast();
+		continue;
+	    }
 
+	    // Compare with the directory on disk in refresh mode. This is
+	    // done here because this runs in the parser thread.
 
-CacheReader::CacheReader( const QString & fileName,
-			  DirTree *	  tree,
-			  DirInfo *	  parent ):
-    QObject(),
-    _multiSlash( "//+" ) // cache regexp for multiple use
-{
-    _fileName		= fileName;
-    _buffer[0]		= 0;
-    _line		= _buffer;
-    _lineNo		= 0;
-    _ok			= true;
-    _errorCount         = 0;
-    _tree		= tree;
-    _toplevel		= parent;
-    _lastDir		= 0;
-    _lastExcludedDir	= 0;
+	    if ( _refresh && record.isDir )
+	    {
+		record.dirStatus = checkCachedDir( buildPath( record.path, record.name ),
+						   record.mtime, record.liveMtime );
+	    }
 
-    _cache = gzopen( fileName.toUtf8(), "r" );
+	    if ( batch.size() >= CACHE_BATCH_SIZE )
+	    {
+		if ( ! queueBatch( batch ) )
+		    return;
 
-    if ( _cache == 0 )
-    {
-	logError() << "Can't open " << fileName << ": " << formatErrno() << endl;
-	_ok = false;
-	emit error();
-	return;
+		batch.clear();
+		batch.reserve( CACHE_BATCH_SIZE );
+	    }
+	}
     }
 
-    // logDebug() << "Opening " << fileName << " OK" << endl;
-    checkHeader();
+    if ( ! batch.isEmpty() )
+	queueBatch( batch );
+
+    QMutexLocker locker( &_batchMutex );
+    _parserFinished = true;
+    _batchQueued.wakeAll();
 }
 
 
-CacheReader::~CacheReader()
+bool CacheReader::queueBatch( const CacheRecordList & batch )
 {
-    if ( _cache )
-	gzclose( _cache );
+    QMutexLocker locker( &_batchMutex );
 
-    logDebug() << "Cache reading finished" << endl;
+    // Don't let the parser run too far ahead: The parsed records need
+    // more memory than the compressed cache file.
 
-    if ( _toplevel )
-    {
-	// logDebug() << "Finalizing recursive for " << _toplevel << endl;
-	finalizeRecursive( _toplevel );
-	_toplevel->finalizeAll();
-    }
+    while ( _batches.size() >= MAX_CACHE_BATCHES && ! _stopParser )
+	_batchTaken.wait( &_batchMutex );
 
-    emit finished();
-}
+    if ( _stopParser )
+	return false;
 
+    _batches.append( batch );
+    _batchQueued.wakeOne();
 
-void CacheReader::rewind()
-{
-    if ( _cache )
-    {
-	gzrewind( _cache );
-	checkHeader();		// skip cache header
-    }
+    return true;
 }
 
 
 bool CacheReader::read( int maxLines )
 {
-    while ( ! gzeof( _cache )
-	    && _ok
-	    && ( maxLines == 0 || --maxLines > 0 ) )
+    if ( ! _ok || ! _cache )
+	return false;
+
+    if ( ! _parserThread )
+	startParser();
+
+    int count = 0;
+
+    while ( _ok && ( maxLines == 0 || count < maxLines ) )
     {
-	if ( readLine() )
+	CacheRecordList batch;
+
 	{
-	    splitLine();
-	    addItem();
+	    QMutexLocker locker( &_batchMutex );
+
+	    if ( _batches.isEmpty() )
+	    {
+		if ( _parserFinished )
+		    break;
+
+		if ( maxLines == 0 )
+		{
+		    _batchQueued.wait( &_batchMutex );
+		    continue;
+		}
+
+		// Don't block the event loop: Wait only a little for the
+		// parser and return if there is nothing yet.
+
+		if ( count > 0 || ! _batchQueued.wait( &_batchMutex, 5 ) )
+		    break;
+
+		continue;
+	    }
+
+	    batch = _batches.takeFirst();
+	    _batchTaken.wakeOne();
 	}
-    }
 
-    return _ok && ! gzeof( _cache );
-}
+	for ( int i=0; i < batch.size() && _ok; ++i )
+	    addItem( batch.at( i ) );
 
+	count += batch.size();
+    }
 
-void CacheReader::addItem()
-{
-    if ( fieldsCount() < 4 )
+    if ( _ok && eof() )
     {
-	logError() << "Syntax error in " << _fileName << ":" << _lineNo
-		   << ": Expected at least 4 fields, saw only " << fieldsCount()
-		   << endl;
-
-	setReadError( _lastDir );
+	// _readError is set by the parser thread before it finishes
 
-	if ( ++_errorCount > MAX_ERROR_COUNT )
+	if ( _readError )
 	{
-	    logError() << "Too many syntax errors. Giving up." << endl;
 	    _ok = false;
 	    emit error();
 	}
+    }
+
+    return _ok && ! eof();
+}
+
 
+void CacheReader::parseRecord( CacheRecord & record )
+{
+    record.mode		= S_IFREG;
+    record.size		= 0;
+    record.blocks	= -1;
+    record.mtime	= 0;
+    record.links	= 1;
+    record.lineNo	= _lineNo;
+    record.fieldsCount	= fieldsCount();
+    record.isDir	= false;
+    record.absolutePath = false;
+    record.syntaxError	= fieldsCount() < 4;
+    record.dirStatus	= CachedDirUnchanged;
+    record.liveMtime	= 0;
+    record.unread	= false;
+
+    if ( record.syntaxError )
 	return;
-    }
 
     int n = 0;
     char * type		= field( n++ );
@@ -328,6 +1312,7 @@ void CacheReader::addItem()
 
 	if ( strcasecmp( keyword, "blocks:" ) == 0 ) blocks_str = val_str;
 	if ( strcasecmp( keyword, "links:"  ) == 0 ) links_str	= val_str;
+	if ( strcasecmp( keyword, "unread:" ) == 0 ) record.unread = atoi( val_str ) != 0;
     }
 
 
@@ -343,11 +1328,13 @@ void CacheReader::addItem()
     else if ( strcasecmp( type, "FIFO"	   ) == 0 )	mode = S_IFIFO;
     else if ( strcasecmp( type, "Socket"   ) == 0 )	mode = S_IFSOCK;
 
+    record.mode	 = mode;
+    record.isDir = mode == S_IFDIR;
+
 
     // Path
 
-    if ( *raw_path == '/' )
-	_lastDir = 0;
+    record.absolutePath = *raw_path == '/';
 
 
     // Size
@@ -368,29 +1355,116 @@ void CacheReader::addItem()
     }
 
 
+    record.size = size;
+
+
     // MTime
 
-    time_t mtime = strtol( mtime_str, 0, 0 );
+    record.mtime = strtol( mtime_str, 0, 0 );
 
 
     // Blocks
 
-    FileSize blocks = blocks_str ? strtoll( blocks_str, 0, 10 ) : -1;
+    record.blocks = blocks_str ? strtoll( blocks_str, 0, 10 ) : -1;
 
 
     // Links
 
-    int links = links_str ? atoi( links_str ) : 1;
+    record.links = links_str ? atoi( links_str ) : 1;
 
 
-    //
-    // Create a new item
-    //
+    // Unescaped path and name
+
+    splitPath( raw_path, record.path, record.name );
+}
+
+
+CachedDirStatus CacheReader::checkCachedDir( const QString & path,
+					     time_t	     cachedMtime,
+					     time_t	   & liveMtime_ret )
+{
+    struct stat statInfo;
+
+    if ( lstat( path.toUtf8(), &statInfo ) != 0 || ! S_ISDIR( statInfo.st_mode ) )
+	return CachedDirGone;
+
+    liveMtime_ret = statInfo.st_mtime;
 
-    QString fullPath = unescapedPath( raw_path );
-    QString path;
-    QString name;
-    splitPath( fullPath, path, name );
+    return statInfo.st_mtime == cachedMtime ? CachedDirUnchanged : CachedDirChanged;
+}
+
+
+void CacheReader::queueRefreshJobs()
+{
+    foreach ( DirInfo * dir, _refreshDirs )
+    {
+	LocalDirReadJob * job = new LocalDirReadJob( _tree, dir );
+	CHECK_NEW( job );
+	job->setKeepExistingSubDirs( true );
+	_tree->addJob( job );
+    }
+
+    if ( ! _refreshDirs.isEmpty() )
+	logInfo() << "Rereading " << _refreshDirs.size() << " changed directories" << endl;
+
+    _refreshDirs.clear();
+}
+
+
+void CacheReader::addItem( const CacheRecord & record )
+{
+    if ( record.syntaxError )
+    {
+	logError() << "Syntax error in " << _fileName << ":" << record.lineNo
+		   << ": Expected at least 4 fields, saw only " << record.fieldsCount
+		   << endl;
+
+	setReadError( _lastDir );
+
+	if ( ++_errorCount > MAX_ERROR_COUNT )
+	{
+	    logError() << "Too many syntax errors. Giving up." << endl;
+	    _ok = false;
+	    emit error();
+	}
+
+	return;
+    }
+
+    if ( record.absolutePath )
+    {
+	_lastDir   = 0;
+	_skipFiles = false;
+    }
+    else if ( _skipFiles )
+    {
+	return;
+    }
+
+    const QString & path  = record.path;
+    const QString & name  = record.name;
+    mode_t	    mode  = record.mode;
+    FileSize	    size  = record.size;
+    time_t	    mtime = record.mtime;
+
+    if ( ! _skippedDirUrl.isEmpty() )
+    {
+	if ( path == _skippedDirUrl || path.startsWith( _skippedDirUrl + "/" ) )
+	    return;
+
+	_skippedDirUrl.clear();
+    }
+
+    if ( record.dirStatus == CachedDirGone )
+    {
+	logDebug() << "Not on disk anymore: " << buildPath( path, name ) << endl;
+	_skippedDirUrl = buildPath( path, name );
+	_skipFiles     = true;
+	return;
+    }
+
+    if ( record.dirStatus == CachedDirChanged )
+	mtime = record.liveMtime;
 
     if ( _lastExcludedDir )
     {
@@ -401,6 +1475,24 @@ void CacheReader::addItem()
 	}
     }
 
+    if ( record.isDir && record.absolutePath && ! _toplevel &&
+	 _tree->firstToplevel() && _tree->firstToplevel()->isDirInfo() &&
+	 _tree->firstToplevel()->url() == buildPath( path, name ) )
+    {
+	// Another shard of the same tree (see DirTree::mergeCaches()):
+	// Continue with the toplevel directory that is already there.
+
+	DirInfo * dir = _tree->firstToplevel()->toDirInfo();
+	logInfo() << "Merging " << _fileName << " into " << dir << endl;
+
+	dir->setReadState( DirReading );
+	_toplevel = dir;
+	_lastDir  = dir;
+	_dirs.insert( dir->url(), dir );
+
+	return;
+    }
+
     // Find parent in tree
 
     DirInfo * parent = _lastDir;
@@ -410,14 +1502,21 @@ void CacheReader::addItem()
 	if ( ! _tree->root()->hasChildren() )
 	    parent = _tree->root();
 
-	// Try the easy way first - the starting point of this cache
+	// Try the easy way first - the directories of this cache that are
+	// already there: Lines that are not in tree order (e.g. from
+	// parallel writers or merged shards) don't need a tree search.
+
+	if ( ! parent )
+	    parent = _dirs.value( path, 0 );
+
+	// The starting point of this cache
 
 	if ( ! parent && _toplevel )
 	    parent = dynamic_cast<DirInfo *> ( _toplevel->locate( path ) );
 
 #if DEBUG_LOCATE_PARENT
 	if ( parent )
-	    logDebug() << "Using cache starting point as parent for " << fullPath << endl;
+	    logDebug() << "Using cache starting point as parent for " << buildPath( path, name ) << endl;
 #endif
 
 
@@ -435,7 +1534,7 @@ void CacheReader::addItem()
 
 	if ( ! parent ) // Still nothing?
 	{
-	    logError() << _fileName << ":" << _lineNo << ": "
+	    logError() << _fileName << ":" << record.lineNo << ": "
 		       << "Could not locate parent \"" << path << "\" for "
 		       << name << endl;
 
@@ -444,9 +1543,12 @@ void CacheReader::addItem()
 #endif
 	    return;	// Ignore this cache line completely
 	}
+
+	if ( parent != _tree->root() )
+	    _dirs.insert( path, parent );
     }
 
-    if ( strcasecmp( type, "D" ) == 0 )
+    if ( record.isDir )
     {
 	QString url = ( parent == _tree->root() ) ? buildPath( path, name ) : name;
 #if VERBOSE_CACHE_DIRS
@@ -456,6 +1558,7 @@ void CacheReader::addItem()
 				     mode, size, mtime );
 	dir->setReadState( DirReading );
 	_lastDir = dir;
+	_dirs.insert( record.absolutePath ? buildPath( path, name ) : dir->url(), dir );
 
 	if ( parent )
 	    parent->insertChild( dir );
@@ -471,11 +1574,20 @@ void CacheReader::addItem()
 
 	_tree->childAddedNotify( dir );
 
+	if ( record.dirStatus == CachedDirChanged || record.unread )
+	{
+	    // Read the entries of this directory from disk later instead
+
+	    _refreshDirs.insert( dir );
+	    _skipFiles = true;
+	}
+
 	if ( dir != _toplevel )
 	{
 	    if ( ExcludeRules::instance()->match( dir->url(), dir->name() ) )
 	    {
 		logDebug() << "Excluding " << name << endl;
+		_refreshDirs.remove( dir );
 		dir->setExcluded();
 		dir->setReadState( DirOnRequestOnly );
 		_tree->sendFinalizeLocal( dir );
@@ -485,6 +1597,7 @@ void CacheReader::addItem()
 		_lastExcludedDir    = dir;
 		_lastExcludedDirUrl = _lastExcludedDir->url();
 		_lastDir	    = 0;
+		_dirs.remove( _lastExcludedDirUrl );
 	    }
 	}
     }
@@ -497,15 +1610,25 @@ void CacheReader::addItem()
 		       << buildPath( parent->debugUrl(), name ) << endl;
 #endif
 
-	    FileInfo * item = new FileInfo( _tree, parent, name,
-					    mode, size, mtime,
-					    blocks, links );
-	    parent->insertChild( item );
-	    _tree->childAddedNotify( item );
+	    if ( _tree->aggregateOnly() )
+	    {
+		FileInfo item( _tree, parent, name,
+			       mode, size, mtime,
+			       record.blocks, record.links );
+		parent->foldChild( &item );
+	    }
+	    else
+	    {
+		FileInfo * item = new FileInfo( _tree, parent, name,
+						mode, size, mtime,
+						record.blocks, record.links );
+		parent->insertChild( item );
+		_tree->childAddedNotify( item );
+	    }
 	}
 	else
 	{
-	    logError() << _fileName << ":" << _lineNo << ": "
+	    logError() << _fileName << ":" << record.lineNo << ": "
 		       << "No parent for item " << name << endl;
 	}
     }
@@ -517,13 +1640,18 @@ bool CacheReader::eof()
     if ( ! _ok || ! _cache )
 	return true;
 
-    return gzeof( _cache );
+    if ( ! _parserThread )
+	return _cache->eof();
+
+    QMutexLocker locker( &_batchMutex );
+
+    return _parserFinished && _batches.isEmpty();
 }
 
 
 QString CacheReader::firstDir()
 {
-    while ( ! gzeof( _cache ) && _ok )
+    while ( ! _cache->eof() && _ok )
     {
 	if ( ! readLine() )
 	    return "";
@@ -551,51 +1679,60 @@ bool CacheReader::checkHeader()
 	return false;
 
     // logDebug() << "Checking cache file header" << endl;
-    QString line( _line );
     splitLine();
+    _ok = isHeader();
+
+    // logDebug() << "Cache file header check OK: " << _ok << endl;
+
+    if ( ! _ok )
+	emit error();
+
+    return _ok;
+}
+
 
+bool CacheReader::isHeader() const
+{
     // Check for    [qdirstat <version> cache file]
     // or	    [kdirstat <version> cache file]
+    //
+    // Currently not checking the version number; for future use.
 
-    if ( fieldsCount() != 4 )	_ok = false;
-
-    if ( _ok )
+    if ( fieldsCount() != 4 ||
+	 ( strcmp( _fields[0], "[qdirstat" ) != 0 &&
+	   strcmp( _fields[0], "[kdirstat" ) != 0   ) ||
+	 strcmp( _fields[2], "cache"     ) != 0 ||
+	 strcmp( _fields[3], "file]"     ) != 0 )
     {
-	if ( ( strcmp( field( 0 ), "[qdirstat" ) != 0 &&
-	       strcmp( field( 0 ), "[kdirstat" ) != 0	) ||
-	     strcmp( field( 2 ), "cache"     ) != 0 ||
-	     strcmp( field( 3 ), "file]"     ) != 0 )
-	{
-	    _ok = false;
-	    logError() << _fileName << ":" << _lineNo
-		      << ": Unknown file format" << endl;
-	}
+	logError() << _fileName << ":" << _lineNo
+		   << ": Unknown file format" << endl;
+	return false;
     }
 
-    if ( _ok )
-    {
-	QString version = field( 1 );
+    return true;
+}
 
-	// currently not checking version number
-	// for future use
 
-	if ( ! _ok )
-	    logError() << _fileName << ":" << _lineNo
-		      << ": Incompatible cache file version" << endl;
-    }
+bool CacheReader::readLine()
+{
+    if ( ! _ok )
+	return false;
 
-    // logDebug() << "Cache file header check OK: " << _ok << endl;
+    bool ok = readNextLine();
 
-    if ( ! _ok )
+    if ( _readError )
+    {
+	_ok = false;
 	emit error();
+    }
 
-    return _ok;
+    return ok;
 }
 
 
-bool CacheReader::readLine()
+bool CacheReader::readNextLine()
 {
-    if ( ! _ok || ! _cache )
+    if ( ! _cache || _readError )
 	return false;
 
     _fieldsCount = 0;
@@ -604,16 +1741,15 @@ bool CacheReader::readLine()
     {
 	_lineNo++;
 
-	if ( ! gzgets( _cache, _buffer, MAX_CACHE_LINE_LEN-1 ) )
+	if ( ! _cache->gets( _buffer, MAX_CACHE_LINE_LEN-1 ) )
 	{
 	    _buffer[0]	= 0;
 	    _line	= _buffer;
 
-	    if ( ! gzeof( _cache ) )
+	    if ( ! _cache->eof() )
 	    {
-		_ok = false;
 		logError() << _fileName << ":" << _lineNo << ": Read error" << endl;
-		emit error();
+		_readError = true;
 	    }
 
 	    return false;
@@ -624,7 +1760,7 @@ bool CacheReader::readLine()
 
 	// logDebug() << "line[ " << _lineNo << "]: \"" << _line<< "\"" << endl;
 
-    } while ( ! gzeof( _cache ) &&
+    } while ( ! _cache->eof() &&
 	      ( *_line == 0   ||	// empty line
 		*_line == '#'	  ) );	// comment line
 
@@ -636,7 +1772,7 @@ void CacheReader::splitLine()
 {
     _fieldsCount = 0;
 
-    if ( ! _ok || ! _line )
+    if ( ! _line )
 	return;
 
     if ( *_line == '#' )	// skip comment lines
@@ -709,26 +1845,70 @@ void CacheReader::killTrailingWhiteSpace( char * cptr )
 }
 
 
-void CacheReader::splitPath( const QString & fileNameWithPath,
-			     QString	   & path_ret,
-			     QString	   & name_ret ) const
+/**
+ * Return the value of hex digit 'c'.
+ **/
+static inline int hexValue( char c )
+{
+    if ( c >= 'a' ) return c - 'a' + 10;
+    if ( c >= 'A' ) return c - 'A' + 10;
+
+    return c - '0';
+}
+
+
+void CacheReader::splitPath( char    * rawPath,
+			     QString & path_ret,
+			     QString & name_ret )
 {
-    bool absolutePath = fileNameWithPath.startsWith( "/" );
-    QStringList components = fileNameWithPath.split( "/", QString::SkipEmptyParts );
+    // Unescape "%xx" and collapse multiple slashes in place: The result
+    // is never longer than the raw path. A '%' without two hex digits
+    // after it is taken literally, just like QUrl does in tolerant mode.
 
-    if ( components.isEmpty() )
+    const char * src  = rawPath;
+    char *	 dest = rawPath;
+
+    while ( *src )
     {
-	path_ret = "";
-	name_ret = absolutePath ? "/" : "";
+	char c = *src++;
+
+	if ( c == '%' && isxdigit( (unsigned char) src[0] ) && isxdigit( (unsigned char) src[1] ) )
+	{
+	    c = (char) ( ( hexValue( src[0] ) << 4 ) | hexValue( src[1] ) );
+	    src += 2;
+	}
+
+	if ( c == '/' && dest > rawPath && dest[-1] == '/' )
+	    continue;
+
+	*dest++ = c;
     }
-    else
-    {
-	name_ret = components.takeLast();
-	path_ret = components.join( "/" );
 
-	if ( absolutePath )
-	    path_ret.prepend( "/" );
+    int len = dest - rawPath;
+
+    if ( len > 1 && rawPath[ len-1 ] == '/' )	// Trailing slash
+	--len;
+
+    if ( len == 1 && *rawPath == '/' )		// Root directory
+    {
+	path_ret = QString();
+	name_ret = "/";
+	return;
     }
+
+    int nameStart = len;
+
+    while ( nameStart > 0 && rawPath[ nameStart-1 ] != '/' )
+	--nameStart;
+
+    name_ret = QString::fromUtf8( rawPath + nameStart, len - nameStart );
+
+    if ( nameStart == 0 )			// No path at all
+	path_ret = QString();
+    else if ( nameStart == 1 )			// Directly below "/"
+	path_ret = "/";
+    else
+	path_ret = QString::fromUtf8( rawPath, nameStart - 1 );
 }
 
 
@@ -744,24 +1924,6 @@ QString CacheReader::buildPath( const QString & path, const QString & name ) con
 }
 
 
-QString CacheReader::unescapedPath( const QString & rawPath ) const
-{
-    // Using a protocol part to avoid directory names with a colon ":"
-    // being cut off because it looks like a URL protocol.
-    QString protocol = "foo:";
-    QString url = protocol + cleanPath( rawPath );
-
-    return QUrl::fromEncoded( url.toUtf8() ).path();
-}
-
-
-QString CacheReader::cleanPath( const QString & rawPath ) const
-{
-    QString clean = rawPath;
-    return clean.replace( _multiSlash, "/" );
-}
-
-
 void CacheReader::finalizeRecursive( DirInfo * dir )
 {
     if ( dir->readState() != DirOnRequestOnly )
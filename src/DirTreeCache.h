@@ -13,32 +13,283 @@
 
 #include <stdio.h>
 #include <zlib.h>
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QVector>
+#include <QList>
+#include <QSet>
+#include <QHash>
+#include <QFile>
+#include <QElapsedTimer>
+
 #include "DirTree.h"
+#include "CacheStream.h"
 
 #define DEFAULT_CACHE_NAME	".qdirstat.cache.gz"
 #define CACHE_FORMAT_VERSION	"1.0"
 #define MAX_CACHE_LINE_LEN	1024
 #define MAX_FIELDS_PER_LINE	32
+#define CACHE_BATCH_SIZE	1000
+#define MAX_CACHE_BATCHES	64
+#define CACHE_WRITE_BUFFER_SIZE	( 1024 * 1024 )
+#define MAX_CACHE_WRITE_BUFFERS	8
+#define CACHE_INDEX_SUFFIX	".idx"
 
 
 namespace QDirStat
 {
+    class CacheReader;
+
+
+    /**
+     * One parsed line of a cache file, ready to be added to the tree.
+     **/
+    struct CacheRecord
+    {
+	QString		path;		// Unescaped path without the name
+	QString		name;
+	mode_t		mode;
+	FileSize	size;
+	FileSize	blocks;
+	time_t		mtime;
+	int		links;
+	int		lineNo;
+	int		fieldsCount;
+	bool		isDir;
+	bool		absolutePath;	// Did the raw path start with "/"?
+	bool		syntaxError;
+	int		dirStatus;	// CachedDirStatus in refresh mode
+	time_t		liveMtime;	// mtime on disk in refresh mode
+	bool		unread;		// Directory not read yet ("unread: 1")
+    };
+
+
+    /**
+     * Result of comparing a directory from a cache file with the
+     * directory on disk.
+     **/
+    enum CachedDirStatus
+    {
+	CachedDirUnchanged,	// Same mtime on disk
+	CachedDirChanged,	// Different mtime: Entries were added or removed
+	CachedDirGone		// Not on disk anymore or no directory
+    };
+
+    typedef QVector<CacheRecord> CacheRecordList;
+
+
+    /**
+     * Thread for decompressing and parsing a cache file in the background.
+     **/
+    class CacheParserThread: public QThread
+    {
+    public:
+
+	CacheParserThread( CacheReader * reader ):
+	    QThread(),
+	    _reader( reader )
+	    {}
+
+    protected:
+
+	virtual void run() Q_DECL_OVERRIDE;
+
+	CacheReader * _reader;
+    };
+
+
+    /**
+     * A point in a cache file where reading can start: The start of a
+     * gzip member at offset 'compressed' in the file that starts with
+     * offset 'uncompressed' in the uncompressed data.
+     **/
+    struct CacheSyncPoint
+    {
+	qint64 uncompressed;
+	qint64 compressed;
+    };
+
+
+    /**
+     * Compressed output of a CacheWriter to file descriptor 'fd'. If the
+     * thread is started, the buffers are compressed and written in the
+     * background; otherwise write() does that directly.
+     *
+     * With gzip, each buffer is written as a separate gzip member, so
+     * the buffers that are queued at the same time can be compressed
+     * with up to 'threads' threads. The result is still a valid gzip file
+     * (gzip and zlib read concatenated members as one stream). With zstd,
+     * libzstd uses 'threads' worker threads of its own.
+     *
+     * With 'syncPoints', reading can also start at the beginning of each
+     * buffer after the first one: the start of its gzip member or (with
+     * zstd) of its zstd frame.
+     *
+     * With 'streaming', the compressed data are flushed after each
+     * buffer, so a reader at the other end of a pipe gets them right away.
+     *
+     * With NoCompression, the output is written as it is, but still in
+     * the background.
+     **/
+    class CacheCompressorThread: public QThread
+    {
+    public:
+
+	CacheCompressorThread( int		fd,
+			       bool		syncPoints,
+			       bool		streaming   = false,
+			       CacheCompression compression = GzipCompression,
+			       int		threads	    = 1 );
+
+	virtual ~CacheCompressorThread();
+
+	/**
+	 * Write 'buffer'. If the thread is running, this only queues
+	 * 'buffer' and waits while there are already too many buffers
+	 * waiting. Returns 'false' if there was a write error.
+	 **/
+	bool write( const QByteArray & buffer );
+
+	/**
+	 * Write all queued buffers, wait until the thread is finished and
+	 * close the output. Returns 'false' if there was a write error.
+	 **/
+	bool finish();
+
+	/**
+	 * Return the sync points written so far. Only use this after
+	 * finish().
+	 **/
+	const QVector<CacheSyncPoint> & syncPoints() const { return _syncPoints; }
+
+    protected:
+
+	virtual void run() Q_DECL_OVERRIDE;
+
+	/**
+	 * Compress and write 'buffers'.
+	 **/
+	bool writeBuffers( const QList<QByteArray> & buffers );
+
+	/**
+	 * Write 'data' as it is.
+	 **/
+	bool writeAll( const QByteArray & data );
+
+	int			_fd;
+	CacheCompression	_compression;
+	int			_threads;
+	bool			_useSyncPoints;
+	bool			_streaming;
+	qint64			_uncompressedSize;
+	qint64			_compressedSize;
+	QVector<CacheSyncPoint> _syncPoints;
+#ifdef HAVE_ZSTD
+	ZstdCompressor *	_zstd;
+#endif
+
+	QMutex			_mutex;		// Protects the members below
+	QWaitCondition		_bufferQueued;
+	QWaitCondition		_bufferTaken;
+	QList<QByteArray>	_buffers;
+	bool			_finished;
+	bool			_ok;
+    };
+
+
     class CacheWriter
     {
     public:
 
 	/**
-	 * Write 'tree' to file 'fileName' in gzip format (using zlib).
+	 * Write 'tree' to file 'fileName' in gzip format or, if 'fileName'
+	 * ends with ZSTD_CACHE_SUFFIX, in zstd format.
 	 *
 	 * Check CacheWriter::ok() to see if writing the cache file went OK.
+	 *
+	 * If 'compressInThread' is true, the output is compressed in
+	 * separate threads (one per CPU) while the next lines are formatted.
+	 *
+	 * If 'writeIndex' is true, an index for reading subtrees is written
+	 * to a file with CACHE_INDEX_SUFFIX appended to 'fileName'. See
+	 * CacheReader::setSubtree().
 	 **/
-	CacheWriter( const QString & fileName, DirTree *tree );
+	CacheWriter( const QString & fileName,
+		     DirTree *	     tree,
+		     bool	     compressInThread = true,
+		     bool	     writeIndex	      = false );
 
 	/**
-	 * Destructor
+	 * Constructor for writing a cache file entry by entry with open(),
+	 * writeEntry() and close() without a DirTree.
+	 **/
+	CacheWriter();
+
+	/**
+	 * Destructor. This closes the cache file if it is still open.
 	 **/
 	virtual ~CacheWriter();
 
+	/**
+	 * Open cache file 'fileName' for writing and write the header.
+	 * Returns 'true' if OK, 'false' upon error.
+	 *
+	 * The compression depends on the suffix of 'fileName', see
+	 * compressionForFile().
+	 *
+	 * "-" means stdout: The output is streamed to whatever reads it
+	 * there, so it is flushed at least every half second, and there is
+	 * no index.
+	 **/
+	bool open( const QString & fileName,
+		   bool		   compressInThread = true,
+		   bool		   writeIndex	    = false );
+
+	/**
+	 * Write one entry to the cache file:
+	 *
+	 * 'mode' is the st_mode of the entry. 'path' with 'len' bytes (in
+	 * UTF-8) is the absolute path for directories and the name without
+	 * path for all others; directories need to be written before their
+	 * files, and all files of a directory before its subdirectories.
+	 *
+	 * 'size' is the size as returned by FileInfo::size(). 'blocks' is
+	 * only written if it is not negative (for sparse files), 'links' only
+	 * if it is more than 1 (for files with hard links).
+	 *
+	 * 'unread' marks a directory whose entries were not read (yet), e.g.
+	 * in a checkpoint of a scan that is still in progress: Its files are
+	 * not in the cache file, and reading the cache file reads it from
+	 * disk.
+	 **/
+	void writeEntry( mode_t		mode,
+			 const char *	path,
+			 int		len,
+			 FileSize	size,
+			 time_t		mtime,
+			 FileSize	blocks = -1,
+			 int		links  = 1,
+			 bool		unread = false );
+
+	/**
+	 * Write the rest of the cache file and close it.
+	 * Returns 'true' if everything was written OK.
+	 **/
+	bool close();
+
+	/**
+	 * Return the cache file type name ("F", "D", "L", ...) for 'mode'.
+	 **/
+	static const char * fileType( mode_t mode );
+
+	/**
+	 * Append 'len' bytes of UTF-8 'path' in URL-encoded form like in the
+	 * cache file to 'target'.
+	 **/
+	static void urlEncode( QByteArray & target, const char * path, int len );
+
 	/**
 	 * Returns true if writing the cache file went OK.
 	 **/
@@ -61,16 +312,27 @@ namespace QDirStat
 	bool writeCache( const QString & fileName, DirTree *tree );
 
 	/**
-	 * Write 'item' recursively to cache file 'cache'.
-	 * Uses zlib to write gzip-compressed files.
+	 * Write 'item' recursively to the cache file.
 	 **/
-	void writeTree( gzFile cache, FileInfo * item );
+	void writeTree( FileInfo * item );
 
 	/**
-	 * Write 'item' to cache file 'cache' without recursion.
-	 * Uses zlib to write gzip-compressed files.
+	 * Write 'item' to the cache file without recursion. Derived classes
+	 * can reimplement this to write something else for each item of
+	 * writeTree().
 	 **/
-	void writeItem( gzFile cache, FileInfo * item );
+	virtual void writeItem( FileInfo * item );
+
+	/**
+	 * Write the header of the cache file. This is called by open().
+	 **/
+	virtual void writeHeader();
+
+	/**
+	 * Return 'true' if 'item' is a directory whose entries are not read
+	 * yet.
+	 **/
+	static bool isUnread( FileInfo * item );
 
         /**
          * Return the 'path' in an URL-encoded form, i.e. with some special
@@ -78,11 +340,64 @@ namespace QDirStat
          **/
         QByteArray urlEncoded( const QString & path );
 
+	/**
+	 * Append 'str' to the output buffer.
+	 **/
+	void append( const char * str );
+
+	/**
+	 * Append the decimal representation of 'num' to the output buffer.
+	 **/
+	void appendNumber( qint64 num );
+
+	/**
+	 * Append 'num' in hex notation ("0x1a2b") to the output buffer.
+	 **/
+	void appendHex( quint64 num );
+
+	/**
+	 * Append 'size' to the output buffer in the format of formatSize().
+	 **/
+	void appendSize( FileSize size );
+
+	/**
+	 * Append 'len' bytes of UTF-8 'path' in URL-encoded form to the
+	 * output buffer.
+	 **/
+	void appendUrlEncoded( const char * path, int len );
+
+	/**
+	 * Write the output buffer to the cache file if it is full (or in
+	 * any case if 'force' is true).
+	 **/
+	void flush( bool force = false );
+
+	/**
+	 * Add the directory 'path' that starts at the current output
+	 * position to the index.
+	 **/
+	void addToIndex( const char * path, int len );
+
+	/**
+	 * Write the rest of the index file and close it.
+	 **/
+	bool closeIndex();
+
 	//
 	// Data members
 	//
 
-	bool _ok;
+	bool			_ok;
+	bool			_compressInThread;
+	bool			_writeIndex;
+	CacheCompression	_compression;	// Gzip by default, see open()
+	QByteArray		_buffer;
+	qint64			_written;	// Uncompressed bytes flushed
+	CacheCompressorThread * _compressor;	// Non-null while open
+	QFile			_indexFile;
+	QByteArray		_indexBuffer;
+	bool			_streaming;	// Writing to stdout
+	QElapsedTimer		_flushTimer;	// Only when streaming
     };
 
 
@@ -101,14 +416,48 @@ namespace QDirStat
 		     DirTree	   * tree,
 		     DirInfo	   * parent = 0 );
 
+	/**
+	 * Begin reading a cache file that is streamed to file descriptor
+	 * 'fd', e.g. a pipe from another process. 'name' is only used for
+	 * messages. This takes over 'fd'.
+	 *
+	 * All data are read by the parser thread, so even the header is only
+	 * read with the first read(); it doesn't matter how long the other
+	 * side takes to send anything. Such a cache file can't be rewound
+	 * and there is no subtree support.
+	 **/
+	CacheReader( int	     fd,
+		     const QString & name,
+		     DirTree	   * tree,
+		     DirInfo	   * parent = 0 );
+
+	/**
+	 * Return 'true' if this reader reads a stream rather than a file.
+	 **/
+	bool isStreaming() const { return _streaming; }
+
+	/**
+	 * Start decompressing and parsing the cache file in the parser thread
+	 * right away, not only with the first read(). This is useful when
+	 * several cache files are read at the same time.
+	 **/
+	void prefetch();
+
 	/**
 	 * Destructor
 	 **/
 	virtual ~CacheReader();
 
 	/**
-	 * Read at most maxLines from the cache file (check with eof() if the
-	 * end of file is reached yet) or the entire file (if maxLines is 0).
+	 * Add at most maxLines from the cache file to the tree (check with
+	 * eof() if the end of file is reached yet) or the entire file (if
+	 * maxLines is 0).
+	 *
+	 * Decompressing and parsing the file is done in a background thread
+	 * that is started with the first call to this; only adding the
+	 * parsed items to the tree is done here. If the background thread
+	 * is not ready with the next lines yet, this returns after a short
+	 * time without adding anything (unless maxLines is 0).
 	 *
 	 * Returns true if OK and there is more to read, false otherwise.
 	 **/
@@ -150,6 +499,55 @@ namespace QDirStat
 	 **/
 	DirTree * tree() const { return _tree; }
 
+	/**
+	 * Set refresh mode: Compare each directory of the cache file with
+	 * the directory on disk. Directories that are no longer on disk are
+	 * skipped; for directories with a different mtime, the entries are
+	 * read from disk instead of from the cache file. Subdirectories are
+	 * checked the same way, so unchanged subtrees are still taken from
+	 * the cache file.
+	 *
+	 * Since the mtime of a directory only changes when entries are
+	 * added, removed or renamed, changes of the content of files in an
+	 * otherwise unchanged directory are not noticed.
+	 *
+	 * This has to be set before the first read().
+	 **/
+	void setRefresh( bool refresh ) { _refresh = refresh; }
+
+	/**
+	 * Return 'true' if this reader is in refresh mode.
+	 **/
+	bool refresh() const { return _refresh; }
+
+	/**
+	 * Read only the subtree 'path' from the cache file (the complete file
+	 * if 'path' is empty). If there is an index file for the cache file
+	 * (the cache file name with CACHE_INDEX_SUFFIX appended), reading
+	 * starts at the sync point right before that subtree, so only that
+	 * part of the file is decompressed; otherwise everything before the
+	 * subtree is skipped.
+	 *
+	 * This has to be set before the first read().
+	 **/
+	void setSubtree( const QString & path );
+
+	/**
+	 * Queue read jobs for all directories that changed on disk. Call
+	 * this when reading the cache file is finished.
+	 **/
+	void queueRefreshJobs();
+
+	/**
+	 * Compare the directory 'path' that has 'cachedMtime' in a cache
+	 * file with the directory on disk. Return the mtime on disk in
+	 * 'liveMtime_ret'. This does not access any tree, so it can be used
+	 * from any thread.
+	 **/
+	static CachedDirStatus checkCachedDir( const QString & path,
+					       time_t	       cachedMtime,
+					       time_t	     & liveMtime_ret );
+
 	/**
 	 * Skip leading whitespace from a string.
 	 * Returns a pointer to the first character that is non-whitespace.
@@ -199,9 +597,24 @@ namespace QDirStat
 	bool checkHeader();
 
 	/**
-	 * Use _fields to add one item to _tree.
+	 * Return 'true' if the current line (after splitLine()) is a valid
+	 * cache file header. Unlike checkHeader(), this doesn't change
+	 * anything, so it can be used from the parser thread.
+	 **/
+	bool isHeader() const;
+
+	/**
+	 * Add the item from 'record' to _tree. Derived classes can
+	 * reimplement this to do something else with the records.
 	 **/
-	void addItem();
+	virtual void addItem( const CacheRecord & record );
+
+	/**
+	 * Parse the fields of the current input line after splitLine() into
+	 * 'record'. This does not access the tree, so it can be done in the
+	 * parser thread.
+	 **/
+	void parseRecord( CacheRecord & record );
 
 	/**
 	 * Read the next line that is not empty or a comment and store it in
@@ -211,6 +624,51 @@ namespace QDirStat
 	 **/
 	bool readLine();
 
+	/**
+	 * Like readLine(), but only set _readError if there is a read error,
+	 * so this can be used from the parser thread.
+	 **/
+	bool readNextLine();
+
+	/**
+	 * Reopen the cache file and go to the start of _subtree using the
+	 * index file. Returns 'true' if the index was used, 'false' if
+	 * reading starts at the beginning of the file.
+	 **/
+	bool seekToSubtree();
+
+	/**
+	 * Check if a record should be added to the tree if only _subtree is
+	 * read. Returns 'false' if the end of the subtree is reached, i.e.
+	 * if parsing can stop. 'skip_ret' is set to 'true' if the record is
+	 * still before the subtree.
+	 **/
+	bool checkSubtree( const CacheRecord & record, bool & skip_ret );
+
+	/**
+	 * Parse all remaining lines of the cache file and queue them in
+	 * batches for read(). This runs in the parser thread.
+	 **/
+	void parseLines();
+
+	/**
+	 * Queue a batch of parsed records. This waits while there are
+	 * already too many batches waiting. Returns 'false' if the parser
+	 * should stop.
+	 **/
+	bool queueBatch( const CacheRecordList & batch );
+
+	/**
+	 * Start the parser thread.
+	 **/
+	void startParser();
+
+	/**
+	 * Stop the parser thread (if it is running) and discard all batches
+	 * that were not read yet.
+	 **/
+	void stopParser();
+
 	/**
 	 * split the current input line into fields separated by whitespace.
 	 **/
@@ -223,33 +681,26 @@ namespace QDirStat
 	char * field( int no );
 
 	/**
-	 * Split up a file name with path into its path and its name component
-	 * and return them in path_ret and name_ret, respectively.
+	 * Split up the raw (URL-encoded) file name with path 'rawPath' of a
+	 * cache line into its path and its name component and return them in
+	 * path_ret and name_ret, respectively. Duplicate slashes are collapsed.
+	 *
+	 * This works in place on the line buffer with no QString other than
+	 * the results, so 'rawPath' is garbage afterwards.
 	 *
 	 * Example:
-	 *     "/some/dir/somewhere/myfile.obj"
-	 * ->  "/some/dir/somewhere", "myfile.obj"
+	 *     "/some/dir//somewhere/my%20file.obj"
+	 * ->  "/some/dir/somewhere", "my file.obj"
 	 **/
-	void splitPath( const QString & fileNameWithPath,
-			QString	      & path_ret,
-			QString	      & name_ret ) const;
+	static void splitPath( char    * rawPath,
+			       QString & path_ret,
+			       QString & name_ret );
 
 	/**
 	 * Build a full path from path + file name (without path).
 	 **/
 	QString buildPath( const QString & path, const QString & name ) const;
 
-	/**
-	 * Return an unescaped version of 'rawPath'.
-	 **/
-	QString unescapedPath( const QString & rawPath ) const;
-
-	/**
-	 * Clean a path: Replace duplicate (or triplicate or more) slashes with
-	 * just one. QUrl doesn't seem to handle those well.
-	 **/
-	QString cleanPath( const QString & rawPath ) const;
-
 	/**
 	 * Returns the number of fields in the current input line after
 	 * splitLine().
@@ -275,7 +726,7 @@ namespace QDirStat
 	//
 
 	DirTree *	_tree;
-	gzFile		_cache;
+	CacheInput *	_cache;
 	char		_buffer[ MAX_CACHE_LINE_LEN ];
 	char *		_line;
 	int		_lineNo;
@@ -288,7 +739,37 @@ namespace QDirStat
 	DirInfo *	_lastDir;
 	DirInfo *	_lastExcludedDir;
 	QString		_lastExcludedDirUrl;
-        QRegExp         _multiSlash;
+	QHash<QString, DirInfo *> _dirs;	// By URL, for any line order
+	bool		_readError;
+
+	// Refresh mode
+
+	bool		_refresh;
+	bool		_skipFiles;	// Skip the files of the last dir line
+	QString		_skippedDirUrl; // Skip everything below this
+	QSet<DirInfo *> _refreshDirs;
+
+	// Reading a subtree
+
+	QString		_subtree;
+	bool		_subtreeStarted;
+
+	// Reading a stream
+
+	bool		_streaming;
+	bool		_headerPending;	// For the parser thread
+
+	// Parser thread
+
+	CacheParserThread *	_parserThread;
+	QMutex			_batchMutex;	// Protects the members below
+	QWaitCondition		_batchQueued;
+	QWaitCondition		_batchTaken;
+	QList<CacheRecordList>	_batches;
+	bool			_parserFinished;
+	bool			_stopParser;
+
+	friend class CacheParserThread;
     };
 
 }	// namespace QDirStat
@@ -7,8 +7,21 @@
  */
 
 
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
+
 #include "DirTreeModel.h"
 #include "DirTree.h"
+#include "DirTreeWatcher.h"
+#include "CacheBudget.h"
+#include "CacheDiff.h"
+#include "ExtentStats.h"
+#include "DirReadTimes.h"
+#include "QuotaEstimates.h"
+#include "DirReadJob.h"
+#include "ScanThrottle.h"
+#include "Statx.h"
 #include "FileInfoIterator.h"
 #include "DataColumns.h"
 #include "SelectionModel.h"
@@ -24,20 +37,33 @@ DirTreeModel::DirTreeModel( QObject * parent ):
     QAbstractItemModel( parent ),
     _tree(0),
     _selectionModel(0),
+    _iconsLoaded( false ),
     _readJobsCol( PercentBarCol ),
     _updateTimerMillisec( 333 ),
     _slowUpdateMillisec( 3000 ),
     _slowUpdate( false ),
+    _fetchPageSize( 5000 ),
+    _removingRows( false ),
+    _textCache( 4000 ),
+    _textGeneration( 0 ),
     _sortCol( NameCol ),
-    _sortOrder( Qt::AscendingOrder )
+    _sortOrder( Qt::AscendingOrder ),
+    _typeSummaries( false ),
+    _recordReadTimes( false ),
+    _visibleAggregates( NoAggregates )
 {
     createTree();
     readSettings();
-    loadIcons();
     _updateTimer.setInterval( _updateTimerMillisec );
 
     connect( &_updateTimer, SIGNAL( timeout()		 ),
 	     this,	    SLOT  ( sendPendingUpdates() ) );
+
+    connect( CacheBudget::instance(), SIGNAL( aboutToDropSortCaches() ),
+	     this,		      SLOT  ( aboutToDropSortCaches() ) );
+
+    connect( CacheBudget::instance(), SIGNAL( sortCachesDropped() ),
+	     this,		      SLOT  ( sortCachesDropped() ) );
 }
 
 
@@ -56,11 +82,44 @@ void DirTreeModel::readSettings()
     settings.beginGroup( "DirectoryTree" );
 
     _tree->setCrossFileSystems( settings.value( "CrossFileSystems", false ).toBool() );
+    _tree->setScannerThreads  ( settings.value( "ScannerThreads",   1     ).toInt()  );
+    _tree->setDepthFirstReading( settings.value( "DepthFirstReading", false ).toBool() );
+    _tree->setFastScan	      ( settings.value( "FastScan",	    false ).toBool() );
+    _tree->setLazySummaries   ( settings.value( "LazySummaries",    false ).toBool() );
+    _tree->setAggregateOnly   ( settings.value( "AggregateOnly",    false ).toBool() );
+    _tree->setCompactColdSubtrees( settings.value( "CompactColdSubtrees", false ).toBool() );
+    _tree->setCountOwners	 ( settings.value( "CountOwners",	  true	).toBool() );
+    _tree->setPrecomputeStats ( settings.value( "PrecomputeStats",  false ).toBool() );
+    _tree->setCompactChildren ( settings.value( "CompactChildren",  false ).toBool() );
+    _tree->setChildColumns    ( settings.value( "ChildColumns",     false ).toBool() );
+    _typeSummaries = settings.value( "TypeSummaries", false ).toBool();
+    _tree->setCountHardLinksOnce( settings.value( "CountHardLinksOnce", false ).toBool() );
+    _tree->setScanBackend( scanBackendFromName( settings.value( "ScanBackend", "lstat" ).toString() ) );
+    _tree->setWriteCacheIndex( settings.value( "WriteCacheIndex", false ).toBool() );
+    _recordReadTimes = settings.value( "RecordReadTimes", false ).toBool();
+    _tree->setQuickEstimates ( settings.value( "QuickEstimates",  false ).toBool() );
+    _tree->setWatchFileSystem( settings.value( "WatchFileSystem", false ).toBool() );
+    _tree->setCheckpoints( settings.value( "CheckpointFile", DirTree::defaultCheckpointFile() ).toString(),
+			   settings.value( "CheckpointInterval", 0 ).toInt() );
+    _tree->setAutoCacheFile( settings.value( "AutoCacheFile", "" ).toString() );
+    _tree->setMetricsFile( settings.value( "MetricsFile", "" ).toString() );
+    RemoteDirReadJob::setRemoteCommand( settings.value( "RemoteCommand", "qdirstat" ).toString() );
+    Statx::setUseCachedAttributes( settings.value( "UseCachedAttributes", false ).toBool() );
+
+    if ( _tree->watcher() )
+	_tree->watcher()->setMaxWatches( settings.value( "MaxWatches", 100000 ).toInt() );
+
     _treeIconDir	 = settings.value( "TreeIconDir" , ":/icons/tree-medium/" ).toString();
     _updateTimerMillisec = settings.value( "UpdateTimerMillisec", 333 ).toInt();
     _slowUpdateMillisec  = settings.value( "SlowUpdateMillisec", 3000 ).toInt();
+    _fetchPageSize	 = settings.value( "FetchPageSize", 5000 ).toInt();
+
+    CacheBudget::instance()->setBudget( 1024LL * 1024 * settings.value( "CacheBudgetMB", 256 ).toInt() );
 
     settings.endGroup();
+
+    updateAggregates();
+    ScanThrottle::instance()->readSettings();
 }
 
 
@@ -70,11 +129,42 @@ void DirTreeModel::writeSettings()
     settings.beginGroup( "DirectoryTree" );
 
     settings.setValue( "CrossFileSystems",    _tree ? _tree->crossFileSystems() : false );
+    settings.setValue( "ScannerThreads",      _tree ? _tree->scannerThreads()   : 1     );
+    settings.setValue( "DepthFirstReading",   _tree ? _tree->depthFirstReading() : false );
+    settings.setValue( "FastScan",	      _tree ? _tree->fastScan()		: false );
+    settings.setValue( "LazySummaries",	      _tree ? _tree->lazySummaries()	: false );
+    settings.setValue( "AggregateOnly",	      _tree ? _tree->aggregateOnly()	: false );
+    settings.setValue( "CompactColdSubtrees", _tree ? _tree->compactColdSubtrees() : false );
+    settings.setValue( "CountOwners",	      _tree ? _tree->countOwners()	  : true  );
+    settings.setValue( "PrecomputeStats",     _tree ? _tree->precomputeStats()	: false );
+    settings.setValue( "CompactChildren",     _tree ? _tree->compactChildren()	: false );
+    settings.setValue( "ChildColumns",	      _tree ? _tree->childColumns()	: false );
+    settings.setValue( "TypeSummaries",	      _typeSummaries );
+    settings.setValue( "CountHardLinksOnce",  _tree ? _tree->countHardLinksOnce() : false );
+    settings.setValue( "ScanBackend",	      scanBackendName( _tree ? _tree->scanBackend() : LstatScanBackend ) );
+    settings.setValue( "WriteCacheIndex",     _tree ? _tree->writeCacheIndex()	: false );
+    settings.setValue( "RecordReadTimes",     _recordReadTimes );
+    settings.setValue( "QuickEstimates",      _tree ? _tree->quickEstimates()	: false );
+    settings.setValue( "WatchFileSystem",     _tree ? _tree->watchFileSystem()	: false );
+    settings.setValue( "CheckpointFile",      _tree ? _tree->checkpointFile()	: DirTree::defaultCheckpointFile() );
+    settings.setValue( "CheckpointInterval",  _tree ? _tree->checkpointInterval() : 0 );
+    settings.setValue( "AutoCacheFile",	      _tree ? _tree->autoCacheFile()	: QString() );
+    settings.setValue( "MetricsFile",	      _tree ? _tree->metricsFile()	: QString() );
+    settings.setValue( "RemoteCommand",	      RemoteDirReadJob::remoteCommand() );
+    settings.setValue( "UseCachedAttributes", Statx::useCachedAttributes() );
+
+    if ( _tree && _tree->watcher() )
+	settings.setValue( "MaxWatches", _tree->watcher()->maxWatches() );
+
     settings.setValue( "TreeIconDir" ,	      _treeIconDir	   );
     settings.setValue( "UpdateTimerMillisec", _updateTimerMillisec );
     settings.setValue( "SlowUpdateMillisec",  _slowUpdateMillisec  );
+    settings.setValue( "FetchPageSize",	      _fetchPageSize	   );
+    settings.setValue( "CacheBudgetMB",	      (int) ( CacheBudget::budget() / ( 1024 * 1024 ) ) );
 
     settings.endGroup();
+
+    ScanThrottle::instance()->writeSettings();
 }
 
 
@@ -102,6 +192,12 @@ void DirTreeModel::createTree()
     connect( _tree, SIGNAL( aborted()	      ),
 	     this,  SLOT  ( readingFinished() ) );
 
+    connect( _tree, SIGNAL( cacheDiffChanged()	  ),
+	     this,  SLOT  ( extraColumnsChanged() ) );
+
+    connect( _tree, SIGNAL( extentStatsChanged()  ),
+	     this,  SLOT  ( extraColumnsChanged() ) );
+
     connect( _tree, SIGNAL( readJobFinished( DirInfo * ) ),
 	     this,  SLOT  ( readJobFinished( DirInfo * ) ) );
 
@@ -114,6 +210,9 @@ void DirTreeModel::createTree()
     connect( _tree, SIGNAL( subtreeCleared( DirInfo * ) ),
 	     this,  SLOT  ( subtreeCleared( DirInfo * ) ) );
 
+    connect( _tree, SIGNAL( childrenChanging( DirInfo * ) ),
+	     this,  SLOT  ( childrenChanging( DirInfo * ) ) );
+
     connect( _tree, SIGNAL( childDeleted() ),
 	     this,  SLOT  ( childDeleted() ) );
 }
@@ -129,6 +228,10 @@ void DirTreeModel::clear()
 	// dumpPersistentIndexList();
 
 	_tree->clear();
+	_textCache.clear();
+	_pendingInserts.clear();
+	_pendingUpdates.clear();
+	_fetchedRows.clear();
 	endResetModel();
 
 	// logDebug() << "After endResetModel()" << endl;
@@ -151,6 +254,8 @@ void DirTreeModel::openUrl( const QString &url )
 
 void DirTreeModel::loadIcons()
 {
+    _iconsLoaded = true;
+
     if ( _treeIconDir.isEmpty() )
     {
 	logWarning() << "No tree icons" << endl;
@@ -210,10 +315,7 @@ int DirTreeModel::rowNumber( FileInfo * child ) const
     if ( ! child->parent() )
 	return 0;
 
-    const FileInfoList & childrenList =
-	child->parent()->sortedChildren( _sortCol, _sortOrder );
-
-    int row = childrenList.indexOf( child );
+    int row = child->parent()->sortedChildRow( child, _sortCol, _sortOrder );
 
     if ( row < 0 )
     {
@@ -238,6 +340,41 @@ int DirTreeModel::countDirectChildren( FileInfo * parent ) const
 }
 
 
+int DirTreeModel::countDirectChildren( FileInfo * parent, int maxCount ) const
+{
+    int count = 0;
+    FileInfo * child = parent->firstChild();
+
+    while ( child && count < maxCount )
+    {
+	++count;
+	child = child->next();
+    }
+
+    if ( count < maxCount && parent->dotEntry() )
+	++count;
+
+    return count;
+}
+
+
+int DirTreeModel::fetchedRows( FileInfo * dir ) const
+{
+    if ( _fetchPageSize <= 0 )
+	return countDirectChildren( dir );
+
+    // Only the first page of a directory with many children is shown
+    // until the view fetches more.
+
+    int limit = _fetchPageSize;
+
+    if ( ! _fetchedRows.isEmpty() && dir->isDirInfo() )
+	limit = _fetchedRows.value( dir->toDirInfo(), _fetchPageSize );
+
+    return countDirectChildren( dir, limit );
+}
+
+
 
 //
 // Reimplented from QAbstractItemModel
@@ -248,7 +385,6 @@ int DirTreeModel::rowCount( const QModelIndex &parentIndex ) const
     if ( ! _tree )
 	return 0;
 
-    int count = 0;
     FileInfo * item = 0;
 
     if ( parentIndex.isValid() )
@@ -259,15 +395,48 @@ int DirTreeModel::rowCount( const QModelIndex &parentIndex ) const
     else
 	item = _tree->root();
 
+    return shownRows( item );
+}
+
+
+bool DirTreeModel::hasChildren( const QModelIndex & parentIndex ) const
+{
+    if ( _tree && parentIndex.isValid() )
+    {
+	FileInfo * item = static_cast<FileInfo *>( parentIndex.internalPointer() );
+
+	if ( item->isDirInfo() && item->toDirInfo()->isCold() && ! item->toDirInfo()->isLocked() )
+	    return true;
+    }
+
+    return QAbstractItemModel::hasChildren( parentIndex );
+}
+
+
+int DirTreeModel::shownRows( FileInfo * item ) const
+{
+    int count = 0;
+
     if ( ! item->isDirInfo() )
 	return 0;
 
+    // The view learns about the children of a finished directory only with
+    // the next batch of insertions; until then, it has none.
+
+    if ( ! _pendingInserts.isEmpty() && _pendingInserts.contains( item->toDirInfo() ) )
+	return 0;
+
     if ( item->toDirInfo()->isLocked() )
     {
 	// logDebug() << item << " is locked - returning 0" << endl;
 	return 0;
     }
 
+    // The view wants the children now: Restore them if they were compacted
+
+    if ( item->toDirInfo()->isCold() )
+	item->toDirInfo()->thaw();
+
     switch ( item->readState() )
     {
 	case DirQueued:
@@ -301,14 +470,14 @@ int DirTreeModel::rowCount( const QModelIndex &parentIndex ) const
             if ( _tree->isBusy() )
                 count = 0;
             else
-                count = countDirectChildren( item );
+                count = fetchedRows( item );
             break;
 
 	case DirFinished:
 	case DirOnRequestOnly:
 	case DirCached:
 	case DirAborted:
-	    count = countDirectChildren( item );
+	    count = fetchedRows( item );
 	    break;
 
 	// intentionally omitting 'default' case so the compiler can report
@@ -320,6 +489,48 @@ int DirTreeModel::rowCount( const QModelIndex &parentIndex ) const
 }
 
 
+bool DirTreeModel::canFetchMore( const QModelIndex & parentIndex ) const
+{
+    if ( ! _tree || _fetchPageSize <= 0 )
+	return false;
+
+    FileInfo * item = parentIndex.isValid() ?
+	static_cast<FileInfo *>( parentIndex.internalPointer() ) : _tree->root();
+
+    int rows = shownRows( item );
+
+    return rows > 0 && countDirectChildren( item, rows + 1 ) > rows;
+}
+
+
+void DirTreeModel::fetchMore( const QModelIndex & parentIndex )
+{
+    if ( ! canFetchMore( parentIndex ) )
+	return;
+
+    FileInfo * item = parentIndex.isValid() ?
+	static_cast<FileInfo *>( parentIndex.internalPointer() ) : _tree->root();
+
+    fetchRows( item->toDirInfo(), shownRows( item ) + _fetchPageSize );
+}
+
+
+void DirTreeModel::fetchRows( DirInfo * dir, int rows )
+{
+    int shown = shownRows( dir );
+    int count = countDirectChildren( dir, rows );
+
+    if ( shown == 0 || count <= shown )
+	return;
+
+    // logDebug() << "Fetching rows " << shown << ".." << count - 1 << " of " << dir << endl;
+
+    beginInsertRows( modelIndex( dir, 0 ), shown, count - 1 );
+    _fetchedRows[ dir ] = count;
+    endInsertRows();
+}
+
+
 int DirTreeModel::columnCount( const QModelIndex &parent ) const
 {
     Q_UNUSED( parent );
@@ -343,7 +554,7 @@ QVariant DirTreeModel::data( const QModelIndex &index, int role ) const
                 CHECK_PTR( item );
 		CHECK_MAGIC( item );
 
-		QVariant result = columnText( item, col );
+		QVariant result = cachedColumnText( item, col );
 
 		if ( item && item->isDirInfo() )
 		{
@@ -376,6 +587,9 @@ QVariant DirTreeModel::data( const QModelIndex &index, int role ) const
 		    case TotalItemsCol:
 		    case TotalFilesCol:
 		    case TotalSubDirsCol:
+		    case GrowthCol:
+		    case ExclusiveSizeCol:
+		    case ReadTimeCol:
 			alignment |= Qt::AlignRight;
 			break;
 
@@ -417,6 +631,10 @@ QVariant DirTreeModel::data( const QModelIndex &index, int role ) const
 		    case TotalFilesCol:	  return item->totalFiles();
 		    case TotalSubDirsCol: return item->totalSubDirs();
 		    case LatestMTimeCol:  return (qulonglong) item->latestMtime();
+		    case MainCategoryCol: return _tree->mainCategoryName( item );
+		    case GrowthCol:	  return _tree->cacheDiff() ? _tree->cacheDiff()->sizeDelta( item ) : 0;
+		    case ExclusiveSizeCol: return _tree->extentStats() ? _tree->extentStats()->exclusiveSize( item ) : 0;
+		    case ReadTimeCol:	  return _tree->readTimes() ? (qlonglong) _tree->readTimes()->readTime( item ).usec : 0;
 		    default:		  return QVariant();
 		}
 	    }
@@ -451,6 +669,10 @@ QVariant DirTreeModel::headerData( int		   section,
 		case TotalFilesCol:	return tr( "Files"		);
 		case TotalSubDirsCol:	return tr( "Subdirs"		);
 		case LatestMTimeCol:	return tr( "Last Modified"	);
+		case MainCategoryCol:	return tr( "Main Category"	);
+		case GrowthCol:		return tr( "Growth"		);
+		case ExclusiveSizeCol:	return tr( "Exclusive Size"	);
+		case ReadTimeCol:	return tr( "Read Time"		);
 		default:		return QVariant();
 	    }
 
@@ -569,6 +791,22 @@ void DirTreeModel::sort( int column, Qt::SortOrder order )
 //---------------------------------------------------------------------------
 
 
+void DirTreeModel::aboutToDropSortCaches()
+{
+    emit layoutAboutToBeChanged();
+}
+
+
+void DirTreeModel::sortCachesDropped()
+{
+    // Sorting again might put children that are equal for the sort column
+    // into a different order, so the persistent indexes need updating.
+
+    updatePersistentIndexes();
+    emit layoutChanged();
+}
+
+
 void DirTreeModel::busyDisplay()
 {
     emit layoutAboutToBeChanged();
@@ -604,11 +842,168 @@ QModelIndex DirTreeModel::modelIndex( FileInfo * item, int column ) const
     {
 	int row = rowNumber( item );
 	// logDebug() << item << " is row #" << row << " of " << item->parent() << endl;
-	return row < 0 ? QModelIndex() : createIndex( row, column, item );
+
+	if ( row < 0 || isPendingRow( item ) )
+	    return QModelIndex();
+
+	if ( _fetchPageSize > 0 && row >= _fetchPageSize && row >= shownRows( item->parent() ) )
+	{
+	    // Fetch all pages up to this row so the view knows about it
+
+	    int rows = ( row / _fetchPageSize + 1 ) * _fetchPageSize;
+	    const_cast<DirTreeModel *>( this )->fetchRows( item->parent(), rows );
+
+	    if ( row >= shownRows( item->parent() ) )
+		return QModelIndex();
+	}
+
+	return createIndex( row, column, item );
+    }
+}
+
+
+QModelIndexList DirTreeModel::dirIndexes( FileInfo * subtree, int levels ) const
+{
+    QModelIndexList indexes;
+
+    if ( _tree && levels > 0 )
+	addDirIndexes( subtree ? subtree : _tree->root(), levels, indexes );
+
+    return indexes;
+}
+
+
+void DirTreeModel::addDirIndexes( FileInfo * dir, int levels, QModelIndexList & indexes ) const
+{
+    int rows = shownRows( dir );	// This also restores cold directories
+
+    if ( rows <= 0 )
+	return;
+
+    // A copy on purpose: Restoring a cold child may change the sort cache
+
+    FileInfoList children = dir->toDirInfo()->sortedChildren( _sortCol, _sortOrder );
+    rows = qMin( rows, children.size() );
+
+    for ( int row=0; row < rows; ++row )
+    {
+	FileInfo * child = children.at( row );
+
+	if ( ! child->isDirInfo() )
+	    continue;
+
+	indexes << createIndex( row, 0, child );
+
+	if ( levels > 1 )
+	    addDirIndexes( child, levels - 1, indexes );
     }
 }
 
 
+QModelIndexList DirTreeModel::largestPathIndexes( FileInfo * subtree ) const
+{
+    QModelIndexList indexes;
+
+    if ( ! _tree || ! subtree || ! subtree->isDirInfo() )
+	return indexes;
+
+    QModelIndex index = modelIndex( subtree );
+
+    if ( index.isValid() )
+	indexes << index;
+
+    FileInfo * dir = subtree;
+
+    while ( dir )
+    {
+	int rows = shownRows( dir );
+	FileInfo * largest = 0;
+	int largestRow = -1;
+
+	if ( rows > 0 )
+	{
+	    const FileInfoList & children = dir->toDirInfo()->sortedChildren( _sortCol, _sortOrder );
+	    rows = qMin( rows, children.size() );
+
+	    for ( int row=0; row < rows; ++row )
+	    {
+		FileInfo * child = children.at( row );
+
+		if ( child->isDirInfo() && ( ! largest || child->totalSize() > largest->totalSize() ) )
+		{
+		    largest    = child;
+		    largestRow = row;
+		}
+	    }
+	}
+
+	if ( largest )
+	    indexes << createIndex( largestRow, 0, largest );
+
+	dir = largest;
+    }
+
+    return indexes;
+}
+
+
+QModelIndex DirTreeModel::shownModelIndex( FileInfo * item, int column ) const
+{
+    if (  ! item || ! item->checkMagicNumber() || item == _tree->root() )
+	return QModelIndex();
+
+    int row = rowNumber( item );
+
+    if ( row < 0 || isPendingRow( item ) )
+	return QModelIndex();
+
+    if ( _fetchPageSize > 0 && row >= _fetchPageSize && row >= shownRows( item->parent() ) )
+	return QModelIndex();
+
+    return createIndex( row, column, item );
+}
+
+
+bool DirTreeModel::isPendingRow( FileInfo * item ) const
+{
+    return ! _pendingInserts.isEmpty() && _pendingInserts.contains( item->parent() );
+}
+
+
+
+QVariant DirTreeModel::cachedColumnText( FileInfo * item, int col ) const
+{
+    switch ( col )
+    {
+	case NameCol:
+	case PercentBarCol:
+	case MainCategoryCol:
+	    return columnText( item, col );	// Nothing to format
+
+	default:
+	    break;
+    }
+
+    if ( col == _readJobsCol && item->isBusy() )
+	return columnText( item, col );		// Changes all the time
+
+    QPair<FileInfo *, int> key( item, col );
+    CachedText * cached = _textCache.object( key );
+
+    if ( cached && cached->generation == _textGeneration )
+	return cached->text;
+
+    QVariant text = columnText( item, col );
+
+    cached = new CachedText;
+    CHECK_NEW( cached );
+    cached->text       = text;
+    cached->generation = _textGeneration;
+    _textCache.insert( key, cached );
+
+    return text;
+}
+
 
 QVariant DirTreeModel::columnText( FileInfo * item, int col ) const
 {
@@ -624,12 +1019,33 @@ QVariant DirTreeModel::columnText( FileInfo * item, int col ) const
 	case OwnSizeCol:	return ownSizeColText( item );
 	case PercentNumCol:	return item == _tree->firstToplevel() ? QVariant() : formatPercent( item->subtreePercent() );
 	case LatestMTimeCol:	return formatTime( item->latestMtime() );
+	case MainCategoryCol:	return _tree->mainCategoryName( item );
+	case GrowthCol:		return _tree->cacheDiff() ? _tree->cacheDiff()->growthText( item ) : QVariant();
+	case ExclusiveSizeCol:
+	    if ( _tree->extentStats() && _tree->extentStats()->contains( item ) )
+		return formatSize( _tree->extentStats()->exclusiveSize( item ) );
+	    else
+		return QVariant();
+	case ReadTimeCol:
+	    if ( _tree->readTimes() && _tree->readTimes()->contains( item ) )
+		return DirReadTimes::formatReadTime( _tree->readTimes()->readTime( item ).usec );
+	    else
+		return QVariant();
     }
 
     if ( item->isDirInfo() || item->isDotEntry() )
     {
 	QString prefix = item->readState() == DirAborted ? ">" : "";
 
+	// While a directory is still being read, the filesystem may already
+	// know about how big it is (see QuotaEstimates)
+
+	if ( col == TotalSizeCol && item->isBusy() &&
+	     _tree->quotaEstimates() && _tree->quotaEstimates()->contains( item ) )
+	{
+	    return "~" + formatSize( _tree->quotaEstimates()->estimatedSize( item ) );
+	}
+
 	switch ( col )
 	{
 	    case TotalSizeCol:	  return prefix + formatSize( item->totalSize() );
@@ -663,6 +1079,12 @@ QVariant DirTreeModel::ownSizeColText( FileInfo * item ) const
 		.arg( formatSize( item->links() ) )
 		.arg( formatSize( item->allocatedSize() ) );
 	}
+	else if ( item->isDuplicateLink() )
+	{
+	    text = tr( "%1 / %2 Links (counted elsewhere)" )
+		.arg( formatSize( item->byteSize() ) )
+		.arg( item->links() );
+	}
 	else
 	{
 	    text = tr( "%1 / %2 Links" )
@@ -693,6 +1115,9 @@ QVariant DirTreeModel::columnIcon( FileInfo * item, int col ) const
     if ( col != NameCol )
 	return QVariant();
 
+    if ( ! _iconsLoaded )
+	const_cast<DirTreeModel *>( this )->loadIcons();
+
     QPixmap icon;
 
     if	    ( item->isDotEntry() )  icon = _dotEntryIcon;
@@ -721,6 +1146,7 @@ QVariant DirTreeModel::columnIcon( FileInfo * item, int col ) const
 void DirTreeModel::readJobFinished( DirInfo * dir )
 {
     // logDebug() << dir << endl;
+    dropTextCache();
     delayedUpdate( dir );
 
     if ( anyAncestorBusy( dir ) )
@@ -729,7 +1155,13 @@ void DirTreeModel::readJobFinished( DirInfo * dir )
     }
     else
     {
-	newChildrenNotify( dir );
+	// The view is notified about the new children with the next update,
+	// together with those of all other directories finished until then.
+
+	_pendingInserts.insert( dir );
+
+	if ( ! _updateTimer.isActive() )
+	    _updateTimer.start();
     }
 }
 
@@ -767,8 +1199,12 @@ void DirTreeModel::newChildrenNotify( DirInfo * dir )
 	return;
     }
 
+    // The view starts over with the first page of this directory
+
+    _fetchedRows.remove( dir );
+
     QModelIndex index = modelIndex( dir );
-    int count = countDirectChildren( dir );
+    int count = fetchedRows( dir );
     // Debug::dumpDirectChildren( dir );
 
     if ( count > 0 )
@@ -801,56 +1237,231 @@ void DirTreeModel::newChildrenNotify( DirInfo * dir )
 
 void DirTreeModel::delayedUpdate( DirInfo * dir )
 {
-    while ( dir && dir != _tree->root() )
+    // The ancestors are added only when the updates are sent, and then
+    // only once for all directories below them.
+
+    if ( dir && dir != _tree->root() )
+	_pendingUpdates.insert( dir );
+}
+
+
+bool DirTreeModel::anyAncestorIn( DirInfo * dir, const QSet<DirInfo *> & dirs ) const
+{
+    for ( DirInfo * parent = dir->parent(); parent; parent = parent->parent() )
+    {
+	if ( dirs.contains( parent ) )
+	    return true;
+    }
+
+    return false;
+}
+
+
+void DirTreeModel::sendPendingInserts()
+{
+    if ( _pendingInserts.isEmpty() )
+	return;
+
+    // The view has to know the right number of rows again before it is
+    // notified about the insertions.
+
+    QSet<DirInfo *> pending = _pendingInserts;
+    _pendingInserts.clear();
+
+    foreach ( DirInfo * dir, pending )
     {
-	if ( dir->isTouched() )
-	    _pendingUpdates.insert( dir );
+	// A directory that is being read again is notified with its read job;
+	// one below another pending directory is notified with that one.
+
+	if ( anyAncestorBusy( dir ) || anyAncestorIn( dir, pending ) )
+	    continue;
 
-	dir = dir->parent();
+	newChildrenNotify( dir );
     }
 }
 
 
 void DirTreeModel::sendPendingUpdates()
 {
-    // logDebug() << "Sending " << _pendingUpdates.size() << " updates" << endl;
+    QElapsedTimer timer;
+    timer.start();
+
+    dropTextCache();	// Summaries changed while reading
+    sendPendingInserts();
+
+    // Collect the pending directories and all their ancestors that the view
+    // knows about, sorted by parent and row, so one dataChanged() signal
+    // can cover each range of adjacent rows.
 
-    foreach ( DirInfo * dir, _pendingUpdates )
+    QSet<DirInfo *> visited;
+    QHash<DirInfo *, QMap<int, DirInfo *> > rowsByParent;
+
+    foreach ( DirInfo * pending, _pendingUpdates )
     {
-	dataChangedNotify( dir );
+	for ( DirInfo * dir = pending; dir && dir != _tree->root(); dir = dir->parent() )
+	{
+	    if ( visited.contains( dir ) )
+		break;
+
+	    visited.insert( dir );
+
+	    if ( dir->isTouched() )
+	    {
+		int row = rowNumber( dir );
+
+		if ( row >= 0 )
+		    rowsByParent[ dir->parent() ].insert( row, dir );
+	    }
+	}
     }
 
     _pendingUpdates.clear();
-}
+    // logDebug() << "Sending updates for " << visited.size() << " dirs" << endl;
 
+    QHash<DirInfo *, QMap<int, DirInfo *> >::const_iterator it = rowsByParent.constBegin();
 
-void DirTreeModel::dataChangedNotify( DirInfo * dir )
-{
-    if ( ! dir || dir == _tree->root() )
-	return;
+    while ( it != rowsByParent.constEnd() )
+    {
+	const QMap<int, DirInfo *> & rows = it.value();
+	QMap<int, DirInfo *>::const_iterator first = rows.constBegin();
+	int shown = _fetchPageSize > 0 ? shownRows( it.key() ) : rows.size();
+
+	while ( first != rows.constEnd() )
+	{
+	    if ( _fetchPageSize > 0 && first.key() >= shown )
+		break;	// The view doesn't know about these rows
+
+	    QMap<int, DirInfo *>::const_iterator last = first;
+	    QMap<int, DirInfo *>::const_iterator next = first + 1;
+
+	    while ( next != rows.constEnd() && next.key() == last.key() + 1 &&
+		    ( _fetchPageSize <= 0 || next.key() < shown ) )
+	    {
+		last = next++;
+	    }
+
+	    dataChangedNotify( first.key(), first.value(), last.key(), last.value() );
+
+	    for ( QMap<int, DirInfo *>::const_iterator dir = first; dir != next; ++dir )
+	    {
+		// If the view is still interested in these dirs, it will
+		// fetch data, and then they will be touched again. For all we
+		// know now, they might easily be out of scope for the view, so
+		// let's not bother the view again about them until it's clear
+		// that the view still wants updates.
+
+		dir.value()->clearTouched();
+	    }
+
+	    first = next;
+	}
 
-    if ( dir->isTouched() ) // only if the view ever requested data about this dir
+	++it;
+    }
+
+    // Keep the time spent here at about a tenth of the time between two
+    // updates: Update less often for large trees or a slow display.
+
+    if ( ! _slowUpdate && _updateTimer.isActive() )
     {
-	QModelIndex topLeft	= modelIndex( dir, 0 );
-	QModelIndex bottomRight = createIndex( topLeft.row(), DataColumns::instance()->colCount() - 1, dir );
+	int interval = qBound( _updateTimerMillisec,
+			       10 * (int) timer.elapsed(),
+			       qMax( _updateTimerMillisec, _slowUpdateMillisec ) );
+
+	if ( interval != _updateTimer.interval() )
+	    _updateTimer.setInterval( interval );
+    }
+}
+
+
+void DirTreeModel::dataChangedNotify( int	 firstRow,
+				      DirInfo * firstDir,
+				      int	 lastRow,
+				      DirInfo * lastDir )
+{
+    QModelIndex topLeft	    = createIndex( firstRow, 0, firstDir );
+    QModelIndex bottomRight = createIndex( lastRow, DataColumns::instance()->colCount() - 1, lastDir );
 
 #if (QT_VERSION < QT_VERSION_CHECK( 5, 1, 0))
-	emit dataChanged( topLeft, bottomRight );
+    emit dataChanged( topLeft, bottomRight );
 #else
-	QVector<int> roles;
-	roles << Qt::DisplayRole;
+    QVector<int> roles;
+    roles << Qt::DisplayRole;
 
-	emit dataChanged( topLeft, bottomRight, roles );
+    emit dataChanged( topLeft, bottomRight, roles );
 #endif
-	// logDebug() << "Data changed for " << dir << endl;
+    // logDebug() << "Data changed for rows " << firstRow << ".." << lastRow
+    //	      << " of " << firstDir->parent() << endl;
+}
+
+
+void DirTreeModel::extraColumnsChanged()
+{
+    dropTextCache();
+
+    if ( _tree->root() )
+	_tree->root()->dropSortCache( true );	// recursive
+
+    emit layoutAboutToBeChanged();
+    updatePersistentIndexes();
+    emit layoutChanged();
+}
+
+
+void DirTreeModel::setVisibleColumns( const DataColumnList & columns )
+{
+    int aggregates = DataColumns::aggregates( columns );
+
+    if ( aggregates != _visibleAggregates )
+    {
+	_visibleAggregates = aggregates;
+	updateAggregates();
+    }
+}
+
+
+void DirTreeModel::updateAggregates()
+{
+    int  aggregates    = _visibleAggregates;
+    bool typeSummaries = _typeSummaries || ( aggregates & TypeSummaryAggregate );
+
+    if ( typeSummaries != _tree->typeSummaries() )
+    {
+	logDebug() << ( typeSummaries ? "Enabling" : "Dropping" )
+		   << " type summaries" << endl;
+
+	// They are computed lazily when the column asks for them
+
+	_tree->setTypeSummaries( typeSummaries );
+	dropTextCache();
+    }
 
-	// If the view is still interested in this dir, it will fetch data, and
-	// then the dir will be touched again. For all we know now, this dir
-	// might easily be out of scope for the view, so let's not bother the
-	// view again about this dir until it's clear that the view still wants
-	// updates about it.
+    bool recordReadTimes = _recordReadTimes || ( aggregates & ReadTimeAggregate );
 
-	dir->clearTouched();
+    if ( recordReadTimes != _tree->recordReadTimes() )
+    {
+	logDebug() << ( recordReadTimes ? "Recording" : "Dropping" )
+		   << " read times" << endl;
+
+	// Only for what is read from now on
+
+	_tree->setRecordReadTimes( recordReadTimes );
+	dropTextCache();
+    }
+
+    if ( ( aggregates & ExtentAggregate ) && ! _tree->isBusy() )
+    {
+	// Counting the extents of the complete tree only makes sense when
+	// it is read, and it must not replace what the user counted
+
+	ExtentStats * extentStats = _tree->extentStats();
+	FileInfo    * toplevel	  = _tree->firstToplevel();
+
+	if ( toplevel && ( ! extentStats || ( ! extentStats->isBusy() && extentStats->isEmpty() ) ) )
+	{
+	    logDebug() << "Counting the extents of " << toplevel << endl;
+	    _tree->countExtents( toplevel );
+	}
     }
 }
 
@@ -858,9 +1469,14 @@ void DirTreeModel::dataChangedNotify( DirInfo * dir )
 void DirTreeModel::readingFinished()
 {
     _updateTimer.stop();
+    _updateTimer.setInterval( _slowUpdate ? _slowUpdateMillisec : _updateTimerMillisec );
+    sendPendingInserts();
     idleDisplay();
     sendPendingUpdates();
 
+    // The extents are only counted when the tree is complete
+    updateAggregates();
+
     // dumpPersistentIndexList();
     // Debug::dumpDirectChildren( _tree->root(), "root" );
 }
@@ -898,7 +1514,7 @@ void DirTreeModel::updatePersistentIndexes()
 	if ( oldIndex.isValid() )
 	{
 	    FileInfo * item = static_cast<FileInfo *>( oldIndex.internalPointer() );
-	    QModelIndex newIndex = modelIndex( item, oldIndex.column() );
+	    QModelIndex newIndex = shownModelIndex( item, oldIndex.column() );
 #if 0
 	    logDebug() << "Updating #" << i
 		       << " " << item
@@ -913,28 +1529,74 @@ void DirTreeModel::updatePersistentIndexes()
 }
 
 
+void DirTreeModel::forgetPending( FileInfo * subtree, bool includeParent )
+{
+    QMutableSetIterator<DirInfo *> it( _pendingUpdates );
+
+    while ( it.hasNext() )
+    {
+	DirInfo * dir = it.next();
+
+	if ( dir->isInSubtree( subtree ) && ( includeParent || dir != subtree ) )
+	    it.remove();
+    }
+
+    QMutableHashIterator<DirInfo *, int> fetchedIt( _fetchedRows );
+
+    while ( fetchedIt.hasNext() )
+    {
+	if ( fetchedIt.next().key()->isInSubtree( subtree ) )
+	    fetchedIt.remove();
+    }
+}
+
+
 void DirTreeModel::deletingChild( FileInfo * child )
 {
     logDebug() << "Deleting child " << child << endl;
+    dropTextCache();
+
+    // The view has to know about all rows that are going to be removed
 
-    if ( child->parent() &&
-	 ( child->parent() == _tree->root() ||
-	   child->parent()->isTouched()	 ) )
+    sendPendingInserts();
+    DirInfo * parent = child->parent();
+
+    if ( parent &&
+	 ( parent == _tree->root() ||
+	   parent->isTouched()	 ) )
     {
-	QModelIndex parentIndex = modelIndex( child->parent(), 0 );
-	int row = rowNumber( child );
-	logDebug() << "beginRemoveRows for " << child << " row " << row << endl;
-	beginRemoveRows( parentIndex, row, row );
+	int row	  = rowNumber( child );
+	int shown = shownRows( parent );
+
+	// A row beyond the fetched ones is none of the view's business
+
+	if ( row >= 0 && row < shown )
+	{
+	    QModelIndex parentIndex = modelIndex( parent, 0 );
+	    logDebug() << "beginRemoveRows for " << child << " row " << row << endl;
+	    beginRemoveRows( parentIndex, row, row );
+	    _removingRows = true;
+
+	    if ( _fetchPageSize > 0 && ( shown >= _fetchPageSize || _fetchedRows.contains( parent ) ) )
+		_fetchedRows[ parent ] = shown - 1;
+	}
     }
 
+    forgetPending( child, true );
     invalidatePersistent( child, true );
 }
 
 
 void DirTreeModel::childDeleted()
 {
-    logDebug() << "endRemoveRows()" << endl;
-    endRemoveRows();
+    dropTextCache();
+
+    if ( _removingRows )
+    {
+	logDebug() << "endRemoveRows()" << endl;
+	_removingRows = false;
+	endRemoveRows();
+    }
 }
 
 
@@ -942,18 +1604,23 @@ void DirTreeModel::clearingSubtree( DirInfo * subtree )
 {
     // logDebug() << "Deleting all children of " << subtree << endl;
 
+    dropTextCache();
+    sendPendingInserts();
+
     if ( subtree == _tree->root() || subtree->isTouched() )
     {
 	QModelIndex subtreeIndex = modelIndex( subtree, 0 );
-	int count = countDirectChildren( subtree );
+	int count = shownRows( subtree );
 
 	if ( count > 0 )
 	{
 	    // logDebug() << "beginRemoveRows for " << subtree << " row 0 to " << count - 1 << endl;
 	    beginRemoveRows( subtreeIndex, 0, count - 1 );
+	    _removingRows = true;
 	}
     }
 
+    forgetPending( subtree, false );
     invalidatePersistent( subtree, false );
 }
 
@@ -961,9 +1628,40 @@ void DirTreeModel::clearingSubtree( DirInfo * subtree )
 void DirTreeModel::subtreeCleared( DirInfo * subtree )
 {
     Q_UNUSED( subtree );
+    dropTextCache();
+
+    if ( _removingRows )
+    {
+	// logDebug() << "endRemoveRows()" << endl;
+	_removingRows = false;
+	endRemoveRows();
+    }
+}
+
+
+void DirTreeModel::childrenChanging( DirInfo * dir )
+{
+    dropTextCache();
+    sendPendingInserts();
+
+    if ( dir == _tree->root() || dir->isTouched() )
+    {
+	int count = shownRows( dir );
+
+	if ( count > 0 )
+	{
+	    // Take all rows away from the view: It gets the children back
+	    // with the readJobFinished() signal for this directory, just like
+	    // after reading it for the first time. Until then, the directory
+	    // is being read, so it has no rows.
+
+	    beginRemoveRows( modelIndex( dir, 0 ), 0, count - 1 );
+	    _pendingInserts.insert( dir );
+	    endRemoveRows();
+	}
+    }
 
-    // logDebug() << "endRemoveRows()" << endl;
-    endRemoveRows();
+    forgetPending( dir, false );
 }
 
 
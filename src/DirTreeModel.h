@@ -13,6 +13,9 @@
 #include <QAbstractItemModel>
 #include <QPixmap>
 #include <QSet>
+#include <QHash>
+#include <QCache>
+#include <QPair>
 #include <QTimer>
 #include <QTextStream>
 
@@ -166,6 +169,16 @@ namespace QDirStat
 	 **/
 	void refreshSelected();
 
+	/**
+	 * Set the columns that the view of this model currently shows. This
+	 * enables or disables the optional aggregates of the tree that they
+	 * need (see DataColumns::aggregates()). The views of other models
+	 * with other trees don't affect this one.
+	 *
+	 * Until this is called, no optional aggregates are needed.
+	 **/
+	void setVisibleColumns( const DataColumnList & columns );
+
         /**
          * Set the update speed to slow (3 sec instead of 333 millisec).
          **/
@@ -202,11 +215,47 @@ namespace QDirStat
 	 **/
 	int countDirectChildren( FileInfo * parent ) const;
 
+	/**
+	 * Count the direct children of 'parent', but stop at 'maxCount'.
+	 **/
+	int countDirectChildren( FileInfo * parent, int maxCount ) const;
+
 	/**
 	 * Return a model index for 'item' and 'column'.
+	 *
+	 * If 'item' is beyond the rows of its parent that the view fetched so
+	 * far, this fetches all pages up to that row first.
 	 **/
 	QModelIndex modelIndex( FileInfo * item, int column = 0 ) const;
 
+	/**
+	 * Return the indexes of all directories (including the dot entries)
+	 * in the first 'levels' levels below 'subtree' (0 for the complete
+	 * tree) in one pass over the tree: Level 1 are the direct children.
+	 * Only the rows that the view knows about are included; cold
+	 * directories are restored on the way.
+	 *
+	 * This is for expanding many branches of the view at once (see
+	 * DirTreeView::expandToLevel()) without the view asking for each
+	 * index on its own.
+	 **/
+	QModelIndexList dirIndexes( FileInfo * subtree, int levels ) const;
+
+	/**
+	 * Return the indexes of 'subtree' and of the chain of its largest
+	 * subdirectories down to the first one without any: The path to
+	 * where most of the disk space is.
+	 **/
+	QModelIndexList largestPathIndexes( FileInfo * subtree ) const;
+
+	/**
+	 * Return the number of children of a directory that are shown at
+	 * most: Only the first page of FetchPageSize rows (from the settings)
+	 * until the view fetches more with fetchMore(); all of them if that
+	 * is 0.
+	 **/
+	int fetchPageSize() const { return _fetchPageSize; }
+
 	/**
 	 * Return the current sort column.
 	 **/
@@ -232,6 +281,25 @@ namespace QDirStat
 	 **/
 	virtual int columnCount( const QModelIndex & parent ) const Q_DECL_OVERRIDE;
 
+	/**
+	 * Return 'true' if 'parent' has any children. For a cold directory
+	 * (see DirInfo::isCold()), this doesn't count them: That would
+	 * restore them just for drawing the branch indicator.
+	 **/
+	virtual bool hasChildren( const QModelIndex & parent ) const Q_DECL_OVERRIDE;
+
+	/**
+	 * Return 'true' if 'parent' has more children than the view fetched
+	 * so far. Directories with many children are shown page by page, so
+	 * expanding them doesn't make the view lay out all of them.
+	 **/
+	virtual bool canFetchMore( const QModelIndex & parent ) const Q_DECL_OVERRIDE;
+
+	/**
+	 * Fetch the next page of children of 'parent'.
+	 **/
+	virtual void fetchMore( const QModelIndex & parent ) Q_DECL_OVERRIDE;
+
 	/**
 	 * Return data to be displayed for the specified model index and role.
 	 **/
@@ -284,6 +352,18 @@ namespace QDirStat
 	 **/
 	void idleDisplay();
 
+	/**
+	 * Notification that the CacheBudget is about to drop the sort caches
+	 * of some directories.
+	 **/
+	void aboutToDropSortCaches();
+
+	/**
+	 * Notification that the CacheBudget dropped the sort caches of some
+	 * directories.
+	 **/
+	void sortCachesDropped();
+
 	/**
 	 * Process notification that the read job for 'dir' is finished.
 	 * Other read jobs might still be pending.
@@ -297,8 +377,27 @@ namespace QDirStat
 	void readingFinished();
 
 	/**
-	 * Delayed update of the data fields in the view for 'dir':
-	 * Store 'dir' and all its ancestors in _pendingUpdates.
+	 * Update the columns with data from outside of the tree: The "Growth"
+	 * column after the comparison with an older cache file was started or
+	 * stopped and the "Exclusive Size" column after the extents were
+	 * counted.
+	 **/
+	void extraColumnsChanged();
+
+	/**
+	 * Enable or disable the optional aggregates of the tree (see
+	 * setVisibleColumns()) according to what the visible columns
+	 * need: They are only computed when a column that shows them
+	 * is displayed and dropped when it is hidden again. The extents are
+	 * counted for the complete tree when it is read and nothing else was
+	 * counted; the read times are recorded for the directories read from
+	 * then on.
+	 **/
+	void updateAggregates();
+
+	/**
+	 * Delayed update of the data fields in the view for 'dir' and all its
+	 * ancestors: Store 'dir' in _pendingUpdates.
 	 *
 	 * The updates will be sent several times per second to the views with
 	 * 'sendPendingUpdates()'.
@@ -306,8 +405,12 @@ namespace QDirStat
 	void delayedUpdate( DirInfo * dir );
 
 	/**
-	 * Send all pending updates to the connected views.
-	 * This is triggered by the update timer.
+	 * Send all pending insertions and updates to the connected views,
+	 * with one dataChanged() signal for each range of adjacent rows that
+	 * changed. This is triggered by the update timer.
+	 *
+	 * The timer interval adapts to the time this takes, between
+	 * UpdateTimerMillisec and SlowUpdateMillisec from the settings.
 	 **/
 	void sendPendingUpdates();
 
@@ -331,6 +434,12 @@ namespace QDirStat
 	 **/
 	void subtreeCleared( DirInfo * subtree );
 
+	/**
+	 * Notification that children of a directory that the view might
+	 * already know are about to be added and removed.
+	 **/
+	void childrenChanging( DirInfo * dir );
+
 	/**
 	 * Invalidate all persistent indexes in 'subtree'. 'includeParent'
          * indicates if 'subtree' itself will become invalid.
@@ -346,7 +455,7 @@ namespace QDirStat
 	void createTree();
 
 	/**
-	 * Load all required icons.
+	 * Load all required icons. This is done on first use.
 	 **/
 	void loadIcons();
 
@@ -358,9 +467,79 @@ namespace QDirStat
 	void newChildrenNotify( DirInfo * dir );
 
 	/**
-	 * Notify the view about changed data of 'dir'.
+	 * Notify the view about the new children of all directories in
+	 * _pendingInserts that are still finished.
+	 **/
+	void sendPendingInserts();
+
+	/**
+	 * Notify the view about changed data of the rows 'firstRow' (with
+	 * 'firstDir') to 'lastRow' (with 'lastDir') of the same parent.
+	 **/
+	void dataChangedNotify( int	  firstRow,
+				DirInfo * firstDir,
+				int	  lastRow,
+				DirInfo * lastDir );
+
+	/**
+	 * Forget the pending updates and the fetched rows in 'subtree' before
+	 * it is deleted ('includeParent' = 'true') or cleared.
+	 **/
+	void forgetPending( FileInfo * subtree, bool includeParent );
+
+	/**
+	 * Return the number of rows of 'item' that the view knows about:
+	 * None while it is being read or its insertion is pending, otherwise
+	 * fetchedRows().
+	 **/
+	int shownRows( FileInfo * item ) const;
+
+	/**
+	 * Add the indexes of the directories in the first 'levels' levels
+	 * below 'dir' to 'indexes'. This is the recursion of dirIndexes().
+	 **/
+	void addDirIndexes( FileInfo * dir, int levels, QModelIndexList & indexes ) const;
+
+	/**
+	 * Return the number of children of 'dir' that were fetched so far,
+	 * but at most the real number of children.
+	 **/
+	int fetchedRows( FileInfo * dir ) const;
+
+	/**
+	 * Make the rows of 'dir' up to (not including) 'rows' known to the
+	 * view.
+	 **/
+	void fetchRows( DirInfo * dir, int rows );
+
+	/**
+	 * Like modelIndex(), but return an invalid index if the view doesn't
+	 * know about the row of 'item' instead of fetching it.
+	 **/
+	QModelIndex shownModelIndex( FileInfo * item, int column ) const;
+
+	/**
+	 * Return 'true' if the parent of 'item' is waiting for the
+	 * notification about its new children.
+	 **/
+	bool isPendingRow( FileInfo * item ) const;
+
+	/**
+	 * Return the text for (model) column 'col' for 'item' from the text
+	 * cache or format it with columnText() and add it to the cache.
 	 **/
-	void dataChangedNotify( DirInfo * dir );
+	QVariant cachedColumnText( FileInfo * item, int col ) const;
+
+	/**
+	 * Invalidate all texts in the text cache. Call this whenever anything
+	 * in the tree changes.
+	 **/
+	void dropTextCache() { ++_textGeneration; }
+
+	/**
+	 * Return 'true' if any ancestor of 'dir' is in 'dirs'.
+	 **/
+	bool anyAncestorIn( DirInfo * dir, const QSet<DirInfo *> & dirs ) const;
 
 	/**
 	 * Update the persistent indexes with current row after sorting etc.
@@ -403,14 +582,35 @@ namespace QDirStat
 	DirTree *	 _tree;
 	SelectionModel * _selectionModel;
 	QString		 _treeIconDir;
+	bool		 _iconsLoaded;
 	int		 _readJobsCol;
 	QSet<DirInfo *>	 _pendingUpdates;
+	QSet<DirInfo *>	 _pendingInserts;
+	QHash<DirInfo *, int> _fetchedRows;
+	int		 _fetchPageSize;
+	bool		 _removingRows;
+
+	// Formatted column texts: The view asks for them with every repaint,
+	// so keep the most recently used ones. An entry is only valid if it
+	// is from the current generation.
+
+	struct CachedText
+	{
+	    QVariant text;
+	    uint     generation;
+	};
+
+	mutable QCache<QPair<FileInfo *, int>, CachedText> _textCache;
+	uint		 _textGeneration;
 	QTimer		 _updateTimer;
 	int		 _updateTimerMillisec;
         int              _slowUpdateMillisec;
         bool             _slowUpdate;
 	DataColumn	 _sortCol;
 	Qt::SortOrder	 _sortOrder;
+	bool		 _typeSummaries;	// Even if no column needs them
+	bool		 _recordReadTimes;	// Even if no column needs them
+	int		 _visibleAggregates;	// What the visible columns need
 
 
 	// The various icons
@@ -75,6 +75,7 @@ void DirTreeView::contextMenu( const QPoint & pos )
     QStringList actions;
     actions << "actionGoUp"
 	    << "actionCopyUrlToClipboard"
+	    << "actionExpandLargestPath"
 	    << "---"
 	    << "actionRefreshSelected"
 	    << "actionReadExcludedDirectory"
@@ -86,7 +87,7 @@ void DirTreeView::contextMenu( const QPoint & pos )
 	    << "actionMoveToTrash"
 	;
 
-    ActionManager::instance()->addActions( &menu, actions );
+    ActionManager::instance()->addActions( &menu, actions, this );
 
     if ( _cleanupCollection && ! _cleanupCollection->isEmpty() )
     {
@@ -149,3 +150,66 @@ void DirTreeView::closeAllExcept( const QModelIndex & branch )
     scrollTo( currentIndex() );
 }
 
+
+DirTreeModel * DirTreeView::dirTreeModel() const
+{
+    DirTreeModel * dirTreeModel = dynamic_cast<DirTreeModel *>( model() );
+
+    if ( model() && ! dirTreeModel )
+	logError() << "Wrong model type for this" << endl;
+
+    return dirTreeModel;
+}
+
+
+void DirTreeView::expandToLevel( int level )
+{
+    // Collapsing everything first only lays out the toplevel rows
+
+    collapseAll();
+
+    DirTreeModel * dirTreeModel = this->dirTreeModel();
+
+    if ( level < 1 || ! dirTreeModel )
+	return;
+
+    expandIndexes( dirTreeModel->dirIndexes( 0, level ) );
+}
+
+
+void DirTreeView::expandLargestPath()
+{
+    DirTreeModel * dirTreeModel = this->dirTreeModel();
+
+    if ( ! dirTreeModel || ! dirTreeModel->tree() )
+	return;
+
+    FileInfo * subtree = static_cast<FileInfo *>( currentIndex().internalPointer() );
+
+    if ( ! subtree )
+	subtree = dirTreeModel->tree()->firstToplevel();
+
+    QModelIndexList indexes = dirTreeModel->largestPathIndexes( subtree );
+
+    if ( indexes.isEmpty() )
+	return;
+
+    expandIndexes( indexes );
+    setCurrentIndex( indexes.last() );
+}
+
+
+void DirTreeView::expandIndexes( const QModelIndexList & indexes )
+{
+    logDebug() << "Expanding " << indexes.size() << " branches" << endl;
+
+    // With a layout pending, expand() only notes each index, and the view
+    // is laid out once for all of them (instead of once for each one) when
+    // it is shown again.
+
+    scheduleDelayedItemsLayout();
+
+    foreach ( const QModelIndex & index, indexes )
+	expand( index );
+}
+
@@ -21,6 +21,7 @@ namespace QDirStat
     class HeaderTweaker;
     class SelectionModelProxy;
     class CleanupCollection;
+    class DirTreeModel;
 
 
     /**
@@ -83,6 +84,22 @@ namespace QDirStat
 	 **/
 	void closeAllExcept( const QModelIndex & branch );
 
+	/**
+	 * Expand the tree to 'level': Level 0 closes all branches, level 1
+	 * opens the toplevel directory, and so on. Unlike expandToDepth(),
+	 * this doesn't ask the model for every row of the tree; it only
+	 * visits the directories that are expanded, and the view is laid out
+	 * only once for all of them.
+	 **/
+	void expandToLevel( int level );
+
+	/**
+	 * Expand the current directory (or the toplevel directory if there
+	 * is no current item) and the chain of its largest subdirectories
+	 * and make the last one the current item.
+	 **/
+	void expandLargestPath();
+
     protected slots:
 
 	/**
@@ -92,6 +109,16 @@ namespace QDirStat
 
     protected:
 
+	/**
+	 * Expand all 'indexes' with only one layout of the view.
+	 **/
+	void expandIndexes( const QModelIndexList & indexes );
+
+	/**
+	 * Return the model if it is a DirTreeModel, 0 otherwise.
+	 **/
+	DirTreeModel * dirTreeModel() const;
+
 	/**
 	 * Change the current item. Overwritten from QTreeView to make sure
 	 * the branch of the new current item is expanded and scrolled to
@@ -0,0 +1,386 @@
+/*
+ *   File name: DirTreeWatcher.cpp
+ *   Summary:	Watching the directories of a DirTree for changes
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <QSocketNotifier>
+#include <QQueue>
+#include <QFile>
+
+#include "DirTreeWatcher.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "FileInfoSet.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+#define DEFAULT_MAX_WATCHES	100000
+#define DEFAULT_UPDATE_DELAY	1000	// millisec
+
+#define WATCH_MASK ( IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+		     IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF |	   \
+		     IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK )
+
+
+using namespace QDirStat;
+
+
+DirTreeWatcher::DirTreeWatcher( DirTree * tree ):
+    QObject( tree ),
+    _tree( tree ),
+    _notifier( 0 ),
+    _overflow( false ),
+    _maxWatches( 0 ),
+    _budgetWarned( false )
+{
+    CHECK_PTR( _tree );
+
+    setMaxWatches( DEFAULT_MAX_WATCHES );
+    _timer.setSingleShot( true );
+    _timer.setInterval( DEFAULT_UPDATE_DELAY );
+
+    _fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+
+    if ( _fd < 0 )
+    {
+	logError() << "inotify_init1() failed: " << formatErrno() << endl;
+	return;
+    }
+
+    _notifier = new QSocketNotifier( _fd, QSocketNotifier::Read, this );
+    CHECK_NEW( _notifier );
+
+    connect( _notifier, SIGNAL( activated( int ) ),
+	     this,	SLOT  ( readEvents()	 ) );
+
+    connect( &_timer,	SIGNAL( timeout()	 ),
+	     this,	SLOT  ( applyChanges()	 ) );
+
+    connect( _tree,	SIGNAL( readJobFinished( DirInfo * ) ),
+	     this,	SLOT  ( readJobFinished( DirInfo * ) ) );
+
+    connect( _tree,	SIGNAL( deletingChild  ( FileInfo * ) ),
+	     this,	SLOT  ( deletingChild  ( FileInfo * ) ) );
+
+    connect( _tree,	SIGNAL( clearingSubtree( DirInfo * ) ),
+	     this,	SLOT  ( clearingSubtree( DirInfo * ) ) );
+
+    connect( _tree,	SIGNAL( clearing() ),
+	     this,	SLOT  ( clear()	   ) );
+
+    FileInfo * toplevel = _tree->firstToplevel();
+
+    if ( toplevel && toplevel->isDirInfo() )
+	watchSubtree( toplevel->toDirInfo() );
+}
+
+
+DirTreeWatcher::~DirTreeWatcher()
+{
+    if ( _fd >= 0 )
+	close( _fd );	// This removes all watches
+}
+
+
+int DirTreeWatcher::systemMaxWatches()
+{
+    QFile file( "/proc/sys/fs/inotify/max_user_watches" );
+
+    if ( ! file.open( QIODevice::ReadOnly ) )
+	return 0;
+
+    return QString::fromLatin1( file.readAll() ).trimmed().toInt();
+}
+
+
+void DirTreeWatcher::setMaxWatches( int maxWatches )
+{
+    int systemMax = systemMaxWatches();
+
+    if ( systemMax > 0 && maxWatches > systemMax / 2 )
+    {
+	logInfo() << "Limiting watches to " << systemMax / 2
+		  << " of " << systemMax << endl;
+	maxWatches = systemMax / 2;
+    }
+
+    _maxWatches	  = qMax( 0, maxWatches );
+    _budgetWarned = false;
+}
+
+
+void DirTreeWatcher::clear()
+{
+    foreach ( int wd, _wdToPath.keys() )
+	inotify_rm_watch( _fd, wd );
+
+    _wdToPath.clear();
+    _pathToWd.clear();
+    _changedDirs.clear();
+    _overflow	  = false;
+    _budgetWarned = false;
+    _timer.stop();
+}
+
+
+void DirTreeWatcher::watchSubtree( DirInfo * subtree )
+{
+    if ( ! subtree )
+	return;
+
+    QQueue<DirInfo *> queue;
+    queue.enqueue( subtree );
+
+    while ( ! queue.isEmpty() )
+    {
+	DirInfo * dir = queue.dequeue();
+
+	if ( ! watch( dir ) && watchCount() >= _maxWatches )
+	    return;
+
+	for ( FileInfo * child = dir->firstChild(); child; child = child->next() )
+	{
+	    if ( child->isDirInfo() && ! child->isDotEntry() )
+		queue.enqueue( child->toDirInfo() );
+	}
+    }
+}
+
+
+bool DirTreeWatcher::watch( DirInfo * dir )
+{
+    if ( _fd < 0 || dir->isDotEntry() || dir->isExcluded() || _tree->isRemote() )
+	return false;
+
+    if ( dir->readState() != DirFinished && dir->readState() != DirCached )
+	return false;	// Nothing to compare changes to
+
+    QString path = dir->url();
+
+    if ( _pathToWd.contains( path ) )
+	return true;
+
+    if ( watchCount() >= _maxWatches )
+    {
+	if ( ! _budgetWarned )
+	{
+	    logWarning() << "All " << _maxWatches << " watches used up; not watching "
+			 << path << " and any further directories" << endl;
+	    _budgetWarned = true;
+	}
+
+	return false;
+    }
+
+    int wd = inotify_add_watch( _fd, path.toUtf8(), WATCH_MASK );
+
+    if ( wd < 0 )
+    {
+	if ( errno == ENOSPC && ! _budgetWarned )
+	{
+	    logWarning() << "Out of inotify watches at " << path << endl;
+	    _budgetWarned = true;
+	}
+	else if ( errno != ENOSPC )
+	{
+	    logWarning() << "Can't watch " << path << ": " << formatErrno() << endl;
+	}
+
+	return false;
+    }
+
+    // The same inode might have been watched with another path before it
+    // was moved.
+
+    forgetWatch( wd );
+    _wdToPath.insert( wd, path );
+    _pathToWd.insert( path, wd );
+
+    return true;
+}
+
+
+void DirTreeWatcher::forgetWatch( int wd )
+{
+    QHash<int, QString>::iterator it = _wdToPath.find( wd );
+
+    if ( it == _wdToPath.end() )
+	return;
+
+    _pathToWd.remove( it.value() );
+    _wdToPath.erase( it );
+}
+
+
+void DirTreeWatcher::unwatch( const QString & path, bool includeSelf )
+{
+    if ( includeSelf && _pathToWd.contains( path ) )
+    {
+	int wd = _pathToWd.value( path );
+	inotify_rm_watch( _fd, wd );
+	forgetWatch( wd );
+    }
+
+    // All paths below 'path' are one contiguous range in the sorted map
+
+    QString prefix = path.endsWith( "/" ) ? path : path + "/";
+    QMap<QString, int>::iterator it = _pathToWd.lowerBound( prefix );
+
+    while ( it != _pathToWd.end() && it.key().startsWith( prefix ) )
+    {
+	inotify_rm_watch( _fd, it.value() );
+	_wdToPath.remove( it.value() );
+	it = _pathToWd.erase( it );
+    }
+}
+
+
+void DirTreeWatcher::readEvents()
+{
+    // Buffer aligned for struct inotify_event as recommended by inotify(7)
+
+    char buffer[ 16384 ] __attribute__ ((aligned( __alignof__( struct inotify_event ) )));
+
+    while ( true )
+    {
+	ssize_t len = read( _fd, buffer, sizeof( buffer ) );
+
+	if ( len <= 0 )
+	    break;	// EAGAIN: No more events
+
+	for ( char * ptr = buffer; ptr < buffer + len; )
+	{
+	    const struct inotify_event * event = (const struct inotify_event *) ptr;
+	    ptr += sizeof( struct inotify_event ) + event->len;
+
+	    if ( event->mask & IN_Q_OVERFLOW )
+	    {
+		logWarning() << "inotify event queue overflow" << endl;
+		_overflow = true;
+		continue;
+	    }
+
+	    if ( event->mask & IN_IGNORED )
+	    {
+		// The watch is gone since the directory is gone
+
+		forgetWatch( event->wd );
+		continue;
+	    }
+
+	    QString path = _wdToPath.value( event->wd );
+
+	    if ( path.isEmpty() )
+		continue;
+
+	    if ( event->mask & ( IN_DELETE_SELF | IN_MOVE_SELF ) )
+	    {
+		// This will be noticed in the parent directory
+
+		int slash = path.lastIndexOf( '/' );
+
+		if ( slash > 0 )
+		    addChange( path.left( slash ) );
+		else if ( slash == 0 && path.size() > 1 )
+		    addChange( "/" );
+	    }
+	    else
+	    {
+		addChange( path );
+	    }
+	}
+    }
+
+    if ( _overflow && ! _timer.isActive() )
+	_timer.start();
+}
+
+
+void DirTreeWatcher::addChange( const QString & path )
+{
+    _changedDirs.insert( path );
+
+    // Not restarting the timer if it is already running: Otherwise a
+    // directory that keeps changing would never be updated.
+
+    if ( ! _timer.isActive() )
+	_timer.start();
+}
+
+
+void DirTreeWatcher::applyChanges()
+{
+    if ( _tree->isBusy() )
+    {
+	// Try again when the tree is done; the directories might be read
+	// right now anyway.
+
+	_timer.start();
+	return;
+    }
+
+    if ( _overflow )
+    {
+	// Some events were lost, so any directory might have changed
+
+	_overflow = false;
+	_changedDirs.clear();
+	FileInfo * toplevel = _tree->firstToplevel();
+
+	if ( toplevel )
+	{
+	    logInfo() << "Checking the complete tree" << endl;
+	    FileInfoSet items;
+	    items << toplevel;
+	    _tree->verify( items );
+	}
+
+	return;
+    }
+
+    FileInfoSet dirs;
+
+    foreach ( const QString & path, _changedDirs )
+    {
+	FileInfo * dir = _tree->locate( path );
+
+	if ( dir && dir->isDirInfo() )
+	    dirs << dir;
+    }
+
+    _changedDirs.clear();
+
+    if ( ! dirs.isEmpty() )
+    {
+	logDebug() << "Updating " << dirs.size() << " changed directories" << endl;
+	_tree->verify( dirs, false );	// not recursive
+    }
+}
+
+
+void DirTreeWatcher::readJobFinished( DirInfo * dir )
+{
+    watch( dir );
+}
+
+
+void DirTreeWatcher::deletingChild( FileInfo * child )
+{
+    if ( child->isDirInfo() && ! child->isDotEntry() )
+	unwatch( child->url(), true );
+}
+
+
+void DirTreeWatcher::clearingSubtree( DirInfo * subtree )
+{
+    unwatch( subtree->url(), false );
+}
@@ -0,0 +1,197 @@
+/*
+ *   File name: DirTreeWatcher.h
+ *   Summary:	Watching the directories of a DirTree for changes
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef DirTreeWatcher_h
+#define DirTreeWatcher_h
+
+
+#include <QObject>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+#include <QString>
+#include <QTimer>
+
+
+class QSocketNotifier;
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class DirInfo;
+    class FileInfo;
+
+
+    /**
+     * Watcher for the directories of a DirTree: Each directory that is
+     * read gets an inotify watch, and when the kernel reports that
+     * anything changed in it, it is checked against the disk again with
+     * DirTree::verify() - only that directory, not the complete subtree,
+     * so the totals stay current without reading anything else again.
+     *
+     * The events are collected for a while (see setUpdateDelay()), so many
+     * changes in a row result in only one update for each directory.
+     * Nothing is updated while the tree is busy reading.
+     *
+     * The number of watches is limited by the kernel (see
+     * /proc/sys/fs/inotify/max_user_watches), so there is a budget of
+     * watches (see setMaxWatches()). Directories are watched in the order
+     * they are read, so for a very large tree, the directories near the
+     * top are the ones that are watched. Changes in directories without a
+     * watch are not noticed.
+     *
+     * fanotify could watch complete file systems with just one mark, but
+     * it needs root permissions, so this is left to inotify.
+     *
+     * Use DirTree::setWatchFileSystem() to create a watcher for a tree.
+     **/
+    class DirTreeWatcher: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor. The watcher is a child of 'tree'. This starts
+	 * watching all directories that are already in the tree.
+	 **/
+	DirTreeWatcher( DirTree * tree );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~DirTreeWatcher();
+
+	/**
+	 * Return 'true' if inotify could be initialized.
+	 **/
+	bool isActive() const { return _fd >= 0; }
+
+	/**
+	 * Return the number of watched directories.
+	 **/
+	int watchCount() const { return _wdToPath.size(); }
+
+	/**
+	 * Return the maximum number of watched directories.
+	 **/
+	int maxWatches() const { return _maxWatches; }
+
+	/**
+	 * Set the maximum number of watched directories. This is limited to
+	 * half of the kernel's limit for the user since other applications
+	 * need watches, too. Directories that are already watched stay
+	 * watched.
+	 **/
+	void setMaxWatches( int maxWatches );
+
+	/**
+	 * Return the time in milliseconds that changes are collected before
+	 * the tree is updated.
+	 **/
+	int updateDelay() const { return _timer.interval(); }
+
+	/**
+	 * Set the time in milliseconds that changes are collected before the
+	 * tree is updated.
+	 **/
+	void setUpdateDelay( int millisec ) { _timer.setInterval( millisec ); }
+
+	/**
+	 * Watch 'subtree' and all directories below it, breadth first, as
+	 * far as the budget goes.
+	 **/
+	void watchSubtree( DirInfo * subtree );
+
+    public slots:
+
+	/**
+	 * Remove all watches and forget all changes that are not applied
+	 * yet.
+	 **/
+	void clear();
+
+    protected slots:
+
+	/**
+	 * Read the events from the inotify file descriptor.
+	 **/
+	void readEvents();
+
+	/**
+	 * Update the tree for the directories that changed.
+	 **/
+	void applyChanges();
+
+	/**
+	 * Watch a directory that was just read.
+	 **/
+	void readJobFinished( DirInfo * dir );
+
+	/**
+	 * Remove the watches for a subtree that is being deleted.
+	 **/
+	void deletingChild( FileInfo * child );
+
+	/**
+	 * Remove the watches below a subtree that is being cleared.
+	 **/
+	void clearingSubtree( DirInfo * subtree );
+
+    protected:
+
+	/**
+	 * Add a watch for 'dir'. Return 'false' if that was not possible,
+	 * e.g. because the budget is used up.
+	 **/
+	bool watch( DirInfo * dir );
+
+	/**
+	 * Remove the watches for 'path' (if 'includeSelf' is 'true') and
+	 * for all directories below it.
+	 **/
+	void unwatch( const QString & path, bool includeSelf );
+
+	/**
+	 * Remove the watch 'wd' from the maps.
+	 **/
+	void forgetWatch( int wd );
+
+	/**
+	 * Note that directory 'path' changed.
+	 **/
+	void addChange( const QString & path );
+
+	/**
+	 * Return the limit of the kernel for the number of inotify watches
+	 * of a user or 0 if it is unknown.
+	 **/
+	static int systemMaxWatches();
+
+
+	// Data members
+
+	DirTree *		_tree;
+	int			_fd;
+	QSocketNotifier *	_notifier;
+	QHash<int, QString>	_wdToPath;
+	QMap<QString, int>	_pathToWd;	// Sorted for unwatch()
+	QSet<QString>		_changedDirs;
+	bool			_overflow;
+	int			_maxWatches;
+	bool			_budgetWarned;
+	QTimer			_timer;
+
+    };	// class DirTreeWatcher
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef DirTreeWatcher_h
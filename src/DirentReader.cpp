@@ -0,0 +1,151 @@
+/*
+ *   File name: DirentReader.cpp
+ *   Summary:	Reading directory entries in bulk with getdents64()
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+
+#include "DirentReader.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+#ifdef SYS_getdents64
+
+/**
+ * What getdents64() returns for each entry (see getdents(2)). glibc only
+ * has this as struct dirent64 with _LARGEFILE64_SOURCE and only has the
+ * getdents64() wrapper since 2.30, so this uses its own.
+ **/
+struct KernelDirent64
+{
+    uint64_t	   ino;
+    int64_t	   off;
+    unsigned short reclen;
+    unsigned char  type;
+    char	   name[1];	// Actually as long as needed, 0-terminated
+};
+
+#endif
+
+
+DirentReader::DirentReader( int dirFd ):
+    _fd( dirFd ),
+    _diskDir( 0 ),
+    _buffer( 0 ),
+    _bufferSize( InitialBufferSize ),
+    _filled( 0 ),
+    _pos( 0 ),
+    _syscalls( 0 ),
+    _eof( false )
+{
+#ifdef SYS_getdents64
+    _buffer = new char[ _bufferSize ];
+    CHECK_NEW( _buffer );
+#else
+    _diskDir = fdopendir( dirFd );
+
+    if ( ! _diskDir )
+    {
+	close( _fd );
+	_fd = -1;
+    }
+#endif
+}
+
+
+DirentReader::~DirentReader()
+{
+    if ( _diskDir )
+	closedir( _diskDir );	// This also closes _fd
+    else if ( _fd >= 0 )
+	close( _fd );
+
+    delete[] _buffer;
+}
+
+
+const char * DirentReader::next( unsigned char * type )
+{
+    while ( true )
+    {
+	const char * name = 0;
+
+#ifdef SYS_getdents64
+	if ( _pos >= _filled && ! fill() )
+	    return 0;
+
+	const KernelDirent64 * entry = (const KernelDirent64 *) ( _buffer + _pos );
+	_pos += entry->reclen;
+	name  = entry->name;
+	*type = entry->type;
+#else
+	if ( ! _diskDir )
+	    return 0;
+
+	++_syscalls;
+	struct dirent * entry = readdir( _diskDir );
+
+	if ( ! entry )
+	    return 0;
+
+	name  = entry->d_name;
+	*type = entry->d_type;
+#endif
+
+	if ( name[0] == '.' &&
+	     ( name[1] == '\0' || ( name[1] == '.' && name[2] == '\0' ) ) )
+	{
+	    continue;	// Skip "." and ".."
+	}
+
+	return name;
+    }
+}
+
+
+bool DirentReader::fill()
+{
+#ifdef SYS_getdents64
+    if ( _eof || _fd < 0 )
+	return false;
+
+    // A buffer that the kernel filled up means a big directory: Ask for
+    // more next time. A certain amount of slack always remains since an
+    // entry that doesn't fit completely is left for the next call.
+
+    if ( _filled > _bufferSize - 1024 && _bufferSize < MaxBufferSize )
+    {
+	delete[] _buffer;
+	_bufferSize *= 2;
+	_buffer = new char[ _bufferSize ];
+	CHECK_NEW( _buffer );
+    }
+
+    _pos    = 0;
+    _filled = 0;
+
+    long result = syscall( SYS_getdents64, _fd, _buffer, _bufferSize );
+    ++_syscalls;
+
+    if ( result <= 0 )	// End of directory or error
+    {
+	_eof = true;
+	return false;
+    }
+
+    _filled = result;
+
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,103 @@
+/*
+ *   File name: DirentReader.h
+ *   Summary:	Reading directory entries in bulk with getdents64()
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef DirentReader_h
+#define DirentReader_h
+
+
+#include <dirent.h>
+
+
+namespace QDirStat
+{
+    /**
+     * Reader for the entries of one open directory that calls
+     * getdents64() directly with a large buffer and hands out the names
+     * right from that buffer.
+     *
+     * readdir() in glibc fetches about 32 kB per system call, which is a
+     * few hundred entries; a directory with millions of entries needs
+     * many thousands of system calls that way. This starts with the same
+     * size, so small directories don't cost more memory, and doubles the
+     * buffer up to MaxBufferSize each time the kernel fills it completely.
+     *
+     * "." and ".." are skipped here by comparing bytes, so the caller
+     * never sees them.
+     *
+     * Without getdents64() (not Linux), this falls back to readdir().
+     **/
+    class DirentReader
+    {
+    public:
+
+	enum
+	{
+	    InitialBufferSize = 32 * 1024,
+	    MaxBufferSize     = 1024 * 1024
+	};
+
+	/**
+	 * Constructor: Read directory file descriptor 'dirFd'. This takes
+	 * ownership of 'dirFd' and closes it in the destructor.
+	 **/
+	DirentReader( int dirFd );
+
+	/**
+	 * Destructor. This closes the directory.
+	 **/
+	~DirentReader();
+
+	/**
+	 * Return 'true' if the directory could be opened for reading.
+	 **/
+	bool ok() const { return _fd >= 0; }
+
+	/**
+	 * Return the directory file descriptor for fstatat() etc.
+	 **/
+	int fd() const { return _fd; }
+
+	/**
+	 * Return the name of the next entry or 0 if there are no more.
+	 * 'type' is set to the d_type of the entry (DT_UNKNOWN if the file
+	 * system doesn't know it). The name is valid until the next call.
+	 **/
+	const char * next( unsigned char * type );
+
+	/**
+	 * Return the number of getdents64() (or readdir()) calls so far.
+	 **/
+	int syscalls() const { return _syscalls; }
+
+    protected:
+
+	/**
+	 * Fill the buffer with the next entries. Return 'false' at the end
+	 * of the directory or on error.
+	 **/
+	bool fill();
+
+
+	// Data members
+
+	int	_fd;
+	DIR *	_diskDir;	// Only for the readdir() fallback
+	char *	_buffer;
+	int	_bufferSize;
+	int	_filled;	// Bytes in _buffer
+	int	_pos;		// Next entry in _buffer
+	int	_syscalls;
+	bool	_eof;
+
+    };	// class DirentReader
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef DirentReader_h
@@ -0,0 +1,448 @@
+/*
+ *   File name: DuplicateFinder.cpp
+ *   Summary:	Finding files with the same content in a subtree
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <sys/stat.h>
+#include <algorithm>
+
+#include <QFile>
+#include <QHash>
+#include <QThread>
+#include <QMutexLocker>
+#include <QCryptographicHash>
+
+#include "DuplicateFinder.h"
+#include "FileInfoIterator.h"
+#include "DirTree.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+#define HASH_BLOCK_SIZE		4096
+#define FULL_HASH_CHUNK_SIZE	( 256 * 1024 )
+#define CHECK_INTERVAL		200	// millisec
+
+using namespace QDirStat;
+
+
+/**
+ * Order for grouping the files: By size and hash, and the links to the
+ * same inode next to each other.
+ **/
+static bool lessBySizeAndHash( const DuplicateFile & a, const DuplicateFile & b )
+{
+    if ( a.size   != b.size   ) return a.size   > b.size; // The largest first
+    if ( a.hash   != b.hash   ) return a.hash   < b.hash;
+    if ( a.device != b.device ) return a.device < b.device;
+
+    return a.inode < b.inode;
+}
+
+
+/**
+ * Order for reading the files: By device and inode number.
+ **/
+static bool lessByInode( const DuplicateFile & a, const DuplicateFile & b )
+{
+    if ( a.device != b.device )
+	return a.device < b.device;
+
+    return a.inode < b.inode;
+}
+
+
+/**
+ * Order for the result: The groups that waste the most space first.
+ **/
+static bool moreWasted( const DuplicateGroup & a, const DuplicateGroup & b )
+{
+    return a.size * ( a.paths.size() - 1 ) > b.size * ( b.paths.size() - 1 );
+}
+
+
+
+
+DuplicateFinder::DuplicateFinder( QObject * parent ):
+    QObject( parent ),
+    _minSize( 1 ),
+    _threads( 1 ),
+    _stage( Idle ),
+    _jobs( 0 ),
+    _jobCount( 0 ),
+    _next( 0 ),
+    _done( 0 ),
+    _abort( false )
+{
+    setThreads( QThread::idealThreadCount() );
+    _timer.setInterval( CHECK_INTERVAL );
+
+    connect( &_timer, SIGNAL( timeout()	     ),
+	     this,    SLOT  ( checkWorkers() ) );
+}
+
+
+DuplicateFinder::~DuplicateFinder()
+{
+    stopWorkers();
+}
+
+
+void DuplicateFinder::setThreads( int threads )
+{
+    _threads = qMax( 1, threads );
+    _threadPool.setMaxThreadCount( _threads );
+}
+
+
+void DuplicateFinder::start( FileInfo * subtree )
+{
+    abort();
+    _result.clear();
+
+    if ( ! subtree )
+	return;
+
+    subtree->tree()->thaw( subtree );
+
+    QVector<DuplicateFile> files;
+    collect( subtree, subtree->url(), files );
+
+    // Only files with the same size can have the same content
+
+    QHash<FileSize, int> sizeCount;
+
+    foreach ( const DuplicateFile & file, files )
+	++sizeCount[ file.size ];
+
+    foreach ( const DuplicateFile & file, files )
+    {
+	if ( sizeCount.value( file.size ) > 1 )
+	    _files << file;
+    }
+
+    logInfo() << _files.size() << " of " << files.size()
+	      << " files below " << subtree->url() << " have the same size as another one"
+	      << endl;
+
+    // Keeping the order of the tree for the first stage: The files of each
+    // directory are next to each other on disk more often than not.
+
+    startStage( PartialHash );
+}
+
+
+void DuplicateFinder::collect( FileInfo *		subtree,
+			       const QString &		url,
+			       QVector<DuplicateFile> & files )
+{
+    if ( subtree->isFile() )
+    {
+	// Links to an inode that is already counted are no duplicates
+
+	if ( subtree->byteSize() >= _minSize && ! subtree->isDuplicateLink() )
+	{
+	    DuplicateFile file;
+	    file.path	= url;
+	    file.size	= subtree->byteSize();
+	    file.device = subtree->device();
+	    file.inode	= 0;
+	    files << file;
+	}
+
+	return;
+    }
+
+    FileInfoUrlIterator it( subtree, url );
+
+    while ( *it )
+    {
+	// Disregard symlinks, block devices and other special files
+
+	if ( (*it)->hasChildren() || (*it)->isFile() )
+	    collect( *it, it.url(), files );
+
+	++it;
+    }
+}
+
+
+void DuplicateFinder::startStage( Stage stage )
+{
+    if ( _files.isEmpty() )
+    {
+	finish();
+	return;
+    }
+
+    logDebug() << "Stage " << (int) stage << ": Hashing " << _files.size() << " files"
+	       << " with " << _threads << " threads" << endl;
+
+    _stage    = stage;
+    _jobs     = _files.data();	// Detaching here, not in the workers
+    _jobCount = _files.size();
+    _next     = 0;
+    _done     = 0;
+    _abort    = false;
+
+    emit progress( 0, _jobCount );
+
+    for ( int i=0; i < qMin( _threads, _jobCount ); ++i )
+    {
+	DuplicateHashWorker * worker = new DuplicateHashWorker( this );
+	CHECK_NEW( worker );
+	_threadPool.start( worker );	// The thread pool takes ownership
+    }
+
+    _timer.start();
+}
+
+
+bool DuplicateFinder::hashNext()
+{
+    _mutex.lock();
+
+    if ( _abort || _next >= _jobCount )
+    {
+	_mutex.unlock();
+	return false;
+    }
+
+    DuplicateFile & file = _jobs[ _next++ ];
+    Stage stage = _stage;
+    _mutex.unlock();
+
+    if ( stage == PartialHash )
+    {
+	struct stat statInfo;
+
+	if ( lstat( file.path.toUtf8(), &statInfo ) == 0 &&
+	     S_ISREG( statInfo.st_mode ) &&
+	     (FileSize) statInfo.st_size == file.size )
+	{
+	    file.device = statInfo.st_dev;
+	    file.inode	= statInfo.st_ino;
+	    file.hash	= partialHash( file.path, file.size );
+	}
+	// else: Changed since it was read - leave the hash empty
+    }
+    else
+    {
+	file.hash = fullHash( file.path, &_abort );
+    }
+
+    QMutexLocker locker( &_mutex );
+    ++_done;
+
+    return true;
+}
+
+
+void DuplicateFinder::checkWorkers()
+{
+    _mutex.lock();
+    int done = _done;
+    _mutex.unlock();
+
+    emit progress( done, _jobCount );
+
+    if ( done < _jobCount )
+	return;
+
+    _timer.stop();
+    _threadPool.waitForDone();
+    nextStage();
+}
+
+
+void DuplicateFinder::nextStage()
+{
+    std::sort( _files.begin(), _files.end(), lessBySizeAndHash );
+
+    QVector<DuplicateFile> candidates;
+    int i = 0;
+
+    while ( i < _files.size() )
+    {
+	// Find the range of files with the same size and hash
+
+	int end = i + 1;
+
+	while ( end < _files.size() &&
+		_files[ end ].size == _files[ i ].size &&
+		_files[ end ].hash == _files[ i ].hash )
+	{
+	    ++end;
+	}
+
+	if ( end - i > 1 && ! _files[ i ].hash.isEmpty() )
+	{
+	    QVector<DuplicateFile> group;
+
+	    for ( int j = i; j < end; ++j )
+	    {
+		const DuplicateFile & file = _files[ j ];
+
+		if ( group.isEmpty() ||
+		     file.device != group.last().device ||
+		     file.inode	 != group.last().inode )
+		{
+		    group << file;
+		}
+	    }
+
+	    if ( group.size() > 1 )
+	    {
+		if ( _stage == FullHash || group.first().size <= 2 * HASH_BLOCK_SIZE )
+		    addResult( group );
+		else
+		    candidates << group;
+	    }
+	}
+
+	i = end;
+    }
+
+    if ( _stage == PartialHash && ! candidates.isEmpty() )
+    {
+	std::sort( candidates.begin(), candidates.end(), lessByInode );
+	_files = candidates;
+	startStage( FullHash );
+    }
+    else
+    {
+	finish();
+    }
+}
+
+
+void DuplicateFinder::addResult( const QVector<DuplicateFile> & group )
+{
+    DuplicateGroup result;
+    result.size = group.first().size;
+
+    foreach ( const DuplicateFile & file, group )
+	result.paths << file.path;
+
+    result.paths.sort();
+    _result << result;
+}
+
+
+void DuplicateFinder::finish()
+{
+    _files = QVector<DuplicateFile>();
+    _jobs  = 0;
+    _stage = Done;
+
+    std::sort( _result.begin(), _result.end(), moreWasted );
+
+    logInfo() << "Found " << _result.size() << " groups of duplicates wasting "
+	      << formatSize( wastedSize() ) << endl;
+
+    emit finished();
+}
+
+
+void DuplicateFinder::abort()
+{
+    if ( ! isBusy() )
+	return;
+
+    logInfo() << "Aborting" << endl;
+    _timer.stop();
+    stopWorkers();
+
+    _files = QVector<DuplicateFile>();
+    _jobs  = 0;
+    _stage = Idle;
+}
+
+
+void DuplicateFinder::stopWorkers()
+{
+    _mutex.lock();
+    _abort = true;
+    _mutex.unlock();
+
+    _threadPool.waitForDone();
+}
+
+
+FileSize DuplicateFinder::wastedSize() const
+{
+    FileSize wasted = 0;
+
+    foreach ( const DuplicateGroup & group, _result )
+	wasted += group.size * ( group.paths.size() - 1 );
+
+    return wasted;
+}
+
+
+QByteArray DuplicateFinder::partialHash( const QString & path, FileSize size )
+{
+    QFile file( path );
+
+    if ( ! file.open( QIODevice::ReadOnly ) )
+	return QByteArray();
+
+    QCryptographicHash hash( QCryptographicHash::Sha1 );
+
+    if ( size <= 2 * HASH_BLOCK_SIZE )
+    {
+	hash.addData( file.readAll() );
+    }
+    else
+    {
+	hash.addData( file.read( HASH_BLOCK_SIZE ) );
+
+	if ( ! file.seek( size - HASH_BLOCK_SIZE ) )
+	    return QByteArray();
+
+	hash.addData( file.read( HASH_BLOCK_SIZE ) );
+    }
+
+    return file.error() == QFile::NoError ? hash.result() : QByteArray();
+}
+
+
+QByteArray DuplicateFinder::fullHash( const QString & path, volatile bool * abort )
+{
+    QFile file( path );
+
+    if ( ! file.open( QIODevice::ReadOnly ) )
+	return QByteArray();
+
+    QCryptographicHash hash( QCryptographicHash::Sha1 );
+
+    while ( ! file.atEnd() )
+    {
+	if ( abort && *abort )
+	    return QByteArray();
+
+	QByteArray chunk = file.read( FULL_HASH_CHUNK_SIZE );
+
+	if ( chunk.isEmpty() )
+	    break;
+
+	hash.addData( chunk );
+    }
+
+    return file.error() == QFile::NoError ? hash.result() : QByteArray();
+}
+
+
+
+
+void DuplicateHashWorker::run()
+{
+    while ( _finder->hashNext() )
+    {
+	// NOP
+    }
+}
@@ -0,0 +1,289 @@
+/*
+ *   File name: DuplicateFinder.h
+ *   Summary:	Finding files with the same content in a subtree
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef DuplicateFinder_h
+#define DuplicateFinder_h
+
+
+#include <sys/types.h>
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QVector>
+#include <QList>
+#include <QMutex>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QTimer>
+
+#include "FileInfo.h"
+
+
+namespace QDirStat
+{
+    /**
+     * One candidate file of a DuplicateFinder.
+     **/
+    struct DuplicateFile
+    {
+	QString	   path;
+	FileSize   size;
+	dev_t	   device;
+	ino_t	   inode;
+	QByteArray hash;	// Of the current stage; empty if unreadable
+    };
+
+
+    /**
+     * Files with the same content. The first one is the one to keep, all
+     * others are wasted space.
+     **/
+    struct DuplicateGroup
+    {
+	FileSize    size;	// Of each file
+	QStringList paths;
+    };
+
+
+    /**
+     * Class to find files with the same content in a subtree.
+     *
+     * This works in stages so that as few bytes as possible are read:
+     *
+     * - Only files with the same size can have the same content. The sizes
+     *	 are known from the tree, so most files are not even opened.
+     *
+     * - The files with the same size are compared by a hash of their first
+     *	 and last block. For small files, this is already all of them.
+     *
+     * - Only the files where that hash is the same as well are read
+     *	 completely, in the order of their device and inode number to
+     *	 keep the disk heads near the data.
+     *
+     * The hashes of each stage are calculated by a number of worker threads
+     * of a thread pool; this object just checks from a timer whether they
+     * are done, so the GUI stays responsive.
+     *
+     * Several hard links to the same inode are not duplicates: They don't
+     * waste any space. Only one of them is kept as a candidate.
+     **/
+    class DuplicateFinder: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	enum Stage
+	{
+	    Idle,
+	    PartialHash,	// Hashing the first and last block
+	    FullHash,		// Hashing the complete files
+	    Done
+	};
+
+	/**
+	 * Constructor.
+	 **/
+	DuplicateFinder( QObject * parent = 0 );
+
+	/**
+	 * Destructor. This stops the worker threads.
+	 **/
+	virtual ~DuplicateFinder();
+
+	/**
+	 * Return the minimum size of the files to compare.
+	 **/
+	FileSize minSize() const { return _minSize; }
+
+	/**
+	 * Set the minimum size of the files to compare. Empty files are
+	 * never compared: They don't waste any space.
+	 **/
+	void setMinSize( FileSize minSize ) { _minSize = qMax( minSize, 1LL ); }
+
+	/**
+	 * Return the number of worker threads for hashing.
+	 **/
+	int threads() const { return _threads; }
+
+	/**
+	 * Set the number of worker threads for hashing.
+	 **/
+	void setThreads( int threads );
+
+	/**
+	 * Start finding the duplicates in 'subtree'. This stops any search
+	 * that is still running. The result comes with the finished()
+	 * signal.
+	 **/
+	void start( FileInfo * subtree );
+
+	/**
+	 * Stop the search. This waits for the files that are being hashed
+	 * right now.
+	 **/
+	void abort();
+
+	/**
+	 * Return the current stage.
+	 **/
+	Stage stage() const { return _stage; }
+
+	/**
+	 * Return 'true' if the search is running.
+	 **/
+	bool isBusy() const { return _stage == PartialHash || _stage == FullHash; }
+
+	/**
+	 * Return the duplicates, the groups that waste the most space first.
+	 **/
+	const QList<DuplicateGroup> & result() const { return _result; }
+
+	/**
+	 * Return the space wasted by all duplicates.
+	 **/
+	FileSize wastedSize() const;
+
+	/**
+	 * Hash the next file of the current stage. Return 'false' if there is
+	 * nothing left to do.
+	 *
+	 * This is called in the worker threads.
+	 **/
+	bool hashNext();
+
+	/**
+	 * Return the hash of the first and last block of file 'path'. For
+	 * files that are not larger than two blocks, this is the hash of the
+	 * complete file. Return an empty hash upon error.
+	 **/
+	static QByteArray partialHash( const QString & path, FileSize size );
+
+	/**
+	 * Return the hash of the complete file 'path'. Return an empty hash
+	 * upon error or if 'abort' is set while reading.
+	 **/
+	static QByteArray fullHash( const QString & path, volatile bool * abort = 0 );
+
+
+    signals:
+
+	/**
+	 * Emitted from time to time while the search is running.
+	 **/
+	void progress( int done, int total );
+
+	/**
+	 * Emitted when the search is finished.
+	 **/
+	void finished();
+
+
+    protected slots:
+
+	/**
+	 * Check if the worker threads are done with the current stage.
+	 **/
+	void checkWorkers();
+
+
+    protected:
+
+	/**
+	 * Start the worker threads for 'stage' for the files in _files.
+	 **/
+	void startStage( Stage stage );
+
+	/**
+	 * Group the files of the finished stage by their size and hash and
+	 * start the next stage (or finish) with the ones that might still be
+	 * duplicates.
+	 **/
+	void nextStage();
+
+	/**
+	 * Recurse through 'subtree' with URL 'url' and add all files that
+	 * are large enough to 'files'.
+	 **/
+	void collect( FileInfo *	     subtree,
+		      const QString &	     url,
+		      QVector<DuplicateFile> & files );
+
+	/**
+	 * Add 'group' of files with the same content to the result.
+	 **/
+	void addResult( const QVector<DuplicateFile> & group );
+
+	/**
+	 * Sort the result and notify the world that the search is done.
+	 **/
+	void finish();
+
+	/**
+	 * Stop the worker threads and wait for them.
+	 **/
+	void stopWorkers();
+
+
+	// Data members
+
+	FileSize		_minSize;
+	int			_threads;
+	Stage			_stage;
+	QVector<DuplicateFile>	_files;	  // Of the current stage
+	DuplicateFile *		_jobs;	  // _files.data() for the workers
+	int			_jobCount;
+	int			_next;	  // Next job for the workers
+	int			_done;	  // Hashed files of this stage
+	volatile bool		_abort;
+	QMutex			_mutex;	  // For _next and _done
+	QThreadPool		_threadPool;
+	QTimer			_timer;
+	QList<DuplicateGroup>	_result;
+
+    };	// class DuplicateFinder
+
+
+
+    /**
+     * Worker thread for a DuplicateFinder: Hash files until the current
+     * stage is done.
+     **/
+    class DuplicateHashWorker: public QRunnable
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	DuplicateHashWorker( DuplicateFinder * finder ):
+	    QRunnable(),
+	    _finder( finder )
+	    { setAutoDelete( true ); }
+
+	/**
+	 * Do the work. This is called in a worker thread.
+	 *
+	 * Reimplemented from QRunnable.
+	 **/
+	virtual void run() Q_DECL_OVERRIDE;
+
+    protected:
+
+	DuplicateFinder * _finder;
+
+    };	// class DuplicateHashWorker
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef DuplicateFinder_h
@@ -0,0 +1,299 @@
+/*
+ *   File name: DuplicatesWindow.cpp
+ *   Summary:	QDirStat "duplicate files" window
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QMenu>
+
+#include "DuplicatesWindow.h"
+#include "FindFilesWindow.h"	// FindFilesResultItem
+#include "CleanupCollection.h"
+#include "DirTree.h"
+#include "SelectionModel.h"
+#include "Settings.h"
+#include "SettingsHelpers.h"
+#include "SignalBlocker.h"
+#include "HeaderTweaker.h"
+#include "Logger.h"
+#include "Exception.h"
+
+using namespace QDirStat;
+
+
+DuplicatesWindow::DuplicatesWindow( SelectionModel *	selectionModel,
+				    CleanupCollection * cleanupCollection,
+				    QWidget *		parent ):
+    QDialog( parent ),
+    _ui( new Ui::DuplicatesWindow ),
+    _selectionModel( selectionModel ),
+    _cleanupCollection( cleanupCollection )
+{
+    // logDebug() << "init" << endl;
+
+    CHECK_NEW( _ui );
+    _ui->setupUi( this );
+    initWidgets();
+    readWindowSettings( this, "DuplicatesWindow" );
+    readSettings();
+
+    connect( _ui->refreshButton,	  SIGNAL( clicked()	   ),
+	     this,			  SLOT	( refresh()	   ) );
+
+    connect( _ui->selectDuplicatesButton, SIGNAL( clicked()	   ),
+	     this,			  SLOT	( selectDuplicates() ) );
+
+    connect( _ui->treeWidget,		  SIGNAL( itemSelectionChanged() ),
+	     this,			  SLOT	( selectResults()	 ) );
+
+    connect( _ui->treeWidget,		  SIGNAL( customContextMenuRequested( QPoint ) ),
+	     this,			  SLOT	( contextMenu		    ( QPoint ) ) );
+
+    connect( &_finder,			  SIGNAL( progress    ( int, int ) ),
+	     this,			  SLOT	( showProgress( int, int ) ) );
+
+    connect( &_finder,			  SIGNAL( finished()   ),
+	     this,			  SLOT	( showResult() ) );
+}
+
+
+DuplicatesWindow::~DuplicatesWindow()
+{
+    // logDebug() << "destroying" << endl;
+    _finder.abort();
+    writeWindowSettings( this, "DuplicatesWindow" );
+    writeSettings();
+}
+
+
+void DuplicatesWindow::readSettings()
+{
+    Settings settings;
+    settings.beginGroup( "DuplicatesWindow" );
+
+    _ui->minSizeSpinBox->setValue( settings.value( "MinSizeKB", 100 ).toInt() );
+    _finder.setThreads( settings.value( "HashThreads", _finder.threads() ).toInt() );
+
+    settings.endGroup();
+}
+
+
+void DuplicatesWindow::writeSettings()
+{
+    Settings settings;
+    settings.beginGroup( "DuplicatesWindow" );
+
+    settings.setValue( "MinSizeKB",   _ui->minSizeSpinBox->value() );
+    settings.setValue( "HashThreads", _finder.threads() );
+
+    settings.endGroup();
+}
+
+
+void DuplicatesWindow::initWidgets()
+{
+    QFont font = _ui->heading->font();
+    font.setBold( true );
+    _ui->heading->setFont( font );
+
+    _ui->treeWidget->setColumnCount( FFR_ColumnCount );
+    _ui->treeWidget->setHeaderLabels( QStringList()
+				      << tr( "Name" )
+				      << tr( "Size" )
+				      << tr( "Directory" ) );
+    _ui->treeWidget->header()->setStretchLastSection( false );
+    HeaderTweaker::resizeToContents( _ui->treeWidget->header() );
+}
+
+
+void DuplicatesWindow::reject()
+{
+    deleteLater();
+}
+
+
+void DuplicatesWindow::populate( FileInfo * subtree )
+{
+    _subtree = subtree;
+    refresh();
+}
+
+
+void DuplicatesWindow::refresh()
+{
+    _ui->treeWidget->clear();
+    _ui->selectDuplicatesButton->setEnabled( false );
+
+    if ( ! _subtree() )
+	return;
+
+    _ui->heading->setText( tr( "Duplicate Files below %1" ).arg( _subtree.url() ) );
+    _ui->progressLabel->setText( tr( "Comparing file sizes..." ) );
+
+    _finder.setMinSize( 1024LL * _ui->minSizeSpinBox->value() );
+    _finder.start( _subtree() );
+}
+
+
+void DuplicatesWindow::showProgress( int done, int total )
+{
+    QString stage = _finder.stage() == DuplicateFinder::FullHash ?
+	tr( "Comparing the content of the files" ) :
+	tr( "Comparing the first and last block of the files" );
+
+    _ui->progressLabel->setText( tr( "%1: %2 of %3" ).arg( stage ).arg( done ).arg( total ) );
+}
+
+
+void DuplicatesWindow::showResult()
+{
+    _ui->treeWidget->clear();
+    DirTree * tree = _subtree.tree();
+
+    if ( ! tree )
+	return;
+
+    // For better Performance: Disable sorting while inserting many items
+    _ui->treeWidget->setSortingEnabled( false );
+
+    int fileCount = 0;
+
+    foreach ( const DuplicateGroup & group, _finder.result() )
+    {
+	DuplicateGroupItem * groupItem = new DuplicateGroupItem( group );
+	CHECK_NEW( groupItem );
+
+	foreach ( const QString & path, group.paths )
+	{
+	    // The tree might have changed while the files were hashed
+
+	    FileInfo * file = tree->locate( path );
+
+	    if ( file )
+	    {
+		FindFilesResultItem * item = new FindFilesResultItem( file );
+		CHECK_NEW( item );
+
+		groupItem->addChild( item );
+	    }
+	}
+
+	if ( groupItem->childCount() > 1 )
+	{
+	    _ui->treeWidget->addTopLevelItem( groupItem );
+	    fileCount += groupItem->childCount();
+	}
+	else
+	{
+	    delete groupItem;
+	}
+    }
+
+    _ui->treeWidget->setSortingEnabled( true );
+    _ui->treeWidget->sortByColumn( FFR_SizeCol, Qt::DescendingOrder );
+    _ui->treeWidget->expandAll();
+    HeaderTweaker::resizeToContents( _ui->treeWidget->header() );
+
+    _ui->progressLabel->setText( tr( "%1 files in %2 groups, wasting %3" )
+				 .arg( fileCount )
+				 .arg( _ui->treeWidget->topLevelItemCount() )
+				 .arg( formatSize( _finder.wastedSize() ) ) );
+    _ui->selectDuplicatesButton->setEnabled( fileCount > 0 );
+}
+
+
+void DuplicatesWindow::selectDuplicates()
+{
+    {
+	// Selecting the result items one by one would select them one by
+	// one in the main window as well
+
+	SignalBlocker sigBlocker( _ui->treeWidget );
+	_ui->treeWidget->clearSelection();
+
+	for ( int i=0; i < _ui->treeWidget->topLevelItemCount(); ++i )
+	{
+	    QTreeWidgetItem * groupItem = _ui->treeWidget->topLevelItem( i );
+
+	    for ( int j=1; j < groupItem->childCount(); ++j )
+		groupItem->child( j )->setSelected( true );
+	}
+    }
+
+    selectResults();
+}
+
+
+void DuplicatesWindow::selectResults()
+{
+    if ( ! _subtree.tree() )
+	return;
+
+    FileInfoSet files;
+
+    foreach ( QTreeWidgetItem * item, _ui->treeWidget->selectedItems() )
+    {
+	FindFilesResultItem * result = dynamic_cast<FindFilesResultItem *>( item );
+
+	if ( ! result )	    // A group
+	    continue;
+
+	FileInfo * file = _subtree.tree()->locate( result->path() );
+
+	if ( file )
+	    files << file;
+    }
+
+    if ( files.size() == 1 )
+	_selectionModel->setCurrentItem( *files.begin(), true );
+    else if ( ! files.isEmpty() )
+	_selectionModel->setSelectedItems( files );
+}
+
+
+void DuplicatesWindow::contextMenu( const QPoint & pos )
+{
+    if ( ! _cleanupCollection || _ui->treeWidget->selectedItems().isEmpty() )
+	return;
+
+    QMenu menu;
+    _cleanupCollection->addToMenu( &menu );
+    menu.exec( _ui->treeWidget->viewport()->mapToGlobal( pos ) );
+}
+
+
+
+
+DuplicateGroupItem::DuplicateGroupItem( const DuplicateGroup & group ):
+    QTreeWidgetItem( QTreeWidgetItem::UserType ),
+    _wastedSize( group.size * ( group.paths.size() - 1 ) )
+{
+    setText( FFR_NameCol, QObject::tr( "%1 identical files" ).arg( group.paths.size() ) );
+    setText( FFR_SizeCol, formatSize( _wastedSize ) );
+    setText( FFR_PathCol, QObject::tr( "wasted" ) );
+
+    setTextAlignment( FFR_NameCol, Qt::AlignLeft  );
+    setTextAlignment( FFR_SizeCol, Qt::AlignRight );
+    setTextAlignment( FFR_PathCol, Qt::AlignLeft  );
+}
+
+
+bool DuplicateGroupItem::operator<(const QTreeWidgetItem & rawOther) const
+{
+    // Since this is a reference, the dynamic_cast will throw a std::bad_cast
+    // exception if it fails. Only groups are toplevel items, so this is a
+    // genuine error.
+    const DuplicateGroupItem & other = dynamic_cast<const DuplicateGroupItem &>( rawOther );
+
+    int col = treeWidget() ? treeWidget()->sortColumn() : FFR_SizeCol;
+
+    switch ( col )
+    {
+	case FFR_NameCol: return childCount() < other.childCount();
+	case FFR_SizeCol: return wastedSize() < other.wastedSize();
+	default:	  return QTreeWidgetItem::operator<( rawOther );
+    }
+}
@@ -0,0 +1,177 @@
+/*
+ *   File name: DuplicatesWindow.h
+ *   Summary:	QDirStat "duplicate files" window
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef DuplicatesWindow_h
+#define DuplicatesWindow_h
+
+
+#include <QDialog>
+#include <QTreeWidgetItem>
+
+#include "ui_duplicates-window.h"
+#include "DuplicateFinder.h"
+#include "FileInfo.h"
+#include "Subtree.h"
+
+
+namespace QDirStat
+{
+    class SelectionModel;
+    class CleanupCollection;
+
+
+    /**
+     * Modeless dialog to show the files with the same content in a subtree,
+     * the groups that waste the most space first. See DuplicateFinder.
+     *
+     * The files that the user selects here are selected in the main window,
+     * so the cleanup actions (also in the context menu of this window) work
+     * on them. "Select Duplicates" selects all but the first file of each
+     * group.
+     **/
+    class DuplicatesWindow: public QDialog
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor.
+	 *
+	 * Notice that this widget will destroy itself upon window close.
+	 *
+	 * It is advised to use a QPointer for storing a pointer to an instance
+	 * of this class. The QPointer will keep track of this window
+	 * auto-deleting itself when closed.
+	 **/
+	DuplicatesWindow( SelectionModel *    selectionModel,
+			  CleanupCollection * cleanupCollection,
+			  QWidget *	      parent );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~DuplicatesWindow();
+
+	/**
+	 * Return the subtree of the files.
+	 **/
+	const Subtree & subtree() const { return _subtree; }
+
+    public slots:
+
+	/**
+	 * Populate the window: Find the duplicates in 'subtree'.
+	 **/
+	void populate( FileInfo * subtree );
+
+	/**
+	 * Start the search again.
+	 **/
+	void refresh();
+
+	/**
+	 * Select all files but the first one of each group.
+	 **/
+	void selectDuplicates();
+
+	/**
+	 * Reject the dialog contents, i.e. the user clicked the "Cancel" or
+	 * WM_CLOSE button. This not only closes the dialog, it also deletes
+	 * it.
+	 *
+	 * Reimplemented from QDialog.
+	 **/
+	virtual void reject() Q_DECL_OVERRIDE;
+
+    protected slots:
+
+	/**
+	 * Show the progress of the search.
+	 **/
+	void showProgress( int done, int total );
+
+	/**
+	 * Show the result of the search.
+	 **/
+	void showResult();
+
+	/**
+	 * Select the selected files in the main window's tree and treemap
+	 * widgets via their SelectionModel.
+	 **/
+	void selectResults();
+
+	/**
+	 * Open the context menu with the cleanup actions.
+	 **/
+	void contextMenu( const QPoint & pos );
+
+    protected:
+
+	/**
+	 * One-time initialization of the widgets in this window.
+	 **/
+	void initWidgets();
+
+	/**
+	 * Read parameters from the settings file.
+	 **/
+	void readSettings();
+
+	/**
+	 * Write parameters to the settings file.
+	 **/
+	void writeSettings();
+
+
+	//
+	// Data members
+	//
+
+	Ui::DuplicatesWindow *	_ui;
+	Subtree			_subtree;
+	SelectionModel *	_selectionModel;
+	CleanupCollection *	_cleanupCollection;
+	DuplicateFinder		_finder;
+    };
+
+
+    /**
+     * Item class for one group of files with the same content. The files
+     * are its children.
+     **/
+    class DuplicateGroupItem: public QTreeWidgetItem
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	DuplicateGroupItem( const DuplicateGroup & group );
+
+	/**
+	 * Return the space wasted by this group.
+	 **/
+	FileSize wastedSize() const { return _wastedSize; }
+
+	/**
+	 * Less-than operator for sorting.
+	 **/
+	virtual bool operator<(const QTreeWidgetItem & other) const Q_DECL_OVERRIDE;
+
+    protected:
+
+	FileSize	_wastedSize;
+    };
+
+} // namespace QDirStat
+
+
+#endif // DuplicatesWindow_h
@@ -7,6 +7,8 @@
  */
 
 
+#include <string.h>	// strchr()
+
 #include "ExcludeRules.h"
 #include "Settings.h"
 #include "SettingsHelpers.h"
@@ -41,6 +43,20 @@ ExcludeRule::~ExcludeRule()
 }
 
 
+void ExcludeRule::setRegexp( const QRegExp & regexp )
+{
+    _regexp = regexp;
+    ExcludeRules::instance()->rulesChanged();
+}
+
+
+void ExcludeRule::setUseFullPath( bool useFullPath )
+{
+    _useFullPath = useFullPath;
+    ExcludeRules::instance()->rulesChanged();
+}
+
+
 bool ExcludeRule::match( const QString & fullPath, const QString & fileName )
 {
     QString matchText = _useFullPath ? fullPath : fileName;
@@ -60,11 +76,259 @@ bool ExcludeRule::match( const QString & fullPath, const QString & fileName )
 //
 
 
+ExcludeMatcher::ExcludeMatcher()
+{
+    // NOP
+}
+
+
+void ExcludeMatcher::compile( const ExcludeRuleList & rules )
+{
+    _namePart	  = MatcherPart();
+    _fullPathPart = MatcherPart();
+
+    foreach ( ExcludeRule * rule, rules )
+    {
+	if ( ! rule->regexp().pattern().isEmpty() )
+	    addRule( rule->useFullPath() ? _fullPathPart : _namePart, rule );
+    }
+
+    finishPart( _namePart );
+    finishPart( _fullPathPart );
+}
+
+
+void ExcludeMatcher::addRule( MatcherPart & part, ExcludeRule * rule )
+{
+    const QRegExp & regexp = rule->regexp();
+    QString pattern	   = regexp.pattern();
+    QRegExp::PatternSyntax syntax = regexp.patternSyntax();
+    bool caseSensitive = regexp.caseSensitivity() == Qt::CaseSensitive;
+    bool wildcard      = syntax == QRegExp::Wildcard || syntax == QRegExp::WildcardUnix;
+
+    if ( isLiteral( pattern, syntax ) )
+    {
+	if ( caseSensitive )
+	    part.exact.insert( pattern );
+	else
+	    part.exactCaseFolded.insert( pattern.toCaseFolded() );
+
+	return;
+    }
+
+    // "foo*" or "foo.*"
+
+    QString wildcardSuffix = wildcard ? "*" : ".*";
+
+    if ( syntax != QRegExp::FixedString &&
+	 pattern.endsWith( wildcardSuffix ) &&
+	 isLiteral( pattern.left( pattern.size() - wildcardSuffix.size() ), syntax ) )
+    {
+	QString prefix = pattern.left( pattern.size() - wildcardSuffix.size() );
+
+	if ( caseSensitive )
+	    part.prefixes << prefix;
+	else
+	    part.prefixesCaseInsensitive << prefix;
+
+	return;
+    }
+
+#ifdef HAVE_QREGULAREXPRESSION
+
+    QString converted;
+
+    if ( wildcard )
+	converted = wildcardToRegexp( pattern, syntax == QRegExp::WildcardUnix );
+    else if ( ! pattern.contains( QRegExp( "\\\\[0-9]" ) ) ) // No backreferences
+	converted = pattern;
+
+    if ( ! converted.isEmpty() )
+    {
+	converted = QString( caseSensitive ? "(?:%1)" : "(?i:%1)" ).arg( converted );
+
+	if ( QRegularExpression( converted ).isValid() )
+	{
+	    part.regexpAlternatives << converted;
+	    return;
+	}
+    }
+
+#endif
+
+    part.fallbackRules << rule;
+}
+
+
+void ExcludeMatcher::finishPart( MatcherPart & part )
+{
+#ifdef HAVE_QREGULAREXPRESSION
+
+    if ( part.regexpAlternatives.isEmpty() )
+	return;
+
+    part.regexp = QRegularExpression( "\\A(?:" + part.regexpAlternatives.join( "|" ) + ")\\z" );
+
+    if ( part.regexp.isValid() )
+    {
+	part.hasRegexp = true;
+
+#if (QT_VERSION >= QT_VERSION_CHECK( 5, 4, 0 ))
+	part.regexp.optimize();	    // Use the JIT right away
+#endif
+    }
+    else
+    {
+	logError() << "Can't combine exclude rules: " << part.regexp.errorString() << endl;
+    }
+
+    part.regexpAlternatives.clear();
+
+#else
+    Q_UNUSED( part );
+#endif
+}
+
+
+bool ExcludeMatcher::match( const QString & fullPath, const QString & fileName )
+{
+    return matchPart( _namePart,     fullPath, fileName ) ||
+	   matchPart( _fullPathPart, fullPath, fileName );
+}
+
+
+bool ExcludeMatcher::matchPart( MatcherPart &	part,
+				const QString & fullPath,
+				const QString & fileName )
+{
+    const QString & text = &part == &_fullPathPart ? fullPath : fileName;
+
+    if ( text.isEmpty() )
+	return false;
+
+    if ( ! part.exact.isEmpty() && part.exact.contains( text ) )
+	return true;
+
+    if ( ! part.exactCaseFolded.isEmpty() && part.exactCaseFolded.contains( text.toCaseFolded() ) )
+	return true;
+
+    foreach ( const QString & prefix, part.prefixes )
+    {
+	if ( text.startsWith( prefix ) )
+	    return true;
+    }
+
+    foreach ( const QString & prefix, part.prefixesCaseInsensitive )
+    {
+	if ( text.startsWith( prefix, Qt::CaseInsensitive ) )
+	    return true;
+    }
+
+#ifdef HAVE_QREGULAREXPRESSION
+
+    if ( part.hasRegexp && part.regexp.match( text ).hasMatch() )
+	return true;
+
+#endif
+
+    foreach ( ExcludeRule * rule, part.fallbackRules )
+    {
+	if ( rule->match( fullPath, fileName ) )
+	    return true;
+    }
+
+    return false;
+}
+
+
+bool ExcludeMatcher::isLiteral( const QString & pattern, QRegExp::PatternSyntax syntax )
+{
+    const char * specialChars = "";
+
+    switch ( syntax )
+    {
+	case QRegExp::FixedString:
+	    return true;
+
+	case QRegExp::Wildcard:
+	    specialChars = "*?[";
+	    break;
+
+	case QRegExp::WildcardUnix:
+	    specialChars = "*?[\\";
+	    break;
+
+	default:
+	    specialChars = "\\^$.|?*+()[]{}";
+	    break;
+    }
+
+    for ( int i=0; i < pattern.size(); ++i )
+    {
+	QChar c = pattern.at( i );
+
+	if ( c.unicode() < 128 && strchr( specialChars, c.toLatin1() ) )
+	    return false;
+    }
+
+    return true;
+}
+
+
+#ifdef HAVE_QREGULAREXPRESSION
+
+QString ExcludeMatcher::wildcardToRegexp( const QString & pattern, bool unixSyntax )
+{
+    QString result;
+    int i = 0;
+
+    while ( i < pattern.size() )
+    {
+	QChar c = pattern.at( i++ );
+
+	if ( c == '*' )
+	    result += ".*";
+	else if ( c == '?' )
+	    result += '.';
+	else if ( c == '\\' && unixSyntax && i < pattern.size() )
+	    result += QRegularExpression::escape( pattern.at( i++ ) );
+	else if ( c == '[' && pattern.indexOf( ']', i + 1 ) > 0 )
+	{
+	    // Character class: Copy it, but with "[!...]" as "[^...]".
+	    // A ']' right after the '[' is part of the class.
+
+	    int end = pattern.indexOf( ']', i + 1 );
+	    QString charClass = pattern.mid( i, end - i );
+
+	    if ( charClass.startsWith( '!' ) )
+		charClass[0] = '^';
+
+	    charClass.replace( "\\", "\\\\" );
+	    result += '[' + charClass + ']';
+	    i = end + 1;
+	}
+	else
+	    result += QRegularExpression::escape( QString( c ) );
+    }
+
+    return result;
+}
+
+#endif
+
+
+//
+//---------------------------------------------------------------------------
+//
+
+
 ExcludeRules::ExcludeRules():
     QObject(),
     _listMover( _rules )
 {
     _lastMatchingRule = 0;
+    _version	      = 0;
+    _matcherVersion   = -1;
 }
 
 
@@ -93,6 +357,7 @@ void ExcludeRules::clear()
     qDeleteAll( _rules );
     _rules.clear();
     _lastMatchingRule = 0;
+    rulesChanged();
 }
 
 
@@ -100,6 +365,7 @@ void ExcludeRules::add( ExcludeRule * rule )
 {
     CHECK_PTR( rule );
     _rules << rule;
+    rulesChanged();
 }
 
 
@@ -124,6 +390,7 @@ void ExcludeRules::remove( ExcludeRule * rule )
 
     _rules.removeAll( rule );
     delete rule;
+    rulesChanged();
 }
 
 
@@ -133,21 +400,27 @@ bool ExcludeRules::match( const QString & fullPath, const QString & fileName )
     if ( fullPath.isEmpty() || fileName.isEmpty() )
 	return false;
 
-    foreach ( ExcludeRule * rule, _rules )
+    if ( _matcherVersion != _version )
     {
-	if ( rule->match( fullPath, fileName ) )
-	{
-	    _lastMatchingRule = rule;
+	_matcher.compile( _rules );
+	_matcherVersion = _version;
+    }
+
+    if ( ! _matcher.match( fullPath, fileName ) )
+	return false;
+
+    // Matches are rare, so it's cheap enough to find out which rule it was
+    // the slow way.
+
+    _lastMatchingRule = const_cast<ExcludeRule *>( matchingRule( fullPath, fileName ) );
+
 #if VERBOSE_EXCLUDE_MATCHES
 
-	    logDebug() << fullPath << " matches " << rule << endl;
+    logDebug() << fullPath << " matches " << _lastMatchingRule << endl;
 
 #endif
-	    return true;
-	}
-    }
 
-    return false;
+    return true;
 }
 
 
@@ -170,24 +443,28 @@ const ExcludeRule * ExcludeRules::matchingRule( const QString & fullPath,
 void ExcludeRules::moveUp( ExcludeRule * rule )
 {
     _listMover.moveUp( rule );
+    rulesChanged();
 }
 
 
 void ExcludeRules::moveDown( ExcludeRule * rule )
 {
     _listMover.moveDown( rule );
+    rulesChanged();
 }
 
 
 void ExcludeRules::moveToTop( ExcludeRule * rule )
 {
     _listMover.moveToTop( rule );
+    rulesChanged();
 }
 
 
 void ExcludeRules::moveToBottom( ExcludeRule * rule )
 {
     _listMover.moveToBottom( rule );
+    rulesChanged();
 }
 
 
@@ -14,8 +14,15 @@
 #include <QString>
 #include <QRegExp>
 #include <QList>
+#include <QSet>
+#include <QStringList>
 #include <QTextStream>
 
+#if (QT_VERSION >= QT_VERSION_CHECK( 5, 0, 0 ))
+#  include <QRegularExpression>
+#  define HAVE_QREGULAREXPRESSION 1
+#endif
+
 #include "ListMover.h"
 
 
@@ -67,7 +74,7 @@ namespace QDirStat
 	/**
 	 * Change this rule's regular expression.
 	 **/
-	void setRegexp( const QRegExp & regexp ) { _regexp = regexp; }
+	void setRegexp( const QRegExp & regexp );
 
 	/**
 	 * Return 'true' if this exclude rule uses the full path to match
@@ -78,7 +85,7 @@ namespace QDirStat
 	/**
 	 * Set the 'full path' flag.
 	 **/
-	void setUseFullPath( bool useFullPath ) { _useFullPath = useFullPath; }
+	void setUseFullPath( bool useFullPath );
 
     private:
 
@@ -91,6 +98,109 @@ namespace QDirStat
     typedef ExcludeRuleList::const_iterator ExcludeRuleListIterator;
 
 
+    /**
+     * All exclude rules of a rule set compiled into one matcher.
+     *
+     * Matching each rule's QRegExp one after another is expensive when it
+     * is done for every directory found during a scan. The matcher sorts
+     * the rules by what they really need:
+     *
+     * - Rules that are just a fixed string (no matter if they are written
+     *	 as fixed string, wildcard or regexp) end up in a hash set.
+     *
+     * - Rules that are a fixed string followed by "*" (or ".*") are
+     *	 checked with a simple prefix comparison.
+     *
+     * - All other rules are combined into one alternation of a
+     *	 QRegularExpression (with JIT if available), so there is only one
+     *	 regexp match for all of them.
+     *
+     * This is done separately for the rules that match against the full
+     * path and those that match against the file name only.
+     *
+     * Rules that can't be converted (e.g. with backreferences) are still
+     * matched with their own QRegExp.
+     **/
+    class ExcludeMatcher
+    {
+    public:
+
+	/**
+	 * Constructor. This creates an empty matcher that never matches.
+	 **/
+	ExcludeMatcher();
+
+	/**
+	 * Compile 'rules' into this matcher, replacing the previous content.
+	 **/
+	void compile( const ExcludeRuleList & rules );
+
+	/**
+	 * Return 'true' if any of the compiled rules matches. This gives
+	 * the same result as matching each rule individually.
+	 **/
+	bool match( const QString & fullPath, const QString & fileName );
+
+#ifdef HAVE_QREGULAREXPRESSION
+	/**
+	 * Convert a QRegExp wildcard pattern to a QRegularExpression pattern
+	 * (without anchors). 'unixSyntax' is for QRegExp::WildcardUnix
+	 * where a backslash escapes the next character.
+	 **/
+	static QString wildcardToRegexp( const QString & pattern, bool unixSyntax );
+#endif
+
+
+    protected:
+
+	/**
+	 * Compiled rules for one kind of match text (full path or file name).
+	 **/
+	struct MatcherPart
+	{
+	    QSet<QString>	exact;		  // Case sensitive
+	    QSet<QString>	exactCaseFolded;  // Case insensitive
+	    QStringList		prefixes;
+	    QStringList		prefixesCaseInsensitive;
+	    ExcludeRuleList	fallbackRules;
+#ifdef HAVE_QREGULAREXPRESSION
+	    QStringList		regexpAlternatives;
+	    QRegularExpression	regexp;
+#endif
+	    bool		hasRegexp;
+
+	    MatcherPart(): hasRegexp( false ) {}
+	};
+
+	/**
+	 * Add 'rule' to 'part'.
+	 **/
+	void addRule( MatcherPart & part, ExcludeRule * rule );
+
+	/**
+	 * Build the combined regexp of 'part' from its alternatives.
+	 **/
+	void finishPart( MatcherPart & part );
+
+	/**
+	 * Match 'text' against 'part'.
+	 **/
+	bool matchPart( MatcherPart & part,
+			const QString & fullPath,
+			const QString & fileName );
+
+	/**
+	 * Return 'true' if 'pattern' with 'syntax' matches only itself, i.e.
+	 * if it doesn't contain any special characters of that syntax.
+	 **/
+	static bool isLiteral( const QString & pattern, QRegExp::PatternSyntax syntax );
+
+
+	MatcherPart _namePart;
+	MatcherPart _fullPathPart;
+    };
+
+
     /**
      * Container for multiple exclude rules. This is a singleton class. Use the
      * static methods or instance() to access the singleton.
@@ -181,6 +291,14 @@ namespace QDirStat
 	 **/
 	void clear();
 
+	/**
+	 * Notification that the rules changed, so the compiled matcher needs
+	 * to be rebuilt before the next match(). This is called automatically
+	 * when rules are added, removed or moved, and when an ExcludeRule is
+	 * changed.
+	 **/
+	void rulesChanged() { ++_version; }
+
 	/**
 	 * Return 'true' if the exclude rules are empty, i.e. if there are no
 	 * exclue rules, 'false' otherwise.
@@ -242,6 +360,9 @@ namespace QDirStat
 	ExcludeRuleList		 _rules;
 	ListMover<ExcludeRule *> _listMover;
 	ExcludeRule *		 _lastMatchingRule;
+	ExcludeMatcher		 _matcher;
+	int			 _version;	   // Incremented for each change
+	int			 _matcherVersion;  // Version of _matcher
     };
 
 
@@ -0,0 +1,348 @@
+/*
+ *   File name: ExtentStats.cpp
+ *   Summary:	Shared and exclusive disk space from the file extents
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+
+#include <QThread>
+#include <QMutexLocker>
+
+#include "ExtentStats.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "FileInfoIterator.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+#define FIEMAP_EXTENTS	256	// Extents per ioctl()
+#define CHECK_INTERVAL	200	// millisec
+
+using namespace QDirStat;
+
+
+ExtentStats::ExtentStats( DirTree * tree ):
+    QObject( tree ),
+    _tree( tree ),
+    _subtree( 0 ),
+    _jobData( 0 ),
+    _jobCount( 0 ),
+    _next( 0 ),
+    _done( 0 ),
+    _abort( false )
+{
+    CHECK_PTR( _tree );
+
+    _threadPool.setMaxThreadCount( qMax( 1, QThread::idealThreadCount() ) );
+    _timer.setInterval( CHECK_INTERVAL );
+
+    connect( &_timer, SIGNAL( timeout()	     ),
+	     this,    SLOT  ( checkWorkers() ) );
+
+    connect( _tree,   SIGNAL( deletingChild  ( FileInfo * ) ),
+	     this,    SLOT  ( deletingChild  ( FileInfo * ) ) );
+
+    connect( _tree,   SIGNAL( clearingSubtree( DirInfo *  ) ),
+	     this,    SLOT  ( clearingSubtree( DirInfo *  ) ) );
+
+    connect( _tree,   SIGNAL( clearing() ),
+	     this,    SLOT  ( clear()	 ) );
+}
+
+
+ExtentStats::~ExtentStats()
+{
+    stopWorkers();
+}
+
+
+void ExtentStats::start( FileInfo * subtree )
+{
+    abort();
+    _counts.clear();
+
+    if ( ! subtree )
+	return;
+
+    subtree->tree()->thaw( subtree );
+    _subtree = subtree;
+    collect( subtree, subtree->url() );
+
+    logInfo() << "Counting the extents of " << _jobs.size() << " files below "
+	      << subtree->url() << endl;
+
+    _jobData  = _jobs.data();	// Detaching here, not in the workers
+    _jobCount = _jobs.size();
+    _next     = 0;
+    _done     = 0;
+    _abort    = false;
+
+    if ( _jobCount == 0 )
+    {
+	addResults();
+	return;
+    }
+
+    emit progress( 0, _jobCount );
+
+    for ( int i=0; i < qMin( _threadPool.maxThreadCount(), _jobCount ); ++i )
+    {
+	ExtentWorker * worker = new ExtentWorker( this );
+	CHECK_NEW( worker );
+	_threadPool.start( worker );	// The thread pool takes ownership
+    }
+
+    _timer.start();
+}
+
+
+void ExtentStats::collect( FileInfo * subtree, const QString & url )
+{
+    if ( subtree->isFile() )
+    {
+	// Links to an inode that is already counted don't count again
+
+	if ( ! subtree->isDuplicateLink() )
+	{
+	    ExtentJob job;
+	    job.file = subtree;
+	    job.path = url;
+	    job.counts.exclusive = subtree->allocatedSize();
+	    _jobs << job;
+	}
+
+	return;
+    }
+
+    FileInfoUrlIterator it( subtree, url );
+
+    while ( *it )
+    {
+	collect( *it, it.url() );
+	++it;
+    }
+}
+
+
+bool ExtentStats::countNext()
+{
+    _mutex.lock();
+
+    if ( _abort || _next >= _jobCount )
+    {
+	_mutex.unlock();
+	return false;
+    }
+
+    ExtentJob & job = _jobData[ _next++ ];
+    _mutex.unlock();
+
+    // job.counts still has the allocated size from collect()
+
+    countExtents( job.path, job.counts.exclusive, job.counts );
+
+    QMutexLocker locker( &_mutex );
+    ++_done;
+
+    return true;
+}
+
+
+void ExtentStats::checkWorkers()
+{
+    _mutex.lock();
+    int done = _done;
+    _mutex.unlock();
+
+    emit progress( done, _jobCount );
+
+    if ( done < _jobCount )
+	return;
+
+    _timer.stop();
+    _threadPool.waitForDone();
+    addResults();
+}
+
+
+void ExtentStats::addResults()
+{
+    FileInfo * stop = _subtree ? _subtree->parent() : 0;
+
+    foreach ( const ExtentJob & job, _jobs )
+    {
+	for ( FileInfo * item = job.file; item && item != stop; item = item->parent() )
+	{
+	    ExtentCounts & counts = _counts[ item ];
+	    counts.exclusive += job.counts.exclusive;
+	    counts.shared    += job.counts.shared;
+	}
+    }
+
+    _jobs     = QVector<ExtentJob>();
+    _jobData  = 0;
+    _jobCount = 0;
+
+    if ( _subtree )
+    {
+	logInfo() << "Below " << _subtree->url() << ": "
+		  << formatSize( exclusiveSize( _subtree ) ) << " exclusive, "
+		  << formatSize( sharedSize( _subtree ) ) << " shared"
+		  << endl;
+    }
+
+    emit finished();
+}
+
+
+void ExtentStats::abort()
+{
+    if ( ! isBusy() )
+	return;
+
+    logInfo() << "Aborting" << endl;
+    _timer.stop();
+    stopWorkers();
+
+    _jobs     = QVector<ExtentJob>();
+    _jobData  = 0;
+    _jobCount = 0;
+}
+
+
+void ExtentStats::clear()
+{
+    bool hadResult = ! _counts.isEmpty() || isBusy();
+
+    abort();
+    _counts.clear();
+    _subtree = 0;
+
+    if ( hadResult )
+	emit cleared();
+}
+
+
+void ExtentStats::stopWorkers()
+{
+    _mutex.lock();
+    _abort = true;
+    _mutex.unlock();
+
+    _threadPool.waitForDone();
+}
+
+
+void ExtentStats::deletingChild( FileInfo * )
+{
+    clear();
+}
+
+
+void ExtentStats::clearingSubtree( DirInfo * )
+{
+    clear();
+}
+
+
+bool ExtentStats::countExtents( const QString & path,
+				FileSize	allocatedSize,
+				ExtentCounts &	counts )
+{
+    counts.exclusive = allocatedSize;
+    counts.shared    = 0;
+
+    int fd = open( path.toUtf8(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC );
+
+    if ( fd < 0 )
+	return false;
+
+    QByteArray buffer( sizeof( struct fiemap ) +
+		       FIEMAP_EXTENTS * sizeof( struct fiemap_extent ), 0 );
+    struct fiemap * fiemap = (struct fiemap *) buffer.data();
+
+    FileSize exclusive = 0;
+    FileSize shared    = 0;
+    bool     encoded   = false;
+    bool     last      = false;
+    bool     ok	       = true;
+    __u64    start     = 0;
+
+    while ( ! last )
+    {
+	memset( fiemap, 0, buffer.size() );
+	fiemap->fm_start	= start;
+	fiemap->fm_length	= FIEMAP_MAX_OFFSET - start;
+	fiemap->fm_extent_count = FIEMAP_EXTENTS;
+
+	if ( ioctl( fd, FS_IOC_FIEMAP, fiemap ) < 0 )
+	{
+	    ok = false;		// Not supported by this filesystem
+	    break;
+	}
+
+	if ( fiemap->fm_mapped_extents == 0 )
+	    break;
+
+	for ( __u32 i=0; i < fiemap->fm_mapped_extents; ++i )
+	{
+	    const struct fiemap_extent & extent = fiemap->fm_extents[ i ];
+
+	    if ( extent.fe_flags & FIEMAP_EXTENT_SHARED )
+		shared += extent.fe_length;
+	    else
+		exclusive += extent.fe_length;
+
+	    if ( extent.fe_flags & FIEMAP_EXTENT_ENCODED )
+		encoded = true;
+
+	    if ( extent.fe_flags & FIEMAP_EXTENT_LAST )
+		last = true;
+
+	    start = extent.fe_logical + extent.fe_length;
+	}
+    }
+
+    close( fd );
+
+    if ( ! ok )
+	return false;
+
+    // Compressed extents are reported with their uncompressed length, but
+    // they only need the allocated size on disk.
+
+    FileSize total = exclusive + shared;
+
+    if ( encoded && total > allocatedSize && total > 0 )
+    {
+	double ratio = (double) allocatedSize / total;
+	exclusive = (FileSize) ( exclusive * ratio );
+	shared	  = allocatedSize - exclusive;
+    }
+
+    counts.exclusive = exclusive;
+    counts.shared    = shared;
+
+    return true;
+}
+
+
+
+
+void ExtentWorker::run()
+{
+    while ( _stats->countNext() )
+    {
+	// NOP
+    }
+}
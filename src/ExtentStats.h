@@ -0,0 +1,269 @@
+/*
+ *   File name: ExtentStats.h
+ *   Summary:	Shared and exclusive disk space from the file extents
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef ExtentStats_h
+#define ExtentStats_h
+
+
+#include <QObject>
+#include <QString>
+#include <QHash>
+#include <QVector>
+#include <QMutex>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QTimer>
+
+#include "FileInfo.h"	// FileSize
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class DirInfo;
+
+
+    /**
+     * The disk space of a file or a subtree by how it is shared.
+     **/
+    struct ExtentCounts
+    {
+	ExtentCounts():
+	    exclusive( 0 ),
+	    shared( 0 )
+	    {}
+
+	FileSize exclusive;	// Used only by this file
+	FileSize shared;	// Shared with other files, e.g. reflinks or snapshots
+    };
+
+
+    /**
+     * One file for the worker threads of ExtentStats.
+     **/
+    struct ExtentJob
+    {
+	FileInfo *   file;
+	QString	     path;
+	ExtentCounts counts;
+    };
+
+
+    /**
+     * Accounting of the disk space of a subtree by the extents of its
+     * files: On filesystems like Btrfs and XFS, files can share their data
+     * with other files (reflinked copies, deduplicated files, snapshots),
+     * so the allocated size of a file is not what deleting it would gain.
+     *
+     * This asks the kernel for the extents of each file with the FIEMAP
+     * ioctl, and it sums up the ones that are marked as shared and the
+     * ones that are not. This is the same that "btrfs filesystem du" does.
+     * Where FIEMAP is not supported, all of the allocated size of a file
+     * is exclusive.
+     *
+     * Notice that an extent that is shared between two files of the same
+     * subtree is shared for that subtree as well: The kernel doesn't tell
+     * with which other files it is shared.
+     *
+     * This is an optional pass over the files of a subtree after reading
+     * it; the ioctls are done by the worker threads of a thread pool, so
+     * the GUI stays responsive. Changing the tree aborts it or drops the
+     * result.
+     *
+     * Use DirTree::extentStats() to get the ExtentStats of a tree.
+     **/
+    class ExtentStats: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor. This is a child of 'tree'.
+	 **/
+	ExtentStats( DirTree * tree );
+
+	/**
+	 * Destructor. This stops the worker threads.
+	 **/
+	virtual ~ExtentStats();
+
+	/**
+	 * Start the accounting for 'subtree'. This replaces any previous
+	 * result. The result comes with the finished() signal.
+	 **/
+	void start( FileInfo * subtree );
+
+	/**
+	 * Stop the accounting. This waits for the worker threads.
+	 **/
+	void abort();
+
+	/**
+	 * Return 'true' if the accounting is running.
+	 **/
+	bool isBusy() const { return _jobCount > 0; }
+
+	/**
+	 * Return 'true' if there is a result for 'item'.
+	 **/
+	bool contains( FileInfo * item ) const { return _counts.contains( item ); }
+
+	/**
+	 * Return 'true' if there is no result at all.
+	 **/
+	bool isEmpty() const { return _counts.isEmpty(); }
+
+	/**
+	 * Return the exclusive disk space of 'item' and of its subtree or 0
+	 * if there is no result for it.
+	 **/
+	FileSize exclusiveSize( FileInfo * item ) const
+	    { return _counts.value( item ).exclusive; }
+
+	/**
+	 * Return the shared disk space of 'item' and of its subtree or 0 if
+	 * there is no result for it.
+	 **/
+	FileSize sharedSize( FileInfo * item ) const
+	    { return _counts.value( item ).shared; }
+
+	/**
+	 * Count the exclusive and shared bytes of file 'path' with FIEMAP.
+	 * 'allocatedSize' is used if FIEMAP is not supported, and to limit
+	 * the result for compressed extents. Return 'false' if FIEMAP did not
+	 * work.
+	 **/
+	static bool countExtents( const QString & path,
+				  FileSize	  allocatedSize,
+				  ExtentCounts	& counts );
+
+	/**
+	 * Count the extents of the next file. Return 'false' if there is
+	 * nothing left to do.
+	 *
+	 * This is called in the worker threads.
+	 **/
+	bool countNext();
+
+
+    signals:
+
+	/**
+	 * Emitted from time to time while the accounting is running.
+	 **/
+	void progress( int done, int total );
+
+	/**
+	 * Emitted when the accounting is finished.
+	 **/
+	void finished();
+
+	/**
+	 * Emitted when the result is dropped because the tree changed.
+	 **/
+	void cleared();
+
+
+    public slots:
+
+	/**
+	 * Abort the accounting and drop the result.
+	 **/
+	void clear();
+
+
+    protected slots:
+
+	/**
+	 * Check if the worker threads are done.
+	 **/
+	void checkWorkers();
+
+	/**
+	 * Drop everything when a child is deleted: The totals of all its
+	 * ancestors would be wrong.
+	 **/
+	void deletingChild( FileInfo * child );
+
+	/**
+	 * Drop everything when a subtree is cleared, e.g. for refreshing it.
+	 **/
+	void clearingSubtree( DirInfo * subtree );
+
+
+    protected:
+
+	/**
+	 * Collect the files of 'subtree' with URL 'url' as jobs.
+	 **/
+	void collect( FileInfo * subtree, const QString & url );
+
+	/**
+	 * Sum up the results of the jobs for the files and their ancestors.
+	 **/
+	void addResults();
+
+	/**
+	 * Stop the worker threads and wait for them.
+	 **/
+	void stopWorkers();
+
+
+	// Data members
+
+	DirTree *			_tree;
+	FileInfo *			_subtree;
+	QVector<ExtentJob>		_jobs;
+	ExtentJob *			_jobData;	// _jobs.data() for the workers
+	int				_jobCount;
+	int				_next;
+	int				_done;
+	bool				_abort;
+	QMutex				_mutex;		// For the above
+	QThreadPool			_threadPool;
+	QTimer				_timer;
+	QHash<FileInfo *, ExtentCounts> _counts;
+
+    };	// class ExtentStats
+
+
+
+    /**
+     * Worker thread for ExtentStats.
+     **/
+    class ExtentWorker: public QRunnable
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	ExtentWorker( ExtentStats * stats ):
+	    QRunnable(),
+	    _stats( stats )
+	    { setAutoDelete( true ); }
+
+	/**
+	 * Do the work. This is called in a worker thread.
+	 *
+	 * Reimplemented from QRunnable.
+	 **/
+	virtual void run() Q_DECL_OVERRIDE;
+
+    protected:
+
+	ExtentStats * _stats;
+
+    };	// class ExtentWorker
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef ExtentStats_h
@@ -0,0 +1,160 @@
+/*
+ *   File name: FileAgeStats.cpp
+ *   Summary:	Statistics classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include "FileAgeStats.h"
+#include "FileInfoIterator.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+FileAgeStats::FileAgeStats( time_t now ):
+    _now( now ? now : time( 0 ) )
+{
+    clear();
+}
+
+
+void FileAgeStats::clear()
+{
+    _sketch.clear();
+    _totalSize = 0LL;
+    _oldest    = 0;
+    _newest    = 0;
+}
+
+
+void FileAgeStats::collect( FileInfo * subtree )
+{
+    if ( subtree->isFile() )
+	add( subtree );
+
+    FileInfoIterator it( subtree );
+
+    while ( *it )
+    {
+	FileInfo * item = *it;
+
+	if ( item->hasChildren() )
+	    collect( item );
+	else if ( item->isFile() )
+	    add( item );
+
+	// Disregard symlinks, block devices and other special files
+
+	++it;
+    }
+}
+
+
+void FileAgeStats::collect( FileInfo * subtree, const QString & suffix )
+{
+    if ( subtree->isFile() && subtree->name().toLower().endsWith( suffix ) )
+	add( subtree );
+
+    FileInfoIterator it( subtree );
+
+    while ( *it )
+    {
+	FileInfo * item = *it;
+
+	if ( item->hasChildren() )
+	    collect( item, suffix );
+	else if ( item->isFile() && item->name().toLower().endsWith( suffix ) )
+	    add( item );
+
+	++it;
+    }
+}
+
+
+void FileAgeStats::add( FileInfo * file )
+{
+    time_t mtime = file->mtime();
+
+    // Files from the future (clock skew, extracted archives) are brand new
+
+    qint64 age = qMax( (qint64) 0, (qint64) ( _now - mtime ) );
+
+    if ( _sketch.count() == 0 || mtime < _oldest )
+	_oldest = mtime;
+
+    if ( _sketch.count() == 0 || mtime > _newest )
+	_newest = mtime;
+
+    _sketch.add( age, file->size() );
+    _totalSize += file->size();
+}
+
+
+void FileAgeStats::merge( const FileAgeStats & other )
+{
+    if ( other._now != _now )
+	THROW( Exception( "Can't merge file ages relative to different times" ) );
+
+    if ( other.fileCount() == 0 )
+	return;
+
+    if ( fileCount() == 0 || other._oldest < _oldest )
+	_oldest = other._oldest;
+
+    if ( fileCount() == 0 || other._newest > _newest )
+	_newest = other._newest;
+
+    _sketch.merge( other._sketch );
+    _totalSize += other._totalSize;
+}
+
+
+qint64 FileAgeStats::ageQuantile( int order, int number ) const
+{
+    if ( number > order )
+    {
+	QString msg = QString( "Cannot determine quantile #%1" ).arg( number );
+	msg += QString( " for %1-quantile - max is %2" ).arg( order ).arg( order );
+
+	THROW( Exception( msg ) );
+    }
+
+    return _sketch.quantile( (double) number / order );
+}
+
+
+void FileAgeStats::bucketTotals( const QList<qint64> & ageLimits,
+				 QList<int>	     & counts,
+				 QList<FileSize>     & sizes ) const
+{
+    counts.clear();
+    sizes.clear();
+
+    for ( int i=0; i <= ageLimits.size(); ++i )
+    {
+	counts << 0;
+	sizes  << 0LL;
+    }
+
+    // The bins are in ascending order of the ages, and so are the limits
+
+    int bucket = 0;
+
+    for ( int bin=0; bin < _sketch.binCount(); ++bin )
+    {
+	if ( _sketch.binItems( bin ) == 0 )
+	    continue;
+
+	qint64 age = _sketch.binValue( bin );
+
+	while ( bucket < ageLimits.size() && age >= ageLimits.at( bucket ) )
+	    ++bucket;
+
+	counts[ bucket ] += _sketch.binItems( bin );
+	sizes [ bucket ] += _sketch.binSum( bin );
+    }
+}
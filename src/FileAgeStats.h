@@ -0,0 +1,139 @@
+/*
+ *   File name: FileAgeStats.h
+ *   Summary:	Statistics classes for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef FileAgeStats_h
+#define FileAgeStats_h
+
+
+#include <time.h>
+
+#include <QList>
+
+#include "FileInfo.h"
+#include "FileSizeSketch.h"
+
+
+namespace QDirStat
+{
+    /**
+     * Helper class for file age statistics: the age (the time since the
+     * last modification) of the files in a subtree, e.g. for planning how
+     * long to keep files.
+     *
+     * The ages are added to a FileSizeSketch in seconds with the file
+     * size as the weight, so there is no need to keep (or sort) any data
+     * for each file: Any age quantile is accurate to 1% of that age, and so
+     * are the age limits of bucketTotals().
+     *
+     * Just like FileSizeStats, this can be collected in the background
+     * with a FileSizeStatsCollector.
+     **/
+    class FileAgeStats
+    {
+    public:
+
+	/**
+	 * Constructor. All ages are relative to 'now'; 0 means the current
+	 * time.
+	 **/
+	FileAgeStats( time_t now = 0 );
+
+	/**
+	 * Clear the collected data. This does not change now().
+	 **/
+	void clear();
+
+	/**
+	 * Return the time that the ages are relative to.
+	 **/
+	time_t now() const { return _now; }
+
+	/**
+	 * Recurse through all file elements in the subtree and add the age
+	 * of each file.
+	 *
+	 * This only reads the FileInfo items of the subtree, so it can be
+	 * used in a worker thread as long as the tree does not change
+	 * meanwhile.
+	 **/
+	void collect( FileInfo * subtree );
+
+	/**
+	 * Like collect( subtree ), but only for files with 'suffix'.
+	 **/
+	void collect( FileInfo * subtree, const QString & suffix );
+
+	/**
+	 * Add the age of one file.
+	 **/
+	void add( FileInfo * file );
+
+	/**
+	 * Add all data collected by 'other'.
+	 **/
+	void merge( const FileAgeStats & other );
+
+	/**
+	 * Return the number of files.
+	 **/
+	int fileCount() const { return _sketch.count(); }
+
+	/**
+	 * Return the total size of the files.
+	 **/
+	FileSize totalSize() const { return _totalSize; }
+
+	/**
+	 * Return the modification time of the oldest file or 0 if there is
+	 * none.
+	 **/
+	time_t oldest() const { return _oldest; }
+
+	/**
+	 * Return the modification time of the newest file or 0 if there is
+	 * none.
+	 **/
+	time_t newest() const { return _newest; }
+
+	/**
+	 * Return quantile no. 'number' of 'order' of the file ages in
+	 * seconds: ageQuantile( 2, 1 ) is the median age.
+	 **/
+	qint64 ageQuantile( int order, int number ) const;
+
+	/**
+	 * Sum up the files for age buckets: Bucket no. i has the files with
+	 * an age below ageLimits[i] (in seconds, ascending), but not below
+	 * the previous limit. There is one more bucket for all files with
+	 * larger ages. The number of files of each bucket is returned in
+	 * 'counts', their total size in 'sizes'.
+	 **/
+	void bucketTotals( const QList<qint64> & ageLimits,
+			   QList<int>	       & counts,
+			   QList<FileSize>     & sizes ) const;
+
+	/**
+	 * Return the sketch of the ages.
+	 **/
+	const FileSizeSketch & sketch() const { return _sketch; }
+
+    protected:
+
+	time_t		_now;
+	FileSizeSketch	_sketch;
+	FileSize	_totalSize;
+	time_t		_oldest;
+	time_t		_newest;
+
+    };	// class FileAgeStats
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef FileAgeStats_h
@@ -0,0 +1,283 @@
+/*
+ *   File name: FileAgeStatsWindow.cpp
+ *   Summary:	QDirStat file age statistics window
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QTreeWidgetItem>
+
+#include "FileAgeStatsWindow.h"
+#include "FileAgeStats.h"
+#include "FileSizeStats.h"	// FileSizeStatsCollector
+#include "DirTree.h"
+#include "SettingsHelpers.h"
+#include "HeaderTweaker.h"
+#include "Logger.h"
+#include "Exception.h"
+
+#define SECONDS_PER_DAY		( 24LL * 3600 )
+#define SECONDS_PER_YEAR	( 365LL * SECONDS_PER_DAY )
+
+using namespace QDirStat;
+
+
+/**
+ * Age groups for the buckets table: The upper limit of each group in
+ * seconds and its name. There is one more group for anything older.
+ **/
+static const struct
+{
+    qint64	 limit;
+    const char * name;
+}
+ageGroups[] =
+{
+    { SECONDS_PER_DAY,       QT_TRANSLATE_NOOP( "QDirStat::FileAgeStatsWindow", "Last day"       ) },
+    { 7 * SECONDS_PER_DAY,   QT_TRANSLATE_NOOP( "QDirStat::FileAgeStatsWindow", "Last week"      ) },
+    { 30 * SECONDS_PER_DAY,  QT_TRANSLATE_NOOP( "QDirStat::FileAgeStatsWindow", "Last month"     ) },
+    { 91 * SECONDS_PER_DAY,  QT_TRANSLATE_NOOP( "QDirStat::FileAgeStatsWindow", "Last 3 months"  ) },
+    { 182 * SECONDS_PER_DAY, QT_TRANSLATE_NOOP( "QDirStat::FileAgeStatsWindow", "Last 6 months"  ) },
+    { SECONDS_PER_YEAR,      QT_TRANSLATE_NOOP( "QDirStat::FileAgeStatsWindow", "Last year"      ) },
+    { 2 * SECONDS_PER_YEAR,  QT_TRANSLATE_NOOP( "QDirStat::FileAgeStatsWindow", "1 - 2 years"    ) },
+    { 3 * SECONDS_PER_YEAR,  QT_TRANSLATE_NOOP( "QDirStat::FileAgeStatsWindow", "2 - 3 years"    ) },
+    { 5 * SECONDS_PER_YEAR,  QT_TRANSLATE_NOOP( "QDirStat::FileAgeStatsWindow", "3 - 5 years"    ) },
+    { 10 * SECONDS_PER_YEAR, QT_TRANSLATE_NOOP( "QDirStat::FileAgeStatsWindow", "5 - 10 years"   ) }
+};
+
+static const int ageGroupCount = sizeof( ageGroups ) / sizeof( ageGroups[0] );
+
+
+enum AgeBucketsColumns
+{
+    AB_AgeCol = 0,
+    AB_FilesCol,
+    AB_SizeCol,
+    AB_PercentCol,
+    AB_ColumnCount
+};
+
+
+enum AgePercentilesColumns
+{
+    AP_PercentileCol = 0,
+    AP_AgeCol,
+    AP_TimeCol,
+    AP_ColumnCount
+};
+
+
+/**
+ * Return a human readable age for 'seconds'.
+ **/
+static QString formatAge( qint64 seconds )
+{
+    if ( seconds < 2 * 3600 )
+	return FileAgeStatsWindow::tr( "%1 min" ).arg( seconds / 60 );
+
+    if ( seconds < 2 * SECONDS_PER_DAY )
+	return FileAgeStatsWindow::tr( "%1 h" ).arg( seconds / 3600 );
+
+    if ( seconds < SECONDS_PER_YEAR )
+	return FileAgeStatsWindow::tr( "%1 days" ).arg( seconds / SECONDS_PER_DAY );
+
+    return FileAgeStatsWindow::tr( "%1 years" ).arg( (double) seconds / SECONDS_PER_YEAR, 0, 'f', 1 );
+}
+
+
+
+FileAgeStatsWindow::FileAgeStatsWindow( QWidget * parent ):
+    QDialog( parent ),
+    _ui( new Ui::FileAgeStatsWindow ),
+    _stats( 0 )
+{
+    // logDebug() << "init" << endl;
+
+    CHECK_NEW( _ui );
+    _ui->setupUi( this );
+    initWidgets();
+    readWindowSettings( this, "FileAgeStatsWindow" );
+
+    _collector = new FileSizeStatsCollector( this );
+    CHECK_NEW( _collector );
+
+    connect( _collector,	 SIGNAL( finished()	),
+	     this,		 SLOT  ( calcFinished() ) );
+
+    connect( _collector,	 SIGNAL( canceled()	),
+	     this,		 SLOT  ( calcCanceled() ) );
+
+    connect( _ui->refreshButton, SIGNAL( clicked() ),
+	     this,		 SLOT  ( refresh() ) );
+}
+
+
+FileAgeStatsWindow::~FileAgeStatsWindow()
+{
+    // logDebug() << "destroying" << endl;
+
+    _collector->cancel();
+    writeWindowSettings( this, "FileAgeStatsWindow" );
+
+    // The collector's worker threads don't use _stats; they have their own
+
+    delete _stats;
+}
+
+
+void FileAgeStatsWindow::initWidgets()
+{
+    QFont font = _ui->heading->font();
+    font.setBold( true );
+    _ui->heading->setFont( font );
+
+    _ui->bucketsTree->setColumnCount( AB_ColumnCount );
+    _ui->bucketsTree->setHeaderLabels( QStringList()
+				       << tr( "Modified" )
+				       << tr( "Files" )
+				       << tr( "Size" )
+				       << tr( "% of Size" ) );
+
+    _ui->percentilesTree->setColumnCount( AP_ColumnCount );
+    _ui->percentilesTree->setHeaderLabels( QStringList()
+					   << tr( "Percentile" )
+					   << tr( "Age" )
+					   << tr( "Modified" ) );
+}
+
+
+void FileAgeStatsWindow::reject()
+{
+    deleteLater();
+}
+
+
+void FileAgeStatsWindow::refresh()
+{
+    populate( _subtree() );
+}
+
+
+void FileAgeStatsWindow::populate( FileInfo * subtree )
+{
+    _collector->cancel();
+    _subtree = subtree;
+
+    _ui->bucketsTree->clear();
+    _ui->percentilesTree->clear();
+
+    if ( ! subtree )
+    {
+	logWarning() << "No tree" << endl;
+	return;
+    }
+
+    _ui->heading->setText( tr( "File Age Statistics for %1" ).arg( _subtree.url() ) );
+    _ui->summary->setText( tr( "Calculating..." ) );
+    _ui->tabWidget->setEnabled( false );
+
+    const PrecomputedStats * precomputed = subtree->tree()->precomputedStats( subtree );
+    delete _stats;
+
+    if ( precomputed )
+    {
+	// Collected while reading: The ages are relative to that time
+
+	_stats = new FileAgeStats( precomputed->ageStats() );
+	CHECK_NEW( _stats );
+	calcFinished();
+	return;
+    }
+
+    // All ages relative to right now
+
+    _stats = new FileAgeStats();
+    CHECK_NEW( _stats );
+
+    _collector->start( subtree, QString(), 0, _stats );
+}
+
+
+void FileAgeStatsWindow::calcFinished()
+{
+    if ( _stats->fileCount() == 0 )
+    {
+	_ui->summary->setText( tr( "No files" ) );
+	return;
+    }
+
+    _ui->summary->setText( tr( "%1 files with %2 total, modified between %3 and %4; median age: %5" )
+			   .arg( _stats->fileCount() )
+			   .arg( formatSize( _stats->totalSize() ) )
+			   .arg( formatTime( _stats->oldest() ) )
+			   .arg( formatTime( _stats->newest() ) )
+			   .arg( formatAge( _stats->ageQuantile( 2, 1 ) ) ) );
+
+    fillBuckets();
+    fillPercentiles();
+    _ui->tabWidget->setEnabled( true );
+}
+
+
+void FileAgeStatsWindow::calcCanceled()
+{
+    _ui->summary->setText( tr( "Canceled: The tree changed." ) );
+}
+
+
+void FileAgeStatsWindow::fillBuckets()
+{
+    QList<qint64>   limits;
+    QList<int>	    counts;
+    QList<FileSize> sizes;
+
+    for ( int i=0; i < ageGroupCount; ++i )
+	limits << ageGroups[ i ].limit;
+
+    _stats->bucketTotals( limits, counts, sizes );
+
+    for ( int i=0; i < counts.size(); ++i )
+    {
+	QString name = i < ageGroupCount ?
+	    tr( ageGroups[ i ].name ) : tr( "Older than %1 years" ).arg( limits.last() / SECONDS_PER_YEAR );
+
+	double percent = _stats->totalSize() > 0 ?
+	    100.0 * sizes.at( i ) / _stats->totalSize() : 0.0;
+
+	QTreeWidgetItem * item = new QTreeWidgetItem( _ui->bucketsTree );
+	CHECK_NEW( item );
+
+	item->setText( AB_AgeCol,     name );
+	item->setText( AB_FilesCol,   QString::number( counts.at( i ) ) );
+	item->setText( AB_SizeCol,    formatSize( sizes.at( i ) ) );
+	item->setText( AB_PercentCol, QString( "%1%" ).arg( percent, 0, 'f', 1 ) );
+
+	for ( int col = AB_FilesCol; col < AB_ColumnCount; ++col )
+	    item->setTextAlignment( col, Qt::AlignRight );
+    }
+
+    HeaderTweaker::resizeToContents( _ui->bucketsTree->header() );
+}
+
+
+void FileAgeStatsWindow::fillPercentiles()
+{
+    for ( int i=0; i <= 100; i += 5 )
+    {
+	qint64 age = _stats->ageQuantile( 100, i );
+
+	QTreeWidgetItem * item = new QTreeWidgetItem( _ui->percentilesTree );
+	CHECK_NEW( item );
+
+	item->setText( AP_PercentileCol, QString( "P%1" ).arg( i ) );
+	item->setText( AP_AgeCol,	 formatAge( age ) );
+	item->setText( AP_TimeCol,	 formatTime( _stats->now() - age ) );
+
+	item->setTextAlignment( AP_PercentileCol, Qt::AlignRight );
+	item->setTextAlignment( AP_AgeCol,	  Qt::AlignRight );
+    }
+
+    HeaderTweaker::resizeToContents( _ui->percentilesTree->header() );
+}
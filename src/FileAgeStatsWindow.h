@@ -0,0 +1,128 @@
+/*
+ *   File name: FileAgeStatsWindow.h
+ *   Summary:	QDirStat file age statistics window
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef FileAgeStatsWindow_h
+#define FileAgeStatsWindow_h
+
+
+#include <QDialog>
+
+#include "ui_file-age-stats-window.h"
+#include "FileInfo.h"
+#include "Subtree.h"
+
+
+namespace QDirStat
+{
+    class FileAgeStats;
+    class FileSizeStatsCollector;
+
+
+    /**
+     * Modeless dialog to display file age statistics for a subtree: how
+     * many files and how much disk space is in each age group, and the age
+     * percentiles.
+     *
+     * The ages are collected in the background, so this window opens
+     * right away and is filled when they are all there.
+     **/
+    class FileAgeStatsWindow: public QDialog
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor.
+	 *
+	 * Notice that this widget will destroy itself upon window close.
+	 *
+	 * It is advised to use a QPointer for storing a pointer to an instance
+	 * of this class. The QPointer will keep track of this window
+	 * auto-deleting itself when closed.
+	 **/
+	FileAgeStatsWindow( QWidget * parent );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~FileAgeStatsWindow();
+
+	/**
+	 * Return the corresponding subtree.
+	 **/
+	const Subtree & subtree() const { return _subtree; }
+
+    public slots:
+
+	/**
+	 * Populate with new content. This only starts collecting the file
+	 * ages; the widgets are filled when that is finished.
+	 **/
+	void populate( FileInfo * subtree );
+
+	/**
+	 * Refresh (reload) all data.
+	 **/
+	void refresh();
+
+	/**
+	 * Reject the dialog contents, i.e. the user clicked the "Cancel"
+	 * or WM_CLOSE button.
+	 *
+	 * Reimplemented from QDialog.
+	 **/
+	virtual void reject() Q_DECL_OVERRIDE;
+
+    protected slots:
+
+	/**
+	 * Fill all widgets with the collected file ages. This is connected
+	 * to the finished() signal of the collector.
+	 **/
+	void calcFinished();
+
+	/**
+	 * Notify the user that the tree changed while collecting the file
+	 * ages. This is connected to the canceled() signal of the collector.
+	 **/
+	void calcCanceled();
+
+    protected:
+
+	/**
+	 * One-time initialization of the widgets in this window.
+	 **/
+	void initWidgets();
+
+	/**
+	 * Fill the age groups table.
+	 **/
+	void fillBuckets();
+
+	/**
+	 * Fill the percentiles table.
+	 **/
+	void fillPercentiles();
+
+
+	//
+	// Data members
+	//
+
+	Ui::FileAgeStatsWindow *	_ui;
+	Subtree				_subtree;
+	FileAgeStats *			_stats;
+	FileSizeStatsCollector *	_collector;
+    };
+
+} // namespace QDirStat
+
+
+#endif // FileAgeStatsWindow_h
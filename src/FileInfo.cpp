@@ -12,6 +12,11 @@
 #include <unistd.h>
 
 #include <QDateTime>
+#include <QVector>
+#include <QVarLengthArray>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QHash>
 
 #include "FileInfo.h"
 #include "DirInfo.h"
@@ -38,14 +43,19 @@ FileInfo::FileInfo( DirTree    * tree,
 {
     _isLocalFile  = true;
     _isSparseFile = false;
+    _isPrimaryLink   = false;
+    _isDuplicateLink = false;
     _name	  = name ? name : "";
-    _device	  = 0;
+    _deviceIndex  = 0;
+    _ownerIndex	  = 0;
     _mode	  = 0;
     _links	  = 0;
+    _treeLevel	  = parent ? parent->treeLevel() + 1 : 0;
     _size	  = 0;
     _blocks	  = 0;
     _mtime	  = 0;
     _magic	  = FileInfoMagic;
+    _mimeCategoryCache = 0;
 }
 
 
@@ -60,13 +70,18 @@ FileInfo::FileInfo( const QString & filenameWithoutPath,
     CHECK_PTR( statInfo );
 
     _isLocalFile = true;
+    _isPrimaryLink   = false;
+    _isDuplicateLink = false;
     _name	 = filenameWithoutPath;
 
-    _device	 = statInfo->st_dev;
+    _deviceIndex = deviceIndex( statInfo->st_dev );
+    _ownerIndex	 = ownerIndex( statInfo->st_uid, statInfo->st_gid );
     _mode	 = statInfo->st_mode;
-    _links	 = statInfo->st_nlink;
+    _links	 = statInfo->st_nlink > UINT_MAX ? UINT_MAX : statInfo->st_nlink;
+    _treeLevel	 = parent ? parent->treeLevel() + 1 : 0;
     _mtime	 = statInfo->st_mtime;
     _magic	 = FileInfoMagic;
+    _mimeCategoryCache = 0;
 
     if ( isSpecial() )
     {
@@ -116,12 +131,17 @@ FileInfo::FileInfo( DirTree *	    tree,
 {
     _name	 = filenameWithoutPath;
     _isLocalFile = true;
-    _device      = 0;
+    _isPrimaryLink   = false;
+    _isDuplicateLink = false;
+    _deviceIndex = 0;
+    _ownerIndex	 = 0;
     _mode	 = mode;
     _size	 = size;
     _mtime	 = mtime;
-    _links	 = links;
+    _links	 = links > UINT_MAX ? UINT_MAX : links;
+    _treeLevel	 = parent ? parent->treeLevel() + 1 : 0;
     _magic	 = FileInfoMagic;
+    _mimeCategoryCache = 0;
 
     if ( blocks < 0 )
     {
@@ -172,31 +192,205 @@ FileSize FileInfo::allocatedSize() const
 
 FileSize FileInfo::size() const
 {
+    if ( _isDuplicateLink )
+	return 0LL;
+
     FileSize sz = _isSparseFile ? allocatedSize() : _size;
 
-    if ( _links > 1 && ! isDir() )
+    if ( _links > 1 && ! isDir() && ! _isPrimaryLink )
 	sz /= _links;
 
     return sz;
 }
 
 
+static QMutex	       deviceTableMutex;
+static QVector<dev_t>  deviceTable( 1, 0 );	// Index 0: Unknown device
+
+
+unsigned short FileInfo::deviceIndex( dev_t device )
+{
+    static unsigned short lastIndex = 0;
+
+    QMutexLocker locker( &deviceTableMutex );
+
+    if ( deviceTable.at( lastIndex ) == device )
+	return lastIndex;
+
+    int index = deviceTable.indexOf( device );
+
+    if ( index < 0 )
+    {
+	if ( deviceTable.size() > USHRT_MAX )
+	{
+	    logError() << "Too many devices; using device 0 for " << device << endl;
+	    return 0;
+	}
+
+	index = deviceTable.size();
+	deviceTable.append( device );
+    }
+
+    lastIndex = index;
+
+    return index;
+}
+
+
+dev_t FileInfo::deviceByIndex( unsigned short index )
+{
+    QMutexLocker locker( &deviceTableMutex );
+
+    return index < deviceTable.size() ? deviceTable.at( index ) : 0;
+}
+
+
+// Owners are (uid << 32 | gid); 0 is a valid owner (root:root), so the
+// unknown owner at index 0 is never looked up.
+
+static QMutex			      ownerTableMutex;
+static QVector<quint64>		      ownerTable( 1, ~0ULL );
+static QHash<quint64, unsigned short> ownerHash;
+
+
+unsigned short FileInfo::ownerIndex( uid_t uid, gid_t gid )
+{
+    static unsigned short lastIndex = 0;
+
+    quint64 owner = ( (quint64) uid << 32 ) | (quint32) gid;
+
+    QMutexLocker locker( &ownerTableMutex );
+
+    // Most files in a directory have the same owner as the one before
+
+    if ( ownerTable.at( lastIndex ) == owner )
+	return lastIndex;
+
+    QHash<quint64, unsigned short>::const_iterator it = ownerHash.constFind( owner );
+
+    if ( it != ownerHash.constEnd() )
+    {
+	lastIndex = it.value();
+	return lastIndex;
+    }
+
+    if ( ownerTable.size() > USHRT_MAX )
+    {
+	logError() << "Too many owners; using owner 0 for " << uid << ":" << gid << endl;
+	return 0;
+    }
+
+    lastIndex = ownerTable.size();
+    ownerTable.append( owner );
+    ownerHash.insert( owner, lastIndex );
+
+    return lastIndex;
+}
+
+
+bool FileInfo::ownerByIndex( unsigned short index, uid_t & uid, gid_t & gid )
+{
+    QMutexLocker locker( &ownerTableMutex );
+
+    if ( index == 0 || index >= ownerTable.size() )
+    {
+	uid = (uid_t) -1;
+	gid = (gid_t) -1;
+
+	return false;
+    }
+
+    quint64 owner = ownerTable.at( index );
+    uid = (uid_t) ( owner >> 32 );
+    gid = (gid_t) ( owner & 0xFFFFFFFF );
+
+    return true;
+}
+
+
+int FileInfo::ownerCount()
+{
+    QMutexLocker locker( &ownerTableMutex );
+
+    return ownerTable.size();
+}
+
+
+uid_t FileInfo::uid() const
+{
+    uid_t uid;
+    gid_t gid;
+    ownerByIndex( _ownerIndex, uid, gid );
+
+    return uid;
+}
+
+
+gid_t FileInfo::gid() const
+{
+    uid_t uid;
+    gid_t gid;
+    ownerByIndex( _ownerIndex, uid, gid );
+
+    return gid;
+}
+
+
 QString FileInfo::url() const
 {
-    if ( _parent )
+    // Collect the ancestors first and append their UTF-8 names to one
+    // buffer from the top down: Concatenating the URL of the parent with
+    // the name on each level creates a new string for each level.
+
+    QVarLengthArray<const FileInfo *, 64> path;
+    int len = 0;
+
+    for ( const FileInfo * item = this; item; item = item->parent() )
     {
-	QString parentUrl = _parent->url();
+	int nameLen;
+	item->_name.utf8( &nameLen );
+
+	path.append( item );
+	len += nameLen + 1;
+    }
 
-	if ( isDotEntry() )	// don't append "/." for dot entries
-	    return parentUrl;
+    QByteArray url;
+    url.reserve( len );
 
-	if ( ! parentUrl.endsWith( "/" ) && ! _name.startsWith( "/" ) )
-	    parentUrl += "/";
+    for ( int i = path.size() - 1; i >= 0; --i )
+    {
+	const FileInfo * item = path[ i ];
+
+	if ( item->isDotEntry() && item->_parent )	// don't append "/." for dot entries
+	    continue;
+
+	int	     nameLen;
+	const char * name = item->_name.utf8( &nameLen );
+
+	if ( item->_parent &&
+	     ! url.endsWith( '/' ) && ! ( nameLen > 0 && name[0] == '/' ) )
+	{
+	    url += '/';
+	}
 
-	return parentUrl + _name;
+	url.append( name, nameLen );
     }
-    else
-	return _name;
+
+    return QString::fromUtf8( url );
+}
+
+
+QString FileInfo::childUrl( const QString & parentUrl, const FileInfo * child )
+{
+    if ( child->isDotEntry() )	// don't append "/." for dot entries
+	return parentUrl;
+
+    QString name = child->name();
+
+    if ( ! parentUrl.endsWith( "/" ) && ! name.startsWith( "/" ) )
+	return parentUrl + "/" + name;
+
+    return parentUrl + name;
 }
 
 
@@ -212,18 +406,15 @@ QString FileInfo::debugUrl() const
 }
 
 
-int FileInfo::treeLevel() const
+void FileInfo::setParent( DirInfo * newParent )
 {
-    int		level	= 0;
-    FileInfo *	parent	= _parent;
+    _parent = newParent;
 
-    while ( parent )
-    {
-	level++;
-	parent = parent->parent();
-    }
+    // A subtree that is only detached for deleting it keeps its level, so
+    // the levels in it are still consistent for isInSubtree().
 
-    return level;
+    if ( newParent )
+	_treeLevel = newParent->treeLevel() + 1;
 }
 
 
@@ -235,29 +426,36 @@ bool FileInfo::hasChildren() const
 
 bool FileInfo::isInSubtree( const FileInfo *subtree ) const
 {
-    const FileInfo * ancestor = this;
+    if ( ! subtree )
+	return false;
 
-    while ( ancestor )
-    {
-	if ( ancestor == subtree )
-	    return true;
+    // Only an ancestor exactly that many levels up can be 'subtree'
 
+    int levels = _treeLevel - subtree->treeLevel();
+
+    if ( levels < 0 )
+	return false;
+
+    const FileInfo * ancestor = this;
+
+    while ( levels-- > 0 && ancestor )
 	ancestor = ancestor->parent();
-    }
 
-    return false;
+    return ancestor == subtree;
 }
 
 
 FileInfo * FileInfo::locate( QString url, bool findDotEntries )
 {
-    if ( ! url.startsWith( _name ) && this != _tree->root() )
+    QString name = _name.toString();
+
+    if ( ! url.startsWith( name ) && this != _tree->root() )
 	return 0;
     else					// URL starts with this node's name
     {
 	if ( this != _tree->root() )		// The root item is invisible
 	{
-	    url.remove( 0, _name.length() );	// Remove leading name of this node
+	    url.remove( 0, name.length() );	// Remove leading name of this node
 
 	    if ( url.length() == 0 )		// Nothing left?
 		return this;			// Hey! That's us!
@@ -266,7 +464,7 @@ FileInfo * FileInfo::locate( QString url, bool findDotEntries )
 		url.remove( 0, 1 );		// remove that leading delimiter.
 	    else				// No path delimiter at the beginning
 	    {
-		if ( _name.right(1) != "/" &&	// and this is not the root directory
+		if ( name.right(1) != "/" &&	// and this is not the root directory
 		     ! isDotEntry() )		// or a dot entry:
 		    return 0;			// This can't be any of our children.
 	    }
@@ -275,16 +473,34 @@ FileInfo * FileInfo::locate( QString url, bool findDotEntries )
 
 	// Search all children
 
-	FileInfo *child = firstChild();
+	if ( isDirInfo() && ! isDotEntry() && this != _tree->root() )
+	{
+	    // Below the toplevel, child names never contain a path
+	    // delimiter, so the next path component can be looked up
+	    // directly rather than searching all children.
 
-	while ( child )
+	    int	       delimiterPos = url.indexOf( '/' );
+	    QString    childName    = delimiterPos < 0 ? url : url.left( delimiterPos );
+	    toDirInfo()->thaw();	// If the children were compacted
+
+	    FileInfo * child	    = toDirInfo()->findChild( childName );
+
+	    if ( child )
+		return child->locate( url, findDotEntries );
+	}
+	else
 	{
-	    FileInfo *foundChild = child->locate( url, findDotEntries );
+	    FileInfo *child = firstChild();
 
-	    if ( foundChild )
-		return foundChild;
-	    else
-		child = child->next();
+	    while ( child )
+	    {
+		FileInfo *foundChild = child->locate( url, findDotEntries );
+
+		if ( foundChild )
+		    return foundChild;
+		else
+		    child = child->next();
+	    }
 	}
 
 
@@ -296,14 +512,12 @@ FileInfo * FileInfo::locate( QString url, bool findDotEntries )
 	// Search the dot entry if there is one - but only if there is no more
 	// path delimiter left in the URL. The dot entry contains files only,
 	// and their names may not contain the path delimiter, nor can they
-	// have children. This check is not strictly necessary, but it may
-	// speed up things a bit if we don't search the non-directory children
-	// if the rest of the URL consists of several pathname components.
+	// have children.
 
 	if ( dotEntry() &&
 	     ! url.contains( "/" ) )	   // No (more) "/" in this URL
 	{
-	    return dotEntry()->locate( url, findDotEntries );
+	    return dotEntry()->findChild( url );
 	}
     }
 
@@ -19,6 +19,8 @@
 #include <QList>
 
 #include "Logger.h"
+#include "NodePool.h"
+#include "CompactName.h"
 
 
 namespace QDirStat
@@ -68,6 +70,8 @@ namespace QDirStat
      **/
     class FileInfo
     {
+	friend class ColdSubtree;
+
     public:
 	/**
 	 * Default constructor.
@@ -107,6 +111,20 @@ namespace QDirStat
 	 **/
 	virtual ~FileInfo();
 
+	/**
+	 * Allocate nodes from the NodePool rather than from the general
+	 * heap. This is inherited by DirInfo and all other derived classes.
+	 **/
+	static void * operator new( size_t size )
+	    { return NodePool::allocate( size ); }
+
+	/**
+	 * Return a node to the NodePool. Since the destructor is virtual,
+	 * 'size' is the size of the most derived class.
+	 **/
+	static void operator delete( void * node, size_t size )
+	    { NodePool::release( node, size ); }
+
 	/**
 	 * Check with the magic number if this object is valid.
 	 * Return 'true' if it is valid, 'false' if invalid.
@@ -132,16 +150,30 @@ namespace QDirStat
 	 * requested for "/usr/share/man". Notice, however, that the entry for
 	 * "/usr/share/man/man1" will only return "man1" in this example.
 	 **/
-	QString name() const { return _name; }
+	QString name() const { return _name.toString(); }
+
+	/**
+	 * Returns the name in its compact internal form. This is cheaper
+	 * than name() for comparisons since it does not create a QString.
+	 **/
+	const CompactName & compactName() const { return _name; }
 
 	/**
 	 * Returns the full URL of this object with full path.
 	 *
-	 * This is a (somewhat) expensive operation since it will recurse up
-	 * to the top of the tree.
+	 * This is a (somewhat) expensive operation since it has to go up to
+	 * the top of the tree, but it builds the URL in one buffer. When
+	 * going through a subtree, use FileInfoUrlIterator or childUrl()
+	 * instead which only append to the URL of the parent.
 	 **/
 	QString url() const;
 
+	/**
+	 * Returns the URL of 'child' if the URL of its parent is
+	 * 'parentUrl'. This is what url() does for each level of the tree.
+	 **/
+	static QString childUrl( const QString & parentUrl, const FileInfo * child );
+
 	/**
 	 * Very much like @ref FileInfo::url(), but with "/<Files>" appended
 	 * if this is a dot entry. Useful for debugging.
@@ -156,7 +188,24 @@ namespace QDirStat
 	 * Returns the major and minor device numbers of the device this file
 	 * resides on or 0 if this is a remote file.
 	 **/
-	dev_t device() const { return _device; }
+	dev_t device() const { return deviceByIndex( _deviceIndex ); }
+
+	/**
+	 * Return the owner's user ID or (uid_t) -1 if it is unknown, e.g.
+	 * for an item read from a cache file.
+	 **/
+	uid_t uid() const;
+
+	/**
+	 * Return the owner's group ID or (gid_t) -1 if it is unknown.
+	 **/
+	gid_t gid() const;
+
+	/**
+	 * Return the index of the owner in the process-wide owner table: 0
+	 * if it is unknown. See ownerIndex( uid_t, gid_t ).
+	 **/
+	unsigned short ownerIndex() const { return _ownerIndex; }
 
 	/**
 	 * The file permissions and object type as returned by lstat().
@@ -203,6 +252,10 @@ namespace QDirStat
 	 * the true allocated size for sparse files. For plain files with
 	 * multiple links this will be size/no_links, for sparse files it is
 	 * the number of bytes actually allocated.
+	 *
+	 * If the tree counts each inode only once (see
+	 * DirTree::countHardLinksOnce()), this is the complete size for the
+	 * first link to an inode that was found and 0 for all others.
 	 **/
 	FileSize size() const;
 
@@ -211,6 +264,13 @@ namespace QDirStat
 	 **/
 	FileSize blocks() const { return _blocks; }
 
+	/**
+	 * The blocks that count for the totals of the parent directories:
+	 * Those of blocks(), but none for all but the first link to an inode
+	 * if the tree counts each inode only once.
+	 **/
+	FileSize countedBlocks() const { return _isDuplicateLink ? 0 : _blocks; }
+
 	/**
 	 * The size of one single block that @ref blocks() returns.
 	 * Notice: This is _not_ the blocksize that lstat() returns!
@@ -232,7 +292,7 @@ namespace QDirStat
 	 * Returns the total size in blocks of this subtree.
 	 * Derived classes that have children should overwrite this.
 	 **/
-	virtual FileSize totalBlocks() { return _blocks; }
+	virtual FileSize totalBlocks() { return countedBlocks(); }
 
 	/**
 	 * Returns the total number of children in this subtree, excluding this
@@ -335,6 +395,18 @@ namespace QDirStat
 	 **/
 	DirTree * tree() const { return _tree; }
 
+	/**
+	 * Return the cached MimeCategory of this entry as stored by the
+	 * MimeCategorizer: 0 if not known yet. MimeCategorizer::category()
+	 * is the only one who knows what the other values mean.
+	 **/
+	unsigned char mimeCategoryCache() const { return _mimeCategoryCache; }
+
+	/**
+	 * Set the cached MimeCategory of this entry.
+	 **/
+	void setMimeCategoryCache( unsigned char value ) { _mimeCategoryCache = value; }
+
 	/**
 	 * Returns a pointer to this entry's parent entry or 0 if there is
 	 * none.
@@ -342,9 +414,11 @@ namespace QDirStat
 	DirInfo * parent() const { return _parent; }
 
 	/**
-	 * Set the "parent" pointer.
+	 * Set the "parent" pointer. This also sets the tree level, but not
+	 * the ones of the children; so this is only for items without
+	 * children or for moving children to a parent on the same level.
 	 **/
-	void setParent( DirInfo *newParent ) { _parent = newParent; }
+	void setParent( DirInfo *newParent );
 
 	/**
 	 * Returns a pointer to the next entry on the same level
@@ -448,10 +522,9 @@ namespace QDirStat
 	 * Returns the tree level (depth) of this item.
 	 * The topmost level is 0.
 	 *
-	 * This is a (somewhat) expensive operation since it will recurse up
-	 * to the top of the tree.
+	 * This is stored in each item when its parent is set.
 	 **/
-	int treeLevel() const;
+	int treeLevel() const { return _treeLevel; }
 
 	/**
 	 * Notification that a child has been added somewhere in the subtree.
@@ -518,6 +591,53 @@ namespace QDirStat
 	 **/
 	bool isSparseFile() const { return _isSparseFile; }
 
+	/**
+	 * Mark this file as one of several hard links to the same inode when
+	 * the tree counts each inode only once: If 'first' is 'true', this is
+	 * the first one that was found, and it counts with its complete size;
+	 * otherwise it doesn't count at all. See size() and countedBlocks().
+	 **/
+	void setHardLinkCounted( bool first )
+	    { _isPrimaryLink = first; _isDuplicateLink = ! first; }
+
+	/**
+	 * Return 'true' if this is a hard link to an inode that is already
+	 * counted with another link.
+	 **/
+	bool isDuplicateLink() const { return _isDuplicateLink; }
+
+	/**
+	 * Return the index of device 'device' in the process-wide device
+	 * table. A tree typically spans only a handful of file systems, so
+	 * this is stored in each node instead of the full dev_t.
+	 **/
+	static unsigned short deviceIndex( dev_t device );
+
+	/**
+	 * Return the device with index 'index' in the device table.
+	 **/
+	static dev_t deviceByIndex( unsigned short index );
+
+	/**
+	 * Return the index of the combination of 'uid' and 'gid' in the
+	 * process-wide owner table. Like for the device, this is stored in
+	 * each node instead of both IDs; index 0 is an unknown owner.
+	 **/
+	static unsigned short ownerIndex( uid_t uid, gid_t gid );
+
+	/**
+	 * Return the user and group ID with index 'index' in the owner
+	 * table in 'uid' and 'gid'. Return 'false' for an unknown owner;
+	 * then both are -1.
+	 **/
+	static bool ownerByIndex( unsigned short index, uid_t & uid, gid_t & gid );
+
+	/**
+	 * Return the number of entries in the owner table, including the
+	 * unknown owner.
+	 **/
+	static int ownerCount();
+
 
 	//
 	// File type / mode convenience methods.
@@ -584,12 +704,17 @@ namespace QDirStat
 	// there will be a _lot_ of entries of this kind!
 
 	short		_magic;			// magic number to detect if this object is valid
-	QString		_name;			// the file name (without path!)
+	unsigned short	_mode;			// file permissions + object type
+	unsigned short	_deviceIndex;		// device this object resides on (see deviceIndex())
 	bool		_isLocalFile  :1;	// flag: local or remote file?
 	bool		_isSparseFile :1;	// (cache) flag: sparse file (file with "holes")?
-	dev_t		_device;		// device this object resides on
-	mode_t		_mode;			// file permissions + object type
-	nlink_t		_links;			// number of links
+	bool		_isPrimaryLink :1;	// flag: first link to an inode, counted in full
+	bool		_isDuplicateLink :1;	// flag: inode already counted with another link
+	unsigned char	_mimeCategoryCache;	// (cache) see MimeCategorizer::category()
+	CompactName	_name;			// the file name (without path!)
+	unsigned	_links;			// number of links
+	unsigned short	_treeLevel;		// number of ancestors (in the padding before _size)
+	unsigned short	_ownerIndex;		// uid and gid (see ownerIndex()); also in the padding
 	FileSize	_size;			// size in bytes
 	FileSize	_blocks;		// 512 bytes blocks
 	time_t		_mtime;			// modification time
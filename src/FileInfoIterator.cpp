@@ -11,6 +11,7 @@
 
 #include "FileInfoIterator.h"
 #include "FileInfoSorter.h"
+#include "DirInfo.h"
 #include "Exception.h"
 
 using namespace QDirStat;
@@ -36,6 +37,7 @@ void FileInfoIterator::init( FileInfo * parent,
 {
     _parent  = parent;
     _current = 0;
+    _childArray = parent && parent->isDirInfo() ? parent->toDirInfo()->childArray() : 0;
 
     _directChildrenProcessed = false;
     _dotEntryProcessed	     = false;
@@ -51,7 +53,17 @@ void FileInfoIterator::next()
     {
 	// Process direct children
 
-	_current = _current ? _current->next() : _parent->firstChild();
+	if ( _childArray )
+	{
+	    _current = *_childArray;
+
+	    if ( _current )
+		++_childArray;
+	}
+	else
+	{
+	    _current = _current ? _current->next() : _parent->firstChild();
+	}
 
 	if ( ! _current )
 	{
@@ -82,12 +94,22 @@ int FileInfoIterator::count()
 
     // Count direct children
 
-    FileInfo * child = _parent->firstChild();
+    FileInfo * const * array = _parent->isDirInfo() ? _parent->toDirInfo()->childArray() : 0;
 
-    while ( child )
+    if ( array )
     {
-	cnt++;
-	child = child->next();
+	while ( *array++ )
+	    cnt++;
+    }
+    else
+    {
+	FileInfo * child = _parent->firstChild();
+
+	while ( child )
+	{
+	    cnt++;
+	    child = child->next();
+	}
     }
 
 
@@ -100,11 +122,43 @@ int FileInfoIterator::count()
 }
 
 
+FileInfoUrlIterator::FileInfoUrlIterator( FileInfo *	  parent,
+					  const QString & parentUrl ):
+    FileInfoIterator( parent ),
+    _parentUrl( parentUrl.isEmpty() && parent ? parent->url() : parentUrl )
+{
+}
+
+
+QString FileInfoUrlIterator::url() const
+{
+    return _current ? FileInfo::childUrl( _parentUrl, _current ) : QString();
+}
+
+
 FileInfoSortedBySizeIterator::FileInfoSortedBySizeIterator( FileInfo	  * parent,
 							    FileSize	    minSize,
 							    Qt::SortOrder   sortOrder )
 {
     _currentIndex = 0;
+
+    if ( sortOrder == Qt::DescendingOrder && parent->isDirInfo() )
+    {
+	// The list is implicitly shared, so this doesn't copy it. The
+	// children that are too small are all at the end.
+
+	_sortedChildren = parent->toDirInfo()->sizeSortedChildren();
+	_count = 0;
+
+	while ( _count < _sortedChildren.size() &&
+		_sortedChildren.at( _count )->totalSize() >= minSize )
+	{
+	    ++_count;
+	}
+
+	return;
+    }
+
     FileInfoIterator it( parent );
 
     while ( *it )
@@ -119,12 +173,13 @@ FileInfoSortedBySizeIterator::FileInfoSortedBySizeIterator( FileInfo	  * parent,
 		      _sortedChildren.end(),
 		      FileInfoSorter( TotalSizeCol, sortOrder ) );
 
+    _count = _sortedChildren.size();
 }
 
 
 FileInfo * FileInfoSortedBySizeIterator::current()
 {
-    if ( _currentIndex >= 0 && _currentIndex < _sortedChildren.size() )
+    if ( _currentIndex >= 0 && _currentIndex < _count )
 	return _sortedChildren.at( _currentIndex );
     else
 	return 0;
@@ -136,7 +191,7 @@ void FileInfoSortedBySizeIterator::next()
     // Intentionally letting _currentIndex move one position after the last so
     // current() will return 0 to indicate we are finished.
 
-    if ( _currentIndex < _sortedChildren.size() )
+    if ( _currentIndex < _count )
 	_currentIndex++;
 }
 
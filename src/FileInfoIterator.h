@@ -98,18 +98,71 @@ namespace QDirStat
 
 	FileInfo *	_parent;
 	FileInfo *	_current;
+	FileInfo * const * _childArray;	// Next child if the parent has a child array
 	bool		_directChildrenProcessed;
 	bool		_dotEntryProcessed;
 
     };	// class FileInfoIterator
 
 
+
+    /**
+     * Iterator for the children of a @ref FileInfo object that also
+     * returns the URL of each one: It only appends the name of each child
+     * to the URL of the parent instead of starting again at the top of
+     * the tree like FileInfo::url(). Use this to go through a subtree
+     * recursively with one iterator for each level:
+     *
+     *	  void collect( FileInfo * dir, const QString & url )
+     *	  {
+     *	      FileInfoUrlIterator it( dir, url );
+     *
+     *	      while ( *it )
+     *	      {
+     *		  paths << it.url();
+     *		  collect( *it, it.url() );
+     *		  ++it;
+     *	      }
+     *	  }
+     **/
+    class FileInfoUrlIterator: public FileInfoIterator
+    {
+    public:
+
+	/**
+	 * Constructor: Iterate over the children of 'parent' whose URL is
+	 * 'parentUrl'. If 'parentUrl' is empty, this uses parent->url().
+	 **/
+	FileInfoUrlIterator( FileInfo * parent, const QString & parentUrl = QString() );
+
+	/**
+	 * Return the URL of the current child or an empty string if there
+	 * is no more.
+	 **/
+	QString url() const;
+
+	/**
+	 * Return the URL of the parent.
+	 **/
+	const QString & parentUrl() const { return _parentUrl; }
+
+    protected:
+
+	QString _parentUrl;
+
+    };	// class FileInfoUrlIterator
+
+
     class FileInfoSortedBySizeIterator
     {
     public:
 
 	/**
 	 * Constructor. Children below 'minSize' will be ignored by this iterator.
+	 *
+	 * For directories in descending order, this uses the cached list of
+	 * DirInfo::sizeSortedChildren() without copying it, so the children
+	 * are only sorted again after they changed.
 	 **/
 	FileInfoSortedBySizeIterator( FileInfo	    * parent,
 				      FileSize	      minSize	= 0,
@@ -140,12 +193,13 @@ namespace QDirStat
 	/**
 	 * Return the number of items that will be processed.
 	 **/
-	int count() { return _sortedChildren.size(); }
+	int count() { return _count; }
 
     protected:
 
 	FileInfoList _sortedChildren;
 	int	     _currentIndex;
+	int	     _count;
     }; //
 
 } // namespace QDirStat
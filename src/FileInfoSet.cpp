@@ -31,13 +31,58 @@ bool FileInfoSet::containsAncestorOf( FileInfo * item ) const
 }
 
 
+bool FileInfoSet::coversDir( FileInfo		     * dir,
+			     QHash<FileInfo *, bool> & covered ) const
+{
+    // Walk up to the first directory that is in the set or whose result is
+    // already known, then remember that result for all directories on the
+    // way there: Everything below a directory of the set is covered.
+
+    QList<FileInfo *> path;
+    bool result = false;
+
+    while ( dir )
+    {
+	QHash<FileInfo *, bool>::const_iterator it = covered.constFind( dir );
+
+	if ( it != covered.constEnd() )
+	{
+	    result = it.value();
+	    break;
+	}
+
+	path << dir;
+
+	if ( contains( dir ) )
+	{
+	    result = true;
+	    break;
+	}
+
+	dir = dir->parent();
+    }
+
+    foreach ( FileInfo * pathDir, path )
+	covered.insert( pathDir, result );
+
+    return result;
+}
+
+
 FileInfoSet FileInfoSet::normalized() const
 {
+    if ( size() < 2 )
+	return *this;
+
+    // Many items typically share the same parents, so each directory is
+    // only checked once instead of walking up all ancestors of each item.
+
     FileInfoSet normalized;
+    QHash<FileInfo *, bool> covered;
 
     foreach ( FileInfo * item, *this )
     {
-	if ( ! containsAncestorOf( item ) )
+	if ( ! coversDir( item->parent(), covered ) )
 	    normalized << item;
 #if 0
 	else
@@ -11,6 +11,7 @@
 #define FileInfoSet_h
 
 #include <QSet>
+#include <QHash>
 #include "FileInfo.h"
 
 
@@ -89,6 +90,11 @@ namespace QDirStat
          * If there is reason to believe that any items of the set might have
          * become invalid, call this first before any other operations.
          *
+         * This is only safe as long as the memory of deleted items is not
+         * reused: Until the event loop is reached again after they were
+         * deleted, or while a NodePin exists that was created before they
+         * were deleted. See NodePool.
+         *
          * Notice that this does not modify the existing set, but you can
          * of course assign the result of this to the set.
          **/
@@ -97,9 +103,21 @@ namespace QDirStat
 	/**
 	 * Return a 'normalized' set, i.e. with all items removed that have
 	 * ancestors in the set.
+	 *
+	 * This checks each directory above the items only once, so this is
+	 * about linear in the number of items plus their ancestors.
 	 **/
 	FileInfoSet normalized() const;
 
+    protected:
+
+	/**
+	 * Return 'true' if 'dir' or any of its ancestors is in this set.
+	 * 'covered' keeps the results for all directories checked so far.
+	 **/
+	bool coversDir( FileInfo		* dir,
+			QHash<FileInfo *, bool> & covered ) const;
+
     };	// class FileInfoSet
 
 }	// namespace QDirStat
@@ -8,11 +8,211 @@
 
 
 #include <algorithm>
+
+#include <QVector>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+
 #include "FileInfoSorter.h"
+#include "DirTree.h"
+#include "CacheDiff.h"
+#include "ExtentStats.h"
+#include "DirReadTimes.h"
 
 using namespace QDirStat;
 
 
+// Use the parallel sort with precomputed keys from this many items on
+#define MIN_PARALLEL_SORT_ITEMS 20000
+
+
+namespace
+{
+    /**
+     * Return the name of the main MIME category of 'item'.
+     * See DirTree::mainCategoryName().
+     **/
+    QString mainCategoryName( FileInfo * item )
+    {
+	return item->tree() ? item->tree()->mainCategoryName( item ) : QString();
+    }
+
+
+    /**
+     * Return the growth of 'item' since the older cache file that the tree
+     * is compared with. See CacheDiff::sizeDelta().
+     **/
+    FileSize growth( FileInfo * item )
+    {
+	CacheDiff * diff = item->tree() ? item->tree()->cacheDiff() : 0;
+
+	return diff ? diff->sizeDelta( item ) : 0;
+    }
+
+
+    /**
+     * Return the exclusive disk space of 'item' if the extents of the tree
+     * were counted. See ExtentStats::exclusiveSize().
+     **/
+    FileSize exclusiveSize( FileInfo * item )
+    {
+	ExtentStats * stats = item->tree() ? item->tree()->extentStats() : 0;
+
+	return stats ? stats->exclusiveSize( item ) : 0;
+    }
+
+
+    /**
+     * Return the time in microseconds it took to read 'item' if the read
+     * times of the tree are recorded. See DirReadTimes.
+     **/
+    qint64 readTime( FileInfo * item )
+    {
+	DirReadTimes * readTimes = item->tree() ? item->tree()->readTimes() : 0;
+
+	return readTimes ? readTimes->readTime( item ).usec : 0;
+    }
+
+
+    /**
+     * The sort key of one FileInfo: Everything that FileInfoSorter would
+     * otherwise ask the FileInfo (often with virtual calls that might even
+     * trigger a recalc()) for each comparison.
+     **/
+    struct SortKey
+    {
+	FileInfo *  item;
+	QString	    name;
+	qint64	    number;
+	float	    percent;
+	bool	    isDotEntry;
+    };
+
+    typedef QVector<SortKey> SortKeyList;
+
+
+    /**
+     * Create the sort key for 'item' for sorting by 'sortCol'.
+     **/
+    SortKey sortKey( FileInfo * item, DataColumn sortCol )
+    {
+	SortKey key;
+	key.item       = item;
+	key.number     = 0;
+	key.percent    = 0.0;
+	key.isDotEntry = item->isDotEntry();
+
+	switch ( sortCol )
+	{
+	    case NameCol:	  key.name    = item->name();		 break;
+	    case PercentBarCol:	  key.percent = item->subtreePercent();	 break;
+	    case PercentNumCol:	  key.percent = item->subtreePercent();	 break;
+	    case TotalSizeCol:	  key.number  = item->totalSize();	 break;
+	    case OwnSizeCol:	  key.number  = item->size();		 break;
+	    case TotalItemsCol:	  key.number  = item->totalItems();	 break;
+	    case TotalFilesCol:	  key.number  = item->totalFiles();	 break;
+	    case TotalSubDirsCol: key.number  = item->totalSubDirs();	 break;
+	    case LatestMTimeCol:  key.number  = item->latestMtime();	 break;
+	    case MainCategoryCol: key.name    = mainCategoryName( item ); break;
+	    case GrowthCol:	  key.number  = growth( item );	 break;
+	    case ExclusiveSizeCol: key.number = exclusiveSize( item ); break;
+	    case ReadTimeCol:	  key.number  = readTime( item );	 break;
+	    case ReadJobsCol:	  key.number  = item->pendingReadJobs(); break;
+	    case UndefinedCol:	  break;
+	}
+
+	return key;
+    }
+
+
+    /**
+     * Comparison functor for sort keys. This has to sort exactly like
+     * FileInfoSorter.
+     **/
+    class SortKeyLess
+    {
+    public:
+
+	SortKeyLess( DataColumn sortCol, Qt::SortOrder sortOrder ):
+	    _sortCol( sortCol ),
+	    _sortOrder( sortOrder )
+	    {}
+
+	bool operator() ( const SortKey & keyA, const SortKey & keyB ) const
+	{
+	    const SortKey * a = &keyA;
+	    const SortKey * b = &keyB;
+
+	    if ( _sortOrder == Qt::DescendingOrder )
+		std::swap( a, b );
+
+	    switch ( _sortCol )
+	    {
+		case NameCol:
+		    if ( a->isDotEntry ) return false;
+		    if ( b->isDotEntry ) return true;
+		    return a->name < b->name;
+
+		case PercentBarCol:
+		case PercentNumCol:
+		    return a->percent < b->percent;
+
+		case MainCategoryCol:
+		    return a->name < b->name;
+
+		default:
+		    return a->number < b->number;
+	    }
+	}
+
+    private:
+	DataColumn    _sortCol;
+	Qt::SortOrder _sortOrder;
+    };
+
+
+    /**
+     * Worker that either sorts one range of sort keys or merges two
+     * adjacent sorted ranges.
+     **/
+    class SortWorker: public QRunnable
+    {
+    public:
+
+	SortWorker( SortKeyList & keys,
+		    int		  begin,
+		    int		  middle,   // -1: sort, don't merge
+		    int		  end,
+		    SortKeyLess	  less ):
+	    _keys( keys ),
+	    _begin( begin ),
+	    _middle( middle ),
+	    _end( end ),
+	    _less( less )
+	    {}
+
+	virtual void run() Q_DECL_OVERRIDE
+	{
+	    SortKey * data = _keys.data();
+
+	    if ( _middle < 0 )
+		std::stable_sort( data + _begin, data + _end, _less );
+	    else
+		std::inplace_merge( data + _begin, data + _middle, data + _end, _less );
+	}
+
+    private:
+	SortKeyList &	_keys;
+	int		_begin;
+	int		_middle;
+	int		_end;
+	SortKeyLess	_less;
+    };
+
+}	// namespace
+
+
 bool FileInfoSorter::operator() ( FileInfo * a, FileInfo * b )
 {
     if ( !a || !b ) return false;
@@ -38,6 +238,10 @@ bool FileInfoSorter::operator() ( FileInfo * a, FileInfo * b )
 	case TotalFilesCol:   return a->totalFiles()	  < b->totalFiles();
 	case TotalSubDirsCol: return a->totalSubDirs()	  < b->totalSubDirs();
 	case LatestMTimeCol:  return a->latestMtime()	  < b->latestMtime();
+	case MainCategoryCol: return mainCategoryName( a ) < mainCategoryName( b );
+	case GrowthCol:	      return growth( a )	  < growth( b );
+	case ExclusiveSizeCol: return exclusiveSize( a ) < exclusiveSize( b );
+	case ReadTimeCol:     return readTime( a )	  < readTime( b );
 	case ReadJobsCol:     return a->pendingReadJobs() < b->pendingReadJobs();
 	case UndefinedCol:    return false;
 	    // Intentionally omitting the 'default' branch
@@ -46,3 +250,73 @@ bool FileInfoSorter::operator() ( FileInfo * a, FileInfo * b )
 
     return false;
 }
+
+
+void FileInfoSorter::sort( FileInfoList & list,
+			   DataColumn	  sortCol,
+			   Qt::SortOrder  sortOrder )
+{
+    int threads = QThread::idealThreadCount();
+
+    if ( list.size() < MIN_PARALLEL_SORT_ITEMS || threads < 2 || sortCol == UndefinedCol )
+    {
+	std::stable_sort( list.begin(), list.end(), FileInfoSorter( sortCol, sortOrder ) );
+	return;
+    }
+
+    // Fetch the sort keys in this thread: This might trigger a recalc()
+    // of the items, and that is not thread safe.
+
+    SortKeyList keys;
+    keys.reserve( list.size() );
+
+    foreach ( FileInfo * item, list )
+	keys.append( sortKey( item, sortCol ) );
+
+
+    // Sort one range per thread
+
+    QVector<int> bounds;
+
+    for ( int i=0; i < threads; ++i )
+	bounds.append( (qint64) keys.size() * i / threads );
+
+    bounds.append( keys.size() );
+
+    SortKeyLess less( sortCol, sortOrder );
+    QThreadPool pool;
+    pool.setMaxThreadCount( threads );
+
+    for ( int i=0; i < bounds.size() - 1; ++i )
+	pool.start( new SortWorker( keys, bounds[i], -1, bounds[i+1], less ) );
+
+    pool.waitForDone();
+
+
+    // Merge adjacent ranges until there is only one left. Merging keeps
+    // the order of equal items, so the result is the same as with
+    // std::stable_sort().
+
+    while ( bounds.size() > 2 )
+    {
+	QVector<int> mergedBounds;
+
+	for ( int i=0; i < bounds.size() - 1; i += 2 )
+	{
+	    mergedBounds.append( bounds[i] );
+
+	    if ( i + 2 < bounds.size() )
+		pool.start( new SortWorker( keys, bounds[i], bounds[i+1], bounds[i+2], less ) );
+	}
+
+	mergedBounds.append( keys.size() );
+	pool.waitForDone();
+	bounds = mergedBounds;
+    }
+
+
+    // Store the result
+
+    for ( int i=0; i < keys.size(); ++i )
+	list[i] = keys[i].item;
+}
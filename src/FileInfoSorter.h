@@ -53,6 +53,16 @@ namespace QDirStat
 	 **/
 	bool operator() ( FileInfo * a, FileInfo * b );
 
+	/**
+	 * Sort 'list' by 'sortCol' and 'sortOrder'. This is the same as
+	 * std::stable_sort() with a FileInfoSorter, but for very long lists
+	 * the sort keys are fetched only once for each item, and the list is
+	 * sorted in parallel in several threads.
+	 **/
+	static void sort( FileInfoList & list,
+			  DataColumn	 sortCol,
+			  Qt::SortOrder	 sortOrder );
+
     private:
 	DataColumn    _sortCol;
 	Qt::SortOrder _sortOrder;
@@ -0,0 +1,484 @@
+/*
+ *   File name: FileQuery.cpp
+ *   Summary:	Query for files by size, age, name, type and depth
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <time.h>
+
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QAtomicInt>
+#include <QVector>
+#include <QStringList>
+#include <QDateTime>
+
+#include "FileQuery.h"
+#include "FileInfoIterator.h"
+#include "DirInfo.h"
+#include "DirTree.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+// Below this number of items, a thread pool costs more than it saves
+
+#define MIN_PARALLEL_QUERY_ITEMS	20000
+
+// Subtrees to search for each thread so the threads that get the small
+// ones don't have to wait for one that got a huge one
+
+#define QUERY_TASKS_PER_THREAD		8
+
+#define SECONDS_PER_DAY			( 24LL * 3600 )
+
+
+using namespace QDirStat;
+
+
+namespace
+{
+    /**
+     * One subtree to search: The children of 'dir' at 'depth'.
+     **/
+    struct QueryTask
+    {
+	FileInfo *  dir;
+	int	    depth;
+    };
+
+
+    /**
+     * Runnable for a QThreadPool that takes one QueryTask after the other
+     * from the shared list until there is none left.
+     *
+     * Each worker has a copy of the query since QRegExp keeps the state of
+     * the last match and can't be shared between threads.
+     **/
+    class QueryWorker: public QRunnable
+    {
+    public:
+
+	QueryWorker( const FileQuery	      & query,
+		     const QVector<QueryTask> & tasks,
+		     QAtomicInt		      & nextTask,
+		     FileInfoList	      & result ):
+	    QRunnable(),
+	    _query( query ),
+	    _tasks( tasks ),
+	    _nextTask( nextTask ),
+	    _result( result )
+	    {
+		setAutoDelete( false );
+	    }
+
+	virtual void run() Q_DECL_OVERRIDE
+	{
+	    int i;
+
+	    while ( ( i = _nextTask.fetchAndAddOrdered( 1 ) ) < _tasks.size() )
+	    {
+		const QueryTask & task = _tasks.at( i );
+		_query.findChildren( task.dir, task.depth, _result );
+	    }
+	}
+
+    private:
+	FileQuery		   _query;
+	const QVector<QueryTask> & _tasks;
+	QAtomicInt &		   _nextTask;
+	FileInfoList &		   _result;
+    };
+
+}	// namespace
+
+
+
+
+FileQuery::FileQuery():
+    _type( AnyType )
+{
+    // NOP
+}
+
+
+bool FileQuery::isEmpty() const
+{
+    return ! _size.isSet()	&&
+	   ! _allocated.isSet() &&
+	   ! _mtime.isSet()	&&
+	   ! _depth.isSet()	&&
+	   _type == AnyType	&&
+	   _namePattern.isEmpty();
+}
+
+
+void FileQuery::setNamePattern( const QString & pattern )
+{
+    _namePattern = pattern;
+    _nameRegExp	 = pattern.isEmpty() ?
+	QRegExp() : QRegExp( pattern, Qt::CaseInsensitive, QRegExp::Wildcard );
+}
+
+
+bool FileQuery::parse( const QString & query, QString * errorMsg )
+{
+    *this = FileQuery();
+
+    QRegExp termRegExp( "^(\\w+)(>=|<=|>|<|=)(.+)$" );
+    QString error;
+
+    foreach ( const QString & term, query.split( QRegExp( "\\s+" ), QString::SkipEmptyParts ) )
+    {
+	if ( ! termRegExp.exactMatch( term ) )
+	{
+	    // Anything else is a name pattern like "*.iso"
+
+	    setNamePattern( term );
+	    continue;
+	}
+
+	QString key   = termRegExp.cap( 1 ).toLower();
+	QString op    = termRegExp.cap( 2 );
+	QString value = termRegExp.cap( 3 );
+
+	if ( key == "size" || key == "allocated" )
+	{
+	    qint64 size = parseSize( value );
+
+	    if ( size < 0 )
+		error = QString( "Bad size: %1" ).arg( value );
+	    else
+		setRange( key == "size" ? _size : _allocated, op, size );
+	}
+	else if ( key == "age" )
+	{
+	    qint64 age = parseAge( value );
+
+	    if ( age < 0 )
+		error = QString( "Bad age: %1" ).arg( value );
+	    else
+	    {
+		// An age greater than 'age' is an mtime before 'now - age'
+
+		QString mtimeOp = op;
+		mtimeOp.replace( '>', 'x' ).replace( '<', '>' ).replace( 'x', '<' );
+		setRange( _mtime, mtimeOp, time( 0 ) - age );
+	    }
+	}
+	else if ( key == "mtime" )
+	{
+	    QDate date = QDate::fromString( value, Qt::ISODate );
+
+	    if ( ! date.isValid() )
+		error = QString( "Bad date: %1" ).arg( value );
+	    else
+		setRange( _mtime, op, QDateTime( date ).toTime_t() );
+	}
+	else if ( key == "depth" )
+	{
+	    bool ok;
+	    int depth = value.toInt( &ok );
+
+	    if ( ! ok || depth < 0 )
+		error = QString( "Bad depth: %1" ).arg( value );
+	    else
+		setRange( _depth, op, depth );
+	}
+	else if ( key == "name" && op == "=" )
+	{
+	    setNamePattern( value );
+	}
+	else if ( key == "type" && op == "=" )
+	{
+	    value = value.toLower();
+
+	    if	    ( value == "file"	 || value == "f" ) _type = FileType;
+	    else if ( value == "dir"	 || value == "d" ) _type = DirType;
+	    else if ( value == "symlink" || value == "l" ) _type = SymLinkType;
+	    else if ( value == "special"		 ) _type = SpecialType;
+	    else
+		error = QString( "Bad type: %1" ).arg( value );
+	}
+	else if ( key == "under" && op == "=" )
+	{
+	    _underPath = value;
+	}
+	else
+	{
+	    error = QString( "Unknown condition: %1" ).arg( term );
+	}
+
+	if ( ! error.isEmpty() )
+	{
+	    logWarning() << error << " in query \"" << query << "\"" << endl;
+
+	    if ( errorMsg )
+		*errorMsg = error;
+
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+
+qint64 FileQuery::parseSize( const QString & value )
+{
+    QRegExp sizeRegExp( "^(\\d+(\\.\\d+)?)([kmgtp]?)(i?b)?$", Qt::CaseInsensitive );
+
+    if ( ! sizeRegExp.exactMatch( value ) )
+	return -1;
+
+    double size = sizeRegExp.cap( 1 ).toDouble();
+    QString unit = sizeRegExp.cap( 3 ).toLower();
+
+    if ( ! unit.isEmpty() )
+    {
+	int exponent = QString( "kmgtp" ).indexOf( unit ) + 1;
+
+	for ( int i=0; i < exponent; ++i )
+	    size *= 1024.0;
+    }
+
+    return (qint64) size;
+}
+
+
+qint64 FileQuery::parseAge( const QString & value )
+{
+    QRegExp ageRegExp( "^(\\d+(\\.\\d+)?)([hdwmy]?)$", Qt::CaseInsensitive );
+
+    if ( ! ageRegExp.exactMatch( value ) )
+	return -1;
+
+    double age = ageRegExp.cap( 1 ).toDouble();
+    QChar  unit = ageRegExp.cap( 3 ).isEmpty() ? QChar( 'd' ) : ageRegExp.cap( 3 ).toLower().at( 0 );
+
+    switch ( unit.toLatin1() )
+    {
+	case 'h': age *= 3600;			 break;
+	case 'd': age *= SECONDS_PER_DAY;	 break;
+	case 'w': age *= 7 * SECONDS_PER_DAY;	 break;
+	case 'm': age *= 30 * SECONDS_PER_DAY;	 break;
+	case 'y': age *= 365 * SECONDS_PER_DAY; break;
+    }
+
+    return (qint64) age;
+}
+
+
+void FileQuery::setRange( FileQueryRange & range, const QString & op, qint64 value )
+{
+    if ( op.startsWith( '>' ) || op == "=" )
+    {
+	range.min    = op == ">" ? value + 1 : value;
+	range.hasMin = true;
+    }
+
+    if ( op.startsWith( '<' ) || op == "=" )
+    {
+	range.max    = op == "<" ? value - 1 : value;
+	range.hasMax = true;
+    }
+}
+
+
+bool FileQuery::matches( FileInfo * item, int depth ) const
+{
+    if ( item->isDotEntry() )
+	return false;
+
+    switch ( _type )
+    {
+	case AnyType:							   break;
+	case FileType:	  if ( ! item->isFile()	   ) return false;	   break;
+	case DirType:	  if ( ! item->isDir()	   ) return false;	   break;
+	case SymLinkType: if ( ! item->isSymLink() ) return false;	   break;
+	case SpecialType: if ( item->isFile() || item->isDir() || item->isSymLink() ) return false; break;
+    }
+
+    if ( ! _depth.contains( depth ) )
+	return false;
+
+    if ( _size.isSet() && ! _size.contains( item->totalSize() ) )
+	return false;
+
+    if ( _allocated.isSet() && ! _allocated.contains( item->totalBlocks() * item->blockSize() ) )
+	return false;
+
+    if ( _mtime.isSet() && ! _mtime.contains( item->mtime() ) )
+	return false;
+
+    // The name is the most expensive one: Creating the QString costs more
+    // than all the other checks
+
+    if ( ! _namePattern.isEmpty() && ! _nameRegExp.exactMatch( item->name() ) )
+	return false;
+
+    return true;
+}
+
+
+bool FileQuery::canSkipChildren( FileInfo * dir, int depth ) const
+{
+    if ( _depth.hasMax && depth >= _depth.max )
+	return true;
+
+    // No item in a subtree can be larger than the subtree or newer than
+    // the newest one in it
+
+    if ( _size.hasMin && dir->totalSize() < _size.min )
+	return true;
+
+    if ( _allocated.hasMin && dir->totalBlocks() * dir->blockSize() < _allocated.min )
+	return true;
+
+    if ( _mtime.hasMin && dir->latestMtime() < _mtime.min )
+	return true;
+
+    if ( _type == FileType && dir->totalFiles() == 0 )
+	return true;
+
+    if ( _type == DirType && dir->totalSubDirs() == 0 )
+	return true;
+
+    return false;
+}
+
+
+void FileQuery::findChildren( FileInfo * dir, int depth, FileInfoList & result ) const
+{
+    if ( canSkipChildren( dir, depth ) )
+	return;
+
+    FileInfoIterator it( dir );
+
+    while ( *it )
+    {
+	FileInfo * item = *it;
+
+	if ( item->isDotEntry() )
+	{
+	    // The children of the dot entry are direct children of 'dir'
+
+	    findChildren( item, depth, result );
+	}
+	else
+	{
+	    if ( matches( item, depth + 1 ) )
+		result << item;
+
+	    if ( item->isDirInfo() )
+		findChildren( item, depth + 1, result );
+	}
+
+	++it;
+    }
+}
+
+
+FileInfoList FileQuery::find( FileInfo * subtree ) const
+{
+    FileInfoList result;
+
+    if ( ! subtree )
+	return result;
+
+    // The workers only read the tree: Restore any cold subtrees and bring
+    // all the summaries up to date here in the main thread.
+
+    if ( subtree->tree() )
+	subtree->tree()->thaw( subtree );
+
+    subtree->totalSize();
+
+    int threads = QThread::idealThreadCount();
+
+    if ( threads < 2 || subtree->totalItems() < MIN_PARALLEL_QUERY_ITEMS )
+    {
+	findChildren( subtree, 0, result );
+	return result;
+    }
+
+
+    // Split the tree into tasks breadth first: Handle the items near the
+    // top right here and queue their subdirectories until there are
+    // enough of them for all threads.
+
+    QVector<QueryTask> tasks;
+    QueryTask top = { subtree, 0 };
+    tasks << top;
+
+    int first = 0;
+
+    while ( first < tasks.size() && tasks.size() - first < threads * QUERY_TASKS_PER_THREAD )
+    {
+	QueryTask task = tasks.at( first++ );
+
+	if ( canSkipChildren( task.dir, task.depth ) )
+	    continue;
+
+	FileInfoIterator it( task.dir );
+
+	while ( *it )
+	{
+	    FileInfo * item = *it;
+
+	    if ( item->isDotEntry() )
+	    {
+		QueryTask dotEntryTask = { item, task.depth };
+		tasks << dotEntryTask;
+	    }
+	    else
+	    {
+		if ( matches( item, task.depth + 1 ) )
+		    result << item;
+
+		if ( item->isDirInfo() )
+		{
+		    QueryTask subTask = { item, task.depth + 1 };
+		    tasks << subTask;
+		}
+	    }
+
+	    ++it;
+	}
+    }
+
+    tasks.remove( 0, first );
+
+
+    // Search the rest in parallel, each thread into a list of its own
+
+    QVector<FileInfoList> results( threads );
+    QList<QueryWorker *>  workers;
+    QAtomicInt		  nextTask( 0 );
+    QThreadPool		  pool;
+    pool.setMaxThreadCount( threads );
+
+    for ( int i=0; i < threads; ++i )
+    {
+	QueryWorker * worker = new QueryWorker( *this, tasks, nextTask, results[i] );
+	CHECK_NEW( worker );
+
+	workers << worker;
+	pool.start( worker );
+    }
+
+    pool.waitForDone();
+    qDeleteAll( workers );
+
+    for ( int i=0; i < threads; ++i )
+	result << results.at( i );
+
+    logDebug() << result.size() << " matches below " << subtree
+	       << " in " << tasks.size() << " tasks" << endl;
+
+    return result;
+}
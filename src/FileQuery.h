@@ -0,0 +1,202 @@
+/*
+ *   File name: FileQuery.h
+ *   Summary:	Query for files by size, age, name, type and depth
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef FileQuery_h
+#define FileQuery_h
+
+
+#include <QString>
+#include <QRegExp>
+
+#include "FileInfo.h"
+
+
+namespace QDirStat
+{
+    /**
+     * Range of values for one condition of a FileQuery. Both ends are
+     * inclusive.
+     **/
+    struct FileQueryRange
+    {
+	FileQueryRange():
+	    min( 0 ),
+	    max( 0 ),
+	    hasMin( false ),
+	    hasMax( false )
+	    {}
+
+	/**
+	 * Return 'true' if there is any limit.
+	 **/
+	bool isSet() const { return hasMin || hasMax; }
+
+	/**
+	 * Return 'true' if 'value' is within the range.
+	 **/
+	bool contains( qint64 value ) const
+	    { return ( ! hasMin || value >= min ) && ( ! hasMax || value <= max ); }
+
+	qint64	min;
+	qint64	max;
+	bool	hasMin;
+	bool	hasMax;
+    };
+
+
+    /**
+     * Query for the items in a subtree that match all of a number of
+     * conditions: Ranges for the size, the allocated size, the mtime and
+     * the depth below the subtree, a wildcard pattern for the name and the
+     * type of the item.
+     *
+     * A query can be parsed from a string of terms separated by blanks,
+     * for example
+     *
+     *	   size>1G age>2y type=file under=/data
+     *
+     * The terms are:
+     *
+     *	   size, allocated	 with >, >=, <, <= or = and a number with an
+     *				 optional K, M, G, T or P suffix (base 1024)
+     *	   age			 with an operator and a number with an
+     *				 optional h, d (the default), w, m (30 days)
+     *				 or y (365 days) suffix
+     *	   mtime		 with an operator and a date like 2020-12-31
+     *	   depth		 with an operator and a number; 1 are the
+     *				 direct children of the subtree
+     *	   name=<pattern>	 wildcard pattern for the name (case
+     *				 insensitive); a term without an operator is
+     *				 the same
+     *	   type=<type>		 file, dir, symlink or special
+     *	   under=<path>		 the directory to search
+     *
+     * The search uses the summaries of the directories to skip complete
+     * subtrees that can't contain any match: No item can be larger than
+     * the total size of a directory, and none can be newer than its latest
+     * mtime. The rest is evaluated in parallel in a thread pool with one
+     * task for each of a number of subtrees.
+     **/
+    class FileQuery
+    {
+    public:
+
+	enum ItemType
+	{
+	    AnyType,
+	    FileType,
+	    DirType,
+	    SymLinkType,
+	    SpecialType
+	};
+
+	/**
+	 * Constructor. This matches all items.
+	 **/
+	FileQuery();
+
+	/**
+	 * Parse 'query' and set up the conditions from it. Return 'true'
+	 * if OK, 'false' upon error; then 'errorMsg' (if non-null) is set
+	 * to what is wrong.
+	 **/
+	bool parse( const QString & query, QString * errorMsg = 0 );
+
+	/**
+	 * Return 'true' if there is no condition at all.
+	 **/
+	bool isEmpty() const;
+
+	/**
+	 * Return 'true' if 'item' at 'depth' below the subtree matches all
+	 * conditions.
+	 **/
+	bool matches( FileInfo * item, int depth ) const;
+
+	/**
+	 * Return 'true' if nothing below 'dir' at 'depth' can match. This
+	 * is only a question of its summaries; 'dir' itself might still
+	 * match.
+	 **/
+	bool canSkipChildren( FileInfo * dir, int depth ) const;
+
+	/**
+	 * Return all items below 'subtree' (but not 'subtree' itself) that
+	 * match. Directories whose children might match are searched in a
+	 * thread pool; this returns when all of them are done.
+	 **/
+	FileInfoList find( FileInfo * subtree ) const;
+
+	/**
+	 * Search the children of 'dir' at 'depth' and append the matches
+	 * to 'result'. This is what each task of find() does.
+	 **/
+	void findChildren( FileInfo * dir, int depth, FileInfoList & result ) const;
+
+
+	//
+	// Conditions
+	//
+
+	FileQueryRange & sizeRange()	  { return _size;      }
+	FileQueryRange & allocatedRange() { return _allocated; }
+	FileQueryRange & mtimeRange()	  { return _mtime;     }
+	FileQueryRange & depthRange()	  { return _depth;     }
+
+	ItemType itemType() const { return _type; }
+	void setItemType( ItemType type ) { _type = type; }
+
+	QString namePattern() const { return _namePattern; }
+	void setNamePattern( const QString & pattern );
+
+	/**
+	 * Return the path from an "under=" term or an empty string.
+	 **/
+	QString underPath() const { return _underPath; }
+
+
+    protected:
+
+	/**
+	 * Parse 'value' as a size with an optional unit. Return -1 upon
+	 * error.
+	 **/
+	static qint64 parseSize( const QString & value );
+
+	/**
+	 * Parse 'value' as an age with an optional unit in seconds.
+	 * Return -1 upon error.
+	 **/
+	static qint64 parseAge( const QString & value );
+
+	/**
+	 * Set 'range' from a comparison operator and a value.
+	 **/
+	static void setRange( FileQueryRange & range, const QString & op, qint64 value );
+
+
+	//
+	// Data members
+	//
+
+	FileQueryRange	_size;
+	FileQueryRange	_allocated;
+	FileQueryRange	_mtime;
+	FileQueryRange	_depth;
+	ItemType	_type;
+	QString		_namePattern;
+	QRegExp		_nameRegExp;
+	QString		_underPath;
+
+    };	// class FileQuery
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef FileQuery_h
@@ -0,0 +1,145 @@
+/*
+ *   File name: FileSizeSketch.cpp
+ *   Summary:	Approximate file size statistics for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <math.h>	// log(), ceil(), pow()
+
+#include "FileSizeSketch.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+FileSizeSketch::FileSizeSketch( double relativeAccuracy ):
+    _relativeAccuracy( relativeAccuracy )
+{
+    if ( relativeAccuracy <= 0.0 || relativeAccuracy >= 1.0 )
+	THROW( Exception( QString( "Invalid relative accuracy %1" ).arg( relativeAccuracy ) ) );
+
+    _gamma    = ( 1.0 + relativeAccuracy ) / ( 1.0 - relativeAccuracy );
+    _logGamma = log( _gamma );
+    clear();
+}
+
+
+void FileSizeSketch::clear()
+{
+    _counts = QVector<int>();
+    _sums   = QVector<FileSize>();
+    _count  = 0;
+    _sum    = 0LL;
+    _min    = 0LL;
+    _max    = 0LL;
+}
+
+
+int FileSizeSketch::binIndex( FileSize size ) const
+{
+    if ( size <= 0 )
+	return 0;
+
+    // Bin 1 + j holds the sizes in ( gamma^(j-1), gamma^j ]
+
+    return 1 + (int) ceil( log( (double) size ) / _logGamma );
+}
+
+
+FileSize FileSizeSketch::binValue( int bin ) const
+{
+    if ( bin <= 0 )
+	return 0LL;
+
+    // The value with the same relative error to both limits of the bin
+
+    double value = 2.0 * pow( _gamma, bin - 1 ) / ( _gamma + 1.0 );
+    FileSize size = (FileSize) ( value + 0.5 );
+
+    return qBound( min(), size, max() );
+}
+
+
+void FileSizeSketch::add( FileSize size, FileSize weight )
+{
+    int bin = binIndex( size );
+
+    if ( bin >= _counts.size() )
+    {
+	_counts.resize( bin + 1 );
+	_sums.resize( bin + 1 );
+    }
+
+    ++_counts[ bin ];
+    _sums[ bin ] += weight;
+
+    if ( _count == 0 || size < _min )
+	_min = size;
+
+    if ( _count == 0 || size > _max )
+	_max = size;
+
+    ++_count;
+    _sum += size;
+}
+
+
+void FileSizeSketch::merge( const FileSizeSketch & other )
+{
+    if ( other._relativeAccuracy != _relativeAccuracy )
+	THROW( Exception( "Can't merge sketches with different accuracy" ) );
+
+    if ( other._count == 0 )
+	return;
+
+    if ( other._counts.size() > _counts.size() )
+    {
+	_counts.resize( other._counts.size() );
+	_sums.resize( other._sums.size() );
+    }
+
+    for ( int bin=0; bin < other._counts.size(); ++bin )
+    {
+	_counts[ bin ] += other._counts.at( bin );
+	_sums  [ bin ] += other._sums.at( bin );
+    }
+
+    if ( _count == 0 || other._min < _min )
+	_min = other._min;
+
+    if ( _count == 0 || other._max > _max )
+	_max = other._max;
+
+    _count += other._count;
+    _sum   += other._sum;
+}
+
+
+FileSize FileSizeSketch::quantile( double q ) const
+{
+    if ( _count == 0 )
+	return 0LL;
+
+    if ( q <= 0.0 )
+	return min();
+
+    if ( q >= 1.0 )
+	return max();
+
+    qint64 rank = (qint64) ( q * ( _count - 1 ) );
+    qint64 sum	= 0;
+
+    for ( int bin=0; bin < _counts.size(); ++bin )
+    {
+	sum += _counts.at( bin );
+
+	if ( sum > rank )
+	    return binValue( bin );
+    }
+
+    return max();
+}
@@ -0,0 +1,154 @@
+/*
+ *   File name: FileSizeSketch.h
+ *   Summary:	Approximate file size statistics for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef FileSizeSketch_h
+#define FileSizeSketch_h
+
+
+#include <QVector>
+
+#include "FileInfo.h"	// FileSize
+
+
+namespace QDirStat
+{
+    /**
+     * Quantile sketch for file sizes: This keeps the number and the sum of
+     * the sizes in bins of exponentially growing width, so each bin covers
+     * the same relative range of sizes. Any quantile can then be obtained
+     * with that relative accuracy, no matter how many files there are, and
+     * the memory usage is bounded by the number of bins (about 2200 for 1%
+     * accuracy over the complete 64 bit range).
+     *
+     * Since a bin all by itself is not affected by any other, two sketches
+     * with the same accuracy can simply be merged by adding up the bins.
+     *
+     * The number of files, the sum, the minimum and the maximum are exact.
+     *
+     * The values don't have to be file sizes; any non-negative 64 bit
+     * values will do, e.g. file ages in seconds.
+     **/
+    class FileSizeSketch
+    {
+    public:
+
+	/**
+	 * Constructor. 'relativeAccuracy' is the maximum relative error of
+	 * the quantiles, e.g. 0.01 for 1%.
+	 **/
+	FileSizeSketch( double relativeAccuracy = 0.01 );
+
+	/**
+	 * Clear all data and free the bins.
+	 **/
+	void clear();
+
+	/**
+	 * Add one file size.
+	 **/
+	void add( FileSize size ) { add( size, size ); }
+
+	/**
+	 * Add one value with a weight for the bin sums. This makes the
+	 * sketch usable for other values than file sizes; e.g. for file ages
+	 * with the file size as the weight, binSum() is the disk space used
+	 * by the files of each age.
+	 **/
+	void add( FileSize value, FileSize weight );
+
+	/**
+	 * Add all data of another sketch. Both need the same accuracy.
+	 **/
+	void merge( const FileSizeSketch & other );
+
+	/**
+	 * Return the relative accuracy of this sketch.
+	 **/
+	double relativeAccuracy() const { return _relativeAccuracy; }
+
+	/**
+	 * Return the number of file sizes added.
+	 **/
+	int count() const { return _count; }
+
+	/**
+	 * Return the sum of all file sizes added.
+	 **/
+	FileSize sum() const { return _sum; }
+
+	/**
+	 * Return the smallest file size added or 0 if there is none.
+	 **/
+	FileSize min() const { return _count > 0 ? _min : 0; }
+
+	/**
+	 * Return the largest file size added or 0 if there is none.
+	 **/
+	FileSize max() const { return _count > 0 ? _max : 0; }
+
+	/**
+	 * Return the approximate quantile 'q' (0.0 .. 1.0): The median is
+	 * quantile( 0.5 ); quantile( 0.0 ) is the minimum, quantile( 1.0 )
+	 * the maximum.
+	 **/
+	FileSize quantile( double q ) const;
+
+	//
+	// Access to the bins in ascending order of the sizes
+	//
+
+	/**
+	 * Return the number of bins. Many of them may be empty.
+	 **/
+	int binCount() const { return _counts.size(); }
+
+	/**
+	 * Return the number of file sizes in bin no. 'bin'.
+	 **/
+	int binItems( int bin ) const { return _counts.at( bin ); }
+
+	/**
+	 * Return the sum of the weights (the file sizes unless specified
+	 * otherwise with add()) in bin no. 'bin'.
+	 **/
+	FileSize binSum( int bin ) const { return _sums.at( bin ); }
+
+	/**
+	 * Return the value that represents all file sizes in bin no. 'bin'.
+	 * The relative error to any of them is at most relativeAccuracy().
+	 **/
+	FileSize binValue( int bin ) const;
+
+
+    protected:
+
+	/**
+	 * Return the bin for 'size'. Bin 0 is for size 0.
+	 **/
+	int binIndex( FileSize size ) const;
+
+
+	// Data members
+
+	double			_relativeAccuracy;
+	double			_gamma;		// Ratio of the limits of each bin
+	double			_logGamma;
+	QVector<int>		_counts;
+	QVector<FileSize>	_sums;
+	int			_count;
+	FileSize		_sum;
+	FileSize		_min;
+	FileSize		_max;
+
+    };	// class FileSizeSketch
+
+}	// namespace QDirStat
+
+
+#endif // ifndef FileSizeSketch_h
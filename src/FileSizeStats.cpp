@@ -10,9 +10,15 @@
 #include <math.h>       // ceil()
 #include <algorithm>
 
+#include <QThread>
+#include <QPair>
+
 #include "FileSizeStats.h"
+#include "FileAgeStats.h"
 #include "FileInfoIterator.h"
+#include "ChildColumns.h"
 #include "DirTree.h"
+#include "Logger.h"
 #include "Exception.h"
 
 #define VERBOSE_SORT_THRESHOLD  50000
@@ -21,7 +27,8 @@ using namespace QDirStat;
 
 
 FileSizeStats::FileSizeStats():
-    _sorted( false )
+    _sorted( false ),
+    _approximate( false )
 {
 
 }
@@ -32,6 +39,10 @@ void FileSizeStats::clear()
     // list to _data.
 
     _data = FileSizeList();
+    _selected = QVector<int>();
+    _sorted = false;
+    _sketch.clear();
+    _bucketCache.clear();
 }
 
 
@@ -48,10 +59,43 @@ void FileSizeStats::collect( FileInfo * subtree )
     Q_CHECK_PTR( subtree );
 
     if ( _data.isEmpty() )
-        _data.reserve( subtree->totalFiles() );
+        reserve( subtree->totalFiles() );
+
+    collectFiles( subtree );
+}
 
+
+void FileSizeStats::collectFiles( FileInfo * subtree )
+{
     if ( subtree->isFile() )
-        _data << subtree->size();
+        add( subtree->size() );
+
+    const ChildColumns * columns = subtree->isDirInfo() ? subtree->toDirInfo()->childColumns() : 0;
+
+    if ( columns )
+    {
+        // The sizes of the files are all in one array
+
+        const FileSize * sizes = columns->sizes().constData();
+        const mode_t   * modes = columns->modes().constData();
+
+        for ( int i = 0; i < columns->count(); ++i )
+        {
+            if ( S_ISREG( modes[ i ] ) )
+                add( sizes[ i ] );
+        }
+
+        foreach ( DirInfo * dir, columns->dirs() )
+        {
+            if ( dir->hasChildren() )
+                collectFiles( dir );
+        }
+
+        if ( subtree->dotEntry() )
+            collectFiles( subtree->dotEntry() );
+
+        return;
+    }
 
     FileInfoIterator it( subtree );
 
@@ -61,11 +105,11 @@ void FileSizeStats::collect( FileInfo * subtree )
 
 	if ( item->hasChildren() )
 	{
-	    collect( item );
+	    collectFiles( item );
 	}
 	else if ( item->isFile() )
 	{
-            _data << item->size();
+            add( item->size() );
 	}
 	// Disregard symlinks, block devices and other special files
 
@@ -93,10 +137,16 @@ void FileSizeStats::collect( FileInfo * subtree, const QString & suffix )
     Q_CHECK_PTR( subtree );
 
     if ( _data.isEmpty() )
-        _data.reserve( subtree->totalFiles() );
+        reserve( subtree->totalFiles() );
+
+    collectFiles( subtree, suffix );
+}
+
 
+void FileSizeStats::collectFiles( FileInfo * subtree, const QString & suffix )
+{
     if ( subtree->isFile() && subtree->name().toLower().endsWith( suffix ) )
-        _data << subtree->size();
+        add( subtree->size() );
 
     FileInfoIterator it( subtree );
 
@@ -106,12 +156,12 @@ void FileSizeStats::collect( FileInfo * subtree, const QString & suffix )
 
 	if ( item->hasChildren() )
 	{
-	    collect( item, suffix );
+	    collectFiles( item, suffix );
 	}
 	else if ( item->isFile() )
 	{
             if ( item->name().toLower().endsWith( suffix ) )
-                _data << item->size();
+                add( item->size() );
 	}
 	// Disregard symlinks, block devices and other special files
 
@@ -120,13 +170,59 @@ void FileSizeStats::collect( FileInfo * subtree, const QString & suffix )
 }
 
 
+void FileSizeStats::reserve( int size )
+{
+    if ( ! _approximate )
+        _data.reserve( _data.size() + size );
+}
+
+
+void FileSizeStats::merge( const FileSizeStats & other )
+{
+    if ( _approximate != other._approximate )
+        THROW( Exception( "Can't merge exact and approximate file size statistics" ) );
+
+    _bucketCache.clear();
+
+    if ( _approximate )
+    {
+        _sketch.merge( other._sketch );
+    }
+    else
+    {
+        if ( _data.isEmpty() )
+            _data = other._data;   // Implicitly shared: No copy
+        else
+            _data += other._data;
+
+        _sorted = false;
+        _selected.clear();
+    }
+}
+
+
+void FileSizeStats::merge( const FileSizeSketch & sketch )
+{
+    if ( ! _approximate )
+        THROW( Exception( "Can't merge a sketch into exact file size statistics" ) );
+
+    _bucketCache.clear();
+
+    _sketch.merge( sketch );
+}
+
+
 void FileSizeStats::sort()
 {
+    if ( _approximate ) // Nothing to sort
+        return;
+
     if ( _data.size() > VERBOSE_SORT_THRESHOLD )
         logDebug() << "Sorting " << _data.size() << " elements" << endl;
 
     std::sort( _data.begin(), _data.end() );
     _sorted = true;
+    _selected.clear();
 
     if ( _data.size() > VERBOSE_SORT_THRESHOLD )
         logDebug() << "Sorting done." << endl;
@@ -135,12 +231,12 @@ void FileSizeStats::sort()
 
 FileSize FileSizeStats::median()
 {
+    if ( _approximate )
+        return _sketch.quantile( 0.5 );
+
     if ( _data.isEmpty() )
         return 0;
 
-    if ( ! _sorted )
-        sort();
-
     int centerPos = _data.size() / 2;
 
     // Since we are doing integer division, the center is already rounded down
@@ -149,7 +245,7 @@ FileSize FileSizeStats::median()
     // _data.size() is 5, we get _data[2] which is the center of
     // [0, 1, 2, 3, 4].
 
-    FileSize result = _data.at( centerPos );
+    FileSize result = valueAt( centerPos );
 
     if ( _data.size() % 2 == 0 ) // Even number of data
     {
@@ -163,7 +259,7 @@ FileSize FileSizeStats::median()
         // arbitrary if we round this average up or down, so let's keep the
         // default "round down" result.
 
-        result = ( result + _data.at( centerPos - 1 ) ) / 2;
+        result = ( result + valueAt( centerPos - 1 ) ) / 2;
     }
 
     return result;
@@ -172,6 +268,9 @@ FileSize FileSizeStats::median()
 
 FileSize FileSizeStats::average()
 {
+    if ( _approximate )
+        return _sketch.count() > 0 ? _sketch.sum() / _sketch.count() : 0;
+
     if ( _data.isEmpty() )
         return 0;
 
@@ -187,32 +286,32 @@ FileSize FileSizeStats::average()
 
 FileSize FileSizeStats::min()
 {
+    if ( _approximate )
+        return _sketch.min();
+
     if ( _data.isEmpty() )
         return 0;
 
-    if ( ! _sorted )
-        sort();
-
-    return _data.first();
+    return valueAt( 0 );
 }
 
 
 
 FileSize FileSizeStats::max()
 {
+    if ( _approximate )
+        return _sketch.max();
+
     if ( _data.isEmpty() )
         return 0;
 
-    if ( ! _sorted )
-        sort();
-
-    return _data.last();
+    return valueAt( _data.size() - 1 );
 }
 
 
 FileSize FileSizeStats::quantile( int order, int number )
 {
-    if ( _data.isEmpty() )
+    if ( dataSize() == 0 )
         return 0;
 
     if ( number > order )
@@ -228,32 +327,114 @@ FileSize FileSizeStats::quantile( int order, int number )
         THROW( Exception( msg ) );
     }
 
-    if ( ! _sorted )
-        sort();
+    if ( _approximate )
+        return _sketch.quantile( (double) number / order );
+
+    bool between;
+    int  pos = quantilePos( order, number, between );
+
+    FileSize result = valueAt( pos );
+
+    if ( between )
+    {
+        // Same as in median: We hit between two elements, so use the average
+        // between them.
+
+        result = ( result + valueAt( pos - 1 ) ) / 2;
+    }
+
+    return result;
+}
+
+
+int FileSizeStats::quantilePos( int order, int number, bool & between ) const
+{
+    between = false;
 
     if ( number == 0 )
-        return _data.first();
+        return 0;
 
     if ( number == order )
-        return _data.last();
+        return _data.size() - 1;
 
-    int pos = ( _data.size() * number ) / order;
+    qint64 product = (qint64) _data.size() * number;
 
     // Same as in median(): The integer division already cut off any non-zero
     // decimal place, so don't subtract 1 to compensate for starting _data with
     // index 0.
 
-    FileSize result = _data.at( pos );
+    between = product % order == 0;
 
-    if ( ( _data.size() * number ) % order == 0 )
+    return product / order;
+}
+
+
+FileSize FileSizeStats::valueAt( int rank )
+{
+    if ( _sorted )
+        return _data.at( rank );
+
+    // Each rank in _selected already has its final value, and everything
+    // before it is less or equal, everything after it greater or equal.
+    // So only the range between the selected ranks next to 'rank' needs to
+    // be partitioned.
+
+    QVector<int>::iterator it = std::lower_bound( _selected.begin(), _selected.end(), rank );
+
+    if ( it == _selected.end() || *it != rank )
     {
-        // Same as in median: We hit between two elements, so use the average
-        // between them.
+        int begin = it == _selected.begin() ? 0            : *( it - 1 ) + 1;
+        int end   = it == _selected.end()   ? _data.size() : *it;
 
-        result = ( result + _data.at( pos - 1 ) ) / 2;
+        std::nth_element( _data.begin() + begin,
+                          _data.begin() + rank,
+                          _data.begin() + end );
+        _selected.insert( it, rank );
     }
 
-    return result;
+    return _data.at( rank );
+}
+
+
+void FileSizeStats::selectRanks( const QVector<int> & ranks, int from, int to )
+{
+    // Start in the middle so each selection halves the ranges for the
+    // others: O( n * log( ranks ) ) rather than O( n * ranks ).
+
+    if ( from >= to )
+        return;
+
+    int middle = ( from + to ) / 2;
+    valueAt( ranks.at( middle ) );
+
+    selectRanks( ranks, from, middle );
+    selectRanks( ranks, middle + 1, to );
+}
+
+
+void FileSizeStats::selectQuantiles( int order )
+{
+    if ( _sorted || _data.isEmpty() )
+        return;
+
+    QVector<int> ranks;
+    ranks.reserve( 2 * order + 2 );
+
+    for ( int i=0; i <= order; ++i )
+    {
+        bool between;
+        int  pos = quantilePos( order, i, between );
+
+        if ( between )
+            ranks << pos - 1;
+
+        ranks << pos;
+    }
+
+    // The ranks are ascending already, but there might be duplicates
+
+    ranks.erase( std::unique( ranks.begin(), ranks.end() ), ranks.end() );
+    selectRanks( ranks, 0, ranks.size() );
 }
 
 
@@ -270,19 +451,40 @@ QRealList FileSizeStats::fillBuckets( int bucketCount,
     if ( bucketCount < 1 )
         THROW( Exception( QString( "Invalid bucket count %1" ).arg( bucketCount ) ) );
 
+    // The percentiles are 0..100 and bucketCount is at most MAX_BUCKET_COUNT
+    // in the histogram, so this is unique for any sane parameters.
+
+    quint32 cacheKey = ( (quint32) bucketCount << 16 ) |
+        ( startPercentile << 8 ) | endPercentile;
+
+    if ( _bucketCache.contains( cacheKey ) )
+        return _bucketCache.value( cacheKey );
+
+    QRealList buckets = calcBuckets( bucketCount, startPercentile, endPercentile );
+    _bucketCache.insert( cacheKey, buckets );
+
+    return buckets;
+}
+
+
+QRealList FileSizeStats::calcBuckets( int bucketCount,
+                                      int startPercentile,
+                                      int endPercentile )
+{
     QRealList buckets;
     buckets.reserve( bucketCount );
 
     for ( int i=0; i < bucketCount; ++i )
         buckets << 0;
 
-    if ( _data.isEmpty() )
+    if ( dataSize() == 0 )
         return buckets;
 
 
-    // The first call to percentile() or quantile() will cause the data to be
-    // sorted, so there is no need to sort them again here.
+    // This only needs the values of the two percentiles; the data are not
+    // sorted.
 
+    selectQuantiles( 100 );
     qreal startVal = percentile( startPercentile );
     qreal endVal   = percentile( endPercentile );
     qreal bucketWidth = ( endVal - startVal ) / bucketCount;
@@ -296,20 +498,40 @@ QRealList FileSizeStats::fillBuckets( int bucketCount,
                << endl;
 #endif
 
+    if ( _approximate )
+    {
+        // Each bin of the sketch goes to the bucket of its value as a
+        // whole.
+
+        for ( int bin=0; bin < _sketch.binCount(); ++bin )
+        {
+            if ( _sketch.binItems( bin ) == 0 )
+                continue;
+
+            qreal val = _sketch.binValue( bin );
+
+            if ( val < startVal )
+                continue;
+
+            if ( val > endVal )
+                break;
+
+            int index = bucketWidth > 0.0 ?
+                qMin( ( val - startVal ) / bucketWidth, bucketCount - 1.0 ) : 0;
+
+            buckets[ index ] += _sketch.binItems( bin );
+        }
+
+        return buckets;
+    }
+
     for ( int i=0; i < _data.size(); ++i )
     {
         qreal val = _data.at( i );
 
-        if ( val < startVal )
+        if ( val < startVal || val > endVal )
             continue;
 
-        if ( val > endVal )
-            break;
-
-        // TO DO: Optimize this by taking into account that the data are sorted
-        // already. We don't really need that many divisions; just when leaving
-        // the current bucket would be sufficient.
-
         int index = qMin( ( val - startVal ) / bucketWidth, bucketCount - 1.0 );
         ++buckets[ index ];
     }
@@ -322,6 +544,7 @@ QRealList FileSizeStats::percentileList()
 {
     QRealList percentiles;
     percentiles.reserve( 100 );
+    selectQuantiles( 100 );
 
     for ( int i=0; i <= 100; ++i )
         percentiles << percentile( i );
@@ -338,11 +561,64 @@ QRealList FileSizeStats::percentileSums()
     for ( int i=0; i <= 100; ++i )
         sums << 0.0;
 
-    if ( ! _sorted )
-        sort();
+    if ( _approximate )
+    {
+        // The files of each bin take up a range of ranks. Split the sum of
+        // the bin among the percentiles of those ranks.
+
+        qreal percentileSize = _sketch.count() / 100.0;
+        qreal rank           = 0.0;
+        int   percentile     = 1;
+
+        for ( int bin=0; bin < _sketch.binCount() && percentileSize > 0.0; ++bin )
+        {
+            int items = _sketch.binItems( bin );
+
+            if ( items == 0 )
+                continue;
+
+            qreal binEnd  = rank + items;
+            qreal average = (qreal) _sketch.binSum( bin ) / items;
+
+            while ( rank < binEnd )
+            {
+                qreal percentileEnd = percentile < 100 ?
+                    qMin( percentile * percentileSize, binEnd ) : binEnd;
+
+                sums[ percentile ] += ( percentileEnd - rank ) * average;
+                rank = percentileEnd;
+
+                if ( percentile < 100 && rank >= percentile * percentileSize )
+                    ++percentile;
+            }
+        }
+
+        return sums;
+    }
 
     qreal percentileSize = _data.size() / 100.0;
 
+    if ( ! _sorted )
+    {
+        // Each sum only needs the right data in its range of ranks, not in
+        // any order: Select the last rank of each percentile.
+
+        QVector<int> lastRanks;
+        int lastPercentile = 1;
+
+        for ( int i=0; i < _data.size(); ++i )
+        {
+            int percentile = qMax( 1, (int) ceil( i / percentileSize ) );
+
+            if ( percentile != lastPercentile )
+                lastRanks << i - 1;
+
+            lastPercentile = percentile;
+        }
+
+        selectRanks( lastRanks, 0, lastRanks.size() );
+    }
+
     for ( int i=0; i < _data.size(); ++i )
     {
         int percentile = qMax( 1, (int) ceil( i / percentileSize ) );
@@ -357,3 +633,288 @@ QRealList FileSizeStats::percentileSums()
 
     return sums;
 }
+
+
+
+FileSizeStatsCollector::FileSizeStatsCollector( QObject * parent ):
+    QObject( parent ),
+    _stats( 0 ),
+    _ageStats( 0 ),
+    _tree( 0 )
+{
+
+}
+
+
+FileSizeStatsCollector::~FileSizeStatsCollector()
+{
+    cancel();
+    _threadPool.waitForDone();
+}
+
+
+void FileSizeStatsCollector::start( FileInfo *      subtree,
+                                    const QString & suffix,
+                                    FileSizeStats * stats,
+                                    FileAgeStats *  ageStats )
+{
+    cancel();
+    _stats    = stats;
+    _ageStats = ageStats;
+
+    if ( ! subtree )
+    {
+        emit finished();
+        return;
+    }
+
+    subtree->tree()->thaw( subtree );
+
+    // Find the number of files for each direct child. This might
+    // recalculate the sums in the tree, so it has to be done here in the
+    // main thread.
+
+    typedef QPair<int, FileInfo *> Unit;
+    QList<Unit> units;
+
+    if ( subtree->isFile() )
+    {
+        units << Unit( 1, subtree );
+    }
+    else
+    {
+        FileInfoIterator it( subtree );
+
+        while ( *it )
+        {
+            FileInfo * item = *it;
+            int files = item->hasChildren() ? item->totalFiles() : 1;
+
+            units << Unit( files, item );
+            ++it;
+        }
+    }
+
+    int partCount = qMin( _threadPool.maxThreadCount(), units.size() );
+
+    if ( partCount < 1 )
+    {
+        emit finished();
+        return;
+    }
+
+    QList<FileSizeStatsPart *> parts;
+
+    for ( int i=0; i < partCount; ++i )
+    {
+        FileSizeStatsPart * part = new FileSizeStatsPart( this, suffix, stats, ageStats );
+        CHECK_NEW( part );
+        parts << part;
+    }
+
+    // Largest first, always to the part with the fewest files so far:
+    // This keeps the parts well balanced even if one child is much larger
+    // than the others.
+
+    std::sort( units.begin(), units.end() );
+
+    for ( int i = units.size() - 1; i >= 0; --i )
+    {
+        FileSizeStatsPart * smallest = parts.first();
+
+        foreach ( FileSizeStatsPart * part, parts )
+        {
+            if ( part->totalFiles() < smallest->totalFiles() )
+                smallest = part;
+        }
+
+        smallest->addSubtree( units.at( i ).second, units.at( i ).first );
+    }
+
+    _tree = subtree->tree();
+
+    if ( _tree )
+    {
+        connect( _tree, SIGNAL( clearing()                   ),
+                 this,  SLOT  ( treeChanging()               ) );
+
+        connect( _tree, SIGNAL( clearingSubtree( DirInfo * ) ),
+                 this,  SLOT  ( treeChanging()               ) );
+
+        connect( _tree, SIGNAL( deletingChild  ( FileInfo * ) ),
+                 this,  SLOT  ( treeChanging()                ) );
+
+        connect( _tree, SIGNAL( startingReading()            ),
+                 this,  SLOT  ( treeChanging()               ) );
+    }
+
+    foreach ( FileSizeStatsPart * part, parts )
+    {
+        connect( part, SIGNAL( done()     ),
+                 this, SLOT  ( partDone() ),
+                 Qt::QueuedConnection );
+
+        _pendingParts << part;
+
+        FileSizeStatsWorker * worker = new FileSizeStatsWorker( part );
+        CHECK_NEW( worker );
+        _threadPool.start( worker );    // The thread pool takes ownership
+    }
+}
+
+
+void FileSizeStatsCollector::cancel()
+{
+    // The parts are deleted when their done() signal arrives.
+
+    foreach ( FileSizeStatsPart * part, _pendingParts )
+        part->cancel();
+
+    _pendingParts.clear();
+    disconnectTree();
+}
+
+
+void FileSizeStatsCollector::disconnectTree()
+{
+    if ( _tree )
+        disconnect( _tree, 0, this, 0 );
+
+    _tree = 0;
+}
+
+
+void FileSizeStatsCollector::partDone()
+{
+    FileSizeStatsPart * part = qobject_cast<FileSizeStatsPart *>( sender() );
+
+    if ( ! part )
+        return;
+
+    part->deleteLater();
+
+    if ( ! _pendingParts.removeOne( part ) ) // Canceled
+        return;
+
+    if ( _stats )
+        _stats->merge( *part->stats() );
+
+    if ( _ageStats )
+        _ageStats->merge( *part->ageStats() );
+
+    if ( _pendingParts.isEmpty() )
+    {
+        disconnectTree();
+        emit finished();
+    }
+}
+
+
+void FileSizeStatsCollector::treeChanging()
+{
+    if ( ! isBusy() )
+        return;
+
+    logInfo() << "The tree is changing; canceling the file size statistics" << endl;
+
+    cancel();
+
+    // The workers must not see any part of the change
+
+    _threadPool.waitForDone();
+    emit canceled();
+}
+
+
+
+
+FileSizeStatsPart::FileSizeStatsPart( FileSizeStatsCollector * parent,
+                                      const QString &          suffix,
+                                      const FileSizeStats *    stats,
+                                      const FileAgeStats *     ageStats ):
+    QObject( parent ),
+    _suffix( suffix ),
+    _totalFiles( 0 ),
+    _stats( 0 ),
+    _ageStats( 0 ),
+    _canceled( 0 )
+{
+    if ( stats )
+    {
+        _stats = new FileSizeStats();
+        CHECK_NEW( _stats );
+        _stats->setApproximate( stats->isApproximate() );
+    }
+
+    if ( ageStats )
+    {
+        _ageStats = new FileAgeStats( ageStats->now() );
+        CHECK_NEW( _ageStats );
+    }
+}
+
+
+FileSizeStatsPart::~FileSizeStatsPart()
+{
+    delete _stats;
+    delete _ageStats;
+}
+
+
+void FileSizeStatsPart::addSubtree( FileInfo * subtree, int totalFiles )
+{
+    _subtrees << subtree;
+    _totalFiles += totalFiles;
+
+    if ( _stats )
+        _stats->reserve( totalFiles );
+}
+
+
+bool FileSizeStatsPart::isCanceled() const
+{
+#if (QT_VERSION < QT_VERSION_CHECK( 5, 0, 0 ))
+    return (int) _canceled != 0;
+#else
+    return _canceled.load() != 0;
+#endif
+}
+
+
+void FileSizeStatsPart::collect()
+{
+    foreach ( FileInfo * subtree, _subtrees )
+    {
+        if ( isCanceled() )
+            return;
+
+        if ( _suffix.isEmpty() )
+        {
+            if ( _stats )
+                _stats->collectFiles( subtree );
+
+            if ( _ageStats )
+                _ageStats->collect( subtree );
+        }
+        else
+        {
+            if ( _stats )
+                _stats->collectFiles( subtree, _suffix );
+
+            if ( _ageStats )
+                _ageStats->collect( subtree, _suffix );
+        }
+    }
+}
+
+
+
+
+void FileSizeStatsWorker::run()
+{
+    _part->collect();
+    _part->sendDone();
+
+    // Don't touch _part after this: It is deleted in the main thread
+    // when the done() signal arrives.
+}
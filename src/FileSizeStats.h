@@ -10,13 +10,24 @@
 #ifndef FileSizeStats_h
 #define FileSizeStats_h
 
+#include <QObject>
+#include <QList>
+#include <QHash>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QAtomicInt>
+
 #include "FileInfo.h"
+#include "NodePool.h"
+#include "FileSizeSketch.h"
 #include "HistogramView.h"
 
 
 namespace QDirStat
 {
     class DirTree;
+    class FileAgeStats;
+    class FileSizeStatsPart;
     typedef QList<FileSize> FileSizeList;
 
     /**
@@ -27,9 +38,14 @@ namespace QDirStat
      *
      * Notice that one data item (one FileSize, i.e. one 64 bit long long) is
      * stored for each file (or each matching file) in this object, so this is
-     * expensive in terms of memory usage. Also, since data usually need to be
-     * sorted for those calculations and sorting has at least logarithmic cost
-     * O( n * log(n) ), this also has heavy performance impact.
+     * expensive in terms of memory usage. The data are not sorted, though:
+     * Each quantile is found by partial selection (std::nth_element) between
+     * the ones that were already found, so all percentiles together cost
+     * O( n * log(100) ) rather than O( n * log(n) ) for a full sort.
+     *
+     * For very large trees, there is an approximate mode: The file sizes
+     * are only added to a FileSizeSketch with bounded memory, and all
+     * quantiles have a small relative error.
      **/
     class FileSizeStats
     {
@@ -45,6 +61,24 @@ namespace QDirStat
 	 **/
 	void clear();
 
+	/**
+	 * Set approximate mode. This has to be done before any collect()
+	 * call. Exact mode is the default.
+	 **/
+	void setApproximate( bool approximate )
+	    { _approximate = approximate; _bucketCache.clear(); }
+
+	/**
+	 * Return 'true' if the data are collected in a FileSizeSketch
+	 * rather than one by one.
+	 **/
+	bool isApproximate() const { return _approximate; }
+
+	/**
+	 * Return the sketch for approximate mode.
+	 **/
+	const FileSizeSketch & sketch() const { return _sketch; }
+
 	/**
 	 * Recurse through all file elements in the tree and append the own
 	 * size for each file to the data collection. Notice that the data are
@@ -77,10 +111,47 @@ namespace QDirStat
 	 **/
 	void collect( FileInfo * subtree, const QString & suffix );
 
+	/**
+	 * Like collect( subtree ), but without reserving any memory first.
+	 *
+	 * This only reads the FileInfo items of the subtree; unlike
+	 * FileInfo::totalFiles(), which collect() uses, it never triggers any
+	 * recalculation in the tree. So this can be used in a worker thread
+	 * as long as the tree does not change meanwhile.
+	 **/
+	void collectFiles( FileInfo * subtree );
+
+	/**
+	 * Like collect( subtree, suffix ), but without reserving any memory
+	 * first. See collectFiles( subtree ).
+	 **/
+	void collectFiles( FileInfo * subtree, const QString & suffix );
+
+	/**
+	 * Reserve memory for 'size' more data items. This does nothing in
+	 * approximate mode.
+	 **/
+	void reserve( int size );
+
+	/**
+	 * Add all data collected by 'other'. Both have to be in the same
+	 * (exact or approximate) mode.
+	 **/
+	void merge( const FileSizeStats & other );
+
+	/**
+	 * Add all file sizes of 'sketch', e.g. the ones that were collected
+	 * while reading (see PrecomputedStats). This has to be in
+	 * approximate mode.
+	 **/
+	void merge( const FileSizeSketch & sketch );
+
 	/**
 	 * Sort the collected data in ascending order.
-	 * This is necessary after all collect() calls.
-	 * The
+	 *
+	 * This is not necessary for any of the calculation functions; they
+	 * only partially sort what they need. But it is useful if all data
+	 * are needed in order.
 	 **/
 	void sort();
 
@@ -88,16 +159,18 @@ namespace QDirStat
          * Return the size of the collected data, i.e. the number of data
          * points.
          **/
-        int dataSize() const { return _data.size(); }
+        int dataSize() const
+	    { return _approximate ? _sketch.count() : _data.size(); }
 
 	/**
-	 * Return a reference to the collected data.
+	 * Return a reference to the collected data. This is empty in
+	 * approximate mode.
 	 **/
 	FileSizeList & data() { return _data; }
 
 
-	// All calculation functions below will sort the internal data first if
-	// they are not sorted yet. This is why they are not const.
+	// All calculation functions below will partially sort the internal
+	// data. This is why they are not const.
 
 	/**
 	 * Calculate the median.
@@ -146,6 +219,11 @@ namespace QDirStat
         /**
          * Fill buckets for a histogram from 'startPercentile' to
          * 'endPercentile'.
+         *
+         * The result is cached for each combination of the parameters until
+         * the data change, so going back and forth between different
+         * percentiles in the histogram doesn't go through all the data
+         * again each time.
          **/
         QRealList fillBuckets( int bucketCount,
                                int startPercentile,
@@ -165,10 +243,296 @@ namespace QDirStat
 
     protected:
 
-	FileSizeList _data;
-	bool	     _sorted;
+	/**
+	 * Fill the buckets for fillBuckets() without using the cache.
+	 **/
+	QRealList calcBuckets( int bucketCount,
+			       int startPercentile,
+			       int endPercentile );
+
+	/**
+	 * Return the value at 'rank' of the data in ascending order. This
+	 * partially sorts the data just enough to find it.
+	 **/
+	FileSize valueAt( int rank );
+
+	/**
+	 * Find the values of ranks no. 'from' to 'to' (excluding) of 'ranks'
+	 * (in ascending order) with valueAt().
+	 **/
+	void selectRanks( const QVector<int> & ranks, int from, int to );
+
+	/**
+	 * Find the values for all quantiles of 'order' in one go. This is
+	 * much faster than finding them one by one.
+	 **/
+	void selectQuantiles( int order );
+
+	/**
+	 * Return the rank of quantile no. 'number' of 'order'. If the
+	 * quantile is between two ranks (then it is the average of their
+	 * values), 'between' is set to 'true', and this returns the upper
+	 * one.
+	 **/
+	int quantilePos( int order, int number, bool & between ) const;
+
+	/**
+	 * Add one file size to the data collection.
+	 **/
+	void add( FileSize size )
+	{
+	    if ( ! _bucketCache.isEmpty() )
+		_bucketCache.clear();
+
+	    if ( _approximate )
+		_sketch.add( size );
+	    else
+	    {
+		_data << size;
+
+		if ( _sorted || ! _selected.isEmpty() )
+		{
+		    // Anything found so far is not in its place anymore
+
+		    _sorted = false;
+		    _selected.clear();
+		}
+	    }
+	}
+
+	FileSizeList	_data;
+	QVector<int>	_selected;	// Ranks that valueAt() already found
+	bool		_sorted;
+	bool		_approximate;
+	FileSizeSketch	_sketch;
+
+	QHash<quint32, QRealList> _bucketCache;	 // See fillBuckets()
     };
 
+
+    /**
+     * Class to collect FileSizeStats (and / or FileAgeStats) in the
+     * background.
+     *
+     * The direct children of the subtree are distributed over a number of
+     * FileSizeStatsPart objects with about the same number of files each,
+     * and each part collects the file sizes of its children into a
+     * FileSizeStats (and / or FileAgeStats) of its own in a thread pool.
+     * When all of them are done, they are merged into the target stats in
+     * the main thread, and finished() is emitted.
+     *
+     * The worker threads read the tree, so it must not change while they
+     * run: If the DirTree announces any change, the collection is canceled
+     * (and canceled() is emitted) before the change takes place.
+     **/
+    class FileSizeStatsCollector: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	FileSizeStatsCollector( QObject * parent = 0 );
+
+	/**
+	 * Destructor. This waits for the worker threads to stop.
+	 **/
+	virtual ~FileSizeStatsCollector();
+
+	/**
+	 * Start collecting the sizes of all files in 'subtree' (of all files
+	 * with 'suffix' if that is non-empty) into 'stats' and their ages
+	 * into 'ageStats'. Either one may be 0. 'stats' has to be set to its
+	 * mode (exact or approximate) already. Both have to live until
+	 * finished() or canceled() is emitted. Any collection that is still
+	 * running is canceled.
+	 **/
+	void start( FileInfo *	    subtree,
+		    const QString & suffix,
+		    FileSizeStats * stats,
+		    FileAgeStats *  ageStats = 0 );
+
+	/**
+	 * Return 'true' if the collection is still running.
+	 **/
+	bool isBusy() const { return ! _pendingParts.isEmpty(); }
+
+    public slots:
+
+	/**
+	 * Cancel the collection. This does not emit canceled().
+	 **/
+	void cancel();
+
+    signals:
+
+	/**
+	 * Emitted when all file sizes are collected into the target
+	 * FileSizeStats.
+	 **/
+	void finished();
+
+	/**
+	 * Emitted when the collection had to be canceled because the tree
+	 * changed.
+	 **/
+	void canceled();
+
+    protected slots:
+
+	/**
+	 * Merge the result of a part. This is connected to the done() signal
+	 * of each FileSizeStatsPart.
+	 **/
+	void partDone();
+
+	/**
+	 * Cancel the collection and wait for the worker threads because the
+	 * tree is about to change.
+	 **/
+	void treeChanging();
+
+    protected:
+
+	/**
+	 * Disconnect from the tree's signals.
+	 **/
+	void disconnectTree();
+
+
+	// Data members
+
+	QThreadPool			_threadPool;
+	QList<FileSizeStatsPart *>	_pendingParts;
+	FileSizeStats *			_stats;
+	FileAgeStats *			_ageStats;
+	DirTree *			_tree;
+
+    };	// class FileSizeStatsCollector
+
+
+    /**
+     * Part of the file sizes for a FileSizeStatsCollector: The file sizes
+     * of a number of subtrees that are collected together in one worker
+     * thread.
+     **/
+    class FileSizeStatsPart: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor. This collects the file sizes if 'stats' is non-null
+	 * (in the same mode) and the file ages if 'ageStats' is non-null
+	 * (relative to the same time).
+	 **/
+	FileSizeStatsPart( FileSizeStatsCollector * parent,
+			   const QString &	    suffix,
+			   const FileSizeStats *    stats,
+			   const FileAgeStats *	    ageStats );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~FileSizeStatsPart();
+
+	/**
+	 * Add a subtree (or a single file). 'totalFiles' is the number of
+	 * its files for reserving memory. This has to be called in the main
+	 * thread before the worker starts.
+	 **/
+	void addSubtree( FileInfo * subtree, int totalFiles );
+
+	/**
+	 * Return the total number of files of all subtrees.
+	 **/
+	int totalFiles() const { return _totalFiles; }
+
+	/**
+	 * Cancel this part: collect() will do nothing or stop early.
+	 **/
+	void cancel() { _canceled.ref(); }
+
+	/**
+	 * Return 'true' if this part was canceled.
+	 **/
+	bool isCanceled() const;
+
+	/**
+	 * Collect the file sizes of all subtrees. This is called in the
+	 * worker thread.
+	 **/
+	void collect();
+
+	/**
+	 * Emit the done() signal. This is called in the worker thread.
+	 **/
+	void sendDone() { emit done(); }
+
+	/**
+	 * Return the collected file sizes or 0 if they are not collected.
+	 **/
+	const FileSizeStats * stats() const { return _stats; }
+
+	/**
+	 * Return the collected file ages or 0 if they are not collected.
+	 **/
+	const FileAgeStats * ageStats() const { return _ageStats; }
+
+    signals:
+
+	/**
+	 * Emitted when collect() is finished or canceled.
+	 **/
+	void done();
+
+    protected:
+
+	QString			_suffix;
+	QList<FileInfo *>	_subtrees;
+	int			_totalFiles;
+	FileSizeStats *		_stats;
+	FileAgeStats *		_ageStats;
+	QAtomicInt		_canceled;
+
+    };	// class FileSizeStatsPart
+
+
+    /**
+     * Runnable for a QThreadPool that processes a FileSizeStatsPart.
+     *
+     * The thread pool takes ownership of this object and deletes it when
+     * it is done; the part is owned by the FileSizeStatsCollector.
+     **/
+    class FileSizeStatsWorker: public QRunnable
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	FileSizeStatsWorker( FileSizeStatsPart * part ):
+	    QRunnable(),
+	    _part( part )
+	    { setAutoDelete( true ); }
+
+	/**
+	 * Do the work. This is called in a worker thread.
+	 *
+	 * Reimplemented from QRunnable.
+	 **/
+	virtual void run() Q_DECL_OVERRIDE;
+
+    protected:
+
+	FileSizeStatsPart * _part;
+	NodePin		    _pin;	// Keep deleted nodes until this is done
+
+    };	// class FileSizeStatsWorker
+
 }	// namespace QDirStat
 
 
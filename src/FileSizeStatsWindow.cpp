@@ -19,6 +19,7 @@
 #include "BucketsTableModel.h"
 #include "DirTree.h"
 #include "MainWindow.h"
+#include "Settings.h"
 #include "SettingsHelpers.h"
 #include "HeaderTweaker.h"
 #include "Logger.h"
@@ -34,7 +35,9 @@ FileSizeStatsWindow::FileSizeStatsWindow( QWidget * parent ):
     _ui( new Ui::FileSizeStatsWindow ),
     _subtree( 0 ),
     _suffix( "" ),
-    _stats( 0 )
+    _stats( 0 ),
+    _collector( 0 ),
+    _approximateFromFiles( 0 )
 {
     // logDebug() << "init" << endl;
 
@@ -42,10 +45,20 @@ FileSizeStatsWindow::FileSizeStatsWindow( QWidget * parent ):
     _ui->setupUi( this );
     initWidgets();
     readWindowSettings( this, "FileSizeStatsWindow" );
+    readSettings();
 
     _stats = new FileSizeStats();
     CHECK_NEW( _stats );
 
+    _collector = new FileSizeStatsCollector( this );
+    CHECK_NEW( _collector );
+
+    connect( _collector, SIGNAL( finished()	),
+	     this,	 SLOT  ( calcFinished() ) );
+
+    connect( _collector, SIGNAL( canceled()	),
+	     this,	 SLOT  ( calcCanceled() ) );
+
     _bucketsTableModel = new BucketsTableModel( this, _ui->histogramView );
     CHECK_NEW( _bucketsTableModel );
 
@@ -64,7 +77,32 @@ FileSizeStatsWindow::FileSizeStatsWindow( QWidget * parent ):
 FileSizeStatsWindow::~FileSizeStatsWindow()
 {
     // logDebug() << "destroying" << endl;
+    _collector->cancel();
     writeWindowSettings( this, "FileSizeStatsWindow" );
+    writeSettings();
+}
+
+
+void FileSizeStatsWindow::readSettings()
+{
+    Settings settings;
+    settings.beginGroup( "FileSizeStatsWindow" );
+
+    // 0 means always exact
+    _approximateFromFiles = settings.value( "ApproximateFromFiles", 5000000 ).toInt();
+
+    settings.endGroup();
+}
+
+
+void FileSizeStatsWindow::writeSettings()
+{
+    Settings settings;
+    settings.beginGroup( "FileSizeStatsWindow" );
+
+    settings.setValue( "ApproximateFromFiles", _approximateFromFiles );
+
+    settings.endGroup();
 }
 
 
@@ -96,6 +134,7 @@ FileSizeStatsWindow * FileSizeStatsWindow::sharedInstance()
 
 void FileSizeStatsWindow::clear()
 {
+    _collector->cancel();
     _stats->clear();
 }
 
@@ -134,12 +173,28 @@ void FileSizeStatsWindow::calc()
 {
     _stats->clear();
 
-    if ( _suffix.isEmpty() )
-	_stats->collect( _subtree );
-    else
-	_stats->collect( _subtree, _suffix );
+    // Above this, the memory for the exact data and the time for sorting
+    // them are not worth it.
+
+    _stats->setApproximate( _approximateFromFiles > 0 &&
+			    _subtree->totalFiles() >= _approximateFromFiles );
+
+    // If the sizes were already collected while reading, there is no need
+    // to go through the tree again.
+
+    const PrecomputedStats * precomputed = 0;
+
+    if ( _stats->isApproximate() && _suffix.isEmpty() )
+	precomputed = _subtree->tree()->precomputedStats( _subtree );
+
+    if ( precomputed )
+    {
+	_stats->merge( precomputed->sizeSketch() );
+	calcFinished();
+	return;
+    }
 
-    _stats->sort();
+    _collector->start( _subtree, _suffix, _stats );
 }
 
 
@@ -171,19 +226,59 @@ void FileSizeStatsWindow::populate( FileInfo * subtree, const QString & suffix )
 	url = subtree->tree()->url();
 
     if ( _suffix.isEmpty() )
-	_ui->heading->setText( tr( "File Size Statistics for %1" ).arg( url ) );
+	_heading = tr( "File Size Statistics for %1" ).arg( url );
     else
-	_ui->heading->setText( tr( "File Size Statistics for %1 in %2" )
-			       .arg( suffix ).arg( url ) );
+	_heading = tr( "File Size Statistics for %1 in %2" ).arg( suffix ).arg( url );
+
+    // Don't show any old data while collecting the new ones
+
+    _ui->heading->setText( tr( "%1 (calculating...)" ).arg( _heading ) );
+    _ui->heading->setToolTip( QString() );
+    _ui->tabWidget->setEnabled( false );
+    _ui->histogramView->clear();
+    _ui->percentileTable->clear();
+    _ui->percentileTable->setRowCount( 0 );
+    fillBucketsTable();
+
     calc();
+}
+
+
+void FileSizeStatsWindow::calcFinished()
+{
+    QString heading = _heading;
+
+    if ( _stats->isApproximate() )
+    {
+	heading = tr( "%1 (approximate)" ).arg( heading );
+	_ui->heading->setToolTip( tr( "For %1 files or more, the quantiles are only accurate to %2%." )
+				  .arg( _approximateFromFiles )
+				  .arg( 100.0 * _stats->sketch().relativeAccuracy() ) );
+    }
+    else
+    {
+	_ui->heading->setToolTip( QString() );
+    }
+
+    _ui->heading->setText( heading );
+    _ui->tabWidget->setEnabled( true );
 
     fillHistogram();
     fillPercentileTable();
 }
 
 
+void FileSizeStatsWindow::calcCanceled()
+{
+    _ui->heading->setText( tr( "%1 (canceled: the tree changed)" ).arg( _heading ) );
+}
+
+
 void FileSizeStatsWindow::fillPercentileTable()
 {
+    if ( _collector->isBusy() )
+	return;
+
     int step = _ui->percentileFilterComboBox->currentIndex() == 0 ? 5 : 1;
     fillQuantileTable( _ui->percentileTable, 100, "P",
 		       _stats->percentileSums(),
@@ -442,6 +537,9 @@ void FileSizeStatsWindow::toggleOptions()
 
 void FileSizeStatsWindow::applyOptions()
 {
+    if ( _collector->isBusy() )
+	return;
+
     HistogramView * histogram = _ui->histogramView;
 
     int newStart = _ui->startPercentileSlider->value();
@@ -463,6 +561,9 @@ void FileSizeStatsWindow::applyOptions()
 
 void FileSizeStatsWindow::autoPercentiles()
 {
+    if ( _collector->isBusy() )
+	return;
+
     _ui->histogramView->autoStartEndPercentiles();
 
     updateOptions();
@@ -23,12 +23,16 @@ namespace QDirStat
 {
     class DirTree;
     class FileSizeStats;
+    class FileSizeStatsCollector;
     class BucketsTableModel;
 
 
     /**
      * Modeless dialog to display file size statistics:
      * median, min, max, quartiles; histogram; percentiles table.
+     *
+     * The file sizes are collected in the background, so this window
+     * opens right away and is filled when they are all there.
      **/
     class FileSizeStatsWindow: public QDialog
     {
@@ -53,7 +57,8 @@ namespace QDirStat
 	virtual ~FileSizeStatsWindow();
 
         /**
-         * Populate with new content.
+         * Populate with new content. This only starts collecting the file
+         * sizes; the widgets are filled when that is finished.
          **/
 	void populate( FileInfo * subtree, const QString & suffix = "" );
 
@@ -99,6 +104,19 @@ namespace QDirStat
 
     protected slots:
 
+        /**
+         * Fill all widgets with the collected file sizes. This is
+         * connected to the finished() signal of the collector.
+         **/
+        void calcFinished();
+
+        /**
+         * Notify the user that the tree changed while collecting the file
+         * sizes. This is connected to the canceled() signal of the
+         * collector.
+         **/
+        void calcCanceled();
+
         /**
          * Fill the percentiles table depending on the content of the filter
          * combo box in the same tab.
@@ -135,10 +153,20 @@ namespace QDirStat
 	void clear();
 
 	/**
-	 * Calculate the statistics from the tree.
+	 * Start collecting the file sizes from the tree in the background.
 	 **/
 	void calc();
 
+	/**
+	 * Read parameters from the settings file.
+	 **/
+	void readSettings();
+
+	/**
+	 * Write parameters to the settings file.
+	 **/
+	void writeSettings();
+
 	/**
 	 * One-time initialization of the widgets in this window.
 	 **/
@@ -223,7 +251,10 @@ namespace QDirStat
         FileInfo *                  _subtree;
         QString                     _suffix;
 	FileSizeStats *		    _stats;
+	FileSizeStatsCollector *    _collector;
+        QString                     _heading;
         BucketsTableModel *         _bucketsTableModel;
+        int                         _approximateFromFiles;
 
         static QPointer<FileSizeStatsWindow> _sharedInstance;
     };
@@ -7,6 +7,8 @@
  */
 
 
+#include <QThread>
+
 #include "FileTypeStats.h"
 #include "DirTree.h"
 #include "FileInfoIterator.h"
@@ -14,12 +16,17 @@
 #include "Logger.h"
 #include "Exception.h"
 
+// Number of files for one worker
+#define CHUNK_SIZE	16384
+
 using namespace QDirStat;
 
 
 FileTypeStats::FileTypeStats( QObject  * parent ):
     QObject( parent ),
-    _totalSize( 0LL )
+    _totalSize( 0LL ),
+    _currentChunk( 0 ),
+    _chunkCount( 0 )
 {
     _mimeCategorizer = new MimeCategorizer( this );
     CHECK_NEW( _mimeCategorizer );
@@ -31,13 +38,17 @@ FileTypeStats::FileTypeStats( QObject  * parent ):
 
 FileTypeStats::~FileTypeStats()
 {
+    // Don't let any worker use the categorizer after this is gone
+
     clear();
+    _threadPool.waitForDone();
     delete _otherCategory;
 }
 
 
 void FileTypeStats::clear()
 {
+    cancel();
     _suffixSum.clear();
     _suffixCount.clear();
     _categorySum.clear();
@@ -91,15 +102,162 @@ void FileTypeStats::calc( FileInfo * subtree )
 {
     clear();
 
-    if ( subtree && subtree->checkMagicNumber() )
+    if ( ! subtree || ! subtree->checkMagicNumber() )
+    {
+	emit calcFinished();
+	return;
+    }
+
+    if ( takePrecomputed( subtree ) )
+    {
+	finishCalc();
+	return;
+    }
+
+    // The workers only read from the categorizer. If that is not safe
+    // with its patterns, use only one at a time.
+
+    bool concurrent = _mimeCategorizer->prepareConcurrentUse();
+    _threadPool.setMaxThreadCount( concurrent ? QThread::idealThreadCount() : 1 );
+
+    subtree->tree()->thaw( subtree );
+    _totalSize = subtree->totalSize();
+    collect( subtree );
+    startChunk();	// The remaining files
+
+    if ( _pendingChunks.isEmpty() )
+	finishCalc();
+}
+
+
+bool FileTypeStats::takePrecomputed( FileInfo * subtree )
+{
+    DirTree * tree = subtree->tree();
+    const PrecomputedStats * precomputed = tree ? tree->precomputedStats( subtree ) : 0;
+
+    if ( ! precomputed || ! precomputed->hasTypeTotals() || ! tree->mimeCategorizer() )
+	return false;
+
+    // They were categorized with the categorizer of the tree; this only
+    // works if its categories are still the same as when reading.
+
+    if ( precomputed->categoryStamp() != tree->mimeCategorizer()->stamp() )
+	return false;
+
+    QHash<QString, MimeCategory *> categories;
+
+    foreach ( MimeCategory * category, _mimeCategorizer->categories() )
+	categories.insert( category->name(), category );
+
+    QHash<QString, FileTypeTotal>::const_iterator suffixIt = precomputed->suffixTotals().constBegin();
+
+    while ( suffixIt != precomputed->suffixTotals().constEnd() )
     {
-        collect( subtree );
-        _totalSize = subtree->totalSize();
-        removeCruft();
-        removeEmpty();
-        sanityCheck();
+	_suffixSum  [ suffixIt.key() ] += suffixIt.value().sum;
+	_suffixCount[ suffixIt.key() ] += suffixIt.value().count;
+	++suffixIt;
     }
 
+    QHash<QString, FileTypeTotal>::const_iterator categoryIt = precomputed->categoryTotals().constBegin();
+
+    while ( categoryIt != precomputed->categoryTotals().constEnd() )
+    {
+	MimeCategory * category = categories.value( categoryIt.key(), _otherCategory );
+
+	_categorySum  [ category ] += categoryIt.value().sum;
+	_categoryCount[ category ] += categoryIt.value().count;
+	++categoryIt;
+    }
+
+    _totalSize = subtree->totalSize();
+    logDebug() << "Using the statistics from reading for " << subtree << endl;
+
+    return true;
+}
+
+
+void FileTypeStats::startChunk()
+{
+    FileTypeStatsChunk * chunk = _currentChunk;
+    _currentChunk = 0;
+
+    if ( ! chunk )
+	return;
+
+    connect( chunk, SIGNAL( done()	),
+	     this,  SLOT  ( chunkDone() ),
+	     Qt::QueuedConnection );
+
+    _pendingChunks << chunk;
+    ++_chunkCount;
+
+    FileTypeStatsWorker * worker = new FileTypeStatsWorker( chunk );
+    CHECK_NEW( worker );
+    _threadPool.start( worker );	// The thread pool takes ownership
+}
+
+
+void FileTypeStats::cancel()
+{
+    // The chunks are deleted when their done() signal arrives.
+
+    foreach ( FileTypeStatsChunk * chunk, _pendingChunks )
+	chunk->cancel();
+
+    _pendingChunks.clear();
+    _chunkCount = 0;
+
+    delete _currentChunk;
+    _currentChunk = 0;
+}
+
+
+void FileTypeStats::chunkDone()
+{
+    FileTypeStatsChunk * chunk = qobject_cast<FileTypeStatsChunk *>( sender() );
+
+    if ( ! chunk )
+	return;
+
+    chunk->deleteLater();
+
+    if ( ! _pendingChunks.removeOne( chunk ) ) // Canceled
+	return;
+
+    QHash<QString, FileTypeTotal>::const_iterator suffixIt = chunk->suffixTotals().constBegin();
+
+    while ( suffixIt != chunk->suffixTotals().constEnd() )
+    {
+	_suffixSum  [ suffixIt.key() ] += suffixIt.value().sum;
+	_suffixCount[ suffixIt.key() ] += suffixIt.value().count;
+	++suffixIt;
+    }
+
+    QHash<MimeCategory *, FileTypeTotal>::const_iterator categoryIt = chunk->categoryTotals().constBegin();
+
+    while ( categoryIt != chunk->categoryTotals().constEnd() )
+    {
+	MimeCategory * category = categoryIt.key() ? categoryIt.key() : _otherCategory;
+
+	_categorySum  [ category ] += categoryIt.value().sum;
+	_categoryCount[ category ] += categoryIt.value().count;
+	++categoryIt;
+    }
+
+    emit calcProgress( 100 * ( _chunkCount - _pendingChunks.size() ) / _chunkCount );
+
+    if ( _pendingChunks.isEmpty() )
+	finishCalc();
+}
+
+
+void FileTypeStats::finishCalc()
+{
+    _chunkCount = 0;
+    removeCruft();
+    removeEmpty();
+    sanityCheck();
+
     emit calcFinished();
 }
 
@@ -121,54 +279,16 @@ void FileTypeStats::collect( FileInfo * dir )
 	}
 	else if ( item->isFile() )
 	{
-	    QString suffix;
-
-	    // First attempt: Try the MIME categorizer.
-	    //
-	    // If it knows the file's suffix, it can much easier find the
-	    // correct one in case there are multiple to choose from, for
-	    // example ".tar.bz2", not ".bz2" for a bzipped tarball. But on
-	    // Linux systems, having multiple dots in filenames is very common,
-	    // e.g. in .deb or .rpm packages, so the longest possible suffix is
-	    // not always the useful one (because it might contain version
-	    // numbers and all kinds of irrelevant information).
-	    //
-	    // The suffixes the MIME categorizer knows are carefully
-	    // hand-crafted, so if it knows anything about a suffix, it's the
-	    // best choice.
-
-	    MimeCategory * category = _mimeCategorizer->category( item->name(), &suffix );
-
-	    if ( ! category )
-		category = _otherCategory;
-
-	    _categorySum[ category ] += item->size();
-	    ++_categoryCount[ category ];
-
-	    if ( suffix.isEmpty() )
+	    if ( ! _currentChunk )
 	    {
-		if ( item->name().contains( '.' ) && ! item->name().startsWith( '.' ) )
-		{
-		    // Fall back to the last (i.e. the shortest) suffix if the
-		    // MIME categorizer didn't know it: Use section -1 (the
-		    // last one, ignoring any trailing '.' separator).
-		    //
-		    // The downside is that this would not find a ".tar.bz",
-		    // but just the ".bz" for a compressed tarball. But it's
-		    // much better than getting a ".eab7d88df-git.deb" rather
-		    // than a ".deb".
-
-		    suffix = item->name().section( '.', -1 );
-		}
+		_currentChunk = new FileTypeStatsChunk( this, _mimeCategorizer );
+		CHECK_NEW( _currentChunk );
 	    }
 
-	    suffix = suffix.toLower();
-
-	    if ( suffix.isEmpty() )
-		suffix = NO_SUFFIX;
+	    _currentChunk->add( item->name(), item->size() );
 
-	    _suffixSum[ suffix ] += item->size();
-	    ++_suffixCount[ suffix ];
+	    if ( _currentChunk->size() >= CHUNK_SIZE )
+		startChunk();
 	}
 	// Disregard symlinks, block devices and other special files
 
@@ -304,3 +424,88 @@ void FileTypeStats::sanityCheck()
 	       << " (" << QString::number( percentage( missing ), 'f', 2 ) << "%)"
 	       << endl;
 }
+
+
+
+
+FileTypeStatsChunk::FileTypeStatsChunk( FileTypeStats	* parent,
+					MimeCategorizer * categorizer ):
+    QObject( parent ),
+    _mimeCategorizer( categorizer ),
+    _canceled( 0 )
+{
+    _files.reserve( CHUNK_SIZE );
+}
+
+
+void FileTypeStatsChunk::add( const QString & name, FileSize size )
+{
+    File file;
+    file.name = name;
+    file.size = size;
+
+    _files << file;
+}
+
+
+bool FileTypeStatsChunk::isCanceled() const
+{
+#if (QT_VERSION < QT_VERSION_CHECK( 5, 0, 0 ))
+    return (int) _canceled != 0;
+#else
+    return _canceled.load() != 0;
+#endif
+}
+
+
+void FileTypeStatsChunk::collect()
+{
+    for ( int i=0; i < _files.size(); ++i )
+    {
+	if ( i % 1024 == 0 && isCanceled() )
+	    return;
+
+	const File & file = _files.at( i );
+	QString suffix;
+
+	// First attempt: Try the MIME categorizer.
+	//
+	// If it knows the file's suffix, it can much easier find the
+	// correct one in case there are multiple to choose from, for
+	// example ".tar.bz2", not ".bz2" for a bzipped tarball. But on
+	// Linux systems, having multiple dots in filenames is very common,
+	// e.g. in .deb or .rpm packages, so the longest possible suffix is
+	// not always the useful one (because it might contain version
+	// numbers and all kinds of irrelevant information).
+	//
+	// The suffixes the MIME categorizer knows are carefully
+	// hand-crafted, so if it knows anything about a suffix, it's the
+	// best choice.
+
+	MimeCategory * category = _mimeCategorizer->category( file.name, &suffix );
+
+	FileTypeTotal & categoryTotal = _categoryTotals[ category ];
+	categoryTotal.sum += file.size;
+	++categoryTotal.count;
+
+	suffix = PrecomputedStats::typeSuffix( file.name, suffix );
+
+	FileTypeTotal & suffixTotal = _suffixTotals[ suffix ];
+	suffixTotal.sum += file.size;
+	++suffixTotal.count;
+    }
+
+    // The names are not needed anymore
+
+    _files = QVector<File>();
+}
+
+
+void FileTypeStatsWorker::run()
+{
+    _chunk->collect();
+    _chunk->sendDone();
+
+    // Don't touch _chunk after this: It is deleted in the main thread
+    // when the done() signal arrives.
+}
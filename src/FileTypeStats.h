@@ -12,11 +12,17 @@
 
 #include <QObject>
 #include <QMap>
+#include <QHash>
+#include <QVector>
+#include <QList>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QAtomicInt>
 
 #include "ui_file-type-stats-window.h"
 #include "DirInfo.h"
-
-#define NO_SUFFIX "//<No Suffix>" // A slash is illegal in Linux/Unix filenames
+#include "NodePool.h"
+#include "PrecomputedStats.h"	// NO_SUFFIX
 
 
 namespace QDirStat
@@ -24,6 +30,7 @@ namespace QDirStat
     class DirTree;
     class MimeCategorizer;
     class MimeCategory;
+    class FileTypeStatsChunk;
 
     typedef QMap<QString, FileSize>		StringFileSizeMap;
     typedef QMap<QString, int>			StringIntMap;
@@ -38,6 +45,11 @@ namespace QDirStat
      * Class to calculate file type statistics for a subtree, such as how much
      * disk space is used for each kind of filename extension (*.jpg, *.mp4
      * etc.).
+     *
+     * The calculation runs in the background: The names and sizes of all
+     * files are collected in chunks in the main thread, and each chunk is
+     * categorized in a thread pool into hashes of its own. The main thread
+     * merges the chunks into the maps of this class as they arrive.
      **/
     class FileTypeStats: public QObject
     {
@@ -58,27 +70,46 @@ namespace QDirStat
     public slots:
 
         /**
-         * Calculate the statistics from a new subtree.
+         * Calculate the statistics from a new subtree. This starts the
+         * calculation in the background; calcFinished() is emitted when it
+         * is done. Any calculation that is still running is canceled.
          **/
 	void calc( FileInfo * subtree );
 
 	/**
-	 * Clear all data.
+	 * Clear all data and cancel any running calculation.
 	 **/
 	void clear();
 
     signals:
 
 	/**
-	 * Emitted when the calculation is finished. This is useful when the
-	 * calc() slot is connected to some outside signal to recalculate the
-	 * contents. calc() itself is synchronous, i.e. it only returns when
-	 * the calculation is finished.
+	 * Emitted when the calculation is finished. Until then, the maps of
+	 * this object are incomplete.
 	 **/
 	void calcFinished() const;
 
+	/**
+	 * Emitted during the calculation with the percentage of the files
+	 * that are done.
+	 **/
+	void calcProgress( int percent ) const;
+
+    protected slots:
+
+	/**
+	 * Merge the result of a chunk of files. This is connected to the
+	 * done() signal of each FileTypeStatsChunk.
+	 **/
+	void chunkDone();
+
     public:
 
+	/**
+	 * Return 'true' if a calculation is running in the background.
+	 **/
+	bool isBusy() const { return ! _pendingChunks.isEmpty(); }
+
 	/**
 	 * Return the number of files in the tree with the specified suffix.
 	 **/
@@ -142,11 +173,35 @@ namespace QDirStat
 	/**
 	 * Collect information from the associated widget tree:
 	 *
-	 * Recursively go through the tree and collect sizes for each file type
-	 * (filename extension).
+	 * Recursively go through the tree and add the name and size of each
+	 * file to the current chunk. Full chunks are handed over to the
+	 * thread pool right away.
 	 **/
 	void collect( FileInfo * dir );
 
+	/**
+	 * Take the totals that were added up while reading the tree if they
+	 * are valid for 'subtree' and if they were categorized with the same
+	 * categories. Return 'true' if they were taken.
+	 **/
+	bool takePrecomputed( FileInfo * subtree );
+
+	/**
+	 * Hand over the current chunk to the thread pool.
+	 **/
+	void startChunk();
+
+	/**
+	 * Cancel all chunks that are still being processed.
+	 **/
+	void cancel();
+
+	/**
+	 * Clean up the maps when all chunks are merged and emit
+	 * calcFinished().
+	 **/
+	void finishCalc();
+
 	/**
 	 * Remove useless content from the maps. On a Linux system, there tend
 	 * to be a lot of files that have a '.' in the name, but it's not a
@@ -190,7 +245,132 @@ namespace QDirStat
 	CategoryIntMap		_categoryCount;
 
         FileSize                _totalSize;
+
+	QThreadPool		_threadPool;
+	FileTypeStatsChunk *	_currentChunk;
+	QList<FileTypeStatsChunk *> _pendingChunks;
+	int			_chunkCount;
     };
+
+
+    /**
+     * A chunk of files for the FileTypeStats to be categorized in a worker
+     * thread. This is created and filled in the main thread; collect() is
+     * called in a worker thread, and it only uses the names and sizes that
+     * were copied into it, not the FileInfo items that might be deleted by
+     * then.
+     **/
+    class FileTypeStatsChunk: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor. 'categorizer' has to be prepared with
+	 * MimeCategorizer::prepareConcurrentUse().
+	 **/
+	FileTypeStatsChunk( FileTypeStats * parent, MimeCategorizer * categorizer );
+
+	/**
+	 * Add a file.
+	 **/
+	void add( const QString & name, FileSize size );
+
+	/**
+	 * Return the number of files in this chunk.
+	 **/
+	int size() const { return _files.size(); }
+
+	/**
+	 * Cancel this chunk: collect() will do nothing or stop early.
+	 **/
+	void cancel() { _canceled.ref(); }
+
+	/**
+	 * Return 'true' if this chunk was canceled.
+	 **/
+	bool isCanceled() const;
+
+	/**
+	 * Categorize all files. This is called in the worker thread.
+	 **/
+	void collect();
+
+	/**
+	 * Emit the done() signal. This is called in the worker thread.
+	 **/
+	void sendDone() { emit done(); }
+
+	/**
+	 * Return the file totals by suffix. The suffix is the one that is
+	 * used in FileTypeStats, i.e. in lowercase and NO_SUFFIX for none.
+	 **/
+	const QHash<QString, FileTypeTotal> & suffixTotals() const
+	    { return _suffixTotals; }
+
+	/**
+	 * Return the file totals by category. Files without any category
+	 * have category 0.
+	 **/
+	const QHash<MimeCategory *, FileTypeTotal> & categoryTotals() const
+	    { return _categoryTotals; }
+
+    signals:
+
+	/**
+	 * Emitted when collect() is finished or canceled.
+	 **/
+	void done();
+
+    protected:
+
+	struct File
+	{
+	    QString  name;
+	    FileSize size;
+	};
+
+	MimeCategorizer *			_mimeCategorizer;
+	QVector<File>				_files;
+	QHash<QString, FileTypeTotal>		_suffixTotals;
+	QHash<MimeCategory *, FileTypeTotal>	_categoryTotals;
+	QAtomicInt				_canceled;
+
+    };	// class FileTypeStatsChunk
+
+
+    /**
+     * Runnable for a QThreadPool that processes a FileTypeStatsChunk.
+     *
+     * The thread pool takes ownership of this object and deletes it when
+     * it is done; the chunk is owned by the FileTypeStats.
+     **/
+    class FileTypeStatsWorker: public QRunnable
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	FileTypeStatsWorker( FileTypeStatsChunk * chunk ):
+	    QRunnable(),
+	    _chunk( chunk )
+	    { setAutoDelete( true ); }
+
+	/**
+	 * Do the work. This is called in a worker thread.
+	 *
+	 * Reimplemented from QRunnable.
+	 **/
+	virtual void run() Q_DECL_OVERRIDE;
+
+    protected:
+
+	FileTypeStatsChunk * _chunk;
+	NodePin		     _pin;	// Keep deleted nodes until this is done
+
+    };	// class FileTypeStatsWorker
 }
 
 
@@ -63,6 +63,12 @@ FileTypeStatsWindow::FileTypeStatsWindow( SelectionModel * selectionModel,
 
     _stats = new FileTypeStats( this );
     CHECK_NEW( _stats );
+
+    connect( _stats,		   SIGNAL( calcProgress( int ) ),
+	     _ui->progressBar,	   SLOT	 ( setValue    ( int ) ) );
+
+    connect( _stats,		   SIGNAL( calcFinished() ),
+	     this,		   SLOT	 ( populateTree() ) );
 }
 
 
@@ -95,6 +101,7 @@ void FileTypeStatsWindow::initWidgets()
 				      << tr( "Percentage" ) );
     _ui->treeWidget->header()->setStretchLastSection( false );
     HeaderTweaker::resizeToContents( _ui->treeWidget->header() );
+    _ui->progressBar->hide();
 
 
     // Create the menu for the menu button
@@ -117,10 +124,25 @@ void FileTypeStatsWindow::populate( FileInfo * newSubtree )
 {
     clear();
     _subtree = newSubtree;
-    _stats->calc( newSubtree ? newSubtree : _subtree() );
 
     _ui->heading->setText( tr( "File Type Statistics for %1" )
                            .arg( _subtree.url() ) );
+
+    // The tree widget is populated when the calculation is finished
+
+    _ui->progressBar->setValue( 0 );
+    _ui->progressBar->show();
+    _ui->refreshButton->setEnabled( false );
+
+    _stats->calc( newSubtree ? newSubtree : _subtree() );
+}
+
+
+void FileTypeStatsWindow::populateTree()
+{
+    _ui->progressBar->hide();
+    _ui->refreshButton->setEnabled( true );
+    _ui->treeWidget->clear();
     _ui->treeWidget->setSortingEnabled( false );
 
 
@@ -67,7 +67,9 @@ namespace QDirStat
         const Subtree & subtree() const { return _subtree; }
 
 	/**
-	 * Populate the widgets for a subtree.
+	 * Populate the widgets for a subtree. This starts the calculation
+	 * in the background and shows its progress; the file types are
+	 * filled in when it is finished.
 	 **/
 	void populate( FileInfo * subtree );
 
@@ -106,6 +108,12 @@ namespace QDirStat
 	 **/
 	void enableActions( QTreeWidgetItem * currentItem );
 
+	/**
+	 * Fill the tree widget from the statistics. This is called when
+	 * their calculation is finished.
+	 **/
+	void populateTree();
+
     protected:
 
 	/**
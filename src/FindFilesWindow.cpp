@@ -0,0 +1,341 @@
+/*
+ *   File name: FindFilesWindow.cpp
+ *   Summary:	QDirStat "find files" window
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QApplication>
+
+#include "FindFilesWindow.h"
+#include "NameIndex.h"
+#include "DirTree.h"
+#include "SelectionModel.h"
+#include "Settings.h"
+#include "SettingsHelpers.h"
+#include "HeaderTweaker.h"
+#include "Logger.h"
+#include "Exception.h"
+
+// Candidates to check with each timer event: Enough to be fast, but few
+// enough to keep the user interface responsive
+
+#define BATCH_SIZE	20000
+
+using namespace QDirStat;
+
+
+FindFilesWindow::FindFilesWindow( SelectionModel * selectionModel,
+				  QWidget *	   parent ):
+    QDialog( parent ),
+    _ui( new Ui::FindFilesWindow ),
+    _selectionModel( selectionModel ),
+    _allItems( false ),
+    _candidateCount( 0 ),
+    _nextCandidate( 0 ),
+    _pathSearch( false ),
+    _resultCount( 0 ),
+    _maxResults( 10000 )
+{
+    // logDebug() << "init" << endl;
+
+    CHECK_NEW( _ui );
+    _ui->setupUi( this );
+    initWidgets();
+    readWindowSettings( this, "FindFilesWindow" );
+    readSettings();
+
+    _timer.setInterval( 0 );
+
+    connect( &_timer,		 SIGNAL( timeout()	   ),
+	     this,		 SLOT  ( searchNextBatch() ) );
+
+    connect( _ui->searchButton,	 SIGNAL( clicked()	   ),
+	     this,		 SLOT  ( startSearch()	   ) );
+
+    connect( _ui->patternEdit,	 SIGNAL( returnPressed()   ),
+	     this,		 SLOT  ( startSearch()	   ) );
+
+    connect( _ui->treeWidget,	 SIGNAL( currentItemChanged( QTreeWidgetItem *,
+							     QTreeWidgetItem * ) ),
+	     this,		 SLOT  ( selectResult	   ( QTreeWidgetItem * ) ) );
+}
+
+
+FindFilesWindow::~FindFilesWindow()
+{
+    // logDebug() << "destroying" << endl;
+    writeWindowSettings( this, "FindFilesWindow" );
+}
+
+
+void FindFilesWindow::readSettings()
+{
+    Settings settings;
+    settings.beginGroup( "FindFilesWindow" );
+
+    _maxResults = settings.value( "MaxResults", 10000 ).toInt();
+
+    settings.endGroup();
+}
+
+
+void FindFilesWindow::initWidgets()
+{
+    QFont font = _ui->heading->font();
+    font.setBold( true );
+    _ui->heading->setFont( font );
+
+    _ui->treeWidget->setColumnCount( FFR_ColumnCount );
+    _ui->treeWidget->setHeaderLabels( QStringList()
+				      << tr( "Name" )
+				      << tr( "Size" )
+				      << tr( "Directory" ) );
+    _ui->treeWidget->header()->setStretchLastSection( false );
+    HeaderTweaker::resizeToContents( _ui->treeWidget->header() );
+}
+
+
+void FindFilesWindow::reject()
+{
+    stopSearch();
+    deleteLater();
+}
+
+
+void FindFilesWindow::populate( FileInfo * subtree )
+{
+    stopSearch();
+    _subtree = subtree;
+
+    _ui->heading->setText( tr( "Find Files below %1" ).arg( _subtree.url() ) );
+    _ui->patternEdit->setFocus();
+    _ui->patternEdit->selectAll();
+}
+
+
+void FindFilesWindow::startSearch()
+{
+    stopSearch();
+    _ui->treeWidget->clear();
+    _resultCount = 0;
+
+    _pattern = _ui->patternEdit->text().trimmed();
+    FileInfo * subtree = _subtree();
+
+    if ( _pattern.isEmpty() || ! subtree || ! _subtree.tree() )
+    {
+	_ui->statusLabel->clear();
+	return;
+    }
+
+    NameIndex * index = _subtree.tree()->nameIndex();
+
+    if ( index != _index )
+    {
+	if ( _index )
+	    disconnect( _index, 0, this, 0 );
+
+	_index = index;
+
+	connect( _index, SIGNAL( cleared()	),
+		 this,	 SLOT  ( indexCleared() ) );
+    }
+
+    if ( ! _index->isBuilt() )
+    {
+	_ui->statusLabel->setText( tr( "Indexing..." ) );
+	QApplication::setOverrideCursor( Qt::WaitCursor );
+	_index->build();
+	QApplication::restoreOverrideCursor();
+    }
+
+    bool wildcard = _pattern.contains( QRegExp( "[*?\\[]" ) );
+    _pathSearch	  = _pattern.contains( '/' );
+    _wildcard	  = wildcard ?
+	QRegExp( _pattern, Qt::CaseInsensitive, QRegExp::Wildcard ) : QRegExp();
+
+    // The index only knows the names. For a path, any part of the pattern
+    // might match a parent directory, so all items are candidates then.
+
+    if ( _pathSearch )
+    {
+	_candidates = QVector<int>();
+	_allItems   = true;
+    }
+    else
+    {
+	QStringList literals;
+
+	if ( wildcard )
+	    literals = NameIndex::literals( _pattern );
+	else
+	    literals << _pattern;
+
+	_candidates = _index->candidates( literals, &_allItems );
+    }
+
+    _candidateCount = _allItems ? _index->itemCount() : _candidates.size();
+    _nextCandidate  = 0;
+
+    logDebug() << "Searching \"" << _pattern << "\" in " << _candidateCount
+	       << " candidates below " << _subtree.url() << endl;
+
+    // For better Performance: Disable sorting while inserting many items
+    _ui->treeWidget->setSortingEnabled( false );
+    _ui->statusLabel->setText( tr( "Searching..." ) );
+    _timer.start();
+}
+
+
+void FindFilesWindow::stopSearch()
+{
+    if ( _timer.isActive() )
+    {
+	_timer.stop();
+	finishSearch();
+    }
+
+    _candidates = QVector<int>();
+}
+
+
+void FindFilesWindow::indexCleared()
+{
+    if ( ! _timer.isActive() )
+	return;
+
+    // The candidate IDs are invalid now, and so might be the results
+
+    logInfo() << "The tree changed; stopping the search" << endl;
+
+    _timer.stop();
+    _candidates = QVector<int>();
+    _ui->treeWidget->clear();
+    _ui->treeWidget->setSortingEnabled( true );
+    _ui->statusLabel->setText( tr( "The tree changed. Please search again." ) );
+}
+
+
+bool FindFilesWindow::matches( FileInfo * item ) const
+{
+    QString text = _pathSearch ? item->url() : item->name();
+
+    if ( ! _wildcard.isEmpty() )
+	return _wildcard.exactMatch( text );
+    else
+	return text.contains( _pattern, Qt::CaseInsensitive );
+}
+
+
+void FindFilesWindow::searchNextBatch()
+{
+    FileInfo * subtree = _index ? _subtree() : 0;
+
+    if ( ! subtree )	// The tree or the subtree is gone
+    {
+	_timer.stop();
+	finishSearch();
+	return;
+    }
+    int end = qMin( _nextCandidate + BATCH_SIZE, _candidateCount );
+
+    for ( ; _nextCandidate < end && _resultCount < _maxResults; ++_nextCandidate )
+    {
+	FileInfo * item = _index->item( _allItems ?
+					_nextCandidate : _candidates.at( _nextCandidate ) );
+
+	if ( item != subtree && item->isInSubtree( subtree ) && matches( item ) )
+	{
+	    FindFilesResultItem * resultItem = new FindFilesResultItem( item );
+	    CHECK_NEW( resultItem );
+
+	    _ui->treeWidget->addTopLevelItem( resultItem );
+	    ++_resultCount;
+	}
+    }
+
+    if ( _nextCandidate >= _candidateCount || _resultCount >= _maxResults )
+    {
+	_timer.stop();
+	finishSearch();
+    }
+    else
+    {
+	_ui->statusLabel->setText( tr( "Searching... %1 found" ).arg( _resultCount ) );
+    }
+}
+
+
+void FindFilesWindow::finishSearch()
+{
+    _ui->treeWidget->setSortingEnabled( true );
+    _ui->treeWidget->sortByColumn( FFR_PathCol, Qt::AscendingOrder );
+    HeaderTweaker::resizeToContents( _ui->treeWidget->header() );
+
+    if ( _resultCount >= _maxResults )
+	_ui->statusLabel->setText( tr( "Showing the first %1 matches" ).arg( _resultCount ) );
+    else
+	_ui->statusLabel->setText( tr( "%1 found" ).arg( _resultCount ) );
+
+    logDebug() << _resultCount << " matches for \"" << _pattern << "\"" << endl;
+}
+
+
+void FindFilesWindow::selectResult( QTreeWidgetItem * item )
+{
+    if ( ! item )
+	return;
+
+    FindFilesResultItem * result = dynamic_cast<FindFilesResultItem *>( item );
+    CHECK_DYNAMIC_CAST( result, "FindFilesResultItem" );
+
+    if ( ! _subtree.tree() )
+	return;
+
+    FileInfo * found = _subtree.tree()->locate( result->path() );
+
+    if ( found )
+	_selectionModel->setCurrentItem( found, true );
+}
+
+
+
+
+
+
+FindFilesResultItem::FindFilesResultItem( FileInfo * item ):
+    QTreeWidgetItem( QTreeWidgetItem::UserType ),
+    _path( item->url() ),
+    _size( item->totalSize() )
+{
+    QString dir = item->parent() ? item->parent()->url() : QString();
+
+    setText( FFR_NameCol, item->name() );
+    setText( FFR_SizeCol, formatSize( _size ) );
+    setText( FFR_PathCol, dir );
+
+    setTextAlignment( FFR_NameCol, Qt::AlignLeft  );
+    setTextAlignment( FFR_SizeCol, Qt::AlignRight );
+    setTextAlignment( FFR_PathCol, Qt::AlignLeft  );
+}
+
+
+bool FindFilesResultItem::operator<(const QTreeWidgetItem & rawOther) const
+{
+    // Since this is a reference, the dynamic_cast will throw a std::bad_cast
+    // exception if it fails. Not catching this here since this is a genuine
+    // error which should not be silently ignored.
+    const FindFilesResultItem & other = dynamic_cast<const FindFilesResultItem &>( rawOther );
+
+    int col = treeWidget() ? treeWidget()->sortColumn() : FFR_PathCol;
+
+    switch ( col )
+    {
+	case FFR_PathCol: return path() < other.path();
+	case FFR_SizeCol: return size() < other.size();
+	default:	  return QTreeWidgetItem::operator<( rawOther );
+    }
+}
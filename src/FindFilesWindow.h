@@ -0,0 +1,214 @@
+/*
+ *   File name: FindFilesWindow.h
+ *   Summary:	QDirStat "find files" window
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef FindFilesWindow_h
+#define FindFilesWindow_h
+
+
+#include <QDialog>
+#include <QTreeWidgetItem>
+#include <QPointer>
+#include <QTimer>
+#include <QVector>
+#include <QRegExp>
+
+#include "ui_find-files-window.h"
+#include "FileInfo.h"
+#include "Subtree.h"
+
+
+namespace QDirStat
+{
+    class NameIndex;
+    class SelectionModel;
+
+
+    /**
+     * Modeless dialog to find files and directories by name in a subtree.
+     *
+     * The search pattern is either part of the name or a wildcard pattern
+     * (with '*', '?' or '[...]') for the complete name. If it contains a
+     * '/', it is matched against the complete path instead.
+     *
+     * The candidates are taken from the tree's NameIndex, so the tree is
+     * not walked and most names are not even compared. They are checked
+     * in batches from a timer, so the results come in while the search is
+     * still running, and the user can start the next one at any time.
+     *
+     * When the user clicks on a result, it is selected in the main window.
+     **/
+    class FindFilesWindow: public QDialog
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor.
+	 *
+	 * Notice that this widget will destroy itself upon window close.
+	 *
+	 * It is advised to use a QPointer for storing a pointer to an instance
+	 * of this class. The QPointer will keep track of this window
+	 * auto-deleting itself when closed.
+	 **/
+	FindFilesWindow( SelectionModel * selectionModel,
+			 QWidget *	  parent );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~FindFilesWindow();
+
+	/**
+	 * Return the subtree to search.
+	 **/
+	const Subtree & subtree() const { return _subtree; }
+
+    public slots:
+
+	/**
+	 * Set the subtree to search. This stops any running search.
+	 **/
+	void populate( FileInfo * subtree );
+
+	/**
+	 * Start a new search with the pattern from the input field.
+	 **/
+	void startSearch();
+
+	/**
+	 * Stop the running search (if any).
+	 **/
+	void stopSearch();
+
+	/**
+	 * Reject the dialog contents, i.e. the user clicked the "Cancel" or
+	 * WM_CLOSE button. This not only closes the dialog, it also deletes
+	 * it.
+	 *
+	 * Reimplemented from QDialog.
+	 **/
+	virtual void reject() Q_DECL_OVERRIDE;
+
+    protected slots:
+
+	/**
+	 * Check the next batch of candidates.
+	 **/
+	void searchNextBatch();
+
+	/**
+	 * Stop the search because the IDs of the name index are invalid.
+	 **/
+	void indexCleared();
+
+	/**
+	 * Select one of the search results in the main window's tree and
+	 * treemap widgets via their SelectionModel.
+	 **/
+	void selectResult( QTreeWidgetItem * item );
+
+    protected:
+
+	/**
+	 * One-time initialization of the widgets in this window.
+	 **/
+	void initWidgets();
+
+	/**
+	 * Read parameters from the settings file.
+	 **/
+	void readSettings();
+
+	/**
+	 * Return 'true' if 'item' matches the current search.
+	 **/
+	bool matches( FileInfo * item ) const;
+
+	/**
+	 * Finish the search: Sort the results and show their number.
+	 **/
+	void finishSearch();
+
+
+	//
+	// Data members
+	//
+
+	Ui::FindFilesWindow *	_ui;
+	SelectionModel *	_selectionModel;
+	Subtree			_subtree;
+	QPointer<NameIndex>	_index;
+	QTimer			_timer;
+
+	QVector<int>		_candidates;
+	bool			_allItems;	// All items are candidates
+	int			_candidateCount;
+	int			_nextCandidate;
+
+	QString			_pattern;
+	QRegExp			_wildcard;	// Invalid for a substring
+	bool			_pathSearch;
+	int			_resultCount;
+	int			_maxResults;
+    };
+
+
+    /**
+     * Column numbers for the find files tree widget
+     **/
+    enum FindFilesResultColumns
+    {
+	FFR_NameCol = 0,
+	FFR_SizeCol,
+	FFR_PathCol,
+	FFR_ColumnCount
+    };
+
+
+    /**
+     * Item class for the search results, representing one file or
+     * directory.
+     *
+     * Just like SuffixSearchResultItem, this stores the path, not the
+     * FileInfo pointer, so a result stays safe to use even if the tree
+     * changes.
+     **/
+    class FindFilesResultItem: public QTreeWidgetItem
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	FindFilesResultItem( FileInfo * item );
+
+	//
+	// Getters
+	//
+
+	QString	 path() const { return _path; }
+	FileSize size() const { return _size; }
+
+	/**
+	 * Less-than operator for sorting.
+	 **/
+	virtual bool operator<(const QTreeWidgetItem & other) const Q_DECL_OVERRIDE;
+
+    protected:
+
+	QString		_path;
+	FileSize	_size;
+    };
+
+} // namespace QDirStat
+
+
+#endif // FindFilesWindow_h
@@ -12,6 +12,7 @@
 
 #include "HeaderTweaker.h"
 #include "DirTreeView.h"
+#include "DirTreeModel.h"
 #include "Settings.h"
 #include "Qt4Compat.h"
 #include "Logger.h"
@@ -184,6 +185,7 @@ void HeaderTweaker::hideCurrentCol()
     {
 	logDebug() << "Hiding column \"" << colName( _currentSection ) << "\"" << endl;
 	_header->setSectionHidden( _currentSection, true );
+	updateVisibleColumns();
     }
 
     _currentSection = -1;
@@ -244,6 +246,7 @@ void HeaderTweaker::showHiddenCol()
 	{
 	    logDebug() << "Showing column \"" << colName( section ) << "\"" << endl;
 	    _header->setSectionHidden( section, false );
+	    updateVisibleColumns();
 	}
 	else
 	    logError() << "Section index out of range: " << section << endl;
@@ -265,6 +268,8 @@ void HeaderTweaker::showAllHiddenColumns()
 	    _header->setSectionHidden( section, false );
 	}
     }
+
+    updateVisibleColumns();
 }
 
 
@@ -338,6 +343,19 @@ void HeaderTweaker::readSettings()
     {
 	// logDebug() << "Falling back to all columns visible" << endl;
 	visibleColList = colOrderList;
+
+	// Except these: Showing them makes the tree keep type summaries
+	// (see DirTree::typeSummaries()), count the extents (see
+	// ExtentStats) or record the read times (see DirReadTimes).
+
+	visibleColList.removeAll( MainCategoryCol );
+
+	// And this one is only useful when comparing with an older cache
+	// file (see CacheDiff).
+
+	visibleColList.removeAll( ExclusiveSizeCol );
+	visibleColList.removeAll( ReadTimeCol );
+	visibleColList.removeAll( GrowthCol );
     }
     else
 	visibleColList = DataColumns::fixup( visibleColList );
@@ -357,6 +375,8 @@ void HeaderTweaker::readSettings()
 	}
     }
 
+    updateVisibleColumns();
+
     //
     // Set all column widths that are specified
     //
@@ -426,6 +446,25 @@ void HeaderTweaker::writeSettings()
 }
 
 
+void HeaderTweaker::updateVisibleColumns()
+{
+    DataColumnList visibleColList;
+
+    for ( int section = 0; section < _header->count(); ++section )
+    {
+	if ( ! _header->isSectionHidden( section ) )
+	    visibleColList << static_cast<DataColumn>( section );
+    }
+
+    // Only for the model of this view: Another window has its own tree
+
+    DirTreeModel * model = qobject_cast<DirTreeModel *>( _treeView->model() );
+
+    if ( model )
+	model->setVisibleColumns( visibleColList );
+}
+
+
 void HeaderTweaker::addMissingColumns( DataColumnList & colList )
 {
     foreach ( const DataColumn col, DataColumns::instance()->defaultColumns() )
@@ -152,6 +152,12 @@ namespace QDirStat
 	 **/
 	bool autoSizeCol( int section ) const;
 
+	/**
+	 * Tell the model of the tree view which columns are visible now so
+	 * only their aggregates are computed.
+	 **/
+	void updateVisibleColumns();
+
 	/**
 	 * Add any columns that are missing from the default columns to
 	 * 'colList'.
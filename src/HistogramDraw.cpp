@@ -223,6 +223,9 @@ void HistogramView::addHistogramBars()
     if ( _useLogHeightScale )
 	maxVal = log2( maxVal );
 
+    while ( _bars.size() > _buckets.size() )
+	delete _bars.takeLast();
+
     for ( int i=0; i < _buckets.size(); ++i )
     {
 	// logDebug() << "Adding bar #" << i << " with value " << _buckets[ i ] << endl;
@@ -241,8 +244,18 @@ void HistogramView::addHistogramBars()
 	    0.0 :
 	    val / maxVal * _histogramHeight;
 
-	HistogramBar * bar = new HistogramBar( this, i, rect, fillHeight );
-	CHECK_NEW( bar );
+	if ( i < _bars.size() )
+	{
+	    _bars[ i ]->setGeometry( rect, fillHeight );
+	}
+	else
+	{
+	    HistogramBar * bar = new HistogramBar( this, i, rect, fillHeight );
+	    CHECK_NEW( bar );
+	    _bars << bar;
+	}
+
+	scene()->addItem( _bars[ i ] );
     }
 }
 
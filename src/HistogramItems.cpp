@@ -32,17 +32,28 @@ HistogramBar::HistogramBar( HistogramView * parent,
     // rectangle is just for clicking. For the bar content, we create a visible
     // separate child item with the correct height.
 
-    QRectF childRect = rect;
-    childRect.setHeight( -fillHeight );
+    _filledRect = new QGraphicsRectItem( this );
+    CHECK_NEW( _filledRect );
 
-    QGraphicsRectItem * filledRect = new QGraphicsRectItem( childRect, this );
-    CHECK_NEW( filledRect );
-
-    filledRect->setPen( _parentView->barPen() );
-    filledRect->setBrush( _parentView->barBrush() );
+    _filledRect->setPen( _parentView->barPen() );
+    _filledRect->setBrush( _parentView->barBrush() );
 
     // setFlags( ItemIsSelectable );
-    _parentView->scene()->addItem( this );
+
+    setZValue( HistogramView::InvisibleBarLayer );
+    _filledRect->setZValue( HistogramView::BarLayer );
+
+    setGeometry( rect, fillHeight );
+}
+
+
+void HistogramBar::setGeometry( const QRectF & rect, qreal fillHeight )
+{
+    setRect( rect );
+
+    QRectF childRect = rect;
+    childRect.setHeight( -fillHeight );
+    _filledRect->setRect( childRect );
 
     _startVal = _parentView->bucketStart( _number );
     _endVal   = _parentView->bucketEnd  ( _number );
@@ -54,10 +65,7 @@ HistogramBar::HistogramBar( HistogramView * parent,
 	.arg( formatSize( _endVal ) );
 
     setToolTip( tooltip );
-    filledRect->setToolTip( tooltip );
-
-    setZValue( HistogramView::InvisibleBarLayer );
-    filledRect->setZValue( HistogramView::BarLayer );
+    _filledRect->setToolTip( tooltip );
 }
 
 
@@ -32,6 +32,10 @@ namespace QDirStat
 	/**
 	 * Constructor. 'number' is the number of the bar (0 being the
 	 * leftmost) in the histogram.
+	 *
+	 * Unlike the other items, this does not add itself to the scene:
+	 * The view keeps its bars from one rebuild to the next and adds
+	 * them again (see HistogramView::addHistogramBars()).
 	 **/
 	HistogramBar( HistogramView * parent,
 		      int	      number,
@@ -43,6 +47,12 @@ namespace QDirStat
 	 **/
 	int number() const { return _number; }
 
+	/**
+	 * Move and resize this bar and update its tooltip from the current
+	 * bucket of the view. This is much cheaper than creating a new bar.
+	 **/
+	void setGeometry( const QRectF & rect, qreal fillHeight );
+
     protected:
 	/**
 	 * Mouse press event
@@ -51,10 +61,11 @@ namespace QDirStat
 	 **/
 	virtual void mousePressEvent( QGraphicsSceneMouseEvent * event ) Q_DECL_OVERRIDE;
 
-	HistogramView * _parentView;
-	int		_number;
-	qreal		_startVal;
-	qreal		_endVal;
+	HistogramView *	    _parentView;
+	QGraphicsRectItem * _filledRect;
+	int		    _number;
+	qreal		    _startVal;
+	qreal		    _endVal;
     };
 
 
@@ -13,6 +13,7 @@
 #include <QResizeEvent>
 
 #include "HistogramView.h"
+#include "HistogramItems.h"
 #include "DelayedRebuilder.h"
 #include "FileInfo.h"
 #include "Logger.h"
@@ -112,6 +113,7 @@ void HistogramView::clear()
     _percentiles.clear();
     _percentileSums.clear();
     init();
+    deleteBars();
 
     if ( scene() )
     {
@@ -463,8 +465,13 @@ void HistogramView::fitToViewport()
     // this all by itself, but no: Everybody has to waste hours upon hours of
     // life time with this crap.
 
-    QRectF rect = scene()->sceneRect().normalized();
-    // logDebug() << "Old scene rect: " << rect << endl;
+    // The scene is reused for each rebuild, and QGraphicsScene never resets
+    // the min and max in both dimensions where it ever created
+    // QGraphicsItems, which makes its automatic sceneRect() pretty useless.
+    // So let's set it to what is really there now.
+
+    QRectF rect = scene()->itemsBoundingRect().normalized();
+    // logDebug() << "New items rect: " << rect << endl;
 
     scene()->setSceneRect( rect );
 
@@ -508,20 +515,31 @@ void HistogramView::rebuild()
     if ( _geometryDirty )
         autoResize();
 
-    // QGraphicsScene never resets the min and max in both dimensions where it
-    // ever created QGraphicsItems, which makes its sceneRect() call pretty
-    // useless. Let's create a new one without those bad old memories.
-
     if ( scene() )
-	delete scene();
+    {
+	// Keep the bars; addHistogramBars() only updates their geometry and
+	// adds them again. Everything else is cheap enough to create anew.
 
-    QGraphicsScene * newScene = new QGraphicsScene( this );
-    CHECK_NEW( newScene);
-    setScene( newScene );
+	foreach ( HistogramBar * bar, _bars )
+	{
+	    if ( bar->scene() == scene() )
+		scene()->removeItem( bar );
+	}
+
+	scene()->clear();
+    }
+    else
+    {
+	QGraphicsScene * newScene = new QGraphicsScene( this );
+	CHECK_NEW( newScene);
+	setScene( newScene );
+    }
 
     if ( _buckets.size() < 1 || _percentiles.size() != 101 )
     {
+	deleteBars();
 	scene()->addText( "No data yet" );
+	scene()->setSceneRect( scene()->itemsBoundingRect() );
 	logInfo() << "No data yet" << endl;
 	return;
     }
@@ -533,6 +551,13 @@ void HistogramView::rebuild()
 }
 
 
+void HistogramView::deleteBars()
+{
+    qDeleteAll( _bars );
+    _bars.clear();
+}
+
+
 qreal HistogramView::scaleValue( qreal value )
 {
     qreal startVal   = _percentiles[ _startPercentile ];
@@ -24,6 +24,7 @@ typedef QList<qreal> QRealList;
 namespace QDirStat
 {
     class DelayedRebuilder;
+    class HistogramBar;
 
     /**
      * Histogram widget.
@@ -53,6 +54,10 @@ namespace QDirStat
      * In addition to that, the percentiles (or at least every 5th of them,
      * depending on configuration) as well as the median, the 1st and the 3rd
      * quartile (Q1 and Q3) can be displayed as an overlay to the histogram.
+     *
+     * The scene and the histogram bars are kept from one rebuild() to the
+     * next; the bars only get their new geometry. Only the few other items
+     * (axes, labels, markers, overflow panel) are created again.
      **/
     class HistogramView: public QGraphicsView
     {
@@ -423,14 +428,20 @@ namespace QDirStat
          **/
         bool needOverflowPanel() const;
 
+	/**
+	 * Delete all histogram bars.
+	 **/
+	void deleteBars();
+
 
 	//
 	// Data Members
 	//
 
-	DelayedRebuilder * _rebuilder;
-	QGraphicsItem	 * _histogramPanel;
-        bool               _geometryDirty;
+	DelayedRebuilder *	_rebuilder;
+	QGraphicsItem	 *	_histogramPanel;
+	QList<HistogramBar *>	_bars;
+        bool			_geometryDirty;
 
 
 	// Statistics Data
@@ -0,0 +1,146 @@
+/*
+ *   File name: InodeSet.cpp
+ *   Summary:	Set of (device, inode) pairs for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <string.h>	// memset()
+
+#include "InodeSet.h"
+#include "Exception.h"
+
+
+#define INITIAL_CAPACITY	1024
+
+using namespace QDirStat;
+
+
+InodeSet::InodeSet():
+    _table( 0 ),
+    _capacity( 0 ),
+    _size( 0 ),
+    _hasZero( false )
+{
+
+}
+
+
+InodeSet::~InodeSet()
+{
+    delete [] _table;
+}
+
+
+void InodeSet::clear()
+{
+    delete [] _table;
+
+    _table    = 0;
+    _capacity = 0;
+    _size     = 0;
+    _hasZero  = false;
+}
+
+
+static inline quint64 hashInode( quint64 device, quint64 inode )
+{
+    // Inode numbers are often dense, so mix the bits thoroughly
+    // (the finalizer of MurmurHash3)
+
+    quint64 hash = inode ^ ( device * Q_UINT64_C( 0x9e3779b97f4a7c15 ) );
+
+    hash ^= hash >> 33;
+    hash *= Q_UINT64_C( 0xff51afd7ed558ccd );
+    hash ^= hash >> 33;
+    hash *= Q_UINT64_C( 0xc4ceb9fe1a85ec53 );
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+
+int InodeSet::slot( quint64 device, quint64 inode ) const
+{
+    int mask = _capacity - 1;
+    int pos  = (int) ( hashInode( device, inode ) & mask );
+
+    while ( true )
+    {
+	const Entry & entry = _table[ pos ];
+
+	if ( ( entry.device == device && entry.inode == inode ) ||
+	     ( entry.device == 0      && entry.inode == 0     )	  )
+	{
+	    return pos;
+	}
+
+	pos = ( pos + 1 ) & mask;
+    }
+}
+
+
+bool InodeSet::insert( dev_t device, ino_t inode )
+{
+    if ( device == 0 && inode == 0 )
+    {
+	bool isNew = ! _hasZero;
+	_hasZero = true;
+
+	return isNew;
+    }
+
+    // Keep the table at most half full so the probe sequences stay short
+
+    if ( 2 * ( _size + 1 ) > _capacity )
+	grow();
+
+    Entry & entry = _table[ slot( device, inode ) ];
+
+    if ( entry.device != 0 || entry.inode != 0 )
+	return false;
+
+    entry.device = device;
+    entry.inode	 = inode;
+    ++_size;
+
+    return true;
+}
+
+
+bool InodeSet::contains( dev_t device, ino_t inode ) const
+{
+    if ( device == 0 && inode == 0 )
+	return _hasZero;
+
+    if ( _size == 0 )
+	return false;
+
+    const Entry & entry = _table[ slot( device, inode ) ];
+
+    return entry.device != 0 || entry.inode != 0;
+}
+
+
+void InodeSet::grow()
+{
+    Entry * oldTable	= _table;
+    int	    oldCapacity = _capacity;
+
+    _capacity = oldCapacity > 0 ? 2 * oldCapacity : INITIAL_CAPACITY;
+    _table    = new Entry[ _capacity ];
+    CHECK_NEW( _table );
+    memset( _table, 0, _capacity * sizeof( Entry ) );
+
+    for ( int i=0; i < oldCapacity; ++i )
+    {
+	const Entry & entry = oldTable[ i ];
+
+	if ( entry.device != 0 || entry.inode != 0 )
+	    _table[ slot( entry.device, entry.inode ) ] = entry;
+    }
+
+    delete [] oldTable;
+}
@@ -0,0 +1,101 @@
+/*
+ *   File name: InodeSet.h
+ *   Summary:	Set of (device, inode) pairs for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef InodeSet_h
+#define InodeSet_h
+
+
+#include <sys/types.h>	// dev_t, ino_t
+
+#include <QtGlobal>	// quint64
+
+
+namespace QDirStat
+{
+    /**
+     * Compact set of (device, inode) pairs to find out if an inode was
+     * already seen, e.g. for files with multiple hard links.
+     *
+     * This is a hash table with open addressing and linear probing over a
+     * plain array of 16 byte entries, so there is no per-entry allocation
+     * and no pointer chasing. It can only grow; there is no way to remove
+     * an entry other than clear().
+     **/
+    class InodeSet
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	InodeSet();
+
+	/**
+	 * Destructor.
+	 **/
+	~InodeSet();
+
+	/**
+	 * Insert an inode. Return 'true' if it was new, 'false' if it was
+	 * already in the set.
+	 **/
+	bool insert( dev_t device, ino_t inode );
+
+	/**
+	 * Return 'true' if the set contains an inode.
+	 **/
+	bool contains( dev_t device, ino_t inode ) const;
+
+	/**
+	 * Return the number of inodes in the set.
+	 **/
+	int size() const { return _size; }
+
+	/**
+	 * Remove all inodes and free the table.
+	 **/
+	void clear();
+
+    protected:
+
+	struct Entry
+	{
+	    quint64 device;
+	    quint64 inode;
+	};
+
+	/**
+	 * Return the slot for an inode: Either the one where it is or the
+	 * empty one where it belongs.
+	 **/
+	int slot( quint64 device, quint64 inode ) const;
+
+	/**
+	 * Double the table size and rehash all entries.
+	 **/
+	void grow();
+
+
+	// Data members
+
+	Entry * _table;
+	int	_capacity;	// Always 0 or a power of 2
+	int	_size;
+
+	// An all-zero entry marks an empty slot, so device 0 / inode 0 (which
+	// no real file has) gets a flag of its own.
+
+	bool	_hasZero;
+
+    };	// class InodeSet
+
+}	// namespace QDirStat
+
+
+#endif // ifndef InodeSet_h
@@ -0,0 +1,382 @@
+/*
+ *   File name: IoUringStat.cpp
+ *   Summary:	Batched statx() calls via Linux io_uring
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#ifdef HAVE_IO_URING
+#  include <linux/io_uring.h>
+#endif
+
+#include "IoUringStat.h"
+#include "Statx.h"
+#include "Logger.h"
+
+using namespace QDirStat;
+
+
+static pthread_key_t  threadKey;
+static pthread_once_t threadKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_once_t probeOnce	    = PTHREAD_ONCE_INIT;
+static bool	      available	    = false;
+
+
+static void deleteThreadInstance( void * instance )
+{
+    delete static_cast<IoUringStat *>( instance );
+}
+
+
+static void createThreadKey()
+{
+    pthread_key_create( &threadKey, deleteThreadInstance );
+}
+
+
+static void probeAvailable()
+{
+    IoUringStat probe( 4 );
+    struct stat statInfo;
+    int		err  = 0;
+    const char * name = ".";
+
+    available = probe.lstatBatch( AT_FDCWD, &name, 1, &statInfo, &err );
+}
+
+
+IoUringStat::IoUringStat( unsigned queueDepth ):
+    _ringFd( -1 ),
+    _unsupported( false ),
+    _failed( false ),
+    _sqEntries( 0 ),
+    _cqEntries( 0 ),
+    _sqRing( 0 ),
+    _cqRing( 0 ),
+    _sqRingSize( 0 ),
+    _cqRingSize( 0 ),
+    _sqes( 0 ),
+    _sqesSize( 0 ),
+    _statxBuf( 0 )
+{
+#ifdef HAVE_IO_URING
+    struct io_uring_params params;
+    memset( &params, 0, sizeof( params ) );
+
+    _ringFd = syscall( __NR_io_uring_setup, queueDepth, &params );
+
+    if ( _ringFd < 0 )
+	return;
+
+    _sqEntries	= params.sq_entries;
+    _cqEntries	= params.cq_entries;
+    _sqRingSize = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+    _cqRingSize = params.cq_off.cqes  + params.cq_entries * sizeof( struct io_uring_cqe );
+
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+
+    if ( singleMmap )
+    {
+	if ( _cqRingSize > _sqRingSize )
+	    _sqRingSize = _cqRingSize;
+
+	_cqRingSize = _sqRingSize;
+    }
+
+    _sqRing = mmap( 0, _sqRingSize, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_SQ_RING );
+
+    if ( _sqRing == MAP_FAILED )
+    {
+	_sqRing = 0;
+	close( _ringFd );
+	_ringFd = -1;
+	return;
+    }
+
+    if ( singleMmap )
+	_cqRing = _sqRing;
+    else
+    {
+	_cqRing = mmap( 0, _cqRingSize, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_CQ_RING );
+
+	if ( _cqRing == MAP_FAILED )
+	{
+	    _cqRing = 0;
+	    munmap( _sqRing, _sqRingSize );
+	    _sqRing = 0;
+	    close( _ringFd );
+	    _ringFd = -1;
+	    return;
+	}
+    }
+
+    _sqesSize = params.sq_entries * sizeof( struct io_uring_sqe );
+    _sqes = mmap( 0, _sqesSize, PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_SQES );
+
+    if ( _sqes == MAP_FAILED )
+    {
+	_sqes = 0;
+
+	if ( _cqRing != _sqRing )
+	    munmap( _cqRing, _cqRingSize );
+
+	munmap( _sqRing, _sqRingSize );
+	_sqRing = _cqRing = 0;
+	close( _ringFd );
+	_ringFd = -1;
+	return;
+    }
+
+    char * sq = static_cast<char *>( _sqRing );
+    char * cq = static_cast<char *>( _cqRing );
+
+    _sqHead  = reinterpret_cast<unsigned *>( sq + params.sq_off.head	     );
+    _sqTail  = reinterpret_cast<unsigned *>( sq + params.sq_off.tail	     );
+    _sqMask  = reinterpret_cast<unsigned *>( sq + params.sq_off.ring_mask    );
+    _sqArray = reinterpret_cast<unsigned *>( sq + params.sq_off.array	     );
+    _cqHead  = reinterpret_cast<unsigned *>( cq + params.cq_off.head	     );
+    _cqTail  = reinterpret_cast<unsigned *>( cq + params.cq_off.tail	     );
+    _cqMask  = reinterpret_cast<unsigned *>( cq + params.cq_off.ring_mask    );
+    _cqes    = cq + params.cq_off.cqes;
+
+    _statxBuf = new struct statx[ _sqEntries ];
+#else
+    (void) queueDepth;
+#endif
+}
+
+
+IoUringStat::~IoUringStat()
+{
+    if ( _sqes )
+	munmap( _sqes, _sqesSize );
+
+    if ( _cqRing && _cqRing != _sqRing )
+	munmap( _cqRing, _cqRingSize );
+
+    if ( _sqRing )
+	munmap( _sqRing, _sqRingSize );
+
+    if ( _ringFd >= 0 )
+	close( _ringFd );
+
+    delete[] _statxBuf;
+}
+
+
+IoUringStat * IoUringStat::forCurrentThread()
+{
+    if ( ! isAvailable() )
+	return 0;
+
+    pthread_once( &threadKeyOnce, createThreadKey );
+    IoUringStat * instance = static_cast<IoUringStat *>( pthread_getspecific( threadKey ) );
+
+    if ( ! instance )
+    {
+	instance = new IoUringStat();
+	pthread_setspecific( threadKey, instance );
+    }
+
+    return instance->ok() ? instance : 0;
+}
+
+
+bool IoUringStat::isAvailable()
+{
+    // The worker threads all get here; only one of them probes, and the
+    // others wait for its result.
+
+    pthread_once( &probeOnce, probeAvailable );
+
+    return available;
+}
+
+
+bool IoUringStat::lstatBatch( int		     dirFd,
+			      const char * const *   names,
+			      int		     count,
+			      struct stat *	     statInfo,
+			      int *		     errors )
+{
+#ifdef HAVE_IO_URING
+    if ( ! ok() )
+	return false;
+
+    struct io_uring_sqe * sqes = static_cast<struct io_uring_sqe *>( _sqes );
+    int done = 0;
+
+    while ( done < count )
+    {
+	unsigned batchSize = count - done;
+
+	if ( batchSize > _sqEntries )
+	    batchSize = _sqEntries;
+
+	unsigned tail = *_sqTail;
+
+	for ( unsigned i=0; i < batchSize; ++i )
+	{
+	    unsigned index = ( tail + i ) & *_sqMask;
+	    struct io_uring_sqe * sqe = &sqes[ index ];
+
+	    memset( sqe, 0, sizeof( *sqe ) );
+	    sqe->opcode	     = IORING_OP_STATX;
+	    sqe->fd	     = dirFd;
+	    sqe->addr	     = (unsigned long) names[ done + i ];
+	    sqe->len	     = Statx::mask();
+	    sqe->off	     = (unsigned long) &_statxBuf[ i ];
+	    sqe->statx_flags = Statx::flags();
+	    sqe->user_data   = i;
+
+	    _sqArray[ index ] = index;
+	}
+
+	__atomic_store_n( _sqTail, tail + batchSize, __ATOMIC_RELEASE );
+
+	if ( ! submitAndWait( batchSize ) )
+	{
+	    fail();
+	    return false;
+	}
+
+	// Collect the completions
+
+	unsigned head = *_cqHead;
+	unsigned cqTail = __atomic_load_n( _cqTail, __ATOMIC_ACQUIRE );
+	struct io_uring_cqe * cqes = static_cast<struct io_uring_cqe *>( _cqes );
+
+	while ( head != cqTail )
+	{
+	    struct io_uring_cqe * cqe = &cqes[ head & *_cqMask ];
+	    unsigned i = cqe->user_data;
+
+	    if ( cqe->res == -EINVAL && done == 0 && i == 0 )
+	    {
+		// Old kernel without IORING_OP_STATX: Give up on io_uring
+
+		_unsupported = true;
+	    }
+
+	    if ( cqe->res < 0 )
+		errors[ done + i ] = -cqe->res;
+	    else
+	    {
+		errors[ done + i ] = 0;
+		Statx::toStat( &_statxBuf[ i ], &statInfo[ done + i ] );
+	    }
+
+	    ++head;
+	}
+
+	__atomic_store_n( _cqHead, head, __ATOMIC_RELEASE );
+
+	if ( _unsupported )
+	    return false;
+
+	done += batchSize;
+    }
+
+    return true;
+#else
+    (void) dirFd;
+    (void) names;
+    (void) count;
+    (void) statInfo;
+    (void) errors;
+
+    return false;
+#endif
+}
+
+
+bool IoUringStat::submitAndWait( unsigned count )
+{
+#ifdef HAVE_IO_URING
+    unsigned submitted = 0;
+    unsigned completed = 0;
+
+    while ( completed < count )
+    {
+	unsigned toSubmit = count - submitted;
+	unsigned waitFor  = count - completed;
+
+	int result = syscall( __NR_io_uring_enter, _ringFd, toSubmit, waitFor,
+			      IORING_ENTER_GETEVENTS, 0, 0 );
+	if ( result < 0 )
+	{
+	    if ( errno == EINTR )
+		continue;
+
+	    return false;
+	}
+
+	submitted += result;
+	unsigned ready = __atomic_load_n( _cqTail, __ATOMIC_ACQUIRE ) - *_cqHead;
+	completed = ready;
+
+	if ( ready >= count )
+	    break;
+    }
+
+    return true;
+#else
+    (void) count;
+    return false;
+#endif
+}
+
+
+void IoUringStat::fail()
+{
+#ifdef HAVE_IO_URING
+    // The requests that the kernel did not take yet point to the names of
+    // the caller that are gone when it falls back, and the completions of
+    // this batch would be mistaken for those of the next one: Never use
+    // this ring again.
+
+    _failed = true;
+
+    // The kernel copied the names of the requests it took, but those still
+    // write to _statxBuf when they complete. Each of them posts exactly one
+    // completion, so they are done when the tail of the completion queue
+    // catches up with the head of the submission queue.
+
+    for ( int retry=0; retry < 100; ++retry )
+    {
+	unsigned inFlight = __atomic_load_n( _sqHead, __ATOMIC_ACQUIRE ) -
+	    __atomic_load_n( _cqTail, __ATOMIC_ACQUIRE );
+
+	if ( inFlight == 0 )
+	{
+	    logWarning() << "io_uring failed; falling back to fstatat()" << endl;
+	    return;
+	}
+
+	if ( syscall( __NR_io_uring_enter, _ringFd, 0, inFlight, IORING_ENTER_GETEVENTS, 0, 0 ) < 0 &&
+	     errno != EINTR )
+	{
+	    usleep( 1000 );
+	}
+    }
+
+    // Better leak the buffer than have the kernel write to freed memory
+
+    logError() << "io_uring requests still in flight; leaking their buffer" << endl;
+    _statxBuf = 0;
+#endif
+}
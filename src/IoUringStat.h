@@ -0,0 +1,120 @@
+/*
+ *   File name: IoUringStat.h
+ *   Summary:	Batched statx() calls via Linux io_uring
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef IoUringStat_h
+#define IoUringStat_h
+
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+
+namespace QDirStat
+{
+    /**
+     * Minimal io_uring wrapper that submits statx() requests in batches
+     * and collects their completions. This uses the raw system calls, so it
+     * does not need liburing.
+     *
+     * Each thread needs its own instance; use forCurrentThread() for that.
+     *
+     * If io_uring (or its statx opcode) is not available on the running
+     * kernel, ok() returns 'false' and callers should fall back to plain
+     * fstatat().
+     **/
+    class IoUringStat
+    {
+    public:
+
+	/**
+	 * Constructor. Set up a ring with room for 'queueDepth' requests.
+	 **/
+	IoUringStat( unsigned queueDepth = 256 );
+
+	/**
+	 * Destructor.
+	 **/
+	~IoUringStat();
+
+	/**
+	 * Return 'true' if the ring could be set up and statx requests work.
+	 **/
+	bool ok() const { return _ringFd >= 0 && ! _unsupported && ! _failed; }
+
+	/**
+	 * lstat() 'count' entries with names 'names' relative to directory
+	 * file descriptor 'dirFd'. Results go to 'statInfo', and the errno
+	 * of each request (0 if OK) goes to 'errors'.
+	 *
+	 * Returns 'false' if io_uring could not be used at all; in that case
+	 * the caller has to do the stat() calls itself.
+	 **/
+	bool lstatBatch( int		   dirFd,
+			 const char * const * names,
+			 int		   count,
+			 struct stat *	   statInfo,
+			 int *		   errors );
+
+	/**
+	 * Return the instance for the current thread. This is created on
+	 * demand. Returns 0 if io_uring is not available on this system.
+	 **/
+	static IoUringStat * forCurrentThread();
+
+	/**
+	 * Return 'true' if io_uring statx is available on this system.
+	 * This will set up a ring on first use to find out.
+	 **/
+	static bool isAvailable();
+
+    protected:
+
+	/**
+	 * Submit the requests that are currently in the submission queue and
+	 * wait for all of them to complete. Returns 'false' on error.
+	 **/
+	bool submitAndWait( unsigned count );
+
+	/**
+	 * Give up on this ring after submitAndWait() failed: Make ok()
+	 * return 'false' and wait for the requests that are still in flight.
+	 **/
+	void fail();
+
+
+	int		_ringFd;
+	bool		_unsupported;
+	bool		_failed;
+
+	unsigned	_sqEntries;
+	unsigned	_cqEntries;
+	void *		_sqRing;
+	void *		_cqRing;
+	size_t		_sqRingSize;
+	size_t		_cqRingSize;
+	void *		_sqes;
+	size_t		_sqesSize;
+
+	unsigned *	_sqHead;
+	unsigned *	_sqTail;
+	unsigned *	_sqMask;
+	unsigned *	_sqArray;
+	unsigned *	_cqHead;
+	unsigned *	_cqTail;
+	unsigned *	_cqMask;
+	void *		_cqes;
+
+	struct statx *	_statxBuf;
+
+    };	// class IoUringStat
+
+}	// namespace QDirStat
+
+
+#endif // ifndef IoUringStat_h
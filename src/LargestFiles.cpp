@@ -0,0 +1,100 @@
+/*
+ *   File name: LargestFiles.cpp
+ *   Summary:	Finding the largest files in a subtree for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <algorithm>
+
+#include "LargestFiles.h"
+#include "FileInfoIterator.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+/**
+ * Comparison function for the heap: With "greater than", the smallest
+ * file is on top.
+ **/
+static bool largerFile( FileInfo * a, FileInfo * b )
+{
+    return a->size() > b->size();
+}
+
+
+LargestFiles::LargestFiles( int maxCount ):
+    _maxCount( qMax( 1, maxCount ) )
+{
+    _heap.reserve( _maxCount );
+}
+
+
+void LargestFiles::clear()
+{
+    _heap.clear();
+}
+
+
+void LargestFiles::setMaxCount( int maxCount )
+{
+    _maxCount = qMax( 1, maxCount );
+    _heap = QVector<FileInfo *>();
+    _heap.reserve( _maxCount );
+}
+
+
+void LargestFiles::collect( FileInfo * subtree )
+{
+    CHECK_PTR( subtree );
+
+    if ( subtree->isFile() )
+	add( subtree );
+
+    FileInfoIterator it( subtree );
+
+    while ( *it )
+    {
+	FileInfo * item = *it;
+
+	if ( item->hasChildren() )
+	    collect( item );
+	else if ( item->isFile() )
+	    add( item );
+
+	// Disregard symlinks, block devices and other special files
+
+	++it;
+    }
+}
+
+
+void LargestFiles::add( FileInfo * file )
+{
+    if ( _heap.size() < _maxCount )
+    {
+	_heap << file;
+	std::push_heap( _heap.begin(), _heap.end(), largerFile );
+    }
+    else if ( file->size() > _heap.first()->size() )
+    {
+	// Replace the smallest one
+
+	std::pop_heap( _heap.begin(), _heap.end(), largerFile );
+	_heap.last() = file;
+	std::push_heap( _heap.begin(), _heap.end(), largerFile );
+    }
+}
+
+
+FileInfoList LargestFiles::result() const
+{
+    QVector<FileInfo *> files = _heap;
+    std::sort( files.begin(), files.end(), largerFile );
+
+    return files.toList();
+}
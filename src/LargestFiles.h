@@ -0,0 +1,81 @@
+/*
+ *   File name: LargestFiles.h
+ *   Summary:	Finding the largest files in a subtree for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef LargestFiles_h
+#define LargestFiles_h
+
+
+#include <QVector>
+
+#include "FileInfo.h"
+
+
+namespace QDirStat
+{
+    /**
+     * Class to find the N largest files in a subtree in one pass.
+     *
+     * The files are kept in a min-heap of at most N entries: Each new file
+     * only has to be compared with the smallest one of them, and only if
+     * it is larger, it replaces that one at a cost of O( log(N) ). So the
+     * complete subtree costs O( n * log(N) ) at worst and O( n ) for
+     * typical trees, and there is no need to sort or even collect all
+     * files.
+     **/
+    class LargestFiles
+    {
+    public:
+
+	/**
+	 * Constructor. 'maxCount' is the number of files to find.
+	 **/
+	LargestFiles( int maxCount = 100 );
+
+	/**
+	 * Clear the collected files.
+	 **/
+	void clear();
+
+	/**
+	 * Return the number of files to find.
+	 **/
+	int maxCount() const { return _maxCount; }
+
+	/**
+	 * Set the number of files to find. This clears the collected files.
+	 **/
+	void setMaxCount( int maxCount );
+
+	/**
+	 * Recurse through all file elements in the subtree and keep the
+	 * largest files.
+	 **/
+	void collect( FileInfo * subtree );
+
+	/**
+	 * Add one file. It is only kept if it is one of the largest so far.
+	 **/
+	void add( FileInfo * file );
+
+	/**
+	 * Return the largest files, the largest first.
+	 **/
+	FileInfoList result() const;
+
+    protected:
+
+	int			_maxCount;
+	QVector<FileInfo *>	_heap;	// The smallest of them first
+
+    };	// class LargestFiles
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef LargestFiles_h
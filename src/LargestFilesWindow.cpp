@@ -0,0 +1,162 @@
+/*
+ *   File name: LargestFilesWindow.cpp
+ *   Summary:	QDirStat "largest files" window
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QApplication>
+
+#include "LargestFilesWindow.h"
+#include "LargestFiles.h"
+#include "FindFilesWindow.h"	// FindFilesResultItem
+#include "DirTree.h"
+#include "SelectionModel.h"
+#include "Settings.h"
+#include "SettingsHelpers.h"
+#include "HeaderTweaker.h"
+#include "Logger.h"
+#include "Exception.h"
+
+using namespace QDirStat;
+
+
+LargestFilesWindow::LargestFilesWindow( SelectionModel * selectionModel,
+					QWidget *	 parent ):
+    QDialog( parent ),
+    _ui( new Ui::LargestFilesWindow ),
+    _selectionModel( selectionModel )
+{
+    // logDebug() << "init" << endl;
+
+    CHECK_NEW( _ui );
+    _ui->setupUi( this );
+    initWidgets();
+    readWindowSettings( this, "LargestFilesWindow" );
+    readSettings();
+
+    connect( _ui->refreshButton, SIGNAL( clicked() ),
+	     this,		 SLOT  ( refresh() ) );
+
+    connect( _ui->countSpinBox,	 SIGNAL( editingFinished() ),
+	     this,		 SLOT  ( refresh()	   ) );
+
+    connect( _ui->treeWidget,	 SIGNAL( currentItemChanged( QTreeWidgetItem *,
+							     QTreeWidgetItem * ) ),
+	     this,		 SLOT  ( selectResult	   ( QTreeWidgetItem * ) ) );
+}
+
+
+LargestFilesWindow::~LargestFilesWindow()
+{
+    // logDebug() << "destroying" << endl;
+    writeWindowSettings( this, "LargestFilesWindow" );
+    writeSettings();
+}
+
+
+void LargestFilesWindow::readSettings()
+{
+    Settings settings;
+    settings.beginGroup( "LargestFilesWindow" );
+
+    _ui->countSpinBox->setValue( settings.value( "Count", 100 ).toInt() );
+
+    settings.endGroup();
+}
+
+
+void LargestFilesWindow::writeSettings()
+{
+    Settings settings;
+    settings.beginGroup( "LargestFilesWindow" );
+
+    settings.setValue( "Count", _ui->countSpinBox->value() );
+
+    settings.endGroup();
+}
+
+
+void LargestFilesWindow::initWidgets()
+{
+    QFont font = _ui->heading->font();
+    font.setBold( true );
+    _ui->heading->setFont( font );
+
+    _ui->treeWidget->setColumnCount( FFR_ColumnCount );
+    _ui->treeWidget->setHeaderLabels( QStringList()
+				      << tr( "Name" )
+				      << tr( "Size" )
+				      << tr( "Directory" ) );
+    _ui->treeWidget->header()->setStretchLastSection( false );
+    HeaderTweaker::resizeToContents( _ui->treeWidget->header() );
+}
+
+
+void LargestFilesWindow::reject()
+{
+    deleteLater();
+}
+
+
+void LargestFilesWindow::refresh()
+{
+    populate( _subtree() );
+}
+
+
+void LargestFilesWindow::populate( FileInfo * subtree )
+{
+    _ui->treeWidget->clear();
+    _subtree = subtree;
+
+    if ( ! subtree )
+	return;
+
+    _ui->heading->setText( tr( "Largest Files below %1" ).arg( _subtree.url() ) );
+
+    QApplication::setOverrideCursor( Qt::WaitCursor );
+
+    LargestFiles largestFiles( _ui->countSpinBox->value() );
+    largestFiles.collect( subtree );
+    FileInfoList files = largestFiles.result();
+
+    // For better Performance: Disable sorting while inserting many items
+    _ui->treeWidget->setSortingEnabled( false );
+
+    foreach ( FileInfo * file, files )
+    {
+	FindFilesResultItem * item = new FindFilesResultItem( file );
+	CHECK_NEW( item );
+
+	_ui->treeWidget->addTopLevelItem( item );
+    }
+
+    _ui->treeWidget->setSortingEnabled( true );
+    _ui->treeWidget->sortByColumn( FFR_SizeCol, Qt::DescendingOrder );
+    HeaderTweaker::resizeToContents( _ui->treeWidget->header() );
+
+    QApplication::restoreOverrideCursor();
+
+    logDebug() << files.size() << " largest files below " << _subtree.url() << endl;
+}
+
+
+void LargestFilesWindow::selectResult( QTreeWidgetItem * item )
+{
+    if ( ! item )
+	return;
+
+    FindFilesResultItem * result = dynamic_cast<FindFilesResultItem *>( item );
+    CHECK_DYNAMIC_CAST( result, "FindFilesResultItem" );
+
+    if ( ! _subtree.tree() )
+	return;
+
+    FileInfo * file = _subtree.tree()->locate( result->path() );
+
+    if ( file )
+	_selectionModel->setCurrentItem( file, true );
+}
@@ -0,0 +1,120 @@
+/*
+ *   File name: LargestFilesWindow.h
+ *   Summary:	QDirStat "largest files" window
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef LargestFilesWindow_h
+#define LargestFilesWindow_h
+
+
+#include <QDialog>
+#include <QTreeWidgetItem>
+
+#include "ui_largest-files-window.h"
+#include "FileInfo.h"
+#include "Subtree.h"
+
+
+namespace QDirStat
+{
+    class SelectionModel;
+
+
+    /**
+     * Modeless dialog to show the largest files in a subtree, the largest
+     * first. See LargestFiles.
+     *
+     * When the user clicks on a file, it is selected in the main window.
+     **/
+    class LargestFilesWindow: public QDialog
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor.
+	 *
+	 * Notice that this widget will destroy itself upon window close.
+	 *
+	 * It is advised to use a QPointer for storing a pointer to an instance
+	 * of this class. The QPointer will keep track of this window
+	 * auto-deleting itself when closed.
+	 **/
+	LargestFilesWindow( SelectionModel * selectionModel,
+			    QWidget *	     parent );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~LargestFilesWindow();
+
+	/**
+	 * Return the subtree of the files.
+	 **/
+	const Subtree & subtree() const { return _subtree; }
+
+    public slots:
+
+	/**
+	 * Populate the window: Find the largest files in 'subtree'.
+	 **/
+	void populate( FileInfo * subtree );
+
+	/**
+	 * Refresh (reload) all data.
+	 **/
+	void refresh();
+
+	/**
+	 * Reject the dialog contents, i.e. the user clicked the "Cancel" or
+	 * WM_CLOSE button. This not only closes the dialog, it also deletes
+	 * it.
+	 *
+	 * Reimplemented from QDialog.
+	 **/
+	virtual void reject() Q_DECL_OVERRIDE;
+
+    protected slots:
+
+	/**
+	 * Select one of the files in the main window's tree and treemap
+	 * widgets via their SelectionModel.
+	 **/
+	void selectResult( QTreeWidgetItem * item );
+
+    protected:
+
+	/**
+	 * One-time initialization of the widgets in this window.
+	 **/
+	void initWidgets();
+
+	/**
+	 * Read parameters from the settings file.
+	 **/
+	void readSettings();
+
+	/**
+	 * Write parameters to the settings file.
+	 **/
+	void writeSettings();
+
+
+	//
+	// Data members
+	//
+
+	Ui::LargestFilesWindow * _ui;
+	Subtree			 _subtree;
+	SelectionModel *	 _selectionModel;
+    };
+
+} // namespace QDirStat
+
+
+#endif // LargestFilesWindow_h
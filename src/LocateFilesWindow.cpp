@@ -8,10 +8,13 @@
 
 
 #include <algorithm>
+#include <QHash>
 
 #include "LocateFilesWindow.h"
 #include "DirTree.h"
+#include "DirInfo.h"
 #include "SelectionModel.h"
+#include "SuffixIndex.h"
 #include "FileInfoIterator.h"
 #include "SettingsHelpers.h"
 #include "HeaderTweaker.h"
@@ -114,7 +117,10 @@ void LocateFilesWindow::populate( const QString & suffix, FileInfo * newSubtree
     // For better Performance: Disable sorting while inserting many items
     _ui->treeWidget->setSortingEnabled( false );
 
-    locate( newSubtree ? newSubtree : _subtree() );
+    FileInfo * subtree = newSubtree ? newSubtree : _subtree();
+
+    if ( subtree && subtree->tree() )
+	locate( subtree->tree()->suffixIndex()->matchingFiles( _searchSuffix, subtree ) );
 
     _ui->treeWidget->setSortingEnabled( true );
     _ui->treeWidget->sortByColumn( SSR_PathCol, Qt::AscendingOrder );
@@ -142,44 +148,41 @@ void LocateFilesWindow::populate( const QString & suffix, FileInfo * newSubtree
 }
 
 
-void LocateFilesWindow::locate( FileInfo * dir )
+void LocateFilesWindow::locate( const FileInfoList & files )
 {
-    if ( ! dir )
-	return;
+    // Sum up the matching files for each directory; a file in a dot entry
+    // belongs to the dot entry's parent.
 
-    FileInfoSet matches = matchingFiles( dir );
+    QHash<FileInfo *, FileTypeTotal> dirTotals;
 
-    if ( ! matches.isEmpty() )
+    foreach ( FileInfo * file, files )
     {
-	// Create a search result for this path
+	FileInfo * dir = file->parent();
 
-	FileSize totalSize = 0LL;
+	if ( dir && dir->isDotEntry() )
+	    dir = dir->parent();
 
-	foreach ( FileInfo * file, matches )
-	    totalSize += file->size();
+	if ( ! dir )
+	    continue;
 
-	SuffixSearchResultItem * searchResultItem =
-	    new SuffixSearchResultItem( dir->url(), matches.size(), totalSize );
-	CHECK_NEW( searchResultItem );
-
-	_ui->treeWidget->addTopLevelItem( searchResultItem );
+	FileTypeTotal & total = dirTotals[ dir ];
+	total.sum += file->size();
+	++total.count;
     }
 
+    // Create a search result for each path
 
-    // Recurse through any subdirectories
+    QHash<FileInfo *, FileTypeTotal>::const_iterator it = dirTotals.constBegin();
 
-    FileInfo* child = dir->firstChild();
-
-    while ( child )
+    while ( it != dirTotals.constEnd() )
     {
-	if ( child->isDir() )
-	    locate( child );
+	SuffixSearchResultItem * searchResultItem =
+	    new SuffixSearchResultItem( it.key()->url(), it.value().count, it.value().sum );
+	CHECK_NEW( searchResultItem );
 
-	child = child->next();
+	_ui->treeWidget->addTopLevelItem( searchResultItem );
+	++it;
     }
-
-    // Notice that unlike in FileTypeStats, there is no need to recurse through
-    // any dot entries: They are handled in matchingFiles() already.
 }
 
 
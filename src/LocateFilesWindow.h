@@ -122,10 +122,11 @@ namespace QDirStat
 	void initWidgets();
 
 	/**
-	 * Recursively locate directories that contain files matching the
-	 * search suffix and create a search result item for each one.
+	 * Create a search result item for each directory that contains any
+	 * of 'files', i.e. the files matching the search suffix from the
+	 * tree's SuffixIndex.
 	 **/
-	void locate( FileInfo * dir );
+	void locate( const FileInfoList & files );
 
 	/**
 	 * Return all direct file children matching the current search suffix.
@@ -0,0 +1,221 @@
+/*
+ *   File name: LogBuffer.cpp
+ *   Summary:	Buffered, asynchronous log file output for the Logger
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <string.h>	// memcpy()
+
+#include <QFile>
+#include <QMutexLocker>
+
+#include "LogBuffer.h"
+
+
+#define FLUSH_INTERVAL	250	// millisec
+
+
+LogBuffer::LogBuffer( int capacity ):
+    QIODevice(),
+    _file( 0 ),
+    _ring( qMax( capacity, 4096 ), 0 ),
+    _head( 0 ),
+    _used( 0 ),
+    _running( false ),
+    _stopping( false ),
+    _urgent( false ),
+    _flusher( this )
+{
+}
+
+
+LogBuffer::~LogBuffer()
+{
+    stop();
+}
+
+
+void LogBuffer::start( QFile * file )
+{
+    stop();
+
+    _mutex.lock();
+    _file     = file;
+    _running  = true;
+    _stopping = false;
+    _mutex.unlock();
+
+    open( QIODevice::WriteOnly | QIODevice::Text );
+    _flusher.start();
+}
+
+
+void LogBuffer::stop()
+{
+    if ( ! isOpen() )
+	return;
+
+    _mutex.lock();
+    _stopping = true;
+    _dataAvailable.wakeAll();
+    _spaceAvailable.wakeAll();
+    _mutex.unlock();
+
+    _flusher.wait();
+
+    // Other threads may still add to the ring while drainLocked() has
+    // the mutex unlocked; from then on, they have to go elsewhere.
+
+    _mutex.lock();
+
+    while ( _used > 0 && _file )
+	drainLocked();
+
+    _running = false;
+    _mutex.unlock();
+
+    close();
+}
+
+
+void LogBuffer::flushNow()
+{
+    QMutexLocker locker( &_mutex );
+    drainLocked();
+}
+
+
+void LogBuffer::setUrgent()
+{
+    QMutexLocker locker( &_mutex );
+    _urgent = true;
+}
+
+
+qint64 LogBuffer::writeData( const char * data, qint64 len )
+{
+    append( data, len );
+
+    return len;
+}
+
+
+bool LogBuffer::append( const char * data, qint64 len )
+{
+    QMutexLocker locker( &_mutex );
+
+    if ( ! _running )
+	return false;
+
+    const int capacity = _ring.size();
+    qint64    written  = 0;
+
+    while ( written < len )
+    {
+	if ( _used == capacity )
+	{
+	    if ( _stopping || ! _flusher.isRunning() )
+	    {
+		// Nobody else will make room
+
+		drainLocked();
+	    }
+	    else
+	    {
+		_dataAvailable.wakeOne();
+		_spaceAvailable.wait( &_mutex );
+	    }
+
+	    continue;
+	}
+
+	int chunk = (int) qMin( (qint64) ( capacity - _used ), len - written );
+	chunk = qMin( chunk, capacity - _head );	// Up to the end of the ring
+
+	memcpy( _ring.data() + _head, data + written, chunk );
+	_head	 = ( _head + chunk ) % capacity;
+	_used	+= chunk;
+	written += chunk;
+    }
+
+    if ( _urgent || _used > capacity / 2 )
+    {
+	_urgent = false;
+	_dataAvailable.wakeOne();
+    }
+
+    return true;
+}
+
+
+qint64 LogBuffer::readData( char *, qint64 )
+{
+    return -1;
+}
+
+
+void LogBuffer::drainLocked()
+{
+    if ( _used == 0 || ! _file )
+	return;
+
+    // Taking _fileMutex while holding _mutex could deadlock with another
+    // thread that is writing to the file and waiting for _mutex afterwards.
+
+    _mutex.unlock();
+    _fileMutex.lock();
+    _mutex.lock();
+
+    QByteArray chunk;
+
+    if ( _used > 0 )
+    {
+	const int capacity = _ring.size();
+	int tail  = ( _head - _used + capacity ) % capacity;
+	int first = qMin( _used, capacity - tail );
+
+	chunk.reserve( _used );
+	chunk.append( _ring.constData() + tail, first );
+	chunk.append( _ring.constData(), _used - first );
+
+	_used = 0;
+	_spaceAvailable.wakeAll();
+    }
+
+    _mutex.unlock();
+
+    if ( ! chunk.isEmpty() )
+    {
+	_file->write( chunk );
+	_file->flush();
+    }
+
+    _fileMutex.unlock();
+    _mutex.lock();
+}
+
+
+void LogBuffer::flushLoop()
+{
+    QMutexLocker locker( &_mutex );
+
+    while ( ! _stopping )
+    {
+	// Wait for a full buffer or an urgent message, but write from time
+	// to time anyway, so 'tail -f' on the log file isn't too far behind.
+
+	_dataAvailable.wait( &_mutex, FLUSH_INTERVAL );
+	drainLocked();
+    }
+}
+
+
+
+
+void LogFlusher::run()
+{
+    _buffer->flushLoop();
+}
@@ -0,0 +1,164 @@
+/*
+ *   File name: LogBuffer.h
+ *   Summary:	Buffered, asynchronous log file output for the Logger
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef LogBuffer_h
+#define LogBuffer_h
+
+
+#include <QIODevice>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QByteArray>
+
+
+class QFile;
+class LogBuffer;
+
+
+/**
+ * Background thread that writes the content of a LogBuffer to the log file.
+ **/
+class LogFlusher: public QThread
+{
+public:
+
+    /**
+     * Constructor.
+     **/
+    LogFlusher( LogBuffer * buffer ):
+	QThread(),
+	_buffer( buffer )
+	{}
+
+protected:
+
+    /**
+     * Write the buffer to the log file until the buffer is stopped.
+     *
+     * Reimplemented from QThread.
+     **/
+    virtual void run() Q_DECL_OVERRIDE;
+
+    LogBuffer * _buffer;
+};
+
+
+/**
+ * Write-only I/O device for the log stream of the Logger: Writing only
+ * copies the data into a ring buffer, and a background thread writes it to
+ * the log file when there is enough of it or from time to time. So logging
+ * a message no longer waits for the file system.
+ *
+ * The mutex is only held for copying the data in and out of the ring
+ * buffer, never while writing to the file. When the ring buffer is full,
+ * the writer waits for the background thread.
+ **/
+class LogBuffer: public QIODevice
+{
+public:
+
+    /**
+     * Constructor. 'capacity' is the size of the ring buffer in bytes.
+     **/
+    LogBuffer( int capacity = 1024 * 1024 );
+
+    /**
+     * Destructor. This stops the background thread and writes what is
+     * left in the buffer.
+     **/
+    virtual ~LogBuffer();
+
+    /**
+     * Start writing to 'file' which has to be open already. This opens
+     * this device and starts the background thread.
+     **/
+    void start( QFile * file );
+
+    /**
+     * Stop the background thread and write what is left in the buffer.
+     * This closes this device, but not the file.
+     **/
+    void stop();
+
+    /**
+     * Write everything that is in the buffer to the file now, e.g. before
+     * aborting the program. This can be called from any thread.
+     **/
+    void flushNow();
+
+    /**
+     * Make the background thread write the buffer as soon as the next
+     * message is complete, e.g. for errors.
+     **/
+    void setUrgent();
+
+    /**
+     * Copy 'len' bytes from 'data' into the ring buffer in one piece. This
+     * waits for the background thread if the buffer is full. Return
+     * 'false' if the buffer is not started or already stopped.
+     *
+     * Unlike write(), this can be called from any thread: It only
+     * touches the ring buffer, not the state of the QIODevice.
+     **/
+    bool append( const char * data, qint64 len );
+
+    /**
+     * Reimplemented from QIODevice.
+     **/
+    virtual bool isSequential() const Q_DECL_OVERRIDE { return true; }
+
+    friend class LogFlusher;
+
+protected:
+
+    /**
+     * Same as append().
+     *
+     * Reimplemented from QIODevice.
+     **/
+    virtual qint64 writeData( const char * data, qint64 len ) Q_DECL_OVERRIDE;
+
+    /**
+     * Reading is not supported: This always returns -1.
+     *
+     * Reimplemented from QIODevice.
+     **/
+    virtual qint64 readData( char * data, qint64 maxLen ) Q_DECL_OVERRIDE;
+
+    /**
+     * Take everything out of the ring buffer and write it to the file.
+     * '_mutex' has to be locked; it is unlocked while writing.
+     **/
+    void drainLocked();
+
+    /**
+     * The loop of the background thread.
+     **/
+    void flushLoop();
+
+
+    // Data members
+
+    QFile *		_file;
+    QByteArray		_ring;
+    int			_head;		// Next byte to write into the ring
+    int			_used;		// Bytes in the ring
+    bool		_running;	// Between start() and stop()
+    bool		_stopping;
+    bool		_urgent;	// Wake up the flusher after the next write
+    QMutex		_mutex;		// For the above
+    QMutex		_fileMutex;	// Keeps the writes to the file in order
+    QWaitCondition	_dataAvailable;
+    QWaitCondition	_spaceAvailable;
+    LogFlusher		_flusher;
+};
+
+
+#endif	// ifndef LogBuffer_h
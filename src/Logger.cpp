@@ -12,13 +12,15 @@
 
 #include <QFile>
 #include <QDir>
-#include <QDateTime>
 #include <QString>
 #include <QRectF>
 #include <QPointF>
 #include <QSizeF>
 #include <QSize>
 #include <QStringList>
+#include <QMutexLocker>
+#include <QByteArray>
+#include <QIODevice>
 
 #include <stdio.h>	// stderr, fprintf()
 #include <stdlib.h>	// abort(), mkdtemp()
@@ -26,10 +28,15 @@
 #include <errno.h>
 #include <pwd.h>	// getpwuid()
 #include <sys/types.h>	// pid_t, getpwuid()
+#include <sys/time.h>	// gettimeofday()
+#include <time.h>	// localtime_r(), strftime()
 
 
 #define VERBOSE_ROTATE 0
 
+#define DEFAULT_MAX_WARNINGS	50	// From the same line of source code
+#define DEFAULT_WARNING_WINDOW	10	// sec
+
 
 static LogSeverity toLogSeverity( QtMsgType msgType );
 
@@ -45,12 +52,78 @@ static void qt_logger( QtMsgType msgType,
 Logger * Logger::_defaultLogger = 0;
 
 
-Logger::Logger( const QString &filename ):
-    _logStream( stderr, QIODevice::WriteOnly ),
-    _nullStream( stderr, QIODevice::WriteOnly )
+/**
+ * Write-only device for the log stream of one thread: This collects what
+ * the stream writes and hands the complete lines to the logger. Without a
+ * logger, it discards everything; that is for suppressing messages below
+ * the log level.
+ **/
+class LogLineDevice: public QIODevice
+{
+public:
+
+    LogLineDevice( Logger * logger ):
+	QIODevice(),
+	_logger( logger )
+	{ open( QIODevice::WriteOnly ); }
+
+    virtual ~LogLineDevice()
+    {
+	if ( _logger && ! _line.isEmpty() )
+	    _logger->writeLines( _line.constData(), _line.size() );
+    }
+
+    virtual bool isSequential() const Q_DECL_OVERRIDE { return true; }
+
+protected:
+
+    virtual qint64 writeData( const char * data, qint64 len ) Q_DECL_OVERRIDE
+    {
+	if ( ! _logger )
+	    return len;
+
+	_line.append( data, (int) len );
+	int end = _line.lastIndexOf( '\n' ) + 1;
+
+	if ( end > 0 )
+	{
+	    _logger->writeLines( _line.constData(), end );
+	    _line.remove( 0, end );
+	}
+
+	return len;
+    }
+
+    virtual qint64 readData( char *, qint64 ) Q_DECL_OVERRIDE { return -1; }
+
+    Logger *	_logger;
+    QByteArray	_line;
+};
+
+
+/**
+ * The log stream and the null stream of one thread. The devices have to
+ * outlive the streams that flush into them.
+ **/
+struct LogThreadStreams
+{
+    LogThreadStreams( Logger * logger ):
+	logDevice( logger ),
+	nullDevice( 0 ),
+	logStream( &logDevice ),
+	nullStream( &nullDevice )
+	{}
+
+    LogLineDevice logDevice;
+    LogLineDevice nullDevice;
+    QTextStream	  logStream;
+    QTextStream	  nullStream;
+};
+
+
+Logger::Logger( const QString &filename )
 {
     init();
-    createNullStream();
     openLogFile( filename );
 }
 
@@ -58,12 +131,9 @@ Logger::Logger( const QString &filename ):
 Logger::Logger( const QString & rawLogDir,
 		const QString & rawFilename,
 		bool		doRotate,
-		int		logRotateCount ):
-    _logStream( stderr, QIODevice::WriteOnly ),
-    _nullStream( stderr, QIODevice::WriteOnly )
+		int		logRotateCount )
 {
     init();
-    createNullStream();
 
     QString logDir   = expandVariables( rawLogDir   );
     QString filename = expandVariables( rawFilename );
@@ -81,8 +151,9 @@ Logger::~Logger()
 {
     if ( _logFile.isOpen() )
     {
-	logInfo() << "-- Log End --\n" << endl;
-	_logFile.close();
+	logSuppressedWarnings();
+	log( __FILE__, __LINE__, __FUNCTION__, LogSeverityInfo )
+	    << "-- Log End --\n" << endl;
     }
 
     if ( this == _defaultLogger )
@@ -94,33 +165,50 @@ Logger::~Logger()
 	qInstallMessageHandler(0); // Restore default message handler
 #endif
     }
+
+    // Only now that Qt messages no longer come here: Writing to the closed
+    // log buffer would make Qt complain about that. Other threads that
+    // still log write to stderr from now on.
+
+    logStream().flush();
+    _logBuffer.stop();
+    _logFile.close();
 }
 
 
 void Logger::init()
 {
-    _logLevel = LogSeverityVerbose;
-    _nullDevice.setFileName( "/dev/null" );
+    _logLevel	      = LogSeverityVerbose;
+    _pid	      = (int) getpid();
+    _maxWarnings      = DEFAULT_MAX_WARNINGS;
+    _warningWindowSec = DEFAULT_WARNING_WINDOW;
 }
 
 
-void Logger::createNullStream()
+LogThreadStreams * Logger::threadStreams()
 {
-    // Open the null device to suppress output below the log level: This is
-    // necessary because each call to operator<<() for QTextStream returns the
-    // QTextStream, so we really need to return _nullStream (connected with
-    // /dev/null) to actually suppress anything; otherwise, it's just the
-    // logger time stamp etc. that gets suppressed, not the real logging
-    // output.
+    // QTextStream is not thread-safe, so each thread formats its lines in
+    // a stream of its own. The null stream suppresses the output below
+    // the log level: Each call to operator<<() returns the stream, so just
+    // skipping the prefix would not suppress the message itself.
 
-    if ( _nullDevice.open( QIODevice::WriteOnly | QIODevice::Text ) )
-    {
-	_nullStream.setDevice( &_nullDevice );
-    }
-    else
-    {
-	fprintf( stderr, "ERROR: Can't open /dev/null to suppress log output\n" );
-    }
+    if ( ! _threadStreams.hasLocalData() )
+	_threadStreams.setLocalData( new LogThreadStreams( this ) );
+
+    return _threadStreams.localData();
+}
+
+
+QTextStream & Logger::logStream()
+{
+    return threadStreams()->logStream;
+}
+
+
+void Logger::writeLines( const char * data, qint64 len )
+{
+    if ( ! _logBuffer.append( data, len ) )
+	fwrite( data, 1, len, stderr );
 }
 
 
@@ -138,8 +226,12 @@ void Logger::openLogFile( const QString & filename )
 		setDefaultLogger();
 
 	    fprintf( stderr, "Logging to %s\n", qPrintable( filename ) );
-	    _logStream.setDevice( &_logFile );
-	    _logStream << "\n\n";
+
+	    // Write the log file in a background thread: Writing each line
+	    // directly makes logging dominate when there are many warnings.
+
+	    _logBuffer.start( &_logFile );
+	    logStream() << "\n\n";
 	    log( __FILE__, __LINE__, __FUNCTION__, LogSeverityInfo )
 		<< "-- Log Start --" << endl;
 	}
@@ -168,15 +260,18 @@ QTextStream & Logger::log( Logger *	  logger,
 			   const QString &srcFunction,
 			   LogSeverity	  severity )
 {
-    static QTextStream stderrStream( stderr, QIODevice::WriteOnly );
+    static QThreadStorage<QTextStream *> stderrStreams;
 
     if ( ! logger )
 	logger = Logger::defaultLogger();
 
     if ( logger )
 	return logger->log( srcFile, srcLine, srcFunction, severity );
-    else
-	return stderrStream;
+
+    if ( ! stderrStreams.hasLocalData() )
+	stderrStreams.setLocalData( new QTextStream( stderr, QIODevice::WriteOnly ) );
+
+    return *stderrStreams.localData();
 }
 
 
@@ -185,9 +280,31 @@ QTextStream & Logger::log( const QString &srcFile,
 			   const QString &srcFunction,
 			   LogSeverity	  severity )
 {
+    LogThreadStreams * streams = threadStreams();
+
     if ( severity < _logLevel )
-	return _nullStream;
+	return streams->nullStream;
+
+    if ( severity == LogSeverityWarning && _maxWarnings > 0 &&
+	 rateLimited( srcFile, srcLine, srcFunction ) )
+    {
+	return streams->nullStream;
+    }
+
+    if ( severity == LogSeverityError )
+	_logBuffer.setUrgent();
+
+    writePrefix( srcFile, srcLine, srcFunction, severity );
+
+    return streams->logStream;
+}
+
 
+void Logger::writePrefix( const QString & srcFile,
+			  int		  srcLine,
+			  const QString & srcFunction,
+			  LogSeverity	  severity )
+{
     QString sev;
 
     switch ( severity )
@@ -201,24 +318,89 @@ QTextStream & Logger::log( const QString &srcFile,
 	    // complain about unhandled enum values
     }
 
-    _logStream << Logger::timeStamp() << " "
-	       << "[" << (int) getpid() << "] "
-	       << sev << " ";
+    QTextStream & stream = logStream();
+
+    stream << Logger::timeStamp() << " "
+	   << "[" << _pid << "] "
+	   << sev << " ";
 
     if ( ! srcFile.isEmpty() )
     {
-	_logStream << srcFile;
+	stream << srcFile;
 
 	if ( srcLine > 0 )
-	    _logStream << ":" << srcLine;
+	    stream << ":" << srcLine;
 
-	_logStream << " ";
+	stream << " ";
 
 	if ( ! srcFunction.isEmpty() )
-	_logStream << srcFunction << "():  ";
+	stream << srcFunction << "():  ";
+    }
+}
+
+
+bool Logger::rateLimited( const QString & srcFile,
+			  int		  srcLine,
+			  const QString & srcFunction )
+{
+    QMutexLocker locker( &_rateLimitMutex );
+
+    time_t now = time( 0 );
+    LogRateLimit & limit = _rateLimits[ srcFile + ":" + QString::number( srcLine ) ];
+
+    if ( now - limit.windowStart >= _warningWindowSec )
+    {
+	if ( limit.suppressed > 0 )
+	{
+	    // This thread's own stream: The mutex is only for the limits
+
+	    writePrefix( srcFile, srcLine, srcFunction, LogSeverityWarning );
+	    logStream() << "(" << limit.suppressed << " more warnings from here suppressed)"
+			<< endl;
+	}
+
+	limit.windowStart = now;
+	limit.count	  = 0;
+	limit.suppressed  = 0;
     }
 
-    return _logStream;
+    if ( ++limit.count <= _maxWarnings )
+	return false;
+
+    ++limit.suppressed;
+
+    return true;
+}
+
+
+void Logger::logSuppressedWarnings()
+{
+    QMutexLocker locker( &_rateLimitMutex );
+
+    QHash<QString, LogRateLimit>::iterator it = _rateLimits.begin();
+
+    while ( it != _rateLimits.end() )
+    {
+	if ( it.value().suppressed > 0 )
+	{
+	    writePrefix( "", 0, "", LogSeverityWarning );
+	    logStream() << it.value().suppressed << " more warnings from "
+			<< it.key() << " suppressed" << endl;
+
+	    it.value().suppressed = 0;
+	}
+
+	++it;
+    }
+}
+
+
+void Logger::setWarningRateLimit( int maxWarnings, int windowSec )
+{
+    QMutexLocker locker( &_rateLimitMutex );
+
+    _maxWarnings      = qMax( maxWarnings, 0 );
+    _warningWindowSec = qMax( windowSec, 1 );
 }
 
 
@@ -256,13 +438,52 @@ void Logger::setLogLevel( Logger *logger, LogSeverity newLevel )
 
 void Logger::newline()
 {
-    _logStream << endl;
+    logStream() << endl;
+}
+
+
+void Logger::flush( Logger *logger )
+{
+    if ( ! logger )
+	logger = Logger::defaultLogger();
+
+    if ( logger )
+	logger->flush();
+}
+
+
+void Logger::flush()
+{
+    // Only this thread's stream: The others are flushed with each endl
+
+    logStream().flush();
+    _logBuffer.flushNow();
 }
 
 
 QString Logger::timeStamp()
 {
-    return QDateTime::currentDateTime().toString( "yyyy-MM-dd hh:mm:ss.zzz" );
+    // Formatting the date and time is expensive, and there are often many
+    // log lines within the same second: Keep the last one for each thread.
+
+    static __thread time_t lastSec = -1;
+    static __thread char   secStamp[ 32 ];
+
+    struct timeval now;
+    gettimeofday( &now, 0 );
+
+    if ( now.tv_sec != lastSec )
+    {
+	struct tm localTime;
+	localtime_r( &now.tv_sec, &localTime );
+	strftime( secStamp, sizeof( secStamp ), "%Y-%m-%d %H:%M:%S", &localTime );
+	lastSec = now.tv_sec;
+    }
+
+    char stamp[ 40 ];
+    snprintf( stamp, sizeof( stamp ), "%s.%03d", secStamp, (int) ( now.tv_usec / 1000 ) );
+
+    return QString::fromLatin1( stamp );
 }
 
 
@@ -317,6 +538,7 @@ static void qt_logger( QtMsgType msgType, const char *msg)
 
     if ( msgType == QtFatalMsg )
     {
+	Logger::flush( 0 );
 	fprintf( stderr, "FATAL: %s\n", msg );
 	abort();
     }
@@ -342,6 +564,7 @@ static void qt_logger( QtMsgType msgType,
 
     if ( msgType == QtFatalMsg )
     {
+	Logger::flush( 0 );
 	fprintf( stderr, "FATAL: %s\n", qPrintable( msg ) );
 
 	if ( msg.contains( "Could not connect to display" ) )
@@ -10,10 +10,20 @@
 #ifndef Logger_h
 #define Logger_h
 
+#include <time.h>	// time_t
+
 #include <QString>
 #include <QStringList>
 #include <QFile>
 #include <QTextStream>
+#include <QHash>
+#include <QMutex>
+#include <QThreadStorage>
+
+#include "LogBuffer.h"
+
+
+struct LogThreadStreams;
 
 
 // Intentionally not using LogDebug, LogMilestone etc. to avoid confusion
@@ -61,6 +71,10 @@ enum LogSeverity
  * QByteArray, int).
  *
  * This class also redirects Qt logging (qDebug() etc.) to the same log file.
+ *
+ * Logging works from any thread: Each thread has a log stream of its own,
+ * and only complete lines go to the log file, so lines from different
+ * threads don't mix.
  */
 class Logger
 {
@@ -123,12 +137,32 @@ public:
     void newline();
     static void newline( Logger * logger );
 
+    /**
+     * Write everything that is buffered to the log file now, e.g. before
+     * aborting the program. Normally, the log file is written by a
+     * background thread.
+     *
+     * If 'logger' is 0, the default logger is used.
+     **/
+    void flush();
+    static void flush( Logger * logger );
+
     /**
      * Return a timestamp string in the format used in the log file:
      * "yyyy-MM-dd hh:mm:ss.zzz"
+     *
+     * The date and time part is only formatted again when the second
+     * changes.
      */
     static QString timeStamp();
 
+    /**
+     * Set the maximum number of warnings that are logged from the same
+     * line of source code within 'windowSec' seconds. The others are
+     * only counted, and their number is logged later. 0 means no limit.
+     **/
+    void setWarningRateLimit( int maxWarnings, int windowSec = 10 );
+
     /**
      * Prefix each line of a multi-line text with 'prefix'.
      */
@@ -159,9 +193,16 @@ public:
     static Logger * defaultLogger() { return _defaultLogger; }
 
     /**
-     * Return the QTextStream associated with this logger. Not for general use.
+     * Return the QTextStream of this logger for the current thread. Not for
+     * general use.
      */
-    QTextStream & logStream() { return _logStream; }
+    QTextStream & logStream();
+
+    /**
+     * Write 'len' bytes of complete log lines to the log file. This is
+     * called by the log streams of all threads.
+     **/
+    void writeLines( const char * data, qint64 len );
 
     /**
      * Return the current log level, i.e. the severity that will actually be
@@ -223,10 +264,10 @@ protected:
     void init();
 
     /**
-     * Create the null log stream to suppress messages below the current log
-     * level.
+     * Return the log stream and the null stream of the current thread.
+     * They are created on demand.
      **/
-    void createNullStream();
+    LogThreadStreams * threadStreams();
 
     /**
      * Actually open the log file.
@@ -260,15 +301,58 @@ protected:
      **/
     static QString oldNamePattern( const QString & filename );
 
+    /**
+     * Write the prefix of a log line to the log stream: The timestamp, the
+     * process ID, the severity and the location in the source code.
+     **/
+    void writePrefix( const QString & srcFile,
+		      int	      srcLine,
+		      const QString & srcFunction,
+		      LogSeverity     severity );
+
+    /**
+     * Return 'true' if a warning from 'srcFile':'srcLine' should be
+     * suppressed because there were too many recently. This also logs
+     * how many were suppressed when a new time window starts.
+     **/
+    bool rateLimited( const QString & srcFile,
+		      int	      srcLine,
+		      const QString & srcFunction );
+
+    /**
+     * Log the number of suppressed warnings for all locations.
+     **/
+    void logSuppressedWarnings();
+
 
 private:
 
+    /**
+     * Warnings from one line of source code in the current time window.
+     **/
+    struct LogRateLimit
+    {
+	LogRateLimit():
+	    windowStart( 0 ),
+	    count( 0 ),
+	    suppressed( 0 )
+	    {}
+
+	time_t	windowStart;
+	int	count;
+	int	suppressed;
+    };
+
     static Logger * _defaultLogger;
     QFile	    _logFile;
-    QTextStream	    _logStream;
-    QFile	    _nullDevice;
-    QTextStream	    _nullStream;
+    LogBuffer	    _logBuffer;
+    QThreadStorage<LogThreadStreams *> _threadStreams;
     LogSeverity	    _logLevel;
+    int		    _pid;
+    int		    _maxWarnings;
+    int		    _warningWindowSec;
+    QMutex	    _rateLimitMutex;
+    QHash<QString, LogRateLimit> _rateLimits;	// By "file:line"
 };
 
 
@@ -14,6 +14,9 @@
 #include <QFileDialog>
 #include <QSignalMapper>
 #include <QClipboard>
+#include <QFontDatabase>
+#include <QTimer>
+#include <QLabel>
 
 #include "MainWindow.h"
 #include "ActionManager.h"
@@ -22,22 +25,32 @@
 #include "ConfigDialog.h"
 #include "DataColumns.h"
 #include "DebugHelpers.h"
+#include "DeleteJob.h"
 #include "DirTree.h"
 #include "DirTreeCache.h"
+#include "BinaryCache.h"
 #include "DirTreeModel.h"
 #include "Exception.h"
 #include "ExcludeRules.h"
 #include "FileInfo.h"
+#include "FileAgeStatsWindow.h"
 #include "FileSizeStatsWindow.h"
+#include "FindFilesWindow.h"
+#include "LargestFilesWindow.h"
+#include "OwnerStatsWindow.h"
+#include "QueryWindow.h"
+#include "DuplicatesWindow.h"
+#include "ScanStatsWindow.h"
 #include "Logger.h"
+#include "MemoryStats.h"
 #include "MimeCategorizer.h"
 #include "MimeCategoryConfigPage.h"
 #include "OutputWindow.h"
-#include "Refresher.h"
 #include "SelectionModel.h"
 #include "Settings.h"
 #include "SettingsHelpers.h"
-#include "Trash.h"
+#include "StartupProfile.h"
+#include "TreeExporter.h"
 #include "Version.h"
 
 using namespace QDirStat;
@@ -54,14 +67,27 @@ MainWindow::MainWindow():
     _configDialog(0),
     _modified( false ),
     _verboseSelection( false ),
+    _logMemoryUsage( false ),
     _statusBarTimeout( 3000 ), // millisec
     _treeLevelMapper(0)
 {
     CHECK_PTR( _ui );
 
     _ui->setupUi( this );
+
+    // A permanent widget so the other status bar messages don't hide it
+
+    _progressLabel = new QLabel( this );
+    CHECK_NEW( _progressLabel );
+    _ui->statusBar->addPermanentWidget( _progressLabel );
+    _progressLabel->hide();
+    _progressTimer.setInterval( 1000 ); // millisec
+
+    connect( &_progressTimer, SIGNAL( timeout()		 ),
+	     this,	      SLOT  ( showReadProgress() ) );
     ActionManager::instance()->addWidgetTree( this );
     readSettings();
+    StartupProfile::milestone( "Main window widgets" );
 
     _dirTreeModel = new DirTreeModel( this );
     CHECK_NEW( _dirTreeModel );
@@ -88,11 +114,15 @@ MainWindow::MainWindow():
 
     _ui->dirTreeView->setCleanupCollection( _cleanupCollection );
     _ui->treemapView->setCleanupCollection( _cleanupCollection );
+    StartupProfile::milestone( "Models and cleanups" );
+
+    // The MIME categories are only read from the settings on first use
 
     _mimeCategorizer = new MimeCategorizer();
     CHECK_NEW( _mimeCategorizer );
 
     _ui->treemapView->setMimeCategorizer( _mimeCategorizer );
+    _dirTreeModel->tree()->setMimeCategorizer( _mimeCategorizer );
 
 #ifdef Q_OS_MACX
     // this makes the application to look like more "native" on macOS
@@ -112,6 +142,9 @@ MainWindow::MainWindow():
     connect( _dirTreeModel->tree(),	SIGNAL( aborted()	  ),
 	     this,			SLOT  ( readingAborted()  ) );
 
+    connect( _dirTreeModel->tree(),	SIGNAL( cacheWritten( QString, bool ) ),
+	     this,			SLOT  ( cacheWritten( QString, bool ) ) );
+
     connect( _selectionModel,  SIGNAL( selectionChanged() ),
 	     this,	       SLOT  ( updateActions()	 ) );
 
@@ -121,6 +154,15 @@ MainWindow::MainWindow():
     connect( _ui->treemapView, SIGNAL( treemapChanged() ),
 	     this,	       SLOT  ( updateActions()	 ) );
 
+    connect( _selectionModel,  SIGNAL( currentItemChanged( FileInfo *, FileInfo * ) ),
+	     this,	       SLOT  ( updateReadPriority()			   ) );
+
+    connect( _ui->treemapView, SIGNAL( treemapChanged()	 ),
+	     this,	       SLOT  ( updateReadPriority() ) );
+
+    connect( _ui->dirTreeView, SIGNAL( expanded    ( QModelIndex ) ),
+	     this,	       SLOT  ( itemExpanded( QModelIndex ) ) );
+
     connect( _cleanupCollection, SIGNAL( startingCleanup( QString ) ),
 	     this,		 SLOT  ( startingCleanup( QString ) ) );
 
@@ -152,6 +194,19 @@ MainWindow::MainWindow():
 
     toggleVerboseSelection();
     updateActions();
+
+    QTimer::singleShot( 0, this, SLOT( startupFinished() ) );
+}
+
+
+void MainWindow::startupFinished()
+{
+    StartupProfile::finish();
+
+    // Just to show the detected desktop in the log; the result is cached
+    // for the cleanups.
+
+    (void) Cleanup::desktopSpecificApps();
 }
 
 
@@ -168,6 +223,7 @@ MainWindow::~MainWindow()
 
     delete _ui->dirTreeView;
     delete _cleanupCollection;
+    _dirTreeModel->tree()->setMimeCategorizer( 0 );
     delete _mimeCategorizer;
     delete _selectionModel;
     delete _dirTreeModel;
@@ -183,13 +239,18 @@ void MainWindow::connectActions()
     // "File" menu
 
     CONNECT_ACTION( _ui->actionOpen,			    this, askOpenUrl()	    );
+    CONNECT_ACTION( _ui->actionOpenInNewWindow,		    this, askOpenUrlInNewWindow() );
     CONNECT_ACTION( _ui->actionRefreshAll,		    this, refreshAll()	    );
     CONNECT_ACTION( _ui->actionRefreshSelected,		    this, refreshSelected() );
     CONNECT_ACTION( _ui->actionReadExcludedDirectory,	    this, refreshSelected() );
     CONNECT_ACTION( _ui->actionContinueReadingAtMountPoint, this, refreshSelected() );
     CONNECT_ACTION( _ui->actionStopReading,		    this, stopReading()	    );
     CONNECT_ACTION( _ui->actionAskWriteCache,		    this, askWriteCache()   );
+    CONNECT_ACTION( _ui->actionAskExportTree,		    this, askExportTree()   );
     CONNECT_ACTION( _ui->actionAskReadCache,		    this, askReadCache()    );
+    CONNECT_ACTION( _ui->actionAskRefreshFromCache,	    this, askRefreshFromCache() );
+    CONNECT_ACTION( _ui->actionAskCompareWithCache,	    this, askCompareWithCache() );
+    CONNECT_ACTION( _ui->actionStopComparing,		    this, stopComparing()   );
     CONNECT_ACTION( _ui->actionQuit,			    qApp, quit()	    );
 
 
@@ -214,8 +275,17 @@ void MainWindow::connectActions()
 
     mapTreeExpandAction( _ui->actionCloseAllTreeLevels, 0 );
 
+    CONNECT_ACTION( _ui->actionExpandLargestPath, _ui->dirTreeView, expandLargestPath() );
+
     CONNECT_ACTION( _ui->actionFileSizeStats,	   this, showFileSizeStats() );
     CONNECT_ACTION( _ui->actionFileTypeStats,	   this, showFileTypeStats() );
+    CONNECT_ACTION( _ui->actionFileAgeStats,	   this, showFileAgeStats() );
+    CONNECT_ACTION( _ui->actionLargestFiles,	   this, showLargestFiles() );
+    CONNECT_ACTION( _ui->actionOwnerStats,	   this, showOwnerStats()   );
+    CONNECT_ACTION( _ui->actionDuplicates,	   this, showDuplicates()   );
+    CONNECT_ACTION( _ui->actionCountExtents,	   this, countExtents()	    );
+    CONNECT_ACTION( _ui->actionScanStats,	   this, showScanStats()    );
+    CONNECT_ACTION( _ui->actionMemoryUsage,	   this, showMemoryUsage()  );
 
     _ui->actionFileTypeStats->setShortcutContext( Qt::ApplicationShortcut );
 
@@ -225,6 +295,8 @@ void MainWindow::connectActions()
 
     CONNECT_ACTION( _ui->actionCopyUrlToClipboard, this, copyCurrentUrlToClipboard() );
     CONNECT_ACTION( _ui->actionMoveToTrash,	   this, moveToTrash() );
+    CONNECT_ACTION( _ui->actionFindFiles,	   this, showFindFiles() );
+    CONNECT_ACTION( _ui->actionQuery,		   this, showQuery()	 );
 
 
     // "Go To" menu
@@ -277,6 +349,31 @@ void MainWindow::mapTreeExpandAction( QAction * action, int level )
 }
 
 
+void MainWindow::updateReadPriority()
+{
+    DirTree * tree = _dirTreeModel->tree();
+
+    if ( ! tree->isBusy() )
+	return;
+
+    FileInfo * item = _selectionModel->currentItem();
+
+    if ( ! item )
+	item = _ui->treemapView->treemapRoot();
+
+    tree->setReadPriority( item );
+}
+
+
+void MainWindow::itemExpanded( const QModelIndex & index )
+{
+    DirTree * tree = _dirTreeModel->tree();
+
+    if ( tree->isBusy() && index.isValid() )
+	tree->setReadPriority( static_cast<FileInfo *>( index.internalPointer() ) );
+}
+
+
 void MainWindow::updateActions()
 {
     bool reading = _dirTreeModel->tree()->isBusy();
@@ -284,11 +381,16 @@ void MainWindow::updateActions()
     _ui->actionStopReading->setEnabled( reading );
     _ui->actionRefreshAll->setEnabled	( ! reading );
     _ui->actionAskReadCache->setEnabled ( ! reading );
+    _ui->actionAskRefreshFromCache->setEnabled( ! reading );
     _ui->actionAskWriteCache->setEnabled( ! reading );
+    _ui->actionAskExportTree->setEnabled( ! reading );
 
     bool haveCurrentItem = ( _selectionModel->currentItem() != 0 );
     bool treeNotEmpty	 = ( _dirTreeModel->tree()->firstToplevel() != 0 );
 
+    _ui->actionAskCompareWithCache->setEnabled( ! reading && treeNotEmpty );
+    _ui->actionStopComparing->setEnabled( _dirTreeModel->tree()->cacheDiff() != 0 );
+
     _ui->actionCopyUrlToClipboard->setEnabled( haveCurrentItem );
     _ui->actionGoUp->setEnabled( haveCurrentItem );
     _ui->actionGoToToplevel->setEnabled( treeNotEmpty );
@@ -307,6 +409,13 @@ void MainWindow::updateActions()
 
     _ui->actionFileSizeStats->setEnabled( ! reading && nothingOrOneDir );
     _ui->actionFileTypeStats->setEnabled( ! reading && nothingOrOneDir );
+    _ui->actionFileAgeStats->setEnabled( ! reading && nothingOrOneDir );
+    _ui->actionLargestFiles->setEnabled( ! reading && nothingOrOneDir );
+    _ui->actionOwnerStats->setEnabled( ! reading && nothingOrOneDir );
+    _ui->actionDuplicates->setEnabled( ! reading && nothingOrOneDir );
+    _ui->actionCountExtents->setEnabled( ! reading && treeNotEmpty && nothingOrOneDir );
+    _ui->actionFindFiles->setEnabled( treeNotEmpty && nothingOrOneDir );
+    _ui->actionQuery->setEnabled( ! reading && treeNotEmpty && nothingOrOneDir );
 
     bool showingTreemap = _ui->treemapView->isVisible();
 
@@ -403,6 +512,11 @@ void MainWindow::closeEvent( QCloseEvent *event )
     {
 	event->accept();
     }
+
+    // Aborting an unfinished scan writes a checkpoint (if enabled), so it
+    // can be resumed with --resume.
+
+    stopReading();
 }
 
 
@@ -445,18 +559,53 @@ void MainWindow::idleDisplay()
 void MainWindow::startingReading()
 {
     _stopWatch.start();
+    _progressTimer.start();
     busyDisplay();
 }
 
 
+void MainWindow::showReadProgress()
+{
+    ScanProgress progress = _dirTreeModel->tree()->scanProgress();
+    progress.update();
+
+    if ( progress.itemsRead() == 0 )	// Not reading from disk (yet)
+	return;
+
+    QString text = tr( "%1 items  (%2 / sec)" )
+	.arg( progress.itemsRead() )
+	.arg( (qint64) progress.itemsPerSec() );
+
+    if ( progress.hasEstimate() )
+    {
+	text += QString( "  %1%" ).arg( progress.percent() );
+
+	if ( progress.remainingSec() >= 0 )
+	{
+	    text += "  " + tr( "%1 left" )
+		.arg( formatTime( progress.remainingSec() * 1000 ) );
+	}
+    }
+
+    _progressLabel->setText( text );
+    _progressLabel->show();
+}
+
+
 void MainWindow::readingFinished()
 {
     logInfo() << endl;
 
+    _progressTimer.stop();
+    _progressLabel->hide();
+
     idleDisplay();
     _ui->statusBar->showMessage( tr( "Finished. Elapsed time: %1")
 				 .arg( formatTime( _stopWatch.elapsed() ) ) );
 
+    if ( _logMemoryUsage )
+	MemoryStats::logReport( MemoryStats::usage( _dirTreeModel->tree(), _ui->treemapView ) );
+
     // Debug::dumpModelTree( _dirTreeModel, QModelIndex(), "" );
 }
 
@@ -465,6 +614,9 @@ void MainWindow::readingAborted()
 {
     logInfo() << endl;
 
+    _progressTimer.stop();
+    _progressLabel->hide();
+
     idleDisplay();
     _ui->statusBar->showMessage( tr( "Aborted. Elapsed time: %1")
 				 .arg( formatTime( _stopWatch.elapsed() ) ) );
@@ -505,6 +657,22 @@ void MainWindow::askOpenUrl()
 }
 
 
+void MainWindow::askOpenUrlInNewWindow()
+{
+    QString url = QFileDialog::getExistingDirectory( this, // parent
+						     tr("Select directory to scan in a new window") );
+    if ( url.isEmpty() )
+	return;
+
+    MainWindow * window = new MainWindow();
+    CHECK_NEW( window );
+
+    window->setAttribute( Qt::WA_DeleteOnClose );
+    window->show();
+    window->openUrl( url );
+}
+
+
 void MainWindow::refreshAll()
 {
     QString url = _dirTreeModel->tree()->url();
@@ -540,12 +708,52 @@ void MainWindow::stopReading()
 }
 
 
-void MainWindow::readCache( const QString & cacheFileName )
+void MainWindow::readCache( const QString & cacheFileName,
+			    const QString & subtree )
+{
+    _dirTreeModel->clear();
+
+    if ( cacheFileName.isEmpty() )
+	return;
+
+    if ( subtree.isEmpty() )
+    {
+	bool ok;
+	MemoryUsage estimate = MemoryStats::estimateCache( cacheFileName, ok );
+
+	if ( ok )
+	{
+	    logInfo() << "Estimated memory for " << estimate.files + estimate.dirs
+		      << " items: " << formatSize( estimate.total() ) << endl;
+	}
+    }
+
+    _dirTreeModel->tree()->readCache( cacheFileName, subtree );
+}
+
+
+void MainWindow::mergeCaches( const QStringList & cacheFileNames )
+{
+    _dirTreeModel->clear();
+
+    if ( ! cacheFileNames.isEmpty() )
+	_dirTreeModel->tree()->mergeCaches( cacheFileNames );
+}
+
+
+void MainWindow::readRemote( const QString & host, const QString & dirName )
 {
     _dirTreeModel->clear();
+    _ui->statusBar->showMessage( tr( "Reading %1 on %2..." ).arg( dirName ).arg( host ) );
+    _dirTreeModel->tree()->readRemote( host, dirName );
+}
 
-    if ( ! cacheFileName.isEmpty() )
-	_dirTreeModel->tree()->readCache( cacheFileName );
+
+QString MainWindow::cacheFileFilter() const
+{
+    return tr( "QDirStat cache files (*.cache.gz *.cache.zst *%1 *%2);;All files (*)" )
+	.arg( BINARY_CACHE_SUFFIX )
+	.arg( COMPRESSED_BINARY_CACHE_SUFFIX );
 }
 
 
@@ -553,25 +761,116 @@ void MainWindow::askReadCache()
 {
     QString fileName = QFileDialog::getOpenFileName( this, // parent
 						     tr( "Select QDirStat cache file" ),
-						     DEFAULT_CACHE_NAME );
+						     DEFAULT_CACHE_NAME,
+						     cacheFileFilter() );
     if ( ! fileName.isEmpty() )
 	readCache( fileName );
 }
 
 
+void MainWindow::askRefreshFromCache()
+{
+    QString fileName = QFileDialog::getOpenFileName( this, // parent
+						     tr( "Select QDirStat cache file to refresh" ),
+						     DEFAULT_CACHE_NAME,
+						     cacheFileFilter() );
+    if ( ! fileName.isEmpty() )
+    {
+	_dirTreeModel->clear();
+	_dirTreeModel->tree()->refreshFromCache( fileName );
+    }
+}
+
+
+void MainWindow::compareWithCache( const QString & fileName )
+{
+    bool ok = _dirTreeModel->tree()->compareWithCache( fileName );
+
+    if ( ok )
+    {
+	// The "Growth" column is hidden by default
+
+	_ui->dirTreeView->setColumnHidden( DataColumns::toViewCol( GrowthCol ), false );
+    }
+
+    QString msg = ok ? tr( "Comparing with cache file %1" ).arg( fileName ) :
+		       tr( "ERROR reading cache file %1" ).arg( fileName );
+    _ui->statusBar->showMessage( msg, _statusBarTimeout );
+    updateActions();
+}
+
+
+void MainWindow::askCompareWithCache()
+{
+    QString fileName = QFileDialog::getOpenFileName( this, // parent
+						     tr( "Select older QDirStat cache file to compare with" ),
+						     DEFAULT_CACHE_NAME,
+						     tr( "QDirStat cache files (*.cache.gz *.cache.zst);;All files (*)" ) );
+    if ( ! fileName.isEmpty() )
+	compareWithCache( fileName );
+}
+
+
+void MainWindow::stopComparing()
+{
+    _dirTreeModel->tree()->clearCacheDiff();
+    updateActions();
+}
+
+
 void MainWindow::askWriteCache()
 {
     QString fileName = QFileDialog::getSaveFileName( this, // parent
 						     tr( "Enter name for QDirStat cache file"),
-						     DEFAULT_CACHE_NAME );
+						     DEFAULT_CACHE_NAME,
+						     cacheFileFilter() );
     if ( ! fileName.isEmpty() )
     {
-	bool ok = _dirTreeModel->tree()->writeCache( fileName );
+	// The tree is written in the background; cacheWritten() reports
+	// the result
+
+	if ( _dirTreeModel->tree()->writeCacheInBackground( fileName ) )
+	    _ui->statusBar->showMessage( tr( "Writing cache file %1..." ).arg( fileName ) );
+	else
+	    _ui->statusBar->showMessage( tr( "ERROR writing cache file %1").arg( fileName ),
+					 _statusBarTimeout );
+    }
+}
+
+
+void MainWindow::cacheWritten( const QString & fileName, bool ok )
+{
+    QString msg = ok ? tr( "Directory tree written to file %1" ).arg( fileName ) :
+		       tr( "ERROR writing cache file %1").arg( fileName );
+    _ui->statusBar->showMessage( msg, _statusBarTimeout );
+}
+
+
+void MainWindow::askExportTree()
+{
+    QString fileName = QFileDialog::getSaveFileName( this, // parent
+						     tr( "Export directory tree" ),
+						     "qdirstat-export.csv",
+						     tr( "CSV files (*.csv *.csv.gz);;"
+							 "JSON lines files (*.jsonl *.ndjson *.jsonl.gz *.ndjson.gz)" ) );
+    if ( fileName.isEmpty() )
+	return;
 
-	QString msg = ok ? tr( "Directory tree written to file %1" ).arg( fileName ) :
-			   tr( "ERROR writing cache file %1").arg( fileName );
-	_ui->statusBar->showMessage( msg, _statusBarTimeout );
+    bool formatOk;
+    TreeExporter::Format format = TreeExporter::formatForName( fileName, formatOk );
+
+    if ( ! formatOk )
+    {
+	fileName += ".csv";
+	format = TreeExporter::CsvFormat;
     }
+
+    TreeExporter exporter( format );
+    bool ok = exporter.exportTree( fileName, _dirTreeModel->tree() );
+
+    QString msg = ok ? tr( "Directory tree exported to file %1" ).arg( fileName ) :
+		       tr( "ERROR exporting to file %1" ).arg( fileName );
+    _ui->statusBar->showMessage( msg, _statusBarTimeout );
 }
 
 
@@ -579,10 +878,7 @@ void MainWindow::expandTreeToLevel( int level )
 {
     logDebug() << "Expanding tree to level " << level << endl;
 
-    if ( level < 1 )
-	_ui->dirTreeView->collapseAll();
-    else
-	_ui->dirTreeView->expandToDepth( level - 1 );
+    _ui->dirTreeView->expandToLevel( level );
 }
 
 
@@ -700,30 +996,17 @@ void MainWindow::moveToTrash()
 
     OutputWindow * outputWindow = new OutputWindow( qApp->activeWindow() );
     CHECK_NEW( outputWindow );
-
-    // Prepare refresher
-
-    FileInfoSet refreshSet = Refresher::parents( selectedItems );
-    _selectionModel->prepareRefresh( refreshSet );
-    Refresher * refresher  = new Refresher( refreshSet, this );
-    CHECK_NEW( refresher );
-
-    connect( outputWindow, SIGNAL( lastProcessFinished( int ) ),
-	     refresher,	   SLOT	 ( refresh()		      ) );
-
     outputWindow->showAfterTimeout();
 
-    // Move all selected items to trash
+    // Move all selected items to trash in a worker thread. No refresh
+    // needed: The job removes them from the tree as soon as they are gone.
 
-    foreach ( FileInfo * item, selectedItems )
-    {
-	bool success = Trash::trash( item->url() );
+    DeleteJob * job = new DeleteJob( DeleteJob::MoveToTrash, outputWindow );
+    CHECK_NEW( job );
 
-	if ( success )
-	    outputWindow->addStdout( tr( "Moved to trash: %1" ).arg( item->url() ) );
-	else
-	    outputWindow->addStderr( tr( "Move to trash failed for %1" ).arg( item->url() ) );
-    }
+    job->addItems( selectedItems );
+    outputWindow->addJob( job );
+    job->start();
 
     outputWindow->noMoreProcesses();
 }
@@ -785,6 +1068,156 @@ void MainWindow::showFileSizeStats()
 }
 
 
+void MainWindow::showFileAgeStats()
+{
+    if ( ! _fileAgeStatsWindow )
+    {
+        // This deletes itself when the user closes it. The associated QPointer
+        // keeps track of that and sets the pointer to 0 when it happens.
+
+        _fileAgeStatsWindow = new QDirStat::FileAgeStatsWindow( this );
+    }
+
+    _fileAgeStatsWindow->populate( selectedDirOrRoot() );
+    _fileAgeStatsWindow->show();
+    _fileAgeStatsWindow->raise();
+}
+
+
+void MainWindow::showLargestFiles()
+{
+    if ( ! _largestFilesWindow )
+    {
+        // This deletes itself when the user closes it. The associated QPointer
+        // keeps track of that and sets the pointer to 0 when it happens.
+
+        _largestFilesWindow = new QDirStat::LargestFilesWindow( _selectionModel, this );
+    }
+
+    _largestFilesWindow->populate( selectedDirOrRoot() );
+    _largestFilesWindow->show();
+    _largestFilesWindow->raise();
+}
+
+
+void MainWindow::showOwnerStats()
+{
+    if ( ! _ownerStatsWindow )
+    {
+        // This deletes itself when the user closes it. The associated QPointer
+        // keeps track of that and sets the pointer to 0 when it happens.
+
+        _ownerStatsWindow = new QDirStat::OwnerStatsWindow( this );
+    }
+
+    _ownerStatsWindow->populate( selectedDirOrRoot() );
+    _ownerStatsWindow->show();
+    _ownerStatsWindow->raise();
+}
+
+
+void MainWindow::showDuplicates()
+{
+    if ( ! _duplicatesWindow )
+    {
+        // This deletes itself when the user closes it. The associated QPointer
+        // keeps track of that and sets the pointer to 0 when it happens.
+
+        _duplicatesWindow = new QDirStat::DuplicatesWindow( _selectionModel,
+                                                            _cleanupCollection,
+                                                            this );
+    }
+
+    _duplicatesWindow->populate( selectedDirOrRoot() );
+    _duplicatesWindow->show();
+    _duplicatesWindow->raise();
+}
+
+
+void MainWindow::countExtents()
+{
+    FileInfo * subtree = selectedDirOrRoot();
+
+    if ( ! subtree )
+	return;
+
+    _dirTreeModel->tree()->countExtents( subtree );
+
+    // The "Exclusive Size" column is hidden by default
+
+    _ui->dirTreeView->setColumnHidden( DataColumns::toViewCol( ExclusiveSizeCol ), false );
+    _ui->statusBar->showMessage( tr( "Counting the exclusive disk space below %1..." )
+				 .arg( subtree->url() ), _statusBarTimeout );
+}
+
+
+void MainWindow::showScanStats()
+{
+    if ( ! _scanStatsWindow )
+    {
+        // This deletes itself when the user closes it. The associated QPointer
+        // keeps track of that and sets the pointer to 0 when it happens.
+
+        _scanStatsWindow = new ScanStatsWindow( this, _dirTreeModel->tree() );
+    }
+
+    _scanStatsWindow->show();
+    _scanStatsWindow->raise();
+}
+
+
+void MainWindow::showMemoryUsage()
+{
+    MemoryUsage usage = MemoryStats::usage( _dirTreeModel->tree(), _ui->treemapView );
+    MemoryStats::logReport( usage );
+
+    QMessageBox box( QMessageBox::Information,		// icon
+		     tr( "Memory Usage" ),		// title
+		     MemoryStats::report( usage ),	// text
+		     QMessageBox::Ok,			// buttons
+		     this );				// parent
+    box.setTextFormat( Qt::PlainText );
+    box.setFont( QFontDatabase::systemFont( QFontDatabase::FixedFont ) );
+    box.exec();
+}
+
+
+void MainWindow::showFindFiles()
+{
+    if ( ! _findFilesWindow )
+    {
+        // This deletes itself when the user closes it. The associated QPointer
+        // keeps track of that and sets the pointer to 0 when it happens.
+
+        _findFilesWindow = new QDirStat::FindFilesWindow( _selectionModel, this );
+    }
+
+    _findFilesWindow->populate( selectedDirOrRoot() );
+    _findFilesWindow->show();
+    _findFilesWindow->raise();
+    _findFilesWindow->activateWindow();
+}
+
+
+void MainWindow::showQuery()
+{
+    if ( ! _queryWindow )
+    {
+        // This deletes itself when the user closes it. The associated QPointer
+        // keeps track of that and sets the pointer to 0 when it happens.
+
+        _queryWindow = new QDirStat::QueryWindow( _selectionModel,
+                                                  _cleanupCollection,
+                                                  this );
+    }
+
+    _queryWindow->populate( selectedDirOrRoot() );
+    _queryWindow->show();
+    _queryWindow->raise();
+    _queryWindow->activateWindow();
+}
+
+
 FileInfo * MainWindow::selectedDirOrRoot() const
 {
     FileInfoSet selectedItems = _selectionModel->selectedItems();
@@ -12,13 +12,23 @@
 
 #include <QMainWindow>
 #include <QString>
+#include <QStringList>
 #include <QElapsedTimer>
 #include <QPointer>
+#include <QTimer>
 
 #include "ui_main-window.h"
+#include "FileAgeStatsWindow.h"
 #include "FileTypeStatsWindow.h"
+#include "FindFilesWindow.h"
+#include "LargestFilesWindow.h"
+#include "OwnerStatsWindow.h"
+#include "QueryWindow.h"
+#include "DuplicatesWindow.h"
+#include "ScanStatsWindow.h"
 
 class QCloseEvent;
+class QLabel;
 class QSortFilterProxyModel;
 class QSignalMapper;
 
@@ -34,7 +44,14 @@ namespace QDirStat
 }
 
 using QDirStat::FileInfo;
+using QDirStat::FileAgeStatsWindow;
 using QDirStat::FileTypeStatsWindow;
+using QDirStat::FindFilesWindow;
+using QDirStat::LargestFilesWindow;
+using QDirStat::OwnerStatsWindow;
+using QDirStat::QueryWindow;
+using QDirStat::DuplicatesWindow;
+using QDirStat::ScanStatsWindow;
 
 
 class MainWindow: public QMainWindow
@@ -63,6 +80,14 @@ public slots:
      **/
     void askOpenUrl();
 
+    /**
+     * Open a directory selection dialog and open the selected URL in a
+     * new main window. All windows and their trees are in this process,
+     * so they share the interned names and the worker threads for
+     * reading.
+     **/
+    void askOpenUrlInNewWindow();
+
     /**
      * Re-read the complete directory tree.
      **/
@@ -80,9 +105,29 @@ public slots:
 
     /**
      * Clear the current tree and replace it with the content of the specified
-     * cache file.
+     * cache file. If 'subtree' is not empty, read only that directory and
+     * everything below it.
+     **/
+    void readCache( const QString & cacheFileName,
+		    const QString & subtree = QString() );
+
+    /**
+     * Clear the current tree and replace it with the merged content of
+     * several cache files. See DirTree::mergeCaches().
      **/
-    void readCache( const QString & cacheFileName );
+    void mergeCaches( const QStringList & cacheFileNames );
+
+    /**
+     * Clear the current tree and read directory 'dirName' on 'host' over
+     * ssh. See DirTree::readRemote().
+     **/
+    void readRemote( const QString & host, const QString & dirName );
+
+    /**
+     * Write the memory usage of the tree to the log each time reading is
+     * finished.
+     **/
+    void setLogMemoryUsage( bool enable ) { _logMemoryUsage = enable; }
 
     /**
      * Open a file selection dialog to ask for a cache file, clear the
@@ -90,12 +135,43 @@ public slots:
      **/
     void askReadCache();
 
+    /**
+     * Open a file selection dialog to ask for a cache file, clear the
+     * current tree and replace it with the content of the cache file,
+     * rereading the directories that changed on disk since the cache file
+     * was written.
+     **/
+    void askRefreshFromCache();
+
+    /**
+     * Compare the current tree with the older cache file 'fileName' and
+     * show the growth of each directory in the tree view and the treemap.
+     **/
+    void compareWithCache( const QString & fileName );
+
+    /**
+     * Open a file selection dialog to ask for an older cache file to
+     * compare the current tree with.
+     **/
+    void askCompareWithCache();
+
+    /**
+     * Stop comparing the current tree with an older cache file.
+     **/
+    void stopComparing();
+
     /**
      * Open a file selection dialog and save the current tree to the selected
      * file.
      **/
     void askWriteCache();
 
+    /**
+     * Open a file selection dialog and export the current tree to the
+     * selected file as CSV or JSON lines.
+     **/
+    void askExportTree();
+
     /**
      * Expand the directory tree's branches to depth 'level'.
      **/
@@ -160,6 +236,12 @@ public slots:
 
 protected slots:
 
+    /**
+     * Initialization that is not needed for the first paint. This is
+     * called when the event loop is running.
+     **/
+    void startupFinished();
+
     /**
      * Switch display to "busy display" after reading was started and restart
      * the stopwatch.
@@ -176,6 +258,18 @@ protected slots:
      **/
     void readingAborted();
 
+    /**
+     * Show the result of writing cache file 'fileName' in the background.
+     **/
+    void cacheWritten( const QString & fileName, bool ok );
+
+    /**
+     * Show how far reading is: The number of items and how fast they are
+     * read and, if there is an estimate, the percentage and the time that
+     * is left (see ScanProgress).
+     **/
+    void showReadProgress();
+
     /**
      * Change display mode to "busy" (while reading a directory tree):
      * Sort tree view by read jobs, hide treemap view.
@@ -194,6 +288,17 @@ protected slots:
      **/
     void updateActions();
 
+    /**
+     * Read the subtree the user is looking at - the current item or the
+     * root of the treemap - before all other directories.
+     **/
+    void updateReadPriority();
+
+    /**
+     * A branch was expanded in the tree view: Read its subtree first.
+     **/
+    void itemExpanded( const QModelIndex & index );
+
     /**
      * Enable or disable the treemap view, depending on the value of
      * the corresponding action.
@@ -234,6 +339,54 @@ protected slots:
      **/
     void showFileSizeStats();
 
+    /**
+     * Show file age statistics for the currently selected directory.
+     **/
+    void showFileAgeStats();
+
+    /**
+     * Show the largest files in the currently selected directory.
+     **/
+    void showLargestFiles();
+
+    /**
+     * Open the "disk usage by owner" window for the currently selected
+     * directory.
+     **/
+    void showOwnerStats();
+
+    /**
+     * Show the files with the same content in the currently selected
+     * directory.
+     **/
+    void showDuplicates();
+
+    /**
+     * Count the exclusive disk space in the currently selected directory
+     * in the background and show it in the "Exclusive Size" column.
+     **/
+    void countExtents();
+
+    /**
+     * Show the live statistics of reading directories.
+     **/
+    void showScanStats();
+
+    /**
+     * Show how much memory the current tree and the treemap need.
+     **/
+    void showMemoryUsage();
+
+    /**
+     * Open the "find files" window for the currently selected directory.
+     **/
+    void showFindFiles();
+
+    /**
+     * Open the "query" window for the currently selected directory.
+     **/
+    void showQuery();
+
     /**
      * Switch verbose logging for selection changes on or off.
      *
@@ -293,6 +446,11 @@ protected:
      **/
     QString formatTime( qint64 millisec );
 
+    /**
+     * Return the file name filter for the cache file dialogs.
+     **/
+    QString cacheFileFilter() const;
+
 
 private:
 
@@ -302,10 +460,20 @@ private:
     QDirStat::CleanupCollection * _cleanupCollection;
     QDirStat::MimeCategorizer	* _mimeCategorizer;
     QDirStat::ConfigDialog	* _configDialog;
+    QPointer<FileAgeStatsWindow>  _fileAgeStatsWindow;
     QPointer<FileTypeStatsWindow> _fileTypeStatsWindow;
+    QPointer<FindFilesWindow>	  _findFilesWindow;
+    QPointer<LargestFilesWindow>  _largestFilesWindow;
+    QPointer<OwnerStatsWindow>	  _ownerStatsWindow;
+    QPointer<QueryWindow>	  _queryWindow;
+    QPointer<DuplicatesWindow>	  _duplicatesWindow;
+    QPointer<ScanStatsWindow>	  _scanStatsWindow;
     QElapsedTimer		  _stopWatch;
+    QTimer			  _progressTimer;
+    QLabel			* _progressLabel;
     bool			  _modified;
     bool			  _verboseSelection;
+    bool			  _logMemoryUsage;
     int				  _statusBarTimeout; // millisec
     QSignalMapper	       * _treeLevelMapper;
 };
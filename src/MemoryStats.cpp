@@ -0,0 +1,288 @@
+/*
+ *   File name: MemoryStats.cpp
+ *   Summary:	Memory usage accounting for DirTree and treemap
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <string.h>
+#include <fcntl.h>
+
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <QtEndian>
+
+#include "MemoryStats.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "ColdSubtree.h"
+#include "CompactName.h"
+#include "NodePool.h"
+#include "CacheBudget.h"
+#include "BinaryCache.h"
+#include "CacheStream.h"
+#include "TreemapView.h"
+#include "Logger.h"
+
+
+#define SAMPLE_SIZE	( 4 * 1024 * 1024 )	// Uncompressed bytes of a text cache
+#define MAX_LINE	( 64 * 1024 )
+
+using namespace QDirStat;
+
+
+/**
+ * Return 'size' rounded up to the granularity of the NodePool.
+ **/
+static qint64 poolSize( qint64 size )
+{
+    return ( size + 7 ) & ~7LL;
+}
+
+
+MemoryUsage MemoryStats::usage( DirTree * tree, TreemapView * treemapView )
+{
+    MemoryUsage usage;
+
+    if ( tree && tree->root() )
+	addSubtree( usage, tree->root() );
+
+    addNodeBytes( usage );
+
+    if ( treemapView )
+	treemapView->addMemoryUsage( usage );
+
+    return usage;
+}
+
+
+void MemoryStats::addSubtree( MemoryUsage & usage, FileInfo * subtree )
+{
+    const CompactName & name = subtree->compactName();
+    usage.nameBytes += poolSize( name.privateBytes() );
+
+    if ( name.utf8Length() > CompactName::InlineMaxLen && name.privateBytes() == 0 )
+	++usage.internedNames;
+
+    if ( ! subtree->isDirInfo() )
+    {
+	++usage.files;
+	return;
+    }
+
+    DirInfo * dir = subtree->toDirInfo();
+    ++usage.dirs;
+    usage.sortCacheBytes  += dir->sortCacheBytes();
+    usage.childIndexBytes += dir->childIndexBytes();
+    usage.childArrayBytes += dir->childArrayBytes();
+
+    if ( dir->isCold() )
+    {
+	++usage.coldSubtrees;
+	usage.coldNodes += dir->coldSubtree()->nodes();
+	usage.coldBytes += poolSize( dir->coldSubtree()->bytes() ) + poolSize( sizeof( ColdSubtree ) );
+    }
+
+    for ( FileInfo * child = dir->firstChild(); child; child = child->next() )
+	addSubtree( usage, child );
+
+    if ( dir->dotEntry() )
+	addSubtree( usage, dir->dotEntry() );
+}
+
+
+void MemoryStats::addNodeBytes( MemoryUsage & usage )
+{
+    usage.nodeBytes = usage.files * poolSize( sizeof( FileInfo ) ) +
+	usage.dirs * poolSize( sizeof( DirInfo ) );
+}
+
+
+MemoryUsage MemoryStats::estimateCache( const QString & cacheFileName, bool & ok )
+{
+    MemoryUsage usage;
+
+    if ( BinaryCacheReader::isBinaryCache( cacheFileName ) )
+	ok = estimateBinaryCache( cacheFileName, usage );
+    else
+	ok = estimateTextCache( cacheFileName, usage );
+
+    addNodeBytes( usage );
+
+    return usage;
+}
+
+
+bool MemoryStats::estimateBinaryCache( const QString & cacheFileName, MemoryUsage & usage )
+{
+    QFile file( cacheFileName );
+    BinaryCacheHeader header;
+
+    if ( ! file.open( QIODevice::ReadOnly ) ||
+	 file.read( (char *) &header, sizeof( header ) ) != (qint64) sizeof( header ) ||
+	 memcmp( header.magic, BINARY_CACHE_MAGIC, sizeof( header.magic ) ) != 0 )
+    {
+	logError() << "Can't read the header of " << cacheFileName << endl;
+	return false;
+    }
+
+    qint64 nodeCount	   = qFromLittleEndian<quint64>( header.nodeCount );
+    qint64 dirCount	   = qFromLittleEndian<quint64>( header.dirCount  );
+    qint64 stringTableSize = qFromLittleEndian<quint64>( header.stringTableSize );
+
+    // Assume that each directory has files and thus a dot entry
+
+    usage.files = nodeCount - dirCount;
+    usage.dirs	= 2 * dirCount;
+
+    // Only the average name length is known
+
+    qint64 averageLen = nodeCount > 0 ? stringTableSize / nodeCount : 0;
+
+    if ( averageLen > CompactName::InternMaxLen )
+	usage.nameBytes = nodeCount * poolSize( sizeof( int ) + averageLen );
+    else if ( averageLen > CompactName::InlineMaxLen )
+	usage.internedNames = nodeCount;
+
+    return true;
+}
+
+
+bool MemoryStats::estimateTextCache( const QString & cacheFileName, MemoryUsage & usage )
+{
+    int fd = ::open( cacheFileName.toUtf8(), O_RDONLY | O_CLOEXEC );
+
+    if ( fd < 0 )
+    {
+	logError() << "Can't open " << cacheFileName << endl;
+	return false;
+    }
+
+    CacheInput cache( fd );	// gzip, zstd or uncompressed
+
+    QByteArray buffer( MAX_LINE, 0 );
+    qint64 uncompressed = 0;
+    qint64 dotEntries	= 0;
+    bool   dirHasFiles	= true;
+
+    while ( uncompressed < SAMPLE_SIZE && cache.gets( buffer.data(), buffer.size() ) )
+    {
+	const char * line = buffer.constData();
+	int len = strlen( line );
+	uncompressed += len;
+
+	if ( len < 2 || line[0] == '#' || line[0] == '[' || line[0] == '\n' )
+	    continue;
+
+	// The name is the second field; of a directory, its last path
+	// component. URL encoding makes some names look a little longer.
+
+	const char * name = line + strcspn( line, " \t" );
+	name += strspn( name, " \t" );
+	int nameLen = strcspn( name, "\t\n" );
+
+	if ( line[0] == 'D' && ( line[1] == ' ' || line[1] == '\t' ) )
+	{
+	    ++usage.dirs;
+	    dirHasFiles = false;
+
+	    const char * slash = (const char *) memrchr( name, '/', nameLen );
+
+	    if ( slash )
+	    {
+		nameLen -= slash + 1 - name;
+		name	 = slash + 1;
+	    }
+	}
+	else
+	{
+	    ++usage.files;
+
+	    if ( ! dirHasFiles )
+	    {
+		++dotEntries;
+		dirHasFiles = true;
+	    }
+	}
+
+	if ( nameLen > CompactName::InternMaxLen )
+	    usage.nameBytes += poolSize( sizeof( int ) + nameLen );
+	else if ( nameLen > CompactName::InlineMaxLen )
+	    ++usage.internedNames;
+    }
+
+    bool   atEnd      = cache.eof();
+    qint64 compressed = cache.compressedPosition();
+
+    usage.dirs += dotEntries;
+
+    if ( ! atEnd && compressed > 0 )
+    {
+	double factor = (double) QFileInfo( cacheFileName ).size() / compressed;
+
+	usage.files	    = (qint64) ( usage.files	     * factor );
+	usage.dirs	    = (qint64) ( usage.dirs	     * factor );
+	usage.nameBytes	    = (qint64) ( usage.nameBytes     * factor );
+	usage.internedNames = (qint64) ( usage.internedNames * factor );
+    }
+
+    return true;
+}
+
+
+QString MemoryStats::report( const MemoryUsage & usage )
+{
+    QStringList lines;
+
+    lines << QString( "Files:        %1" ).arg( usage.files )
+	  << QString( "Directories:  %1 (including dot entries)" ).arg( usage.dirs )
+	  << QString( "Nodes:        %1" ).arg( formatSize( usage.nodeBytes ) )
+	  << QString( "Names:        %1 (%2 more names are interned)" )
+	     .arg( formatSize( usage.nameBytes ) ).arg( usage.internedNames )
+	  << QString( "Name index:   %1" ).arg( formatSize( usage.childIndexBytes ) )
+	  << QString( "Child arrays: %1" ).arg( formatSize( usage.childArrayBytes ) )
+	  << QString( "Sort caches:  %1" ).arg( formatSize( usage.sortCacheBytes ) )
+	  << QString( "Cold:         %1 for %2 nodes in %3 subtrees" )
+	     .arg( formatSize( usage.coldBytes ) )
+	     .arg( usage.coldNodes )
+	     .arg( usage.coldSubtrees )
+	  << QString( "Treemap:      %1 for %2 items, %3 for pixmaps" )
+	     .arg( formatSize( usage.treemapItemBytes ) )
+	     .arg( usage.treemapItems )
+	     .arg( formatSize( usage.treemapPixmapBytes ) )
+	  << QString( "Total:        %1" ).arg( formatSize( usage.total() ) )
+	  << ""
+	  << QString( "Shared by all trees:" )
+	  << QString( "Intern pool:  %1 for %2 names" )
+	     .arg( formatSize( CompactName::internedBytes() ) )
+	     .arg( CompactName::internedNames() )
+	  << QString( "Node pool:    %1 in chunks for %2 live nodes" )
+	     .arg( formatSize( NodePool::chunkBytes() ) )
+	     .arg( NodePool::liveNodes() );
+
+    if ( CacheBudget::isEnabled() )
+    {
+	CacheBudget * budget = CacheBudget::instance();
+
+	lines << QString( "Cache budget: %1 of %2 in %3 caches, %4 dropped so far" )
+	    .arg( formatSize( budget->usedBytes() ) )
+	    .arg( formatSize( CacheBudget::budget() ) )
+	    .arg( budget->count() )
+	    .arg( budget->evictions() );
+    }
+
+    return lines.join( "\n" );
+}
+
+
+void MemoryStats::logReport( const MemoryUsage & usage )
+{
+    foreach ( const QString & line, report( usage ).split( "\n" ) )
+    {
+	if ( ! line.isEmpty() )
+	    logInfo() << line << endl;
+    }
+}
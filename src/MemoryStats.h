@@ -0,0 +1,131 @@
+/*
+ *   File name: MemoryStats.h
+ *   Summary:	Memory usage accounting for DirTree and treemap
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef MemoryStats_h
+#define MemoryStats_h
+
+
+#include <QString>
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class FileInfo;
+    class TreemapView;
+
+
+    /**
+     * How much memory a tree and its views need, in bytes.
+     **/
+    struct MemoryUsage
+    {
+	MemoryUsage():
+	    files( 0 ),
+	    dirs( 0 ),
+	    nodeBytes( 0 ),
+	    nameBytes( 0 ),
+	    internedNames( 0 ),
+	    childIndexBytes( 0 ),
+	    childArrayBytes( 0 ),
+	    sortCacheBytes( 0 ),
+	    coldSubtrees( 0 ),
+	    coldNodes( 0 ),
+	    coldBytes( 0 ),
+	    treemapItems( 0 ),
+	    treemapItemBytes( 0 ),
+	    treemapPixmapBytes( 0 )
+	    {}
+
+	/**
+	 * Return the sum of all bytes.
+	 **/
+	qint64 total() const
+	    { return nodeBytes + nameBytes + childIndexBytes + childArrayBytes + sortCacheBytes +
+		     coldBytes + treemapItemBytes + treemapPixmapBytes; }
+
+	qint64 files;			// Everything that is not a DirInfo
+	qint64 dirs;			// Including dot entries
+	qint64 nodeBytes;		// FileInfo and DirInfo objects
+	qint64 nameBytes;		// Names that are neither inline nor interned
+	qint64 internedNames;		// References to the intern pool
+	qint64 childIndexBytes;		// Name index of big directories
+	qint64 childArrayBytes;		// DirInfo::childArray() and childColumns()
+	qint64 sortCacheBytes;		// DirInfo::sortedChildren() etc.
+	qint64 coldSubtrees;		// Directories with a ColdSubtree
+	qint64 coldNodes;		// Nodes in them (not counted in 'files' and 'dirs')
+	qint64 coldBytes;		// Their compressed data
+	qint64 treemapItems;		// Tiles or flat layout items
+	qint64 treemapItemBytes;
+	qint64 treemapPixmapBytes;	// Cushions and the framebuffer
+    };
+
+
+    /**
+     * Memory accounting: How much RAM a loaded tree needs, and an estimate
+     * how much a cache file would need before reading it.
+     *
+     * The nodes and names are counted exactly (they come from the
+     * NodePool in a few fixed sizes); the Qt containers of the caches and
+     * the QGraphicsItems of the treemap are close estimates since their
+     * internals are private to Qt.
+     *
+     * This walks the complete tree, so it is only done on demand.
+     **/
+    class MemoryStats
+    {
+    public:
+
+	/**
+	 * Return the memory usage of 'tree' and, if it is non-null, of
+	 * 'treemapView'.
+	 **/
+	static MemoryUsage usage( DirTree * tree, TreemapView * treemapView = 0 );
+
+	/**
+	 * Estimate the memory that reading cache file 'cacheFileName' would
+	 * need for the nodes and the names. For binary cache files, the
+	 * numbers come from the header; for text cache files, they are
+	 * extrapolated from the first few MB. Set 'ok' to 'false' if the
+	 * file can't be read.
+	 **/
+	static MemoryUsage estimateCache( const QString & cacheFileName, bool & ok );
+
+	/**
+	 * Return a multi-line text report of 'usage'.
+	 **/
+	static QString report( const MemoryUsage & usage );
+
+	/**
+	 * Write a report of 'usage' to the log.
+	 **/
+	static void logReport( const MemoryUsage & usage );
+
+    protected:
+
+	/**
+	 * Add the nodes of 'subtree' to 'usage'.
+	 **/
+	static void addSubtree( MemoryUsage & usage, FileInfo * subtree );
+
+	/**
+	 * Set the node bytes of 'usage' from its number of files and
+	 * directories.
+	 **/
+	static void addNodeBytes( MemoryUsage & usage );
+
+	static bool estimateBinaryCache( const QString & cacheFileName, MemoryUsage & usage );
+	static bool estimateTextCache  ( const QString & cacheFileName, MemoryUsage & usage );
+
+    };	// class MemoryStats
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef MemoryStats_h
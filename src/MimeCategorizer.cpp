@@ -9,19 +9,36 @@
 
 #include "MimeCategorizer.h"
 #include "FileInfo.h"
+#include "DirInfo.h"
+#include "DirTree.h"
 #include "Settings.h"
 #include "SettingsHelpers.h"
 #include "Logger.h"
 #include "Exception.h"
 
+// Values of FileInfo::mimeCategoryCache()
+#define CATEGORY_UNKNOWN	0	// Not cached
+#define CATEGORY_NONE		1	// No category
+#define CATEGORY_FIRST		2	// For _categories[0]
+#define CATEGORY_MAX		255
+
+
 using namespace QDirStat;
 
 
+uint MimeCategorizer::_lastStamp = 0;
+
+
 MimeCategorizer::MimeCategorizer( QObject * parent ):
     QObject( parent ),
-    _mapsDirty( true )
+    _settingsRead( false ),
+    _mapsDirty( true ),
+    _maxSuffixLen( 0 ),
+    _usePatterns( false ),
+    _stamp( 0 )
 {
-    readSettings();
+    // Reading the settings is deferred to the first use: This is created
+    // at program startup, but only needed once there are files.
 }
 
 
@@ -36,7 +53,31 @@ void MimeCategorizer::clear()
 {
     qDeleteAll( _categories );
     _categories.clear();
-    _mapsDirty = true;
+    _mapsDirty	  = true;
+    _settingsRead = true;
+}
+
+
+void MimeCategorizer::ensureSettings() const
+{
+    if ( ! _settingsRead )
+	const_cast<MimeCategorizer *>( this )->readSettings();
+}
+
+
+int MimeCategorizer::size() const
+{
+    ensureSettings();
+
+    return _categories.size();
+}
+
+
+const MimeCategoryList & MimeCategorizer::categories() const
+{
+    ensureSettings();
+
+    return _categories;
 }
 
 
@@ -47,8 +88,78 @@ MimeCategory * MimeCategorizer::category( FileInfo * item )
 
     if ( item->isDir() || item->isDirInfo() )
 	return 0;
-    else
+
+    DirTree * tree = item->tree();
+
+    if ( ! tree )
 	return category( item->name() );
+
+    checkCategoryCache( tree );
+    int cached = item->mimeCategoryCache();
+
+    if ( cached == CATEGORY_NONE )
+	return 0;
+
+    if ( cached >= CATEGORY_FIRST && cached - CATEGORY_FIRST < _categories.size() )
+	return _categories.at( cached - CATEGORY_FIRST );
+
+    MimeCategory * result = category( item->name() );
+
+    if ( ! result )
+	item->setMimeCategoryCache( CATEGORY_NONE );
+    else
+    {
+	int index = _categories.indexOf( result ) + CATEGORY_FIRST;
+
+	if ( index >= CATEGORY_FIRST && index <= CATEGORY_MAX ) // Otherwise not cached
+	    item->setMimeCategoryCache( index );
+    }
+
+    return result;
+}
+
+
+void MimeCategorizer::checkCategoryCache( DirTree * tree )
+{
+    CHECK_PTR( tree );
+
+    if ( _mapsDirty )
+	buildMaps();
+
+    // The cached values are indices in _categories. If they were set with
+    // other categories, they are all invalid.
+
+    if ( tree->mimeCategoryStamp() != _stamp )
+    {
+	clearCategoryCache( tree->root() );
+	tree->setMimeCategoryStamp( _stamp );
+    }
+}
+
+
+uint MimeCategorizer::stamp()
+{
+    if ( _mapsDirty )
+	buildMaps();
+
+    return _stamp;
+}
+
+
+void MimeCategorizer::clearCategoryCache( FileInfo * item )
+{
+    if ( ! item )
+	return;
+
+    item->setMimeCategoryCache( CATEGORY_UNKNOWN );
+
+    if ( item->isDirInfo() )
+	item->toDirInfo()->dropTypeSummary();
+
+    for ( FileInfo * child = item->firstChild(); child; child = child->next() )
+	clearCategoryCache( child );
+
+    clearCategoryCache( item->dotEntry() );
 }
 
 
@@ -66,45 +177,163 @@ MimeCategory * MimeCategorizer::category( const QString & filename,
     if ( _mapsDirty )
 	buildMaps();
 
+    // Some files have more than one suffix, e.g., "tar.bz2". The longest
+    // one that is known wins; if there is no match for "tar.bz2", there
+    // might be one for just "bz2".
+
+    int suffixLen = 0;
+    MimeCategory * category = matchSuffixes( filename, suffixLen );
+
+    if ( category && suffix_ret )
+	*suffix_ret = filename.right( suffixLen );
+
+    if ( ! category ) // No match yet?
+	category = matchPatterns( filename );
+
+#if 0
+    if ( category )
+	logVerbose() << "Found " << category << " for " << filename << endl;
+#endif
+
+    return category;
+}
+
+
+bool MimeCategorizer::prepareConcurrentUse()
+{
+    if ( _mapsDirty )
+	buildMaps();
+
+#ifdef HAVE_QREGULAREXPRESSION
+
+    if ( _usePatterns )
+    {
+#if (QT_VERSION >= QT_VERSION_CHECK( 5, 4, 0 ))
+	// Compile the regexp now and not while several threads use it
+
+	_patterns.optimize();
+#endif
+	return true;
+    }
+
+#endif
+
+    foreach ( MimeCategory * category, _categories )
+    {
+	if ( category && ! category->patternList().isEmpty() )
+	    return false;
+    }
+
+    return true;
+}
+
+
+MimeCategory * MimeCategorizer::matchSuffixes( const QString & filename,
+					       int	     & suffixLen_ret ) const
+{
     MimeCategory * category = 0;
+    int  size		 = filename.size();
+    int  minPos		 = qMax( 1, size - _maxSuffixLen );
+    uint caseSensitiveHash   = 2166136261U;
+    uint caseInsensitiveHash = 2166136261U;
 
-    // Find the filename suffix: Section #1
-    // (ignoring any leading '.' separator)
-    QString suffix = filename.section( '.', 1 );
+    // Each part after a '.' is a candidate suffix. Going backwards, they
+    // are found from the shortest to the longest, so a later match wins.
 
-    while ( ! suffix.isEmpty() )
+    for ( int pos = size - 1; pos >= minPos; --pos )
     {
+	QChar c = filename.at( pos );
+	caseSensitiveHash   = suffixHash( caseSensitiveHash,   c );
+	caseInsensitiveHash = suffixHash( caseInsensitiveHash, c.toLower() );
+
+	if ( filename.at( pos - 1 ) != '.' )
+	    continue;
+
+	int len = size - pos;
+
 	// Try case sensitive first
 
-	category = _caseSensitiveSuffixMap.value( suffix, 0 );
+	MimeCategory * found = findSuffix( _caseSensitiveSuffixes, caseSensitiveHash,
+					   filename, pos, len, Qt::CaseSensitive );
+	if ( ! found )
+	{
+	    found = findSuffix( _caseInsensitiveSuffixes, caseInsensitiveHash,
+				filename, pos, len, Qt::CaseInsensitive );
+	}
+
+	if ( found )
+	{
+	    category	  = found;
+	    suffixLen_ret = len;
+	}
+    }
+
+    return category;
+}
+
 
-	if ( ! category )
-	    category = _caseInsensitiveSuffixMap.value( suffix.toLower(), 0 );
+MimeCategory * MimeCategorizer::findSuffix( const SuffixHash & suffixHash,
+					    uint	       hash,
+					    const QString    & filename,
+					    int		       pos,
+					    int		       len,
+					    Qt::CaseSensitivity caseSensitivity )
+{
+    SuffixHash::const_iterator it = suffixHash.constFind( hash );
 
-	if ( category && suffix_ret )
-	    *suffix_ret = suffix;
+    while ( it != suffixHash.constEnd() && it.key() == hash )
+    {
+	const SuffixEntry & entry = it.value();
 
-	// No match so far? Try the next suffix. Some files might have more
-	// than one, e.g., "tar.bz2" - if there is no match for "tar.bz2",
-	// there might be one for just "bz2".
+	if ( entry.suffix.size() == len &&
+	     filename.midRef( pos, len ).compare( entry.suffix, caseSensitivity ) == 0 )
+	{
+	    return entry.category;
+	}
 
-	suffix = suffix.section( '.', 1 );
+	++it;
     }
 
-    if ( ! category ) // No match yet?
-	category = matchPatterns( filename );
+    return 0;
+}
 
-#if 0
-    if ( category )
-	logVerbose() << "Found " << category << " for " << filename << endl;
-#endif
 
-    return category;
+uint MimeCategorizer::suffixHash( const QString & suffix )
+{
+    uint hash = 2166136261U;
+
+    for ( int i = suffix.size() - 1; i >= 0; --i )
+	hash = suffixHash( hash, suffix.at( i ) );
+
+    return hash;
 }
 
 
 MimeCategory * MimeCategorizer::matchPatterns( const QString & filename ) const
 {
+#ifdef HAVE_QREGULAREXPRESSION
+
+    if ( _usePatterns )
+    {
+	QRegularExpressionMatch match = _patterns.match( filename );
+
+	if ( ! match.hasMatch() )
+	    return 0;
+
+	// The first category with a matching pattern is the one whose
+	// capture group is set.
+
+	for ( int i=0; i < _patternCategories.size(); ++i )
+	{
+	    if ( match.capturedStart( i + 1 ) >= 0 )
+		return _patternCategories.at( i );
+	}
+
+	return 0;
+    }
+
+#endif
+
     foreach ( MimeCategory * category, _categories )
     {
 	if ( category )
@@ -124,6 +353,7 @@ MimeCategory * MimeCategorizer::matchPatterns( const QString & filename ) const
 void MimeCategorizer::add( MimeCategory * category )
 {
     CHECK_PTR( category );
+    ensureSettings();
 
     _categories << category;
     _mapsDirty = true;
@@ -133,6 +363,7 @@ void MimeCategorizer::add( MimeCategory * category )
 void MimeCategorizer::remove( MimeCategory * category )
 {
     CHECK_PTR( category );
+    ensureSettings();
 
     _categories.removeAll( category );
     delete category;
@@ -142,38 +373,108 @@ void MimeCategorizer::remove( MimeCategory * category )
 
 void MimeCategorizer::buildMaps()
 {
-    _caseInsensitiveSuffixMap.clear();
-    _caseSensitiveSuffixMap.clear();
+    ensureSettings();
+
+    _caseInsensitiveSuffixes.clear();
+    _caseSensitiveSuffixes.clear();
+    _maxSuffixLen = 0;
 
     foreach ( MimeCategory * category, _categories )
     {
 	CHECK_PTR( category );
 
-	addSuffixes( _caseInsensitiveSuffixMap, category, category->caseInsensitiveSuffixList() );
-	addSuffixes( _caseSensitiveSuffixMap,	category, category->caseSensitiveSuffixList()	);
+	addSuffixes( _caseInsensitiveSuffixes, category, category->caseInsensitiveSuffixList() );
+	addSuffixes( _caseSensitiveSuffixes,   category, category->caseSensitiveSuffixList()   );
     }
 
+    buildPatterns();
+    _stamp     = ++_lastStamp;
     _mapsDirty = false;
 }
 
 
-void MimeCategorizer::addSuffixes( QMap<QString, MimeCategory *> & suffixMap,
-				   MimeCategory			 * category,
-				   const QStringList		 & suffixList  )
+void MimeCategorizer::addSuffixes( SuffixHash	     & suffixHash,
+				   MimeCategory	     * category,
+				   const QStringList & suffixList  )
 {
     foreach ( const QString & suffix, suffixList )
     {
-	if ( suffixMap.contains( suffix ) )
+	uint hash = MimeCategorizer::suffixHash( suffix );
+	MimeCategory * existing = findSuffix( suffixHash, hash, suffix, 0, suffix.size(),
+					      Qt::CaseSensitive );
+	if ( existing )
 	{
 	    logError() << "Duplicate suffix: " << suffix << " for "
-		       << suffixMap.value( suffix ) << " and " << category
+		       << existing << " and " << category
 		       << endl;
 	}
 	else
 	{
-	    suffixMap[ suffix ] = category;
+	    SuffixEntry entry;
+	    entry.suffix   = suffix;
+	    entry.category = category;
+	    suffixHash.insert( hash, entry );
+	    _maxSuffixLen = qMax( _maxSuffixLen, suffix.size() );
+	}
+    }
+}
+
+
+void MimeCategorizer::buildPatterns()
+{
+    _usePatterns = false;
+
+#ifdef HAVE_QREGULAREXPRESSION
+
+    // One capture group for each category with patterns, in the order of
+    // the categories. The regexp engine tries the alternatives in that
+    // order, so the first category that matches wins, just like in the
+    // loop over all patterns.
+
+    QStringList groups;
+    _patternCategories.clear();
+
+    foreach ( MimeCategory * category, _categories )
+    {
+	QStringList alternatives;
+
+	foreach ( const QRegExp & pattern, category->patternList() )
+	{
+	    QString regexp = ExcludeMatcher::wildcardToRegexp( pattern.pattern(), false );
+	    alternatives << QString( pattern.caseSensitivity() == Qt::CaseSensitive ?
+				     "(?:%1)" : "(?i:%1)" ).arg( regexp );
+	}
+
+	if ( ! alternatives.isEmpty() )
+	{
+	    groups << "(" + alternatives.join( "|" ) + ")";
+	    _patternCategories << category;
 	}
     }
+
+    if ( groups.isEmpty() )
+    {
+	_usePatterns = true;	// Simply no match
+	_patterns    = QRegularExpression( "(?!)" );
+	return;
+    }
+
+    _patterns = QRegularExpression( "\\A(?:" + groups.join( "|" ) + ")\\z" );
+
+    if ( _patterns.isValid() )
+    {
+	_usePatterns = true;
+
+#if (QT_VERSION >= QT_VERSION_CHECK( 5, 4, 0 ))
+	_patterns.optimize();
+#endif
+    }
+    else
+    {
+	logError() << "Can't combine MIME category patterns: " << _patterns.errorString() << endl;
+    }
+
+#endif
 }
 
 
@@ -182,7 +483,7 @@ void MimeCategorizer::readSettings()
     MimeCategorySettings settings;
     QStringList mimeCategoryGroups = settings.findGroups( settings.groupPrefix() );
 
-    clear();
+    clear();	// This also sets _settingsRead
 
     // Read all settings groups [MimeCategory_xx] that were found
 
@@ -212,6 +513,9 @@ void MimeCategorizer::readSettings()
 
 void MimeCategorizer::writeSettings()
 {
+    if ( ! _settingsRead )
+	return;
+
     MimeCategorySettings settings;
 
     // Remove all leftover cleanup descriptions
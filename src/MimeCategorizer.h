@@ -10,14 +10,16 @@
 #define MimeCategorizer_h
 
 #include <QObject>
-#include <QMap>
+#include <QMultiHash>
 
 #include "MimeCategory.h"
+#include "ExcludeRules.h"	// HAVE_QREGULAREXPRESSION
 
 
 namespace QDirStat
 {
     class FileInfo;
+    class DirTree;
 
     /**
      * Class to determine the MimeCategory of filenames.
@@ -32,7 +34,8 @@ namespace QDirStat
 
     public:
 	/**
-	 * Constructor.
+	 * Constructor. The categories are only read from the settings when
+	 * they are needed for the first time.
 	 **/
 	MimeCategorizer( QObject * parent = 0 );
 
@@ -44,6 +47,9 @@ namespace QDirStat
 	/**
 	 * Return the MimeCategory for a FileInfo item or 0 if it doesn't fit
 	 * into any of the available categories.
+	 *
+	 * The result is cached in the item, so this is very fast for each
+	 * further call for the same item until the categories change.
 	 **/
 	MimeCategory * category( FileInfo * item );
 
@@ -58,6 +64,34 @@ namespace QDirStat
 	 **/
 	MimeCategory * category( const QString & filename, QString * suffix_ret = 0 );
 
+	/**
+	 * Prepare for calling category( const QString & ) from several
+	 * threads at the same time and return 'true' if that is possible.
+	 *
+	 * This builds the internal maps if necessary; after that, the lookup
+	 * is read-only unless it has to fall back to trying each QRegExp
+	 * pattern, which is not thread-safe. The categories must not be
+	 * changed while other threads use this categorizer.
+	 **/
+	bool prepareConcurrentUse();
+
+	/**
+	 * Make sure that everything that is cached in the items of 'tree'
+	 * about their categories is valid for the current categories of this
+	 * categorizer: The category of each item (see category( FileInfo * ))
+	 * and the type summaries of the directories (see
+	 * DirInfo::typeSummary()). If the categories changed since that was
+	 * cached, it is all discarded.
+	 **/
+	void checkCategoryCache( DirTree * tree );
+
+	/**
+	 * Return the stamp of the current categories: It is different for
+	 * each categorizer and each time its categories change. This builds
+	 * the internal maps if necessary.
+	 **/
+	uint stamp();
+
 	/**
 	 * Add a MimeCategory.
 	 **/
@@ -71,15 +105,16 @@ namespace QDirStat
 	/**
 	 * Return the number of MimeCategories.
 	 **/
-	int size() const { return _categories.size(); }
+	int size() const;
 
 	/**
 	 * Return the MimeCategories list.
 	 **/
-	const MimeCategoryList & categories() const { return _categories; }
+	const MimeCategoryList & categories() const;
 
 	/**
-	 * Clear all categories.
+	 * Clear all categories. This replaces the categories from the
+	 * settings, so they are not read any more.
 	 **/
 	void clear();
 
@@ -92,47 +127,128 @@ namespace QDirStat
 	void readSettings();
 
 	/**
-	 * Write the MimeCategory parameter to the settings.
+	 * Write the MimeCategory parameter to the settings. This does nothing
+	 * if they were never read: Nothing can have changed.
 	 **/
 	void writeSettings();
 
     protected:
 
+	/**
+	 * One suffix in the suffix hashes.
+	 **/
+	struct SuffixEntry
+	{
+	    QString	   suffix;
+	    MimeCategory * category;
+	};
+
+	/**
+	 * Suffixes by their suffixHash().
+	 **/
+	typedef QMultiHash<uint, SuffixEntry> SuffixHash;
+
 	/**
 	 * Build the internal maps and clear the _mapsDirty flag.
 	 **/
 	void buildMaps();
 
 	/**
-	 * Add all suffixes in 'suffixList' as key to 'suffixMap' with value
-	 * 'category'.
+	 * Add all suffixes in 'suffixList' to 'suffixHash' with 'category'.
 	 *
-	 * This provides a really fast map lookup for each suffix.
+	 * This provides a really fast lookup for each suffix.
 	 **/
-	void addSuffixes( QMap<QString, MimeCategory *> & suffixMap,
-			  MimeCategory			* category,
-			  const QStringList		& suffixList  );
+	void addSuffixes( SuffixHash	    & suffixHash,
+			  MimeCategory	    * category,
+			  const QStringList & suffixList  );
+
+	/**
+	 * Find the category of the longest suffix of 'filename' that is in
+	 * one of the suffix hashes. Return 0 if there is none. The length of
+	 * that suffix is returned in 'suffixLen_ret'.
+	 *
+	 * This does not allocate any memory: It scans the name from the end
+	 * and computes the hash of each candidate suffix on the fly.
+	 **/
+	MimeCategory * matchSuffixes( const QString & filename, int & suffixLen_ret ) const;
+
+	/**
+	 * Return 'entry' from 'suffixHash' with hash 'hash' that matches
+	 * the 'len' characters of 'filename' from 'pos' on or 0 if there is
+	 * none.
+	 **/
+	static MimeCategory * findSuffix( const SuffixHash & suffixHash,
+					  uint		     hash,
+					  const QString    & filename,
+					  int		     pos,
+					  int		     len,
+					  Qt::CaseSensitivity caseSensitivity );
+
+	/**
+	 * Hash function for suffixes. This processes the characters from the
+	 * end so candidate suffixes can be hashed incrementally while
+	 * scanning a file name backwards. Add character 'c' to 'hash'.
+	 **/
+	static uint suffixHash( uint hash, QChar c )
+	    { return ( hash ^ c.unicode() ) * 16777619U; }
+
+	/**
+	 * Return the hash of 'suffix'.
+	 **/
+	static uint suffixHash( const QString & suffix );
 
 	/**
 	 * Iterate over all categories and try all patterns until the first
 	 * match. Return the matched category or 0 if none matched.
+	 *
+	 * If possible, all patterns are combined into one regexp.
 	 **/
 	MimeCategory * matchPatterns( const QString & filename ) const;
 
+	/**
+	 * Combine the patterns of all categories into _patterns.
+	 **/
+	void buildPatterns();
+
 	/**
 	 * Add default categories in case none were read from the settings.
 	 **/
 	void addDefaultCategories();
 
+	/**
+	 * Reset the cached MimeCategory of 'item' and all its children and
+	 * drop their type summaries.
+	 **/
+	static void clearCategoryCache( FileInfo * item );
+
+	/**
+	 * Read the settings if that was not done yet.
+	 **/
+	void ensureSettings() const;
+
 	//
 	// Data members
 	//
 
+	bool		 _settingsRead;
 	bool		 _mapsDirty;
 	MimeCategoryList _categories;
 
-	QMap<QString, MimeCategory *> _caseInsensitiveSuffixMap;
-	QMap<QString, MimeCategory *> _caseSensitiveSuffixMap;
+	SuffixHash	 _caseInsensitiveSuffixes;  // Lowercase suffixes
+	SuffixHash	 _caseSensitiveSuffixes;
+	int		 _maxSuffixLen;
+
+#ifdef HAVE_QREGULAREXPRESSION
+	QRegularExpression _patterns;		    // All patterns of all categories
+	MimeCategoryList   _patternCategories;	    // Category for each capture group
+#endif
+	bool		 _usePatterns;		    // _patterns is valid
+
+	// Unique for each categorizer and each version of its categories; see
+	// DirTree::mimeCategoryStamp()
+
+	uint		 _stamp;
+	static uint	 _lastStamp;
 
     };	// class MimeCategorizer
 
@@ -7,9 +7,14 @@
  */
 
 
+#include <fcntl.h>        // open()
+#include <unistd.h>       // read(), lseek()
+#include <poll.h>         // poll()
+#include <string.h>       // memchr()
+
 #include <QFile>
-#include <QRegExp>
 #include <QFileInfo>
+#include <QMutexLocker>
 
 #include "MountPoints.h"
 #include "Logger.h"
@@ -59,8 +64,10 @@ MountPoints * MountPoints::instance()
 }
 
 
-MountPoints::MountPoints()
+MountPoints::MountPoints():
+    _mutex( QMutex::Recursive )
 {
+    _mountInfoFd = -1;
     init();
 }
 
@@ -68,6 +75,9 @@ MountPoints::MountPoints()
 MountPoints::~MountPoints()
 {
     init();
+
+    if ( _mountInfoFd >= 0 )
+        ::close( _mountInfoFd );
 }
 
 
@@ -75,6 +85,22 @@ void MountPoints::init()
 {
     qDeleteAll( _mountPointMap );
     _mountPointMap.clear();
+    qDeleteAll( _retired );
+    _retired.clear();
+    _trie.clear();
+    _isPopulated     = false;
+    _hasBtrfs        = false;
+    _checkedForBtrfs = false;
+}
+
+
+void MountPoints::retire()
+{
+    foreach ( MountPoint * mountPoint, _mountPointMap )
+        _retired << mountPoint;
+
+    _mountPointMap.clear();
+    _trie.clear();
     _isPopulated     = false;
     _hasBtrfs        = false;
     _checkedForBtrfs = false;
@@ -84,12 +110,16 @@ void MountPoints::init()
 void MountPoints::clear()
 {
     if ( _instance )
+    {
+        QMutexLocker locker( &_instance->_mutex );
         _instance->init();
+    }
 }
 
 
 bool MountPoints::isEmpty()
 {
+    QMutexLocker locker( &instance()->_mutex );
     instance()->ensurePopulated();
 
     return instance()->_mountPointMap.isEmpty();
@@ -98,44 +128,141 @@ bool MountPoints::isEmpty()
 
 const MountPoint * MountPoints::findByPath( const QString & path )
 {
+    QMutexLocker locker( &instance()->_mutex );
     instance()->ensurePopulated();
 
     return instance()->_mountPointMap.value( path, 0 );
 }
 
 
+QList<const MountPoint *> MountPoints::findBelow( const QString & path )
+{
+    QMutexLocker locker( &instance()->_mutex );
+    instance()->ensurePopulated();
+
+    QList<const MountPoint *> result;
+    QString prefix = path.endsWith( '/' ) ? path : path + "/";
+    QMap<QString, MountPoint *>::const_iterator it = _instance->_mountPointMap.lowerBound( prefix );
+
+    while ( it != _instance->_mountPointMap.constEnd() && it.key().startsWith( prefix ) )
+    {
+        if ( it.key() != path )
+            result << it.value();
+
+        ++it;
+    }
+
+    return result;
+}
+
+
 const MountPoint * MountPoints::findNearestMountPoint( const QString & startPath )
 {
-    QFileInfo fileInfo( startPath );
-    QString path = fileInfo.canonicalFilePath(); // absolute path without symlinks or ..
+    QString path = startPath;
+
+    // Only paths with "." or ".." components or relative paths need the
+    // system call to make them canonical
+
+    if ( ! path.startsWith( '/' ) || path.contains( "/./" ) || path.contains( "/../" ) ||
+         path.endsWith( "/." ) || path.endsWith( "/.." ) )
+    {
+        QFileInfo fileInfo( startPath );
+        path = fileInfo.canonicalFilePath(); // absolute path without symlinks or ..
+
+        if ( path.isEmpty() )
+            path = fileInfo.absoluteFilePath();
 
-    if ( path != startPath )
         logDebug() << startPath << " canonicalized is " << path << endl;
+    }
+
+    QMutexLocker locker( &instance()->_mutex );
+    instance()->ensurePopulated();
+
+    const MountPoint * mountPoint = instance()->findInTrie( path );
+
+    // logDebug() << "Nearest mount point for " << startPath << " is " << mountPoint << endl;
+
+    return mountPoint;
+}
+
 
-    const MountPoint * mountPoint = findByPath( path );
+const MountPoint * MountPoints::findInTrie( const QString & path ) const
+{
+    const MountPointTrieNode * node = &_trie;
+    const MountPoint * mountPoint   = node->mountPoint;
+    int start = 0;
 
-    if ( ! mountPoint )
+    while ( start < path.size() )
     {
-        QStringList pathComponents = startPath.split( "/", QString::SkipEmptyParts );
+        int end = path.indexOf( '/', start );
 
-        while ( ! mountPoint && !pathComponents.isEmpty() )
+        if ( end < 0 )
+            end = path.size();
+
+        if ( end > start )      // Skip empty components of "//"
         {
-            // Try one level upwards
-            pathComponents.removeLast();
-            path = QString( "/" ) + pathComponents.join( "/" );
+            node = node->children.value( path.mid( start, end - start ), 0 );
+
+            if ( ! node )
+                break;
 
-            mountPoint = instance()->_mountPointMap.value( path, 0 );
+            if ( node->mountPoint )
+                mountPoint = node->mountPoint;
         }
-    }
 
-    // logDebug() << "Nearest mount point for " << startPath << " is " << mountPoint << endl;
+        start = end + 1;
+    }
 
     return mountPoint;
 }
 
 
+void MountPoints::add( MountPoint * mountPoint )
+{
+    const QString & path = mountPoint->path();
+
+    // A later mount on the same path hides the earlier one
+
+    if ( _mountPointMap.contains( path ) )
+        _retired << _mountPointMap.value( path );
+
+    _mountPointMap[ path ] = mountPoint;
+
+    MountPointTrieNode * node = &_trie;
+    int start = 0;
+
+    while ( start < path.size() )
+    {
+        int end = path.indexOf( '/', start );
+
+        if ( end < 0 )
+            end = path.size();
+
+        if ( end > start )
+        {
+            QString component = path.mid( start, end - start );
+            MountPointTrieNode * child = node->children.value( component, 0 );
+
+            if ( ! child )
+            {
+                child = new MountPointTrieNode();
+                CHECK_NEW( child );
+                node->children.insert( component, child );
+            }
+
+            node = child;
+        }
+
+        start = end + 1;
+    }
+
+    node->mountPoint = mountPoint;
+}
+
+
 bool MountPoints::hasBtrfs()
 {
+    QMutexLocker locker( &instance()->_mutex );
     instance()->ensurePopulated();
 
     if ( ! _instance->_checkedForBtrfs )
@@ -150,66 +277,240 @@ bool MountPoints::hasBtrfs()
 
 void MountPoints::ensurePopulated()
 {
+    QMutexLocker locker( &_mutex );
+
     if ( _isPopulated )
-        return;
+    {
+        if ( ! mountTableChanged() )
+            return;
 
-    read( "/proc/mounts" ) || read( "/etc/mtab" );
+        logInfo() << "Mount table changed; reading it again" << endl;
+        retire();
+    }
+
+    readMountInfo() || read( "/proc/mounts" ) || read( "/etc/mtab" );
 
     if ( ! _isPopulated )
-        logError() << "Could not read either /proc/mounts or /etc/mtab" << endl;
+        logError() << "Could not read /proc/self/mountinfo, /proc/mounts or /etc/mtab" << endl;
 
     _isPopulated = true;
 }
 
 
-bool MountPoints::read( const QString & filename )
+/**
+ * Split 'line' to 'end' at the blanks and store the start and end of each
+ * field in 'starts' and 'ends'. Return the number of fields, but at most
+ * 'maxFields'.
+ **/
+static int splitFields( const char * line, const char * end,
+                        const char ** starts, const char ** ends, int maxFields )
 {
-    QFile file( filename );
+    int count = 0;
+    const char * pos = line;
 
-    if ( ! file.open( QIODevice::ReadOnly | QIODevice::Text ) )
+    while ( pos < end && count < maxFields )
     {
-        logWarning() << "Can't open " << filename << endl;
+        while ( pos < end && ( *pos == ' ' || *pos == '\t' ) )
+            ++pos;
+
+        if ( pos >= end )
+            break;
+
+        starts[ count ] = pos;
+
+        while ( pos < end && *pos != ' ' && *pos != '\t' )
+            ++pos;
+
+        ends[ count++ ] = pos;
+    }
+
+    return count;
+}
+
+
+/**
+ * Return 'true' if there is nothing but blanks from 'line' to 'end'.
+ **/
+static bool isBlank( const char * line, const char * end )
+{
+    while ( line < end && ( *line == ' ' || *line == '\t' ) )
+        ++line;
+
+    return line >= end;
+}
+
+
+bool MountPoints::mountTableChanged()
+{
+    if ( _mountInfoFd < 0 )
+        return false;
+
+    if ( _changeCheckTimer.isValid() && _changeCheckTimer.elapsed() < 1000 )
         return false;
+
+    _changeCheckTimer.start();
+
+    // The kernel reports a change of the mount table as an exceptional
+    // condition on any open file descriptor of the mountinfo file until it
+    // is read again.
+
+    struct pollfd pollInfo;
+    pollInfo.fd      = _mountInfoFd;
+    pollInfo.events  = POLLPRI;
+    pollInfo.revents = 0;
+
+    return poll( &pollInfo, 1, 0 ) > 0 && ( pollInfo.revents & ( POLLPRI | POLLERR ) );
+}
+
+
+bool MountPoints::readMountInfo()
+{
+    if ( _mountInfoFd < 0 )
+    {
+        _mountInfoFd = ::open( "/proc/self/mountinfo", O_RDONLY | O_CLOEXEC );
+
+        if ( _mountInfoFd < 0 )
+        {
+            logWarning() << "Can't open /proc/self/mountinfo" << endl;
+            return false;
+        }
     }
 
-    QTextStream in( &file );
+    // Read it all at once: The kernel only guarantees a consistent view
+    // for each read() call, and this also resets the change notification.
+
+    QByteArray content;
+    char buffer[ 16384 ];
+    ssize_t len;
+
+    lseek( _mountInfoFd, 0, SEEK_SET );
+
+    while ( ( len = ::read( _mountInfoFd, buffer, sizeof( buffer ) ) ) > 0 )
+        content.append( buffer, len );
+
+    _changeCheckTimer.start();
+
+    const char * line = content.constData();
+    const char * end  = line + content.size();
     int lineNo = 0;
     int count  = 0;
-    QString line = in.readLine();
 
-    while ( ! line.isNull() ) // in.atEnd() always returns true for /proc/*
+    while ( line < end )
     {
+        const char * lineEnd = (const char *) memchr( line, '\n', end - line );
+
+        if ( ! lineEnd )
+            lineEnd = end;
+
         ++lineNo;
-        QStringList fields = line.split( QRegExp( "\\s+" ), QString::SkipEmptyParts );
 
-        if ( fields.isEmpty() ) // allow empty lines
-            continue;
+        if ( parseMountInfoLine( line, lineEnd ) )
+            ++count;
+        else if ( ! isBlank( line, lineEnd ) )
+            logError() << "Bad line /proc/self/mountinfo:" << lineNo << endl;
 
-        if ( fields.size() < 4 )
+        line = lineEnd + 1;
+    }
+
+    if ( count < 1 )
+        logWarning() << "Not a single mount point in /proc/self/mountinfo" << endl;
+    else
+        _isPopulated = true;
+
+    return _isPopulated;
+}
+
+
+bool MountPoints::parseMountInfoLine( const char * line, const char * end )
+{
+    // File format (/proc/self/mountinfo):
+    //
+    //   id parent major:minor root mount-point mount-options [optional...] - type device super-options
+    //   36 25 8:6 / / rw,relatime shared:1 - ext4 /dev/sda6 rw,errors=remount-ro
+    //   97 36 0:45 / /nas/work rw,relatime shared:53 - nfs nas:/share/work rw,vers=3
+
+    const int maxFields = 32;
+    const char * starts[ maxFields ];
+    const char * ends  [ maxFields ];
+    int fields = splitFields( line, end, starts, ends, maxFields );
+    int separator = 6;
+
+    while ( separator < fields &&
+            ! ( ends[ separator ] - starts[ separator ] == 1 && *starts[ separator ] == '-' ) )
+    {
+        ++separator;
+    }
+
+    if ( separator + 2 >= fields )   // No "-" or not enough fields after it
+        return false;
+
+    QString path      = unescape( starts[4], ends[4] );
+    QString mountOpts = QString::fromUtf8( starts[5], ends[5] - starts[5] );
+    QString fsType    = unescape( starts[ separator + 1 ], ends[ separator + 1 ] );
+    QString device    = unescape( starts[ separator + 2 ], ends[ separator + 2 ] );
+
+    // Like in /proc/mounts: The options of this mount and of the
+    // filesystem, without duplicates
+
+    if ( separator + 3 < fields )
+    {
+        QStringList opts = mountOpts.split( ',' );
+
+        foreach ( const QString & opt,
+                  QString::fromUtf8( starts[ separator + 3 ],
+                                     ends[ separator + 3 ] - starts[ separator + 3 ] ).split( ',' ) )
         {
-            logError() << "Bad line " << filename << ":" << lineNo << ": " << line << endl;
-            continue;
+            if ( ! opts.contains( opt ) )
+                opts << opt;
         }
 
-        // File format (/proc/mounts or /etc/mtab):
-        //
-        //   /dev/sda6 / ext4 rw,relatime,errors=remount-ro,data=ordered 0 0
-        //   /dev/sda7 /work ext4 rw,relatime,data=ordered 0 0
-        //   nas:/share/work /nas/work nfs rw,local_lock=none 0 0
+        mountOpts = opts.join( "," );
+    }
+
+    MountPoint * mountPoint = new MountPoint( device, path, fsType, mountOpts );
+    CHECK_NEW( mountPoint );
+    add( mountPoint );
+
+    return true;
+}
+
+
+bool MountPoints::read( const QString & filename )
+{
+    QFile file( filename );
+
+    if ( ! file.open( QIODevice::ReadOnly ) )
+    {
+        logWarning() << "Can't open " << filename << endl;
+        return false;
+    }
+
+    // readAll() also works for /proc files where size() is 0
 
-        QString device    = fields[0];
-        QString path      = fields[1];
-        QString fsType    = fields[2];
-        QString mountOpts = fields[3];
-        // ignoring fsck and dump order (0 0)
+    QByteArray content = file.readAll();
+    const char * line  = content.constData();
+    const char * end   = line + content.size();
+    int lineNo = 0;
+    int count  = 0;
+
+    while ( line < end )
+    {
+        const char * lineEnd = (const char *) memchr( line, '\n', end - line );
 
-        MountPoint * mountPoint = new MountPoint( device, path, fsType, mountOpts );
-        CHECK_NEW( mountPoint );
+        if ( ! lineEnd )
+            lineEnd = end;
 
-        _mountPointMap[ path ] = mountPoint;
-        ++count;
+        ++lineNo;
 
-        line = in.readLine();
+        if ( parseMountsLine( line, lineEnd ) )
+            ++count;
+        else if ( ! isBlank( line, lineEnd ) ) // allow empty lines
+        {
+            logError() << "Bad line " << filename << ":" << lineNo << ": "
+                       << QString::fromUtf8( line, lineEnd - line ) << endl;
+        }
+
+        line = lineEnd + 1;
     }
 
     if ( count < 1 )
@@ -221,6 +522,62 @@ bool MountPoints::read( const QString & filename )
 }
 
 
+bool MountPoints::parseMountsLine( const char * line, const char * end )
+{
+    // File format (/proc/mounts or /etc/mtab):
+    //
+    //   /dev/sda6 / ext4 rw,relatime,errors=remount-ro,data=ordered 0 0
+    //   /dev/sda7 /work ext4 rw,relatime,data=ordered 0 0
+    //   nas:/share/work /nas/work nfs rw,local_lock=none 0 0
+
+    const char * starts[4];
+    const char * ends  [4];
+
+    if ( splitFields( line, end, starts, ends, 4 ) < 4 )
+        return false;
+
+    QString device    = unescape( starts[0], ends[0] );
+    QString path      = unescape( starts[1], ends[1] );
+    QString fsType    = unescape( starts[2], ends[2] );
+    QString mountOpts = QString::fromUtf8( starts[3], ends[3] - starts[3] );
+    // ignoring fsck and dump order (0 0)
+
+    MountPoint * mountPoint = new MountPoint( device, path, fsType, mountOpts );
+    CHECK_NEW( mountPoint );
+    add( mountPoint );
+
+    return true;
+}
+
+
+QString MountPoints::unescape( const char * start, const char * end )
+{
+    if ( ! memchr( start, '\\', end - start ) )
+        return QString::fromUtf8( start, end - start );
+
+    QByteArray result;
+    result.reserve( end - start );
+
+    for ( const char * pos = start; pos < end; ++pos )
+    {
+        if ( *pos == '\\' && end - pos >= 4 &&
+             pos[1] >= '0' && pos[1] <= '3' &&
+             pos[2] >= '0' && pos[2] <= '7' &&
+             pos[3] >= '0' && pos[3] <= '7' )
+        {
+            result.append( (char) ( ( pos[1] - '0' ) * 64 + ( pos[2] - '0' ) * 8 + ( pos[3] - '0' ) ) );
+            pos += 3;
+        }
+        else
+        {
+            result.append( *pos );
+        }
+    }
+
+    return QString::fromUtf8( result );
+}
+
+
 bool MountPoints::checkForBtrfs()
 {
     ensurePopulated();
@@ -237,6 +594,8 @@ bool MountPoints::checkForBtrfs()
 
 void MountPoints::dump()
 {
+    QMutexLocker locker( &instance()->_mutex );
+
     foreach ( const MountPoint * mountPoint, instance()->_mountPointMap )
     {
         logDebug() << mountPoint << endl;
@@ -13,6 +13,10 @@
 #include <QString>
 #include <QStringList>
 #include <QMap>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QElapsedTimer>
 #include <QTextStream>
 
 
@@ -73,8 +77,39 @@ namespace QDirStat
     }; // class MountPoint
 
 
+    /**
+     * One node of the trie of the mount point paths: One level for each
+     * path component.
+     **/
+    struct MountPointTrieNode
+    {
+        MountPointTrieNode():
+            mountPoint( 0 )
+            {}
+
+        ~MountPointTrieNode() { clear(); }
+
+        void clear()
+        {
+            qDeleteAll( children );
+            children.clear();
+            mountPoint = 0;
+        }
+
+        QHash<QString, MountPointTrieNode *> children;
+        const MountPoint *                   mountPoint; // mounted exactly here
+    };
+
+
     /**
      * Singleton class to access the current mount points.
+     *
+     * The mount points are read from /proc/self/mountinfo (or from
+     * /proc/mounts or /etc/mtab if that is not available) in one go. They
+     * are read again when the kernel reports a change of the mount table
+     * on /proc/self/mountinfo; that is checked at most once per second.
+     *
+     * All static methods can be used from any thread.
      **/
     class MountPoints
     {
@@ -114,11 +149,26 @@ namespace QDirStat
          * starting from 'path'. 'path' itself might be that mount point.
          * Ownership of the returned object is not transferred to the caller.
          *
+         * This is one lookup for each path component in the trie of the
+         * mount point paths. An absolute path without "." or ".."
+         * components is used as it is; only other paths are made
+         * canonical first, which needs a system call. Symlinks in an
+         * absolute path are not resolved, just like for the paths in a
+         * DirTree.
+         *
          * This might return 0 if none of the files containing mount
-         * information (/proc/mounts, /etc/mtab) could be read.
+         * information (/proc/self/mountinfo, /proc/mounts, /etc/mtab) could
+         * be read.
          **/
         static const MountPoint * findNearestMountPoint( const QString & path );
 
+        /**
+         * Return the mount points below 'path', but not 'path' itself, in
+         * alphabetical order. Ownership of the returned objects is not
+         * transferred to the caller.
+         **/
+        static QList<const MountPoint *> findBelow( const QString & path );
+
         /**
          * Return 'true' if any mount point has filesystem type "btrfs".
          **/
@@ -126,8 +176,9 @@ namespace QDirStat
 
         /**
          * Ensure the mount points are populated with the content of
-         * /proc/mounts, falling back to /etc/mtab if /proc/mounts cannot be
-         * read.
+         * /proc/self/mountinfo, falling back to /proc/mounts and /etc/mtab
+         * if that cannot be read, and read them again if the mount table
+         * changed.
          **/
         void ensurePopulated();
 
@@ -156,6 +207,26 @@ namespace QDirStat
          **/
         void init();
 
+        /**
+         * Clear the content of this class, but keep the MountPoint objects
+         * until the next clear(), since other threads might still use
+         * them.
+         **/
+        void retire();
+
+        /**
+         * Return 'true' if the kernel reported a change of the mount table
+         * since the last read of /proc/self/mountinfo. This checks at most
+         * once per second.
+         **/
+        bool mountTableChanged();
+
+        /**
+         * Read /proc/self/mountinfo and populate the mount points with the
+         * content. Return 'true' on success, 'false' on failure.
+         **/
+        bool readMountInfo();
+
         /**
          * Read 'filename' (in /proc/mounts or /etc/mnt syntax) and populate
          * the mount points with the content. Return 'true' on success, 'false'
@@ -163,6 +234,36 @@ namespace QDirStat
          **/
         bool read( const QString & filename );
 
+        /**
+         * Parse one line of /proc/self/mountinfo from 'line' to 'end' and
+         * add its mount point. Return 'false' if it is not a valid line.
+         **/
+        bool parseMountInfoLine( const char * line, const char * end );
+
+        /**
+         * Parse one line of /proc/mounts or /etc/mtab from 'line' to 'end'
+         * and add its mount point. Return 'false' if it is not a valid
+         * line.
+         **/
+        bool parseMountsLine( const char * line, const char * end );
+
+        /**
+         * Add a mount point to the map and to the trie. This takes over
+         * ownership of 'mountPoint'.
+         **/
+        void add( MountPoint * mountPoint );
+
+        /**
+         * Return the nearest mount point for 'path' from the trie.
+         **/
+        const MountPoint * findInTrie( const QString & path ) const;
+
+        /**
+         * Return a field of /proc/self/mountinfo or /proc/mounts with the
+         * octal escapes ("\040" for a blank etc.) resolved.
+         **/
+        static QString unescape( const char * start, const char * end );
+
         /**
          * Check if any of the mount points has filesystem type "btrfs".
          **/
@@ -175,9 +276,14 @@ namespace QDirStat
         static MountPoints * _instance;
 
         QMap<QString, MountPoint *> _mountPointMap;
+        MountPointTrieNode          _trie;        // for "/"
+        QList<MountPoint *>         _retired;     // See retire()
         bool                        _isPopulated;
         bool                        _hasBtrfs;
         bool                        _checkedForBtrfs;
+        int                         _mountInfoFd; // For change notifications
+        QElapsedTimer               _changeCheckTimer;
+        QMutex                      _mutex;
 
     }; // class MountPoints
 
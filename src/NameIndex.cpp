@@ -0,0 +1,229 @@
+/*
+ *   File name: NameIndex.cpp
+ *   Summary:	Trigram index of the names in a DirTree for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <algorithm>
+#include <iterator>
+
+#include "NameIndex.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "FileInfoIterator.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+static bool shorterList( const QVector<int> * a, const QVector<int> * b )
+{
+    return a->size() < b->size();
+}
+
+
+NameIndex::NameIndex( DirTree * tree ):
+    QObject( tree ),
+    _tree( tree ),
+    _built( false )
+{
+    CHECK_PTR( _tree );
+
+    connect( _tree, SIGNAL( childAdded     ( FileInfo * ) ),
+	     this,  SLOT  ( childAdded     ( FileInfo * ) ) );
+
+    connect( _tree, SIGNAL( deletingChild  ( FileInfo * ) ),
+	     this,  SLOT  ( itemsDeleted() ) );
+
+    connect( _tree, SIGNAL( clearingSubtree( DirInfo *	) ),
+	     this,  SLOT  ( itemsDeleted() ) );
+
+    connect( _tree, SIGNAL( clearing() ),
+	     this,  SLOT  ( itemsDeleted() ) );
+}
+
+
+NameIndex::~NameIndex()
+{
+
+}
+
+
+void NameIndex::clear()
+{
+    // Assigning empty containers frees the memory right away
+
+    _items    = QVector<FileInfo *>();
+    _postings = QHash<quint64, QVector<int> >();
+    _built    = false;
+
+    emit cleared();
+}
+
+
+void NameIndex::itemsDeleted()
+{
+    if ( _built )
+    {
+	logDebug() << "Dropping the name index" << endl;
+	clear();
+    }
+}
+
+
+void NameIndex::build()
+{
+    clear();
+
+    if ( _tree->root() )
+	addSubtree( _tree->root() );
+
+    _built = true;
+
+    logDebug() << "Indexed " << _items.size() << " names with "
+	       << _postings.size() << " trigrams" << endl;
+}
+
+
+void NameIndex::childAdded( FileInfo * newChild )
+{
+    // Each new child is reported separately, even if it comes with its
+    // parent from a cache file, so there is no need to recurse here.
+
+    if ( _built && newChild )
+	addItem( newChild );
+}
+
+
+void NameIndex::addSubtree( FileInfo * item )
+{
+    addItem( item );
+
+    FileInfoIterator it( item );
+
+    while ( *it )
+    {
+	addSubtree( *it );
+	++it;
+    }
+}
+
+
+void NameIndex::addItem( FileInfo * item )
+{
+    // The invisible root and the dot entries have no real names
+
+    if ( ! item->parent() || item->isDotEntry() )
+	return;
+
+    int id = _items.size();
+    _items << item;
+
+    QString lowerName = item->name().toLower();
+
+    for ( int pos=0; pos + 2 < lowerName.size(); ++pos )
+    {
+	QVector<int> & list = _postings[ trigram( lowerName, pos ) ];
+
+	if ( list.isEmpty() || list.last() != id ) // Same trigram twice in this name
+	    list << id;
+    }
+}
+
+
+QVector<int> NameIndex::candidates( const QStringList & literals,
+				    bool *		whole ) const
+{
+    QVector<const QVector<int> *> lists;
+
+    foreach ( const QString & literal, literals )
+    {
+	QString lowerLiteral = literal.toLower();
+
+	for ( int pos=0; pos + 2 < lowerLiteral.size(); ++pos )
+	{
+	    QHash<quint64, QVector<int> >::const_iterator found =
+		_postings.find( trigram( lowerLiteral, pos ) );
+
+	    if ( found == _postings.constEnd() ) // No item has that trigram
+	    {
+		*whole = false;
+		return QVector<int>();
+	    }
+
+	    lists << &found.value();
+	}
+    }
+
+    *whole = lists.isEmpty();
+
+    if ( lists.isEmpty() )
+	return QVector<int>();
+
+    // Start with the shortest list so each intersection is as short as
+    // possible
+
+    std::sort( lists.begin(), lists.end(), shorterList );
+    QVector<int> result = *lists.first();
+
+    for ( int i=1; i < lists.size() && ! result.isEmpty(); ++i )
+    {
+	QVector<int> intersection;
+	intersection.reserve( result.size() );
+
+	const QVector<int> * list = lists.at( i );
+
+	std::set_intersection( result.constBegin(), result.constEnd(),
+			       list->constBegin(),  list->constEnd(),
+			       std::back_inserter( intersection ) );
+	result = intersection;
+    }
+
+    return result;
+}
+
+
+QStringList NameIndex::literals( const QString & wildcardPattern )
+{
+    QStringList result;
+    QString literal;
+
+    for ( int i=0; i < wildcardPattern.size(); ++i )
+    {
+	QChar c = wildcardPattern.at( i );
+	bool wildcard = ( c == '*' || c == '?' );
+
+	if ( c == '[' )
+	{
+	    int end = wildcardPattern.indexOf( ']', i + 2 ); // "[]...]" includes ']'
+
+	    if ( end > 0 )
+	    {
+		wildcard = true;
+		i = end;
+	    }
+	}
+
+	if ( wildcard )
+	{
+	    if ( ! literal.isEmpty() )
+		result << literal;
+
+	    literal.clear();
+	}
+	else
+	{
+	    literal += c;
+	}
+    }
+
+    if ( ! literal.isEmpty() )
+	result << literal;
+
+    return result;
+}
@@ -0,0 +1,163 @@
+/*
+ *   File name: NameIndex.h
+ *   Summary:	Trigram index of the names in a DirTree for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef NameIndex_h
+#define NameIndex_h
+
+
+#include <QObject>
+#include <QHash>
+#include <QVector>
+#include <QString>
+#include <QStringList>
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class DirInfo;
+    class FileInfo;
+
+
+    /**
+     * Trigram index of the names of all files and directories in a
+     * DirTree for finding them by substrings or wildcard patterns.
+     *
+     * Each item gets an ID (its position in the item list), and for each
+     * trigram (three consecutive characters in lowercase) of its name, the
+     * ID is added to the list of that trigram. The IDs are added in
+     * ascending order, so each list is sorted, and the candidates for a
+     * literal string are the intersection of the lists of all its
+     * trigrams. They still have to be checked against the complete
+     * pattern; see candidates().
+     *
+     * The index is built on demand with build(). Children that are added
+     * to the tree after that (e.g. while reading or from a cache file) are
+     * added to it, too. Since the IDs are positions in the item list,
+     * items can't be removed, so the complete index is cleared when any
+     * item is deleted from the tree, and cleared() is emitted.
+     *
+     * Use DirTree::nameIndex() to get the index of a tree.
+     **/
+    class NameIndex: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor. The index is a child of 'tree'.
+	 **/
+	NameIndex( DirTree * tree );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~NameIndex();
+
+	/**
+	 * Build the index from the complete tree.
+	 **/
+	void build();
+
+	/**
+	 * Return 'true' if the index is built.
+	 **/
+	bool isBuilt() const { return _built; }
+
+	/**
+	 * Return the number of indexed items.
+	 **/
+	int itemCount() const { return _items.size(); }
+
+	/**
+	 * Return the item with ID 'id'.
+	 **/
+	FileInfo * item( int id ) const { return _items.at( id ); }
+
+	/**
+	 * Return the IDs (in ascending order) of the items whose names
+	 * contain all of 'literals' (case-insensitive). Literals with less
+	 * than three characters can't be looked up; if there are no others,
+	 * 'whole' is set to 'true' and the result is empty: Then all items are
+	 * candidates.
+	 **/
+	QVector<int> candidates( const QStringList & literals,
+				 bool *		   whole ) const;
+
+	/**
+	 * Return the literal parts of a wildcard pattern, i.e. everything
+	 * that is not '*', '?' or a '[...]' character set.
+	 **/
+	static QStringList literals( const QString & wildcardPattern );
+
+    public slots:
+
+	/**
+	 * Clear the index and emit cleared(). It has to be built again with
+	 * build().
+	 **/
+	void clear();
+
+    signals:
+
+	/**
+	 * Emitted when the index is cleared. Any IDs obtained before are
+	 * invalid after this.
+	 **/
+	void cleared();
+
+    protected slots:
+
+	/**
+	 * Add a new child to the index.
+	 **/
+	void childAdded( FileInfo * newChild );
+
+	/**
+	 * Clear the index because items are deleted from the tree.
+	 **/
+	void itemsDeleted();
+
+    protected:
+
+	/**
+	 * Add 'item' and everything below it to the index.
+	 **/
+	void addSubtree( FileInfo * item );
+
+	/**
+	 * Add one item to the index.
+	 **/
+	void addItem( FileInfo * item );
+
+	/**
+	 * Return the trigram that starts at 'pos' in 'lowerName'.
+	 **/
+	static quint64 trigram( const QString & lowerName, int pos )
+	{
+	    return ( (quint64) lowerName.at( pos     ).unicode() << 32 ) |
+		   ( (quint64) lowerName.at( pos + 1 ).unicode() << 16 ) |
+		     (quint64) lowerName.at( pos + 2 ).unicode();
+	}
+
+
+	// Data members
+
+	DirTree *			 _tree;
+	bool				 _built;
+	QVector<FileInfo *>		 _items;
+	QHash<quint64, QVector<int> >	 _postings;
+
+    };	// class NameIndex
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef NameIndex_h
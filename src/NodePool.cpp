@@ -0,0 +1,270 @@
+/*
+ *   File name: NodePool.cpp
+ *   Summary:	Pool allocator for FileInfo / DirInfo nodes
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <new>
+
+#include <QMutexLocker>
+
+#include "NodePool.h"
+
+using namespace QDirStat;
+
+
+// Size of the chunk header, rounded up to keep the nodes aligned
+#define ChunkHeaderSize	 ( ( sizeof( Chunk ) + 15 ) & ~15 )
+
+
+QMutex		    NodePool::_mutex;
+NodePool::Chunk *   NodePool::_chunksWithFreeNodes[ NodePool::SizeClasses ];
+qint64		    NodePool::_liveNodes  = 0;
+qint64		    NodePool::_chunkCount = 0;
+qint64		    NodePool::_retiredCount = 0;
+quint64		    NodePool::_epoch	  = 1;
+QList<NodePool::RetiredNodes> NodePool::_retired;
+QMap<quint64, int>  NodePool::_pins;
+
+
+int NodePool::sizeClass( size_t size )
+{
+    int sizeClass = ( size + Granularity - 1 ) / Granularity - 1;
+
+    return sizeClass < SizeClasses ? sizeClass : -1;
+}
+
+
+NodePool::Chunk * NodePool::chunk( void * node )
+{
+    return reinterpret_cast<Chunk *>( reinterpret_cast<uintptr_t>( node ) & ~( (uintptr_t) ChunkSize - 1 ) );
+}
+
+
+bool NodePool::isFull( const Chunk * chunk )
+{
+    size_t nodeSize = ( chunk->sizeClass + 1 ) * Granularity;
+    const char * chunkEnd = reinterpret_cast<const char *>( chunk ) + ChunkSize;
+
+    return ! chunk->freeList && chunk->unused + nodeSize > chunkEnd;
+}
+
+
+NodePool::Chunk * NodePool::newChunk( int sizeClass )
+{
+    void * mem = 0;
+
+    if ( posix_memalign( &mem, ChunkSize, ChunkSize ) != 0 || ! mem )
+	throw std::bad_alloc();
+
+    Chunk * chunk = static_cast<Chunk *>( mem );
+    chunk->prev		= 0;
+    chunk->next		= 0;
+    chunk->freeList	= 0;
+    chunk->unused	= static_cast<char *>( mem ) + ChunkHeaderSize;
+    chunk->liveNodes	= 0;
+    chunk->sizeClass	= sizeClass;
+    chunk->hasFreeNodes = false;
+    ++_chunkCount;
+
+    return chunk;
+}
+
+
+void NodePool::linkChunk( Chunk * chunk )
+{
+    Chunk *& head = _chunksWithFreeNodes[ chunk->sizeClass ];
+
+    chunk->prev = 0;
+    chunk->next = head;
+
+    if ( head )
+	head->prev = chunk;
+
+    head = chunk;
+    chunk->hasFreeNodes = true;
+}
+
+
+void NodePool::unlinkChunk( Chunk * chunk )
+{
+    if ( chunk->prev )
+	chunk->prev->next = chunk->next;
+    else
+	_chunksWithFreeNodes[ chunk->sizeClass ] = chunk->next;
+
+    if ( chunk->next )
+	chunk->next->prev = chunk->prev;
+
+    chunk->prev = 0;
+    chunk->next = 0;
+    chunk->hasFreeNodes = false;
+}
+
+
+void * NodePool::allocate( size_t size )
+{
+    int index = sizeClass( size );
+
+    if ( index < 0 )
+	return ::operator new( size );
+
+    QMutexLocker locker( &_mutex );
+
+    Chunk * chunk = _chunksWithFreeNodes[ index ];
+
+    if ( ! chunk )
+    {
+	chunk = newChunk( index );
+	linkChunk( chunk );
+    }
+
+    void * node = 0;
+
+    if ( chunk->freeList )
+    {
+	node = chunk->freeList;
+	chunk->freeList = chunk->freeList->next;
+    }
+    else
+    {
+	node = chunk->unused;
+	chunk->unused += ( index + 1 ) * Granularity;
+    }
+
+    ++chunk->liveNodes;
+    ++_liveNodes;
+
+    if ( isFull( chunk ) )
+	unlinkChunk( chunk );
+
+    return node;
+}
+
+
+void NodePool::release( void * node, size_t size )
+{
+    if ( ! node )
+	return;
+
+    QMutexLocker locker( &_mutex );
+
+    if ( _retired.isEmpty() || _retired.last().epoch != _epoch )
+    {
+	RetiredNodes retired;
+	retired.epoch = _epoch;
+	_retired.append( retired );
+    }
+
+    RetiredNodes & retired = _retired.last();
+
+    if ( sizeClass( size ) < 0 )
+    {
+	BigNode bigNode;
+	bigNode.node = node;
+	bigNode.size = size;
+	retired.bigNodes.append( bigNode );
+    }
+    else
+    {
+	retired.nodes.append( node );
+    }
+
+    ++_retiredCount;
+}
+
+
+void NodePool::reclaim()
+{
+    QMutexLocker locker( &_mutex );
+
+    // A pin protects the nodes released in its epoch and in all later ones
+
+    quint64 limit = _pins.isEmpty() ? _epoch + 1 : _pins.firstKey();
+
+    while ( ! _retired.isEmpty() && _retired.first().epoch < limit )
+    {
+	RetiredNodes retired = _retired.takeFirst();
+
+	foreach ( void * node, retired.nodes )
+	    freeNode( node );
+
+	foreach ( const BigNode & bigNode, retired.bigNodes )
+	    ::operator delete( bigNode.node );
+
+	_retiredCount -= retired.nodes.size() + retired.bigNodes.size();
+    }
+
+    ++_epoch;
+}
+
+
+quint64 NodePool::pin()
+{
+    QMutexLocker locker( &_mutex );
+    ++_pins[ _epoch ];
+
+    return _epoch;
+}
+
+
+void NodePool::unpin( quint64 epoch )
+{
+    QMutexLocker locker( &_mutex );
+    QMap<quint64, int>::iterator it = _pins.find( epoch );
+
+    if ( it != _pins.end() && --it.value() <= 0 )
+	_pins.erase( it );
+}
+
+
+void NodePool::freeNode( void * node )
+{
+    Chunk * chunk = NodePool::chunk( node );
+    --_liveNodes;
+
+    if ( --chunk->liveNodes == 0 )
+    {
+	// Last node of this chunk: Give the complete chunk back
+
+	if ( chunk->hasFreeNodes )
+	    unlinkChunk( chunk );
+
+	free( chunk );
+	--_chunkCount;
+	return;
+    }
+
+    FreeNode * link = static_cast<FreeNode *>( node );
+    link->next	    = chunk->freeList;
+    chunk->freeList = link;
+
+    if ( ! chunk->hasFreeNodes )
+	linkChunk( chunk );
+}
+
+
+qint64 NodePool::liveNodes()
+{
+    QMutexLocker locker( &_mutex );
+    return _liveNodes;
+}
+
+
+qint64 NodePool::retiredNodes()
+{
+    QMutexLocker locker( &_mutex );
+    return _retiredCount;
+}
+
+
+qint64 NodePool::chunkBytes()
+{
+    QMutexLocker locker( &_mutex );
+    return _chunkCount * ChunkSize;
+}
@@ -0,0 +1,237 @@
+/*
+ *   File name: NodePool.h
+ *   Summary:	Pool allocator for FileInfo / DirInfo nodes
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef NodePool_h
+#define NodePool_h
+
+
+#include <stddef.h>
+
+#include <QMutex>
+#include <QList>
+#include <QMap>
+#include <QVector>
+
+
+namespace QDirStat
+{
+    /**
+     * Pool allocator for the nodes of a DirTree (FileInfo, DirInfo and
+     * their derived classes).
+     *
+     * There are many millions of those nodes on a big file system, and all
+     * of them have one of very few sizes. The pool carves them from large,
+     * aligned chunks that each hold nodes of only one size class, so there
+     * is no per-node malloc() overhead, the nodes of one directory tend to
+     * be close to each other in memory, and freeing a node is just pushing
+     * it to the free list of its chunk.
+     *
+     * A chunk is released as a whole as soon as its last node is freed,
+     * so clearing a tree (or a big subtree) gives the memory back.
+     *
+     * This is used by the class-specific operator new / operator delete of
+     * FileInfo.
+     *
+     * Released nodes are not reused right away: They are only retired, and
+     * they are given back to the pool with the next reclaim(), which the
+     * DirTree does from the event loop after it deleted any nodes. Until
+     * then, the memory of a deleted node stays as its destructor left it,
+     * so code that still has a pointer to it can safely find out with
+     * FileInfo::checkMagicNumber() that it is gone.
+     *
+     * Code that holds node pointers for longer than that, in particular
+     * in other threads, uses a NodePin: Nodes released while any pin is
+     * active are not reclaimed until that pin is gone (epoch based
+     * reclamation). Holding a pointer doesn't need any lock; only taking
+     * and dropping a pin does.
+     **/
+    class NodePool
+    {
+    public:
+
+	/**
+	 * Allocate 'size' bytes for a node.
+	 **/
+	static void * allocate( size_t size );
+
+	/**
+	 * Release a node of 'size' bytes that was allocated with
+	 * allocate(). The node is only retired; see reclaim().
+	 **/
+	static void release( void * node, size_t size );
+
+	/**
+	 * Give all retired nodes back to the pool that are not protected by
+	 * any pin, and start a new epoch.
+	 *
+	 * Call this only where there is no more code on the stack that might
+	 * use pointers to nodes that were deleted, e.g. from the event loop.
+	 **/
+	static void reclaim();
+
+	/**
+	 * Pin the current epoch: Nodes that are released from now on are
+	 * not reclaimed until unpin() is called with the returned epoch.
+	 * Better use a NodePin than calling this directly.
+	 **/
+	static quint64 pin();
+
+	/**
+	 * Drop a pin that was returned by pin().
+	 **/
+	static void unpin( quint64 epoch );
+
+	/**
+	 * Return the number of nodes that are released, but not reclaimed
+	 * yet.
+	 **/
+	static qint64 retiredNodes();
+
+	/**
+	 * Return the number of nodes currently allocated from the pool.
+	 **/
+	static qint64 liveNodes();
+
+	/**
+	 * Return the number of bytes of all chunks currently held by the
+	 * pool.
+	 **/
+	static qint64 chunkBytes();
+
+
+    protected:
+
+	enum
+	{
+	    Granularity	   = 8,
+	    SizeClasses	   = 48,	// Nodes up to 384 bytes
+	    ChunkSize	   = 256 * 1024 // Must be a power of 2
+	};
+
+	struct FreeNode
+	{
+	    FreeNode * next;
+	};
+
+	/**
+	 * A node that is too big for the pool, with its size.
+	 **/
+	struct BigNode
+	{
+	    void *	node;
+	    size_t	size;
+	};
+
+	/**
+	 * The nodes that were released in one epoch. Only the pointers are
+	 * stored here; the nodes themselves are left alone until they are
+	 * reclaimed.
+	 **/
+	struct RetiredNodes
+	{
+	    quint64		epoch;
+	    QVector<void *>	nodes;
+	    QVector<BigNode>	bigNodes;
+	};
+
+	/**
+	 * Header at the start of each chunk.
+	 **/
+	struct Chunk
+	{
+	    Chunk *	prev;		// List of chunks with free nodes
+	    Chunk *	next;
+	    FreeNode *	freeList;	// Freed nodes of this chunk
+	    char *	unused;		// Start of the never used part
+	    int		liveNodes;
+	    int		sizeClass;
+	    bool	hasFreeNodes;	// In the list of chunks with free nodes?
+	};
+
+	/**
+	 * Return the size class for 'size' or -1 if nodes of this size are
+	 * not handled by the pool.
+	 **/
+	static int sizeClass( size_t size );
+
+	/**
+	 * Create a new chunk for size class 'sizeClass'.
+	 **/
+	static Chunk * newChunk( int sizeClass );
+
+	/**
+	 * Link 'chunk' into / unlink it from the list of chunks with free
+	 * nodes for its size class.
+	 **/
+	static void linkChunk  ( Chunk * chunk );
+	static void unlinkChunk( Chunk * chunk );
+
+	/**
+	 * Return the chunk 'node' belongs to.
+	 **/
+	static Chunk * chunk( void * node );
+
+	/**
+	 * Return 'true' if 'chunk' has no more room for another node.
+	 **/
+	static bool isFull( const Chunk * chunk );
+
+	/**
+	 * Give a pool node back to its chunk. The mutex has to be locked.
+	 **/
+	static void freeNode( void * node );
+
+
+	static QMutex	_mutex;
+	static Chunk *	_chunksWithFreeNodes[ SizeClasses ];
+	static qint64	_liveNodes;
+	static qint64	_chunkCount;
+	static qint64	_retiredCount;
+	static quint64	_epoch;
+	static QList<RetiredNodes> _retired;	// Oldest epoch first
+	static QMap<quint64, int>  _pins;	// Pin count for each epoch
+
+    };	// class NodePool
+
+
+    /**
+     * Pin for the NodePool: As long as this exists, no node that is
+     * deleted after it was created is reclaimed, so the memory of any node
+     * this code has a pointer to remains valid, even if the node is
+     * deleted in another thread.
+     *
+     * Create this before obtaining the node pointers, e.g. as a member of
+     * a worker that gets them in its constructor.
+     **/
+    class NodePin
+    {
+    public:
+
+	NodePin():
+	    _epoch( NodePool::pin() )
+	    {}
+
+	~NodePin()
+	    { NodePool::unpin( _epoch ); }
+
+    private:
+
+	// Disable copying: Each pin has to be dropped exactly once.
+
+	NodePin( const NodePin & );
+	NodePin & operator=( const NodePin & );
+
+	quint64 _epoch;
+
+    };	// class NodePin
+
+}	// namespace QDirStat
+
+
+#endif // ifndef NodePool_h
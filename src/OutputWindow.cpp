@@ -26,6 +26,8 @@ using QDirStat::writeFontEntry;
 #define CONNECT_ACTION(ACTION, RECEIVER, RCVR_SLOT) \
     connect( (ACTION), SIGNAL( triggered() ), (RECEIVER), SLOT( RCVR_SLOT ) )
 
+#define FLUSH_INTERVAL_MILLISEC	100
+
 
 OutputWindow::OutputWindow( QWidget * parent ):
     QDialog( parent ),
@@ -34,10 +36,19 @@ OutputWindow::OutputWindow( QWidget * parent ):
     _noMoreProcesses( false ),
     _closed( false ),
     _killedAll( false ),
-    _errorCount( 0 )
+    _errorCount( 0 ),
+    _maxParallelProcesses( 1 ),
+    _maxLines( 0 )
 {
     _ui->setupUi( this );
     logDebug() << "Creating" << endl;
+
+    _flushTimer.setSingleShot( true );
+    _flushTimer.setInterval( FLUSH_INTERVAL_MILLISEC );
+
+    connect( &_flushTimer, SIGNAL( timeout()	 ),
+	     this,	   SLOT  ( flushOutput() ) );
+
     readSettings();
 
     _ui->terminal->clear();
@@ -66,6 +77,7 @@ OutputWindow::~OutputWindow()
 	qDeleteAll( _processList );
     }
 
+    flushOutput();	// At least to the log file
     writeSettings();
 }
 
@@ -97,8 +109,36 @@ void OutputWindow::addProcess( Process * process )
     connect( process, SIGNAL( finished	     ( int, QProcess::ExitStatus ) ),
 	     this,    SLOT  ( processFinished( int, QProcess::ExitStatus ) ) );
 
-    if ( ! hasActiveProcess() )
-	startNextProcess();
+    startQueuedProcesses();
+}
+
+
+void OutputWindow::addJob( QObject * job )
+{
+    CHECK_PTR( job );
+
+    _jobs << job;
+
+    connect( job,  SIGNAL( progress    ( QString ) ),
+	     this, SLOT  ( addStdout   ( QString ) ) );
+
+    connect( job,  SIGNAL( errorMessage( QString ) ),
+	     this, SLOT  ( addStderr   ( QString ) ) );
+
+    connect( job,  SIGNAL( finished()	 ),
+	     this, SLOT  ( jobFinished() ) );
+
+    updateActions();
+}
+
+
+void OutputWindow::jobFinished()
+{
+    _jobs.removeAll( sender() );
+
+    checkLastProcessFinished();
+    closeIfDone();
+    updateActions();
 }
 
 
@@ -135,22 +175,94 @@ void OutputWindow::addText( const QString & rawText, const QColor & textColor )
     if ( ! text.endsWith( "\n" ) )
 	text += "\n";
 
-    _ui->terminal->moveCursor( QTextCursor::End );
-    QTextCursor cursor( _ui->terminal->textCursor() );
+    // Only collect the text here; flushOutput() adds everything that came
+    // in the meantime in one go.
+
+    if ( ! _pendingText.isEmpty() && _pendingText.last().color == textColor )
+    {
+	_pendingText.last().text += text;
+    }
+    else
+    {
+	PendingText pending;
+	pending.text  = text;
+	pending.color = textColor;
+	_pendingText << pending;
+    }
 
-    QTextCharFormat format;
-    format.setForeground( QBrush( textColor ) );
-    cursor.setCharFormat( format );
-    cursor.insertText( text );
+    if ( ! _flushTimer.isActive() )
+	_flushTimer.start();
+}
+
+
+void OutputWindow::flushOutput()
+{
+    _flushTimer.stop();
+
+    if ( _pendingText.isEmpty() )
+	return;
+
+    QTextCursor cursor( _ui->terminal->document() );
+    cursor.movePosition( QTextCursor::End );
+    cursor.beginEditBlock();
+
+    foreach ( const PendingText & pending, _pendingText )
+    {
+	QTextCharFormat format;
+	format.setForeground( QBrush( pending.color ) );
+	cursor.insertText( pending.text, format );
+
+	if ( _logFile.isOpen() )
+	    _logFile.write( pending.text.toUtf8() );
+    }
+
+    cursor.endEditBlock();
+    _pendingText.clear();
+
+    if ( _logFile.isOpen() )
+	_logFile.flush();
+
+    _ui->terminal->moveCursor( QTextCursor::End );
+    _ui->terminal->ensureCursorVisible();
 }
 
 
 void OutputWindow::clearOutput()
 {
+    _pendingText.clear();
     _ui->terminal->clear();
 }
 
 
+void OutputWindow::setMaxLines( int maxLines )
+{
+    _maxLines = qMax( 0, maxLines );
+    _ui->terminal->setMaximumBlockCount( _maxLines );
+}
+
+
+void OutputWindow::setLogFile( const QString & fileName )
+{
+    flushOutput();
+
+    if ( _logFile.isOpen() )
+	_logFile.close();
+
+    _logFileName = fileName;
+
+    if ( fileName.isEmpty() )
+	return;
+
+    _logFile.setFileName( fileName );
+
+    if ( ! _logFile.open( QIODevice::WriteOnly | QIODevice::Append ) )
+    {
+	logError() << "Can't open " << fileName << ": "
+		   << _logFile.errorString() << endl;
+    }
+}
+
+
 Process * OutputWindow::senderProcess( const char * function ) const
 {
     Process * process = qobject_cast<Process *>( sender() );
@@ -226,17 +338,13 @@ void OutputWindow::processFinished( int exitCode, QProcess::ExitStatus exitStatu
     {
 	_processList.removeAll( process );
 
-	if ( _processList.isEmpty() && _noMoreProcesses )
-	{
-	    logDebug() << "Emitting lastProcessFinished() err: " << _errorCount << endl;
-	    emit lastProcessFinished( _errorCount );
-	}
+	checkLastProcessFinished();
 
 	process->deleteLater();
 	closeIfDone();
     }
 
-    startNextProcess(); // this also calls updateActions()
+    startQueuedProcesses(); // this also calls updateActions()
 }
 
 
@@ -282,25 +390,37 @@ void OutputWindow::processError( QProcess::ProcessError error )
     {
 	_processList.removeAll( process );
 
-	if ( _processList.isEmpty() && _noMoreProcesses )
-	{
-	    logDebug() << "Emitting lastProcessFinished() err: " << _errorCount << endl;
-	    emit lastProcessFinished( _errorCount );
-	}
+	checkLastProcessFinished();
 
 	process->deleteLater();
     }
 
-    startNextProcess(); // this also calls updateActions()
+    startQueuedProcesses(); // this also calls updateActions()
 
     if ( ! _showOnStderr && ! isVisible() )
 	closeIfDone();
 }
 
 
+bool OutputWindow::isDone() const
+{
+    return _processList.isEmpty() && _jobs.isEmpty() && _noMoreProcesses;
+}
+
+
+void OutputWindow::checkLastProcessFinished()
+{
+    if ( isDone() )
+    {
+	logDebug() << "Emitting lastProcessFinished() err: " << _errorCount << endl;
+	emit lastProcessFinished( _errorCount );
+    }
+}
+
+
 void OutputWindow::closeIfDone()
 {
-    if ( _processList.isEmpty() && _noMoreProcesses )
+    if ( isDone() )
     {
 	if ( ( autoClose() && _errorCount == 0 ) ||
 	     _closed || ! isVisible() )
@@ -315,13 +435,7 @@ void OutputWindow::closeIfDone()
 void OutputWindow::noMoreProcesses()
 {
     _noMoreProcesses = true;
-
-    if ( _processList.isEmpty() && _noMoreProcesses )
-    {
-	logDebug() << "Emitting lastProcessFinished() err: " << _errorCount << endl;
-	emit lastProcessFinished( _errorCount );
-    }
-
+    checkLastProcessFinished();
     closeIfDone();
 }
 
@@ -379,6 +493,13 @@ void OutputWindow::killAll()
 	++killCount;
     }
 
+    foreach ( QObject * job, _jobs )
+    {
+	logInfo() << "Canceling " << job->metaObject()->className() << endl;
+	QMetaObject::invokeMethod( job, "cancel" );
+	++killCount;
+    }
+
     _killedAll = true;
     addCommandLine( killCount == 1 ?
 		    tr( "Process killed." ) :
@@ -411,6 +532,23 @@ bool OutputWindow::hasActiveProcess() const
 }
 
 
+int OutputWindow::activeProcessCount() const
+{
+    int count = 0;
+
+    foreach ( Process * process, _processList )
+    {
+	if ( process->state() == QProcess::Starting ||
+	     process->state() == QProcess::Running )
+	{
+	    ++count;
+	}
+    }
+
+    return count;
+}
+
+
 Process * OutputWindow::pickQueuedProcess()
 {
     foreach ( Process * process, _processList )
@@ -450,6 +588,20 @@ Process * OutputWindow::startNextProcess()
 }
 
 
+void OutputWindow::startQueuedProcesses()
+{
+    // Count again each time: A process that failed to start is already
+    // gone.
+
+    while ( activeProcessCount() < _maxParallelProcesses && startNextProcess() )
+    {
+	// Nothing else to do
+    }
+
+    updateActions();
+}
+
+
 QString OutputWindow::command( Process * process )
 {
     // The common case is to start an external command with
@@ -482,7 +634,7 @@ void OutputWindow::closeEvent( QCloseEvent * event )
 {
     _closed = true;
 
-    if ( _processList.isEmpty() && _noMoreProcesses )
+    if ( isDone() )
 	this->deleteLater();
 
     // If there are any more processes, wait until the last one is finished and
@@ -494,7 +646,7 @@ void OutputWindow::closeEvent( QCloseEvent * event )
 
 void OutputWindow::updateActions()
 {
-    _ui->killButton->setEnabled( hasActiveProcess() );
+    _ui->killButton->setEnabled( hasActiveProcess() || ! _jobs.isEmpty() );
 }
 
 
@@ -525,10 +677,14 @@ void OutputWindow::readSettings()
     _stderrColor	 = readColorEntry( settings, "StdErrTextColor"	 , QColor( Qt::red    ) );
     _terminalDefaultFont = readFontEntry ( settings, "TerminalFont"	 , _ui->terminal->font() );
     _defaultShowTimeout	 = settings.value( "DefaultShowTimeoutMillisec", 500 ).toInt();
+    int	    maxLines	 = settings.value( "MaxLines", 10000 ).toInt();
+    QString logFile	 = settings.value( "LogFile", "" ).toString();
 
     settings.endGroup();
 
     _ui->terminal->setFont( _terminalDefaultFont );
+    setMaxLines( maxLines );
+    setLogFile( logFile );
 }
 
 
@@ -543,6 +699,8 @@ void OutputWindow::writeSettings()
     writeColorEntry( settings, "StdErrTextColor"   , _stderrColor	  );
     writeFontEntry ( settings, "TerminalFont"	   , _terminalDefaultFont );
     settings.setValue( "DefaultShowTimeoutMillisec", _defaultShowTimeout  );
+    settings.setValue( "MaxLines",		     _maxLines		  );
+    settings.setValue( "LogFile",		     _logFileName	  );
 
     settings.endGroup();
 }
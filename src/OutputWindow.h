@@ -13,6 +13,8 @@
 #include <QList>
 #include <QTextStream>
 #include <QStringList>
+#include <QTimer>
+#include <QFile>
 
 #include "ui_output-window.h"
 #include "Process.h"
@@ -33,6 +35,11 @@ using QDirStat::Process;
  *
  * If this dialog is created, but now shown, it will (by default) show itself
  * as soon as there is any output on stderr.
+ *
+ * The output is collected and added to the output area only a few times per
+ * second, and only the last maxLines() lines are kept there: Thousands of
+ * lines from a verbose command would otherwise make the GUI crawl. The
+ * complete output can optionally be written to a file (see setLogFile()).
  **/
 class OutputWindow: public QDialog
 {
@@ -53,10 +60,33 @@ public:
     /**
      * Add a process to watch. Ownership of the process is transferred to this
      * object. If the process is not started yet, it will be started as soon as
-     * there is no other one running.
+     * fewer than maxParallelProcesses() are running.
      **/
     void addProcess( Process * process );
 
+    /**
+     * Return the maximum number of processes to run at the same time.
+     * The default is 1, i.e. one after another.
+     **/
+    int maxParallelProcesses() const { return _maxParallelProcesses; }
+
+    /**
+     * Set the maximum number of processes to run at the same time.
+     **/
+    void setMaxParallelProcesses( int count )
+	{ _maxParallelProcesses = qMax( 1, count ); }
+
+    /**
+     * Add a job to watch that does its work in some other way than with an
+     * external process, e.g. a DeleteJob. It needs a progress( QString )
+     * and an errorMessage( QString ) signal for the output, a finished()
+     * signal and a cancel() slot. It counts as an active process until it
+     * emits finished().
+     *
+     * This does not take over ownership of the job.
+     **/
+    void addJob( QObject * job );
+
     /**
      * Tell this dialog that no more processes will be added, so when the last
      * one is finished and the "auto close" checkbox is checked, it may close
@@ -98,6 +128,30 @@ public:
      **/
     bool showOnStderr() const { return _showOnStderr; }
 
+    /**
+     * Return the maximum number of lines that are kept in the output area.
+     * 0 means no limit.
+     **/
+    int maxLines() const { return _maxLines; }
+
+    /**
+     * Set the maximum number of lines that are kept in the output area.
+     * Older lines are discarded. 0 means no limit.
+     **/
+    void setMaxLines( int maxLines );
+
+    /**
+     * Return the name of the file that the complete output is appended to
+     * or an empty string if there is none.
+     **/
+    const QString & logFile() const { return _logFileName; }
+
+    /**
+     * Append the complete output to file 'fileName'. An empty name stops
+     * that.
+     **/
+    void setLogFile( const QString & fileName );
+
     /**
      * Show window (if not already shown) after the specified timeout has
      * elapsed. This is useful for operations that might be very short, so no
@@ -173,6 +227,11 @@ public:
      **/
     bool hasActiveProcess() const;
 
+    /**
+     * Return the number of processes that are starting or running.
+     **/
+    int activeProcessCount() const;
+
     /**
      * Get the command of the process. Since usually processes are started via
      * a shell ("/bin/sh -c theRealCommand arg1 arg2 ..."), this is typically
@@ -249,6 +308,11 @@ protected slots:
      **/
     void processError( QProcess::ProcessError error );
 
+    /**
+     * One of the watched jobs finished.
+     **/
+    void jobFinished();
+
     /**
      * Zoom the output area in, i.e. make its font larger.
      **/
@@ -270,6 +334,12 @@ protected slots:
      **/
     void timeoutShow();
 
+    /**
+     * Add the output that was collected since the last time to the output
+     * area and to the log file.
+     **/
+    void flushOutput();
+
 
 signals:
 
@@ -301,12 +371,32 @@ protected:
      **/
     void closeIfDone();
 
+    /**
+     * Return 'true' if no more processes or jobs will come and all are
+     * finished.
+     **/
+    bool isDone() const;
+
+    /**
+     * Emit lastProcessFinished() if isDone().
+     **/
+    void checkLastProcessFinished();
+
     /**
      * Add one or more lines of text in text color 'textColor' to the output
      * area.
      **/
     void addText( const QString & text, const QColor & textColor );
 
+    /**
+     * A chunk of output that is not in the output area yet.
+     **/
+    struct PendingText
+    {
+	QString text;
+	QColor	color;
+    };
+
     /**
      * Obtain the process to use from sender(). Return 0 if this is not a
      * QProcess.
@@ -325,6 +415,12 @@ protected:
      **/
     Process * startNextProcess();
 
+    /**
+     * Start queued processes until maxParallelProcesses() are running or
+     * there is none left.
+     **/
+    void startQueuedProcesses();
+
     /**
      * Zoom the terminal font by the specified factor.
      **/
@@ -337,6 +433,7 @@ protected:
 
     Ui::OutputWindow  * _ui;
     QList<Process *>	_processList;
+    QList<QObject *>	_jobs;
     bool		_showOnStderr;
     bool		_noMoreProcesses;
     bool		_closed;
@@ -349,6 +446,12 @@ protected:
     QColor		_stderrColor;
     QFont		_terminalDefaultFont;
     int			_defaultShowTimeout;
+    int			_maxParallelProcesses;
+    int			_maxLines;
+    QList<PendingText>	_pendingText;
+    QTimer		_flushTimer;
+    QString		_logFileName;
+    QFile		_logFile;
 
 };	// class OutputWindow
 
@@ -0,0 +1,236 @@
+/*
+ *   File name: OwnerStatsWindow.cpp
+ *   Summary:	QDirStat "disk usage by owner" window
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QApplication>
+#include <QMap>
+
+#include "OwnerStatsWindow.h"
+#include "DirTree.h"
+#include "Settings.h"
+#include "SettingsHelpers.h"
+#include "HeaderTweaker.h"
+#include "Logger.h"
+#include "Exception.h"
+
+using namespace QDirStat;
+
+
+namespace
+{
+    enum Grouping
+    {
+	ByUser = 0,
+	ByGroup,
+	ByUserAndGroup
+    };
+}
+
+
+OwnerStatsWindow::OwnerStatsWindow( QWidget * parent ):
+    QDialog( parent ),
+    _ui( new Ui::OwnerStatsWindow ),
+    _totalSize( 0LL )
+{
+    // logDebug() << "init" << endl;
+
+    CHECK_NEW( _ui );
+    _ui->setupUi( this );
+    initWidgets();
+    readWindowSettings( this, "OwnerStatsWindow" );
+    readSettings();
+
+    connect( _ui->refreshButton,    SIGNAL( clicked() ),
+	     this,		    SLOT  ( refresh() ) );
+
+    connect( _ui->groupingComboBox, SIGNAL( currentIndexChanged( int ) ),
+	     this,		    SLOT  ( fillList()		       ) );
+}
+
+
+OwnerStatsWindow::~OwnerStatsWindow()
+{
+    // logDebug() << "destroying" << endl;
+    writeWindowSettings( this, "OwnerStatsWindow" );
+    writeSettings();
+}
+
+
+void OwnerStatsWindow::readSettings()
+{
+    Settings settings;
+    settings.beginGroup( "OwnerStatsWindow" );
+
+    _ui->groupingComboBox->setCurrentIndex( settings.value( "Grouping", ByUser ).toInt() );
+
+    settings.endGroup();
+}
+
+
+void OwnerStatsWindow::writeSettings()
+{
+    Settings settings;
+    settings.beginGroup( "OwnerStatsWindow" );
+
+    settings.setValue( "Grouping", _ui->groupingComboBox->currentIndex() );
+
+    settings.endGroup();
+}
+
+
+void OwnerStatsWindow::initWidgets()
+{
+    QFont font = _ui->heading->font();
+    font.setBold( true );
+    _ui->heading->setFont( font );
+
+    _ui->treeWidget->setColumnCount( OS_ColumnCount );
+    _ui->treeWidget->setHeaderLabels( QStringList()
+				      << tr( "Owner" )
+				      << tr( "Size" )
+				      << tr( "%" )
+				      << tr( "Files" )
+				      << tr( "Directories" ) );
+    _ui->treeWidget->header()->setStretchLastSection( false );
+    HeaderTweaker::resizeToContents( _ui->treeWidget->header() );
+}
+
+
+void OwnerStatsWindow::reject()
+{
+    deleteLater();
+}
+
+
+void OwnerStatsWindow::refresh()
+{
+    populate( _subtree() );
+}
+
+
+void OwnerStatsWindow::populate( FileInfo * subtree )
+{
+    _ui->treeWidget->clear();
+    _totals.clear();
+    _subtree = subtree;
+
+    if ( ! subtree )
+	return;
+
+    _ui->heading->setText( tr( "Disk Usage by Owner below %1" ).arg( _subtree.url() ) );
+
+    QApplication::setOverrideCursor( Qt::WaitCursor );
+
+    DirTree * tree = subtree->tree();
+
+    if ( tree && subtree == tree->firstToplevel() && ! subtree->next() )
+	_totals = tree->ownerTotals();	// Cheap: They are already there
+    else
+	_totals.collect( subtree );
+
+    _totalSize = subtree->totalSize();
+    fillList();
+
+    QApplication::restoreOverrideCursor();
+}
+
+
+void OwnerStatsWindow::fillList()
+{
+    _ui->treeWidget->clear();
+
+    int grouping = _ui->groupingComboBox->currentIndex();
+    QMap<QString, OwnerTotal> owners;
+    const QVector<OwnerTotal> & totals = _totals.totals();
+
+    for ( int i=0; i < totals.size(); ++i )
+    {
+	if ( totals.at( i ).items == 0 )
+	    continue;
+
+	uid_t	uid;
+	gid_t	gid;
+	QString owner;
+
+	if ( ! FileInfo::ownerByIndex( i, uid, gid ) )
+	    owner = tr( "Unknown" );
+	else if ( grouping == ByUser )
+	    owner = OwnerTotals::userName( uid );
+	else if ( grouping == ByGroup )
+	    owner = OwnerTotals::groupName( gid );
+	else
+	    owner = OwnerTotals::userName( uid ) + ":" + OwnerTotals::groupName( gid );
+
+	owners[ owner ].add( totals.at( i ) );
+    }
+
+    // For better Performance: Disable sorting while inserting many items
+    _ui->treeWidget->setSortingEnabled( false );
+
+    for ( QMap<QString, OwnerTotal>::const_iterator it = owners.constBegin();
+	  it != owners.constEnd();
+	  ++it )
+    {
+	OwnerStatsItem * item = new OwnerStatsItem( it.key(), it.value(), _totalSize );
+	CHECK_NEW( item );
+
+	_ui->treeWidget->addTopLevelItem( item );
+    }
+
+    _ui->treeWidget->setSortingEnabled( true );
+    _ui->treeWidget->sortByColumn( OS_SizeCol, Qt::DescendingOrder );
+    HeaderTweaker::resizeToContents( _ui->treeWidget->header() );
+
+    logDebug() << owners.size() << " owners below " << _subtree.url() << endl;
+}
+
+
+
+
+
+
+OwnerStatsItem::OwnerStatsItem( const QString	 & owner,
+				const OwnerTotal & total,
+				FileSize	   totalSize ):
+    QTreeWidgetItem( QTreeWidgetItem::UserType ),
+    _total( total )
+{
+    float percent = totalSize > 0 ? 100.0 * total.size / totalSize : 0.0;
+
+    setText( OS_OwnerCol,   owner );
+    setText( OS_SizeCol,    formatSize( total.size ) );
+    setText( OS_PercentCol, QString( "%1%" ).arg( percent, 0, 'f', 1 ) );
+    setText( OS_FilesCol,   QString::number( total.files ) );
+    setText( OS_DirsCol,    QString::number( total.dirs ) );
+
+    setTextAlignment( OS_OwnerCol,   Qt::AlignLeft  );
+    setTextAlignment( OS_SizeCol,    Qt::AlignRight );
+    setTextAlignment( OS_PercentCol, Qt::AlignRight );
+    setTextAlignment( OS_FilesCol,   Qt::AlignRight );
+    setTextAlignment( OS_DirsCol,    Qt::AlignRight );
+}
+
+
+bool OwnerStatsItem::operator<(const QTreeWidgetItem & rawOther) const
+{
+    // Since this is a reference, the dynamic_cast will throw a std::bad_cast
+    // exception if it fails. Not catching this here since this is a genuine
+    // error which should not be silently ignored.
+    const OwnerStatsItem & other = dynamic_cast<const OwnerStatsItem &>( rawOther );
+
+    int col = treeWidget() ? treeWidget()->sortColumn() : OS_SizeCol;
+
+    switch ( col )
+    {
+	case OS_SizeCol:
+	case OS_PercentCol: return total().size	 < other.total().size;
+	case OS_FilesCol:   return total().files < other.total().files;
+	case OS_DirsCol:    return total().dirs	 < other.total().dirs;
+	default:	    return QTreeWidgetItem::operator<( rawOther );
+    }
+}
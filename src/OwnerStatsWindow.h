@@ -0,0 +1,163 @@
+/*
+ *   File name: OwnerStatsWindow.h
+ *   Summary:	QDirStat "disk usage by owner" window
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef OwnerStatsWindow_h
+#define OwnerStatsWindow_h
+
+
+#include <QDialog>
+#include <QTreeWidgetItem>
+
+#include "ui_owner-stats-window.h"
+#include "OwnerTotals.h"
+#include "FileInfo.h"
+#include "Subtree.h"
+
+
+namespace QDirStat
+{
+    /**
+     * Modeless dialog to show how much disk space each user or group uses
+     * in a subtree. See OwnerTotals.
+     *
+     * For the complete tree, this uses the totals that the DirTree keeps
+     * while reading; for any other subtree, they are collected from the
+     * nodes.
+     **/
+    class OwnerStatsWindow: public QDialog
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor.
+	 *
+	 * Notice that this widget will destroy itself upon window close.
+	 *
+	 * It is advised to use a QPointer for storing a pointer to an instance
+	 * of this class. The QPointer will keep track of this window
+	 * auto-deleting itself when closed.
+	 **/
+	OwnerStatsWindow( QWidget * parent );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~OwnerStatsWindow();
+
+	/**
+	 * Return the corresponding subtree.
+	 **/
+	const Subtree & subtree() const { return _subtree; }
+
+    public slots:
+
+	/**
+	 * Populate the window with the owners in 'subtree'.
+	 **/
+	void populate( FileInfo * subtree );
+
+	/**
+	 * Refresh (reload) all data.
+	 **/
+	void refresh();
+
+	/**
+	 * Reject the dialog contents, i.e. the user clicked the "Cancel" or
+	 * WM_CLOSE button. This not only closes the dialog, it also deletes
+	 * it.
+	 *
+	 * Reimplemented from QDialog.
+	 **/
+	virtual void reject() Q_DECL_OVERRIDE;
+
+    protected slots:
+
+	/**
+	 * Fill the list from the owner totals with the current grouping.
+	 **/
+	void fillList();
+
+    protected:
+
+	/**
+	 * One-time initialization of the widgets in this window.
+	 **/
+	void initWidgets();
+
+	/**
+	 * Read parameters from the settings file.
+	 **/
+	void readSettings();
+
+	/**
+	 * Write parameters to the settings file.
+	 **/
+	void writeSettings();
+
+
+	//
+	// Data members
+	//
+
+	Ui::OwnerStatsWindow *	_ui;
+	Subtree			_subtree;
+	OwnerTotals		_totals;
+	FileSize		_totalSize;
+    };
+
+
+    /**
+     * Column numbers for the owner stats tree widget
+     **/
+    enum OwnerStatsColumns
+    {
+	OS_OwnerCol = 0,
+	OS_SizeCol,
+	OS_PercentCol,
+	OS_FilesCol,
+	OS_DirsCol,
+	OS_ColumnCount
+    };
+
+
+    /**
+     * Item class for one user, group or both in the owner stats list.
+     **/
+    class OwnerStatsItem: public QTreeWidgetItem
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	OwnerStatsItem( const QString	 & owner,
+			const OwnerTotal & total,
+			FileSize	   totalSize );
+
+	/**
+	 * Return the totals of this owner.
+	 **/
+	const OwnerTotal & total() const { return _total; }
+
+	/**
+	 * Less-than operator for sorting.
+	 **/
+	virtual bool operator<(const QTreeWidgetItem & other) const Q_DECL_OVERRIDE;
+
+    protected:
+
+	OwnerTotal	_total;
+    };
+
+} // namespace QDirStat
+
+
+#endif // OwnerStatsWindow_h
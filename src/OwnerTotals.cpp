@@ -0,0 +1,150 @@
+/*
+ *   File name: OwnerTotals.cpp
+ *   Summary:	Disk usage by owner (uid and gid)
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <pwd.h>	// getpwuid()
+#include <grp.h>	// getgrgid()
+
+#include <QHash>
+
+#include "OwnerTotals.h"
+#include "FileInfoIterator.h"
+#include "DirInfo.h"
+#include "ColdSubtree.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+void OwnerTotal::add( const OwnerTotal & other )
+{
+    size   += other.size;
+    blocks += other.blocks;
+    items  += other.items;
+    files  += other.files;
+    dirs   += other.dirs;
+}
+
+
+void OwnerTotals::add( FileInfo * item )
+{
+    if ( item->isDotEntry() )
+	return;
+
+    OwnerTotal & owner = total( item->ownerIndex() );
+
+    owner.size	 += item->size();
+    owner.blocks += item->countedBlocks();
+    owner.items++;
+
+    if ( item->isFile() )
+	owner.files++;
+    else if ( item->isDir() )
+	owner.dirs++;
+}
+
+
+void OwnerTotals::add( const FoldedFiles * folded )
+{
+    if ( ! folded )
+	return;
+
+    // Only the owner of the first one is known
+
+    OwnerTotal & owner = total( folded->ownerIndex );
+
+    owner.size	 += folded->size;
+    owner.blocks += folded->blocks;
+    owner.items	 += folded->items;
+    owner.files	 += folded->files;
+}
+
+
+void OwnerTotals::add( const OwnerTotals & other )
+{
+    for ( int i=0; i < other._totals.size(); ++i )
+	total( i ).add( other._totals.at( i ) );
+}
+
+
+void OwnerTotals::collect( FileInfo * subtree )
+{
+    CHECK_PTR( subtree );
+
+    add( subtree );
+
+    if ( ! subtree->isDirInfo() )
+	return;
+
+    DirInfo * dir = subtree->toDirInfo();
+
+    if ( dir->isCold() )
+    {
+	add( dir->coldSubtree()->ownerTotals() );
+	return;
+    }
+
+    add( dir->foldedFiles() );
+
+    FileInfoIterator it( dir );
+
+    while ( *it )
+    {
+	collect( *it );
+	++it;
+    }
+}
+
+
+OwnerTotal OwnerTotals::userTotal( uid_t uid ) const
+{
+    OwnerTotal result;
+
+    for ( int i=1; i < _totals.size(); ++i )
+    {
+	uid_t ownerUid;
+	gid_t ownerGid;
+
+	if ( FileInfo::ownerByIndex( i, ownerUid, ownerGid ) && ownerUid == uid )
+	    result.add( _totals.at( i ) );
+    }
+
+    return result;
+}
+
+
+QString OwnerTotals::userName( uid_t uid )
+{
+    // Looking up a name might ask a directory server, so ask only once
+
+    static QHash<uid_t, QString> names;
+
+    if ( ! names.contains( uid ) )
+    {
+	struct passwd * pw = getpwuid( uid );
+	names.insert( uid, pw ? QString::fromLocal8Bit( pw->pw_name ) : QString::number( uid ) );
+    }
+
+    return names.value( uid );
+}
+
+
+QString OwnerTotals::groupName( gid_t gid )
+{
+    static QHash<gid_t, QString> names;
+
+    if ( ! names.contains( gid ) )
+    {
+	struct group * gr = getgrgid( gid );
+	names.insert( gid, gr ? QString::fromLocal8Bit( gr->gr_name ) : QString::number( gid ) );
+    }
+
+    return names.value( gid );
+}
@@ -0,0 +1,143 @@
+/*
+ *   File name: OwnerTotals.h
+ *   Summary:	Disk usage by owner (uid and gid)
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef OwnerTotals_h
+#define OwnerTotals_h
+
+
+#include <sys/types.h>
+
+#include <QVector>
+#include <QString>
+
+#include "FileInfo.h"
+
+
+namespace QDirStat
+{
+    struct FoldedFiles;
+
+    /**
+     * Totals of the items of one owner.
+     **/
+    struct OwnerTotal
+    {
+	OwnerTotal():
+	    size( 0LL ),
+	    blocks( 0LL ),
+	    items( 0 ),
+	    files( 0 ),
+	    dirs( 0 )
+	    {}
+
+	/**
+	 * Add the totals of 'other'.
+	 **/
+	void add( const OwnerTotal & other );
+
+	FileSize	size;
+	FileSize	blocks;
+	int		items;
+	int		files;
+	int		dirs;
+    };
+
+
+    /**
+     * Totals by owner, indexed by the index of the owner in the
+     * process-wide owner table (see FileInfo::ownerIndex()). Index 0 is the
+     * unknown owner, e.g. for items read from a cache file.
+     *
+     * Adding an item is an index into a small vector, so the DirTree can
+     * keep this up to date for each item that is added while reading.
+     **/
+    class OwnerTotals
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	OwnerTotals() {}
+
+	/**
+	 * Add 'item' (but not its children). Dot entries are ignored.
+	 **/
+	void add( FileInfo * item );
+
+	/**
+	 * Add the folded files of a directory in aggregate-only mode.
+	 **/
+	void add( const FoldedFiles * folded );
+
+	/**
+	 * Add all totals of 'other'.
+	 **/
+	void add( const OwnerTotals & other );
+
+	/**
+	 * Add 'subtree' and everything below it, including folded files and
+	 * cold subtrees.
+	 **/
+	void collect( FileInfo * subtree );
+
+	/**
+	 * Clear everything.
+	 **/
+	void clear() { _totals.clear(); }
+
+	/**
+	 * Return the totals by owner index. This might be shorter than the
+	 * owner table; missing owners don't have any items.
+	 **/
+	const QVector<OwnerTotal> & totals() const { return _totals; }
+
+	/**
+	 * Return the totals of user 'uid' over all of its groups.
+	 **/
+	OwnerTotal userTotal( uid_t uid ) const;
+
+	/**
+	 * Return the name of user 'uid' or the number if there is no such
+	 * user.
+	 **/
+	static QString userName( uid_t uid );
+
+	/**
+	 * Return the name of group 'gid' or the number if there is no such
+	 * group.
+	 **/
+	static QString groupName( gid_t gid );
+
+
+    protected:
+
+	/**
+	 * Return the totals for owner index 'index', growing the vector if
+	 * needed.
+	 **/
+	OwnerTotal & total( unsigned short index )
+	{
+	    if ( index >= _totals.size() )
+		_totals.resize( index + 1 );
+
+	    return _totals[ index ];
+	}
+
+
+	// Data members
+
+	QVector<OwnerTotal>	_totals;
+
+    };	// class OwnerTotals
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef OwnerTotals_h
@@ -8,6 +8,8 @@
 
 
 #include <QPainter>
+#include <QPixmap>
+#include <QPixmapCache>
 #include <QTreeView>
 
 #include "PercentBar.h"
@@ -119,12 +121,12 @@ void PercentBarDelegate::paint( QPainter		   * painter,
 	    int indentPixel  = ( depth * _treeView->indentation() ) / 2;
 	    QColor fillColor = _fillColors.at( depth % _fillColors.size() );
 
-	    paintPercentBar( percent,
-			     painter,
-			     indentPixel,
-			     option.rect,
-			     fillColor,
-			     _barBackground );
+	    paintCachedPercentBar( percent,
+				   painter,
+				   indentPixel,
+				   option.rect,
+				   fillColor,
+				   _barBackground );
 	}
 	else // percent < 0.0 => tree is busy => use as read job column
 	{
@@ -247,6 +249,64 @@ namespace QDirStat
     }
 
 
+    void paintCachedPercentBar( float	       percent,
+				QPainter *     painter,
+				int	       indentPixel,
+				const QRect  & cellRect,
+				const QColor & fillColor,
+				const QColor & barBackground )
+    {
+	if ( cellRect.isEmpty() )
+	    return;
+
+	int    tenthPercent = qRound( percent * 10.0 );
+	QColor background   = painter->background().color();
+
+#if (QT_VERSION >= QT_VERSION_CHECK( 5, 6, 0 ))
+	qreal pixelRatio = painter->device()->devicePixelRatioF();
+#else
+	qreal pixelRatio = 1.0;
+#endif
+
+	QString key = QString( "qdirstat-percent-bar-%1x%2@%3-%4-%5-%6-%7-%8" )
+	    .arg( cellRect.width() )
+	    .arg( cellRect.height() )
+	    .arg( pixelRatio )
+	    .arg( indentPixel )
+	    .arg( tenthPercent )
+	    .arg( fillColor.rgba(),	 0, 16 )
+	    .arg( barBackground.rgba(), 0, 16 )
+	    .arg( background.rgba(),	 0, 16 );
+
+	QPixmap pixmap;
+
+	if ( ! QPixmapCache::find( key, &pixmap ) )
+	{
+	    pixmap = QPixmap( cellRect.size() * pixelRatio );
+#if (QT_VERSION >= QT_VERSION_CHECK( 5, 6, 0 ))
+	    pixmap.setDevicePixelRatio( pixelRatio );
+#endif
+	    pixmap.fill( background );
+
+	    QPainter pixmapPainter( &pixmap );
+	    pixmapPainter.setPen( painter->pen() );
+	    pixmapPainter.setBackground( painter->background() );
+
+	    paintPercentBar( tenthPercent / 10.0,
+			     &pixmapPainter,
+			     indentPixel,
+			     QRect( QPoint( 0, 0 ), cellRect.size() ),
+			     fillColor,
+			     barBackground );
+	    pixmapPainter.end();
+
+	    QPixmapCache::insert( key, pixmap );
+	}
+
+	painter->drawPixmap( cellRect.topLeft(), pixmap );
+    }
+
+
     QColor contrastingColor( const QColor &desiredColor,
 			     const QColor &contrastColor )
     {
@@ -133,6 +133,22 @@ namespace QDirStat
 			  const QColor & fillColor,
 			  const QColor & barBackground	 );
 
+    /**
+     * Paint a percent bar like paintPercentBar(), but use a pixmap from the
+     * QPixmapCache if the same bar was painted before. The percentage is
+     * rounded to 0.1% for that which is less than one pixel for any sane
+     * column width.
+     *
+     * When scrolling through a tree with thousands of items, most bars are
+     * the same again and again, so this is mostly just a blit.
+     **/
+    void paintCachedPercentBar( float	       percent,
+				QPainter *     painter,
+				int	       indentPixel,
+				const QRect  & cellRect,
+				const QColor & fillColor,
+				const QColor & barBackground );
+
     /**
      * Return a color that contrasts with 'contrastColor'.
      **/
@@ -0,0 +1,115 @@
+/*
+ *   File name: PrecomputedStats.cpp
+ *   Summary:	Statistics that are collected while reading a tree
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include "PrecomputedStats.h"
+#include "MimeCategorizer.h"
+#include "MimeCategory.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+PrecomputedStats::PrecomputedStats()
+{
+    clear();
+}
+
+
+void PrecomputedStats::clear()
+{
+    _sizeSketch.clear();
+    _ageStats.clear();
+    _typeTotalsValid = true;
+    _categoryStamp   = 0;
+    _suffixTotals.clear();
+    _categoryTotals.clear();
+}
+
+
+void PrecomputedStats::add( FileInfo * item, MimeCategorizer * categorizer )
+{
+    CHECK_PTR( item );
+
+    if ( ! item->isFile() )
+	return;
+
+    if ( _sizeSketch.count() == 0 )
+	_ageStats = FileAgeStats();	// All ages relative to right now
+
+    _sizeSketch.add( item->size() );
+    _ageStats.add( item );
+
+    if ( ! _typeTotalsValid )
+	return;
+
+    if ( ! categorizer )
+    {
+	_typeTotalsValid = false;
+	_suffixTotals.clear();
+	_categoryTotals.clear();
+	return;
+    }
+
+    QString	   name = item->name();
+    QString	   suffix;
+    MimeCategory * category = categorizer->category( name, &suffix );
+    uint	   stamp    = categorizer->stamp();
+
+    if ( _categoryStamp != 0 && stamp != _categoryStamp )
+    {
+	// The categories changed while reading: Don't mix them up
+
+	_typeTotalsValid = false;
+	_suffixTotals.clear();
+	_categoryTotals.clear();
+	return;
+    }
+
+    _categoryStamp = stamp;
+
+    FileTypeTotal & categoryTotal = _categoryTotals[ category ? category->name() : QString() ];
+    categoryTotal.sum += item->size();
+    ++categoryTotal.count;
+
+    FileTypeTotal & suffixTotal = _suffixTotals[ typeSuffix( name, suffix ) ];
+    suffixTotal.sum += item->size();
+    ++suffixTotal.count;
+}
+
+
+QString PrecomputedStats::typeSuffix( const QString & name,
+				      const QString & categorySuffix )
+{
+    QString suffix = categorySuffix;
+
+    if ( suffix.isEmpty() )
+    {
+	if ( name.contains( '.' ) && ! name.startsWith( '.' ) )
+	{
+	    // Fall back to the last (i.e. the shortest) suffix if the
+	    // MIME categorizer didn't know it: Use section -1 (the
+	    // last one, ignoring any trailing '.' separator).
+	    //
+	    // The downside is that this would not find a ".tar.bz",
+	    // but just the ".bz" for a compressed tarball. But it's
+	    // much better than getting a ".eab7d88df-git.deb" rather
+	    // than a ".deb".
+
+	    suffix = name.section( '.', -1 );
+	}
+    }
+
+    suffix = suffix.toLower();
+
+    if ( suffix.isEmpty() )
+	suffix = NO_SUFFIX;
+
+    return suffix;
+}
@@ -0,0 +1,133 @@
+/*
+ *   File name: PrecomputedStats.h
+ *   Summary:	Statistics that are collected while reading a tree
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef PrecomputedStats_h
+#define PrecomputedStats_h
+
+
+#include <QHash>
+#include <QString>
+
+#include "DirInfo.h"		// FileTypeTotal
+#include "FileSizeSketch.h"
+#include "FileAgeStats.h"
+
+#define NO_SUFFIX "//<No Suffix>" // A slash is illegal in Linux/Unix filenames
+
+
+namespace QDirStat
+{
+    class MimeCategorizer;
+
+    /**
+     * File statistics of a complete tree that are added up as the files
+     * are inserted while reading, so the statistics windows don't need to
+     * walk through the tree again when it is finished:
+     *
+     * - the file sizes in a FileSizeSketch like approximate FileSizeStats
+     * - the file ages in a FileAgeStats (relative to the start of reading)
+     * - the file type totals by suffix and by MIME category like
+     *   FileTypeStats
+     *
+     * The type totals need the MimeCategorizer of the tree. Since the
+     * FileTypeStats use categorizers of their own, the categories are
+     * stored by name, and the stamp of the categories is kept to tell if
+     * they are still the same.
+     *
+     * All this is bounded in size: The sketches have a fixed number of
+     * bins, and there are only so many different suffixes.
+     **/
+    class PrecomputedStats
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	PrecomputedStats();
+
+	/**
+	 * Clear everything. The file ages will be relative to the time the
+	 * next file is added.
+	 **/
+	void clear();
+
+	/**
+	 * Add 'item' if it is a file; anything else is ignored, just like
+	 * in FileSizeStats and FileTypeStats. 'categorizer' may be 0; then
+	 * there are no type totals until the next clear().
+	 **/
+	void add( FileInfo * item, MimeCategorizer * categorizer );
+
+	/**
+	 * Return the number of files added.
+	 **/
+	int fileCount() const { return _sizeSketch.count(); }
+
+	/**
+	 * Return the sketch of the file sizes.
+	 **/
+	const FileSizeSketch & sizeSketch() const { return _sizeSketch; }
+
+	/**
+	 * Return the file ages, relative to the time the first file was
+	 * added.
+	 **/
+	const FileAgeStats & ageStats() const { return _ageStats; }
+
+	/**
+	 * Return 'true' if the type totals are complete, i.e. every file was
+	 * categorized with the same categories.
+	 **/
+	bool hasTypeTotals() const { return _typeTotalsValid; }
+
+	/**
+	 * Return the stamp of the categories of the type totals (see
+	 * MimeCategorizer::stamp()) or 0 if there are none.
+	 **/
+	uint categoryStamp() const { return _categoryStamp; }
+
+	/**
+	 * Return the file totals by suffix. The suffix is the one that is
+	 * used in FileTypeStats, i.e. in lowercase and NO_SUFFIX for none.
+	 **/
+	const QHash<QString, FileTypeTotal> & suffixTotals() const
+	    { return _suffixTotals; }
+
+	/**
+	 * Return the file totals by the name of their MIME category. Files
+	 * without any category have an empty name.
+	 **/
+	const QHash<QString, FileTypeTotal> & categoryTotals() const
+	    { return _categoryTotals; }
+
+	/**
+	 * Return the suffix of 'name' for the file type statistics:
+	 * 'categorySuffix' if the MIME categorizer found the category by a
+	 * suffix, otherwise the last suffix of the name, in lowercase.
+	 * Return NO_SUFFIX if there is none.
+	 **/
+	static QString typeSuffix( const QString & name,
+				   const QString & categorySuffix );
+
+    protected:
+
+	FileSizeSketch			_sizeSketch;
+	FileAgeStats			_ageStats;
+	bool				_typeTotalsValid;
+	uint				_categoryStamp;
+	QHash<QString, FileTypeTotal>	_suffixTotals;
+	QHash<QString, FileTypeTotal>	_categoryTotals;
+
+    };	// class PrecomputedStats
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef PrecomputedStats_h
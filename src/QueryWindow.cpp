@@ -0,0 +1,222 @@
+/*
+ *   File name: QueryWindow.cpp
+ *   Summary:	QDirStat "query" window
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QApplication>
+#include <QMenu>
+
+#include "QueryWindow.h"
+#include "FileQuery.h"
+#include "FindFilesWindow.h"	// FindFilesResultItem
+#include "CleanupCollection.h"
+#include "DirTree.h"
+#include "SelectionModel.h"
+#include "Settings.h"
+#include "SettingsHelpers.h"
+#include "HeaderTweaker.h"
+#include "Logger.h"
+#include "Exception.h"
+
+using namespace QDirStat;
+
+
+QueryWindow::QueryWindow( SelectionModel *    selectionModel,
+			  CleanupCollection * cleanupCollection,
+			  QWidget *	      parent ):
+    QDialog( parent ),
+    _ui( new Ui::QueryWindow ),
+    _selectionModel( selectionModel ),
+    _cleanupCollection( cleanupCollection ),
+    _maxResults( 10000 )
+{
+    // logDebug() << "init" << endl;
+
+    CHECK_NEW( _ui );
+    _ui->setupUi( this );
+    initWidgets();
+    readWindowSettings( this, "QueryWindow" );
+    readSettings();
+
+    connect( _ui->searchButton,	 SIGNAL( clicked()	   ),
+	     this,		 SLOT  ( startSearch()	   ) );
+
+    connect( _ui->patternEdit,	 SIGNAL( returnPressed()   ),
+	     this,		 SLOT  ( startSearch()	   ) );
+
+    connect( _ui->treeWidget,	 SIGNAL( itemSelectionChanged() ),
+	     this,		 SLOT  ( selectResults()	) );
+
+    connect( _ui->treeWidget,	 SIGNAL( customContextMenuRequested( QPoint ) ),
+	     this,		 SLOT  ( contextMenu		   ( QPoint ) ) );
+}
+
+
+QueryWindow::~QueryWindow()
+{
+    // logDebug() << "destroying" << endl;
+    writeWindowSettings( this, "QueryWindow" );
+    writeSettings();
+}
+
+
+void QueryWindow::readSettings()
+{
+    Settings settings;
+    settings.beginGroup( "QueryWindow" );
+
+    _maxResults = settings.value( "MaxResults", 10000 ).toInt();
+    _ui->patternEdit->setText( settings.value( "Query" ).toString() );
+
+    settings.endGroup();
+}
+
+
+void QueryWindow::writeSettings()
+{
+    Settings settings;
+    settings.beginGroup( "QueryWindow" );
+
+    settings.setValue( "MaxResults", _maxResults );
+    settings.setValue( "Query",	     _ui->patternEdit->text().trimmed() );
+
+    settings.endGroup();
+}
+
+
+void QueryWindow::initWidgets()
+{
+    QFont font = _ui->heading->font();
+    font.setBold( true );
+    _ui->heading->setFont( font );
+
+    _ui->treeWidget->setColumnCount( FFR_ColumnCount );
+    _ui->treeWidget->setHeaderLabels( QStringList()
+				      << tr( "Name" )
+				      << tr( "Size" )
+				      << tr( "Directory" ) );
+    _ui->treeWidget->header()->setStretchLastSection( false );
+    HeaderTweaker::resizeToContents( _ui->treeWidget->header() );
+}
+
+
+void QueryWindow::reject()
+{
+    deleteLater();
+}
+
+
+void QueryWindow::populate( FileInfo * subtree )
+{
+    _subtree = subtree;
+
+    _ui->heading->setText( tr( "Query below %1" ).arg( _subtree.url() ) );
+    _ui->patternEdit->setFocus();
+    _ui->patternEdit->selectAll();
+}
+
+
+void QueryWindow::startSearch()
+{
+    _ui->treeWidget->clear();
+
+    FileQuery query;
+    QString   errorMsg;
+
+    if ( ! query.parse( _ui->patternEdit->text(), &errorMsg ) )
+    {
+	_ui->statusLabel->setText( errorMsg );
+	return;
+    }
+
+    FileInfo * subtree = _subtree();
+
+    if ( subtree && ! query.underPath().isEmpty() )
+    {
+	subtree = _subtree.tree()->locate( query.underPath() );
+
+	if ( ! subtree )
+	{
+	    _ui->statusLabel->setText( tr( "Not in the tree: %1" ).arg( query.underPath() ) );
+	    return;
+	}
+    }
+
+    if ( ! subtree || query.isEmpty() )
+    {
+	_ui->statusLabel->clear();
+	return;
+    }
+
+    _ui->statusLabel->setText( tr( "Searching..." ) );
+    QApplication::setOverrideCursor( Qt::WaitCursor );
+
+    FileInfoList result = query.find( subtree );
+
+    // For better Performance: Disable sorting while inserting many items
+    _ui->treeWidget->setSortingEnabled( false );
+
+    int count = qMin( result.size(), _maxResults );
+
+    for ( int i=0; i < count; ++i )
+    {
+	FindFilesResultItem * item = new FindFilesResultItem( result.at( i ) );
+	CHECK_NEW( item );
+
+	_ui->treeWidget->addTopLevelItem( item );
+    }
+
+    _ui->treeWidget->setSortingEnabled( true );
+    _ui->treeWidget->sortByColumn( FFR_SizeCol, Qt::DescendingOrder );
+    HeaderTweaker::resizeToContents( _ui->treeWidget->header() );
+
+    QApplication::restoreOverrideCursor();
+
+    if ( result.size() > count )
+	_ui->statusLabel->setText( tr( "Showing %1 of %2 matches" ).arg( count ).arg( result.size() ) );
+    else
+	_ui->statusLabel->setText( tr( "%1 found" ).arg( count ) );
+
+    logDebug() << result.size() << " matches for \"" << _ui->patternEdit->text()
+	       << "\" below " << subtree << endl;
+}
+
+
+void QueryWindow::selectResults()
+{
+    if ( ! _subtree.tree() )
+	return;
+
+    FileInfoSet files;
+
+    foreach ( QTreeWidgetItem * item, _ui->treeWidget->selectedItems() )
+    {
+	FindFilesResultItem * result = dynamic_cast<FindFilesResultItem *>( item );
+	CHECK_DYNAMIC_CAST( result, "FindFilesResultItem" );
+
+	FileInfo * file = _subtree.tree()->locate( result->path() );
+
+	if ( file )
+	    files << file;
+    }
+
+    if ( files.size() == 1 )
+	_selectionModel->setCurrentItem( *files.begin(), true );
+    else if ( ! files.isEmpty() )
+	_selectionModel->setSelectedItems( files );
+}
+
+
+void QueryWindow::contextMenu( const QPoint & pos )
+{
+    if ( ! _cleanupCollection || _ui->treeWidget->selectedItems().isEmpty() )
+	return;
+
+    QMenu menu;
+    _cleanupCollection->addToMenu( &menu );
+    menu.exec( _ui->treeWidget->viewport()->mapToGlobal( pos ) );
+}
@@ -0,0 +1,131 @@
+/*
+ *   File name: QueryWindow.h
+ *   Summary:	QDirStat "query" window
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef QueryWindow_h
+#define QueryWindow_h
+
+
+#include <QDialog>
+#include <QTreeWidgetItem>
+
+#include "ui_query-window.h"
+#include "FileInfo.h"
+#include "Subtree.h"
+
+
+namespace QDirStat
+{
+    class SelectionModel;
+    class CleanupCollection;
+
+
+    /**
+     * Modeless dialog to find the items in a subtree that match a
+     * FileQuery like "size>1G age>2y type=file".
+     *
+     * When the user selects results, they are selected in the main window,
+     * so cleanups can be started on them from there or from the context
+     * menu of the results.
+     **/
+    class QueryWindow: public QDialog
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor.
+	 *
+	 * Notice that this widget will destroy itself upon window close.
+	 *
+	 * It is advised to use a QPointer for storing a pointer to an instance
+	 * of this class. The QPointer will keep track of this window
+	 * auto-deleting itself when closed.
+	 **/
+	QueryWindow( SelectionModel *	 selectionModel,
+		     CleanupCollection * cleanupCollection,
+		     QWidget *		 parent );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~QueryWindow();
+
+	/**
+	 * Return the subtree to search.
+	 **/
+	const Subtree & subtree() const { return _subtree; }
+
+    public slots:
+
+	/**
+	 * Set the subtree to search.
+	 **/
+	void populate( FileInfo * subtree );
+
+	/**
+	 * Run the query from the input field.
+	 **/
+	void startSearch();
+
+	/**
+	 * Reject the dialog contents, i.e. the user clicked the "Cancel" or
+	 * WM_CLOSE button. This not only closes the dialog, it also deletes
+	 * it.
+	 *
+	 * Reimplemented from QDialog.
+	 **/
+	virtual void reject() Q_DECL_OVERRIDE;
+
+    protected slots:
+
+	/**
+	 * Select the selected results in the main window's tree and treemap
+	 * widgets via their SelectionModel.
+	 **/
+	void selectResults();
+
+	/**
+	 * Open the cleanup context menu for the selected results.
+	 **/
+	void contextMenu( const QPoint & pos );
+
+    protected:
+
+	/**
+	 * One-time initialization of the widgets in this window.
+	 **/
+	void initWidgets();
+
+	/**
+	 * Read parameters from the settings file.
+	 **/
+	void readSettings();
+
+	/**
+	 * Write parameters to the settings file.
+	 **/
+	void writeSettings();
+
+
+	//
+	// Data members
+	//
+
+	Ui::QueryWindow *	_ui;
+	SelectionModel *	_selectionModel;
+	CleanupCollection *	_cleanupCollection;
+	Subtree			_subtree;
+	int			_maxResults;
+    };
+
+} // namespace QDirStat
+
+
+#endif // QueryWindow_h
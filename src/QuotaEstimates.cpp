@@ -0,0 +1,300 @@
+/*
+ *   File name: QuotaEstimates.cpp
+ *   Summary:	Quick subtree sizes from Btrfs qgroups and project quotas
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <endian.h>
+#include <sys/ioctl.h>
+#include <sys/quota.h>
+#include <linux/fs.h>
+#include <linux/btrfs.h>
+#include <linux/btrfs_tree.h>
+
+#include "QuotaEstimates.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "MountPoints.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+#ifndef PRJQUOTA
+#  define PRJQUOTA	2
+#endif
+
+using namespace QDirStat;
+
+
+QuotaEstimates::QuotaEstimates( DirTree * tree ):
+    QObject( tree ),
+    _tree( tree )
+{
+    CHECK_PTR( _tree );
+
+    connect( _tree,   SIGNAL( deletingChild  ( FileInfo * ) ),
+	     this,    SLOT  ( deletingChild  ( FileInfo * ) ) );
+
+    connect( _tree,   SIGNAL( clearingSubtree( DirInfo *  ) ),
+	     this,    SLOT  ( clearingSubtree( DirInfo *  ) ) );
+
+    connect( _tree,   SIGNAL( clearing() ),
+	     this,    SLOT  ( clear()	 ) );
+}
+
+
+QuotaEstimates::~QuotaEstimates()
+{
+}
+
+
+void QuotaEstimates::check( DirInfo		* dir,
+			    const QString	& path,
+			    const struct stat	* statInfo )
+{
+    if ( ! dir )
+	return;
+
+    struct stat ownStatInfo;
+
+    if ( ! statInfo )
+    {
+	if ( lstat( path.toUtf8(), &ownStatInfo ) != 0 )
+	    return;
+
+	statInfo = &ownStatInfo;
+    }
+
+    int features = deviceFeatures( statInfo->st_dev, path );
+
+    if ( features == NoFeature )
+	return;
+
+    FileSize size = -1;
+
+    // The root directory of each Btrfs subvolume has the same inode number
+
+    if ( ( features & BtrfsFeature ) && statInfo->st_ino == BTRFS_FIRST_FREE_OBJECTID )
+	size = btrfsQgroupSize( path );
+
+    if ( size < 0 && ( features & ProjectFeature ) )
+    {
+	int depth = 0;
+	FileInfo * parent = dir->parent();
+
+	while ( parent && parent != _tree->root() && depth <= PROJECT_QUOTA_DEPTH )
+	{
+	    ++depth;
+	    parent = parent->parent();
+	}
+
+	if ( depth <= PROJECT_QUOTA_DEPTH )
+	{
+	    // The subdirectories inherit the project ID; only the topmost
+	    // directory of a project gets its size.
+
+	    quint32 projId = projectId( path );
+	    _projIds.insert( dir, projId );
+
+	    if ( projId != 0 && projId != _projIds.value( dir->parent(), 0 ) )
+		size = projectQuotaSize( _blockDevices.value( statInfo->st_dev ), projId );
+	}
+    }
+
+    if ( size >= 0 )
+    {
+	_estimates.insert( dir, size );
+	logInfo() << "Estimated " << formatSize( size ) << " for " << path << endl;
+    }
+}
+
+
+bool QuotaEstimates::contains( FileInfo * item ) const
+{
+    return item && item->isDirInfo() && _estimates.contains( item->toDirInfo() );
+}
+
+
+FileSize QuotaEstimates::estimatedSize( FileInfo * item ) const
+{
+    if ( ! item || ! item->isDirInfo() )
+	return 0;
+
+    return _estimates.value( item->toDirInfo(), 0 );
+}
+
+
+int QuotaEstimates::deviceFeatures( dev_t device, const QString & path )
+{
+    if ( _features.contains( device ) )
+	return _features.value( device );
+
+    int features = NoFeature;
+    const MountPoint * mountPoint = MountPoints::findNearestMountPoint( path );
+
+    if ( mountPoint )
+    {
+	if ( mountPoint->isBtrfs() )
+	    features |= BtrfsFeature;
+
+	QStringList options = mountPoint->mountOptions();
+
+	if ( options.contains( "prjquota"    ) ||
+	     options.contains( "pquota"	     ) ||
+	     options.contains( "pqnoenforce" ) )
+	{
+	    features |= ProjectFeature;
+	    _blockDevices.insert( device, mountPoint->device() );
+	}
+    }
+
+    _features.insert( device, features );
+
+    return features;
+}
+
+
+FileSize QuotaEstimates::btrfsQgroupSize( const QString & path )
+{
+    int fd = open( path.toUtf8(), O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+
+    if ( fd < 0 )
+	return -1;
+
+    // The ID of the subvolume
+
+    struct btrfs_ioctl_ino_lookup_args lookup;
+    memset( &lookup, 0, sizeof( lookup ) );
+    lookup.objectid = BTRFS_FIRST_FREE_OBJECTID;
+
+    if ( ioctl( fd, BTRFS_IOC_INO_LOOKUP, &lookup ) != 0 )
+    {
+	close( fd );
+	return -1;
+    }
+
+    // Its qgroup info item: (0, BTRFS_QGROUP_INFO_KEY, qgroupid) in the
+    // quota tree; the level 0 qgroup ID is the subvolume ID.
+
+    struct btrfs_ioctl_search_args args;
+    memset( &args, 0, sizeof( args ) );
+
+    struct btrfs_ioctl_search_key * key = &args.key;
+    key->tree_id      = BTRFS_QUOTA_TREE_OBJECTID;
+    key->min_objectid = 0;
+    key->max_objectid = 0;
+    key->min_type     = BTRFS_QGROUP_INFO_KEY;
+    key->max_type     = BTRFS_QGROUP_INFO_KEY;
+    key->min_offset   = lookup.treeid;
+    key->max_offset   = lookup.treeid;
+    key->max_transid  = (__u64) -1;
+    key->nr_items     = 1;
+
+    int result = ioctl( fd, BTRFS_IOC_TREE_SEARCH, &args );
+    close( fd );
+
+    // No qgroups (ENOENT) or no permission (EPERM)
+
+    if ( result != 0 || key->nr_items < 1 )
+	return -1;
+
+    const struct btrfs_ioctl_search_header * header =
+	(const struct btrfs_ioctl_search_header *) args.buf;
+
+    if ( header->type != BTRFS_QGROUP_INFO_KEY ||
+	 header->offset != lookup.treeid ||
+	 header->len < sizeof( struct btrfs_qgroup_info_item ) )
+    {
+	return -1;
+    }
+
+    const struct btrfs_qgroup_info_item * info =
+	(const struct btrfs_qgroup_info_item *) ( header + 1 );
+
+    return (FileSize) le64toh( info->rfer );
+}
+
+
+quint32 QuotaEstimates::projectId( const QString & path )
+{
+    int fd = open( path.toUtf8(), O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+
+    if ( fd < 0 )
+	return 0;
+
+    struct fsxattr attr;
+    memset( &attr, 0, sizeof( attr ) );
+
+    int result = ioctl( fd, FS_IOC_FSGETXATTR, &attr );
+    close( fd );
+
+    if ( result != 0 || ! ( attr.fsx_xflags & FS_XFLAG_PROJINHERIT ) )
+	return 0;
+
+    return attr.fsx_projid;
+}
+
+
+FileSize QuotaEstimates::projectQuotaSize( const QString & device, quint32 projId )
+{
+    if ( device.isEmpty() )
+	return -1;
+
+    struct dqblk quota;
+    memset( &quota, 0, sizeof( quota ) );
+
+    if ( quotactl( QCMD( Q_GETQUOTA, PRJQUOTA ), device.toUtf8(),
+		   (int) projId, (caddr_t) &quota ) != 0 )
+    {
+	return -1;
+    }
+
+    return (FileSize) quota.dqb_curspace;
+}
+
+
+void QuotaEstimates::clear()
+{
+    _estimates.clear();
+    _projIds.clear();
+    _features.clear();
+    _blockDevices.clear();
+}
+
+
+void QuotaEstimates::deletingChild( FileInfo * child )
+{
+    if ( ! child || ! child->isDirInfo() || ( _projIds.isEmpty() && _estimates.isEmpty() ) )
+	return;
+
+    _estimates.remove( child->toDirInfo() );
+    _projIds.remove( child->toDirInfo() );
+    removeChildren( child );
+}
+
+
+void QuotaEstimates::clearingSubtree( DirInfo * subtree )
+{
+    if ( subtree && ( ! _estimates.isEmpty() || ! _projIds.isEmpty() ) )
+	removeChildren( subtree );
+}
+
+
+void QuotaEstimates::removeChildren( FileInfo * subtree )
+{
+    for ( FileInfo * child = subtree->firstChild(); child; child = child->next() )
+    {
+	if ( child->isDirInfo() && ! child->isDotEntry() )
+	{
+	    _estimates.remove( child->toDirInfo() );
+	    _projIds.remove( child->toDirInfo() );
+	    removeChildren( child );
+	}
+    }
+}
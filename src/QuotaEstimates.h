@@ -0,0 +1,165 @@
+/*
+ *   File name: QuotaEstimates.h
+ *   Summary:	Quick subtree sizes from Btrfs qgroups and project quotas
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef QuotaEstimates_h
+#define QuotaEstimates_h
+
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <QObject>
+#include <QString>
+#include <QHash>
+
+#include "FileInfo.h"	// FileSize
+
+
+// Project quotas are only checked this many levels below the toplevel
+// directory since that needs a system call for each directory
+
+#define PROJECT_QUOTA_DEPTH	3
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class DirInfo;
+
+
+    /**
+     * Subtree sizes that the filesystem already knows: A Btrfs subvolume
+     * with qgroups enabled has the referenced bytes in its level 0 qgroup,
+     * and a directory with an XFS or ext4 project quota has the used
+     * space in that quota. Those are available right away while reading
+     * the subtree may take hours.
+     *
+     * This is optional (see DirTree::setQuickEstimates()). Each directory
+     * that is about to be read is checked with check(); the estimates are
+     * shown for the directories that are still being read until reading
+     * them is finished and the real totals are known.
+     *
+     * They are only estimates: A qgroup also counts snapshots that share
+     * the data, and a project may have files outside of the directory.
+     * Querying them usually needs root permissions.
+     **/
+    class QuotaEstimates: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor. This is a child of 'tree'.
+	 **/
+	QuotaEstimates( DirTree * tree );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~QuotaEstimates();
+
+	/**
+	 * Check if the filesystem knows the size of directory 'dir' with
+	 * path 'path'. 'statInfo' is what lstat() returned for it; if it
+	 * is 0, this does the lstat() itself.
+	 **/
+	void check( DirInfo		* dir,
+		    const QString	& path,
+		    const struct stat	* statInfo = 0 );
+
+	/**
+	 * Return 'true' if there is an estimate for 'item'.
+	 **/
+	bool contains( FileInfo * item ) const;
+
+	/**
+	 * Return the estimated total size of 'item' or 0 if there is none.
+	 **/
+	FileSize estimatedSize( FileInfo * item ) const;
+
+	/**
+	 * Return the number of estimates.
+	 **/
+	int count() const { return _estimates.size(); }
+
+	/**
+	 * Return the referenced bytes of the level 0 qgroup of the Btrfs
+	 * subvolume at 'path' or -1 if that is not available.
+	 **/
+	static FileSize btrfsQgroupSize( const QString & path );
+
+	/**
+	 * Return the project ID of directory 'path' or 0 if it has none or
+	 * if it doesn't pass it on to new files.
+	 **/
+	static quint32 projectId( const QString & path );
+
+	/**
+	 * Return the used space of project 'projId' on block device 'device'
+	 * or -1 if that is not available.
+	 **/
+	static FileSize projectQuotaSize( const QString & device, quint32 projId );
+
+
+    public slots:
+
+	/**
+	 * Drop everything.
+	 **/
+	void clear();
+
+
+    protected slots:
+
+	/**
+	 * Drop the estimates of a deleted subtree.
+	 **/
+	void deletingChild( FileInfo * child );
+
+	/**
+	 * Drop the estimates below a subtree that is cleared.
+	 **/
+	void clearingSubtree( DirInfo * subtree );
+
+
+    protected:
+
+	enum DeviceFeature
+	{
+	    NoFeature	   = 0,
+	    BtrfsFeature   = 1,
+	    ProjectFeature = 2
+	};
+
+	/**
+	 * Return the DeviceFeature flags of 'device' with a directory
+	 * 'path' on it.
+	 **/
+	int deviceFeatures( dev_t device, const QString & path );
+
+	/**
+	 * Remove everything below 'subtree' from the hashes.
+	 **/
+	void removeChildren( FileInfo * subtree );
+
+
+	// Data members
+
+	DirTree *			_tree;
+	QHash<DirInfo *, FileSize>	_estimates;
+	QHash<DirInfo *, quint32>	_projIds;	// Of the checked directories
+	QHash<dev_t, int>		_features;
+	QHash<dev_t, QString>		_blockDevices;
+    };
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef QuotaEstimates_h
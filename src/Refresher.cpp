@@ -38,7 +38,7 @@ void Refresher::refresh()
     {
 	logDebug() << "Refreshing " << _items.size() << " items" << endl;
 
-	_tree->refresh( _items );
+	_tree->verify( _items );
     }
     else
     {
@@ -12,6 +12,7 @@
 
 #include <QObject>
 #include "FileInfoSet.h"
+#include "NodePool.h"
 
 
 namespace QDirStat
@@ -26,6 +27,9 @@ namespace QDirStat
      * OutputWindow::lastProcessFinished()), trigger refreshing all stored
      * subtrees.
      *
+     * This uses DirTree::verify(), so only what actually changed on disk is
+     * read again.
+     *
      * Do not hold on to pointers to instances of this class since each
      * instance will destroy itself at the end of refresh(). On the other hand,
      * if the signal triggering refresh() never arrives, this object will stay
@@ -69,6 +73,7 @@ namespace QDirStat
 
 	FileInfoSet _items;
         DirTree *   _tree;
+	NodePin	    _pin;	// Keep the memory of deleted items while waiting
     };
 }	// namespace QDirStat
 
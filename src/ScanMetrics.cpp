@@ -0,0 +1,375 @@
+/*
+ *   File name: ScanMetrics.cpp
+ *   Summary:	Machine-readable metrics of a scan for monitoring
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <stdio.h>	// rename()
+
+#include <QFile>
+#include <QFileInfo>
+
+#include "ScanMetrics.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+ScanMetrics::ScanMetrics():
+    _finishTime( 0 ),
+    _scanNsec( 0 ),
+    _items( 0 ),
+    _errorDirs( 0 ),
+    _cacheReadBytes( 0 ),
+    _cacheReadNsec( 0 ),
+    _cacheWriteBytes( 0 ),
+    _cacheWriteNsec( 0 )
+{
+}
+
+
+void ScanMetrics::readingStarted()
+{
+    _cacheReadFiles.clear();
+    _readTimer.start();
+}
+
+
+void ScanMetrics::cacheReadStarted( const QStringList & fileNames )
+{
+    _cacheReadFiles = fileNames;
+}
+
+
+void ScanMetrics::readingFinished( DirTree * tree )
+{
+    CHECK_PTR( tree );
+
+    FileInfo * toplevel = tree->firstToplevel();
+
+    if ( ! toplevel )
+	return;
+
+    setScan( toplevel->url(),
+	     _readTimer.isValid() ? _readTimer.nsecsElapsed() : 0,
+	     toplevel->totalItems() + 1,
+	     countErrorDirs( toplevel ) );
+
+    _dirs.clear();
+    addDir( toplevel->url(), toplevel->totalSize(), toplevel->totalItems() );
+
+    for ( FileInfo * child = toplevel->firstChild(); child; child = child->next() )
+    {
+	if ( child->isDirInfo() && ! child->isDotEntry() )
+	    addDir( child->name(), child->totalSize(), child->totalItems() );
+    }
+
+    if ( ! _cacheReadFiles.isEmpty() )
+    {
+	// Reading cache files is hardly more than parsing them, so the time
+	// of the complete scan is the time for reading them.
+
+	qint64 bytes = 0;
+
+	foreach ( const QString & fileName, _cacheReadFiles )
+	    bytes += QFileInfo( fileName ).size();
+
+	setCacheRead( bytes, _scanNsec );
+    }
+}
+
+
+void ScanMetrics::cacheWriteStarted()
+{
+    _writeTimer.start();
+}
+
+
+void ScanMetrics::cacheWritten( const QString & fileName )
+{
+    if ( _writeTimer.isValid() )
+	setCacheWrite( QFileInfo( fileName ).size(), _writeTimer.nsecsElapsed() );
+}
+
+
+void ScanMetrics::setScan( const QString & path, qint64 nsec, qint64 items, int errorDirs )
+{
+    _path	= path;
+    _finishTime = time( 0 );
+    _scanNsec	= nsec;
+    _items	= items;
+    _errorDirs	= errorDirs;
+}
+
+
+void ScanMetrics::addDir( const QString & name, FileSize totalSize, qint64 totalItems )
+{
+    ScanMetricsDir dir;
+    dir.name	   = name;
+    dir.totalSize  = totalSize;
+    dir.totalItems = totalItems;
+
+    _dirs << dir;
+}
+
+
+void ScanMetrics::setCacheRead( qint64 bytes, qint64 nsec )
+{
+    _cacheReadBytes = bytes;
+    _cacheReadNsec  = nsec;
+}
+
+
+void ScanMetrics::setCacheWrite( qint64 bytes, qint64 nsec )
+{
+    _cacheWriteBytes = bytes;
+    _cacheWriteNsec  = nsec;
+}
+
+
+int ScanMetrics::countErrorDirs( FileInfo * subtree )
+{
+    if ( ! subtree )
+	return 0;
+
+    int count = subtree->readState() == DirError ? 1 : 0;
+
+    for ( FileInfo * child = subtree->firstChild(); child; child = child->next() )
+    {
+	// The dot entries only have files and the read state of their parent
+
+	if ( child->isDirInfo() && ! child->isDotEntry() )
+	    count += countErrorDirs( child );
+    }
+
+    return count;
+}
+
+
+QString ScanMetrics::labelValue( const QString & str )
+{
+    QString result = str;
+
+    result.replace( "\\", "\\\\" );
+    result.replace( "\"", "\\\"" );
+    result.replace( "\n", "\\n"  );
+
+    return "\"" + result + "\"";
+}
+
+
+QString ScanMetrics::jsonString( const QString & str )
+{
+    QString result = "\"";
+
+    foreach ( QChar c, str )
+    {
+	switch ( c.unicode() )
+	{
+	    case '"':	result += "\\\""; break;
+	    case '\\':	result += "\\\\"; break;
+	    case '\n':	result += "\\n";  break;
+	    case '\t':	result += "\\t";  break;
+
+	    default:
+		if ( c.unicode() < 0x20 )
+		    result += QString( "\\u%1" ).arg( (int) c.unicode(), 4, 16, QChar( '0' ) );
+		else
+		    result += c;
+	}
+    }
+
+    return result + "\"";
+}
+
+
+/**
+ * Return the HELP and TYPE lines of the Prometheus gauge 'name'.
+ **/
+static QString gauge( const char * name, const char * help )
+{
+    return QString( "# HELP %1 %2\n# TYPE %1 gauge\n" ).arg( name ).arg( help );
+}
+
+
+/**
+ * Return 'nsec' as seconds for the metrics.
+ **/
+static QString seconds( qint64 nsec )
+{
+    return QString::number( nsec / 1e9, 'f', 3 );
+}
+
+
+/**
+ * Return 'count' per second in 'nsec'.
+ **/
+static qint64 perSecond( qint64 count, qint64 nsec )
+{
+    return (qint64) ( count / ( qMax( nsec, 1LL ) / 1e9 ) );
+}
+
+
+/**
+ * Return one sample line of gauge 'name' with 'labels'.
+ *
+ * This concatenates rather than using QString::arg(): A path or directory
+ * name with "%2" in it would be substituted by the next arg() call.
+ **/
+static QString sample( const char * name, const QString & labels, const QString & value )
+{
+    return QString( name ) + "{" + labels + "} " + value + "\n";
+}
+
+
+static QString sample( const char * name, const QString & labels, qint64 value )
+{
+    return sample( name, labels, QString::number( value ) );
+}
+
+
+QString ScanMetrics::prometheusText() const
+{
+    QString path = "path=" + labelValue( _path );
+    QString str;
+
+    str += gauge( "qdirstat_scan_timestamp_seconds", "When the last scan was finished." );
+    str += sample( "qdirstat_scan_timestamp_seconds", path, (qint64) _finishTime );
+
+    str += gauge( "qdirstat_scan_duration_seconds", "How long the last scan took." );
+    str += sample( "qdirstat_scan_duration_seconds", path, seconds( _scanNsec ) );
+
+    str += gauge( "qdirstat_scan_items", "Files and directories read by the last scan." );
+    str += sample( "qdirstat_scan_items", path, _items );
+
+    str += gauge( "qdirstat_scan_items_per_second", "Files and directories read per second." );
+    str += sample( "qdirstat_scan_items_per_second", path, perSecond( _items, _scanNsec ) );
+
+    str += gauge( "qdirstat_scan_error_dirs", "Directories that could not be read." );
+    str += sample( "qdirstat_scan_error_dirs", path, _errorDirs );
+
+    str += gauge( "qdirstat_dir_size_bytes", "Total size of the toplevel directory and the directories below it." );
+
+    foreach ( const ScanMetricsDir & dir, _dirs )
+	str += sample( "qdirstat_dir_size_bytes", path + ",dir=" + labelValue( dir.name ), dir.totalSize );
+
+    str += gauge( "qdirstat_dir_items", "Total items of the toplevel directory and the directories below it." );
+
+    foreach ( const ScanMetricsDir & dir, _dirs )
+	str += sample( "qdirstat_dir_items", path + ",dir=" + labelValue( dir.name ), dir.totalItems );
+
+    if ( _cacheReadBytes > 0 )
+    {
+	str += gauge( "qdirstat_cache_read_bytes", "Size of the cache files read." );
+	str += sample( "qdirstat_cache_read_bytes", path, _cacheReadBytes );
+	str += gauge( "qdirstat_cache_read_seconds", "How long reading the cache files took." );
+	str += sample( "qdirstat_cache_read_seconds", path, seconds( _cacheReadNsec ) );
+    }
+
+    if ( _cacheWriteBytes > 0 )
+    {
+	str += gauge( "qdirstat_cache_write_bytes", "Size of the cache file written." );
+	str += sample( "qdirstat_cache_write_bytes", path, _cacheWriteBytes );
+	str += gauge( "qdirstat_cache_write_seconds", "How long writing the cache file took." );
+	str += sample( "qdirstat_cache_write_seconds", path, seconds( _cacheWriteNsec ) );
+    }
+
+    return str;
+}
+
+
+/**
+ * Return the JSON object of the 'bytes' read or written in 'nsec'.
+ **/
+static QString transfer( qint64 bytes, qint64 nsec )
+{
+    return QString( "{ \"bytes\": %1, \"seconds\": %2, \"bytesPerSecond\": %3 }" )
+	.arg( bytes )
+	.arg( seconds( nsec ) )
+	.arg( perSecond( bytes, nsec ) );
+}
+
+
+QString ScanMetrics::json() const
+{
+    // Only numbers go through QString::arg(): The path and the directory
+    // names are concatenated, or a "%2" in them would be substituted.
+
+    QString str;
+
+    str += "{\n";
+    str += "  \"path\": " + jsonString( _path ) + ",\n";
+    str += QString( "  \"timestamp\": %1,\n"	).arg( (qint64) _finishTime );
+    str += QString( "  \"durationSeconds\": %1,\n" ).arg( seconds( _scanNsec ) );
+    str += QString( "  \"items\": %1,\n"		).arg( _items );
+    str += QString( "  \"itemsPerSecond\": %1,\n"	).arg( perSecond( _items, _scanNsec ) );
+    str += QString( "  \"errorDirs\": %1,\n"	).arg( _errorDirs );
+    str += "  \"dirs\": [\n";
+
+    for ( int i=0; i < _dirs.size(); ++i )
+    {
+	const ScanMetricsDir & dir = _dirs.at( i );
+
+	str += "    { \"name\": " + jsonString( dir.name );
+	str += QString( ", \"totalSize\": %1, \"totalItems\": %2 }%3\n" )
+	    .arg( dir.totalSize )
+	    .arg( dir.totalItems )
+	    .arg( i < _dirs.size() - 1 ? "," : "" );
+    }
+
+    str += "  ]";
+
+    if ( _cacheReadBytes > 0 )
+	str += ",\n  \"cacheRead\": " + transfer( _cacheReadBytes, _cacheReadNsec );
+
+    if ( _cacheWriteBytes > 0 )
+	str += ",\n  \"cacheWrite\": " + transfer( _cacheWriteBytes, _cacheWriteNsec );
+
+    str += "\n}\n";
+
+    return str;
+}
+
+
+bool ScanMetrics::write( const QString & fileName ) const
+{
+    if ( fileName.isEmpty() || isEmpty() )
+	return false;
+
+    // Write a temporary file first and rename it: A collector that reads
+    // the file at the same time gets either the old or the new metrics.
+
+    QString tmpName = fileName + ".tmp";
+    QFile file( tmpName );
+
+    if ( ! file.open( QIODevice::WriteOnly | QIODevice::Truncate ) )
+    {
+	logError() << "Can't open " << tmpName << endl;
+	return false;
+    }
+
+    QByteArray data = ( fileName.endsWith( ".json" ) ? json() : prometheusText() ).toUtf8();
+    bool ok = file.write( data ) == data.size();
+    file.close();
+
+    if ( ok )
+	ok = rename( tmpName.toUtf8(), fileName.toUtf8() ) == 0;
+
+    if ( ! ok )
+    {
+	logError() << "Can't write the scan metrics to " << fileName << endl;
+	QFile::remove( tmpName );
+	return false;
+    }
+
+    logInfo() << "Wrote the scan metrics to " << fileName << endl;
+
+    return true;
+}
@@ -0,0 +1,176 @@
+/*
+ *   File name: ScanMetrics.h
+ *   Summary:	Machine-readable metrics of a scan for monitoring
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef ScanMetrics_h
+#define ScanMetrics_h
+
+
+#include <time.h>
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QElapsedTimer>
+
+#include "FileInfo.h"	// FileSize
+
+
+namespace QDirStat
+{
+    class DirTree;
+
+
+    /**
+     * The totals of one directory in the ScanMetrics.
+     **/
+    struct ScanMetricsDir
+    {
+	ScanMetricsDir():
+	    totalSize( 0LL ),
+	    totalItems( 0LL )
+	    {}
+
+	QString		name;
+	FileSize	totalSize;
+	qint64		totalItems;
+    };
+
+
+    /**
+     * Metrics of the last scan for monitoring: The totals of the toplevel
+     * directory and of each directory directly below it, how long the scan
+     * took, how many directories could not be read, and how fast the cache
+     * files were read and written. This is written to a file each time a
+     * scan is finished (see DirTree::setMetricsFile() and qdirstat
+     * --scan-to-cache --metrics), so storage growth and scan performance
+     * can be graphed without parsing the log.
+     *
+     * A file name ending with ".json" gets JSON; anything else gets the
+     * Prometheus text format for the textfile collector of the node
+     * exporter (e.g. qdirstat.prom). The file is replaced atomically, so a
+     * collector never sees half of it.
+     **/
+    class ScanMetrics
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	ScanMetrics();
+
+	/**
+	 * Start the timer for a new scan and forget the cache files read
+	 * for the last one.
+	 **/
+	void readingStarted();
+
+	/**
+	 * Note that the scan reads cache files 'fileNames'.
+	 **/
+	void cacheReadStarted( const QStringList & fileNames );
+
+	/**
+	 * Take the metrics of 'tree' when reading it is finished.
+	 **/
+	void readingFinished( DirTree * tree );
+
+	/**
+	 * Start the timer for writing a cache file.
+	 **/
+	void cacheWriteStarted();
+
+	/**
+	 * Note that cache file 'fileName' was written successfully.
+	 **/
+	void cacheWritten( const QString & fileName );
+
+	/**
+	 * Set the metrics of the scan of 'path' directly, e.g. for a
+	 * headless scan without a tree: 'nsec' is the duration, 'items' the
+	 * number of items read, 'errorDirs' the number of directories that
+	 * could not be read.
+	 **/
+	void setScan( const QString & path, qint64 nsec, qint64 items, int errorDirs );
+
+	/**
+	 * Add the totals of a directory. The first one is the toplevel
+	 * directory.
+	 **/
+	void addDir( const QString & name, FileSize totalSize, qint64 totalItems );
+
+	/**
+	 * Set the bytes and the time for reading or writing the cache files.
+	 **/
+	void setCacheRead ( qint64 bytes, qint64 nsec );
+	void setCacheWrite( qint64 bytes, qint64 nsec );
+
+	/**
+	 * Return 'true' if there is a finished scan.
+	 **/
+	bool isEmpty() const { return _path.isEmpty(); }
+
+	/**
+	 * Return the metrics in the Prometheus text format.
+	 **/
+	QString prometheusText() const;
+
+	/**
+	 * Return the metrics as JSON.
+	 **/
+	QString json() const;
+
+	/**
+	 * Write the metrics to 'fileName' in the format that its suffix
+	 * asks for. Return 'true' if OK, 'false' upon error.
+	 **/
+	bool write( const QString & fileName ) const;
+
+	/**
+	 * Return the number of directories in 'subtree' that could not be
+	 * read.
+	 **/
+	static int countErrorDirs( FileInfo * subtree );
+
+
+    protected:
+
+	/**
+	 * Return 'str' as a quoted Prometheus label value.
+	 **/
+	static QString labelValue( const QString & str );
+
+	/**
+	 * Return 'str' as a quoted JSON string.
+	 **/
+	static QString jsonString( const QString & str );
+
+
+	// Data members
+
+	QString			_path;
+	time_t			_finishTime;
+	qint64			_scanNsec;
+	qint64			_items;
+	int			_errorDirs;
+	QList<ScanMetricsDir>	_dirs;
+	QStringList		_cacheReadFiles;
+	qint64			_cacheReadBytes;
+	qint64			_cacheReadNsec;
+	qint64			_cacheWriteBytes;
+	qint64			_cacheWriteNsec;
+	QElapsedTimer		_readTimer;
+	QElapsedTimer		_writeTimer;
+
+    };	// class ScanMetrics
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef ScanMetrics_h
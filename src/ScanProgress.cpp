@@ -0,0 +1,131 @@
+/*
+ *   File name: ScanProgress.cpp
+ *   Summary:	Estimate how far reading a directory tree is
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <sys/statvfs.h>
+
+#include <QSet>
+#include <QList>
+
+#include "ScanProgress.h"
+#include "ScanStats.h"
+#include "MountPoints.h"
+#include "Logger.h"
+
+
+using namespace QDirStat;
+
+
+ScanProgress::ScanProgress()
+{
+    clear();
+}
+
+
+void ScanProgress::clear()
+{
+    _estimatedItems = -1;
+    _itemsRead	    = 0;
+    _elapsedNsec    = 0;
+}
+
+
+void ScanProgress::start( const QString & path, bool crossFileSystems )
+{
+    clear();
+
+    // Only at a mount point all of the used inodes belong to what is read
+
+    if ( path != "/" && ! MountPoints::findByPath( path ) )
+	return;
+
+    qint64 inodes = usedInodes( path );
+
+    if ( inodes <= 0 )
+	return;
+
+    if ( crossFileSystems )
+    {
+	QSet<QString> devices;	// Bind mounts would count twice
+
+	const MountPoint * mountPoint = MountPoints::findByPath( path );
+
+	if ( mountPoint )
+	    devices << mountPoint->device();
+
+	foreach ( const MountPoint * below, MountPoints::findBelow( path ) )
+	{
+	    if ( devices.contains( below->device() ) )
+		continue;
+
+	    devices << below->device();
+	    qint64 belowInodes = usedInodes( below->path() );
+
+	    if ( belowInodes > 0 )
+		inodes += belowInodes;
+	}
+    }
+
+    _estimatedItems = inodes;
+    logInfo() << "Estimated " << _estimatedItems << " items for " << path << endl;
+}
+
+
+void ScanProgress::update()
+{
+    ScanStatsData stats = ScanStats::instance()->data();
+
+    _itemsRead	 = stats.entries;
+    _elapsedNsec = stats.elapsedNsec;
+}
+
+
+double ScanProgress::itemsPerSec() const
+{
+    if ( _elapsedNsec <= 0 )
+	return 0.0;
+
+    return _itemsRead * 1e9 / _elapsedNsec;
+}
+
+
+int ScanProgress::percent() const
+{
+    if ( ! hasEstimate() )
+	return -1;
+
+    // Hard links and exclude rules can make this more or less than
+    // estimated; only reading being finished means 100%.
+
+    return (int) qBound( 0LL, _itemsRead * 100 / _estimatedItems, 99LL );
+}
+
+
+qint64 ScanProgress::remainingSec() const
+{
+    double rate = itemsPerSec();
+
+    if ( ! hasEstimate() || rate <= 0.0 || _itemsRead >= _estimatedItems )
+	return -1;
+
+    return (qint64) ( ( _estimatedItems - _itemsRead ) / rate );
+}
+
+
+qint64 ScanProgress::usedInodes( const QString & path )
+{
+    struct statvfs fs;
+
+    if ( statvfs( path.toUtf8(), &fs ) != 0 )
+	return -1;
+
+    if ( fs.f_files == 0 || fs.f_ffree > fs.f_files )
+	return -1;
+
+    return (qint64) ( fs.f_files - fs.f_ffree );
+}
@@ -0,0 +1,112 @@
+/*
+ *   File name: ScanProgress.h
+ *   Summary:	Estimate how far reading a directory tree is
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef ScanProgress_h
+#define ScanProgress_h
+
+
+#include <QString>
+
+
+namespace QDirStat
+{
+    /**
+     * Progress of reading a directory tree from disk: statvfs() tells how
+     * many inodes are used on a filesystem, and that is about the number of
+     * items that reading all of it will find. Compared with the number of
+     * items read so far (see ScanStats), this gives a percentage and the
+     * time that is left.
+     *
+     * This only works if reading starts at a mount point (or at "/"):
+     * Otherwise the inodes of the rest of the filesystem would be counted,
+     * too. When crossing filesystems, the filesystems mounted below are
+     * added. Hard links and exclude rules make it less precise; that's why
+     * this never claims to be done before it really is.
+     *
+     * This is a small value class; DirTree::scanProgress() has the
+     * estimate for the current scan, and update() takes the numbers from
+     * ScanStats.
+     **/
+    class ScanProgress
+    {
+    public:
+
+	/**
+	 * Constructor: No estimate.
+	 **/
+	ScanProgress();
+
+	/**
+	 * Estimate the number of items for reading 'path'. If
+	 * 'crossFileSystems' is 'true', the filesystems mounted below 'path'
+	 * count as well.
+	 **/
+	void start( const QString & path, bool crossFileSystems );
+
+	/**
+	 * Drop the estimate.
+	 **/
+	void clear();
+
+	/**
+	 * Take the numbers read so far from ScanStats.
+	 **/
+	void update();
+
+	/**
+	 * Return 'true' if there is an estimate.
+	 **/
+	bool hasEstimate() const { return _estimatedItems > 0; }
+
+	/**
+	 * Return the estimated number of items or -1 if there is no
+	 * estimate.
+	 **/
+	qint64 estimatedItems() const { return _estimatedItems; }
+
+	/**
+	 * Return the number of items read so far (as of the last update()).
+	 **/
+	qint64 itemsRead() const { return _itemsRead; }
+
+	/**
+	 * Return the number of items read per second so far.
+	 **/
+	double itemsPerSec() const;
+
+	/**
+	 * Return the progress in percent (0..99) or -1 if there is no
+	 * estimate.
+	 **/
+	int percent() const;
+
+	/**
+	 * Return the estimated number of seconds that are left or -1 if
+	 * that is not known.
+	 **/
+	qint64 remainingSec() const;
+
+	/**
+	 * Return the number of used inodes of the filesystem of 'path' or -1
+	 * if statvfs() doesn't tell (some filesystems like Btrfs don't have
+	 * a fixed number of inodes).
+	 **/
+	static qint64 usedInodes( const QString & path );
+
+    protected:
+
+	qint64	_estimatedItems;
+	qint64	_itemsRead;
+	qint64	_elapsedNsec;
+    };
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef ScanProgress_h
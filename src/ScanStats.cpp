@@ -0,0 +1,234 @@
+/*
+ *   File name: ScanStats.cpp
+ *   Summary:	Instrumentation for reading directory trees
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <sys/sysmacros.h>	// major(), minor()
+
+#include <QMutexLocker>
+
+#include "ScanStats.h"
+#include "DirInfo.h"
+#include "Logger.h"
+
+
+using namespace QDirStat;
+
+
+void ScanLatencies::clear()
+{
+    for ( int i=0; i < BucketCount; ++i )
+	buckets[i] = 0;
+
+    count = 0;
+    nsec  = 0;
+}
+
+
+void ScanLatencies::add( qint64 callNsec )
+{
+    // Bucket 0 is below 1 µs, bucket n is below 2^n µs
+
+    qint64 usec   = callNsec / 1000;
+    int	   bucket = 0;
+
+    while ( usec > 0 && bucket < BucketCount - 1 )
+    {
+	usec >>= 1;
+	++bucket;
+    }
+
+    ++buckets[ bucket ];
+    ++count;
+    nsec += callNsec;
+}
+
+
+void ScanLatencies::add( const ScanLatencies & other )
+{
+    for ( int i=0; i < BucketCount; ++i )
+	buckets[i] += other.buckets[i];
+
+    count += other.count;
+    nsec  += other.nsec;
+}
+
+
+qint64 ScanLatencies::bucketLimit( int bucket )
+{
+    if ( bucket >= BucketCount - 1 )
+	return -1;
+
+    return 1LL << bucket;
+}
+
+
+
+
+ScanStats * ScanStats::instance()
+{
+    static ScanStats instance;
+
+    return &instance;
+}
+
+
+ScanStats::ScanStats():
+    _startNsec( now() ),
+    _finishNsec( 0 )
+{
+}
+
+
+void ScanStats::reset()
+{
+    QMutexLocker locker( &_mutex );
+
+    _data	= ScanStatsData();
+    _deviceIndex.clear();
+    _startNsec	= now();
+    _finishNsec = 0;
+}
+
+
+void ScanStats::finish()
+{
+    QMutexLocker locker( &_mutex );
+
+    if ( _finishNsec == 0 )
+	_finishNsec = now();
+
+    _data.queueDepth  = 0;
+    _data.busyWorkers = 0;
+}
+
+
+void ScanStats::addSyscalls( const ScanLatencies & latencies, qint64 nsec )
+{
+    QMutexLocker locker( &_mutex );
+
+    _data.lstat.add( latencies );
+    _data.syscallNsec += nsec;
+}
+
+
+void ScanStats::addDir( DirInfo * dir, int entries, qint64 nsec, bool complete )
+{
+    QMutexLocker locker( &_mutex );
+
+    if ( complete )
+	++_data.dirs;
+
+    _data.entries     += entries;
+    _data.processNsec += nsec;
+
+    dev_t device = dir->device();
+    QHash<dev_t, int>::const_iterator it = _deviceIndex.find( device );
+    int index;
+
+    if ( it == _deviceIndex.end() )
+    {
+	ScanDeviceStats deviceStats;
+	deviceStats.device   = device;
+	deviceStats.firstDir = dir->url();
+
+	index = _data.devices.size();
+	_data.devices << deviceStats;
+	_deviceIndex.insert( device, index );
+    }
+    else
+    {
+	index = it.value();
+    }
+
+    ScanDeviceStats & deviceStats = _data.devices[ index ];
+    deviceStats.entries += entries;
+
+    if ( complete )
+	++deviceStats.dirs;
+}
+
+
+void ScanStats::addNotifyTime( qint64 nsec )
+{
+    QMutexLocker locker( &_mutex );
+
+    _data.notifyNsec += nsec;
+}
+
+
+void ScanStats::setQueueDepth( int depth, int busyWorkers )
+{
+    QMutexLocker locker( &_mutex );
+
+    _data.queueDepth	= depth;
+    _data.maxQueueDepth = qMax( depth, _data.maxQueueDepth );
+    _data.busyWorkers	= busyWorkers;
+}
+
+
+ScanStatsData ScanStats::data()
+{
+    QMutexLocker locker( &_mutex );
+
+    ScanStatsData data = _data;
+    data.elapsedNsec = ( _finishNsec ? _finishNsec : now() ) - _startNsec;
+
+    return data;
+}
+
+
+void ScanStats::logSummary()
+{
+    ScanStatsData stats = data();
+
+    double sec = qMax( stats.elapsedNsec, 1LL ) / 1e9;
+
+    logInfo() << "Read " << stats.dirs << " directories and "
+	      << stats.entries << " entries in " << sec << " sec: "
+	      << (int) ( stats.dirs / sec ) << " dirs/sec, "
+	      << (int) ( stats.entries / sec ) << " entries/sec"
+	      << endl;
+
+    logInfo() << "System calls: " << stats.syscallNsec / 1000000 << " millisec"
+	      << " (all threads); creating the nodes: "
+	      << qMax( stats.processNsec - stats.notifyNsec, 0LL ) / 1000000
+	      << " millisec; notifying the models: " << stats.notifyNsec / 1000000
+	      << " millisec; max. queue depth: " << stats.maxQueueDepth
+	      << endl;
+
+    if ( stats.lstat.count > 0 )
+    {
+	QString histogram;
+
+	for ( int i=0; i < ScanLatencies::BucketCount; ++i )
+	{
+	    if ( stats.lstat.buckets[i] == 0 )
+		continue;
+
+	    qint64 limit = ScanLatencies::bucketLimit( i );
+
+	    histogram += limit < 0 ?
+		QString( " >=%1us: " ).arg( ScanLatencies::bucketLimit( i - 1 ) ) :
+		QString( " <%1us: "  ).arg( limit );
+	    histogram += QString::number( stats.lstat.buckets[i] );
+	}
+
+	logInfo() << stats.lstat.count << " lstat() calls, average "
+		  << stats.lstat.nsec / stats.lstat.count / 1000.0 << " us;"
+		  << histogram << endl;
+    }
+
+    foreach ( const ScanDeviceStats & device, stats.devices )
+    {
+	logInfo() << "Device " << major( device.device ) << ":" << minor( device.device )
+		  << " (" << device.firstDir << "): "
+		  << device.dirs << " dirs, " << device.entries << " entries, "
+		  << (int) ( device.entries / sec ) << " entries/sec"
+		  << endl;
+    }
+}
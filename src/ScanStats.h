@@ -0,0 +1,217 @@
+/*
+ *   File name: ScanStats.h
+ *   Summary:	Instrumentation for reading directory trees
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef ScanStats_h
+#define ScanStats_h
+
+
+#include <sys/types.h>
+#include <time.h>
+
+#include <QString>
+#include <QList>
+#include <QHash>
+#include <QMutex>
+
+
+namespace QDirStat
+{
+    class DirInfo;
+
+
+    /**
+     * Histogram of system call latencies with buckets of powers of 2
+     * microseconds.
+     **/
+    struct ScanLatencies
+    {
+	enum { BucketCount = 16 };
+
+	ScanLatencies() { clear(); }
+
+	/**
+	 * Clear all buckets.
+	 **/
+	void clear();
+
+	/**
+	 * Add one system call that took 'nsec' nanoseconds.
+	 **/
+	void add( qint64 nsec );
+
+	/**
+	 * Add all system calls of 'other'.
+	 **/
+	void add( const ScanLatencies & other );
+
+	/**
+	 * Return the upper limit of bucket 'bucket' in microseconds or -1
+	 * for the last one which has no upper limit.
+	 **/
+	static qint64 bucketLimit( int bucket );
+
+	int	buckets[ BucketCount ];
+	int	count;
+	qint64	nsec;
+    };
+
+
+    /**
+     * What was read from one device.
+     **/
+    struct ScanDeviceStats
+    {
+	ScanDeviceStats():
+	    device( 0 ),
+	    dirs( 0 ),
+	    entries( 0 )
+	    {}
+
+	dev_t	device;
+	QString firstDir;	// The first directory read from this device
+	int	dirs;
+	qint64	entries;
+    };
+
+
+    /**
+     * The counters of a ScanStats at one point in time.
+     **/
+    struct ScanStatsData
+    {
+	ScanStatsData():
+	    elapsedNsec( 0 ),
+	    dirs( 0 ),
+	    entries( 0 ),
+	    syscallNsec( 0 ),
+	    processNsec( 0 ),
+	    notifyNsec( 0 ),
+	    queueDepth( 0 ),
+	    maxQueueDepth( 0 ),
+	    busyWorkers( 0 )
+	    {}
+
+	qint64			elapsedNsec;
+	int			dirs;
+	qint64			entries;
+	qint64			syscallNsec;	// readdir() and lstat(), all threads
+	qint64			processNsec;	// Creating the tree nodes including notifyNsec
+	qint64			notifyNsec;	// The signals to the models
+	int			queueDepth;
+	int			maxQueueDepth;
+	int			busyWorkers;
+	ScanLatencies		lstat;
+	QList<ScanDeviceStats>	devices;
+    };
+
+
+    /**
+     * Instrumentation for reading directory trees: How many directories
+     * and entries were read how fast, how long the lstat() calls took, how
+     * much time went into the system calls, into creating the tree nodes
+     * and into notifying the models, and how many directories were waiting
+     * in the read queue. This tells if a slow scan is bound by the disk,
+     * by the network or by the CPU.
+     *
+     * This is a process-wide singleton since the system calls are done by
+     * static functions in worker threads. All methods are thread-safe; the
+     * worker threads collect their numbers for a complete directory first,
+     * so they rarely need the mutex.
+     *
+     * The counters are reset when a DirReadJobQueue starts reading, and
+     * the summary is logged when the DirTree is finished. ScanStatsWindow
+     * shows them live.
+     **/
+    class ScanStats
+    {
+    public:
+
+	/**
+	 * Return the singleton.
+	 **/
+	static ScanStats * instance();
+
+	/**
+	 * Return a monotonic time stamp in nanoseconds for measuring.
+	 **/
+	static qint64 now()
+	{
+	    struct timespec ts;
+	    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+	    return (qint64) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+	}
+
+	/**
+	 * Clear all counters and start measuring again.
+	 **/
+	void reset();
+
+	/**
+	 * Stop the clock for the directories and entries per second.
+	 **/
+	void finish();
+
+	/**
+	 * Add the system calls for reading one directory or part of it:
+	 * 'latencies' of the lstat() calls and 'nsec' for all of them
+	 * including readdir().
+	 **/
+	void addSyscalls( const ScanLatencies & latencies, qint64 nsec );
+
+	/**
+	 * Add 'entries' entries of directory 'dir' that took 'nsec'
+	 * nanoseconds in the main thread to create the nodes for. 'complete'
+	 * is 'true' for the last part of the directory.
+	 **/
+	void addDir( DirInfo * dir, int entries, qint64 nsec, bool complete = true );
+
+	/**
+	 * Add 'nsec' nanoseconds for notifying the models.
+	 **/
+	void addNotifyTime( qint64 nsec );
+
+	/**
+	 * Set the current number of directories in the read queue and of
+	 * busy worker threads.
+	 **/
+	void setQueueDepth( int depth, int busyWorkers );
+
+	/**
+	 * Return a copy of the current counters.
+	 **/
+	ScanStatsData data();
+
+	/**
+	 * Write a summary to the log.
+	 **/
+	void logSummary();
+
+    protected:
+
+	/**
+	 * Constructor. Use instance() instead.
+	 **/
+	ScanStats();
+
+
+	// Data members
+
+	QMutex			_mutex;
+	ScanStatsData		_data;
+	QHash<dev_t, int>	_deviceIndex;	// In _data.devices
+	qint64			_startNsec;
+	qint64			_finishNsec;	// 0 while reading
+
+    };	// class ScanStats
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef ScanStats_h
@@ -0,0 +1,183 @@
+/*
+ *   File name: ScanStatsWindow.cpp
+ *   Summary:	QDirStat "scan statistics" window
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <sys/sysmacros.h>	// major(), minor()
+
+#include <QFontDatabase>
+
+#include "ScanStatsWindow.h"
+#include "DirTree.h"
+#include "DirReadTimes.h"
+#include "SettingsHelpers.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+#define UPDATE_INTERVAL	1000	// millisec
+#define BAR_WIDTH	40	// characters
+#define SHOW_SLOWEST	20	// directories
+
+using namespace QDirStat;
+
+
+ScanStatsWindow::ScanStatsWindow( QWidget * parent, DirTree * tree ):
+    QDialog( parent ),
+    _ui( new Ui::ScanStatsWindow ),
+    _tree( tree )
+{
+    // logDebug() << "init" << endl;
+
+    CHECK_NEW( _ui );
+    _ui->setupUi( this );
+    initWidgets();
+    readWindowSettings( this, "ScanStatsWindow" );
+
+    connect( &_timer, SIGNAL( timeout() ),
+	     this,    SLOT  ( refresh() ) );
+
+    _timer.start( UPDATE_INTERVAL );
+    refresh();
+}
+
+
+ScanStatsWindow::~ScanStatsWindow()
+{
+    // logDebug() << "destroying" << endl;
+    writeWindowSettings( this, "ScanStatsWindow" );
+}
+
+
+void ScanStatsWindow::initWidgets()
+{
+    QFont font = _ui->heading->font();
+    font.setBold( true );
+    _ui->heading->setFont( font );
+
+    _ui->statsText->setFont( QFontDatabase::systemFont( QFontDatabase::FixedFont ) );
+}
+
+
+void ScanStatsWindow::reject()
+{
+    deleteLater();
+}
+
+
+void ScanStatsWindow::refresh()
+{
+    ScanStatsData stats = ScanStats::instance()->data();
+    double sec = qMax( stats.elapsedNsec, 1LL ) / 1e9;
+
+    QString text;
+
+    text += tr( "Elapsed:            %1 sec\n" ).arg( sec, 0, 'f', 1 );
+    text += tr( "Directories:        %1  (%2 / sec)\n" )
+	.arg( stats.dirs ).arg( (int) ( stats.dirs / sec ) );
+    text += tr( "Entries:            %1  (%2 / sec)\n" )
+	.arg( stats.entries ).arg( (qint64) ( stats.entries / sec ) );
+    text += tr( "Queue depth:        %1  (max. %2)\n" )
+	.arg( stats.queueDepth ).arg( stats.maxQueueDepth );
+    text += tr( "Busy workers:       %1\n" ).arg( stats.busyWorkers );
+    text += "\n";
+    text += tr( "System calls:       %1 millisec (all threads)\n" )
+	.arg( stats.syscallNsec / 1000000 );
+    text += tr( "Creating nodes:     %1 millisec\n" )
+	.arg( qMax( stats.processNsec - stats.notifyNsec, 0LL ) / 1000000 );
+    text += tr( "Notifying models:   %1 millisec\n" )
+	.arg( stats.notifyNsec / 1000000 );
+    text += "\n";
+
+    if ( stats.lstat.count > 0 )
+    {
+	text += tr( "lstat() calls:      %1  (average %2 us)\n" )
+	    .arg( stats.lstat.count )
+	    .arg( stats.lstat.nsec / stats.lstat.count / 1000.0, 0, 'f', 1 );
+	text += histogram( stats );
+	text += "\n";
+    }
+
+    if ( ! stats.devices.isEmpty() )
+    {
+	text += tr( "Device     Dirs      Entries  Entries/sec  First directory\n" );
+
+	foreach ( const ScanDeviceStats & device, stats.devices )
+	{
+	    text += QString( "%1 %2 %3 %4  %5\n" )
+		.arg( QString( "%1:%2" ).arg( major( device.device ) ).arg( minor( device.device ) ), -7 )
+		.arg( device.dirs,    7 )
+		.arg( device.entries, 12 )
+		.arg( (qint64) ( device.entries / sec ), 12 )
+		.arg( device.firstDir );
+	}
+    }
+
+    text += slowestDirs();
+
+    _ui->statsText->setPlainText( text );
+}
+
+
+QString ScanStatsWindow::slowestDirs() const
+{
+    DirReadTimes * readTimes = _tree ? _tree->readTimes() : 0;
+
+    if ( ! readTimes || readTimes->slowest().isEmpty() )
+	return QString();
+
+    QString text = "\n";
+    text += tr( "Slowest directories:\n" );
+    text += tr( "   Read time    Entries  Directory\n" );
+
+    const QList<SlowDir> & slowest = readTimes->slowest();
+
+    for ( int i=0; i < slowest.size() && i < SHOW_SLOWEST; ++i )
+    {
+	const SlowDir & slowDir = slowest.at( i );
+
+	text += QString( "%1 %2  %3\n" )
+	    .arg( DirReadTimes::formatReadTime( slowDir.usec ), 12 )
+	    .arg( slowDir.entries, 10 )
+	    .arg( slowDir.url );
+    }
+
+    return text;
+}
+
+
+QString ScanStatsWindow::histogram( const ScanStatsData & stats ) const
+{
+    int max = 0;
+
+    for ( int i=0; i < ScanLatencies::BucketCount; ++i )
+	max = qMax( max, stats.lstat.buckets[i] );
+
+    QString text;
+
+    for ( int i=0; i < ScanLatencies::BucketCount; ++i )
+    {
+	int count = stats.lstat.buckets[i];
+
+	if ( count == 0 )
+	    continue;
+
+	qint64	limit = ScanLatencies::bucketLimit( i );
+	QString label = limit < 0 ?
+	    QString( ">=%1 us" ).arg( ScanLatencies::bucketLimit( i - 1 ) ) :
+	    QString( "<%1 us"  ).arg( limit );
+
+	int barLength = qMax( 1, (int) ( (qint64) count * BAR_WIDTH / max ) );
+
+	text += QString( "  %1 %2 %3\n" )
+	    .arg( label, 10 )
+	    .arg( QString( barLength, '#' ), -BAR_WIDTH )
+	    .arg( count );
+    }
+
+    return text;
+}
@@ -0,0 +1,100 @@
+/*
+ *   File name: ScanStatsWindow.h
+ *   Summary:	QDirStat "scan statistics" window
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef ScanStatsWindow_h
+#define ScanStatsWindow_h
+
+
+#include <QDialog>
+#include <QTimer>
+
+#include "ui_scan-stats-window.h"
+#include "ScanStats.h"
+
+
+namespace QDirStat
+{
+    class DirTree;
+
+
+    /**
+     * Modeless dialog to show the ScanStats live while reading a directory
+     * tree: How fast it is, where the time goes, and how long the lstat()
+     * calls take. If 'tree' records the read times of its directories (see
+     * DirReadTimes), this also shows the slowest directories.
+     **/
+    class ScanStatsWindow: public QDialog
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor.
+	 *
+	 * Notice that this widget will destroy itself upon window close.
+	 *
+	 * It is advised to use a QPointer for storing a pointer to an instance
+	 * of this class. The QPointer will keep track of this window
+	 * auto-deleting itself when closed.
+	 **/
+	ScanStatsWindow( QWidget * parent, DirTree * tree = 0 );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~ScanStatsWindow();
+
+    public slots:
+
+	/**
+	 * Show the current numbers.
+	 **/
+	void refresh();
+
+	/**
+	 * Reject the dialog contents, i.e. the user clicked the "Cancel" or
+	 * WM_CLOSE button. This not only closes the dialog, it also deletes
+	 * it.
+	 *
+	 * Reimplemented from QDialog.
+	 **/
+	virtual void reject() Q_DECL_OVERRIDE;
+
+    protected:
+
+	/**
+	 * One-time initialization of the widgets in this window.
+	 **/
+	void initWidgets();
+
+	/**
+	 * Format the lstat() latency histogram of 'stats' as text bars.
+	 **/
+	QString histogram( const ScanStatsData & stats ) const;
+
+	/**
+	 * Format the slowest directories of the tree.
+	 **/
+	QString slowestDirs() const;
+
+
+	//
+	// Data members
+	//
+
+	Ui::ScanStatsWindow * _ui;
+	DirTree *	      _tree;
+	QTimer		      _timer;
+    };
+
+} // namespace QDirStat
+
+
+#endif // ScanStatsWindow_h
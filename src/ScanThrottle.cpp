@@ -0,0 +1,299 @@
+/*
+ *   File name: ScanThrottle.cpp
+ *   Summary:	Low-impact scanning: I/O priority, rate limit and backoff
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>		// strerror()
+#include <time.h>		// nanosleep()
+#include <sys/syscall.h>
+#include <sys/resource.h>	// setpriority()
+
+#include <QMutexLocker>
+
+#include "ScanThrottle.h"
+#include "ScanStats.h"
+#include "Settings.h"
+#include "Logger.h"
+
+
+// ioprio_set() has no glibc wrapper; these are from linux/ioprio.h.
+
+#define IOPRIO_CLASS_SHIFT	13
+#define IOPRIO_CLASS_NONE	0
+#define IOPRIO_CLASS_IDLE	3
+#define IOPRIO_WHO_PROCESS	1
+
+#define BACKGROUND_NICE		19
+
+// The backoff doubles when the average lstat() latency is above
+// BACKOFF_HIGH_FACTOR times the normal latency and halves when it is below
+// BACKOFF_LOW_FACTOR times, at most once every BACKOFF_ADJUST_NSEC.
+
+#define BACKOFF_HIGH_FACTOR	4.0
+#define BACKOFF_LOW_FACTOR	2.0
+#define BACKOFF_ADJUST_NSEC	100000000LL	// 0.1 sec
+#define MAX_BACKOFF		64
+
+// The normal latency is the lowest average seen, but it creeps up slowly,
+// so an extremely fast start (everything in the dentry cache) doesn't
+// count as normal forever.
+
+#define BASE_LATENCY_CREEP	1.01
+#define LATENCY_AVG_WEIGHT	0.2
+
+// Don't save wait times for more than this: After a long pause, the rate
+// limit starts over instead of allowing a burst.
+
+#define MAX_IDLE_NSEC		1000000000LL	// 1 sec
+
+
+using namespace QDirStat;
+
+
+// The priority generation that the current thread has applied; -1 if it
+// is not a worker thread that reads directories.
+
+static __thread int threadPriorityGeneration = -1;
+
+
+ScanThrottle * ScanThrottle::instance()
+{
+    static ScanThrottle instance;
+
+    return &instance;
+}
+
+
+ScanThrottle::ScanThrottle():
+    _backgroundPriority( false ),
+    _maxOpsPerSec( 0 ),
+    _adaptiveBackoff( false ),
+    _priorityGeneration( 0 ),
+    _nextOpNsec( 0 ),
+    _avgLatencyNsec( 0.0 ),
+    _baseLatencyNsec( 0.0 ),
+    _lastAdjustNsec( 0 ),
+    _backoff( 1 )
+{
+}
+
+
+void ScanThrottle::setBackgroundPriority( bool enable )
+{
+    QMutexLocker locker( &_mutex );
+
+    if ( enable != _backgroundPriority )
+    {
+	_backgroundPriority = enable;
+	++_priorityGeneration;
+    }
+}
+
+
+void ScanThrottle::setMaxOpsPerSec( int maxOps )
+{
+    QMutexLocker locker( &_mutex );
+    _maxOpsPerSec = qMax( 0, maxOps );
+}
+
+
+void ScanThrottle::setAdaptiveBackoff( bool enable )
+{
+    QMutexLocker locker( &_mutex );
+    _adaptiveBackoff = enable;
+
+    if ( ! enable )
+	_backoff = 1;
+}
+
+
+void ScanThrottle::reset()
+{
+    QMutexLocker locker( &_mutex );
+
+    _nextOpNsec	     = 0;
+    _avgLatencyNsec  = 0.0;
+    _baseLatencyNsec = 0.0;
+    _lastAdjustNsec  = 0;
+    _backoff	     = 1;
+}
+
+
+void ScanThrottle::workerStarted()
+{
+    int  generation;
+    bool background;
+
+    {
+	QMutexLocker locker( &_mutex );
+	generation = _priorityGeneration;
+	background = _backgroundPriority;
+    }
+
+    if ( threadPriorityGeneration == generation )
+	return;
+
+    // A new thread only needs to change anything for the background
+    // priority; an older one might have to go back to normal.
+
+    if ( background || threadPriorityGeneration >= 0 )
+	setThreadPriority( background );
+
+    threadPriorityGeneration = generation;
+}
+
+
+void ScanThrottle::setThreadPriority( bool background )
+{
+    // Both work for the calling thread only: With 0 for ioprio_set(), and
+    // with the thread ID for setpriority() since Linux threads have their
+    // own nice value.
+
+#ifdef SYS_ioprio_set
+    int ioClass = background ? IOPRIO_CLASS_IDLE : IOPRIO_CLASS_NONE;
+
+    if ( syscall( SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioClass << IOPRIO_CLASS_SHIFT ) != 0 )
+	logWarning() << "ioprio_set() failed: " << strerror( errno ) << endl;
+#endif
+
+    pid_t tid = syscall( SYS_gettid );
+
+    // Going back from nice 19 to 0 needs privileges (or RLIMIT_NICE);
+    // the thread then just stays at low priority until the pool retires it.
+
+    if ( setpriority( PRIO_PROCESS, tid, background ? BACKGROUND_NICE : 0 ) != 0 )
+	logWarning() << "setpriority() failed: " << strerror( errno ) << endl;
+}
+
+
+void ScanThrottle::throttle( const ScanLatencies & latencies )
+{
+    if ( ! isThrottling() )
+	return;
+
+    qint64 now = ScanStats::now();
+    qint64 waitNsec;
+
+    {
+	QMutexLocker locker( &_mutex );
+
+	if ( _nextOpNsec < now - MAX_IDLE_NSEC )
+	    _nextOpNsec = now - MAX_IDLE_NSEC;
+
+	if ( _maxOpsPerSec > 0 )
+	{
+	    // One more for the readdir() or the io_uring submission
+
+	    int ops = latencies.count + 1;
+	    _nextOpNsec += ops * ( 1000000000LL / _maxOpsPerSec );
+	}
+
+	if ( _adaptiveBackoff )
+	{
+	    updateBackoff( latencies, now );
+
+	    if ( _backoff > 1 )
+		_nextOpNsec = qMax( _nextOpNsec, now ) + ( _backoff - 1 ) * latencies.nsec;
+	}
+
+	waitNsec = _nextOpNsec - now;
+    }
+
+    // The main thread only sets the time; the DirReadJobQueue waits with
+    // its timer.
+
+    if ( threadPriorityGeneration < 0 || waitNsec <= 0 )
+	return;
+
+    struct timespec ts;
+    ts.tv_sec  = waitNsec / 1000000000LL;
+    ts.tv_nsec = waitNsec % 1000000000LL;
+
+    while ( nanosleep( &ts, &ts ) != 0 && errno == EINTR )
+    {
+	// Continue with the remaining time
+    }
+}
+
+
+void ScanThrottle::updateBackoff( const ScanLatencies & latencies, qint64 now )
+{
+    if ( latencies.count == 0 )
+	return;
+
+    double latency = latencies.nsec / (double) latencies.count;
+
+    if ( _avgLatencyNsec <= 0.0 )
+    {
+	_avgLatencyNsec  = latency;
+	_baseLatencyNsec = latency;
+	_lastAdjustNsec	 = now;
+	return;
+    }
+
+    _avgLatencyNsec  = ( 1.0 - LATENCY_AVG_WEIGHT ) * _avgLatencyNsec + LATENCY_AVG_WEIGHT * latency;
+    _baseLatencyNsec = qMin( _baseLatencyNsec * BASE_LATENCY_CREEP, _avgLatencyNsec );
+
+    if ( now - _lastAdjustNsec < BACKOFF_ADJUST_NSEC )
+	return;
+
+    int oldBackoff = _backoff;
+
+    if ( _avgLatencyNsec > BACKOFF_HIGH_FACTOR * _baseLatencyNsec )
+	_backoff = qMin( 2 * _backoff, MAX_BACKOFF );
+    else if ( _avgLatencyNsec < BACKOFF_LOW_FACTOR * _baseLatencyNsec )
+	_backoff = qMax( _backoff / 2, 1 );
+
+    _lastAdjustNsec = now;
+
+    if ( _backoff != oldBackoff )
+    {
+	logDebug() << "lstat() latency " << (qint64) _avgLatencyNsec / 1000 << " µs"
+		   << " (normal: " << (qint64) _baseLatencyNsec / 1000 << " µs):"
+		   << " backoff " << _backoff << endl;
+    }
+}
+
+
+int ScanThrottle::delayMillisec()
+{
+    if ( ! isThrottling() )
+	return 0;
+
+    QMutexLocker locker( &_mutex );
+    qint64 waitNsec = _nextOpNsec - ScanStats::now();
+
+    return waitNsec > 0 ? (int) ( ( waitNsec + 999999 ) / 1000000 ) : 0;
+}
+
+
+void ScanThrottle::readSettings()
+{
+    Settings settings;
+    settings.beginGroup( "DirectoryTree" );
+
+    setBackgroundPriority( settings.value( "BackgroundScan",	  false ).toBool() );
+    setMaxOpsPerSec	 ( settings.value( "MaxScanOpsPerSec",	  0	).toInt()  );
+    setAdaptiveBackoff	 ( settings.value( "AdaptiveScanBackoff", false ).toBool() );
+
+    settings.endGroup();
+}
+
+
+void ScanThrottle::writeSettings()
+{
+    Settings settings;
+    settings.beginGroup( "DirectoryTree" );
+
+    settings.setValue( "BackgroundScan",      backgroundPriority() );
+    settings.setValue( "MaxScanOpsPerSec",    maxOpsPerSec()	   );
+    settings.setValue( "AdaptiveScanBackoff", adaptiveBackoff()    );
+
+    settings.endGroup();
+}
@@ -0,0 +1,172 @@
+/*
+ *   File name: ScanThrottle.h
+ *   Summary:	Low-impact scanning: I/O priority, rate limit and backoff
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef ScanThrottle_h
+#define ScanThrottle_h
+
+
+#include <QMutex>
+
+
+namespace QDirStat
+{
+    struct ScanLatencies;
+
+
+    /**
+     * Keeping a scan from competing with the real work load of a busy
+     * server:
+     *
+     * - Background priority: The worker threads that read directories
+     *	 switch to the "idle" I/O scheduling class and the lowest CPU
+     *	 priority (nice 19) when they start reading.
+     *
+     * - A limit for the system calls (readdir() and lstat()) per second
+     *	 of all threads together.
+     *
+     * - Adaptive backoff: When the lstat() latency rises well above what
+     *	 was seen before, the disk is busy with something else; the scan
+     *	 then pauses for a multiple of the time that its own system calls
+     *	 took until the latency is back to normal.
+     *
+     * The system call sites in LocalDirReadJob report each batch with
+     * throttle(). Worker threads sleep right there; the main thread never
+     * sleeps since that would block the event loop: The DirReadJobQueue
+     * asks delayMillisec() instead and waits with its timer.
+     *
+     * This is a process-wide singleton like ScanStats. All methods are
+     * thread-safe.
+     **/
+    class ScanThrottle
+    {
+    public:
+
+	/**
+	 * Return the singleton.
+	 **/
+	static ScanThrottle * instance();
+
+	/**
+	 * Return 'true' if worker threads use the idle I/O class and nice 19.
+	 **/
+	bool backgroundPriority() const { return _backgroundPriority; }
+
+	/**
+	 * Enable or disable the background priority for worker threads.
+	 **/
+	void setBackgroundPriority( bool enable );
+
+	/**
+	 * Return the limit for system calls per second or 0 for no limit.
+	 **/
+	int maxOpsPerSec() const { return _maxOpsPerSec; }
+
+	/**
+	 * Set the limit for system calls per second. 0 means no limit.
+	 **/
+	void setMaxOpsPerSec( int maxOps );
+
+	/**
+	 * Return 'true' if the scan backs off when the lstat() latency rises.
+	 **/
+	bool adaptiveBackoff() const { return _adaptiveBackoff; }
+
+	/**
+	 * Enable or disable the adaptive backoff.
+	 **/
+	void setAdaptiveBackoff( bool enable );
+
+	/**
+	 * Return 'true' if system calls might have to wait at all.
+	 **/
+	bool isThrottling() const { return _maxOpsPerSec > 0 || _adaptiveBackoff; }
+
+	/**
+	 * Return the current backoff factor: 1 for none, otherwise the
+	 * scan pauses (factor - 1) times the time of its system calls.
+	 **/
+	int backoff() const { return _backoff; }
+
+	/**
+	 * Forget the latencies and the system calls seen so far. This is
+	 * called when a new scan starts.
+	 **/
+	void reset();
+
+	/**
+	 * Notification that the current thread is a worker thread that
+	 * reads directories: Apply the background priority (or go back to
+	 * normal if it was switched off meanwhile), and let throttle()
+	 * sleep in this thread. This is cheap when nothing changed.
+	 **/
+	void workerStarted();
+
+	/**
+	 * Account for the system calls that were just done: The lstat()
+	 * calls in 'latencies' and at least one more for readdir(). In a
+	 * worker thread, this sleeps as long as the rate limit or the
+	 * backoff require.
+	 **/
+	void throttle( const ScanLatencies & latencies );
+
+	/**
+	 * Return the number of milliseconds until the next system call is
+	 * allowed or 0 if it can be done right now.
+	 **/
+	int delayMillisec();
+
+	/**
+	 * Read the settings from the "DirectoryTree" group.
+	 **/
+	void readSettings();
+
+	/**
+	 * Write the settings to the "DirectoryTree" group.
+	 **/
+	void writeSettings();
+
+    protected:
+
+	/**
+	 * Constructor. Use instance() instead.
+	 **/
+	ScanThrottle();
+
+	/**
+	 * Set the I/O class and nice value of the current thread for
+	 * 'background' or back to normal.
+	 **/
+	static void setThreadPriority( bool background );
+
+	/**
+	 * Update the latency average and the backoff factor with the
+	 * lstat() calls of 'latencies'. The mutex has to be locked.
+	 **/
+	void updateBackoff( const ScanLatencies & latencies, qint64 now );
+
+
+	// Data members
+
+	QMutex	_mutex;
+	bool	_backgroundPriority;
+	int	_maxOpsPerSec;
+	bool	_adaptiveBackoff;
+	int	_priorityGeneration;	// Changed with _backgroundPriority
+	qint64	_nextOpNsec;		// When the next system call is allowed
+	double	_avgLatencyNsec;	// Moving average of the lstat() calls
+	double	_baseLatencyNsec;	// The normal one without other load
+	qint64	_lastAdjustNsec;
+	int	_backoff;
+
+    };	// class ScanThrottle
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef ScanThrottle_h
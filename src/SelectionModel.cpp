@@ -25,6 +25,7 @@ SelectionModel::SelectionModel( DirTreeModel * dirTreeModel, QObject * parent ):
     _currentItem(0),
     _currentBranch(0),
     _selectedItemsDirty(false),
+    _selectionGeneration(0),
     _verbose(false)
 {
     connect( this, SIGNAL( currentChanged	  ( QModelIndex, QModelIndex ) ),
@@ -38,6 +39,9 @@ SelectionModel::SelectionModel( DirTreeModel * dirTreeModel, QObject * parent ):
 
     connect( dirTreeModel->tree(), SIGNAL( clearing() ),
 	     this,		   SLOT	 ( clear()    ) );
+
+    connect( dirTreeModel->tree(), SIGNAL( collectingUsedNodes( QDirStat::UsedNodes * ) ),
+	     this,		   SLOT	 ( collectUsedNodes   ( QDirStat::UsedNodes * ) ) );
 }
 
 
@@ -51,6 +55,7 @@ void SelectionModel::clear()
 {
     _selectedItems.clear();
     _selectedItemsDirty = true;
+    ++_selectionGeneration;
     _currentItem = 0;
     _currentBranch = 0;
 
@@ -111,15 +116,61 @@ void SelectionModel::propagateCurrentChanged( const QModelIndex & newCurrentInde
 void SelectionModel::propagateSelectionChanged( const QItemSelection & selected,
 						const QItemSelection & deselected )
 {
-    Q_UNUSED( selected );
-    Q_UNUSED( deselected );
+    if ( ! _selectedItemsDirty )
+    {
+	// Apply only the changes to the set instead of collecting all
+	// selected items again: Selecting all children of a large directory
+	// and then clicking somewhere else would otherwise go through all of
+	// them twice.
 
-    _selectedItemsDirty = true;
+	int lastCol = _dirTreeModel->columnCount( QModelIndex() ) - 1;
+
+	foreach ( const QItemSelectionRange & range, deselected )
+	{
+	    // If only some columns were deselected, the row might still be
+	    // selected with the others.
+
+	    bool wholeRows = range.left() == 0 && range.right() >= lastCol;
+
+	    for ( int row = range.top(); row <= range.bottom(); ++row )
+	    {
+		if ( wholeRows || ! rowIntersectsSelection( row, range.parent() ) )
+		    _selectedItems.remove( itemAt( range, row ) );
+	    }
+	}
+
+	foreach ( const QItemSelectionRange & range, selected )
+	{
+	    for ( int row = range.top(); row <= range.bottom(); ++row )
+	    {
+		FileInfo * item = itemAt( range, row );
+
+		if ( item )
+		    _selectedItems.insert( item );
+	    }
+	}
+    }
+
+    ++_selectionGeneration;
     emit selectionChanged();
     emit selectionChanged( selectedItems() );
 }
 
 
+FileInfo * SelectionModel::itemAt( const QItemSelectionRange & range, int row ) const
+{
+    QModelIndex index = _dirTreeModel->index( row, range.left(), range.parent() );
+
+    if ( ! index.isValid() )
+	return 0;
+
+    FileInfo * item = static_cast<FileInfo *>( index.internalPointer() );
+    CHECK_MAGIC( item );
+
+    return item;
+}
+
+
 void SelectionModel::selectItem( FileInfo * item )
 {
     extendSelection( item,
@@ -251,12 +302,25 @@ void SelectionModel::deletingChildNotify( FileInfo * deletedChild )
 {
     _selectedItemsDirty = true;
     _selectedItems.clear();
+    ++_selectionGeneration;
 
     if ( _currentItem->isInSubtree( deletedChild ) )
 	setCurrentItem( 0 );
 }
 
 
+void SelectionModel::collectUsedNodes( UsedNodes * usedNodes )
+{
+    if ( _currentItem )
+	usedNodes->nodes.insert( _currentItem );
+
+    if ( _currentBranch )
+	usedNodes->nodes.insert( _currentBranch );
+
+    usedNodes->nodes.unite( selectedItems() );
+}
+
+
 void SelectionModel::dumpSelectedItems()
 {
     logDebug() << "Current item: " << _currentItem << endl;
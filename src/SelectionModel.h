@@ -19,6 +19,7 @@ namespace QDirStat
 {
     class FileInfo;
     class DirTreeModel;
+    struct UsedNodes;
 
     /**
      * Selection model that can translate between QModelIndex and FileInfo
@@ -49,9 +50,19 @@ namespace QDirStat
 
 	/**
 	 * Return all currently selected items as a set.
+	 *
+	 * The set is kept up to date with each change of the selection, so
+	 * this is cheap: FileInfoSet is implicitly shared.
 	 **/
 	FileInfoSet selectedItems();
 
+	/**
+	 * Return a number that changes whenever the selection changes. Users
+	 * of the selection can compare this with the value from last time to
+	 * find out if they need to update anything.
+	 **/
+	uint selectionGeneration() const { return _selectionGeneration; }
+
 	/**
 	 * Return the current item (the one that has the keyboard focus).
 	 * This might return 0 if currently no item has the keyboard focus.
@@ -200,9 +211,21 @@ namespace QDirStat
 	 **/
 	void deletingChildNotify( FileInfo *deletedChild );
 
+	/**
+	 * Add the current item, the current branch and the selected items to
+	 * 'usedNodes' so the tree doesn't compact them.
+	 **/
+	void collectUsedNodes( QDirStat::UsedNodes * usedNodes );
+
 
     protected:
 
+	/**
+	 * Return the item in row 'row' of the parent of 'range' or 0 if
+	 * there is none.
+	 **/
+	FileInfo * itemAt( const QItemSelectionRange & range, int row ) const;
+
 	// Data members
 
 	DirTreeModel	* _dirTreeModel;
@@ -210,6 +233,7 @@ namespace QDirStat
 	FileInfo	* _currentBranch;
 	FileInfoSet	  _selectedItems;
 	bool		  _selectedItemsDirty;
+	uint		  _selectionGeneration;
 	bool		  _verbose;
 
     };	// class SelectionModel
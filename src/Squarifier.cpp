@@ -0,0 +1,70 @@
+/*
+ *   File name: Squarifier.cpp
+ *   Summary:	Row breaks of the squarified treemap layout
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include "Squarifier.h"
+
+
+using namespace QDirStat;
+
+
+Squarifier::Squarifier( const QVector<FileSize> & sizes )
+{
+    _prefixSums.reserve( sizes.size() + 1 );
+
+    FileSize sum = 0;
+    _prefixSums.append( sum );
+
+    for ( int i = 0; i < sizes.size(); ++i )
+    {
+	sum += sizes.at( i );
+	_prefixSums.append( sum );
+    }
+}
+
+
+int Squarifier::rowEnd( const QRectF & rect, double scale, int first ) const
+{
+    int length = qMax( rect.width(), rect.height() );
+    const int end = count();
+
+    if ( length == 0 || first >= end )	// Sanity check
+	return first;
+
+    const FileSize * prefix = _prefixSums.constData();
+
+    // Doing all calculations in the 'size' dimension only needs one
+    // scaling before the loop.
+
+    const double scaledLengthSquare = length * (double) length / scale;
+    const double firstSize	    = prefix[ first + 1 ] - prefix[ first ];
+    double	 lastWorstAspectRatio = -1.0;
+    int		 pos		    = first + 1;	// The first one is always in the row
+
+    while ( pos < end )
+    {
+	FileSize size = prefix[ pos + 1 ] - prefix[ pos ];
+	double	 sum  = prefix[ pos + 1 ] - prefix[ first ];
+
+	if ( sum != 0 && size != 0 )
+	{
+	    double sumSquare	    = sum * sum;
+	    double worstAspectRatio = qMax( scaledLengthSquare * firstSize / sumSquare,
+					    sumSquare / ( scaledLengthSquare * size ) );
+
+	    if ( lastWorstAspectRatio >= 0.0 && worstAspectRatio > lastWorstAspectRatio )
+		break;
+
+	    lastWorstAspectRatio = worstAspectRatio;
+	}
+
+	++pos;
+    }
+
+    return pos;
+}
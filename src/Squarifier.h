@@ -0,0 +1,78 @@
+/*
+ *   File name: Squarifier.h
+ *   Summary:	Row breaks of the squarified treemap layout
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef Squarifier_h
+#define Squarifier_h
+
+
+#include <QVector>
+#include <QRectF>
+
+#include "FileInfo.h"	// FileSize
+
+
+namespace QDirStat
+{
+    /**
+     * The row breaks of the "squarified treemaps" algorithm (see
+     * TreemapTile::createSquarifiedChildren()) for the sizes of the
+     * children of one tile, sorted in descending order.
+     *
+     * This keeps the prefix sums of the sizes, so the sum of any row is
+     * one subtraction: Deciding whether one more child still improves the
+     * aspect ratio of a row and laying out the row afterwards don't need
+     * to add up the sizes again, and nothing calls FileInfo::totalSize()
+     * again. The complete layout of a tile is linear in the number of its
+     * children.
+     **/
+    class Squarifier
+    {
+    public:
+
+	/**
+	 * Constructor. 'sizes' have to be sorted in descending order.
+	 **/
+	Squarifier( const QVector<FileSize> & sizes );
+
+	/**
+	 * Return the number of sizes.
+	 **/
+	int count() const { return _prefixSums.size() - 1; }
+
+	/**
+	 * Return size no. 'index'.
+	 **/
+	FileSize size( int index ) const
+	    { return _prefixSums.at( index + 1 ) - _prefixSums.at( index ); }
+
+	/**
+	 * Return the sum of the sizes from 'first' to 'end' (excluding).
+	 **/
+	FileSize sum( int first, int end ) const
+	    { return _prefixSums.at( end ) - _prefixSums.at( first ); }
+
+	/**
+	 * Return the end of the row that starts at 'first' in 'rect': Add
+	 * children to the row until the worst aspect ratio in it gets
+	 * worse. 'scale' is the scaling factor between the sizes and pixels.
+	 *
+	 * This returns 'first' (an empty row) if 'rect' has no area.
+	 **/
+	int rowEnd( const QRectF & rect, double scale, int first ) const;
+
+    protected:
+
+	QVector<FileSize> _prefixSums;	// Sum of the sizes before each one
+
+    };	// class Squarifier
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef Squarifier_h
@@ -0,0 +1,53 @@
+/*
+ *   File name: StartupProfile.cpp
+ *   Summary:	Timing the steps of the program startup
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include "StartupProfile.h"
+#include "Logger.h"
+
+
+using namespace QDirStat;
+
+
+QElapsedTimer StartupProfile::_timer;
+qint64	      StartupProfile::_lastMsec = 0;
+bool	      StartupProfile::_finished = false;
+
+
+void StartupProfile::start()
+{
+    _timer.start();
+    _lastMsec = 0;
+    _finished = false;
+}
+
+
+void StartupProfile::milestone( const QString & name )
+{
+    if ( _finished || ! _timer.isValid() )
+	return;
+
+    qint64 msec = _timer.elapsed();
+
+    logInfo() << "Startup: " << name << " after " << msec << " millisec"
+	      << " (+" << msec - _lastMsec << ")" << endl;
+
+    _lastMsec = msec;
+}
+
+
+void StartupProfile::finish()
+{
+    if ( _finished || ! _timer.isValid() )
+	return;
+
+    milestone( "Event loop running" );
+    _finished = true;
+
+    logInfo() << "Startup complete after " << _timer.elapsed() << " millisec" << endl;
+}
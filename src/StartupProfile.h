@@ -0,0 +1,65 @@
+/*
+ *   File name: StartupProfile.h
+ *   Summary:	Timing the steps of the program startup
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef StartupProfile_h
+#define StartupProfile_h
+
+
+#include <QString>
+#include <QElapsedTimer>
+
+
+namespace QDirStat
+{
+    /**
+     * Timing the steps of the program startup until the main window is
+     * shown and the event loop runs: Each milestone is logged with the
+     * time since main() was entered and since the previous milestone, so
+     * it is easy to see what makes the startup slow.
+     *
+     * Everything that is not needed for the first paint should be
+     * initialized on first use or after finish().
+     **/
+    class StartupProfile
+    {
+    public:
+
+	/**
+	 * Start the clock. Call this first thing in main().
+	 **/
+	static void start();
+
+	/**
+	 * Log that step 'name' of the startup is done.
+	 **/
+	static void milestone( const QString & name );
+
+	/**
+	 * Log that the startup is complete. Only the first call does
+	 * anything.
+	 **/
+	static void finish();
+
+	/**
+	 * Return 'true' if the startup is complete.
+	 **/
+	static bool isFinished() { return _finished; }
+
+    protected:
+
+	static QElapsedTimer	_timer;
+	static qint64		_lastMsec;
+	static bool		_finished;
+
+    };	// class StartupProfile
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef StartupProfile_h
@@ -0,0 +1,111 @@
+/*
+ *   File name: Statx.cpp
+ *   Summary:	lstat() via statx() with only the attributes that are needed
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>	// makedev()
+
+#include "Statx.h"
+
+
+using namespace QDirStat;
+
+
+bool Statx::_useCachedAttributes = false;
+
+// -1: unknown, 0: no statx() on this system, 1: statx() works
+
+static int statxAvailable = -1;
+
+
+unsigned Statx::mask()
+{
+#ifdef STATX_TYPE
+    // No atime and ctime, no birth time. The inode is needed for counting
+    // hard links only once, the owner for the owner totals; st_dev is
+    // always returned.
+
+    return STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_BLOCKS |
+	STATX_MTIME | STATX_NLINK | STATX_INO | STATX_UID | STATX_GID;
+#else
+    return 0;
+#endif
+}
+
+
+int Statx::flags()
+{
+    int flags = AT_SYMLINK_NOFOLLOW;
+
+#ifdef AT_STATX_DONT_SYNC
+    if ( _useCachedAttributes )
+	flags |= AT_STATX_DONT_SYNC;
+#endif
+
+    return flags;
+}
+
+
+int Statx::lstatAt( int dirFd, const char * name, struct stat * statInfo )
+{
+#if defined( STATX_TYPE ) && defined( SYS_statx )
+    if ( statxAvailable != 0 )
+    {
+	// The raw system call: The glibc wrapper only came with 2.28, and
+	// it would emulate statx() with fstatat() on old kernels anyway.
+
+	struct statx stx;
+
+	if ( syscall( SYS_statx, dirFd, name, flags(), mask(), &stx ) == 0 )
+	{
+	    statxAvailable = 1;
+	    toStat( &stx, statInfo );
+
+	    return 0;
+	}
+
+	if ( errno != ENOSYS )
+	    return errno;
+
+	statxAvailable = 0;	// Old kernel: Use fstatat() from now on
+    }
+#endif
+
+    if ( fstatat( dirFd, name, statInfo, AT_SYMLINK_NOFOLLOW ) != 0 )
+	return errno;
+
+    return 0;
+}
+
+
+#ifdef STATX_TYPE
+
+void Statx::toStat( const struct statx * stx, struct stat * statInfo )
+{
+    memset( statInfo, 0, sizeof( *statInfo ) );
+
+    statInfo->st_dev	    = makedev( stx->stx_dev_major, stx->stx_dev_minor );
+    statInfo->st_ino	    = stx->stx_ino;
+    statInfo->st_mode	    = stx->stx_mode;
+    statInfo->st_nlink	    = stx->stx_nlink;
+    statInfo->st_uid	    = stx->stx_uid;
+    statInfo->st_gid	    = stx->stx_gid;
+    statInfo->st_rdev	    = makedev( stx->stx_rdev_major, stx->stx_rdev_minor );
+    statInfo->st_size	    = stx->stx_size;
+    statInfo->st_blksize    = stx->stx_blksize;
+    statInfo->st_blocks	    = stx->stx_blocks;
+    statInfo->st_atime	    = stx->stx_atime.tv_sec;
+    statInfo->st_mtime	    = stx->stx_mtime.tv_sec;
+    statInfo->st_ctime	    = stx->stx_ctime.tv_sec;
+}
+
+#endif
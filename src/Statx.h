@@ -0,0 +1,85 @@
+/*
+ *   File name: Statx.h
+ *   Summary:	lstat() via statx() with only the attributes that are needed
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef Statx_h
+#define Statx_h
+
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+
+namespace QDirStat
+{
+    /**
+     * lstat() for reading directories with statx(): This only asks for the
+     * attributes that FileInfo uses (type, mode, size, blocks, mtime,
+     * number of links and the inode for counting hard links only once),
+     * so network file systems like NFS or CephFS don't need to fetch or
+     * revalidate anything else.
+     *
+     * Optionally, this uses AT_STATX_DONT_SYNC: The file system may then
+     * return the attributes that it has cached without asking the server
+     * again. This saves a lot of round trips, but the result might be a
+     * little out of date.
+     *
+     * If the kernel (or glibc) doesn't have statx(), this falls back to
+     * fstatat(). IoUringStat uses the same attribute mask and flags.
+     *
+     * All methods are static and thread-safe.
+     **/
+    class Statx
+    {
+    public:
+
+	/**
+	 * lstat() 'name' relative to directory file descriptor 'dirFd'.
+	 * Return 0 on success or the errno value otherwise.
+	 **/
+	static int lstatAt( int dirFd, const char * name, struct stat * statInfo );
+
+	/**
+	 * Return the statx() attribute mask.
+	 **/
+	static unsigned mask();
+
+	/**
+	 * Return the statx() flags: AT_SYMLINK_NOFOLLOW and, if enabled,
+	 * AT_STATX_DONT_SYNC.
+	 **/
+	static int flags();
+
+	/**
+	 * Return 'true' if cached attributes are good enough.
+	 **/
+	static bool useCachedAttributes() { return _useCachedAttributes; }
+
+	/**
+	 * Set if cached attributes are good enough (AT_STATX_DONT_SYNC).
+	 * Set this before reading starts.
+	 **/
+	static void setUseCachedAttributes( bool useCached )
+	    { _useCachedAttributes = useCached; }
+
+	/**
+	 * Convert 'stx' to a classic struct stat. Anything that was not
+	 * requested is 0.
+	 **/
+	static void toStat( const struct statx * stx, struct stat * statInfo );
+
+    protected:
+
+	static bool _useCachedAttributes;
+
+    };	// class Statx
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef Statx_h
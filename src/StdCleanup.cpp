@@ -152,6 +152,7 @@ Cleanup * StdCleanup::hardDelete( QObject * parent )
     cleanup->setWorksForDotEntry( false );
     cleanup->setAskForConfirmation( true );
     cleanup->setRefreshPolicy( Cleanup::RefreshParent );
+    cleanup->setBatchSize( 100 );	// "rm -rf" takes any number of paths
     cleanup->setIcon( ":/icons/delete.png" );
     cleanup->setShortcut( Qt::CTRL + Qt::Key_Delete );
 
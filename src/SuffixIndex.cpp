@@ -0,0 +1,190 @@
+/*
+ *   File name: SuffixIndex.cpp
+ *   Summary:	Index of files by filename suffix for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include "SuffixIndex.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "FileInfoIterator.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+SuffixIndex::SuffixIndex( DirTree * tree ):
+    QObject( tree ),
+    _tree( tree ),
+    _built( false )
+{
+    CHECK_PTR( _tree );
+
+    connect( _tree, SIGNAL( childAdded     ( FileInfo * ) ),
+	     this,  SLOT  ( childAdded     ( FileInfo * ) ) );
+
+    connect( _tree, SIGNAL( deletingChild  ( FileInfo * ) ),
+	     this,  SLOT  ( deletingChild  ( FileInfo * ) ) );
+
+    connect( _tree, SIGNAL( clearingSubtree( DirInfo *	) ),
+	     this,  SLOT  ( clearingSubtree( DirInfo *	) ) );
+
+    connect( _tree, SIGNAL( clearing() ),
+	     this,  SLOT  ( clear()    ) );
+}
+
+
+SuffixIndex::~SuffixIndex()
+{
+
+}
+
+
+void SuffixIndex::clear()
+{
+    // Assigning an empty hash frees the memory right away
+
+    _files = QHash<QString, QSet<FileInfo *> >();
+    _built = false;
+}
+
+
+QString SuffixIndex::key( const QString & name )
+{
+    int pos = name.lastIndexOf( '.' );
+
+    if ( pos < 0 )
+	return QString();
+
+    return name.mid( pos + 1 ).toLower();
+}
+
+
+void SuffixIndex::build()
+{
+    clear();
+
+    if ( _tree->root() )
+	addSubtree( _tree->root() );
+
+    _built = true;
+    logDebug() << "Indexed " << _files.size() << " suffixes" << endl;
+}
+
+
+FileInfoList SuffixIndex::matchingFiles( const QString & suffix,
+					 FileInfo *	 subtree )
+{
+    FileInfoList result;
+    QString indexKey = key( suffix );
+
+    if ( indexKey.isEmpty() )
+    {
+	logWarning() << "Can't look up suffix \"" << suffix << "\"" << endl;
+	return result;
+    }
+
+    if ( ! _built )
+	build();
+
+    // The index only knows the last part of the suffix, so there may be a
+    // few more files for ".bz2" than for ".tar.bz2".
+
+    const QSet<FileInfo *> candidates = _files.value( indexKey );
+
+    foreach ( FileInfo * file, candidates )
+    {
+	if ( file->name().endsWith( suffix, Qt::CaseInsensitive ) &&
+	     ( ! subtree || file->isInSubtree( subtree ) ) )
+	{
+	    result << file;
+	}
+    }
+
+    return result;
+}
+
+
+void SuffixIndex::addSubtree( FileInfo * subtree )
+{
+    if ( subtree->isFile() )
+    {
+	QString indexKey = key( subtree->name() );
+
+	if ( ! indexKey.isEmpty() )
+	    _files[ indexKey ].insert( subtree );
+    }
+
+    FileInfoIterator it( subtree );
+
+    while ( *it )
+    {
+	addSubtree( *it );
+	++it;
+    }
+}
+
+
+void SuffixIndex::removeSubtree( FileInfo * subtree )
+{
+    if ( subtree->isFile() )
+    {
+	QString indexKey = key( subtree->name() );
+	QHash<QString, QSet<FileInfo *> >::iterator found = _files.find( indexKey );
+
+	if ( found != _files.end() )
+	{
+	    found.value().remove( subtree );
+
+	    if ( found.value().isEmpty() )
+		_files.erase( found );
+	}
+    }
+
+    FileInfoIterator it( subtree );
+
+    while ( *it )
+    {
+	removeSubtree( *it );
+	++it;
+    }
+}
+
+
+void SuffixIndex::childAdded( FileInfo * newChild )
+{
+    // Children that are added while there is no index are found when it
+    // is built.
+
+    if ( _built && newChild )
+	addSubtree( newChild );
+}
+
+
+void SuffixIndex::deletingChild( FileInfo * deletedChild )
+{
+    if ( _built && deletedChild )
+	removeSubtree( deletedChild );
+}
+
+
+void SuffixIndex::clearingSubtree( DirInfo * subtree )
+{
+    if ( ! _built || ! subtree )
+	return;
+
+    // The subtree itself remains; only its children are deleted.
+
+    FileInfoIterator it( subtree );
+
+    while ( *it )
+    {
+	removeSubtree( *it );
+	++it;
+    }
+}
@@ -0,0 +1,133 @@
+/*
+ *   File name: SuffixIndex.h
+ *   Summary:	Index of files by filename suffix for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef SuffixIndex_h
+#define SuffixIndex_h
+
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QList>
+#include <QString>
+
+#include "FileInfo.h"	// FileInfoList
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class DirInfo;
+
+
+    /**
+     * Index of all files of a DirTree by the last part of their filename
+     * suffix, so all files with a given suffix can be found without
+     * walking the tree and comparing each filename.
+     *
+     * The index is built on demand with the first query, and then it is
+     * kept current with the tree's signals. When the tree is cleared, it
+     * is dropped again until the next query.
+     *
+     * Use DirTree::suffixIndex() to get the index of a tree.
+     **/
+    class SuffixIndex: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor. The index is a child of 'tree'.
+	 **/
+	SuffixIndex( DirTree * tree );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~SuffixIndex();
+
+	/**
+	 * Return all files in 'subtree' (in the complete tree if that is 0)
+	 * whose name ends with 'suffix' (case-insensitive). 'suffix' should
+	 * start with ".", e.g. ".jpg" or ".tar.bz2".
+	 *
+	 * This builds the index if it is not there yet.
+	 **/
+	FileInfoList matchingFiles( const QString & suffix,
+				    FileInfo *	    subtree = 0 );
+
+	/**
+	 * Return 'true' if the index is built.
+	 **/
+	bool isBuilt() const { return _built; }
+
+	/**
+	 * Return the index key for a filename or for a suffix: The part
+	 * after the last dot in lowercase, or an empty string if there is no
+	 * dot.
+	 **/
+	static QString key( const QString & name );
+
+    public slots:
+
+	/**
+	 * Drop the index. It is built again with the next query.
+	 **/
+	void clear();
+
+    protected slots:
+
+	/**
+	 * Add a new child (and everything below it) to the index.
+	 **/
+	void childAdded( FileInfo * newChild );
+
+	/**
+	 * Remove a child (and everything below it) from the index before it
+	 * is deleted.
+	 **/
+	void deletingChild( FileInfo * deletedChild );
+
+	/**
+	 * Remove everything below 'subtree' from the index before it is
+	 * cleared.
+	 **/
+	void clearingSubtree( DirInfo * subtree );
+
+    protected:
+
+	/**
+	 * Build the index from the complete tree.
+	 **/
+	void build();
+
+	/**
+	 * Add all files in 'subtree' to the index.
+	 **/
+	void addSubtree( FileInfo * subtree );
+
+	/**
+	 * Remove all files in 'subtree' from the index.
+	 **/
+	void removeSubtree( FileInfo * subtree );
+
+
+	// Data members
+
+	DirTree *				 _tree;
+	bool					 _built;
+	QHash<QString, QSet<FileInfo *> >	 _files;
+
+    };	// class SuffixIndex
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef SuffixIndex_h
@@ -8,16 +8,33 @@
 
 
 #include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <stdio.h>	// rename()
+#include <string.h>	// strcmp()
+#include <unistd.h>	// link(), unlink()
+#include <sys/stat.h>	// lstat()
+#include <sys/time.h>	// utimes()
+#include <sys/syscall.h>
 #include <QDir>
 #include <QDateTime>
 #include <QFile>
-#include <QTextStream>
+#include <QMutexLocker>
 
 #include "Trash.h"
+#include "DeleteJob.h"
 #include "Logger.h"
 #include "Exception.h"
 
 
+#define COPY_BUFFER_SIZE	( 1024 * 1024 )
+#define MAX_NAME_ATTEMPTS	100
+
+#ifndef RENAME_NOREPLACE
+#  define RENAME_NOREPLACE	( 1 << 0 )	// From <linux/fs.h>
+#endif
+
+
 Trash * Trash::_instance = 0;
 
 
@@ -57,11 +74,13 @@ Trash::~Trash()
 }
 
 
-dev_t Trash::device( const QString & path )
+dev_t Trash::device( const QString & path, bool followSymLinks )
 {
     dev_t dev = 0;
     struct stat statBuf;
-    int result = stat( path.toUtf8(), &statBuf );
+    int result = followSymLinks ?
+	stat ( path.toUtf8(), &statBuf ) :
+	lstat( path.toUtf8(), &statBuf );
     dev = statBuf.st_dev;
 
     if ( result < 0 )
@@ -102,7 +121,9 @@ QString Trash::toplevel( const QString & rawPath )
 
 TrashDir * Trash::trashDir( const QString & path )
 {
-    dev_t dev = device( path );
+    // A symlink is moved to the trash, not its target
+
+    dev_t dev = device( path, false );
 
     if ( _trashDirs.contains( dev ) )
 	return _trashDirs[ dev ];
@@ -166,6 +187,10 @@ TrashDir * Trash::trashDir( const QString & path )
 	logWarning() << "Falling back to home trash dir: "
 		     << _homeTrashDir->path() << endl;
 
+	// Don't try again for every single item on this device
+
+	_trashDirs[ dev ] = _homeTrashDir;
+
 	return _homeTrashDir;
     }
 }
@@ -173,6 +198,8 @@ TrashDir * Trash::trashDir( const QString & path )
 
 bool Trash::trash( const QString & path )
 {
+    QMutexLocker locker( &instance()->_mutex );
+
     try
     {
 	TrashDir * trashDir = instance()->trashDir( path );
@@ -180,9 +207,36 @@ bool Trash::trash( const QString & path )
 	if ( ! trashDir )
 	    return false;
 
-	QString targetName = trashDir->uniqueName( path );
-	trashDir->createTrashInfo( path, targetName );
-	trashDir->move( path, targetName );
+	// Another program might put something with the same name into
+	// Trash/files without creating a .trashinfo file first: Then try
+	// the next name.
+
+	int attempts = 0;
+
+	while ( true )
+	{
+	    QString targetName = trashDir->createTrashInfo( path );
+	    bool    moved      = false;
+
+	    try
+	    {
+		moved = trashDir->move( path, targetName );
+	    }
+	    catch ( const FileException & ex )
+	    {
+		CAUGHT( ex );
+		trashDir->removeTrashInfo( targetName );
+		RETHROW( ex );
+	    }
+
+	    if ( moved )
+		break;
+
+	    trashDir->removeTrashInfo( targetName );
+
+	    if ( ++attempts >= MAX_NAME_ATTEMPTS )
+		THROW( FileException( path, "No free name in " + trashDir->filesPath() ) );
+	}
     }
     catch ( const FileException & ex )
     {
@@ -233,82 +287,380 @@ TrashDir::TrashDir( const QString & path, dev_t device ):
 }
 
 
-QString TrashDir::uniqueName( const QString & path )
+bool TrashDir::ensureDirExists( const QString & path,
+				mode_t		mode,
+				bool		doThrow )
+{
+    QDir dir( path );
+
+    if ( dir.exists() )
+	return true;
+
+    logInfo() << "mkdir " << path << endl;
+    int result = mkdir( path.toUtf8(), mode );
+
+    if ( result < 0 && doThrow )
+    {
+	THROW( FileException( path,
+			      QString( "Could not create directory %1: %2" )
+			      .arg( path ).arg( formatErrno() ) ) );
+    }
+
+    return result >= 0;
+}
+
+
+QString TrashDir::createTrashInfo( const QString & path )
 {
     QFileInfo file( path );
-    QDir filesDir( filesPath() );
 
     QString baseName  = file.baseName();
     QString extension = file.completeSuffix();
-    int	    count     = 0;
-    QString name      = baseName;
 
-    if ( ! extension.isEmpty() )
-	name += "." + extension;
+    QByteArray content = "[Trash Info]\nPath=" + path.toUtf8() +
+	"\nDeletionDate=" + QDateTime::currentDateTime().toString( Qt::ISODate ).toUtf8() + "\n";
 
-    while ( filesDir.exists( name ) )
+    for ( int count = 0; count < MAX_NAME_ATTEMPTS; ++count )
     {
-	name = QString( "%1_%2" ).arg( baseName ).arg( ++count );
+	QString name = count == 0 ? baseName : baseName + "_" + QString::number( count );
 
 	if ( ! extension.isEmpty() )
 	    name += "." + extension;
+
+	// Something in Trash/files without a .trashinfo file doesn't reserve
+	// its name, but it's still in the way.
+
+	struct stat statInfo;
+
+	if ( lstat( QString( filesPath() + "/" + name ).toUtf8(), &statInfo ) == 0 )
+	    continue;
+
+	// O_EXCL makes this atomic: Whoever creates the .trashinfo file
+	// first owns the name.
+
+	QByteArray infoName = QString( infoPath() + "/" + name + ".trashinfo" ).toUtf8();
+	int fd = open( infoName, O_WRONLY | O_CREAT | O_EXCL, 0600 );
+
+	if ( fd < 0 )
+	{
+	    if ( errno == EEXIST )
+		continue;
+
+	    THROW( FileException( QString::fromUtf8( infoName ),
+				  "Can't create " + QString::fromUtf8( infoName ) + ": " + formatErrno() ) );
+	}
+
+	const char * data = content.constData();
+	ssize_t	     len  = content.size();
+
+	while ( len > 0 )
+	{
+	    ssize_t written = write( fd, data, len );
+
+	    if ( written < 0 && errno == EINTR )
+		continue;
+
+	    if ( written < 0 )
+	    {
+		QString msg = "Could not write " + QString::fromUtf8( infoName ) + ": " + formatErrno();
+		close( fd );
+		unlink( infoName );
+		THROW( FileException( QString::fromUtf8( infoName ), msg ) );
+	    }
+
+	    data += written;
+	    len	 -= written;
+	}
+
+	close( fd );
+
+	return name;
     }
 
-    // We don't care if a .trashinfo file with that name already exists in the
-    // Trash/info directory: Without a corresponding file or directory in the
-    // Trash/files directory, that .trashinfo file is worthless anyway and can
-    // safely be overwritten.
+    THROW( FileException( path, "No free name in " + filesPath() ) );
 
-    return name;
+    return QString();	// Not reached
 }
 
 
-bool TrashDir::ensureDirExists( const QString & path,
-				mode_t		mode,
-				bool		doThrow )
+void TrashDir::removeTrashInfo( const QString & targetName )
 {
-    QDir dir( path );
+    unlink( QString( infoPath() + "/" + targetName + ".trashinfo" ).toUtf8() );
+}
 
-    if ( dir.exists() )
+
+int TrashDir::renameNoReplace( const QByteArray & source, const QByteArray & target )
+{
+#ifdef SYS_renameat2
+    if ( syscall( SYS_renameat2, AT_FDCWD, source.constData(),
+		  AT_FDCWD, target.constData(), RENAME_NOREPLACE ) == 0 )
+    {
+	return 0;
+    }
+
+    // ENOSYS: Old kernel; EINVAL: The file system doesn't support it
+
+    if ( errno != ENOSYS && errno != EINVAL )
+	return -1;
+#endif
+
+    // Like RENAME_NOREPLACE, a hard link fails if the target exists
+
+    if ( link( source, target ) == 0 )
+    {
+	if ( unlink( source ) == 0 )
+	    return 0;
+
+	int err = errno;
+	unlink( target );
+	errno = err;
+
+	return -1;
+    }
+
+    if ( errno != EPERM && errno != EOPNOTSUPP && errno != EMLINK )
+	return -1;
+
+    // Directories (and some file systems) can't have hard links. This last
+    // resort is not atomic, but rename() at least refuses to replace
+    // a directory that is not empty.
+
+    struct stat statInfo;
+
+    if ( lstat( target, &statInfo ) == 0 )
+    {
+	errno = EEXIST;
+	return -1;
+    }
+
+    return rename( source, target );
+}
+
+
+bool TrashDir::move( const QString & path,
+		     const QString & targetName )
+{
+    QByteArray source = path.toUtf8();
+    QByteArray target = QString( filesPath() + "/" + targetName ).toUtf8();
+
+    // The .trashinfo file reserves the name, but a program that doesn't
+    // follow the spec might still create the target: Never replace it.
+
+    if ( renameNoReplace( source, target ) == 0 )
 	return true;
 
-    logInfo() << "mkdir " << path << endl;
-    int result = mkdir( path.toUtf8(), mode );
+    if ( errno == EEXIST || errno == ENOTEMPTY )	// From rename() onto a directory
+    {
+	logWarning() << QString::fromUtf8( target ) << " appeared in the meantime" << endl;
+	return false;
+    }
 
-    if ( result < 0 && doThrow )
+    if ( errno != EXDEV )
     {
-	THROW( FileException( path,
-			      QString( "Could not create directory %1: %2" )
-			      .arg( path ).arg( formatErrno() ) ) );
+	THROW( FileException( path, "Could not move " + path + " to " + QString::fromUtf8( target )
+			      + ": " + formatErrno() ) );
     }
 
-    return result >= 0;
+    // Different devices: Copy everything and then delete the original.
+    // This runs in the DeleteJob's worker thread, so it doesn't block the
+    // GUI even for large subtrees.
+
+    logInfo() << "Copying " << path << " to " << QString::fromUtf8( target ) << endl;
+
+    bool created = false;
+
+    try
+    {
+	copyRecursive( source, target, &created );
+    }
+    catch ( const FileException & ex )
+    {
+	CAUGHT( ex );
+
+	// Don't leave a partial copy, but don't remove what somebody else
+	// created with that name
+
+	struct stat statInfo;
+
+	if ( created )
+	    QDirStat::DeleteJob::removeTree( target );
+	else if ( lstat( target, &statInfo ) == 0 )
+	    return false;
+
+	RETHROW( ex );
+    }
+
+    QString error = QDirStat::DeleteJob::removeTree( source );
+
+    if ( ! error.isEmpty() )
+	THROW( FileException( path, error ) );
+
+    return true;
 }
 
 
-void TrashDir::createTrashInfo( const QString & path,
-				const QString & targetName )
+void TrashDir::copyRecursive( const QByteArray & source,
+			      const QByteArray & target,
+			      bool *		 created )
 {
-    QFile trashInfo( infoPath() + "/" + targetName + ".trashinfo" );
+    struct stat statInfo;
+
+    if ( lstat( source, &statInfo ) < 0 )
+    {
+	THROW( FileException( QString::fromUtf8( source ),
+			      "lstat() failed for " + QString::fromUtf8( source )
+			      + ": " + formatErrno() ) );
+    }
+
+    if ( S_ISDIR( statInfo.st_mode ) )
+    {
+	if ( mkdir( target, 0700 ) < 0 )
+	{
+	    THROW( FileException( QString::fromUtf8( target ),
+				  "Could not create directory " + QString::fromUtf8( target )
+				  + ": " + formatErrno() ) );
+	}
+
+	if ( created )
+	    *created = true;
+
+	DIR * dir = opendir( source );
+
+	if ( ! dir )
+	{
+	    THROW( FileException( QString::fromUtf8( source ),
+				  "Could not open " + QString::fromUtf8( source )
+				  + ": " + formatErrno() ) );
+	}
+
+	try
+	{
+	    struct dirent * entry;
+
+	    while ( ( entry = readdir( dir ) ) != 0 )
+	    {
+		if ( strcmp( entry->d_name, "." ) == 0 || strcmp( entry->d_name, ".." ) == 0 )
+		    continue;
+
+		copyRecursive( source + "/" + entry->d_name,
+			       target + "/" + entry->d_name );
+	    }
+	}
+	catch ( const FileException & ex )
+	{
+	    closedir( dir );
+	    RETHROW( ex );
+	}
+
+	closedir( dir );
+    }
+    else if ( S_ISLNK( statInfo.st_mode ) )
+    {
+	QByteArray linkTarget( statInfo.st_size + 1, '\0' );
+	ssize_t len = readlink( source, linkTarget.data(), linkTarget.size() );
+
+	if ( len < 0 || symlink( linkTarget.left( len ), target ) < 0 )
+	{
+	    THROW( FileException( QString::fromUtf8( source ),
+				  "Could not copy symlink " + QString::fromUtf8( source )
+				  + ": " + formatErrno() ) );
+	}
+
+	if ( created )
+	    *created = true;
 
-    if ( ! trashInfo.open( QIODevice::WriteOnly | QIODevice::Text ) )
-	THROW( FileException( trashInfo.fileName(), "Can't open " + trashInfo.fileName() ) );
+	return; // Nothing more to do for a symlink
+    }
+    else if ( S_ISREG( statInfo.st_mode ) )
+    {
+	copyFile( source, target, created );
+    }
+    else
+    {
+	THROW( FileException( QString::fromUtf8( source ),
+			      "Can't copy special file " + QString::fromUtf8( source ) ) );
+    }
+
+    chmod( target, statInfo.st_mode & 07777 );
 
-    QTextStream str( &trashInfo );
-    str << "[Trash Info]" << endl;
-    str << "Path=" << path << endl;
-    str << "DeletionDate=" << QDateTime::currentDateTime().toString( Qt::ISODate ) << endl;
+    struct timeval times[2];
+    times[0].tv_sec  = statInfo.st_atime;
+    times[0].tv_usec = 0;
+    times[1].tv_sec  = statInfo.st_mtime;
+    times[1].tv_usec = 0;
+
+    utimes( target, times );
 }
 
 
-void TrashDir::move( const QString & path,
-		     const QString & targetName )
+void TrashDir::copyFile( const QByteArray & source,
+			 const QByteArray & target,
+			 bool *		    created )
 {
-    QFile file( path );
-    QString targetPath = filesPath() + "/" + targetName;
+    int sourceFd = open( source, O_RDONLY );
+
+    if ( sourceFd < 0 )
+    {
+	THROW( FileException( QString::fromUtf8( source ),
+			      "Could not open " + QString::fromUtf8( source )
+			      + ": " + formatErrno() ) );
+    }
+
+    int targetFd = open( target, O_WRONLY | O_CREAT | O_EXCL, 0600 );
+
+    if ( targetFd < 0 )
+    {
+	QString msg = "Could not create " + QString::fromUtf8( target ) + ": " + formatErrno();
+	close( sourceFd );
+	THROW( FileException( QString::fromUtf8( target ), msg ) );
+    }
+
+    if ( created )
+	*created = true;
+
+    QByteArray buffer( COPY_BUFFER_SIZE, '\0' );
+    QString msg;
+
+    while ( msg.isEmpty() )
+    {
+	ssize_t len = read( sourceFd, buffer.data(), buffer.size() );
+
+	if ( len == 0 )		// End of file
+	    break;
+
+	if ( len < 0 )
+	{
+	    if ( errno != EINTR )
+		msg = "Could not read " + QString::fromUtf8( source ) + ": " + formatErrno();
+
+	    continue;
+	}
+
+	const char * data = buffer.constData();
+
+	while ( len > 0 )
+	{
+	    ssize_t written = write( targetFd, data, len );
+
+	    if ( written < 0 )
+	    {
+		if ( errno == EINTR )
+		    continue;
+
+		msg = "Could not write " + QString::fromUtf8( target ) + ": " + formatErrno();
+		break;
+	    }
+
+	    data += written;
+	    len	 -= written;
+	}
+    }
+
+    close( sourceFd );
 
-    bool success = file.rename( targetPath );
+    if ( close( targetFd ) < 0 && msg.isEmpty() )
+	msg = "Could not write " + QString::fromUtf8( target ) + ": " + formatErrno();
 
-    if ( ! success )
-	THROW( FileException( path, "Could not move " + path + " to " + targetPath ) );
+    if ( ! msg.isEmpty() )
+	THROW( FileException( QString::fromUtf8( target ), msg ) );
 }
@@ -15,6 +15,7 @@
 #include <unistd.h>
 #include <QObject>
 #include <QMap>
+#include <QMutex>
 
 class TrashDir;
 typedef QMap<dev_t, TrashDir *> TrashDirMap;
@@ -41,6 +42,9 @@ public:
     /**
      * Throw a file or directory into the trash.
      * Return 'true' on success, 'false' on error.
+     *
+     * This may be called from a worker thread as long as the singleton
+     * was created in the main thread.
      **/
     static bool trash( const QString & path );
 
@@ -69,9 +73,11 @@ public:
     static Trash * instance();
 
     /**
-     * Return the device of file or directory 'path'.
+     * Return the device of file or directory 'path'. If 'path' is a
+     * symlink, this is the device of the symlink itself unless
+     * 'followSymLinks' is 'true'.
      **/
-    static dev_t device( const QString & path );
+    static dev_t device( const QString & path, bool followSymLinks = true );
 
 
 protected:
@@ -107,6 +113,7 @@ protected:
     dev_t		_homeDevice;
     TrashDir	      * _homeTrashDir;
     TrashDirMap		_trashDirs;
+    QMutex		_mutex;
 
 };	// class Trash
 
@@ -156,32 +163,69 @@ public:
     QString infoPath() const { return _path + "/info"; }
 
     /**
-     * Create a name that is unique within this trash directory.
-     * If no file or directory with 'name' exists yet in Trash/files or
-     * Trash/info, append a number.
+     * Create a .trashinfo file for a file or directory 'path' with a name
+     * that is unique within this trash directory and return that name:
+     * The name of 'path', with a number appended if that one is taken.
+     *
+     * Creating the .trashinfo file reserves the name (as the XDG trash
+     * spec requires), so another program that trashes a file with the
+     * same name at the same time gets a different one.
+     *
+     * This might throw a FileException.
      **/
-    QString uniqueName( const QString & name );
+    QString createTrashInfo( const QString & path );
 
     /**
-     * Create a .trashinfo file for a file or directory 'path' that will be
-     * named 'targetName' (the unique name) in the trash dir.
-     *
-     * This might throw a FileException.
+     * Remove the .trashinfo file for 'targetName' again, e.g. if moving
+     * the file failed.
      **/
-    void createTrashInfo( const QString & path, const QString & targetName );
+    void removeTrashInfo( const QString & targetName );
 
     /**
      * Move a file or directory 'path' to to targetName in the trash dir's
      * /files subdirectory. If both are on different devices, copy the file and
      * then delete the original.
      *
+     * This never replaces anything: Return 'false' if the target already
+     * exists.
+     *
      * This might throw a FileException.
      **/
-    void move( const QString & path, const QString & targetName );
+    bool move( const QString & path, const QString & targetName );
 
 
 protected:
 
+    /**
+     * Rename 'source' to 'target' unless 'target' exists. Return 0 on
+     * success and -1 with errno set otherwise (EEXIST if 'target'
+     * exists).
+     **/
+    static int renameNoReplace( const QByteArray & source, const QByteArray & target );
+
+    /**
+     * Copy 'source' to 'target' with everything below it, keeping the
+     * permissions and the modification times. 'target' must not exist yet.
+     * If 'created' is non-null, it is set to 'true' as soon as 'target'
+     * was created.
+     *
+     * This might throw a FileException.
+     **/
+    static void copyRecursive( const QByteArray & source,
+			       const QByteArray & target,
+			       bool *		  created = 0 );
+
+    /**
+     * Copy the contents of the plain file 'source' to the new file 'target'.
+     * If 'created' is non-null, it is set to 'true' as soon as 'target'
+     * was created.
+     *
+     * This might throw a FileException.
+     **/
+    static void copyFile( const QByteArray & source,
+			  const QByteArray & target,
+			  bool *	     created = 0 );
+
     /**
      * Create a directory if it doesn't exist. This throws an exception if
      * 'doThrow' is 'true'.
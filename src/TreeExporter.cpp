@@ -0,0 +1,331 @@
+/*
+ *   File name: TreeExporter.cpp
+ *   Summary:	Export of a DirTree or a cache file to CSV or JSON lines
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <sys/stat.h>
+#include <string.h>	// strlen()
+
+#include "TreeExporter.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "BinaryCache.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+#define CSV_HEADER	"type,path,size,allocated,mtime,links\n"
+#define STD_BLOCK_SIZE	512LL	// The unit of FileInfo::blocks()
+
+
+using namespace QDirStat;
+
+
+namespace
+{
+    /**
+     * Cache reader that doesn't build a tree: It hands each record to the
+     * TreeExporter right away.
+     **/
+    class ExportCacheReader: public CacheReader
+    {
+    public:
+
+	ExportCacheReader( const QString & cacheFileName, TreeExporter * exporter ):
+	    CacheReader( cacheFileName, 0, 0 ),
+	    _exporter( exporter )
+	    {}
+
+    protected:
+
+	/**
+	 * Export 'record' instead of adding it to a tree.
+	 *
+	 * Reimplemented from CacheReader.
+	 **/
+	virtual void addItem( const CacheRecord & record ) Q_DECL_OVERRIDE
+	{
+	    if ( record.syntaxError )
+		return;
+
+	    // One UTF-8 conversion for each directory, one for each name
+
+	    if ( record.isDir )
+		_dirPath = buildPath( record.path, record.name ).toUtf8();
+	    else if ( record.absolutePath )
+		_dirPath = record.path.toUtf8();
+
+	    QByteArray name;
+
+	    if ( ! record.isDir )
+		name = record.name.toUtf8();
+
+	    FileSize blocks = record.blocks;
+
+	    if ( blocks < 0 )
+		blocks = ( record.size + STD_BLOCK_SIZE - 1 ) / STD_BLOCK_SIZE;
+
+	    _exporter->writeRow( record.mode,
+				 _dirPath.constData(), _dirPath.size(),
+				 record.isDir ? 0 : name.constData(), name.size(),
+				 record.size, blocks, record.mtime, record.links );
+	}
+
+
+	TreeExporter *	_exporter;
+	QByteArray	_dirPath;
+    };
+
+}	// namespace
+
+
+
+
+TreeExporter::TreeExporter( Format format ):
+    CacheWriter(),
+    _format( format ),
+    _pathDir( 0 )
+{
+    // NOP
+}
+
+
+TreeExporter::Format TreeExporter::formatForName( const QString & fileName, bool & ok )
+{
+    QString name = fileName;
+
+    if ( name.endsWith( ".gz" ) )
+	name.chop( 3 );
+    else if ( name.endsWith( ZSTD_CACHE_SUFFIX ) )
+	name.chop( strlen( ZSTD_CACHE_SUFFIX ) );
+
+    ok = true;
+
+    if ( name.endsWith( ".csv" ) )
+	return CsvFormat;
+
+    if ( name.endsWith( ".jsonl" ) || name.endsWith( ".ndjson" ) )
+	return JsonLinesFormat;
+
+    ok = false;
+
+    return CsvFormat;
+}
+
+
+bool TreeExporter::openExport( const QString & fileName )
+{
+    _compression = fileName.endsWith( ".gz" ) ? GzipCompression : NoCompression;
+    _pathDir  = 0;
+    _dirPath.clear();
+
+    return open( fileName, true, false );
+}
+
+
+bool TreeExporter::exportTree( const QString & fileName, DirTree * tree )
+{
+    if ( ! tree || ! tree->root() )
+	return false;
+
+    if ( ! openExport( fileName ) )
+	return false;
+
+    tree->thaw();
+
+    for ( FileInfo * toplevel = tree->firstToplevel(); toplevel; toplevel = toplevel->next() )
+	writeTree( toplevel );
+
+    if ( ! close() )
+    {
+	logError() << "Error writing " << fileName << endl;
+	return false;
+    }
+
+    return true;
+}
+
+
+bool TreeExporter::exportCache( const QString & fileName, const QString & cacheFileName )
+{
+    if ( BinaryCacheReader::isBinaryCache( cacheFileName ) )
+    {
+	logError() << "Can't export binary cache file " << cacheFileName << endl;
+	return false;
+    }
+
+    ExportCacheReader reader( cacheFileName, this );
+
+    if ( ! reader.ok() || ! openExport( fileName ) )
+	return false;
+
+    while ( reader.read( 0 ) )
+    {
+	// Read everything
+    }
+
+    bool ok = close() && reader.ok();
+
+    if ( ! ok )
+	logError() << "Error exporting " << cacheFileName << " to " << fileName << endl;
+
+    return ok;
+}
+
+
+void TreeExporter::writeHeader()
+{
+    if ( _format == CsvFormat )
+	append( CSV_HEADER );
+}
+
+
+void TreeExporter::writeItem( FileInfo * item )
+{
+    if ( ! item )
+	return;
+
+    if ( item->isDirInfo() && ! item->isDotEntry() )
+    {
+	_pathDir = item->toDirInfo();
+	_dirPath = item->url().toUtf8();
+
+	writeRow( item->mode(), _dirPath.constData(), _dirPath.size(), 0, 0,
+		  item->size(), item->blocks(), item->mtime(), item->links() );
+
+	return;
+    }
+
+    // Files are written right after their directory, but not when there is
+    // no dot entry: Then they come between the subdirectories.
+
+    DirInfo * dir = item->parent();
+
+    if ( dir && dir->isDotEntry() )
+	dir = dir->parent();
+
+    if ( dir != _pathDir )
+    {
+	_pathDir = dir;
+	_dirPath = dir ? dir->url().toUtf8() : QByteArray();
+    }
+
+    int len;
+    const char * name = item->compactName().utf8( &len );
+
+    writeRow( item->mode(), _dirPath.constData(), _dirPath.size(), name, len,
+	      item->size(), item->blocks(), item->mtime(), item->links() );
+}
+
+
+void TreeExporter::writeRow( mode_t	  mode,
+			     const char * dirPath,
+			     int	  dirPathLen,
+			     const char * name,
+			     int	  nameLen,
+			     FileSize	  size,
+			     FileSize	  blocks,
+			     time_t	  mtime,
+			     int	  links )
+{
+    if ( ! _compressor )
+	return;
+
+    if ( _format == CsvFormat )
+    {
+	append( fileType( mode ) );
+	_buffer.append( ',' );
+	appendPath( dirPath, dirPathLen, name, nameLen );
+	_buffer.append( ',' );
+	appendNumber( size );
+	_buffer.append( ',' );
+	appendNumber( blocks * STD_BLOCK_SIZE );
+	_buffer.append( ',' );
+	appendNumber( mtime );
+	_buffer.append( ',' );
+	appendNumber( links );
+	_buffer.append( '\n' );
+    }
+    else
+    {
+	append( "{\"type\":\"" );
+	append( fileType( mode ) );
+	append( "\",\"path\":" );
+	appendPath( dirPath, dirPathLen, name, nameLen );
+	append( ",\"size\":" );
+	appendNumber( size );
+	append( ",\"allocated\":" );
+	appendNumber( blocks * STD_BLOCK_SIZE );
+	append( ",\"mtime\":" );
+	appendNumber( mtime );
+	append( ",\"links\":" );
+	appendNumber( links );
+	append( "}\n" );
+    }
+
+    flush();
+}
+
+
+void TreeExporter::appendPath( const char * dirPath, int dirPathLen,
+			       const char * name,    int nameLen )
+{
+    // Both CSV and JSON always quote the path
+
+    _buffer.append( '"' );
+    appendEscaped( dirPath, dirPathLen );
+
+    if ( name )
+    {
+	if ( dirPathLen > 0 && dirPath[ dirPathLen - 1 ] != '/' )
+	    _buffer.append( '/' );
+
+	appendEscaped( name, nameLen );
+    }
+
+    _buffer.append( '"' );
+}
+
+
+void TreeExporter::appendEscaped( const char * str, int len )
+{
+    static const char hexDigits[] = "0123456789abcdef";
+
+    for ( int i=0; i < len; ++i )
+    {
+	char c = str[i];
+
+	if ( _format == CsvFormat )
+	{
+	    // RFC 4180: A quote within a quoted field is doubled
+
+	    if ( c == '"' )
+		_buffer.append( '"' );
+
+	    _buffer.append( c );
+	}
+	else
+	{
+	    // UTF-8 can stay as it is in JSON; only quotes, backslashes and
+	    // control characters need to be escaped.
+
+	    if ( c == '"' || c == '\\' )
+	    {
+		_buffer.append( '\\' );
+		_buffer.append( c );
+	    }
+	    else if ( (unsigned char) c < 0x20 )
+	    {
+		_buffer.append( "\\u00" );
+		_buffer.append( hexDigits[ ( c >> 4 ) & 0xf ] );
+		_buffer.append( hexDigits[ c & 0xf ] );
+	    }
+	    else
+		_buffer.append( c );
+	}
+    }
+}
@@ -0,0 +1,130 @@
+/*
+ *   File name: TreeExporter.h
+ *   Summary:	Export of a DirTree or a cache file to CSV or JSON lines
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef TreeExporter_h
+#define TreeExporter_h
+
+
+#include "DirTreeCache.h"
+
+
+namespace QDirStat
+{
+    /**
+     * Writer for the items of a tree in formats that other tools can read
+     * directly: CSV with a header line or newline-delimited JSON with one
+     * object per line. Each line has the type, the complete path, the
+     * size, the allocated size, the mtime and the number of links of one
+     * item.
+     *
+     * This uses the traversal, the output buffer and the compressor thread
+     * of the CacheWriter: The fields are appended to the buffer directly
+     * from the UTF-8 names of the nodes without creating a QString for
+     * them, and writing (and, for a name ending with ".gz" or ".zst",
+     * compressing) is done in a separate thread. "-" means stdout.
+     *
+     * A cache file can be exported without reading it into a DirTree:
+     * Its records are converted one by one as they are parsed.
+     **/
+    class TreeExporter: public CacheWriter
+    {
+    public:
+
+	enum Format
+	{
+	    CsvFormat,
+	    JsonLinesFormat
+	};
+
+	/**
+	 * Constructor.
+	 **/
+	TreeExporter( Format format );
+
+	/**
+	 * Write all of 'tree' to 'fileName'. Returns 'true' if OK, 'false'
+	 * upon error.
+	 **/
+	bool exportTree( const QString & fileName, DirTree * tree );
+
+	/**
+	 * Convert text cache file 'cacheFileName' to 'fileName'. Returns
+	 * 'true' if OK, 'false' upon error.
+	 **/
+	bool exportCache( const QString & fileName, const QString & cacheFileName );
+
+	/**
+	 * Return the format for the suffix of 'fileName' (".csv",
+	 * ".jsonl", ".ndjson", optionally followed by ".gz" or ".zst").
+	 * 'ok' is set to 'false' if it is none of those.
+	 **/
+	static Format formatForName( const QString & fileName, bool & ok );
+
+	/**
+	 * Write one item: 'dirPath' is the UTF-8 path of the directory that
+	 * the item is in (or its complete path for a directory, then 'name'
+	 * is 0). 'blocks' is the number of 512-byte blocks or -1 if unknown.
+	 **/
+	void writeRow( mode_t	     mode,
+		       const char *  dirPath,
+		       int	     dirPathLen,
+		       const char *  name,
+		       int	     nameLen,
+		       FileSize	     size,
+		       FileSize	     blocks,
+		       time_t	     mtime,
+		       int	     links );
+
+
+    protected:
+
+	/**
+	 * Write 'item' as one line.
+	 *
+	 * Reimplemented from CacheWriter.
+	 **/
+	virtual void writeItem( FileInfo * item ) Q_DECL_OVERRIDE;
+
+	/**
+	 * Write the CSV header line (nothing for JSON lines).
+	 *
+	 * Reimplemented from CacheWriter.
+	 **/
+	virtual void writeHeader() Q_DECL_OVERRIDE;
+
+	/**
+	 * Open 'fileName' for this format.
+	 **/
+	bool openExport( const QString & fileName );
+
+	/**
+	 * Append the path 'dirPath' / 'name' as a CSV field or a JSON
+	 * string.
+	 **/
+	void appendPath( const char * dirPath, int dirPathLen,
+			 const char * name,    int nameLen );
+
+	/**
+	 * Append 'len' bytes of 'str' escaped for the current format.
+	 **/
+	void appendEscaped( const char * str, int len );
+
+
+	// Data members
+
+	Format		_format;
+	DirInfo *	_pathDir;	// The directory that _dirPath belongs to
+	QByteArray	_dirPath;
+
+    };	// class TreeExporter
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef TreeExporter_h
@@ -0,0 +1,197 @@
+/*
+ *   File name: TreeSnapshot.cpp
+ *   Summary:	Read-only copy of a subtree for other threads
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QElapsedTimer>
+
+#include "TreeSnapshot.h"
+#include "DirTree.h"
+#include "DirInfo.h"
+#include "FileInfoIterator.h"
+#include "Logger.h"
+#include "Exception.h"
+
+
+using namespace QDirStat;
+
+
+const char * SnapshotDir::utf8Name( int index, int * len ) const
+{
+    const SnapshotNode & node = _nodes.at( index );
+    *len = node.nameLen;
+
+    return _names.constData() + node.nameOffset;
+}
+
+
+QString SnapshotDir::name( int index ) const
+{
+    int len;
+    const char * name = utf8Name( index, &len );
+
+    return QString::fromUtf8( name, len );
+}
+
+
+
+
+TreeSnapshot::TreeSnapshot( DirTree * tree, FileInfo * subtree ):
+    _tree( tree ),
+    _subtree( subtree ),
+    _generation( 0 ),
+    _stale( 0 )
+{
+    CHECK_PTR( _tree );
+
+    if ( ! _subtree )
+	_subtree = _tree->firstToplevel();
+
+    _generation = _tree->generation();
+    _tree->addSnapshot( this );
+
+    if ( ! _subtree )
+	return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    _tree->thaw( _subtree );
+    _url = _subtree->url();
+
+    _top = new SnapshotDir();
+    CHECK_NEW( _top.data() );
+    addNode( _top.data(), _subtree );
+
+    logDebug() << "Snapshot of " << size() << " items of " << _url
+	       << " in " << timer.elapsed() << " ms" << endl;
+}
+
+
+TreeSnapshot::~TreeSnapshot()
+{
+    if ( _tree )
+	_tree->removeSnapshot( this );
+}
+
+
+SnapshotDir * TreeSnapshot::children( DirInfo * dir )
+{
+    // Still valid: Anything that changes in the subtree of 'dir' drops it
+    // (see DirTree::treeChanged())
+
+    if ( dir->snapshotDir() )
+	return dir->snapshotDir();
+
+    SnapshotDir * children = new SnapshotDir();
+    CHECK_NEW( children );
+
+    FileInfoIterator it( dir );
+
+    while ( *it )
+    {
+	addNode( children, *it );
+	++it;
+    }
+
+    children->_nodes.squeeze();
+    dir->setSnapshotDir( children );
+
+    return children;
+}
+
+
+void TreeSnapshot::addNode( SnapshotDir * dir, FileInfo * item )
+{
+    SnapshotNode node;
+    int len;
+    const char * name = item->compactName().utf8( &len );
+
+    node.item	       = item;
+    node.nameOffset    = dir->_names.size();
+    node.nameLen       = len;
+    node.mode	       = item->mode();
+    node.size	       = item->size();
+    node.blocks	       = item->blocks();
+    node.countedBlocks = item->countedBlocks();
+    node.mtime	       = item->mtime();
+    node.uid	       = item->uid();
+    node.gid	       = item->gid();
+    node.links	       = item->links();
+    node.totalSize     = item->totalSize();
+    node.totalItems    = item->totalItems();
+    node.latestMtime   = item->latestMtime();
+    node.readState     = item->readState();
+    node.isDirInfo     = item->isDirInfo();
+    node.isDotEntry    = item->isDotEntry();
+    node.isExcluded    = item->isExcluded();
+    node.isMountPoint  = item->isMountPoint();
+    node.isSparseFile  = item->isSparseFile();
+
+    if ( item->isDirInfo() )
+	node.children = children( item->toDirInfo() );
+
+    dir->_names.append( name, len );
+    dir->_nodes << node;
+}
+
+
+QByteArray TreeSnapshot::childUrl( const QByteArray  & parentUrl,
+				   const SnapshotDir * dir,
+				   int		       index )
+{
+    if ( dir->node( index ).isDotEntry )	// don't append "/." for dot entries
+	return parentUrl;
+
+    int len;
+    const char * name = dir->utf8Name( index, &len );
+    QByteArray url = parentUrl;
+
+    if ( ! url.endsWith( '/' ) && ! ( len > 0 && name[0] == '/' ) )
+	url += '/';
+
+    url.append( name, len );
+
+    return url;
+}
+
+
+bool TreeSnapshot::isStale() const
+{
+#if (QT_VERSION < QT_VERSION_CHECK( 5, 0, 0 ))
+    return (int) _stale != 0;
+#else
+    return _stale.load() != 0;
+#endif
+}
+
+
+void TreeSnapshot::setStale()
+{
+    _stale.fetchAndStoreOrdered( 1 );
+}
+
+
+bool TreeSnapshot::affectedBy( FileInfo * item ) const
+{
+    if ( ! item || ! _subtree )
+	return false;
+
+    // Only the main thread ever calls this, so it may follow the parent
+    // pointers: Something was added or deleted somewhere in the subtree,
+    // or an ancestor of it is deleted.
+
+    return item->isInSubtree( _subtree ) || _subtree->isInSubtree( item );
+}
+
+
+void TreeSnapshot::detach()
+{
+    setStale();
+    _tree    = 0;
+    _subtree = 0;
+}
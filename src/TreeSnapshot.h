@@ -0,0 +1,251 @@
+/*
+ *   File name: TreeSnapshot.h
+ *   Summary:	Read-only copy of a subtree for other threads
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef TreeSnapshot_h
+#define TreeSnapshot_h
+
+
+#include <sys/types.h>
+
+#include <QVector>
+#include <QString>
+#include <QByteArray>
+#include <QAtomicInt>
+#include <QSharedData>
+
+#include "FileInfo.h"	// FileSize, DirReadState
+
+
+namespace QDirStat
+{
+    class DirTree;
+    class DirInfo;
+    class SnapshotDir;
+
+    typedef QExplicitlySharedDataPointer<SnapshotDir> SnapshotDirPtr;
+
+
+    /**
+     * One item of a TreeSnapshot.
+     **/
+    struct SnapshotNode
+    {
+	FileInfo *	item;		// Only for the main thread; see below
+	SnapshotDirPtr	children;	// 0 if this is not a DirInfo
+	int		nameOffset;	// In the names of the SnapshotDir
+	int		nameLen;
+	mode_t		mode;
+	FileSize	size;		// As FileInfo::size() returns it
+	FileSize	blocks;		// As FileInfo::blocks() returns it
+	FileSize	countedBlocks;	// As FileInfo::countedBlocks() returns it
+	time_t		mtime;
+	uid_t		uid;
+	gid_t		gid;
+	nlink_t		links;
+	FileSize	totalSize;
+	int		totalItems;
+	time_t		latestMtime;
+	DirReadState	readState;
+	bool		isDirInfo;
+	bool		isDotEntry;
+	bool		isExcluded;
+	bool		isMountPoint;
+	bool		isSparseFile;
+    };
+
+
+    /**
+     * The children of one directory in a TreeSnapshot (including its dot
+     * entry) with the UTF-8 names of all of them in one buffer.
+     *
+     * This never changes once it is created, and it is shared: Between
+     * all snapshots that contain that directory, and with the directory
+     * itself that keeps it until anything in its subtree changes (see
+     * DirInfo::snapshotDir()). So taking a snapshot only has to copy the
+     * directories that changed since the last one and their ancestors.
+     * The reference count is atomic, so other threads may hold on to it
+     * as long as they like.
+     **/
+    class SnapshotDir: public QSharedData
+    {
+    public:
+
+	/**
+	 * Return the number of children.
+	 **/
+	int size() const { return _nodes.size(); }
+
+	/**
+	 * Return child no. 'index'.
+	 **/
+	const SnapshotNode & node( int index ) const { return _nodes.at( index ); }
+
+	/**
+	 * Return the UTF-8 bytes of the name of child no. 'index' and its
+	 * length in 'len'. The bytes are not null-terminated.
+	 **/
+	const char * utf8Name( int index, int * len ) const;
+
+	/**
+	 * Return the name of child no. 'index'.
+	 **/
+	QString name( int index ) const;
+
+    protected:
+
+	friend class TreeSnapshot;
+
+	QVector<SnapshotNode>	_nodes;
+	QByteArray		_names;
+    };
+
+
+    /**
+     * Read-only copy of a subtree of a DirTree that other threads can walk
+     * at their own pace while the tree itself goes on changing in the main
+     * thread: Reading, refreshing and cleanups add and delete nodes at any
+     * time, so nothing but the main thread may ever touch the FileInfo
+     * nodes of a tree.
+     *
+     * Taking a snapshot copies the fields of each item into a SnapshotDir
+     * for its parent directory. Those are cached in the directories and
+     * dropped for a directory and all its ancestors when anything in it
+     * changes (see DirTree::treeChanged()), so a snapshot only copies
+     * what changed since the last one; the rest is shared. After that,
+     * the snapshot never changes.
+     *
+     * The tree keeps track of its snapshots: As soon as anything in the
+     * subtree of a snapshot changes, the snapshot is marked as stale, and
+     * the tree sends a snapshotStale() signal. A worker thread can check
+     * isStale() from time to time to give up early if an outdated result
+     * is useless. The SnapshotNode::item pointers may only be followed in
+     * the main thread and only as long as the snapshot is not stale.
+     *
+     * Snapshots have to be created and deleted in the main thread; only
+     * the const methods may be used in other threads.
+     **/
+    class TreeSnapshot
+    {
+    public:
+
+	/**
+	 * Constructor: Take a snapshot of 'subtree' of 'tree'. 0 means the
+	 * complete tree. This restores any cold directories in the subtree
+	 * first (see DirTree::thaw()).
+	 **/
+	TreeSnapshot( DirTree * tree, FileInfo * subtree = 0 );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~TreeSnapshot();
+
+	/**
+	 * Return 'true' if there is nothing in this snapshot.
+	 **/
+	bool isEmpty() const { return ! _top; }
+
+	/**
+	 * Return the top of the snapshot: The node of the subtree itself is
+	 * node 0 of it; its children are below that. This is 0 if the
+	 * snapshot is empty.
+	 **/
+	const SnapshotDir * top() const { return _top.data(); }
+
+	/**
+	 * Return the number of items in the snapshot.
+	 **/
+	int size() const { return _top ? _top->node( 0 ).totalItems + 1 : 0; }
+
+	/**
+	 * Return the URL of the subtree at the time of the snapshot.
+	 **/
+	const QString & url() const { return _url; }
+
+	/**
+	 * Return the URL of child no. 'index' of 'dir' whose own URL is
+	 * 'parentUrl' (both in UTF-8). This is the same as FileInfo::url()
+	 * of that child. The dot entries don't add to the URL.
+	 **/
+	static QByteArray childUrl( const QByteArray  & parentUrl,
+				    const SnapshotDir * dir,
+				    int			index );
+
+	/**
+	 * Return the generation of the tree (see DirTree::generation()) when
+	 * this snapshot was taken.
+	 **/
+	quint64 generation() const { return _generation; }
+
+	/**
+	 * Return 'true' if the subtree has changed since the snapshot was
+	 * taken. This may be called in any thread.
+	 **/
+	bool isStale() const;
+
+	/**
+	 * Return the subtree or 0 if the snapshot is stale. Only use this in
+	 * the main thread.
+	 **/
+	FileInfo * subtree() const { return isStale() ? 0 : _subtree; }
+
+	/**
+	 * Mark this snapshot as stale. This is called by the tree.
+	 **/
+	void setStale();
+
+	/**
+	 * Return 'true' if the item 'item' of the tree is in the subtree of
+	 * this snapshot or if the subtree is in the subtree of 'item'. This
+	 * is called by the tree in the main thread.
+	 **/
+	bool affectedBy( FileInfo * item ) const;
+
+	/**
+	 * Forget about the tree because it is deleted. This is called by the
+	 * tree.
+	 **/
+	void detach();
+
+    protected:
+
+	/**
+	 * Return the SnapshotDir with the children of 'dir': The one it has
+	 * cached if it is still valid, or a new one. This recurses into
+	 * the subdirectories.
+	 **/
+	static SnapshotDir * children( DirInfo * dir );
+
+	/**
+	 * Copy the fields of 'item' into a new node of 'dir'.
+	 **/
+	static void addNode( SnapshotDir * dir, FileInfo * item );
+
+
+	// Data members
+
+	DirTree *		_tree;
+	FileInfo *		_subtree;
+	QString			_url;
+	SnapshotDirPtr		_top;
+	quint64			_generation;
+	QAtomicInt		_stale;
+
+    private:
+
+	// Disable copying: The tree has a pointer to each snapshot
+
+	TreeSnapshot( const TreeSnapshot & );
+	TreeSnapshot & operator=( const TreeSnapshot & );
+    };
+
+}	// namespace QDirStat
+
+
+#endif	// ifndef TreeSnapshot_h
@@ -0,0 +1,259 @@
+/*
+ *   File name: TreemapGLRenderer.cpp
+ *   Summary:	OpenGL rendering of the flat treemap for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include "TreemapGLRenderer.h"
+
+#ifdef HAVE_TREEMAP_GL
+
+#include <QOpenGLContext>
+
+#include "Logger.h"
+
+using namespace QDirStat;
+
+
+// Each tile is a triangle strip over the corners of a unit square that the
+// vertex shader moves to the tile's rectangle.
+
+static const char * vertexShaderSource =
+    "layout( location = 0 ) in vec2 corner;\n"
+    "layout( location = 1 ) in vec4 rect;\n"
+    "layout( location = 2 ) in vec4 surface;\n"
+    "layout( location = 3 ) in vec4 color;\n"
+    "\n"
+    "uniform vec4 viewRect;\n"
+    "\n"
+    "out vec2 pos;\n"
+    "flat out vec4 tileRect;\n"
+    "flat out vec4 tileSurface;\n"
+    "flat out vec4 tileColor;\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "    pos         = rect.xy + corner * rect.zw;\n"
+    "    tileRect    = rect;\n"
+    "    tileSurface = surface;\n"
+    "    tileColor   = color;\n"
+    "\n"
+    "    vec2 ndc = ( pos - viewRect.xy ) / viewRect.zw * 2.0 - 1.0;\n"
+    "    gl_Position = vec4( ndc.x, -ndc.y, 0.0, 1.0 );\n"
+    "}\n";
+
+
+// The same as CushionKernel: The normal of the cushion surface at the
+// pixel and the cosine of the angle to the light source.
+
+static const char * fragmentShaderSource =
+    "in vec2 pos;\n"
+    "flat in vec4 tileRect;\n"
+    "flat in vec4 tileSurface;\n"
+    "flat in vec4 tileColor;\n"
+    "\n"
+    "uniform vec3  light;\n"
+    "uniform float ambientLight;\n"
+    "uniform vec4  gridColor;\n"
+    "\n"
+    "out vec4 fragColor;\n"
+    "\n"
+    "void main()\n"
+    "{\n"
+    "    if ( tileColor.a == 0.0 )\n"
+    "    {\n"
+    "        fragColor = vec4( tileColor.rgb / 255.0, 1.0 );\n"
+    "        return;\n"
+    "    }\n"
+    "\n"
+    "    vec2 p = floor( pos ); // The CPU uses the pixel's top left corner\n"
+    "\n"
+    "    if ( gridColor.a > 0.0 &&\n"
+    "         ( ( p.x == tileRect.x && tileRect.x > 0.0 ) ||\n"
+    "           ( p.y == tileRect.y && tileRect.y > 0.0 ) ) )\n"
+    "    {\n"
+    "        fragColor = gridColor;\n"
+    "        return;\n"
+    "    }\n"
+    "\n"
+    "    float nx   = 2.0 * tileSurface.x * p.x + tileSurface.y;\n"
+    "    float ny   = 2.0 * tileSurface.z * p.y + tileSurface.w;\n"
+    "    float cosa = ( nx * light.x + ny * light.y + light.z ) / sqrt( nx * nx + ny * ny + 1.0 );\n"
+    "\n"
+    "    vec3 rgb = ambientLight + floor( max( tileColor.rgb * cosa + 0.5, 0.0 ) );\n"
+    "    fragColor = vec4( rgb / 255.0, 1.0 );\n"
+    "}\n";
+
+
+
+TreemapGLRenderer::TreemapGLRenderer():
+    _initialized( false ),
+    _cornerBuffer( QOpenGLBuffer::VertexBuffer ),
+    _instanceBuffer( QOpenGLBuffer::VertexBuffer ),
+    _instanceCount( 0 ),
+    _uploadPending( false ),
+    _ambientLight( 0.0 ),
+    _lightX( 0.0 ),
+    _lightY( 0.0 ),
+    _lightZ( 1.0 )
+{
+
+}
+
+
+TreemapGLRenderer::~TreemapGLRenderer()
+{
+    _vao.destroy();
+    _cornerBuffer.destroy();
+    _instanceBuffer.destroy();
+}
+
+
+bool TreemapGLRenderer::initialize()
+{
+    QOpenGLContext * context = QOpenGLContext::currentContext();
+
+    if ( ! context )
+	return false;
+
+    initializeOpenGLFunctions();
+
+    QSurfaceFormat format = context->format();
+    QByteArray header;
+
+    if ( context->isOpenGLES() )
+    {
+	if ( format.majorVersion() < 3 )
+	{
+	    logWarning() << "Need OpenGL ES 3.0, have " << format.majorVersion()
+			 << "." << format.minorVersion() << endl;
+	    return false;
+	}
+
+	header = "#version 300 es\nprecision highp float;\n";
+    }
+    else
+    {
+	if ( format.version() < qMakePair( 3, 3 ) )
+	{
+	    logWarning() << "Need OpenGL 3.3, have " << format.majorVersion()
+			 << "." << format.minorVersion() << endl;
+	    return false;
+	}
+
+	header = "#version 330 core\n";
+    }
+
+    if ( ! _program.addShaderFromSourceCode( QOpenGLShader::Vertex,   header + vertexShaderSource   ) ||
+	 ! _program.addShaderFromSourceCode( QOpenGLShader::Fragment, header + fragmentShaderSource ) ||
+	 ! _program.link() )
+    {
+	logError() << "Can't build the treemap shaders: " << _program.log() << endl;
+	return false;
+    }
+
+    if ( ! _vao.create() )
+	return false;
+
+    _vao.bind();
+
+    const GLfloat corners[] = { 0.0, 0.0,  1.0, 0.0,  0.0, 1.0,	 1.0, 1.0 };
+
+    _cornerBuffer.create();
+    _cornerBuffer.bind();
+    _cornerBuffer.allocate( corners, sizeof( corners ) );
+
+    glEnableVertexAttribArray( 0 );
+    glVertexAttribPointer( 0, 2, GL_FLOAT, GL_FALSE, 0, 0 );
+
+    _instanceBuffer.create();
+    _instanceBuffer.setUsagePattern( QOpenGLBuffer::DynamicDraw );
+    _instanceBuffer.bind();
+
+    const GLsizei stride = sizeof( TreemapGLInstance );
+
+    for ( int i=0; i < 3; ++i )
+    {
+	GLuint attrib = i + 1;
+	glEnableVertexAttribArray( attrib );
+	glVertexAttribPointer( attrib, 4, GL_FLOAT, GL_FALSE, stride,
+			       reinterpret_cast<const void *>( i * 4 * sizeof( float ) ) );
+	glVertexAttribDivisor( attrib, 1 );	// Once per tile
+    }
+
+    _vao.release();
+    _instanceBuffer.release();
+
+    _initialized = true;
+    logInfo() << "Using OpenGL " << format.majorVersion() << "." << format.minorVersion()
+	      << ( context->isOpenGLES() ? " ES" : "" ) << " for the treemap" << endl;
+
+    return true;
+}
+
+
+void TreemapGLRenderer::setInstances( const QVector<TreemapGLInstance> & instances )
+{
+    _pendingInstances = instances;
+    _uploadPending    = true;
+}
+
+
+void TreemapGLRenderer::setLight( int ambientLight, double lightX, double lightY, double lightZ )
+{
+    _ambientLight = ambientLight;
+    _lightX	  = lightX;
+    _lightY	  = lightY;
+    _lightZ	  = lightZ;
+}
+
+
+void TreemapGLRenderer::paint( const QRectF & viewRect, const QColor & background )
+{
+    if ( ! _initialized )
+	return;
+
+    if ( _uploadPending )
+    {
+	_instanceBuffer.bind();
+	_instanceBuffer.allocate( _pendingInstances.constData(),
+				  _pendingInstances.size() * sizeof( TreemapGLInstance ) );
+	_instanceBuffer.release();
+
+	_instanceCount	  = _pendingInstances.size();
+	_pendingInstances = QVector<TreemapGLInstance>();	// Free the memory
+	_uploadPending	  = false;
+    }
+
+    glClearColor( background.redF(), background.greenF(), background.blueF(), 1.0 );
+    glClear( GL_COLOR_BUFFER_BIT );
+
+    if ( _instanceCount == 0 || viewRect.isEmpty() )
+	return;
+
+    // The tiles are opaque and drawn in the right order
+
+    glDisable( GL_DEPTH_TEST );
+    glDisable( GL_BLEND );
+
+    QColor grid = _gridColor.isValid() ? _gridColor : QColor( 0, 0, 0, 0 );
+
+    _program.bind();
+    _program.setUniformValue( "viewRect",
+			      (GLfloat) viewRect.x(),	  (GLfloat) viewRect.y(),
+			      (GLfloat) viewRect.width(), (GLfloat) viewRect.height() );
+    _program.setUniformValue( "light", _lightX, _lightY, _lightZ );
+    _program.setUniformValue( "ambientLight", _ambientLight );
+    _program.setUniformValue( "gridColor", grid );
+
+    _vao.bind();
+    glDrawArraysInstanced( GL_TRIANGLE_STRIP, 0, 4, _instanceCount );
+    _vao.release();
+
+    _program.release();
+}
+
+#endif	// HAVE_TREEMAP_GL
@@ -0,0 +1,131 @@
+/*
+ *   File name: TreemapGLRenderer.h
+ *   Summary:	OpenGL rendering of the flat treemap for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef TreemapGLRenderer_h
+#define TreemapGLRenderer_h
+
+
+#ifdef HAVE_TREEMAP_GL
+
+#include <QVector>
+#include <QRectF>
+#include <QColor>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLBuffer>
+#include <QOpenGLVertexArrayObject>
+
+
+namespace QDirStat
+{
+    /**
+     * One tile of the treemap as it is uploaded to the GPU.
+     **/
+    struct TreemapGLInstance
+    {
+	float rect[4];		// x, y, width, height in treemap coordinates
+	float surface[4];	// Cushion surface: xx2, xx1, yy2, yy1
+	float color[4];		// Red, green, blue (0..255); alpha 1 for a cushion
+				// (then this is the tile color minus the ambient
+				// light), 0 for a plain color
+    };
+
+
+    /**
+     * Renderer for the flat treemap with OpenGL.
+     *
+     * All tiles are uploaded as one instance buffer and drawn with one
+     * instanced draw call; the cushions are shaded in the fragment shader
+     * from the cushion surface coefficients, just like CushionKernel does
+     * on the CPU. So the CPU only has to prepare the instances once per
+     * layout, and redrawing (e.g. for highlighting) costs next to nothing.
+     *
+     * The TreemapView uses this from its drawBackground() with a
+     * QOpenGLWidget as its viewport. All methods except setInstances()
+     * and setLight() need the OpenGL context of that viewport to be current.
+     *
+     * This needs OpenGL 3.3 or OpenGL ES 3.0. If initialize() fails, the
+     * TreemapView falls back to rendering on the CPU.
+     **/
+    class TreemapGLRenderer: protected QOpenGLExtraFunctions
+    {
+    public:
+
+	/**
+	 * Constructor. This does not need an OpenGL context yet.
+	 **/
+	TreemapGLRenderer();
+
+	/**
+	 * Destructor. The OpenGL context has to be current.
+	 **/
+	~TreemapGLRenderer();
+
+	/**
+	 * Set up the shaders and buffers. Return 'true' on success,
+	 * 'false' if the OpenGL version is too old or anything else went
+	 * wrong.
+	 **/
+	bool initialize();
+
+	/**
+	 * Return 'true' if initialize() was successful.
+	 **/
+	bool isInitialized() const { return _initialized; }
+
+	/**
+	 * Set the tiles to draw. They are drawn in this order, so parents
+	 * have to come before their children. They are uploaded with the
+	 * next paint().
+	 **/
+	void setInstances( const QVector<TreemapGLInstance> & instances );
+
+	/**
+	 * Set the light source for the cushion shading.
+	 **/
+	void setLight( int ambientLight, double lightX, double lightY, double lightZ );
+
+	/**
+	 * Set the color for the cushion grid or an invalid color for none.
+	 **/
+	void setGridColor( const QColor & color ) { _gridColor = color; }
+
+	/**
+	 * Draw the treemap. 'viewRect' is the part of the treemap (in
+	 * treemap coordinates) that the complete viewport shows.
+	 * Everything not covered by any tile gets 'background'.
+	 **/
+	void paint( const QRectF & viewRect, const QColor & background );
+
+
+    protected:
+
+	bool				_initialized;
+	QOpenGLShaderProgram		_program;
+	QOpenGLVertexArrayObject	_vao;
+	QOpenGLBuffer			_cornerBuffer;
+	QOpenGLBuffer			_instanceBuffer;
+	int				_instanceCount;
+
+	QVector<TreemapGLInstance>	_pendingInstances;
+	bool				_uploadPending;
+
+	float				_ambientLight;
+	float				_lightX;
+	float				_lightY;
+	float				_lightZ;
+	QColor				_gridColor;
+
+    };	// class TreemapGLRenderer
+
+}	// namespace QDirStat
+
+#endif	// HAVE_TREEMAP_GL
+
+#endif	// ifndef TreemapGLRenderer_h
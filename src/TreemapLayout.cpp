@@ -0,0 +1,715 @@
+/*
+ *   File name: TreemapLayout.cpp
+ *   Summary:	Flat treemap layout for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#include <QMutexLocker>
+
+#include "TreemapLayout.h"
+#include "TreemapView.h"
+#include "Squarifier.h"
+#include "DirInfo.h"
+#include "Logger.h"
+
+// Width and height of one cell of the hit-testing grid in pixels
+#define GridCellSize	32
+
+using namespace QDirStat;
+
+
+TreemapLayout::TreemapLayout():
+    _root( 0 ),
+    _complete( false ),
+    _gridColumns( 0 ),
+    _gridRows( 0 )
+{
+
+}
+
+
+void TreemapLayout::clear()
+{
+    _root     = 0;
+    _complete = false;
+    _items.clear();
+    _cellStart.clear();
+    _cellItems.clear();
+    _gridColumns = 0;
+    _gridRows	 = 0;
+}
+
+
+void TreemapLayout::begin( FileInfo * root )
+{
+    clear();
+    _root = root;
+}
+
+
+void TreemapLayout::addItems( const TreemapLayoutItemList & items )
+{
+    _items += items;
+}
+
+
+void TreemapLayout::finish()
+{
+    _items.squeeze();
+    buildIndex();
+    _complete = true;
+
+    // logDebug() << _items.size() << " items" << endl;
+}
+
+
+void TreemapLayout::buildIndex()
+{
+    if ( _items.isEmpty() )
+	return;
+
+    QRect bounds = _items.first().rect;
+
+    if ( bounds.right() < 0 || bounds.bottom() < 0 )
+	return;
+
+    _gridColumns = bounds.right()  / GridCellSize + 1;
+    _gridRows	 = bounds.bottom() / GridCellSize + 1;
+    int cellCount = _gridColumns * _gridRows;
+
+
+    // First pass: Count the items of each cell
+
+    _cellStart.fill( 0, cellCount + 1 );
+
+    for ( int i=0; i < _items.size(); ++i )
+    {
+	QRect rect = _items.at( i ).rect.intersected( bounds );
+
+	if ( rect.isEmpty() )
+	    continue;
+
+	for ( int row = rect.top() / GridCellSize; row <= rect.bottom() / GridCellSize; ++row )
+	{
+	    for ( int col = rect.left() / GridCellSize; col <= rect.right() / GridCellSize; ++col )
+		++_cellStart[ row * _gridColumns + col + 1 ];
+	}
+    }
+
+    for ( int cell = 0; cell < cellCount; ++cell )
+	_cellStart[ cell + 1 ] += _cellStart[ cell ];
+
+
+    // Second pass: Fill in the items. This keeps them in ascending order
+    // within each cell, i.e. parents before children.
+
+    _cellItems.resize( _cellStart.last() );
+    QVector<int> fillPos = _cellStart;
+
+    for ( int i=0; i < _items.size(); ++i )
+    {
+	QRect rect = _items.at( i ).rect.intersected( bounds );
+
+	if ( rect.isEmpty() )
+	    continue;
+
+	for ( int row = rect.top() / GridCellSize; row <= rect.bottom() / GridCellSize; ++row )
+	{
+	    for ( int col = rect.left() / GridCellSize; col <= rect.right() / GridCellSize; ++col )
+		_cellItems[ fillPos[ row * _gridColumns + col ]++ ] = i;
+	}
+    }
+}
+
+
+int TreemapLayout::itemAt( const QPoint & pos ) const
+{
+    if ( pos.x() < 0 || pos.y() < 0 )
+	return -1;
+
+    int col = pos.x() / GridCellSize;
+    int row = pos.y() / GridCellSize;
+
+    if ( col >= _gridColumns || row >= _gridRows )
+	return -1;
+
+    int cell = row * _gridColumns + col;
+
+    // Sibling items don't overlap, so the last item that contains 'pos' is
+    // the innermost one.
+
+    for ( int i = _cellStart.at( cell + 1 ) - 1; i >= _cellStart.at( cell ); --i )
+    {
+	int index = _cellItems.at( i );
+
+	if ( _items.at( index ).rect.contains( pos ) )
+	    return _items.at( index ).summary ? _items.at( index ).parent : index;
+    }
+
+    return -1;
+}
+
+
+int TreemapLayout::indexOf( const TreemapLayoutItemList & items, const FileInfo * node )
+{
+    if ( ! node )
+	return -1;
+
+    for ( int i=0; i < items.size(); ++i )
+    {
+	if ( items.at( i ).orig == node && ! items.at( i ).summary )
+	    return i;
+    }
+
+    return -1;
+}
+
+
+TreemapLayoutItemList TreemapLayout::rescaled( const TreemapLayoutItemList & items,
+					       int			     subtree,
+					       const QRect		   & newRect )
+{
+    TreemapLayoutItemList result;
+
+    if ( subtree < 0 || subtree >= items.size() )
+	return result;
+
+    const QRect from = items.at( subtree ).rect;
+
+    if ( from.isEmpty() || newRect.isEmpty() )
+	return result;
+
+    double scaleX  = newRect.width()  / (double) from.width();
+    double scaleY  = newRect.height() / (double) from.height();
+    double offsetX = from.x() - newRect.x() / scaleX;
+    double offsetY = from.y() - newRect.y() / scaleY;
+    int baseDepth  = items.at( subtree ).depth;
+
+    // The items are in breadth-first order, so everything below 'subtree'
+    // comes after it, and each parent comes before its children.
+
+    QVector<int> newIndex( items.size(), -1 );
+
+    for ( int i = subtree; i < items.size(); ++i )
+    {
+	const TreemapLayoutItem & item = items.at( i );
+
+	if ( i != subtree && ( item.parent < subtree || newIndex.at( item.parent ) < 0 ) )
+	    continue;	// Not in the subtree
+
+	// Scale the edges rather than position and size so there are no
+	// gaps between neighbours.
+
+	int left   = qRound( ( item.rect.x()		       - offsetX ) * scaleX );
+	int right  = qRound( ( item.rect.x() + item.rect.width()  - offsetX ) * scaleX );
+	int top	   = qRound( ( item.rect.y()		       - offsetY ) * scaleY );
+	int bottom = qRound( ( item.rect.y() + item.rect.height() - offsetY ) * scaleY );
+
+	TreemapLayoutItem newItem = item;
+	newItem.rect   = QRect( left, top, right - left, bottom - top );
+	newItem.parent = i == subtree ? -1 : newIndex.at( item.parent );
+	newItem.depth  = item.depth - baseDepth;
+	newItem.cushionSurface.rescale( offsetX, scaleX, offsetY, scaleY );
+
+	newIndex[ i ] = result.size();
+	result << newItem;
+    }
+
+    return result;
+}
+
+
+void TreemapLayout::removeItems( int subtree, bool withRoot )
+{
+    if ( subtree < 0 || subtree >= _items.size() )
+	return;
+
+    // Everything below 'subtree' comes after it, and each parent comes
+    // before its children, so one pass is enough.
+
+    QVector<bool> inSubtree( _items.size(), false );
+    QVector<int>  newIndex( _items.size(), -1 );
+    TreemapLayoutItemList items;
+    items.reserve( _items.size() );
+
+    for ( int i=0; i < _items.size(); ++i )
+    {
+	const TreemapLayoutItem & item = _items.at( i );
+
+	if ( i == subtree || ( i > subtree && item.parent >= subtree && inSubtree.at( item.parent ) ) )
+	{
+	    inSubtree[ i ] = true;
+
+	    if ( i != subtree || withRoot )
+		continue;
+	}
+
+	TreemapLayoutItem newItem = item;
+	newItem.parent = item.parent < 0 ? -1 : newIndex.at( item.parent );
+
+	newIndex[ i ] = items.size();
+	items << newItem;
+    }
+
+    _items	  = items;
+    _complete = false;
+}
+
+
+void TreemapLayout::addChildren( int index, const TreemapLayoutItemList & subtree )
+{
+    if ( index < 0 || index >= _items.size() )
+	return;
+
+    // Item no. i of 'subtree' (except the first one) becomes no. base + i
+
+    int base  = _items.size() - 1;
+    int depth = _items.at( index ).depth;
+
+    for ( int i=1; i < subtree.size(); ++i )
+    {
+	TreemapLayoutItem item = subtree.at( i );
+	item.parent = item.parent == 0 ? index : base + item.parent;
+	item.depth += depth;
+	_items << item;
+    }
+
+    _complete = false;
+}
+
+
+
+
+TreemapLayoutResult::TreemapLayoutResult( TreemapView  * parentView,
+					  FileInfo     * root,
+					  const QRectF & rect ):
+    QObject( parentView ),
+    _root( root ),
+    _rect( rect ),
+    _squarify( parentView->squarify() ),
+    _summaryTiles( parentView->summaryTiles() ),
+    _minTileSize( parentView->minTileSize() ),
+    _heightScaleFactor( parentView->heightScaleFactor() ),
+    _canceled( 0 )
+{
+    // A tile gets the same share of the treemap area as its share of the
+    // root's total size (minus what is lost to rounding and to the
+    // children that are too small). Anything that is less than half of
+    // what would make _minTileSize pixels can't possibly get a tile, so
+    // there is no need to take it into the snapshot.
+
+    FileSize rootSize = root->totalSize();
+    double   area     = rect.width() * rect.height();
+    FileSize minSize  = 0;
+
+    if ( rootSize > 0 && area > 0.0 )
+	minSize = (FileSize) ( _minTileSize * ( rootSize / area ) / 2.0 );
+
+    takeSnapshot( root, minSize );
+}
+
+
+TreemapLayoutResult::~TreemapLayoutResult()
+{
+
+}
+
+
+bool TreemapLayoutResult::isCanceled() const
+{
+#if (QT_VERSION < QT_VERSION_CHECK( 5, 0, 0 ))
+    return (int) _canceled != 0;
+#else
+    return _canceled.load() != 0;
+#endif
+}
+
+
+void TreemapLayoutResult::takeSnapshot( FileInfo * root, FileSize minSize )
+{
+    Node rootNode;
+    rootNode.orig	= root;
+    rootNode.size	= root->totalSize();
+    rootNode.firstChild = 0;
+    rootNode.childCount = 0;
+    rootNode.rest	= 0;
+    _nodes.append( rootNode );
+
+    if ( rootNode.size == 0 )	// Nothing to lay out below the root
+	return;
+
+    for ( int i=0; i < _nodes.size(); ++i )
+    {
+	// This uses the cached size order of the DirInfo, so the children
+	// are already sorted here, and the first one that is too small is
+	// where all the others that are too small start.
+
+	FileInfo * orig = _nodes.at( i ).orig;
+	FileInfo * rest = 0;
+	int firstChild	= _nodes.size();
+
+	if ( orig->isDirInfo() )
+	{
+	    const FileInfoList & children = orig->toDirInfo()->sizeSortedChildren();
+
+	    for ( int j=0; j < children.size() && ! rest; ++j )
+	    {
+		FileInfo * child = children.at( j );
+		FileSize   size	 = child->totalSize();
+
+		if ( size >= minSize )
+		{
+		    Node node;
+		    node.orig	    = child;
+		    node.size	    = size;
+		    node.firstChild = 0;
+		    node.childCount = 0;
+		    node.rest	    = 0;
+		    _nodes.append( node );
+		}
+		else
+		{
+		    rest = child;
+		}
+	    }
+	}
+
+	_nodes[ i ].firstChild = firstChild;
+	_nodes[ i ].childCount = _nodes.size() - firstChild;
+	_nodes[ i ].rest       = rest;
+    }
+
+    _nodes.squeeze();
+}
+
+
+QList<TreemapLayoutItemList> TreemapLayoutResult::takeLevels()
+{
+    QMutexLocker locker( &_mutex );
+
+    QList<TreemapLayoutItemList> levels = _pendingLevels;
+    _pendingLevels.clear();
+
+    return levels;
+}
+
+
+void TreemapLayoutResult::layout()
+{
+    Level level;
+    addItem( level, 0, _rect, _cushionSurface, -1, 0, TreemapAuto );
+    int base = 0;
+
+    while ( ! level.items.isEmpty() && ! isCanceled() )
+    {
+	// The items of this level are final now, so the main thread can
+	// display them while the next level is laid out. Both only read
+	// them (and QVector's implicit sharing is thread-safe).
+
+	{
+	    QMutexLocker locker( &_mutex );
+	    _pendingLevels << level.items;
+	}
+
+	emit levelDone();
+
+	Level next;
+
+	for ( int i=0; i < level.items.size() && ! isCanceled(); ++i )
+	    layoutChildren( level, i, base + i, next );
+
+	base += level.items.size();
+	level = next;
+    }
+}
+
+
+int TreemapLayoutResult::addItem( Level		       & level,
+				  int			 node,
+				  const QRectF	       & rect,
+				  const CushionSurface & cushionSurface,
+				  int			 parent,
+				  int			 depth,
+				  Orientation		 orientation )
+{
+    TreemapLayoutItem item;
+    item.orig		= _nodes.at( node ).orig;
+    item.rect		= QRect( (int) rect.x(), (int) rect.y(),
+				 qRound( rect.width() ), qRound( rect.height() ) );
+    item.parent		= parent;
+    item.depth		= depth;
+    item.summary	= false;
+    item.cushionSurface = cushionSurface;
+
+    CushionSurface childSurface = cushionSurface;
+
+    if ( ! _squarify && _nodes.at( node ).size != 0 )
+    {
+	// Just like TreemapTile::createChildrenSimple(), add a ridge to the
+	// item's own cushion surface before the children copy it.
+
+	Orientation childDir = orientation;
+
+	if ( orientation == TreemapHorizontal )	 childDir = TreemapVertical;
+	if ( orientation == TreemapVertical   )	 childDir = TreemapHorizontal;
+
+	childSurface.addRidge( childDir, childSurface.height(), rect );
+	item.cushionSurface = childSurface;
+    }
+
+    level.items		<< item;
+    level.nodes		<< node;
+    level.childSurfaces << childSurface;
+    level.orientations	<< orientation;
+
+    return level.items.size() - 1;
+}
+
+
+void TreemapLayoutResult::addSummaryItem( const Level  & level,
+					  int		 index,
+					  int		 parent,
+					  Level		& next,
+					  int		 rest,
+					  const QRectF & rect )
+{
+    if ( ! _summaryTiles || rect.width() < _minTileSize || rect.height() < _minTileSize )
+	return;
+
+    const Node & node = _nodes.at( level.nodes.at( index ) );
+    FileInfo * orig   = rest < node.firstChild + node.childCount ? _nodes.at( rest ).orig : node.rest;
+
+    if ( ! orig )	// Only rounding errors left
+	return;
+
+    CushionSurface cushionSurface = level.childSurfaces.at( index );
+    double height = cushionSurface.height() * _heightScaleFactor;
+
+    cushionSurface.addRidge( TreemapHorizontal, height, rect );
+    cushionSurface.addRidge( TreemapVertical,	height, rect );
+
+    TreemapLayoutItem item;
+    item.orig		= orig;
+    item.rect		= QRect( (int) rect.x(), (int) rect.y(),
+				 qRound( rect.width() ), qRound( rect.height() ) );
+    item.parent		= parent;
+    item.depth		= level.items.at( index ).depth + 1;
+    item.summary	= true;
+    item.cushionSurface = cushionSurface;
+
+    // The snapshot node -1 has no children
+
+    next.items		<< item;
+    next.nodes		<< -1;
+    next.childSurfaces	<< cushionSurface;
+    next.orientations	<< TreemapAuto;
+}
+
+
+void TreemapLayoutResult::layoutChildren( const Level & level, int index, int parent, Level & next )
+{
+    if ( level.nodes.at( index ) < 0 )				// Summary item
+	return;
+
+    if ( _nodes.at( level.nodes.at( index ) ).size == 0 )	// Prevent division by zero
+	return;
+
+    if ( _squarify )
+	layoutSquarifiedChildren( level, index, parent, next );
+    else
+	layoutChildrenSimple( level, index, parent, next );
+}
+
+
+void TreemapLayoutResult::layoutChildrenSimple( const Level & level, int index, int parent, Level & next )
+{
+    QRectF	   rect		  = level.items.at( index ).rect;
+    CushionSurface cushionSurface = level.childSurfaces.at( index );
+    Orientation	   orientation	  = level.orientations.at( index );
+    int		   node		  = level.nodes.at( index );
+    int		   depth	  = level.items.at( index ).depth + 1;
+
+    Orientation dir	 = orientation;
+    Orientation childDir = orientation;
+
+    if ( dir == TreemapAuto )
+	dir = rect.width() > rect.height() ? TreemapHorizontal : TreemapVertical;
+
+    if ( orientation == TreemapHorizontal )  childDir = TreemapVertical;
+    if ( orientation == TreemapVertical	  )  childDir = TreemapHorizontal;
+
+    int offset	 = 0;
+    int size	 = dir == TreemapHorizontal ? rect.width() : rect.height();
+    double scale = (double) size / (double) _nodes.at( node ).size;
+
+    FileSize minSize = (FileSize) ( _minTileSize / scale );
+    int first = _nodes.at( node ).firstChild;
+    int end   = first + countChildren( node, minSize );
+
+    for ( int i = first; i < end; ++i )
+    {
+	int childSize = (int) ( scale * _nodes.at( i ).size );
+
+	if ( childSize >= _minTileSize )
+	{
+	    QRectF childRect;
+
+	    if ( dir == TreemapHorizontal )
+		childRect = QRectF( rect.x() + offset, rect.y(), childSize, rect.height() );
+	    else
+		childRect = QRectF( rect.x(), rect.y() + offset, rect.width(), childSize );
+
+	    int child = addItem( next, i, childRect, cushionSurface, parent, depth, childDir );
+
+	    next.items[ child ].cushionSurface.addRidge( dir,
+							 cushionSurface.height() * _heightScaleFactor,
+							 childRect );
+	    offset += childSize;
+	}
+    }
+
+    if ( dir == TreemapHorizontal )
+	addSummaryItem( level, index, parent, next, end,
+			QRectF( rect.x() + offset, rect.y(), rect.width() - offset, rect.height() ) );
+    else
+	addSummaryItem( level, index, parent, next, end,
+			QRectF( rect.x(), rect.y() + offset, rect.width(), rect.height() - offset ) );
+}
+
+
+void TreemapLayoutResult::layoutSquarifiedChildren( const Level & level, int index, int parent, Level & next )
+{
+    QRectF rect	     = level.items.at( index ).rect;
+    int	   node	     = level.nodes.at( index );
+    double scale     = rect.width() * (double) rect.height() / _nodes.at( node ).size;
+    FileSize minSize = (FileSize) ( _minTileSize / scale );
+
+    int first = _nodes.at( node ).firstChild;
+    int end   = first + countChildren( node, minSize );
+    QRectF childrenRect = rect;
+
+    QVector<FileSize> sizes;
+    sizes.reserve( end - first );
+
+    for ( int i = first; i < end; ++i )
+	sizes.append( _nodes.at( i ).size );
+
+    Squarifier squarifier( sizes );
+    int pos = 0;
+
+    while ( pos < sizes.size() )
+    {
+	int rowEnd = squarifier.rowEnd( childrenRect, scale, pos );
+
+	if ( rowEnd == pos )	// Empty row: Prevent an endless loop
+	{
+	    ++pos;
+	    continue;
+	}
+
+	childrenRect = layoutRow( level, index, parent, next, childrenRect, scale,
+				  first + pos, first + rowEnd, squarifier.sum( pos, rowEnd ) );
+	pos = rowEnd;
+    }
+
+    // What is left over is the area of the children that are too small
+
+    addSummaryItem( level, index, parent, next, end, childrenRect );
+}
+
+
+QRectF TreemapLayoutResult::layoutRow( const Level  & level,
+				       int	      index,
+				       int	      parent,
+				       Level	    & next,
+				       const QRectF & rect,
+				       double	      scale,
+				       int	      first,
+				       int	      end,
+				       FileSize	      sum )
+{
+    if ( first >= end )
+	return rect;
+
+    Orientation dir = rect.width() > rect.height() ? TreemapHorizontal : TreemapVertical;
+    int primary = qMax( rect.width(), rect.height() );
+    int secondary = (int) ( sum * scale / primary );
+
+    if ( sum == 0 )	// Prevent division by zero.
+	return rect;
+
+    if ( secondary < _minTileSize )	// We don't want tiles that small.
+	return rect;
+
+    CushionSurface rowCushionSurface = level.childSurfaces.at( index );
+
+    rowCushionSurface.addRidge( dir == TreemapHorizontal ? TreemapVertical : TreemapHorizontal,
+				rowCushionSurface.height() * _heightScaleFactor,
+				rect );
+
+    int depth	  = level.items.at( index ).depth + 1;
+    int offset	  = 0;
+    int remaining = primary;
+
+    for ( int i = first; i < end; ++i )
+    {
+	int childSize = (int) ( _nodes.at( i ).size / (double) sum * primary + 0.5 );
+
+	if ( childSize > remaining )	// Prevent overflow because of accumulated rounding errors
+	    childSize = remaining;
+
+	remaining -= childSize;
+
+	if ( childSize >= _minTileSize )
+	{
+	    QRectF childRect;
+
+	    if ( dir == TreemapHorizontal )
+		childRect = QRectF( rect.x() + offset, rect.y(), childSize, secondary );
+	    else
+		childRect = QRectF( rect.x(), rect.y() + offset, secondary, childSize );
+
+	    int child = addItem( next, i, childRect, rowCushionSurface, parent, depth, TreemapAuto );
+
+	    next.items[ child ].cushionSurface.addRidge( dir,
+							 rowCushionSurface.height() * _heightScaleFactor,
+							 childRect );
+	    offset += childSize;
+	}
+    }
+
+    QRectF newRect;
+
+    if ( dir == TreemapHorizontal )
+	newRect = QRectF( rect.x(), rect.y() + secondary, rect.width(), rect.height() - secondary );
+    else
+	newRect = QRectF( rect.x() + secondary, rect.y(), rect.width() - secondary, rect.height() );
+
+    return newRect;
+}
+
+
+int TreemapLayoutResult::countChildren( int node, FileSize minSize )
+{
+    int first = _nodes.at( node ).firstChild;
+    int end   = first + _nodes.at( node ).childCount;
+    int count = 0;
+
+    while ( first + count < end && _nodes.at( first + count ).size >= minSize )
+	++count;
+
+    return count;
+}
+
+
+void TreemapLayoutWorker::run()
+{
+    _result->layout();
+    _result->sendDone();
+
+    // Don't touch _result after this: It is deleted in the main thread
+    // when the done() signal arrives.
+}
@@ -0,0 +1,479 @@
+/*
+ *   File name: TreemapLayout.h
+ *   Summary:	Flat treemap layout for QDirStat
+ *   License:	GPL V2 - See file LICENSE for details.
+ *
+ *   Author:	Stefan Hundhammer <Stefan.Hundhammer@gmx.de>
+ */
+
+
+#ifndef TreemapLayout_h
+#define TreemapLayout_h
+
+
+#include <QObject>
+#include <QRunnable>
+#include <QRect>
+#include <QRectF>
+#include <QSize>
+#include <QVector>
+#include <QList>
+#include <QMutex>
+#include <QAtomicInt>
+
+#include "TreemapTile.h"	// CushionSurface, Orientation
+#include "NodePool.h"
+
+
+namespace QDirStat
+{
+    class FileInfo;
+    class TreemapView;
+
+
+    /**
+     * One rectangle of a flat treemap layout.
+     *
+     * A summary item stands for all the children of its parent that are
+     * too small to get an item of their own. Its 'orig' is the largest of
+     * them; it is only used for the color.
+     **/
+    struct TreemapLayoutItem
+    {
+	FileInfo *	orig;
+	QRect		rect;		// In treemap coordinates (whole pixels)
+	int		parent;		// Index of the parent item, -1 for the root
+	int		depth;		// 0 for the root
+	bool		summary;	// Summary of the parent's small children
+	CushionSurface	cushionSurface;
+    };
+
+    typedef QVector<TreemapLayoutItem> TreemapLayoutItemList;
+
+
+    /**
+     * A complete layout that the TreemapView keeps for reusing it.
+     **/
+    struct TreemapLayoutCacheEntry
+    {
+	FileInfo *		root;
+	QSize			size;
+	TreemapLayoutItemList	items;
+    };
+
+
+    /**
+     * Treemap layout as one flat array of rectangles instead of one
+     * TreemapTile (a QGraphicsItem) per file.
+     *
+     * This is the same treemap as with the tiles, but it needs only a
+     * fraction of the memory: For a tree with a million files, a million
+     * QGraphicsItems each with their own cushion pixmap are just way too
+     * much. The TreemapView renders this layout into one single image.
+     *
+     * The layout is computed in a worker thread by a TreemapLayoutResult
+     * and added here level by level: The items are in breadth-first
+     * order (except after an incremental update); each item comes after its
+     * parent, so painting them in that order gets the stacking right. For hit-testing, there is a simple
+     * grid index: Each grid cell knows all the items that overlap it.
+     **/
+    class TreemapLayout
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	TreemapLayout();
+
+	/**
+	 * Start a new layout for 'root'. This clears any previous layout.
+	 **/
+	void begin( FileInfo * root );
+
+	/**
+	 * Add the next level of items.
+	 **/
+	void addItems( const TreemapLayoutItemList & items );
+
+	/**
+	 * Finish the layout: Build the grid index. Until then, itemAt()
+	 * doesn't find anything.
+	 **/
+	void finish();
+
+	/**
+	 * Clear the layout.
+	 **/
+	void clear();
+
+	/**
+	 * Return 'true' if there is no layout.
+	 **/
+	bool isEmpty() const { return _items.isEmpty(); }
+
+	/**
+	 * Return 'true' if the layout is complete, i.e. if finish() was
+	 * called.
+	 **/
+	bool isComplete() const { return _complete; }
+
+	/**
+	 * Return the number of items.
+	 **/
+	int size() const { return _items.size(); }
+
+	/**
+	 * Return item no. 'index'.
+	 **/
+	const TreemapLayoutItem & item( int index ) const { return _items.at( index ); }
+
+	/**
+	 * Return the root of the layout or 0 if there is none. This is
+	 * already set while the layout is still being computed.
+	 **/
+	FileInfo * root() const { return _root; }
+
+	/**
+	 * Return the index of the innermost item at 'pos' or -1 if there is
+	 * none. For a summary item, this is its parent.
+	 **/
+	int itemAt( const QPoint & pos ) const;
+
+	/**
+	 * Return the index of the item for 'node' or -1 if 'node' is not in
+	 * the layout.
+	 *
+	 * Notice: This is a linear search.
+	 **/
+	int indexOf( const FileInfo * node ) const { return indexOf( _items, node ); }
+
+	/**
+	 * Return all items.
+	 **/
+	const TreemapLayoutItemList & items() const { return _items; }
+
+	/**
+	 * Return the index of the item for 'node' in 'items' or -1 if there
+	 * is none. Summary items don't count.
+	 **/
+	static int indexOf( const TreemapLayoutItemList & items, const FileInfo * node );
+
+	/**
+	 * Return item no. 'subtree' of 'items' and everything below it,
+	 * rescaled and moved so that item fills 'newRect'. Cushion surfaces
+	 * are adapted accordingly. The result is a complete layout with
+	 * that item as the root.
+	 *
+	 * This is only an approximation of a new layout for 'newRect': Items
+	 * don't appear or disappear with the new size. But it is much
+	 * cheaper.
+	 **/
+	static TreemapLayoutItemList rescaled( const TreemapLayoutItemList & items,
+					       int			     subtree,
+					       const QRect		   & newRect );
+
+	/**
+	 * Remove item no. 'index' and everything below it. This changes
+	 * the indices of the items after it. Call finish() afterwards.
+	 **/
+	void removeSubtree( int index ) { removeItems( index, true ); }
+
+	/**
+	 * Remove everything below item no. 'index', but not that item
+	 * itself. Call finish() afterwards.
+	 **/
+	void removeChildren( int index ) { removeItems( index, false ); }
+
+	/**
+	 * Add new children to item no. 'index': 'subtree' is a complete
+	 * layout for that item, i.e. its first item is the one for 'index'
+	 * itself (which is not added again). The new items are added at the
+	 * end; they still come after their parents. Call finish()
+	 * afterwards.
+	 **/
+	void addChildren( int index, const TreemapLayoutItemList & subtree );
+
+
+    protected:
+
+	/**
+	 * Build the grid index.
+	 **/
+	void buildIndex();
+
+	/**
+	 * Remove everything below item no. 'subtree' and, if 'withRoot' is
+	 * 'true', that item itself.
+	 **/
+	void removeItems( int subtree, bool withRoot );
+
+
+	// Data members
+
+	FileInfo *			_root;
+	bool				_complete;
+	TreemapLayoutItemList		_items;
+
+	// Grid index: The items of cell no. i are
+	// _cellItems[ _cellStart[i] ] .. _cellItems[ _cellStart[i+1] - 1 ]
+
+	int				_gridColumns;
+	int				_gridRows;
+	QVector<int>			_cellStart;
+	QVector<int>			_cellItems;
+    };
+
+
+
+    /**
+     * Computing a TreemapLayout in a worker thread.
+     *
+     * Objects of this class live in the main thread. The constructor takes
+     * a snapshot of the sizes of everything that can possibly get a tile
+     * (in the main thread, with the children of each node sorted by
+     * size), so the worker never touches the DirTree: The
+     * FileInfo pointers are only handed back to the main thread.
+     *
+     * The worker lays out the treemap one level at a time, using the same
+     * algorithms (simple or squarified) and the same parameters as the
+     * TreemapTiles. After each level, it sends levelDone(); the main
+     * thread can then take the new items with takeLevels() and display
+     * them right away while the worker continues with the next level. At
+     * the end, it sends done().
+     *
+     * Optionally, the children of each directory that are too small for
+     * an item of their own get one summary item together, so the treemap
+     * doesn't get patchy where they are left out. They are never looked
+     * at individually, so the cost of the layout depends on the treemap
+     * size, not on the number of files.
+     *
+     * If the layout is no longer needed, cancel() it; the worker then
+     * stops at the next opportunity. It still sends done().
+     **/
+    class TreemapLayoutResult: public QObject
+    {
+	Q_OBJECT
+
+    public:
+
+	/**
+	 * Constructor: Take the snapshot of 'root' for a layout in 'rect'
+	 * with the parameters of 'parentView'. Call this from the main
+	 * thread. 'parentView' is also the QObject parent.
+	 **/
+	TreemapLayoutResult( TreemapView  * parentView,
+			     FileInfo	  * root,
+			     const QRectF & rect );
+
+	/**
+	 * Destructor.
+	 **/
+	virtual ~TreemapLayoutResult();
+
+	/**
+	 * Cancel this layout. Call this only from the main thread.
+	 **/
+	void cancel() { _canceled.ref(); }
+
+	/**
+	 * Return 'true' if this layout was canceled.
+	 **/
+	bool isCanceled() const;
+
+	/**
+	 * Return the root of this layout.
+	 **/
+	FileInfo * root() const { return _root; }
+
+	/**
+	 * Set the cushion surface of the root item. This is needed when
+	 * laying out a subtree of an existing layout again (squarified
+	 * layout only). Call this before layout().
+	 **/
+	void setCushionSurface( const CushionSurface & cushionSurface )
+	    { _cushionSurface = cushionSurface; }
+
+	/**
+	 * Take all levels that are finished so far. Call this from the main
+	 * thread.
+	 **/
+	QList<TreemapLayoutItemList> takeLevels();
+
+	/**
+	 * Lay out the treemap. This is called in the worker thread.
+	 **/
+	void layout();
+
+	/**
+	 * Send the done() signal. This is called in the worker thread.
+	 **/
+	void sendDone() { emit done(); }
+
+
+    signals:
+
+	/**
+	 * Emitted when another level of the layout is finished.
+	 **/
+	void levelDone();
+
+	/**
+	 * Emitted when the layout is finished or canceled.
+	 **/
+	void done();
+
+
+    protected:
+
+	/**
+	 * One node of the snapshot: The children of each node are
+	 * consecutive.
+	 **/
+	struct Node
+	{
+	    FileInfo *	orig;
+	    FileSize	size;
+	    int		firstChild;
+	    int		childCount;
+	    FileInfo *	rest;		// Largest child not in the snapshot
+	};
+
+	/**
+	 * The level that is being laid out. Besides the items, this keeps
+	 * what is needed to lay out their children in the next level.
+	 **/
+	struct Level
+	{
+	    TreemapLayoutItemList   items;
+	    QVector<int>	    nodes;	    // Snapshot node of each item
+	    QVector<CushionSurface> childSurfaces;  // Cushion surface for the children
+	    QVector<Orientation>    orientations;   // Orientation for the children
+	};
+
+	/**
+	 * Take the snapshot of everything below 'root' with a total size of
+	 * at least 'minSize'.
+	 **/
+	void takeSnapshot( FileInfo * root, FileSize minSize );
+
+	/**
+	 * Add an item for snapshot node 'node' in 'rect' with
+	 * 'cushionSurface' to 'level'. Return its index in 'level'.
+	 **/
+	int addItem( Level		  & level,
+		     int		    node,
+		     const QRectF	  & rect,
+		     const CushionSurface & cushionSurface,
+		     int		    parent,
+		     int		    depth,
+		     Orientation	    orientation );
+
+	/**
+	 * Add a summary item in 'rect' for the children of item no. 'index'
+	 * of 'level' that didn't get an item of their own, starting with
+	 * snapshot node 'rest', if it is large enough.
+	 **/
+	void addSummaryItem( const Level  & level,
+			     int	    index,
+			     int	    parent,
+			     Level	  & next,
+			     int	    rest,
+			     const QRectF & rect );
+
+	/**
+	 * Lay out the children of item no. 'index' of 'level' to 'next'.
+	 * 'parent' is the index of that item in the complete layout.
+	 **/
+	void layoutChildren( const Level & level, int index, int parent, Level & next );
+
+	/**
+	 * Lay out the children with the simple algorithm.
+	 * See TreemapTile::createChildrenSimple().
+	 **/
+	void layoutChildrenSimple( const Level & level, int index, int parent, Level & next );
+
+	/**
+	 * Lay out the children with the squarified algorithm.
+	 * See TreemapTile::createSquarifiedChildren().
+	 **/
+	void layoutSquarifiedChildren( const Level & level, int index, int parent, Level & next );
+
+	/**
+	 * Lay out the row of children from 'first' to 'end' within 'rect'.
+	 * 'sum' is the sum of their sizes. Return the new rectangle with the
+	 * layouted area subtracted. See TreemapTile::layoutRow().
+	 **/
+	QRectF layoutRow( const Level  & level,
+			  int		 index,
+			  int		 parent,
+			  Level	       & next,
+			  const QRectF & rect,
+			  double	 scale,
+			  int		 first,
+			  int		 end,
+			  FileSize	 sum );
+
+	/**
+	 * Return the number of children of snapshot node 'node' that are at
+	 * least 'minSize'. The snapshot has the children of each node sorted
+	 * by size in descending order.
+	 **/
+	int countChildren( int node, FileSize minSize );
+
+
+	// Data members
+
+	FileInfo *			_root;
+	QRectF				_rect;
+	bool				_squarify;
+	bool				_summaryTiles;
+	int				_minTileSize;
+	double				_heightScaleFactor;
+	CushionSurface			_cushionSurface;
+	QVector<Node>			_nodes;
+	QAtomicInt			_canceled;
+
+	QMutex				_mutex;	    // Protects _pendingLevels
+	QList<TreemapLayoutItemList>	_pendingLevels;
+
+    };	// class TreemapLayoutResult
+
+
+
+    /**
+     * Runnable for a QThreadPool that computes a TreemapLayoutResult.
+     *
+     * The thread pool takes ownership of this object and deletes it when
+     * it is done; the result is owned by the TreemapView.
+     **/
+    class TreemapLayoutWorker: public QRunnable
+    {
+    public:
+
+	/**
+	 * Constructor.
+	 **/
+	TreemapLayoutWorker( TreemapLayoutResult * result ):
+	    QRunnable(),
+	    _result( result )
+	    { setAutoDelete( true ); }
+
+	/**
+	 * Do the work. This is called in a worker thread.
+	 *
+	 * Reimplemented from QRunnable.
+	 **/
+	virtual void run() Q_DECL_OVERRIDE;
+
+    protected:
+
+	TreemapLayoutResult * _result;
+	NodePin		      _pin;	// Keep deleted nodes until this is done
+
+    };	// class TreemapLayoutWorker
+
+}	// namespace QDirStat
+
+
+#endif // ifndef TreemapLayout_h
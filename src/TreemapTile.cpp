@@ -8,24 +8,33 @@
 
 
 #include <math.h>
+#include <string.h>	// memcpy()
 
 #include <QImage>
 #include <QPainter>
 #include <QGraphicsSceneMouseEvent>
-#include <QMenu>
 
 #include "TreemapTile.h"
 #include "TreemapView.h"
+#include "CushionKernel.h"
+#include "CacheBudget.h"
 #include "FileInfoIterator.h"
-#include "SelectionModel.h"
-#include "ActionManager.h"
-#include "CleanupCollection.h"
+#include "Squarifier.h"
 #include "Exception.h"
 #include "Logger.h"
 
 using namespace QDirStat;
 
 
+/**
+ * Drop the cushion of tile 'tile' when the cache budget evicts it.
+ **/
+static void dropTileCushion( void * tile )
+{
+    static_cast<TreemapTile *>( tile )->dropCushion();
+}
+
+
 TreemapTile::TreemapTile( TreemapView *	 parentView,
 			  TreemapTile *	 parentTile,
 			  FileInfo *	 orig,
@@ -69,9 +78,8 @@ TreemapTile::TreemapTile( TreemapView *		 parentView,
 
 TreemapTile::~TreemapTile()
 {
-    // DO NOT try to delete the _highlighter: It is owned by the TreemapView /
-    // QGraphicsScene and deleted together with all other QGraphicsItems
-    // in the TreemapView destructor.
+    if ( CacheBudget::isEnabled() )
+	CacheBudget::instance()->remove( this );
 }
 
 
@@ -82,34 +90,23 @@ void TreemapTile::init()
 
     setZValue( _parentTile ? ( _parentTile->zValue() + 1.0 ) : 0.0 );
 
-    setBrush( QColor( 0x60, 0x60, 0x60 ) );
     setPen( Qt::NoPen );
 
     if ( _orig->isDir() || _orig->isDotEntry() )
-    {
-        if ( _parentView->useDirGradient() )
-        {
-            if ( qMax( rect().width(), rect().height() ) < _parentView->minTileSize() )
-            {
-                setBrush( Qt::NoBrush );
-            }
-            else
-            {
-                QLinearGradient gradient( rect().topLeft(), rect().bottomRight() );
-                gradient.setColorAt( 0.0, _parentView->dirGradientStart() );
-                gradient.setColorAt( 1.0, _parentView->dirGradientEnd()   );
-                setBrush( gradient );
-            }
-        }
-    }
+	setBrush( _parentView->dirBrush( rect() ) );
+    else
+	setBrush( QColor( 0x60, 0x60, 0x60 ) );
 
     setFlags( ItemIsSelectable );
-    _highlighter = 0;
-    setAcceptHoverEvents(true);
+
+    // No hover events: The TreemapView finds the tile under the mouse
+    // itself, which is much faster without an index of the scene items.
 
     if ( ! _parentTile )
 	_parentView->scene()->addItem( this );
 
+    _parentView->addToTileIndex( this );
+
     // logDebug() << "Creating treemap tile for " << this
     //		  << " size " << formatSize( _orig->totalSize() ) << endl;
 }
@@ -191,86 +188,51 @@ void TreemapTile::createSquarifiedChildren( const QRectF & rect )
     double scale	= rect.width() * (double) rect.height() / _orig->totalSize();
     FileSize minSize	= (FileSize) ( _parentView->minTileSize() / scale );
 
+    // Take the sizes only once: The row breaks and the layout of the rows
+    // only use the prefix sums of the Squarifier.
+
     FileInfoSortedBySizeIterator it( _orig, minSize );
-    QRectF childrenRect = rect;
+    FileInfoList      children;
+    QVector<FileSize> sizes;
+    children.reserve( it.count() );
+    sizes.reserve( it.count() );
 
     while ( *it )
     {
-	FileInfoList row = squarify( childrenRect, scale, it );
-	childrenRect = layoutRow( childrenRect, scale, row );
-    }
-}
-
-
-FileInfoList TreemapTile::squarify( const QRectF & rect,
-				    double	  scale,
-				    FileInfoSortedBySizeIterator & it )
-{
-    // logDebug() << "squarify() " << this << " " << rect << endl;
-
-    FileInfoList row;
-    int length = qMax( rect.width(), rect.height() );
-
-    if ( length == 0 )	// Sanity check
-    {
-	logWarning()  << "Zero length" << endl;
-
-	if ( *it )	// Prevent endless loop in case of error:
-	    ++it;	// Advance iterator.
-
-	return row;
+	children.append( *it );
+	sizes.append( (*it)->totalSize() );
+	++it;
     }
 
+    Squarifier squarifier( sizes );
+    QRectF childrenRect = rect;
+    int pos = 0;
 
-    bool   improvingAspectRatio = true;
-    double lastWorstAspectRatio = -1.0;
-    double sum			= 0;
-
-    // This is a bit ugly, but doing all calculations in the 'size' dimension
-    // is more efficient here since that requires only one scaling before
-    // doing all other calculations in the loop.
-    const double scaledLengthSquare = length * (double) length / scale;
-
-    while ( *it && improvingAspectRatio )
+    while ( pos < children.size() )
     {
-	sum += (*it)->totalSize();
+	int end = squarifier.rowEnd( childrenRect, scale, pos );
 
-	if ( ! row.isEmpty() && sum != 0 && (*it)->totalSize() != 0 )
+	if ( end == pos )
 	{
-	    double sumSquare	    = sum * sum;
-	    double worstAspectRatio = qMax( scaledLengthSquare * row.first()->totalSize() / sumSquare,
-                                            sumSquare / ( scaledLengthSquare * (*it)->totalSize() ) );
-
-	    if ( lastWorstAspectRatio >= 0.0 &&
-		 worstAspectRatio > lastWorstAspectRatio )
-	    {
-		improvingAspectRatio = false;
-	    }
-
-	    lastWorstAspectRatio = worstAspectRatio;
+	    logWarning()  << "Zero length" << endl;
+	    ++pos;	// Prevent endless loop in case of error
+	    continue;
 	}
 
-	if ( improvingAspectRatio )
-	{
-	    // logDebug() << "Adding " << *it << " size " << (*it)->totalSize() << endl;
-	    row.append( *it );
-	    ++it;
-	}
-	else
-	{
-	    // logDebug() << "Getting worse after adding " << *it << " size " << (*it)->totalSize() << endl;
-	}
+	childrenRect = layoutRow( childrenRect, scale, children, squarifier, pos, end );
+	pos = end;
     }
-
-    return row;
 }
 
 
-QRectF TreemapTile::layoutRow( const QRectF & rect,
-			       double	      scale,
-			       FileInfoList & row )
+QRectF TreemapTile::layoutRow( const QRectF	    & rect,
+			       double		      scale,
+			       const FileInfoList   & children,
+			       const Squarifier	    & squarifier,
+			       int		      first,
+			       int		      end )
 {
-    if ( row.isEmpty() )
+    if ( first >= end )
 	return rect;
 
     // Determine the direction in which to subdivide.
@@ -283,11 +245,7 @@ QRectF TreemapTile::layoutRow( const QRectF & rect,
     // This row's secondary length is determined by the area (the number of
     // pixels) to be allocated for all of the row's items.
 
-    FileSize sum = 0;
-
-    foreach ( FileInfo * item, row )
-	sum += item->totalSize();
-
+    FileSize sum = squarifier.sum( first, end );
     int secondary = (int) ( sum * scale / primary );
 
     if ( sum == 0 )	// Prevent division by zero.
@@ -309,12 +267,10 @@ QRectF TreemapTile::layoutRow( const QRectF & rect,
 
     int offset = 0;
     int remaining = primary;
-    FileInfoList::const_iterator it  = row.constBegin();
-    FileInfoList::const_iterator end = row.constEnd();
 
-    while ( it != end )
+    for ( int i = first; i < end; ++i )
     {
-	int childSize = (int) ( (*it)->totalSize() / (double) sum * primary + 0.5 );
+	int childSize = (int) ( squarifier.size( i ) / (double) sum * primary + 0.5 );
 
 	if ( childSize > remaining )	// Prevent overflow because of accumulated rounding errors
 	    childSize = remaining;
@@ -330,7 +286,7 @@ QRectF TreemapTile::layoutRow( const QRectF & rect,
 	    else
 		childRect = QRectF( rect.x(), rect.y() + offset, secondary, childSize );
 
-	    TreemapTile * tile = new TreemapTile( _parentView, this, *it, childRect, rowCushionSurface );
+	    TreemapTile * tile = new TreemapTile( _parentView, this, children.at( i ), childRect, rowCushionSurface );
 	    CHECK_NEW( tile );
 
 	    tile->cushionSurface().addRidge( dir,
@@ -338,8 +294,6 @@ QRectF TreemapTile::layoutRow( const QRectF & rect,
 					     childRect );
 	    offset += childSize;
 	}
-
-	++it;
     }
 
 
@@ -371,18 +325,30 @@ void TreemapTile::paint( QPainter			* painter,
 
     if ( _parentView->doCushionShading() )
     {
+	// With a cushion framebuffer, the parent view already painted the
+	// cushions of all tiles and the background of all directories.
+
+	bool prerendered = _parentView->hasCushionFramebuffer();
+
 	if ( _orig->isDir() || _orig->isDotEntry() )
 	{
-	    QGraphicsRectItem::paint( painter, option, widget );
+	    if ( ! prerendered )
+		QGraphicsRectItem::paint( painter, option, widget );
 	}
 	else
 	{
-	    if ( _cushion.isNull() )
+	    if ( _cushion.isNull() && ! prerendered )
 		_cushion = renderCushion();
 
+	    if ( ! _cushion.isNull() && ! prerendered && CacheBudget::isEnabled() )
+	    {
+		CacheBudget::instance()->touch( this, CacheBudget::OtherCache,
+						cushionBytes(), dropTileCushion );
+	    }
+
 	    QRectF rect = QGraphicsRectItem::rect();
 
-	    if ( ! _cushion.isNull() )
+	    if ( ! _cushion.isNull() && ! prerendered )
 		painter->drawPixmap( rect.topLeft(), _cushion );
 
 	    if ( isSelected() && ! _orig->hasChildren() )
@@ -390,10 +356,8 @@ void TreemapTile::paint( QPainter			* painter,
 		// Highlight this tile. This makes only sense if this is a leaf
 		// tile (i.e., if the corresponding FileInfo doesn't have any
 		// children), because otherwise the children will obscure this
-		// tile anyway. In that case, we have to rely on a
-		// HighlightRect to be created. But we can save some memory if
-		// we don't do that for every tile, so we draw that highlight
-		// frame manually if this is a leaf tile.
+		// tile anyway. In that case, TreemapView::drawForeground()
+		// draws the frame on top of the children.
 
 		QRectF selectionRect = rect;
 		selectionRect.setSize( rect.size() - QSize( 1.0, 1.0 ) );
@@ -435,72 +399,44 @@ void TreemapTile::paint( QPainter			* painter,
 }
 
 
-QPixmap TreemapTile::renderCushion()
+CushionShading TreemapTile::cushionShading()
 {
-    QRectF rect = QGraphicsRectItem::rect();
-
-    if ( rect.width() < 1.0 || rect.height() < 1.0 )
-	return QPixmap();
-
-    // logDebug() << endl;
+    return _parentView->cushionShading( _orig, _cushionSurface );
+}
 
-    double nx;
-    double ny;
-    double cosa;
-    int	   x, y;
-    int	   red, green, blue;
 
+QRect TreemapTile::cushionRect() const
+{
+    QRectF rect = QGraphicsRectItem::rect();
 
-    // Cache some values. They are used for each loop iteration, so let's try
-    // to keep multiple indirect references down.
+    return QRect( (int) rect.x(), (int) rect.y(), qRound( rect.width() ), qRound( rect.height() ) );
+}
 
-    int		ambientLight = parentView()->ambientLight();
-    double	lightX	     = parentView()->lightX();
-    double	lightY	     = parentView()->lightY();
-    double	lightZ	     = parentView()->lightZ();
 
-    double	xx2	     = cushionSurface().xx2();
-    double	xx1	     = cushionSurface().xx1();
-    double	yy2	     = cushionSurface().yy2();
-    double	yy1	     = cushionSurface().yy1();
+QPixmap TreemapTile::renderCushion()
+{
+    QRect rect = cushionRect();
 
-    int		x0	     = rect.x();
-    int		y0	     = rect.y();
+    if ( rect.width() < 1 || rect.height() < 1 )
+	return QPixmap();
 
-    QColor	color	     = parentView()->tileColor( _orig );
-    int		maxRed	     = qMax( 0, color.red()   - ambientLight );
-    int		maxGreen     = qMax( 0, color.green() - ambientLight );
-    int		maxBlue	     = qMax( 0, color.blue()  - ambientLight );
+    // logDebug() << endl;
 
-    QImage image( qRound( rect.width() ), qRound( rect.height() ), QImage::Format_RGB32 );
+    CushionShading shading  = cushionShading();
+    bool	   contrast = _parentView->ensureContrast();
+    QImage image = _parentView->cushionCache()->find( shading, rect, contrast );
 
-    for ( y = 0; y < rect.height(); y++ )
+    if ( image.isNull() )
     {
-	for ( x = 0; x < rect.width(); x++ )
-	{
-	    nx = 2.0 * xx2 * (x+x0) + xx1;
-	    ny = 2.0 * yy2 * (y+y0) + yy1;
-	    cosa  = ( nx * lightX + ny * lightY + lightZ ) / sqrt( nx*nx + ny*ny + 1.0 );
-
-	    red	  = (int) ( maxRed   * cosa + 0.5 );
-	    green = (int) ( maxGreen * cosa + 0.5 );
-	    blue  = (int) ( maxBlue  * cosa + 0.5 );
-
-	    if ( red   < 0 )	red   = 0;
-	    if ( green < 0 )	green = 0;
-	    if ( blue  < 0 )	blue  = 0;
+	image = QImage( rect.size(), QImage::Format_RGB32 );
+	CushionKernel::renderCushion( shading, rect, image.bits(), image.bytesPerLine() );
 
-	    red	  += ambientLight;
-	    green += ambientLight;
-	    blue  += ambientLight;
+	if ( contrast )
+	    ensureContrast( image );
 
-	    image.setPixel( x, y, qRgb( red, green, blue) );
-	}
+	_parentView->cushionCache()->insert( shading, rect, contrast, image );
     }
 
-    if ( _parentView->ensureContrast() )
-	ensureContrast( image );
-
     return QPixmap::fromImage( image );
 }
 
@@ -578,37 +514,62 @@ QRgb TreemapTile::contrastingColor( QRgb col )
 }
 
 
-QVariant TreemapTile::itemChange( GraphicsItemChange   change,
-				  const QVariant     & value)
+CushionRenderJob::CushionRenderJob( uchar * framebuffer,
+				    int	    bytesPerLine,
+				    bool    ensureContrast ):
+    QRunnable(),
+    _framebuffer( framebuffer ),
+    _bytesPerLine( bytesPerLine ),
+    _ensureContrast( ensureContrast ),
+    _pixels( 0 )
 {
-    // logDebug() << this << endl;
+    setAutoDelete( true );
+}
+
+
+void CushionRenderJob::add( const CushionShading & shading, const QRect & rect )
+{
+    _shadings.append( shading );
+    _rects.append( rect );
+    _pixels += rect.width() * (qint64) rect.height();
+}
+
+
+void CushionRenderJob::addRendered( const QImage & cushion, const QRect & rect )
+{
+    _rendered.append( cushion );
+    _renderedRects.append( rect );
+    _pixels += rect.width() * (qint64) rect.height() / 16;
+}
 
-    if ( change == ItemSelectedChange )
+
+void CushionRenderJob::run()
+{
+    for ( int i=0; i < _renderedRects.size(); ++i )
     {
-	bool selected = value.toBool();
-	// logDebug() << this << ( selected ? " is selected" : " is deselected" ) << endl;
+	const QRect  & rect    = _renderedRects.at( i );
+	const QImage & cushion = _rendered.at( i );
+	uchar * bits = _framebuffer + rect.y() * _bytesPerLine + rect.x() * sizeof( QRgb );
 
-	if ( _orig->hasChildren() )
-	{
-	    if ( ! selected && _highlighter )
-		_highlighter->hide();
+	for ( int y=0; y < rect.height(); ++y )
+	    memcpy( bits + y * _bytesPerLine, cushion.constScanLine( y ), rect.width() * sizeof( QRgb ) );
+    }
 
-	    if ( selected && this != _parentView->rootTile() ) // don't highlight the root tile
-	    {
-		if ( ! _highlighter )
-		{
-		    // logDebug() << "Creating highlighter for " << this << endl;
-		    _highlighter = new SelectedItemHighlighter( this, _parentView->selectedItemsColor() );
-		    CHECK_NEW( _highlighter );
-		}
+    for ( int i=0; i < _rects.size(); ++i )
+    {
+	const QRect & rect = _rects.at( i );
+	uchar * bits = _framebuffer + rect.y() * _bytesPerLine + rect.x() * sizeof( QRgb );
 
-		if ( ! _highlighter->isVisible() )
-		    _highlighter->show();
-	    }
+	CushionKernel::renderCushion( _shadings.at( i ), rect, bits, _bytesPerLine );
+
+	if ( _ensureContrast )
+	{
+	    // A QImage that uses this part of the framebuffer without copying
+
+	    QImage image( bits, rect.width(), rect.height(), _bytesPerLine, QImage::Format_RGB32 );
+	    TreemapTile::ensureContrast( image );
 	}
     }
-
-    return QGraphicsRectItem::itemChange( change, value );
 }
 
 
@@ -732,63 +693,7 @@ void TreemapTile::wheelEvent( QGraphicsSceneWheelEvent * event )
 
 void TreemapTile::contextMenuEvent( QGraphicsSceneContextMenuEvent * event )
 {
-    if ( ! _parentView->selectionModel() )
-	return;
-
-    FileInfoSet selectedItems = _parentView->selectionModel()->selectedItems();
-
-    if ( ! selectedItems.contains( _orig ) )
-    {
-	logDebug() << "Abandoning old selection" << endl;
-	_parentView->selectionModel()->setCurrentItem( _orig, true );
-	selectedItems = _parentView->selectionModel()->selectedItems();
-    }
-
-    if ( _parentView->selectionModel()->verbose() )
-	_parentView->selectionModel()->dumpSelectedItems();
-
-    logDebug() << "Context menu for " << this << endl;
-
-    QMenu menu;
-    QStringList actions;
-    actions << "actionGoUp"
-	    << "actionCopyUrlToClipboard"
-	    << "---"
-	    << "actionTreemapZoomIn"
-	    << "actionTreemapZoomOut"
-	    << "actionResetTreemapZoom"
-	    << "---"
-	    << "actionMoveToTrash"
-	;
-
-    ActionManager::instance()->addActions( &menu, actions );
-
-    if ( _parentView->cleanupCollection() &&
-	 ! _parentView->cleanupCollection()->isEmpty() )
-    {
-	menu.addSeparator();
-	_parentView->cleanupCollection()->addToMenu( &menu );
-    }
-
-    menu.exec( event->screenPos() );
-}
-
-
-void TreemapTile::hoverEnterEvent( QGraphicsSceneHoverEvent * event )
-{
-    Q_UNUSED( event );
-
-    // logDebug() << "Hovering over " << this << endl;
-    _parentView->sendHoverEnter( _orig );
-}
-
-
-void TreemapTile::hoverLeaveEvent( QGraphicsSceneHoverEvent * event )
-{
-    Q_UNUSED( event );
-
-    // logDebug() << "  Leaving " << this << endl;
-    _parentView->sendHoverLeave( _orig );
+    _parentView->showContextMenu( _orig, event->screenPos() );
 }
 
 
@@ -824,6 +729,18 @@ void CushionSurface::addRidge( Orientation dim, double height, const QRectF & re
 }
 
 
+void CushionSurface::rescale( double offsetX, double scaleX, double offsetY, double scaleY )
+{
+    // z = xx2 * x^2 + xx1 * x  with  x = x' / scaleX + offsetX
+
+    _xx1 = ( 2.0 * _xx2 * offsetX + _xx1 ) / scaleX;
+    _xx2 = _xx2 / ( scaleX * scaleX );
+
+    _yy1 = ( 2.0 * _yy2 * offsetY + _yy1 ) / scaleY;
+    _yy2 = _yy2 / ( scaleY * scaleY );
+}
+
+
 double CushionSurface::squareRidge( double squareCoefficient, double height, int x1, int x2 )
 {
     if ( x2 != x1 ) // Avoid division by zero
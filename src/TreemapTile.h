@@ -13,19 +13,22 @@
 
 #include <QGraphicsRectItem>
 #include <QRectF>
+#include <QRunnable>
+#include <QImage>
+#include <QVector>
 
 #include "FileInfoIterator.h"
+#include "CushionKernel.h"
 
 
 class QGraphicsSceneMouseEvent;
-class QGraphicsSceneHoverEvent;
 
 
 namespace QDirStat
 {
     class FileInfo;
     class TreemapView;
-    class HighlightRect;
+    class Squarifier;
 
     enum Orientation
     {
@@ -67,6 +70,18 @@ namespace QDirStat
 	 **/
 	void addRidge( Orientation dim, double height, const QRectF & rect );
 
+	/**
+	 * Adapt this surface to new coordinates
+	 *
+	 *     x' = ( x - offsetX ) * scaleX
+	 *     y' = ( y - offsetY ) * scaleY
+	 *
+	 * so it has the same shape in a rescaled and moved rectangle. Only
+	 * the slope matters for shading, so the constant term that this
+	 * would add is simply left out.
+	 **/
+	void rescale( double offsetX, double scaleX, double offsetY, double scaleY );
+
 	/**
 	 * Set the cushion's height.
 	 **/
@@ -180,6 +195,19 @@ namespace QDirStat
 	 **/
 	TreemapView * parentView() const { return _parentView; }
 
+	/**
+	 * Returns the number of bytes of the cushion pixmap of this tile or
+	 * 0 if it doesn't have one (yet).
+	 **/
+	qint64 cushionBytes() const
+	    { return (qint64) _cushion.width() * _cushion.height() * _cushion.depth() / 8; }
+
+	/**
+	 * Drop the cushion pixmap of this tile to save memory. It is rendered
+	 * again when the tile is painted the next time.
+	 **/
+	void dropCushion() { _cushion = QPixmap(); }
+
 	/**
 	 * Returns the parent @ref TreemapTile or 0 if there is none.
 	 **/
@@ -190,6 +218,33 @@ namespace QDirStat
 	 **/
 	CushionSurface & cushionSurface() { return _cushionSurface; }
 
+	/**
+	 * Return the parameters for rendering the cushion of this tile:
+	 * The cushion surface, the light source of the parent view and the
+	 * tile color. This needs the MimeCategorizer, so it has to be called
+	 * from the GUI thread.
+	 **/
+	CushionShading cushionShading();
+
+	/**
+	 * Return the rectangle of the cushion of this tile in treemap
+	 * coordinates (whole pixels).
+	 **/
+	QRect cushionRect() const;
+
+	/**
+	 * Check if the contrast of the specified image is sufficient to
+	 * visually distinguish an outline at the right and bottom borders
+	 * and add a grey line there, if necessary.
+	 **/
+	static void ensureContrast( QImage & image );
+
+	/**
+	 * Returns a color that gives a reasonable contrast to 'col': Lighter
+	 * if 'col' is dark, darker if 'col' is light.
+	 **/
+	static QRgb contrastingColor( QRgb col );
+
 
     protected:
 
@@ -238,25 +293,17 @@ namespace QDirStat
 	void createSquarifiedChildren( const QRectF & rect );
 
 	/**
-	 * Squarify as many children as possible: Try to squeeze members
-	 * referred to by 'it' into 'rect' until the aspect ratio doesn't get
-	 * better any more. Returns a list of children that should be laid out
-	 * in 'rect'. Moves 'it' until there is no more improvement or 'it'
-	 * runs out of items.
-	 *
-	 * 'scale' is the scaling factor between file sizes and pixels.
+	 * Lay out the row of 'children' from 'first' to 'end' (excluding)
+	 * within 'rect' along its longer side. 'squarifier' has the sizes of
+	 * 'children'. Returns the new rectangle with the layouted area
+	 * subtracted.
 	 **/
-	FileInfoList squarify( const QRectF & rect,
-			       double	     scale,
-			       FileInfoSortedBySizeIterator & it   );
-
-	/**
-	 * Lay out all members of 'row' within 'rect' along its longer side.
-	 * Returns the new rectangle with the layouted area subtracted.
-	 **/
-	QRectF layoutRow( const QRectF	& rect,
-			  double	  scale,
-			  FileInfoList	& row );
+	QRectF layoutRow( const QRectF	     & rect,
+			  double	       scale,
+			  const FileInfoList & children,
+			  const Squarifier   & squarifier,
+			  int		       first,
+			  int		       end );
 
 	/**
 	 * Paint this tile.
@@ -267,15 +314,6 @@ namespace QDirStat
 			    const QStyleOptionGraphicsItem * option,
 			    QWidget			   * widget = 0) Q_DECL_OVERRIDE;
 
-	/**
-	 * Notification that item attributes (such as the 'selected' state)
-	 * have changed.
-	 *
-	 * Reimplemented from QGraphicsItem.
-	 **/
-	virtual QVariant itemChange( GraphicsItemChange	  change,
-				     const QVariant	& value) Q_DECL_OVERRIDE;
-
 	/**
 	 * Mouse press event: Handle setting the current item.
 	 *
@@ -314,39 +352,12 @@ namespace QDirStat
 	 **/
 	virtual void contextMenuEvent( QGraphicsSceneContextMenuEvent * event ) Q_DECL_OVERRIDE;
 
-        /**
-         * Hover enter event.
-	 *
-	 * Reimplemented from QGraphicsItem.
-         **/
-        virtual void hoverEnterEvent( QGraphicsSceneHoverEvent * event ) Q_DECL_OVERRIDE;
-
-        /**
-         * Hover enter event.
-	 *
-	 * Reimplemented from QGraphicsItem.
-         **/
-        virtual void hoverLeaveEvent( QGraphicsSceneHoverEvent * event ) Q_DECL_OVERRIDE;
-
 	/**
 	 * Render a cushion as described in "cushioned treemaps" by Jarke
 	 * J. van Wijk and Huub van de Wetering	 of the TU Eindhoven, NL.
 	 **/
 	QPixmap renderCushion();
 
-	/**
-	 * Check if the contrast of the specified image is sufficient to
-	 * visually distinguish an outline at the right and bottom borders
-	 * and add a grey line there, if necessary.
-	 **/
-	void ensureContrast( QImage & image );
-
-	/**
-	 * Returns a color that gives a reasonable contrast to 'col': Lighter
-	 * if 'col' is dark, darker if 'col' is light.
-	 **/
-	QRgb contrastingColor( QRgb col );
-
     private:
 
 	/**
@@ -364,12 +375,73 @@ namespace QDirStat
 	FileInfo *	_orig;
 	CushionSurface	_cushionSurface;
 	QPixmap		_cushion;
-	HighlightRect * _highlighter;
 
     }; // class TreemapTile
 
 
 
+    /**
+     * Job for rendering the cushions of a number of tiles into a shared
+     * framebuffer in a QThreadPool. The tiles must not overlap, so
+     * several of these jobs can work on the same framebuffer at the same
+     * time.
+     *
+     * All information about the tiles is collected in the GUI thread in
+     * advance; this job doesn't access any tiles or FileInfo nodes.
+     **/
+    class CushionRenderJob: public QRunnable
+    {
+    public:
+
+	/**
+	 * Constructor. 'framebuffer' is the start of the RGB32 pixel buffer
+	 * for the complete treemap with 'bytesPerLine' bytes per row.
+	 **/
+	CushionRenderJob( uchar * framebuffer,
+			  int	  bytesPerLine,
+			  bool	  ensureContrast );
+
+	/**
+	 * Add a tile with 'shading' and 'rect' to render.
+	 **/
+	void add( const CushionShading & shading, const QRect & rect );
+
+	/**
+	 * Add a cushion that is already rendered to copy to 'rect'.
+	 **/
+	void addRendered( const QImage & cushion, const QRect & rect );
+
+	/**
+	 * Return the number of pixels this job will render. Copying a
+	 * cushion only counts for a fraction of its size.
+	 **/
+	qint64 pixels() const { return _pixels; }
+
+	/**
+	 * Return 'true' if this job has nothing to do.
+	 **/
+	bool isEmpty() const { return _rects.isEmpty() && _renderedRects.isEmpty(); }
+
+	/**
+	 * Render all tiles. Reimplemented from QRunnable.
+	 **/
+	virtual void run() Q_DECL_OVERRIDE;
+
+
+    protected:
+
+	uchar *			_framebuffer;
+	int			_bytesPerLine;
+	bool			_ensureContrast;
+	QVector<CushionShading> _shadings;
+	QVector<QRect>		_rects;
+	QVector<QImage>		_rendered;
+	QVector<QRect>		_renderedRects;
+	qint64			_pixels;
+    };
+
+
+
     inline QTextStream & operator<< ( QTextStream & stream, TreemapTile * tile )
     {
 	if ( tile )
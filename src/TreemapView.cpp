@@ -10,9 +10,21 @@
 #include <QResizeEvent>
 #include <QRegExp>
 #include <QTimer>
+#include <QPainter>
+#include <QElapsedTimer>
+#include <QMouseEvent>
+#include <QWheelEvent>
+#include <QContextMenuEvent>
+#include <QMenu>
+
+#ifdef HAVE_TREEMAP_GL
+#  include <QOpenGLWidget>
+#  include <QSurfaceFormat>
+#endif
 
 #include "TreemapView.h"
 #include "DirTree.h"
+#include "CacheDiff.h"
 #include "Exception.h"
 #include "Logger.h"
 #include "SelectionModel.h"
@@ -20,11 +32,32 @@
 #include "SettingsHelpers.h"
 #include "SignalBlocker.h"
 #include "TreemapTile.h"
+#include "TreemapLayout.h"
+#include "TreemapGLRenderer.h"
 #include "MimeCategorizer.h"
 #include "DelayedRebuilder.h"
+#include "ActionManager.h"
+#include "CleanupCollection.h"
+#include "MemoryStats.h"
 
 #define UpdateMinSize	      20
 
+// Number of complete flat layouts to keep for reusing them
+#define LayoutCacheSize	      3
+
+// Range of scale factors for reusing a cached flat layout after a resize.
+// Shrinking a layout is harmless, but growing it too much would make the
+// lack of detail obvious.
+#define MinLayoutRescale      0.5
+#define MaxLayoutRescale      1.25
+
+// Maximum difference of aspect ratios for reusing a cached flat layout
+#define MaxAspectRatioDiff    0.05
+
+// Number of cushion render jobs per thread. More jobs than threads are
+// better for balancing the load since tiles have very different sizes.
+#define RenderJobsPerThread   4
+
 using namespace QDirStat;
 
 
@@ -38,15 +71,43 @@ TreemapView::TreemapView( QWidget * parent ):
     _rebuilder(0),
     _rootTile(0),
     _currentItem(0),
-    _currentItemRect(0),
+    _hoverTile(0),
     _newRoot(0),
     _useFixedColor(false),
-    _useDirGradient(true)
+    _useDirGradient(true),
+    _flatRenderer(false),
+    _summaryTiles(false),
+    _useOpenGL(false),
+    _layout(0),
+    _flatCurrentItem(-1),
+    _flatHoverItem(-1),
+    _layoutResult(0),
+    _layoutPreview(false),
+    _incrementalUpdate(false)
 {
     // logDebug() << endl;
 
+#ifdef HAVE_TREEMAP_GL
+    _glViewport	      = 0;
+    _glRenderer	      = 0;
+    _glInstancesDirty = true;
+#endif
+
     readSettings();
 
+    _layout = new TreemapLayout();
+    CHECK_NEW( _layout );
+
+    if ( _flatRenderer )
+    {
+	setupOpenGL();
+
+	// Without any hover items in the scene, QGraphicsView doesn't
+	// enable this for the viewport.
+
+	viewport()->setMouseTracking( true );
+    }
+
     // Default values for light sources taken from Wiik / Wetering's paper
     // about "cushion treemaps".
 
@@ -62,6 +123,9 @@ TreemapView::TreemapView( QWidget * parent ):
 
     connect( _rebuilder, SIGNAL( rebuild() ),
              this,       SLOT  ( rebuildTreemapDelayed() ) );
+
+    connect( _rebuilder, SIGNAL( cancelRebuild() ),
+             this,       SLOT  ( cancelLayout()	 ) );
 }
 
 
@@ -71,6 +135,23 @@ TreemapView::~TreemapView()
     // There is no settings dialog for this class because the settings are all
     // pretty obscure - strictly for experts.
     writeSettings();
+
+    // Don't let any layout worker continue after this view is gone.
+
+    cancelLayout();
+    _layoutPool.waitForDone();
+    delete _layout;
+
+#ifdef HAVE_TREEMAP_GL
+    if ( _glRenderer )
+    {
+	// The OpenGL resources can only be freed with the context current
+
+	_glViewport->makeCurrent();
+	delete _glRenderer;
+	_glViewport->doneCurrent();
+    }
+#endif
 }
 
 
@@ -79,9 +160,35 @@ void TreemapView::clear()
     if ( scene() )
 	qDeleteAll( scene()->items() );
 
+    _tileIndex.clear();
     _currentItem     = 0;
-    _currentItemRect = 0;
+    _hoverTile	     = 0;
     _rootTile	     = 0;
+    _cushionFramebuffer = QImage();
+    cancelLayout();
+    _layoutPreview     = false;
+    _incrementalUpdate = false;
+    _pendingRelayouts.clear();
+
+#ifdef HAVE_TREEMAP_GL
+    _glInstancesDirty = true;
+#endif
+
+    if ( _layout )
+	_layout->clear();
+
+    _flatCurrentItem = -1;
+    _flatHoverItem   = -1;
+    _flatSelectedItems.clear();
+}
+
+
+FileInfo * TreemapView::treemapRoot() const
+{
+    if ( _rootTile )
+	return _rootTile->orig();
+
+    return _layout ? _layout->root() : 0;
 }
 
 
@@ -95,7 +202,7 @@ void TreemapView::setDirTree( DirTree * newTree )
 
     if ( _tree->firstToplevel() )
     {
-	if ( ! _rootTile )
+	if ( ! treemapRoot() )
 	{
 	    // The treemap might already be created indirectly by
 	    // rebuildTreemap() called from resizeEvent() triggered by resize()
@@ -108,8 +215,23 @@ void TreemapView::setDirTree( DirTree * newTree )
     connect( _tree, SIGNAL( deletingChild   ( FileInfo * )  ),
 	     this,  SLOT  ( deleteNotify    ( FileInfo * ) ) );
 
-    connect( _tree, SIGNAL( childDeleted()   ),
-	     this,  SLOT  ( rebuildTreemap() ) );
+    connect( _tree, SIGNAL( clearing()	       ),
+	     this,  SLOT  ( clearLayoutCache() ) );
+
+    connect( _tree, SIGNAL( clearingSubtree ( DirInfo * ) ),
+	     this,  SLOT  ( clearLayoutCache()	       ) );
+
+    connect( _tree, SIGNAL( startingReading() ),
+	     this,  SLOT  ( clearLayoutCache() ) );
+
+    connect( _tree, SIGNAL( cacheDiffChanged() ),
+	     this,  SLOT  ( rebuildTreemap()   ) );
+
+    connect( _tree, SIGNAL( childDeleted()	 ),
+	     this,  SLOT  ( childDeletedNotify() ) );
+
+    connect( _tree, SIGNAL( collectingUsedNodes( QDirStat::UsedNodes * ) ),
+	     this,  SLOT  ( collectUsedNodes   ( QDirStat::UsedNodes * ) ) );
 
     connect( _tree, SIGNAL( clearing() ),
 	     this,  SLOT  ( clear()    ) );
@@ -164,6 +286,9 @@ void TreemapView::readSettings()
     _forceCushionGrid	= settings.value( "ForceCushionGrid" , false ).toBool();
     _useDirGradient     = settings.value( "UseDirGradient"   , true  ).toBool();
     _minTileSize	= settings.value( "MinTileSize"	     , DefaultMinTileSize ).toInt();
+    _flatRenderer	= settings.value( "FlatRenderer"     , false ).toBool();
+    _summaryTiles	= settings.value( "SummaryTiles"     , false ).toBool();
+    _useOpenGL		= settings.value( "OpenGL"	     , false ).toBool();
 
     _currentItemColor	= readColorEntry( settings, "CurrentItemColor"	, Qt::red		     );
     _selectedItemsColor = readColorEntry( settings, "SelectedItemsColor", Qt::yellow		     );
@@ -193,6 +318,9 @@ void TreemapView::writeSettings()
     settings.setValue( "ForceCushionGrid"  , _forceCushionGrid	 );
     settings.setValue( "UseDirGradient"    , _useDirGradient     );
     settings.setValue( "MinTileSize"	   , _minTileSize	 );
+    settings.setValue( "FlatRenderer"	   , _flatRenderer	 );
+    settings.setValue( "SummaryTiles"	   , _summaryTiles	 );
+    settings.setValue( "OpenGL"		   , _useOpenGL		 );
 
     writeColorEntry( settings, "CurrentItemColor"  , _currentItemColor	 );
     writeColorEntry( settings, "SelectedItemsColor", _selectedItemsColor );
@@ -212,6 +340,12 @@ void TreemapView::zoomIn()
     if ( ! canZoomIn() )
 	return;
 
+    if ( _flatRenderer )
+    {
+	rebuildTreemap( _layout->item( flatZoomInItem() ).orig );
+	return;
+    }
+
     TreemapTile * newRootTile = _currentItem;
 
     while ( newRootTile &&
@@ -236,7 +370,7 @@ void TreemapView::zoomOut()
     if ( ! canZoomOut() )
 	return;
 
-    FileInfo * newRoot = _rootTile->orig();
+    FileInfo * newRoot = treemapRoot();
 
     if ( newRoot->parent() && newRoot->parent() != _tree->root() )
 	newRoot = newRoot->parent();
@@ -254,6 +388,9 @@ void TreemapView::resetZoom()
 
 bool TreemapView::canZoomIn() const
 {
+    if ( _flatRenderer )
+	return flatZoomInItem() >= 0;
+
     if ( ! _currentItem || ! _rootTile )
 	return false;
 
@@ -282,15 +419,40 @@ bool TreemapView::canZoomIn() const
 
 bool TreemapView::canZoomOut() const
 {
-    if ( ! _rootTile || ! _tree->firstToplevel() )
+    if ( ! treemapRoot() || ! _tree->firstToplevel() )
 	return false;
 
-    return _rootTile->orig() != _tree->firstToplevel();
+    return treemapRoot() != _tree->firstToplevel();
+}
+
+
+int TreemapView::flatZoomInItem() const
+{
+    // Item no. 0 is the root; zooming in to that doesn't make sense.
+
+    int index = _flatCurrentItem;
+
+    if ( index <= 0 )
+	return -1;
+
+    while ( _layout->item( index ).parent > 0 )
+	index = _layout->item( index ).parent;
+
+    FileInfo * newRoot = _layout->item( index ).orig;
+
+    if ( newRoot->isDir() || newRoot->isDotEntry() )
+	return index;
+
+    return -1;
 }
 
 
 void TreemapView::rebuildTreemap()
 {
+    // This is also what is called when the tree changed, so any cached
+    // layout might be outdated.
+
+    clearLayoutCache();
     FileInfo * root = 0;
 
     if ( ! _savedRootUrl.isEmpty() )
@@ -301,7 +463,7 @@ void TreemapView::rebuildTreemap()
     }
 
     if ( ! root )
-	root = _rootTile ? _rootTile->orig() : _tree->firstToplevel();
+	root = treemapRoot() ? treemapRoot() : _tree->firstToplevel();
 
     rebuildTreemap( root, sceneRect().size() );
     _savedRootUrl = "";
@@ -327,6 +489,13 @@ void TreemapView::rebuildTreemap( FileInfo *	 newRoot,
     {
 	QGraphicsScene * scene = new QGraphicsScene( this );
 	CHECK_NEW( scene);
+
+	// The tiles never move; the whole scene is rebuilt for any change.
+	// Building an index for hundreds of thousands of tiles each time
+	// does not pay off: Hovering finds its tile with tileAt(), and the
+	// highlight frames are not items in the scene.
+
+	scene->setItemIndexMethod( QGraphicsScene::NoIndex );
 	setScene( scene );
     }
 
@@ -342,13 +511,24 @@ void TreemapView::rebuildTreemap( FileInfo *	 newRoot,
 
 	// Fill the new scene
 
-	if ( newRoot )
+	if ( newRoot && _flatRenderer )
+	{
+	    // The layout is computed in the background and displayed level
+	    // by level as it comes in - unless a cached one can be used.
+
+	    if ( ! reuseLayout( newRoot, rect.toRect() ) )
+		startLayout( newRoot, rect );
+	}
+	else if ( newRoot )
 	{
 	    _rootTile = new TreemapTile( this,		// parentView
 					 0,		// parentTile
 					 newRoot,	// orig
 					 rect,
 					 TreemapAuto );
+
+	    if ( _doCushionShading )
+		renderCushions();
 	}
 
 
@@ -371,6 +551,11 @@ void TreemapView::rebuildTreemap( FileInfo *	 newRoot,
 
 void TreemapView::scheduleRebuildTreemap( FileInfo * newRoot )
 {
+    // A newer rebuild is coming, so the layout that is still being
+    // computed won't be needed anymore. The rebuilder cancels the ones it
+    // started, but this might also be from a direct rebuildTreemap().
+
+    cancelLayout();
     _newRoot = newRoot;
     _rebuilder->scheduleRebuild();
 }
@@ -379,14 +564,25 @@ void TreemapView::scheduleRebuildTreemap( FileInfo * newRoot )
 void TreemapView::rebuildTreemapDelayed()
 {
     rebuildTreemap( _newRoot );
+
+    // The flat layout continues in the worker thread; the rebuilder
+    // should count that, too, to adapt its delay.
+
+    if ( _layoutResult )
+	_rebuilder->rebuildInBackground();
 }
 
 
-void TreemapView::deleteNotify( FileInfo * )
+void TreemapView::deleteNotify( FileInfo * deletedChild )
 {
-    if ( _rootTile )
+    clearLayoutCache();
+
+    if ( prepareIncrementalUpdate( deletedChild ) )
+	return;
+
+    if ( treemapRoot() )
     {
-	if ( _rootTile->orig() != _tree->firstToplevel() )
+	if ( treemapRoot() != _tree->firstToplevel() )
 	{
 	    // If the user zoomed the treemap in, save the root's URL so the
 	    // current state can be restored upon the next rebuildTreemap()
@@ -397,7 +593,7 @@ void TreemapView::deleteNotify( FileInfo * )
 	    // the correct zoom can be restored even when a dot entry is the
 	    // current treemap root.
 
-	    _savedRootUrl = _rootTile->orig()->debugUrl();
+	    _savedRootUrl = treemapRoot()->debugUrl();
 	}
 	else
 	{
@@ -419,6 +615,44 @@ void TreemapView::deleteNotify( FileInfo * )
 }
 
 
+void TreemapView::childDeletedNotify()
+{
+    if ( _incrementalUpdate )
+	incrementalUpdate();
+    else
+	rebuildTreemap();
+}
+
+
+void TreemapView::collectUsedNodes( UsedNodes * usedNodes )
+{
+    // The worker thread walks the tree nodes of its snapshot, and a
+    // scheduled rebuild still has its new root
+
+    if ( _layoutResult || _rebuilder->pendingRebuildCount() > 0 )
+    {
+	usedNodes->busy = true;
+	return;
+    }
+
+    for ( QHash<const FileInfo *, TreemapTile *>::const_iterator it = _tileIndex.constBegin();
+	  it != _tileIndex.constEnd();
+	  ++it )
+    {
+	usedNodes->nodes.insert( const_cast<FileInfo *>( it.key() ) );
+    }
+
+    if ( _layout )
+    {
+	foreach ( const TreemapLayoutItem & item, _layout->items() )
+	    usedNodes->nodes.insert( item.orig );
+    }
+
+    foreach ( FileInfo * node, _pendingRelayouts.keys() )
+	usedNodes->nodes.insert( node );
+}
+
+
 void TreemapView::resizeEvent( QResizeEvent * event )
 {
     // logDebug() << endl;
@@ -430,12 +664,14 @@ void TreemapView::resizeEvent( QResizeEvent * event )
     bool tooSmall = event->size().width()  < UpdateMinSize ||
 		    event->size().height() < UpdateMinSize;
 
-    if ( tooSmall && _rootTile )
+    FileInfo * root = treemapRoot();
+
+    if ( tooSmall && root )
     {
 	// logDebug() << "Suppressing treemap contents" << endl;
-	scheduleRebuildTreemap( _rootTile->orig() );
+	scheduleRebuildTreemap( root );
     }
-    else if ( ! tooSmall && ! _rootTile )
+    else if ( ! tooSmall && ! root )
     {
 	if ( _tree && _tree->firstToplevel() )
 	{
@@ -443,216 +679,1506 @@ void TreemapView::resizeEvent( QResizeEvent * event )
 	    scheduleRebuildTreemap( _tree->firstToplevel() );
 	}
     }
-    else if ( _rootTile )
+    else if ( root )
     {
 	// logDebug() << "Auto-resizing treemap" << endl;
-	scheduleRebuildTreemap( _rootTile->orig() );
+	scheduleRebuildTreemap( root );
     }
 }
 
 
-void TreemapView::disable()
+void TreemapView::renderCushions()
 {
-    // logDebug() << "Disabling treemap view" << endl;
+    QElapsedTimer timer;
+    timer.start();
 
-    clear();
-    resize( width(), 1 );
-    hide();
+    QSize size = sceneRect().size().toSize();
+    QImage framebuffer( size, QImage::Format_RGB32 );
 
-    emit treemapChanged();
-}
+    if ( framebuffer.isNull() || ! _rootTile )
+	return;
 
+    framebuffer.fill( QColor( 0x60, 0x60, 0x60 ).rgb() );
+    QList<CushionRenderJob *> jobs = createRenderJobs( framebuffer );
 
-void TreemapView::enable()
-{
-    if ( ! isVisible() )
+
+    // Walk the tiles parents first: Paint the directories right away just
+    // like TreemapTile::paint() would, and distribute the leaf tiles to
+    // the render jobs.
+
+    QPainter painter( &framebuffer );
+    QList<TreemapTile *> tiles;
+    tiles << _rootTile;
+    int leafTiles = 0;
+    int cachedTiles = 0;
+
+    while ( ! tiles.isEmpty() )
     {
-	// logDebug() << "Enabling treemap view" << endl;
-	show();
-	QWidget * parentWidget = qobject_cast<QWidget *>( parent() );
+	TreemapTile * tile = tiles.takeFirst();
+	QRect rect = tile->cushionRect().intersected( framebuffer.rect() );
 
-	if ( parentWidget )
-	    resize( parentWidget->height(), width() );
+	if ( ! rect.isEmpty() )
+	{
+	    if ( tile->orig()->isDir() || tile->orig()->isDotEntry() )
+	    {
+		if ( tile->brush().style() != Qt::NoBrush )
+		    painter.fillRect( tile->rect(), tile->brush() );
+	    }
+	    else
+	    {
+		if ( addToRenderJob( jobs, tile->cushionShading(), rect ) )
+		    ++cachedTiles;
 
-	scheduleRebuildTreemap( _tree->firstToplevel() );
+		++leafTiles;
+	    }
+	}
+
+	foreach ( QGraphicsItem * child, tile->childItems() )
+	{
+	    TreemapTile * childTile = dynamic_cast<TreemapTile *>( child );
+
+	    if ( childTile )
+		tiles << childTile;
+	}
     }
+
+    painter.end();
+    runRenderJobs( jobs, framebuffer );
+    _cushionFramebuffer = framebuffer;
+
+    logDebug() << leafTiles << " cushions (" << cachedTiles << " from the cache)"
+	       << " rendered in " << timer.elapsed() << " ms"
+	       << " with " << _renderPool.maxThreadCount() << " threads (" << CushionKernel::name() << ")"
+	       << endl;
 }
 
 
-void TreemapView::setCurrentItem( TreemapTile * tile )
+void TreemapView::addMemoryUsage( MemoryUsage & usage ) const
 {
-    // logDebug() << tile << endl;
+    // Each QGraphicsItem also has a private d-pointer object of roughly
+    // this size that sizeof() doesn't see.
 
-    TreemapTile * oldCurrent = _currentItem;
-    _currentItem = tile;
+    const int graphicsItemPrivate = 256;
 
-    if ( _currentItem )
+    QList<TreemapTile *> tiles;
+
+    if ( _rootTile )
+	tiles << _rootTile;
+
+    while ( ! tiles.isEmpty() )
     {
-	if ( ! _currentItemRect )
-	    _currentItemRect = new CurrentItemHighlighter( scene(), _currentItemColor );
+	TreemapTile * tile = tiles.takeFirst();
+
+	++usage.treemapItems;
+	usage.treemapItemBytes	 += sizeof( TreemapTile ) + graphicsItemPrivate;
+	usage.treemapPixmapBytes += tile->cushionBytes();
+
+	foreach ( QGraphicsItem * child, tile->childItems() )
+	{
+	    TreemapTile * childTile = dynamic_cast<TreemapTile *>( child );
+
+	    if ( childTile )
+		tiles << childTile;
+	}
     }
 
-    if ( _currentItemRect )
+    const int hashNode = 32;	// Key, value, hash and next pointer, see DirInfo
+    usage.treemapItemBytes += _tileIndex.size() * hashNode;
+
+    if ( _layout )
     {
-	if ( _currentItem == _rootTile )
-	    _currentItemRect->hide(); // Don't highlight the root tile
-	else
-	    _currentItemRect->highlight( _currentItem );
+	usage.treemapItems     += _layout->size();
+	usage.treemapItemBytes += _layout->size() * sizeof( TreemapLayoutItem );
     }
 
-    if ( oldCurrent != _currentItem && _selectionModelProxy )
-    {
-	// logDebug() << "Sending currentItemChanged " << _currentItem << endl;
+    foreach ( const TreemapLayoutCacheEntry & entry, _layoutCache )
+	usage.treemapItemBytes += entry.items.size() * sizeof( TreemapLayoutItem );
 
-	SignalBlocker sigBlocker( _selectionModelProxy ); // Prevent signal ping-pong
-	emit currentItemChanged( _currentItem ? _currentItem->orig() : 0 );
-    }
+    usage.treemapPixmapBytes += (qint64) _cushionFramebuffer.bytesPerLine() * _cushionFramebuffer.height();
+    usage.treemapPixmapBytes += _cushionCache.bytes();
 }
 
 
-void TreemapView::setCurrentItem( FileInfo * node )
+void TreemapView::renderFlatItems( int first, int last )
 {
-    // logDebug() << node << endl;
+#ifdef HAVE_TREEMAP_GL
+    if ( useOpenGL() )
+    {
+	// All the (changed) items are uploaded in one go with the next
+	// paint event.
+
+	_glInstancesDirty = true;
+	return;
+    }
+#endif
 
-    if ( node && _rootTile )
+    if ( _cushionFramebuffer.isNull() )
     {
-	FileInfo * treemapRoot = _rootTile->orig();
+	QSize size = sceneRect().size().toSize();
+	_cushionFramebuffer = QImage( size, QImage::Format_RGB32 );
 
-	// Check if the new current item is inside the current treemap
-	// (it might be zoomed).
+	if ( _cushionFramebuffer.isNull() )
+	    return;
 
-	while ( ! node->isInSubtree( treemapRoot ) &&
-		treemapRoot->parent() &&
-		treemapRoot->parent() != _tree->root() )
+	_cushionFramebuffer.fill( QColor( 0x60, 0x60, 0x60 ).rgb() );
+    }
+
+    QList<CushionRenderJob *> jobs;
+
+    if ( _doCushionShading )
+	jobs = createRenderJobs( _cushionFramebuffer );
+
+
+    // The layout is in breadth-first order, so painting the items in that
+    // order paints the children on top of their parents; that's also why
+    // each new level can simply be painted over the previous ones.
+
+    QRect bounds = _cushionFramebuffer.rect();
+    QPainter painter( &_cushionFramebuffer );
+    painter.setPen( _doCushionShading ? QPen( Qt::NoPen ) : QPen( _outlineColor, 1 ) );
+
+    for ( int i = first; i < last; ++i )
+    {
+	const TreemapLayoutItem & item = _layout->item( i );
+	QRect rect = item.rect.intersected( bounds );
+
+	if ( rect.isEmpty() )
+	    continue;
+
+	bool isDir = ! item.summary && ( item.orig->isDir() || item.orig->isDotEntry() );
+
+	if ( _doCushionShading )
 	{
-	    treemapRoot = treemapRoot->parent(); // try one level higher
-	}
+	    if ( isDir )
+	    {
+		QBrush brush = dirBrush( item.rect );
 
-	if ( treemapRoot != _rootTile->orig() )	  // need to zoom out?
+		if ( brush.style() != Qt::NoBrush )
+		    painter.fillRect( item.rect, brush );
+	    }
+	    else
+	    {
+		addToRenderJob( jobs, cushionShading( item.orig, item.cushionSurface ), rect );
+	    }
+	}
+	else	// No cushion shading, use plain tiles
 	{
-	    logDebug() << "Zooming out to " << treemapRoot << " to make current item visible" << endl;
-	    rebuildTreemap( treemapRoot );
+	    if ( isDir )
+		painter.setBrush( _useDirGradient ? dirBrush( item.rect ) : QBrush( _dirFillColor ) );
+	    else
+		painter.setBrush( tileColor( item.orig ) );
+
+	    painter.drawRect( QRectF( item.rect ) );
 	}
     }
 
-    setCurrentItem( findTile( node ) );
-}
+    painter.end();
+    runRenderJobs( jobs, _cushionFramebuffer );
 
+    if ( _doCushionShading && _forceCushionGrid )
+    {
+	// Draw a clearly visible boundary on top of the cushions
 
-void TreemapView::updateSelection( const FileInfoSet & newSelection )
-{
-    if ( ! scene() )
-	return;
+	QPainter gridPainter( &_cushionFramebuffer );
+	gridPainter.setPen( QPen( _cushionGridColor, 1 ) );
 
-    // logDebug() << newSelection.size() << " items selected" << endl;
-    SignalBlocker sigBlocker( this );
-    scene()->clearSelection();
+	for ( int i = first; i < last; ++i )
+	{
+	    const TreemapLayoutItem & item = _layout->item( i );
 
-    foreach ( const FileInfo * item, newSelection )
-    {
-	// logDebug() << "	 Selected: " << item << endl;
-	TreemapTile * tile = findTile( item );
+	    if ( ! item.summary && ( item.orig->isDir() || item.orig->isDotEntry() ) )
+		continue;
 
-	if ( tile )
-	    tile->setSelected( true );
-    }
+	    const QRect & rect = item.rect;
 
-    updateCurrentItem( _currentItem ? _currentItem->orig() : 0 );
+	    if ( rect.x() > 0 )
+		gridPainter.drawLine( rect.x(), rect.y(), rect.x(), rect.y() + rect.height() );
+
+	    if ( rect.y() > 0 )
+		gridPainter.drawLine( rect.x(), rect.y(), rect.x() + rect.width(), rect.y() );
+	}
+    }
 }
 
 
-void TreemapView::sendSelection()
+void TreemapView::startLayout( FileInfo * newRoot, const QRectF & rect )
 {
-    if ( ! scene() || ! _selectionModel )
-	return;
+    cancelLayout();
+    _layoutTimer.start();
+    _layout->begin( newRoot );
 
-    SignalBlocker sigBlocker( _selectionModelProxy );
-    QList<QGraphicsItem *> selectedTiles = scene()->selectedItems();
+    // Taking the snapshot has to be done here in the main thread.
 
-    if ( selectedTiles.size() == 1 && selectedTiles.first() == _currentItem )
-    {
-	// This is the most common case: One tile is selected.
-	// Reduce number of signals in that case.
+    _layoutResult = new TreemapLayoutResult( this, newRoot, rect );
+    CHECK_NEW( _layoutResult );
 
-	_selectionModel->setCurrentItem( _currentItem->orig(),
-					 true ); // select
-    }
-    else // Multi-selection
-    {
-	FileInfoSet selectedItems;
+    connect( _layoutResult, SIGNAL( levelDone()	     ),
+	     this,	    SLOT  ( layoutLevelDone() ),
+	     Qt::QueuedConnection );
 
-	foreach ( QGraphicsItem * item, selectedTiles )
-	{
-	    TreemapTile * tile = dynamic_cast<TreemapTile *>( item );
+    connect( _layoutResult, SIGNAL( done()	 ),
+	     this,	    SLOT  ( layoutDone() ),
+	     Qt::QueuedConnection );
 
-	    if ( tile )
-		selectedItems << tile->orig();
-	}
+    TreemapLayoutWorker * worker = new TreemapLayoutWorker( _layoutResult );
+    CHECK_NEW( worker );
+    _layoutPool.start( worker );	// The thread pool takes ownership
+}
 
-	_selectionModel->setSelectedItems( selectedItems );
-	_selectionModel->setCurrentItem( _currentItem ? _currentItem->orig() : 0 );
+
+void TreemapView::cancelLayout()
+{
+    if ( _layoutResult )
+    {
+	// The result is deleted when its done() signal arrives.
+
+	_layoutResult->cancel();
+	_layoutResult = 0;
     }
 }
 
 
-void TreemapView::updateCurrentItem( FileInfo * currentItem )
+void TreemapView::layoutLevelDone()
 {
-    if ( ! scene() )
-	return;
+    TreemapLayoutResult * result = qobject_cast<TreemapLayoutResult *>( sender() );
 
-    SignalBlocker sigBlocker( this );
-    setCurrentItem( currentItem );
+    if ( result && result == _layoutResult )
+	addLayoutLevels( result );
 }
 
 
-
-TreemapTile * TreemapView::findTile( const FileInfo * fileInfo )
+void TreemapView::layoutDone()
 {
-    if ( ! fileInfo || ! scene() )
-	return 0;
+    TreemapLayoutResult * result = qobject_cast<TreemapLayoutResult *>( sender() );
 
-    foreach ( QGraphicsItem * graphicsItem, scene()->items() )
+    if ( ! result )
+	return;
+
+    result->deleteLater();
+
+    if ( result != _layoutResult )	// Canceled
+	return;
+
+    addLayoutLevels( result );
+    _layoutResult = 0;
+    _layout->finish();
+    cacheLayout();
+    _rebuilder->rebuildFinished();
+
+    if ( _layoutPreview )
     {
-	TreemapTile * tile = dynamic_cast<TreemapTile *>(graphicsItem);
+	// Now replace the preview
 
-	if ( tile && tile->orig() == fileInfo )
-	    return tile;
+	_layoutPreview = false;
+	_cushionFramebuffer = QImage();
+	renderFlatItems( 0, _layout->size() );
+	viewport()->update();
     }
 
-    return 0;
-}
+    logDebug() << _layout->size() << " layout items in " << _layoutTimer.elapsed() << " ms"
+	       << " with " << _renderPool.maxThreadCount() << " render threads (" << CushionKernel::name() << ")"
+	       << endl;
 
+    // Now that there is a complete layout, synchronize the selection with
+    // the other views. This couldn't be done when rebuilding started.
 
-QSize TreemapView::visibleSize()
-{
-    QSize size = viewport()->size();
-    // logDebug() << "Visible size: " << size.width() << " x " << size.height() << endl;
+    if ( _selectionModel )
+    {
+	updateSelection( _selectionModel->selectedItems() );
+	updateCurrentItem( _selectionModel->currentItem() );
+    }
 
-    return size;
+    emit treemapChanged();
 }
 
 
-void TreemapView::setMimeCategorizer( MimeCategorizer * newCategorizer )
+void TreemapView::addLayoutLevels( TreemapLayoutResult * result )
 {
-    if ( _mimeCategorizer )
-	delete _mimeCategorizer;
+    QList<TreemapLayoutItemList> levels = result->takeLevels();
 
-    _mimeCategorizer = newCategorizer;
+    if ( levels.isEmpty() )
+	return;
+
+    foreach ( const TreemapLayoutItemList & level, levels )
+    {
+	int first = _layout->size();
+	_layout->addItems( level );
+
+	// Painting the top level would erase the preview right away, so
+	// with a preview, everything is rendered at the end.
+
+	if ( ! _layoutPreview )
+	    renderFlatItems( first, _layout->size() );
+    }
+
+    if ( ! _layoutPreview )
+	viewport()->update();
 }
 
 
-void TreemapView::setFixedColor( const QColor & color )
+void TreemapView::clearLayoutCache()
 {
-    _fixedColor	   = color;
-    _useFixedColor = _fixedColor.isValid();
+    _layoutCache.clear();
 }
 
 
-QColor TreemapView::tileColor( FileInfo * file )
+void TreemapView::cacheLayout()
 {
-    if ( _useFixedColor )
+    if ( ! _layout->isComplete() || _layout->isEmpty() )
+	return;
+
+    TreemapLayoutCacheEntry entry;
+    entry.root	= _layout->root();
+    entry.size	= _layout->item( 0 ).rect.size();
+    entry.items = _layout->items();	// Implicitly shared, no deep copy
+
+    for ( int i = _layoutCache.size() - 1; i >= 0; --i )
+    {
+	if ( _layoutCache.at( i ).root == entry.root &&
+	     _layoutCache.at( i ).size == entry.size )
+	{
+	    _layoutCache.removeAt( i );
+	}
+    }
+
+    _layoutCache.prepend( entry );
+
+    while ( _layoutCache.size() > LayoutCacheSize )
+	_layoutCache.removeLast();
+}
+
+
+bool TreemapView::prepareIncrementalUpdate( FileInfo * deletedChild )
+{
+    // Laying out the children again needs the cushion surface of their
+    // parent; with the simple algorithm, that's not the one that is stored
+    // in the layout. That's rarely used anyway, though.
+
+    if ( ! _flatRenderer || ! _squarify || ! deletedChild ||
+	 ! _layout->isComplete() || _layout->isEmpty() ||
+	 ( _cushionFramebuffer.isNull() && ! useOpenGL() ) )
+    {
+	return false;
+    }
+
+    FileInfo * root = _layout->root();
+
+    if ( deletedChild == root || root->isInSubtree( deletedChild ) )
+	return false;
+
+    _incrementalUpdate = true;
+
+    if ( ! deletedChild->isInSubtree( root ) )	// Not in the treemap: Nothing to do
+	return true;
+
+
+    // Find the items for 'deletedChild' and its ancestors in one pass
+
+    QList<FileInfo *> chain;
+
+    for ( FileInfo * node = deletedChild; node; node = node->parent() )
+    {
+	chain << node;
+
+	if ( node == root )
+	    break;
+    }
+
+    QVector<int> chainIndex( chain.size(), -1 );
+
+    for ( int i=0; i < _layout->size(); ++i )
+    {
+	int pos = chain.indexOf( _layout->item( i ).orig );
+
+	// A summary item only needs to go if its 'orig' is deleted; it is
+	// not an item for an ancestor.
+
+	if ( pos > 0 && _layout->item( i ).summary )
+	    continue;
+
+	if ( pos >= 0 )
+	    chainIndex[ pos ] = i;
+    }
+
+    FileInfo * target = root;
+
+    for ( int pos = 1; pos < chain.size(); ++pos )
+    {
+	if ( chainIndex.at( pos ) >= 0 )
+	{
+	    target = chain.at( pos );
+	    break;
+	}
+    }
+
+
+    // Remove the items that are about to become invalid. The indices of
+    // the other items change with that.
+
+    if ( chainIndex.first() >= 0 )
+    {
+	_layout->removeSubtree( chainIndex.first() );
+	_layout->finish();
+    }
+
+    _flatCurrentItem = -1;
+    _flatHoverItem   = -1;
+    _flatSelectedItems.clear();
+
+
+    // Merge the pending relayouts: Anything in the subtree of the new
+    // target is laid out with it; what has been freed there already is
+    // part of its old size.
+
+    FileSize oldSize = target->totalSize();
+    QMutableMapIterator<FileInfo *, FileSize> it( _pendingRelayouts );
+
+    while ( it.hasNext() )
+    {
+	it.next();
+
+	if ( target == it.key() || target->isInSubtree( it.key() ) )
+	    return true;	// Already pending
+
+	if ( it.key()->isInSubtree( target ) )
+	{
+	    oldSize += it.value() - it.key()->totalSize();
+	    it.remove();
+	}
+    }
+
+    _pendingRelayouts.insert( target, oldSize );
+
+    return true;
+}
+
+
+void TreemapView::incrementalUpdate()
+{
+    _incrementalUpdate = false;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QMapIterator<FileInfo *, FileSize> it( _pendingRelayouts );
+
+    while ( it.hasNext() )
+    {
+	it.next();
+	int index = _layout->indexOf( it.key() );
+
+	if ( index >= 0 )
+	    relayoutChildren( index, it.value() );
+    }
+
+    _pendingRelayouts.clear();
+    _layout->finish();
+    viewport()->update();
+
+    logDebug() << "Incremental update: " << _layout->size() << " layout items"
+	       << " in " << timer.elapsed() << " ms" << endl;
+
+    if ( _selectionModel )
+    {
+	updateSelection( _selectionModel->selectedItems() );
+	updateCurrentItem( _selectionModel->currentItem() );
+    }
+
+    emit treemapChanged();
+}
+
+
+void TreemapView::relayoutChildren( int index, FileSize oldSize )
+{
+    TreemapLayoutItem item = _layout->item( index );
+    FileSize newSize = item.orig->totalSize();
+    QRect childrenRect = item.rect;
+
+    // Shrink the area along the longer side so the scale of the rest of
+    // the treemap remains correct; what is left over is the freed space.
+
+    if ( oldSize > 0 && newSize < oldSize )
+    {
+	double ratio = newSize / (double) oldSize;
+
+	if ( childrenRect.width() >= childrenRect.height() )
+	    childrenRect.setWidth( qRound( childrenRect.width() * ratio ) );
+	else
+	    childrenRect.setHeight( qRound( childrenRect.height() * ratio ) );
+    }
+
+    _layout->removeChildren( index );
+    int first = _layout->size();
+
+    if ( newSize > 0 && ! childrenRect.isEmpty() )
+    {
+	// Using the same layout code as always, but synchronously: This is
+	// only one subtree.
+
+	TreemapLayoutResult result( this, item.orig, childrenRect );
+	result.setCushionSurface( item.cushionSurface );
+	result.layout();
+
+	TreemapLayoutItemList subtree;
+
+	foreach ( const TreemapLayoutItemList & level, result.takeLevels() )
+	    subtree += level;
+
+	_layout->addChildren( index, subtree );
+    }
+
+
+    // Erase the old children, then render the item itself and its new
+    // children again.
+
+    if ( ! _cushionFramebuffer.isNull() )
+    {
+	QPainter painter( &_cushionFramebuffer );
+	painter.fillRect( item.rect, QColor( 0x60, 0x60, 0x60 ) );
+    }
+
+    renderFlatItems( index, index + 1 );
+    renderFlatItems( first, _layout->size() );
+}
+
+
+void TreemapView::setupOpenGL()
+{
+    if ( ! _useOpenGL )
+	return;
+
+#ifdef HAVE_TREEMAP_GL
+
+    QOpenGLWidget * glViewport = new QOpenGLWidget();
+    CHECK_NEW( glViewport );
+
+    // Instanced drawing needs OpenGL 3.3 (or OpenGL ES 3.0). The renderer
+    // checks what it actually got.
+
+    QSurfaceFormat format = glViewport->format();
+
+    if ( QSurfaceFormat::defaultFormat().renderableType() != QSurfaceFormat::OpenGLES )
+    {
+	format.setVersion( 3, 3 );
+	format.setProfile( QSurfaceFormat::CoreProfile );
+    }
+
+    glViewport->setFormat( format );
+    setViewport( glViewport );	// The view takes ownership
+    setViewportUpdateMode( QGraphicsView::FullViewportUpdate );
+
+    _glViewport = glViewport;
+    _glRenderer = new TreemapGLRenderer();
+    CHECK_NEW( _glRenderer );
+
+#else
+
+    logWarning() << "No OpenGL support in this build" << endl;
+
+#endif
+}
+
+
+bool TreemapView::useOpenGL() const
+{
+#ifdef HAVE_TREEMAP_GL
+
+    // Plain tiles need outlines; that's not worthwhile on the GPU.
+
+    return _glRenderer && _doCushionShading;
+
+#else
+
+    return false;
+
+#endif
+}
+
+
+bool TreemapView::drawOpenGL( QPainter * painter )
+{
+#ifdef HAVE_TREEMAP_GL
+
+    painter->beginNativePainting();
+
+    bool ok = _glRenderer->isInitialized() || _glRenderer->initialize();
+
+    if ( ok )
+    {
+	if ( _glInstancesDirty )
+	{
+	    QVector<TreemapGLInstance> instances;
+	    instances.reserve( _layout->size() );
+
+	    QColor dirColor = _useDirGradient ?
+		QColor( ( _dirGradientStart.red()   + _dirGradientEnd.red()   ) / 2,
+			( _dirGradientStart.green() + _dirGradientEnd.green() ) / 2,
+			( _dirGradientStart.blue()  + _dirGradientEnd.blue()  ) / 2 ) :
+		QColor( 0x60, 0x60, 0x60 );
+
+	    for ( int i=0; i < _layout->size(); ++i )
+	    {
+		const TreemapLayoutItem & item = _layout->item( i );
+		TreemapGLInstance instance;
+
+		instance.rect[0] = item.rect.x();
+		instance.rect[1] = item.rect.y();
+		instance.rect[2] = item.rect.width();
+		instance.rect[3] = item.rect.height();
+
+		if ( ! item.summary && ( item.orig->isDir() || item.orig->isDotEntry() ) )
+		{
+		    // Like the dir brush, but without the gradient
+
+		    if ( _useDirGradient && qMax( item.rect.width(), item.rect.height() ) < _minTileSize )
+			continue;
+
+		    instance.surface[0] = instance.surface[1] = 0.0;
+		    instance.surface[2] = instance.surface[3] = 0.0;
+		    instance.color[0]	= dirColor.red();
+		    instance.color[1]	= dirColor.green();
+		    instance.color[2]	= dirColor.blue();
+		    instance.color[3]	= 0.0;	// Plain color
+		}
+		else
+		{
+		    CushionShading shading = cushionShading( item.orig, item.cushionSurface );
+
+		    instance.surface[0] = shading.xx2;
+		    instance.surface[1] = shading.xx1;
+		    instance.surface[2] = shading.yy2;
+		    instance.surface[3] = shading.yy1;
+		    instance.color[0]	= shading.maxRed;
+		    instance.color[1]	= shading.maxGreen;
+		    instance.color[2]	= shading.maxBlue;
+		    instance.color[3]	= 1.0;	// Cushion
+		}
+
+		instances << instance;
+	    }
+
+	    _glRenderer->setInstances( instances );
+	    _glInstancesDirty = false;
+	}
+
+	_glRenderer->setLight( _ambientLight, _lightX, _lightY, _lightZ );
+	_glRenderer->setGridColor( _forceCushionGrid ? _cushionGridColor : QColor() );
+	_glRenderer->paint( mapToScene( viewport()->rect() ).boundingRect(),
+			    QColor( 0x60, 0x60, 0x60 ) );
+    }
+    else
+    {
+	delete _glRenderer;
+	_glRenderer = 0;
+    }
+
+    painter->endNativePainting();
+
+    if ( ! ok )
+    {
+	logWarning() << "OpenGL rendering is not available - rendering on the CPU" << endl;
+	renderFlatItems( 0, _layout->size() );
+    }
+
+    return ok;
+
+#else
+
+    Q_UNUSED( painter );
+    return false;
+
+#endif
+}
+
+
+static bool sameAspectRatio( const QSize & size1, const QSize & size2 )
+{
+    if ( size1.isEmpty() || size2.isEmpty() )
+	return false;
+
+    double ratio1 = size1.width() / (double) size1.height();
+    double ratio2 = size2.width() / (double) size2.height();
+
+    return qAbs( ratio1 / ratio2 - 1.0 ) <= MaxAspectRatioDiff;
+}
+
+
+bool TreemapView::reuseLayout( FileInfo * newRoot, const QRect & rect )
+{
+    if ( ! newRoot || rect.isEmpty() )
+	return false;
+
+    // A cached layout for the same root: Use it as it is if it has the
+    // same size, or rescale it if the size didn't change too much.
+
+    for ( int i=0; i < _layoutCache.size(); ++i )
+    {
+	const TreemapLayoutCacheEntry & entry = _layoutCache.at( i );
+
+	if ( entry.root != newRoot || ! sameAspectRatio( entry.size, rect.size() ) )
+	    continue;
+
+	double scale = rect.width() / (double) entry.size.width();
+	TreemapLayoutItemList items;
+
+	if ( entry.size == rect.size() )
+	    items = entry.items;
+	else if ( scale >= MinLayoutRescale && scale <= MaxLayoutRescale )
+	    items = TreemapLayout::rescaled( entry.items, 0, rect );
+
+	if ( items.isEmpty() )
+	    continue;
+
+	logDebug() << ( entry.size == rect.size() ? "Reusing" : "Rescaling" )
+		   << " cached layout for " << newRoot << endl;
+
+	_layout->begin( newRoot );
+	_layout->addItems( items );
+	_layout->finish();
+	renderFlatItems( 0, _layout->size() );
+
+	// Move it to the front; don't cache the rescaled (less accurate)
+	// one.
+
+	if ( i > 0 )
+	    _layoutCache.move( i, 0 );
+
+	return true;
+    }
+
+
+    // Zooming into a subtree of a cached layout: If it has about the
+    // right shape, show it rescaled as a preview until the new layout
+    // with all the additional detail is complete.
+
+    for ( int i=0; i < _layoutCache.size(); ++i )
+    {
+	const TreemapLayoutCacheEntry & entry = _layoutCache.at( i );
+	int subtree = TreemapLayout::indexOf( entry.items, newRoot );
+
+	if ( subtree < 0 || ! sameAspectRatio( entry.items.at( subtree ).rect.size(), rect.size() ) )
+	    continue;
+
+	// logDebug() << "Showing a preview for " << newRoot << endl;
+
+	_layout->begin( newRoot );
+	_layout->addItems( TreemapLayout::rescaled( entry.items, subtree, rect ) );
+	renderFlatItems( 0, _layout->size() );
+	_layoutPreview = true;
+
+	break;
+    }
+
+    return false;
+}
+
+
+QList<CushionRenderJob *> TreemapView::createRenderJobs( QImage & framebuffer )
+{
+    int threadCount = qMax( 1, _renderPool.maxThreadCount() );
+    QList<CushionRenderJob *> jobs;
+
+    // bits() detaches the image here in the GUI thread, so the render jobs
+    // only work on the raw pixel buffer.
+
+    uchar * bits = framebuffer.bits();
+
+    // Keep the cushions of the complete treemap and those of the next
+    // rebuild.
+
+    qint64 framebufferBytes = (qint64) framebuffer.bytesPerLine() * framebuffer.height();
+
+    if ( _cushionCache.maxBytes() < 2 * framebufferBytes )
+	_cushionCache.setMaxBytes( 2 * framebufferBytes );
+
+    _newCushions.clear();
+
+    for ( int i=0; i < threadCount * RenderJobsPerThread; ++i )
+    {
+	CushionRenderJob * job = new CushionRenderJob( bits, framebuffer.bytesPerLine(), _ensureContrast );
+	CHECK_NEW( job );
+	jobs << job;
+    }
+
+    return jobs;
+}
+
+
+bool TreemapView::addToRenderJob( QList<CushionRenderJob *> & jobs,
+				  const CushionShading	    & shading,
+				  const QRect		    & rect )
+{
+    // Always giving a cushion to the job with the fewest pixels keeps them
+    // balanced.
+
+    CushionRenderJob * job = jobs.first();
+
+    foreach ( CushionRenderJob * candidate, jobs )
+    {
+	if ( candidate->pixels() < job->pixels() )
+	    job = candidate;
+    }
+
+    QImage cushion = _cushionCache.find( shading, rect, _ensureContrast );
+
+    if ( ! cushion.isNull() )
+    {
+	job->addRendered( cushion, rect );
+	return true;
+    }
+
+    job->add( shading, rect );
+    _newCushions << CushionCacheKey( shading, rect, _ensureContrast );
+
+    return false;
+}
+
+
+void TreemapView::runRenderJobs( QList<CushionRenderJob *> & jobs, const QImage & framebuffer )
+{
+    foreach ( CushionRenderJob * job, jobs )
+    {
+	if ( ! job->isEmpty() )
+	    _renderPool.start( job );
+	else
+	    delete job;
+    }
+
+    jobs.clear();
+    _renderPool.waitForDone();
+
+    // Copying them out of the framebuffer is much cheaper than rendering
+    // them again with the next rebuild.
+
+    foreach ( const CushionCacheKey & key, _newCushions )
+	_cushionCache.insert( key.shading, key.rect, key.ensureContrast, framebuffer.copy( key.rect ) );
+
+    _newCushions.clear();
+}
+
+
+void TreemapView::drawBackground( QPainter * painter, const QRectF & rect )
+{
+    if ( useOpenGL() && drawOpenGL( painter ) )
+	return;
+
+    if ( _cushionFramebuffer.isNull() )
+	QGraphicsView::drawBackground( painter, rect );
+    else
+	painter->drawImage( rect, _cushionFramebuffer, rect );
+}
+
+
+void TreemapView::drawForeground( QPainter * painter, const QRectF & rect )
+{
+    QGraphicsView::drawForeground( painter, rect );
+
+    if ( ! _flatRenderer )
+    {
+	drawTileHighlights( painter, rect );
+	return;
+    }
+
+    if ( _layout->isEmpty() )
+	return;
+
+    // The same frames as drawTileHighlights() and TreemapTile::paint() of
+    // the tile renderer. Item no. 0 is the root which is never
+    // highlighted.
+
+    painter->setBrush( Qt::NoBrush );
+
+    foreach ( int index, _flatSelectedItems )
+    {
+	if ( index == 0 )
+	    continue;
+
+	const TreemapLayoutItem & item = _layout->item( index );
+
+	if ( item.orig->hasChildren() )
+	{
+	    painter->setPen( QPen( _selectedItemsColor, 2 ) );
+	    painter->drawRect( QRectF( item.rect ) );
+	}
+	else
+	{
+	    painter->setPen( QPen( _selectedItemsColor, 1 ) );
+	    painter->drawRect( QRectF( item.rect ).adjusted( 0.0, 0.0, -1.0, -1.0 ) );
+	}
+    }
+
+    if ( _flatCurrentItem > 0 )
+    {
+	QPen pen( _currentItemColor, 2 );
+
+	if ( ! _flatSelectedItems.contains( _flatCurrentItem ) )
+	    pen.setStyle( Qt::DotLine );
+
+	painter->setPen( pen );
+	painter->drawRect( QRectF( _layout->item( _flatCurrentItem ).rect ) );
+    }
+}
+
+
+void TreemapView::drawTileHighlights( QPainter * painter, const QRectF & rect )
+{
+    if ( ! scene() || ! _rootTile )
+	return;
+
+    // Leaf tiles draw their own frame when they are selected, but
+    // directory tiles are completely obscured by their children, so
+    // their frame is drawn here on top of them. The root tile is never
+    // highlighted.
+
+    painter->setBrush( Qt::NoBrush );
+    painter->setPen( QPen( _selectedItemsColor, 2 ) );
+
+    foreach ( QGraphicsItem * item, scene()->selectedItems() )
+    {
+	TreemapTile * tile = dynamic_cast<TreemapTile *>( item );
+
+	if ( ! tile || tile == _rootTile || ! tile->orig()->hasChildren() )
+	    continue;
+
+	QRectF frame = tile->mapRectToScene( tile->rect() );
+
+	if ( frame.intersects( rect ) )
+	    painter->drawRect( frame );
+    }
+
+    if ( _currentItem && _currentItem != _rootTile )
+    {
+	QPen pen( _currentItemColor, 2 );
+
+	if ( ! _currentItem->isSelected() )
+	    pen.setStyle( Qt::DotLine );
+
+	painter->setPen( pen );
+	painter->drawRect( _currentItem->mapRectToScene( _currentItem->rect() ) );
+    }
+}
+
+
+void TreemapView::updateFrame( const QRectF & rect )
+{
+    if ( ! scene() )
+	return;
+
+    // Just the four edges with some room for the pen: For a large
+    // directory, repainting all of its tiles would be much more work.
+
+    qreal  margin = 2.0;
+    QRectF outer  = rect.adjusted( -margin, -margin, margin, margin );
+
+    scene()->update( QRectF( outer.left(), outer.top(), outer.width(), 2 * margin ) );
+    scene()->update( QRectF( outer.left(), rect.bottom() - margin, outer.width(), 2 * margin ) );
+    scene()->update( QRectF( outer.left(), outer.top(), 2 * margin, outer.height() ) );
+    scene()->update( QRectF( rect.right() - margin, outer.top(), 2 * margin, outer.height() ) );
+}
+
+
+TreemapTile * TreemapView::tileAt( const QPoint & pos ) const
+{
+    if ( ! _rootTile )
+	return 0;
+
+    // Descend through the tiles rather than asking the scene which would
+    // have to check all of its items: The children of a tile don't
+    // overlap, so there is at most one on each level.
+
+    QPointF	  scenePos = mapToScene( pos );
+    TreemapTile * tile	   = _rootTile;
+
+    if ( ! tile->rect().contains( tile->mapFromScene( scenePos ) ) )
+	return 0;
+
+    while ( true )
+    {
+	TreemapTile * child = 0;
+
+	foreach ( QGraphicsItem * item, tile->childItems() )
+	{
+	    if ( item->boundingRect().contains( item->mapFromScene( scenePos ) ) )
+	    {
+		child = dynamic_cast<TreemapTile *>( item );
+
+		if ( child )
+		    break;
+	    }
+	}
+
+	if ( ! child )
+	    return tile;
+
+	tile = child;
+    }
+}
+
+
+int TreemapView::flatItemAt( const QPoint & pos ) const
+{
+    return _layout->itemAt( mapToScene( pos ).toPoint() );
+}
+
+
+void TreemapView::mousePressEvent( QMouseEvent * event )
+{
+    if ( ! _flatRenderer )
+    {
+	QGraphicsView::mousePressEvent( event );
+	return;
+    }
+
+    int index = flatItemAt( event->pos() );
+
+    if ( index < 0 )
+	return;
+
+    switch ( event->button() )
+    {
+	case Qt::LeftButton:
+	    if ( event->modifiers() & Qt::ControlModifier )
+	    {
+		if ( ! _flatSelectedItems.removeOne( index ) )
+		    _flatSelectedItems << index;
+	    }
+	    else
+	    {
+		_flatSelectedItems.clear();
+		_flatSelectedItems << index;
+	    }
+
+	    setFlatCurrentItem( index );
+	    break;
+
+	case Qt::RightButton:
+	    setFlatCurrentItem( index );
+	    break;
+
+	default:
+	    break;
+    }
+}
+
+
+void TreemapView::mouseReleaseEvent( QMouseEvent * event )
+{
+    if ( ! _flatRenderer )
+    {
+	QGraphicsView::mouseReleaseEvent( event );
+	return;
+    }
+
+    int index = flatItemAt( event->pos() );
+
+    if ( index < 0 )
+	return;
+
+    if ( event->button() == Qt::MidButton )
+    {
+	logDebug() << "Selecting parent" << endl;
+
+	int newCurrent = index;
+
+	// Select the next-higher ancestor if possible
+
+	if ( _flatCurrentItem >= 0 )
+	{
+	    int parent = _layout->item( _flatCurrentItem ).parent;
+
+	    if ( parent >= 0 &&
+		 _layout->item( index ).orig->isInSubtree( _layout->item( parent ).orig ) )
+	    {
+		newCurrent = parent;
+	    }
+	}
+
+	_flatSelectedItems.clear();
+	_flatSelectedItems << newCurrent;
+	setFlatCurrentItem( newCurrent );
+    }
+
+    sendSelection();
+}
+
+
+void TreemapView::mouseDoubleClickEvent( QMouseEvent * event )
+{
+    if ( ! _flatRenderer )
+    {
+	QGraphicsView::mouseDoubleClickEvent( event );
+	return;
+    }
+
+    switch ( event->button() )
+    {
+	case Qt::LeftButton:
+	    logDebug() << "Zooming treemap in" << endl;
+	    zoomIn();
+	    break;
+
+	case Qt::MidButton:
+	    logDebug() << "Zooming treemap out" << endl;
+	    zoomOut();
+	    break;
+
+	default:
+	    break;
+    }
+}
+
+
+void TreemapView::mouseMoveEvent( QMouseEvent * event )
+{
+    if ( _flatRenderer )
+    {
+	setFlatHoverItem( flatItemAt( event->pos() ) );
+    }
+    else
+    {
+	setHoverTile( tileAt( event->pos() ) );
+	QGraphicsView::mouseMoveEvent( event );
+    }
+}
+
+
+void TreemapView::wheelEvent( QWheelEvent * event )
+{
+    if ( ! _flatRenderer )
+    {
+	QGraphicsView::wheelEvent( event );
+	return;
+    }
+
+    if ( event->delta() > 0 )
+    {
+	if ( _flatCurrentItem < 0 )  // can only zoom in with a current item
+	    setFlatCurrentItem( flatItemAt( event->pos() ) );
+
+	zoomIn();
+    }
+    else if ( event->delta() < 0 )
+    {
+	zoomOut();
+    }
+}
+
+
+void TreemapView::contextMenuEvent( QContextMenuEvent * event )
+{
+    if ( ! _flatRenderer )
+    {
+	QGraphicsView::contextMenuEvent( event );
+	return;
+    }
+
+    int index = flatItemAt( event->pos() );
+
+    if ( index >= 0 )
+	showContextMenu( _layout->item( index ).orig, event->globalPos() );
+}
+
+
+bool TreemapView::viewportEvent( QEvent * event )
+{
+    if ( event->type() == QEvent::Leave )
+    {
+	if ( _flatRenderer )
+	    setFlatHoverItem( -1 );
+	else
+	    setHoverTile( 0 );
+    }
+
+    return QGraphicsView::viewportEvent( event );
+}
+
+
+void TreemapView::setHoverTile( TreemapTile * tile )
+{
+    if ( tile == _hoverTile )
+	return;
+
+    if ( _hoverTile )
+	sendHoverLeave( _hoverTile->orig() );
+
+    _hoverTile = tile;
+
+    if ( _hoverTile )
+	sendHoverEnter( _hoverTile->orig() );
+}
+
+
+void TreemapView::setFlatHoverItem( int index )
+{
+    if ( index == _flatHoverItem )
+	return;
+
+    if ( _flatHoverItem >= 0 )
+	sendHoverLeave( _layout->item( _flatHoverItem ).orig );
+
+    _flatHoverItem = index;
+
+    if ( _flatHoverItem >= 0 )
+	sendHoverEnter( _layout->item( _flatHoverItem ).orig );
+}
+
+
+void TreemapView::disable()
+{
+    // logDebug() << "Disabling treemap view" << endl;
+
+    clear();
+    _cushionCache.clear();
+    resize( width(), 1 );
+    hide();
+
+    emit treemapChanged();
+}
+
+
+void TreemapView::enable()
+{
+    if ( ! isVisible() )
+    {
+	// logDebug() << "Enabling treemap view" << endl;
+	show();
+	QWidget * parentWidget = qobject_cast<QWidget *>( parent() );
+
+	if ( parentWidget )
+	    resize( parentWidget->height(), width() );
+
+	scheduleRebuildTreemap( _tree->firstToplevel() );
+    }
+}
+
+
+void TreemapView::setCurrentItem( TreemapTile * tile )
+{
+    // logDebug() << tile << endl;
+
+    TreemapTile * oldCurrent = _currentItem;
+    _currentItem = tile;
+
+    // The frame is drawn in drawForeground(): Just repaint where it was
+    // and where it is now.
+
+    if ( oldCurrent && oldCurrent != _currentItem )
+	updateFrame( oldCurrent->mapRectToScene( oldCurrent->rect() ) );
+
+    if ( _currentItem )
+	updateFrame( _currentItem->mapRectToScene( _currentItem->rect() ) );
+
+    if ( oldCurrent != _currentItem && _selectionModelProxy )
+    {
+	// logDebug() << "Sending currentItemChanged " << _currentItem << endl;
+
+	SignalBlocker sigBlocker( _selectionModelProxy ); // Prevent signal ping-pong
+	emit currentItemChanged( _currentItem ? _currentItem->orig() : 0 );
+    }
+}
+
+
+void TreemapView::setCurrentItem( FileInfo * node )
+{
+    // logDebug() << node << endl;
+
+    FileInfo * currentRoot = treemapRoot();
+
+    if ( node && currentRoot )
+    {
+	FileInfo * treemapRoot = currentRoot;
+
+	// Check if the new current item is inside the current treemap
+	// (it might be zoomed).
+
+	while ( ! node->isInSubtree( treemapRoot ) &&
+		treemapRoot->parent() &&
+		treemapRoot->parent() != _tree->root() )
+	{
+	    treemapRoot = treemapRoot->parent(); // try one level higher
+	}
+
+	if ( treemapRoot != currentRoot )	  // need to zoom out?
+	{
+	    logDebug() << "Zooming out to " << treemapRoot << " to make current item visible" << endl;
+	    rebuildTreemap( treemapRoot );
+	}
+    }
+
+    if ( _flatRenderer )
+	setFlatCurrentItem( _layout->indexOf( node ) );
+    else
+	setCurrentItem( findTile( node ) );
+}
+
+
+void TreemapView::setFlatCurrentItem( int index )
+{
+    int oldCurrent = _flatCurrentItem;
+    _flatCurrentItem = index;
+    viewport()->update();
+
+    if ( oldCurrent != _flatCurrentItem && _selectionModelProxy )
+    {
+	SignalBlocker sigBlocker( _selectionModelProxy ); // Prevent signal ping-pong
+	emit currentItemChanged( index >= 0 ? _layout->item( index ).orig : 0 );
+    }
+}
+
+
+void TreemapView::updateSelection( const FileInfoSet & newSelection )
+{
+    if ( ! scene() )
+	return;
+
+    // logDebug() << newSelection.size() << " items selected" << endl;
+    SignalBlocker sigBlocker( this );
+
+    if ( _flatRenderer )
+    {
+	// One pass over the layout rather than one search for each
+	// selected item
+
+	_flatSelectedItems.clear();
+
+	if ( ! newSelection.isEmpty() )
+	{
+	    for ( int i=0; i < _layout->size(); ++i )
+	    {
+		if ( newSelection.contains( _layout->item( i ).orig ) )
+		    _flatSelectedItems << i;
+	    }
+	}
+
+	viewport()->update();
+	updateCurrentItem( _flatCurrentItem >= 0 ? _layout->item( _flatCurrentItem ).orig : 0 );
+
+	return;
+    }
+
+    scene()->clearSelection();
+
+    foreach ( const FileInfo * item, newSelection )
+    {
+	// logDebug() << "	 Selected: " << item << endl;
+	TreemapTile * tile = findTile( item );
+
+	if ( tile )
+	    tile->setSelected( true );
+    }
+
+    updateCurrentItem( _currentItem ? _currentItem->orig() : 0 );
+}
+
+
+void TreemapView::sendSelection()
+{
+    if ( ! scene() || ! _selectionModel )
+	return;
+
+    SignalBlocker sigBlocker( _selectionModelProxy );
+
+    if ( _flatRenderer )
+    {
+	FileInfo * current = _flatCurrentItem >= 0 ? _layout->item( _flatCurrentItem ).orig : 0;
+
+	if ( _flatSelectedItems.size() == 1 && _flatSelectedItems.first() == _flatCurrentItem )
+	{
+	    _selectionModel->setCurrentItem( current,
+					     true ); // select
+	}
+	else // Multi-selection
+	{
+	    FileInfoSet selectedItems;
+
+	    foreach ( int index, _flatSelectedItems )
+		selectedItems << _layout->item( index ).orig;
+
+	    _selectionModel->setSelectedItems( selectedItems );
+	    _selectionModel->setCurrentItem( current );
+	}
+
+	return;
+    }
+
+    QList<QGraphicsItem *> selectedTiles = scene()->selectedItems();
+
+    if ( selectedTiles.size() == 1 && selectedTiles.first() == _currentItem )
+    {
+	// This is the most common case: One tile is selected.
+	// Reduce number of signals in that case.
+
+	_selectionModel->setCurrentItem( _currentItem->orig(),
+					 true ); // select
+    }
+    else // Multi-selection
+    {
+	FileInfoSet selectedItems;
+
+	foreach ( QGraphicsItem * item, selectedTiles )
+	{
+	    TreemapTile * tile = dynamic_cast<TreemapTile *>( item );
+
+	    if ( tile )
+		selectedItems << tile->orig();
+	}
+
+	_selectionModel->setSelectedItems( selectedItems );
+	_selectionModel->setCurrentItem( _currentItem ? _currentItem->orig() : 0 );
+    }
+}
+
+
+void TreemapView::updateCurrentItem( FileInfo * currentItem )
+{
+    if ( ! scene() )
+	return;
+
+    SignalBlocker sigBlocker( this );
+    setCurrentItem( currentItem );
+}
+
+
+
+void TreemapView::addToTileIndex( TreemapTile * tile )
+{
+    _tileIndex.insert( tile->orig(), tile );
+}
+
+
+QSize TreemapView::visibleSize()
+{
+    QSize size = viewport()->size();
+    // logDebug() << "Visible size: " << size.width() << " x " << size.height() << endl;
+
+    return size;
+}
+
+
+void TreemapView::setMimeCategorizer( MimeCategorizer * newCategorizer )
+{
+    if ( _mimeCategorizer )
+	delete _mimeCategorizer;
+
+    _mimeCategorizer = newCategorizer;
+}
+
+
+void TreemapView::setFixedColor( const QColor & color )
+{
+    _fixedColor	   = color;
+    _useFixedColor = _fixedColor.isValid();
+}
+
+
+QColor TreemapView::tileColor( FileInfo * file )
+{
+    if ( _useFixedColor )
 	return _fixedColor;
 
+    if ( file && _tree && _tree->cacheDiff() )
+	return _tree->cacheDiff()->growthColor( file );
+
     if ( file )
     {
 	if ( file->isFile() )
@@ -685,88 +2211,93 @@ QColor TreemapView::tileColor( FileInfo * file )
 }
 
 
-void TreemapView::sendHoverEnter( FileInfo * node )
+QBrush TreemapView::dirBrush( const QRectF & rect ) const
 {
-    emit hoverEnter( node );
-}
-
+    if ( ! _useDirGradient )
+	return QBrush( QColor( 0x60, 0x60, 0x60 ) );
 
-void TreemapView::sendHoverLeave( FileInfo * node )
-{
-    emit hoverLeave( node );
-}
+    if ( qMax( rect.width(), rect.height() ) < _minTileSize )
+	return QBrush( Qt::NoBrush );
 
+    QLinearGradient gradient( rect.topLeft(), rect.bottomRight() );
+    gradient.setColorAt( 0.0, _dirGradientStart );
+    gradient.setColorAt( 1.0, _dirGradientEnd	);
 
+    return QBrush( gradient );
+}
 
 
+CushionShading TreemapView::cushionShading( FileInfo * file, const CushionSurface & surface )
+{
+    QColor color = tileColor( file );
+
+    CushionShading shading;
+    shading.ambientLight = _ambientLight;
+    shading.lightX	 = _lightX;
+    shading.lightY	 = _lightY;
+    shading.lightZ	 = _lightZ;
+    shading.xx2		 = surface.xx2();
+    shading.xx1		 = surface.xx1();
+    shading.yy2		 = surface.yy2();
+    shading.yy1		 = surface.yy1();
+    shading.maxRed	 = qMax( 0, color.red()	  - shading.ambientLight );
+    shading.maxGreen	 = qMax( 0, color.green() - shading.ambientLight );
+    shading.maxBlue	 = qMax( 0, color.blue()  - shading.ambientLight );
+
+    return shading;
+}
 
 
-HighlightRect::HighlightRect( QGraphicsScene * scene, const QColor & color, int lineWidth ):
-    QGraphicsRectItem()
+void TreemapView::sendHoverEnter( FileInfo * node )
 {
-    QPen pen( color, lineWidth );
-    pen.setStyle( Qt::DotLine );
-    setPen( QPen( color, lineWidth ) );
-    setPen( pen );
-    setZValue( 1e10 );		// Higher than everything else
-    hide();
-    scene->addItem( this );
+    emit hoverEnter( node );
 }
 
 
-HighlightRect::HighlightRect( TreemapTile * tile, const QColor & color, int lineWidth ):
-    QGraphicsRectItem()
+void TreemapView::sendHoverLeave( FileInfo * node )
 {
-    CHECK_PTR( tile );
-
-    setPen( QPen( color, lineWidth ) );
-    setZValue( 1e8 );	       // Not quite as high as the scene-wide highlight rect
-    tile->scene()->addItem( this );
-    highlight( tile );
+    emit hoverLeave( node );
 }
 
 
-
-void HighlightRect::highlight( TreemapTile * tile )
+void TreemapView::showContextMenu( FileInfo * item, const QPoint & pos )
 {
-    if ( tile )
-    {
-	QRectF tileRect = tile->rect();
-	tileRect.moveTo( mapFromScene( tile->mapToScene( tileRect.topLeft() ) ) );
-	setRect( tileRect );
+    if ( ! _selectionModel )
+	return;
 
-	if ( ! isVisible() )
-	    show();
-    }
-    else
+    FileInfoSet selectedItems = _selectionModel->selectedItems();
+
+    if ( ! selectedItems.contains( item ) )
     {
-	if ( isVisible() )
-	    hide();
+	logDebug() << "Abandoning old selection" << endl;
+	_selectionModel->setCurrentItem( item, true );
+	selectedItems = _selectionModel->selectedItems();
     }
-}
 
+    if ( _selectionModel->verbose() )
+	_selectionModel->dumpSelectedItems();
 
-void HighlightRect::setPenStyle( Qt::PenStyle style )
-{
-    QPen highlightPen = pen();
-    highlightPen.setStyle( style );
-    setPen( highlightPen );
-}
-
+    logDebug() << "Context menu for " << item << endl;
 
-void HighlightRect::setPenStyle( TreemapTile * tile )
-{
-    if ( tile && tile->isSelected() )
-	setPenStyle( Qt::SolidLine );
-    else
-	setPenStyle( Qt::DotLine );
-}
+    QMenu menu;
+    QStringList actions;
+    actions << "actionGoUp"
+	    << "actionCopyUrlToClipboard"
+	    << "---"
+	    << "actionTreemapZoomIn"
+	    << "actionTreemapZoomOut"
+	    << "actionResetTreemapZoom"
+	    << "---"
+	    << "actionMoveToTrash"
+	;
 
+    ActionManager::instance()->addActions( &menu, actions, this );
 
+    if ( _cleanupCollection && ! _cleanupCollection->isEmpty() )
+    {
+	menu.addSeparator();
+	_cleanupCollection->addToMenu( &menu );
+    }
 
-void CurrentItemHighlighter::highlight( TreemapTile * tile )
-{
-    HighlightRect::highlight( tile );
-    setPenStyle( tile );
+    menu.exec( pos );
 }
-
@@ -13,8 +13,18 @@
 
 #include <QGraphicsView>
 #include <QGraphicsRectItem>
+#include <QImage>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <QBrush>
+#include <QList>
+#include <QMap>
+#include <QHash>
 
 #include "FileInfo.h"
+#include "CushionKernel.h"
+#include "CushionCache.h"
+#include "TreemapLayout.h"	// TreemapLayoutCacheEntry
 
 
 #define MinAmbientLight		   0
@@ -31,20 +41,29 @@
 
 
 class QMouseEvent;
+class QWheelEvent;
+class QContextMenuEvent;
 class QSettings;
+class QOpenGLWidget;
 
 
 namespace QDirStat
 {
     class TreemapTile;
-    class HighlightRect;
+    class TreemapLayout;
+    class TreemapLayoutResult;
+    class TreemapGLRenderer;
+    class CushionSurface;
+    class CushionRenderJob;
     class DirTree;
     class SelectionModel;
     class SelectionModelProxy;
     class CleanupCollection;
     class FileInfoSet;
     class MimeCategorizer;
+    struct UsedNodes;
     class DelayedRebuilder;
+    struct MemoryUsage;
 
 
     /**
@@ -86,9 +105,22 @@ namespace QDirStat
 
 	/**
 	 * Returns this treemap view's root treemap tile or 0 if there is none.
+	 * This is always 0 with the flat renderer.
 	 **/
 	TreemapTile * rootTile() const { return _rootTile; }
 
+	/**
+	 * Add the memory of the treemap to 'usage': The tiles and their
+	 * cushion pixmaps, or the flat layouts, and the cushion framebuffer.
+	 **/
+	void addMemoryUsage( MemoryUsage & usage ) const;
+
+	/**
+	 * Returns the FileInfo node of the treemap root or 0 if there is
+	 * no treemap. Unlike rootTile(), this works with both renderers.
+	 **/
+	FileInfo * treemapRoot() const;
+
 	/**
 	 * Returns this treemap view's @ref DirTree.
 	 **/
@@ -118,17 +150,26 @@ namespace QDirStat
 	CleanupCollection * cleanupCollection() const { return _cleanupCollection; }
 
 	/**
-	 * Search the treemap for a tile that corresponds to the specified
-	 * FileInfo node. Returns 0 if there is none.
-	 *
-	 * Notice: This is an expensive operation since all treemap tiles need
-	 * to be searched.
+	 * Return the treemap tile that corresponds to the specified FileInfo
+	 * node or 0 if there is none. This is a lookup in the tile index.
 	 **/
-	TreemapTile * findTile( const FileInfo * node );
+	TreemapTile * findTile( const FileInfo * node ) const
+	    { return _tileIndex.value( node, 0 ); }
+
+	/**
+	 * Add 'tile' to the tile index for findTile(). Each TreemapTile calls
+	 * this when it is created. The index is cleared together with the
+	 * tiles.
+	 **/
+	void addToTileIndex( TreemapTile * tile );
 
 	/**
 	 * Returns a suitable color for 'file' based on a set of internal rules
 	 * (according to filename extension, MIME type or permissions).
+	 *
+	 * While the tree is compared with an older cache file, this is the
+	 * color for the growth of the directory of 'file' instead; see
+	 * CacheDiff::growthColor().
 	 **/
 	QColor tileColor( FileInfo * file );
 
@@ -151,6 +192,25 @@ namespace QDirStat
 	 **/
 	void setFixedColor( const QColor & fixedColor );
 
+	/**
+	 * Return the brush for a directory tile with 'rect'.
+	 **/
+	QBrush dirBrush( const QRectF & rect ) const;
+
+	/**
+	 * Return the parameters for rendering the cushion of 'file' with
+	 * 'surface': The light source of this view and the tile color of
+	 * 'file'. This needs the MimeCategorizer, so it has to be called
+	 * from the GUI thread.
+	 **/
+	CushionShading cushionShading( FileInfo * file, const CushionSurface & surface );
+
+	/**
+	 * Open the context menu for 'item' at global position 'pos'. If
+	 * 'item' is not selected, it becomes the only selected item.
+	 **/
+	void showContextMenu( FileInfo * item, const QPoint & pos );
+
 
     public slots:
 
@@ -222,15 +282,34 @@ namespace QDirStat
 	void enable();
 
 	/**
-	 * Notification that a dir tree node has been deleted.
+	 * Notification that a dir tree node is about to be deleted.
 	 **/
 	void deleteNotify( FileInfo * node );
 
+	/**
+	 * Notification that deleting is done: Update the treemap.
+	 **/
+	void childDeletedNotify();
+
+	/**
+	 * Add the nodes that the tiles, the flat layout and the pending
+	 * updates refer to to 'usedNodes' so the tree doesn't compact
+	 * them. While a rebuild is scheduled or a layout is computed in the
+	 * background, the tree can't compact anything.
+	 **/
+	void collectUsedNodes( QDirStat::UsedNodes * usedNodes );
+
 	/**
 	 * Sync the selected items and the current item to the selection model.
 	 **/
 	void sendSelection();
 
+	/**
+	 * Flat renderer: Drop all cached layouts. This is necessary
+	 * whenever the tree changes.
+	 **/
+	void clearLayoutCache();
+
         /**
          * Send a hoverEnter() signal for 'node'.
          **/
@@ -430,6 +509,33 @@ namespace QDirStat
 	 **/
 	double heightScaleFactor() const { return _heightScaleFactor; }
 
+	/**
+	 * Returns 'true' if the cushions of all tiles are already rendered
+	 * into the cushion framebuffer, so the tiles don't need to paint
+	 * them.
+	 **/
+	bool hasCushionFramebuffer() const { return ! _cushionFramebuffer.isNull(); }
+
+	/**
+	 * Return the cache of the rendered cushions that survives rebuilding
+	 * the treemap.
+	 **/
+	CushionCache * cushionCache() { return &_cushionCache; }
+
+	/**
+	 * Returns 'true' if the treemap is rendered from a flat
+	 * TreemapLayout into one image instead of one TreemapTile per
+	 * file. This needs much less memory for very large trees.
+	 **/
+	bool flatRenderer() const { return _flatRenderer; }
+
+	/**
+	 * Returns 'true' if the flat renderer shows the children of each
+	 * directory that are too small for a tile of their own as one
+	 * summary tile instead of leaving them out.
+	 **/
+	bool summaryTiles() const { return _summaryTiles; }
+
 
     signals:
 
@@ -475,6 +581,23 @@ namespace QDirStat
 	 **/
 	void rebuildTreemapDelayed();
 
+	/**
+	 * Flat renderer: Cancel the layout that is being computed, if any.
+	 **/
+	void cancelLayout();
+
+	/**
+	 * Flat renderer: Another level of the layout is finished in the
+	 * worker thread. Add it to the layout and display it.
+	 **/
+	void layoutLevelDone();
+
+	/**
+	 * Flat renderer: The layout is finished (or canceled) in the worker
+	 * thread.
+	 **/
+	void layoutDone();
+
     protected:
 
 	/**
@@ -486,6 +609,204 @@ namespace QDirStat
 	 **/
 	virtual void resizeEvent( QResizeEvent * event ) Q_DECL_OVERRIDE;
 
+	/**
+	 * Draw the background: The cushion framebuffer, if there is one, or
+	 * the flat layout with OpenGL.
+	 *
+	 * Reimplemented from QGraphicsView.
+	 **/
+	virtual void drawBackground( QPainter * painter, const QRectF & rect ) Q_DECL_OVERRIDE;
+
+	/**
+	 * Draw the foreground: The frames of the selected items and the
+	 * current item. They are drawn on top of everything here rather than
+	 * with items in the scene, so moving them around does not change the
+	 * scene.
+	 *
+	 * Reimplemented from QGraphicsView.
+	 **/
+	virtual void drawForeground( QPainter * painter, const QRectF & rect ) Q_DECL_OVERRIDE;
+
+	/**
+	 * Mouse and context menu events. With the tile renderer, the tiles
+	 * handle these; with the flat renderer, this view does it with the
+	 * same semantics.
+	 *
+	 * Reimplemented from QGraphicsView.
+	 **/
+	virtual void mousePressEvent	   ( QMouseEvent * event	) Q_DECL_OVERRIDE;
+	virtual void mouseReleaseEvent	   ( QMouseEvent * event	) Q_DECL_OVERRIDE;
+	virtual void mouseDoubleClickEvent ( QMouseEvent * event	) Q_DECL_OVERRIDE;
+	virtual void mouseMoveEvent	   ( QMouseEvent * event	) Q_DECL_OVERRIDE;
+	virtual void wheelEvent		   ( QWheelEvent * event	) Q_DECL_OVERRIDE;
+	virtual void contextMenuEvent	   ( QContextMenuEvent * event	) Q_DECL_OVERRIDE;
+
+	/**
+	 * Viewport events: Handle leaving the viewport for the hover
+	 * signals.
+	 *
+	 * Reimplemented from QGraphicsView.
+	 **/
+	virtual bool viewportEvent( QEvent * event ) Q_DECL_OVERRIDE;
+
+	/**
+	 * Render the cushions of all tiles into the cushion framebuffer:
+	 * The directory tiles are painted first in the GUI thread, then the
+	 * cushions of all leaf tiles are rendered in parallel in
+	 * _renderPool.
+	 **/
+	void renderCushions();
+
+	/**
+	 * Render the items from 'first' to 'last' (exclusive) of the flat
+	 * layout into the framebuffer on top of what is already there: Just
+	 * like renderCushions(), but from the TreemapLayout, and also
+	 * without cushion shading.
+	 **/
+	void renderFlatItems( int first, int last );
+
+	/**
+	 * Flat renderer: Start computing the layout for 'newRoot' in 'rect'
+	 * in the background. This cancels any layout that is still being
+	 * computed.
+	 **/
+	void startLayout( FileInfo * newRoot, const QRectF & rect );
+
+	/**
+	 * Flat renderer: Add and render the levels that 'result' has
+	 * finished so far.
+	 **/
+	void addLayoutLevels( TreemapLayoutResult * result );
+
+	/**
+	 * Flat renderer: Add the current layout to the layout cache if it
+	 * is complete.
+	 **/
+	void cacheLayout();
+
+	/**
+	 * Flat renderer: Try to use a cached layout for 'newRoot' in 'rect'
+	 * instead of computing a new one. Return 'true' if that worked and
+	 * the layout is complete.
+	 *
+	 * Otherwise, if 'newRoot' is in a cached layout, a rescaled copy of
+	 * it is shown as a preview while the new layout is computed.
+	 **/
+	bool reuseLayout( FileInfo * newRoot, const QRect & rect );
+
+	/**
+	 * Flat renderer: Set up a QOpenGLWidget as the viewport for
+	 * rendering with OpenGL if the "OpenGL" setting is on.
+	 **/
+	void setupOpenGL();
+
+	/**
+	 * Flat renderer: Return 'true' if the layout is rendered with
+	 * OpenGL rather than into the cushion framebuffer.
+	 **/
+	bool useOpenGL() const;
+
+	/**
+	 * Flat renderer: Draw the layout with OpenGL. Return 'false' if
+	 * OpenGL turned out not to work; then this switches back to
+	 * rendering on the CPU for good.
+	 **/
+	bool drawOpenGL( QPainter * painter );
+
+	/**
+	 * Flat renderer: Prepare updating the layout incrementally after
+	 * 'deletedChild' is deleted. Return 'false' if that is not possible
+	 * and the treemap has to be rebuilt completely.
+	 *
+	 * This removes the items of 'deletedChild' right away, and it
+	 * remembers the innermost ancestor in the layout so its children can
+	 * be laid out again in incrementalUpdate().
+	 **/
+	bool prepareIncrementalUpdate( FileInfo * deletedChild );
+
+	/**
+	 * Flat renderer: Lay out the children of all ancestors of deleted
+	 * items again and render them.
+	 **/
+	void incrementalUpdate();
+
+	/**
+	 * Flat renderer: Lay out the children of item no. 'index' again.
+	 * 'oldSize' is the total size of that item when its children were
+	 * laid out; the children only get the corresponding share of its
+	 * area, the rest is the space that was freed.
+	 **/
+	void relayoutChildren( int index, FileSize oldSize );
+
+	/**
+	 * Create the cushion render jobs for 'framebuffer'.
+	 **/
+	QList<CushionRenderJob *> createRenderJobs( QImage & framebuffer );
+
+	/**
+	 * Add a cushion with 'shading' and 'rect' to the job of 'jobs' with
+	 * the fewest pixels so far: Only to be copied if it is in the
+	 * cushion cache, otherwise to be rendered. Return 'true' if it is in
+	 * the cache.
+	 **/
+	bool addToRenderJob( QList<CushionRenderJob *> & jobs,
+			     const CushionShading      & shading,
+			     const QRect	       & rect );
+
+	/**
+	 * Run the render jobs in _renderPool, wait until they are done, and
+	 * add the cushions that they rendered into 'framebuffer' to the
+	 * cushion cache.
+	 **/
+	void runRenderJobs( QList<CushionRenderJob *> & jobs, const QImage & framebuffer );
+
+	/**
+	 * Flat renderer: Make layout item no. 'index' the current item
+	 * (-1 for none).
+	 **/
+	void setFlatCurrentItem( int index );
+
+	/**
+	 * Flat renderer: Set the layout item the mouse hovers over and send
+	 * the hover signals.
+	 **/
+	void setFlatHoverItem( int index );
+
+	/**
+	 * Flat renderer: Return the index of the layout item that would
+	 * become the new root with zoomIn() or -1 if there is none.
+	 **/
+	int flatZoomInItem() const;
+
+	/**
+	 * Flat renderer: Return the layout item at viewport position 'pos'.
+	 **/
+	int flatItemAt( const QPoint & pos ) const;
+
+	/**
+	 * Tile renderer: Return the innermost tile at viewport position
+	 * 'pos' or 0 if there is none.
+	 **/
+	TreemapTile * tileAt( const QPoint & pos ) const;
+
+	/**
+	 * Tile renderer: Set the tile the mouse hovers over and send the
+	 * hover signals.
+	 **/
+	void setHoverTile( TreemapTile * tile );
+
+	/**
+	 * Tile renderer: Draw the frames of the selected directory tiles and
+	 * of the current tile.
+	 **/
+	void drawTileHighlights( QPainter * painter, const QRectF & rect );
+
+	/**
+	 * Schedule repainting the frame around scene rectangle 'rect', but
+	 * not the tiles inside it.
+	 **/
+	void updateFrame( const QRectF & rect );
+
 
 	// Data members
 
@@ -496,8 +817,9 @@ namespace QDirStat
 	MimeCategorizer	    * _mimeCategorizer;
         DelayedRebuilder    * _rebuilder;
 	TreemapTile	    * _rootTile;
+	QHash<const FileInfo *, TreemapTile *> _tileIndex;
 	TreemapTile	    * _currentItem;
-	HighlightRect	    * _currentItemRect;
+	TreemapTile	    * _hoverTile;
 	FileInfo	    * _newRoot;
 	QString		      _savedRootUrl;
 
@@ -519,6 +841,34 @@ namespace QDirStat
         QColor _dirGradientEnd;
 	QColor _fixedColor;
 
+	QImage	    _cushionFramebuffer;
+	QThreadPool _renderPool;
+	CushionCache _cushionCache;
+	QList<CushionCacheKey> _newCushions;	// Rendered by the render jobs
+
+	bool		_flatRenderer;
+	bool		_summaryTiles;
+	bool		_useOpenGL;
+	TreemapLayout * _layout;
+	int		_flatCurrentItem;
+	int		_flatHoverItem;
+	QList<int>	_flatSelectedItems;
+
+	TreemapLayoutResult * _layoutResult;
+	QThreadPool	      _layoutPool;
+	QElapsedTimer	      _layoutTimer;
+	bool		      _layoutPreview;
+
+	QList<TreemapLayoutCacheEntry> _layoutCache;
+	QMap<FileInfo *, FileSize>     _pendingRelayouts;   // Node -> old size
+	bool			       _incrementalUpdate;
+
+#ifdef HAVE_TREEMAP_GL
+	QOpenGLWidget *	    _glViewport;
+	TreemapGLRenderer * _glRenderer;
+	bool		    _glInstancesDirty;
+#endif
+
 	int    _ambientLight;
 
 	double _lightX;
@@ -529,90 +879,6 @@ namespace QDirStat
 
     }; // class TreemapView
 
-
-
-    /**
-     * Transparent rectangle to make a treemap tile clearly visible as the
-     * current item or as selected.
-     *
-     * Leaf tiles can do that themselves, but directory tiles are typically
-     * completely obscured by their children, so no highlight border they draw
-     * themselves will ever become visible.
-     *
-     * This highlight rectangle simply draws a colored red outline on top
-     * (i.e., great z-height) of everything else. The rectangle is transparent,
-     * so the treemap tile contents remain visible.
-     **/
-    class HighlightRect: public QGraphicsRectItem
-    {
-    public:
-
-	/**
-	 * Create a highlight rectangle for the entire scene. This is most
-	 * useful for the current item.
-	 **/
-	HighlightRect( QGraphicsScene * scene, const QColor & color, int lineWidth = 2 );
-
-	/**
-	 * Create a highlight rectangle for one specific tile and highlight it
-	 * right away. This is most useful for selected items if more than one
-	 * item is selected. The z-height of this is lower than for the
-	 * scene-wide highlight rectangle.
-	 **/
-	HighlightRect( TreemapTile * tile, const QColor & color, int lineWidth = 2 );
-
-	/**
-	 * Highlight the specified treemap tile: Resize this selection
-	 * rectangle to match this tile and move it to this tile's
-	 * position. Show the selection rectangle if it is currently
-	 * invisible.
-	 **/
-	virtual void highlight( TreemapTile * tile );
-
-	/**
-	 * Set the pen style. Recommended: Qt::SolidLine or Qt::DotLine.
-	 **/
-	void setPenStyle( Qt::PenStyle style = Qt::SolidLine );
-
-	/**
-	 * Set the pen style according to the 'selected' status of 'tile'.
-	 **/
-	void setPenStyle( TreemapTile * tile );
-
-    }; // class TreemapSelectionRect
-
-
-    /**
-     * Highlighter for the treemap view's current tile.
-     * This one is shared; it moves around from tile to tile.
-     **/
-    class CurrentItemHighlighter: public HighlightRect
-    {
-    public:
-	CurrentItemHighlighter( QGraphicsScene * scene, const QColor & color, int lineWidth = 2 ):
-	    HighlightRect( scene, color, lineWidth )
-	    {}
-
-	virtual void highlight( TreemapTile * tile );
-    };
-
-
-    /**
-     * Highlighter for the treemap view's current item.
-     *
-     * This one is created on demand for each directory when the directory is
-     * selected; this cannot be done in the tile's paint() method since the
-     * tile will mostly be obscured by its children. This highlighter hovers
-     * above the children as long as the directory is selected.
-     **/
-    class SelectedItemHighlighter: public HighlightRect
-    {
-    public:
-	SelectedItemHighlighter( TreemapTile * tile, const QColor & color, int lineWidth = 2 ):
-	    HighlightRect( tile, color, lineWidth )
-	    {}
-    };
-
 }	// namespace QDirStat
 
 
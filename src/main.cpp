@@ -10,15 +10,29 @@
 #include <unistd.h>	// getuid()
 #include <sys/types.h>	// uid_t
 #include <iostream>	// cerr
+#include <string.h>	// strcmp()
 
 #include <QApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QTemporaryFile>
+#include <QElapsedTimer>
 #include "MainWindow.h"
 #include "DirTreeModel.h"
+#include "DirTree.h"
+#include "CacheScanner.h"
+#include "CacheReport.h"
+#include "ScanMetrics.h"
+#include "TreeExporter.h"
+#include "MemoryStats.h"
 #include "Logger.h"
+#include "StartupProfile.h"
 #include "Version.h"
 
 
 using std::cerr;
+using namespace QDirStat;
 static const char * progName = "qdirstat";
 static bool fatal = false;
 
@@ -28,8 +42,15 @@ void usage( const QStringList & argList )
     cerr << "\n"
 	 << "Usage: \n"
 	 << "\n"
-	 << "  " << progName << " [--slow-update|-s] [<directory-name>]\n"
-	 << "  " << progName << " --cache|-c <cache-file-name>\n"
+	 << "  " << progName << " [--slow-update|-s] [--memory-stats] [--scan-backend lstat|io_uring] [<directory-name>]\n"
+	 << "  " << progName << " --cache|-c <cache-file-name> [<subtree>]\n"
+	 << "  " << progName << " --resume|-r [<checkpoint-file-name>]\n"
+	 << "  " << progName << " --merge|-M <cache-file-name> [<cache-file-name>...]\n"
+	 << "  " << progName << " --remote|-R <[user@]host> <directory-name>\n"
+	 << "  " << progName << " [--scan-backend lstat|io_uring] --scan-to-cache <directory-name> <cache-file-name>|- [--metrics <file>.prom|.json]\n"
+	 << "  " << progName << " --estimate-memory <cache-file-name>\n"
+	 << "  " << progName << " [--scan-backend lstat|io_uring] --report <cache-file-name>|<directory-name> [--depth <n>] [--top <n>] [--json]\n"
+	 << "  " << progName << " [--scan-backend lstat|io_uring] --export <cache-file-name>|<directory-name> <file>.csv|.jsonl[.gz]|-\n"
 	 << "  " << progName << " --help|-h\n"
 	 << std::endl;
 
@@ -77,8 +98,339 @@ bool commandLineSwitch( const QString & longName,
 }
 
 
+/**
+ * Extract a command line option with one parameter from the command line
+ * and remove both from 'argList'. Return the parameter or an empty string
+ * if there is no such option. If the parameter is missing, 'ok' is set to
+ * 'false'.
+ **/
+QString commandLineOption( const QString & longName,
+			   const QString & shortName,
+			   QStringList	 & argList,
+			   bool		 & ok )
+{
+    int index = argList.indexOf( longName );
+
+    if ( index < 0 && ! shortName.isEmpty() )
+	index = argList.indexOf( shortName );
+
+    if ( index < 0 )
+	return QString();
+
+    if ( index + 1 >= argList.size() )
+    {
+	ok = false;
+	argList.removeAt( index );
+	return QString();
+    }
+
+    QString value = argList.at( index + 1 );
+    argList.removeAt( index + 1 );
+    argList.removeAt( index );
+    logDebug() << "Found " << longName << " " << value << endl;
+
+    return value;
+}
+
+
+/**
+ * Extract the --scan-backend option from the command line and remove it
+ * from 'argList'. Return 'false' if there is one, but its parameter is
+ * missing or it is not a known backend.
+ **/
+bool scanBackendOption( QStringList & argList, QString & scanBackend )
+{
+    bool ok = true;
+    scanBackend = commandLineOption( "--scan-backend", "", argList, ok );
+
+    if ( ok && ! scanBackend.isEmpty() &&
+	 scanBackend != scanBackendName( scanBackendFromName( scanBackend ) ) )
+    {
+	logError() << "Unknown scan backend " << scanBackend << endl;
+	ok = false;
+    }
+
+    return ok;
+}
+
+
+/**
+ * Set up 'scanner' for a headless scan with the settings and with
+ * 'scanBackend' if it is not empty.
+ **/
+void setupScanner( CacheScanner & scanner, const QString & scanBackend )
+{
+    scanner.readSettings();
+
+    if ( ! scanBackend.isEmpty() )
+	scanner.setScanBackend( scanBackendFromName( scanBackend ) );
+}
+
+
+/**
+ * Return 'true' if the command line asks for a headless scan that doesn't
+ * need the GUI (and thus no display).
+ **/
+bool isHeadless( int argc, char *argv[] )
+{
+    for ( int i=1; i < argc; ++i )
+    {
+	if ( strcmp( argv[i], "--scan-to-cache"	  ) == 0 ||
+	     strcmp( argv[i], "--estimate-memory" ) == 0 ||
+	     strcmp( argv[i], "--report"	  ) == 0 ||
+	     strcmp( argv[i], "--export"	  ) == 0   )
+	    return true;
+    }
+
+    return false;
+}
+
+
+/**
+ * Pre-flight check: Print how much memory reading a cache file would
+ * need, without reading it.
+ **/
+int estimateMemory( const QStringList & argList )
+{
+    if ( argList.size() != 2 )
+    {
+	usage( argList );
+	return 1;
+    }
+
+    bool ok;
+    MemoryUsage estimate = MemoryStats::estimateCache( argList.at( 1 ), ok );
+
+    if ( ! ok )
+	return 1;
+
+    std::cout << "Estimated memory for " << qPrintable( argList.at( 1 ) ) << ":\n\n"
+	      << qPrintable( MemoryStats::report( estimate ) ) << std::endl;
+
+    return 0;
+}
+
+
+/**
+ * Headless report: Print the totals, the directories down to a certain
+ * depth, the largest directories and the sizes by file type of a cache
+ * file. For a directory, it is scanned to a temporary cache file first.
+ * Neither needs a DirTree, so this runs in constant memory.
+ **/
+int report( QStringList argList, const QString & scanBackend )
+{
+    bool argsOk = true;
+    bool asJson = commandLineSwitch( "--json", "", argList );
+    QString depth = commandLineOption( "--depth", "", argList, argsOk );
+    QString top	  = commandLineOption( "--top",	  "", argList, argsOk );
+
+    CacheReport cacheReport;
+
+    if ( ! depth.isEmpty() )
+	cacheReport.setMaxDepth( depth.toInt( &argsOk ) );
+
+    if ( argsOk && ! top.isEmpty() )
+	cacheReport.setTopCount( top.toInt( &argsOk ) );
+
+    if ( ! argsOk || argList.size() != 2 || argList.first() != "--report" )
+    {
+	usage( argList );
+	return 1;
+    }
+
+    QString fileName = argList.at( 1 );
+    QTemporaryFile tempFile( QDir::tempPath() + "/qdirstat-report-XXXXXX.cache.gz" );
+
+    if ( QFileInfo( fileName ).isDir() )
+    {
+	if ( ! tempFile.open() )
+	{
+	    logError() << "Can't create a temporary cache file" << endl;
+	    return 1;
+	}
+
+	CacheScanner scanner;
+	setupScanner( scanner, scanBackend );
+
+	if ( ! scanner.scan( fileName, tempFile.fileName() ) )
+	    return 1;
+
+	fileName = tempFile.fileName();
+    }
+
+    if ( ! cacheReport.read( fileName ) )
+	return 1;
+
+    std::cout << qPrintable( asJson ? cacheReport.json() : cacheReport.text() ) << std::endl;
+
+    return 0;
+}
+
+
+/**
+ * Headless export: Convert a cache file to CSV or JSON lines. For a
+ * directory, it is scanned to a temporary cache file first. Like for
+ * --report, nothing is kept in memory.
+ **/
+int exportTree( const QStringList & argList, const QString & scanBackend )
+{
+    if ( argList.size() != 3 || argList.first() != "--export" )
+    {
+	usage( argList );
+	return 1;
+    }
+
+    QString fileName   = argList.at( 1 );
+    QString exportName = argList.at( 2 );
+    bool    formatOk;
+
+    // "-" for stdout doesn't have a suffix: Use CSV.
+
+    TreeExporter::Format format = TreeExporter::formatForName( exportName, formatOk );
+
+    if ( ! formatOk && exportName != "-" )
+    {
+	logError() << "Unknown export format for " << exportName << endl;
+	usage( argList );
+	return 1;
+    }
+
+    QTemporaryFile tempFile( QDir::tempPath() + "/qdirstat-export-XXXXXX.cache.gz" );
+
+    if ( QFileInfo( fileName ).isDir() )
+    {
+	if ( ! tempFile.open() )
+	{
+	    logError() << "Can't create a temporary cache file" << endl;
+	    return 1;
+	}
+
+	CacheScanner scanner;
+	setupScanner( scanner, scanBackend );
+
+	if ( ! scanner.scan( fileName, tempFile.fileName() ) )
+	    return 1;
+
+	fileName = tempFile.fileName();
+    }
+
+    TreeExporter exporter( format );
+
+    return exporter.exportCache( exportName, fileName ) ? 0 : 1;
+}
+
+
+/**
+ * Write the metrics of the headless scan of 'dirName' to 'metricsFile'.
+ * The totals of the directories come from reading the cache file again;
+ * the scanner doesn't keep them.
+ **/
+bool writeScanMetrics( const QString	  & metricsFile,
+		       const QString	  & dirName,
+		       const QString	  & cacheFileName,
+		       const CacheScanner & scanner,
+		       qint64		    nsec )
+{
+    ScanMetrics metrics;
+    metrics.setScan( QFileInfo( dirName ).absoluteFilePath(), nsec,
+		     scanner.dirCount() + scanner.fileCount(),
+		     scanner.errorCount() );
+
+    if ( cacheFileName != "-" )
+    {
+	CacheReport cacheReport;
+	cacheReport.setMaxDepth( 1 );
+
+	if ( cacheReport.read( cacheFileName ) )
+	{
+	    const CacheReportDir & toplevel = cacheReport.toplevel();
+	    metrics.addDir( toplevel.url, toplevel.totalSize,
+			    toplevel.totalFiles + toplevel.totalSubDirs );
+
+	    foreach ( const CacheReportDir & dir, cacheReport.dirs() )
+	    {
+		if ( dir.depth == 1 )
+		    metrics.addDir( dir.url.section( '/', -1 ), dir.totalSize,
+				    dir.totalFiles + dir.totalSubDirs );
+	    }
+	}
+
+	// The cache file is written while scanning, so writing it takes
+	// as long as the scan.
+
+	metrics.setCacheWrite( QFileInfo( cacheFileName ).size(), nsec );
+    }
+
+    return metrics.write( metricsFile );
+}
+
+
+/**
+ * Headless scan: Scan a directory and write it directly to a cache file
+ * without building a DirTree and without any GUI. The exclude rules and
+ * the "cross file systems" setting are the same as in the GUI.
+ **/
+int scanToCache( int argc, char *argv[] )
+{
+    QCoreApplication app( argc, argv );
+    QStringList argList = QCoreApplication::arguments();
+    argList.removeFirst(); // Remove program name
+
+    // Check the scan backend for all headless modes before anything else,
+    // so a typo doesn't silently fall back to the default.
+
+    QString scanBackend;
+
+    if ( ! scanBackendOption( argList, scanBackend ) )
+    {
+	usage( argList );
+	return 1;
+    }
+
+    if ( argList.indexOf( "--estimate-memory" ) == 0 )
+	return estimateMemory( argList );
+
+    if ( argList.contains( "--report" ) )
+	return report( argList, scanBackend );
+
+    if ( argList.indexOf( "--export" ) == 0 )
+	return exportTree( argList, scanBackend );
+
+    bool argsOk = true;
+    QString metricsFile = commandLineOption( "--metrics",      "", argList, argsOk );
+    int index = argList.indexOf( "--scan-to-cache" );
+
+    if ( ! argsOk || index != 0 || argList.size() != 3 )
+    {
+	usage( argList );
+	return 1;
+    }
+
+    QString dirName	  = argList.at( 1 );
+    QString cacheFileName = argList.at( 2 );
+
+    CacheScanner scanner;
+    setupScanner( scanner, scanBackend );
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if ( ! scanner.scan( dirName, cacheFileName ) )
+	return 1;
+
+    if ( ! metricsFile.isEmpty() &&
+	 ! writeScanMetrics( metricsFile, dirName, cacheFileName, scanner, timer.nsecsElapsed() ) )
+    {
+	return 1;
+    }
+
+    return 0;
+}
+
+
 int main( int argc, char *argv[] )
 {
+    StartupProfile::start();
     Logger logger( "/tmp/qdirstat-$USER", "qdirstat.log" );
     logVersion();
 
@@ -86,17 +438,33 @@ int main( int argc, char *argv[] )
     QCoreApplication::setOrganizationName( "QDirStat" );
     QCoreApplication::setApplicationName ( "QDirStat" );
 
+    if ( isHeadless( argc, argv ) )
+	return scanToCache( argc, argv );
+
     QApplication app( argc, argv);
     QStringList argList = QCoreApplication::arguments();
     argList.removeFirst(); // Remove program name
+    StartupProfile::milestone( "QApplication" );
 
     MainWindow mainWin;
     mainWin.show();
+    StartupProfile::milestone( "Main window shown" );
 
     if ( commandLineSwitch( "--slow-update", "-s", argList ) )
 	mainWin.dirTreeModel()->setSlowUpdate();
 
-    if ( argList.isEmpty() )
+    if ( commandLineSwitch( "--memory-stats", "", argList ) )
+	mainWin.setLogMemoryUsage( true );
+
+    QString scanBackend;
+    bool argsOk = scanBackendOption( argList, scanBackend );
+
+    if ( argsOk && ! scanBackend.isEmpty() )
+	mainWin.dirTreeModel()->tree()->setScanBackend( scanBackendFromName( scanBackend ) );
+
+    if ( ! argsOk )
+	usage( argList );
+    else if ( argList.isEmpty() )
 	mainWin.askOpenUrl();
     else
     {
@@ -104,15 +472,51 @@ int main( int argc, char *argv[] )
 
 	if ( arg == "--cache" || arg == "-c" )
 	{
-	    if ( argList.size() == 2 )
+	    if ( argList.size() == 2 || argList.size() == 3 )
 	    {
 		QString cacheFileName = argList.at(1);
+		QString subtree	      = argList.size() == 3 ? argList.at(2) : QString();
 		logDebug() << "Reading cache file " << cacheFileName << endl;
-		mainWin.readCache( cacheFileName );
+		mainWin.readCache( cacheFileName, subtree );
+	    }
+	    else
+		usage( argList );
+	}
+	else if ( arg == "--resume" || arg == "-r" )
+	{
+	    if ( argList.size() <= 2 )
+	    {
+		QString checkpointFile = argList.size() == 2 ?
+		    argList.at(1) : mainWin.dirTreeModel()->tree()->checkpointFile();
+
+		if ( QFile::exists( checkpointFile ) )
+		{
+		    logInfo() << "Resuming from checkpoint " << checkpointFile << endl;
+		    mainWin.readCache( checkpointFile );
+		}
+		else
+		{
+		    logError() << "No checkpoint " << checkpointFile << endl;
+		    mainWin.askOpenUrl();
+		}
 	    }
 	    else
 		usage( argList );
 	}
+	else if ( arg == "--merge" || arg == "-M" )
+	{
+	    if ( argList.size() >= 2 )
+		mainWin.mergeCaches( argList.mid( 1 ) );
+	    else
+		usage( argList );
+	}
+	else if ( arg == "--remote" || arg == "-R" )
+	{
+	    if ( argList.size() == 3 )
+		mainWin.readRemote( argList.at(1), argList.at(2) );
+	    else
+		usage( argList );
+	}
 	else if ( arg == "--help" || arg == "-h" )
 	    usage( argList );
 	else if ( arg.startsWith( "-" ) || argList.size() > 1 )
@@ -18,6 +18,18 @@ MOC_DIR		 = .moc
 OBJECTS_DIR	 = .obj
 LIBS		+= -lz
 
+# Use io_uring for batched statx() calls if the kernel headers have it
+exists( /usr/include/linux/io_uring.h ):DEFINES += HAVE_IO_URING
+
+# Optional zstd compression of cache files
+exists( /usr/include/zstd.h ) {
+    DEFINES += HAVE_ZSTD
+    LIBS    += -lzstd
+}
+
+# Optional OpenGL rendering of the flat treemap; this needs Qt 5.6 or later
+equals(QT_MAJOR_VERSION, 5):greaterThan(QT_MINOR_VERSION, 5):contains(QT_CONFIG, opengl):DEFINES += HAVE_TREEMAP_GL
+
 major_is_less_5 = $$find(QT_MAJOR_VERSION, [234])
 !isEmpty(major_is_less_5):DEFINES += 'Q_DECL_OVERRIDE=""'
 
@@ -28,111 +40,213 @@ INSTALLS	+= TARGET desktop icons
 
 SOURCES	  = main.cpp			\
 	    ActionManager.cpp		\
+	    BinaryCache.cpp		\
             BucketsTableModel.cpp       \
+	    CacheBudget.cpp		\
+	    CacheDiff.cpp		\
+	    CacheReport.cpp		\
+	    CacheScanner.cpp		\
+	    CacheSnapshot.cpp		\
+	    CacheStream.cpp		\
+	    ChildColumns.cpp		\
 	    Cleanup.cpp			\
 	    CleanupCollection.cpp	\
 	    CleanupConfigPage.cpp	\
+	    ColdSubtree.cpp		\
+	    CompactName.cpp		\
 	    ConfigDialog.cpp		\
+	    CushionCache.cpp		\
+	    CushionKernel.cpp		\
 	    DataColumns.cpp		\
 	    DebugHelpers.cpp		\
             DelayedRebuilder.cpp        \
+	    DeleteJob.cpp		\
 	    DirInfo.cpp			\
 	    DirReadJob.cpp		\
+	    DirReadTimes.cpp		\
+	    DirReadWorker.cpp		\
 	    DirSaver.cpp		\
 	    DirTree.cpp			\
 	    DirTreeCache.cpp		\
 	    DirTreeModel.cpp		\
 	    DirTreeView.cpp		\
+	    DirTreeWatcher.cpp		\
+	    DirentReader.cpp		\
+	    DuplicateFinder.cpp		\
+	    DuplicatesWindow.cpp	\
 	    Exception.cpp		\
 	    ExcludeRulesConfigPage.cpp	\
 	    ExcludeRules.cpp		\
+	    ExtentStats.cpp		\
 	    FileInfo.cpp		\
 	    FileInfoIterator.cpp	\
 	    FileInfoSet.cpp		\
 	    FileInfoSorter.cpp		\
+	    FileQuery.cpp		\
+	    FileAgeStats.cpp		\
+	    FileAgeStatsWindow.cpp	\
+	    FileSizeSketch.cpp		\
 	    FileSizeStats.cpp		\
 	    FileSizeStatsWindow.cpp	\
 	    FileTypeStats.cpp		\
 	    FileTypeStatsWindow.cpp	\
+	    FindFilesWindow.cpp		\
 	    HeaderTweaker.cpp		\
 	    HistogramView.cpp		\
 	    HistogramDraw.cpp	        \
 	    HistogramItems.cpp	        \
             HistogramOverflowPanel.cpp  \
+	    InodeSet.cpp		\
+	    IoUringStat.cpp		\
+	    LargestFiles.cpp		\
+	    LargestFilesWindow.cpp	\
 	    ListEditor.cpp		\
 	    LocateFilesWindow.cpp	\
+	    LogBuffer.cpp		\
 	    Logger.cpp			\
 	    MainWindow.cpp		\
+	    MemoryStats.cpp		\
 	    MimeCategorizer.cpp		\
 	    MimeCategory.cpp		\
 	    MimeCategoryConfigPage.cpp	\
 	    MountPoints.cpp		\
+	    NameIndex.cpp		\
+	    NodePool.cpp		\
 	    OutputWindow.cpp		\
+	    OwnerStatsWindow.cpp	\
+	    OwnerTotals.cpp		\
 	    PercentBar.cpp		\
+	    PrecomputedStats.cpp	\
 	    Process.cpp			\
+	    QueryWindow.cpp		\
+	    QuotaEstimates.cpp		\
 	    Refresher.cpp		\
+	    ScanMetrics.cpp		\
+	    ScanProgress.cpp		\
+	    ScanStats.cpp		\
+	    ScanStatsWindow.cpp		\
+	    ScanThrottle.cpp		\
 	    SelectionModel.cpp		\
 	    Settings.cpp		\
 	    SettingsHelpers.cpp		\
+	    Squarifier.cpp		\
+	    StartupProfile.cpp		\
+	    Statx.cpp			\
 	    StdCleanup.cpp		\
             Subtree.cpp                 \
+	    SuffixIndex.cpp		\
 	    Trash.cpp			\
+	    TreeExporter.cpp		\
+	    TreeSnapshot.cpp		\
+	    TreemapGLRenderer.cpp	\
+	    TreemapLayout.cpp		\
 	    TreemapTile.cpp		\
 	    TreemapView.cpp		\
 
 
 HEADERS	  =				\
 	    ActionManager.h		\
+	    BinaryCache.h		\
             BucketsTableModel.h         \
+	    CacheBudget.h		\
+	    CacheDiff.h			\
+	    CacheReport.h		\
+	    CacheScanner.h		\
+	    CacheSnapshot.h		\
+	    CacheStream.h		\
+	    ChildColumns.h		\
 	    Cleanup.h			\
 	    CleanupCollection.h		\
 	    CleanupConfigPage.h		\
+	    ColdSubtree.h		\
+	    CompactName.h		\
 	    ConfigDialog.h		\
+	    CushionCache.h		\
+	    CushionKernel.h		\
 	    DataColumns.h		\
 	    DebugHelpers.h		\
             DelayedRebuilder.h          \
+	    DeleteJob.h			\
 	    DirInfo.h			\
 	    DirReadJob.h		\
+	    DirReadTimes.h		\
+	    DirReadWorker.h		\
 	    DirSaver.h			\
 	    DirTree.h			\
 	    DirTreeCache.h		\
 	    DirTreeModel.h		\
 	    DirTreeView.h		\
+	    DirTreeWatcher.h		\
+	    DirentReader.h		\
+	    DuplicateFinder.h		\
+	    DuplicatesWindow.h		\
 	    Exception.h			\
 	    ExcludeRules.h		\
 	    ExcludeRulesConfigPage.h	\
+	    ExtentStats.h		\
 	    FileInfo.h			\
 	    FileInfoIterator.h		\
 	    FileInfoSet.h		\
 	    FileInfoSorter.h		\
+	    FileQuery.h			\
+	    FileAgeStats.h		\
+	    FileAgeStatsWindow.h	\
+	    FileSizeSketch.h		\
 	    FileSizeStats.h		\
 	    FileSizeStatsWindow.h	\
 	    FileTypeStats.h		\
 	    FileTypeStatsWindow.h	\
+	    FindFilesWindow.h		\
 	    HeaderTweaker.h		\
 	    HistogramView.h		\
 	    HistogramItems.h		\
+	    InodeSet.h			\
+	    IoUringStat.h		\
+	    LargestFiles.h		\
+	    LargestFilesWindow.h	\
 	    ListEditor.h		\
 	    ListMover.h			\
 	    LocateFilesWindow.h		\
+	    LogBuffer.h			\
 	    Logger.h			\
 	    MainWindow.h		\
+	    MemoryStats.h		\
 	    MimeCategorizer.h		\
 	    MimeCategory.h		\
 	    MimeCategoryConfigPage.h	\
 	    MountPoints.h		\
+	    NameIndex.h			\
+	    NodePool.h			\
 	    OutputWindow.h		\
+	    OwnerStatsWindow.h		\
+	    OwnerTotals.h		\
 	    PercentBar.h		\
+	    PrecomputedStats.h		\
 	    Process.h			\
             Qt4Compat.h                 \
+	    QueryWindow.h		\
+	    QuotaEstimates.h		\
 	    Refresher.h			\
+	    ScanMetrics.h		\
+	    ScanProgress.h		\
+	    ScanStats.h			\
+	    ScanStatsWindow.h		\
+	    ScanThrottle.h		\
 	    SelectionModel.h		\
 	    Settings.h			\
 	    SettingsHelpers.h		\
 	    SignalBlocker.h		\
+	    Squarifier.h		\
+	    StartupProfile.h		\
+	    Statx.h			\
 	    StdCleanup.h		\
             Subtree.h                   \
+	    SuffixIndex.h		\
 	    Trash.h			\
+	    TreeExporter.h		\
+	    TreeSnapshot.h		\
+	    TreemapGLRenderer.h		\
+	    TreemapLayout.h		\
 	    TreemapTile.h		\
 	    TreemapView.h		\
 	    Version.h			\
@@ -145,9 +259,16 @@ FORMS	  = main-window.ui		   \
 	    cleanup-config-page.ui	   \
 	    mime-category-config-page.ui   \
 	    exclude-rules-config-page.ui   \
+	    duplicates-window.ui	   \
+	    file-age-stats-window.ui	   \
 	    file-size-stats-window.ui	   \
 	    file-type-stats-window.ui	   \
-	    locate-files-window.ui
+	    find-files-window.ui		   \
+	    largest-files-window.ui	   \
+	    locate-files-window.ui	   \
+	    owner-stats-window.ui	   \
+	    query-window.ui		   \
+	    scan-stats-window.ui
 
 #	    general-config-page.ui
 